@@ -20,7 +20,10 @@ SOURCES += subsurface-mobile-main.cpp \
 	commands/command_event.cpp \
 	commands/command_filter.cpp \
 	commands/command_pictures.cpp \
+	core/binarylog.cpp \
+	core/changejournal.cpp \
 	core/cloudstorage.cpp \
+	core/cloudsync.cpp \
 	core/configuredivecomputerthreads.cpp \
 	core/devicedetails.cpp \
 	core/downloadfromdcthread.cpp \
@@ -47,6 +50,8 @@ SOURCES += subsurface-mobile-main.cpp \
 	core/subsurface-string.cpp \
 	core/pref.cpp \
 	core/profile.cpp \
+	core/profilesignature.cpp \
+	core/progressreporter.cpp \
 	core/device.cpp \
 	core/dive.cpp \
 	core/divecomputer.cpp \
@@ -58,16 +63,20 @@ SOURCES += subsurface-mobile-main.cpp \
 	core/filterpresettable.cpp \
 	core/divelist.cpp \
 	core/divelog.cpp \
+	core/divelogsnapshot.cpp \
 	core/gas-model.cpp \
 	core/gaspressures.cpp \
 	core/git-access.cpp \
 	core/globals.cpp \
 	core/liquivision.cpp \
 	core/load-git.cpp \
+	core/mappedfile.cpp \
 	core/parse-xml.cpp \
 	core/parse.cpp \
+	core/perfcounters.cpp \
 	core/picture.cpp \
 	core/sample.cpp \
+	core/samplecodec.cpp \
 	core/import-suunto.cpp \
 	core/import-shearwater.cpp \
 	core/import-seac.cpp \
@@ -87,16 +96,21 @@ SOURCES += subsurface-mobile-main.cpp \
 	core/cochran.cpp \
 	core/deco.cpp \
 	core/divesite.cpp \
+	core/divesiteindex.cpp \
 	core/equipment.cpp \
 	core/gas.cpp \
 	core/membuffer.cpp \
+	core/memoryusage.cpp \
+	core/messagering.cpp \
 	core/selection.cpp \
 	core/sha1.cpp \
 	core/string-format.cpp \
 	core/strtod.cpp \
+	core/summarycache.cpp \
 	core/tag.cpp \
 	core/taxonomy.cpp \
 	core/time.cpp \
+	core/trace.cpp \
 	core/trip.cpp \
 	core/triptable.cpp \
 	core/units.cpp \
@@ -106,6 +120,7 @@ SOURCES += subsurface-mobile-main.cpp \
 	core/qt-ble.cpp \
 	core/uploadDiveShare.cpp \
 	core/uploadDiveLogsDE.cpp \
+	core/zipwriter.cpp \
 	core/save-profiledata.cpp \
 	core/xmlparams.cpp \
 	core/settings/qPref.cpp \
@@ -146,6 +161,7 @@ SOURCES += subsurface-mobile-main.cpp \
 	stats/statscolors.cpp \
 	stats/statsgrid.cpp \
 	stats/statshelper.cpp \
+	stats/statsquery.cpp \
 	stats/statsselection.cpp \
 	stats/statsseries.cpp \
 	stats/statsstate.cpp \
@@ -197,7 +213,10 @@ HEADERS += \
 	commands/command_pictures.h \
 	core/interpolate.h \
 	core/libdivecomputer.h \
+	core/binarylog.h \
+	core/changejournal.h \
 	core/cloudstorage.h \
+	core/cloudsync.h \
 	core/configuredivecomputerthreads.h \
 	core/device.h \
 	core/devicedetails.h \
@@ -210,15 +229,19 @@ HEADERS += \
 	core/globals.h \
 	core/pref.h \
 	core/profile.h \
+	core/profilesignature.h \
+	core/progressreporter.h \
 	core/qthelper.h \
 	core/range.h \
 	core/save-html.h \
 	core/statistics.h \
 	core/units.h \
 	core/version.h \
+	core/perfcounters.h \
 	core/picture.h \
 	core/planner.h \
 	core/divesite.h \
+	core/divesiteindex.h \
 	core/divesitetable.h \
 	core/checkcloudconnection.h \
 	core/cochran.h \
@@ -232,6 +255,7 @@ HEADERS += \
 	core/filterpresettable.h \
 	core/divelist.h \
 	core/divelog.h \
+	core/divelogsnapshot.h \
 	core/divelogexportlogic.h \
 	core/divesitehelpers.h \
 	core/exif.h \
@@ -240,16 +264,22 @@ HEADERS += \
 	core/gaspressures.h \
 	core/gettext.h \
 	core/gettextfromc.h \
+	core/mappedfile.h \
 	core/membuffer.h \
+	core/memoryusage.h \
+	core/messagering.h \
 	core/metrics.h \
 	core/qt-gui.h \
 	core/sample.h \
+	core/samplecodec.h \
 	core/selection.h \
 	core/sha1.h \
 	core/string-format.h \
 	core/subsurfacestartup.h \
 	core/subsurfacesysinfo.h \
+	core/summarycache.h \
 	core/taxonomy.h \
+	core/trace.h \
 	core/trip.h \
 	core/triptable.h \
 	core/uemis.h \
@@ -264,6 +294,7 @@ HEADERS += \
 	core/save-profiledata.h \
 	core/uploadDiveShare.h \
 	core/uploadDiveLogsDE.h \
+	core/zipwriter.h \
 	core/xmlparams.h \
 	core/settings/qPref.h \
 	core/settings/qPrefCloudStorage.h \
@@ -301,6 +332,7 @@ HEADERS += \
 	stats/statscolors.h \
 	stats/statsgrid.h \
 	stats/statshelper.h \
+	stats/statsquery.h \
 	stats/statsselection.h \
 	stats/statsseries.h \
 	stats/statsstate.h \
@@ -381,7 +413,8 @@ android {
 		../install-root-$${QT_ARCH}/lib/libsqlite3.a \
 		../install-root-$${QT_ARCH}/lib/libssl_1_1.so \
 		../install-root-$${QT_ARCH}/lib/libcrypto_1_1.so \
-		../googlemaps-build/libplugins_geoservices_qtgeoservices_googlemaps_$${QT_ARCH}.so
+		../googlemaps-build/libplugins_geoservices_qtgeoservices_googlemaps_$${QT_ARCH}.so \
+		-lz
 
 	# ensure that the openssl libraries are bundled into the app
 	# for some reason doing so with dollar dollar { QT_ARCH } (like what works
@@ -431,7 +464,8 @@ ios {
 		../googlemaps-build/libqtgeoservices_googlemaps.a \
 		-liconv \
 		-lsqlite3 \
-		-lxml2
+		-lxml2 \
+		-lz
 
 	LIBS += -framework MessageUI
 
@@ -252,40 +252,19 @@ public class AndroidSerial {
 	}
 
 	/* length of read data, or dc_status_t if not successful */
-	public int read(byte[] data)
+	/* Returns what is available after waiting at most timeout ms, which is
+	 * up to one bulk transfer. The caller keeps what it didn't ask for. */
+	public int read(byte[] data, int timeout)
 	{
-		Log.d(TAG, "in " + Thread.currentThread().getStackTrace()[2].getMethodName());
-
 		try {
-
-			Log.d(TAG, "read length: " + data.length);
-
-			int toReadFromHwLength = data.length - readBuffer.size();
-			int arraylength = (toReadFromHwLength % 64) != 0 ? toReadFromHwLength + (64 - (toReadFromHwLength % 64)): toReadFromHwLength; // use blocks of 64 for reading
-
-			long startTime =  (new Date()).getTime();
-
-			// while we don't have enough in the buffer, try to read from HW until there is enough or timeout is reached.
-			while (toReadFromHwLength > 0 && (startTime + timeout > (new Date()).getTime() || timeout == 0)) {
-				// Read and append to buffer
-				byte[] readFromHwData = new byte[arraylength];
-				int actuallyReadFromHwLength = usbSerialPort.read(readFromHwData, 0); // This behaves differently on different chipsets. CP210x blocks, FTDI seems to return instantly.
-				for (int i = 0; i < actuallyReadFromHwLength; i++ ) {
-					readBuffer.add(readFromHwData[i]);
-				}
-				toReadFromHwLength = data.length - readBuffer.size();
-				arraylength = (toReadFromHwLength % 64) != 0 ? toReadFromHwLength + (64 - (toReadFromHwLength % 64)): toReadFromHwLength; // use blocks of 64 for reading
+			// filled by get_available(), should that ever work
+			if (!readBuffer.isEmpty()) {
+				int returnLength = 0;
+				while (returnLength < data.length && !readBuffer.isEmpty())
+					data[returnLength++] = readBuffer.remove();
+				return returnLength;
 			}
-
-			//Log.d(TAG, "read buffer: " + printQueue(readBuffer));
-			int returnLength = 0;
-			for (returnLength = 0; returnLength < data.length; returnLength++) {
-				if (readBuffer.isEmpty()) break;
-				data[returnLength] = readBuffer.remove();
-			}
-
-			Log.d(TAG, "return length: " + returnLength);
-			return returnLength;
+			return usbSerialPort.read(data, Math.max(timeout, 1));
 		} catch (Exception e) {
 			Log.e(TAG, "Error in " + Thread.currentThread().getStackTrace()[2].getMethodName(), e);
 			return AndroidSerial.DC_STATUS_IO;
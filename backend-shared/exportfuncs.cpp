@@ -13,6 +13,7 @@
 #include "core/divesite.h"
 #include "core/picture.h"
 #include "core/pref.h"
+#include "core/profile.h"
 #include "core/range.h"
 #include "core/sample.h"
 #include "core/selection.h"
@@ -21,7 +22,10 @@
 #include "profile-widget/profilescene.h"
 #include <QDir>
 #include <QFileInfo>
+#include <QThread>
 #include <QtConcurrent>
+#include <algorithm>
+#include <deque>
 #include <memory>
 
 // Default implementation of the export callback: do nothing / never cancel
@@ -41,13 +45,15 @@ static constexpr int profileScale = 4;
 static constexpr int profileWidth = 800 * profileScale;
 static constexpr int profileHeight = 600 * profileScale;
 
-static void exportProfile(ProfileScene &profile, const struct dive &dive, const QString &filename)
+static constexpr size_t profileBatchSize = 64;
+
+static QImage renderProfile(ProfileScene &profile, const struct dive &dive, const struct plot_info *pi)
 {
 	QImage image = QImage(QSize(profileWidth, profileHeight), QImage::Format_RGB32);
 	QPainter paint;
 	paint.begin(&image);
-	profile.draw(&paint, QRect(0, 0, profileWidth, profileHeight), &dive, 0, nullptr, false);
-	image.save(filename);
+	profile.draw(&paint, QRect(0, 0, profileWidth, profileHeight), &dive, 0, nullptr, false, pi);
+	return image;
 }
 
 static std::unique_ptr<ProfileScene> getPrintProfile()
@@ -55,6 +61,40 @@ static std::unique_ptr<ProfileScene> getPrintProfile()
 	return std::make_unique<ProfileScene>((double)profileScale, true, false);
 }
 
+// Export the profiles of the given dives into the given files. The scene
+// uses pixmaps and therefore must stay on the UI thread. However, the
+// plot infos are calculated in batches on the thread pool, and the images
+// are encoded and written by the thread pool while the next profile is
+// drawn. To bound the memory use, only a few images are in flight.
+static void exportProfiles(const std::vector<std::pair<const dive *, QString>> &profiles, ExportCallback &cb)
+{
+	auto profile = getPrintProfile();
+	size_t maxPending = std::max(QThread::idealThreadCount(), 1);
+	std::deque<QFuture<bool>> pending;
+	std::vector<plot_info> plotInfos;
+
+	for (size_t i = 0; i < profiles.size(); ++i) {
+		if (cb.canceled())
+			break;
+		cb.setProgress((int)(i * 1000 / profiles.size()));
+		if (i % profileBatchSize == 0) {
+			std::vector<const dive *> batch;
+			for (size_t j = i; j < std::min(i + profileBatchSize, profiles.size()); ++j)
+				batch.push_back(profiles[j].first);
+			plotInfos = create_plot_infos(batch);
+		}
+		QImage image = renderProfile(*profile, *profiles[i].first, &plotInfos[i % profileBatchSize]);
+		if (pending.size() >= maxPending) {
+			pending.front().waitForFinished();
+			pending.pop_front();
+		}
+		pending.push_back(QtConcurrent::run([image = std::move(image), filename = profiles[i].second]()
+				  { return image.save(filename); }));
+	}
+	for (QFuture<bool> &f: pending)
+		f.waitForFinished();
+}
+
 void exportProfile(QString filename, bool selected_only, ExportCallback &cb)
 {
 	int count = 0;
@@ -62,20 +102,16 @@ void exportProfile(QString filename, bool selected_only, ExportCallback &cb)
 		filename = filename.append(".png");
 	QFileInfo fi(filename);
 
-	int todo = selected_only ? amount_selected : static_cast<int>(divelog.dives.size());
-	int done = 0;
-	auto profile = getPrintProfile();
+	std::vector<std::pair<const dive *, QString>> profiles;
 	for (auto &dive: divelog.dives) {
-		if (cb.canceled())
-			return;
 		if (selected_only && !dive->selected)
 			continue;
-		cb.setProgress(done++ * 1000 / todo);
 		QString fn = count ? fi.path() + QDir::separator() + fi.completeBaseName().append(QString("-%1.").arg(count)) + fi.suffix()
 				   : filename;
-		exportProfile(*profile, *dive, fn);
+		profiles.emplace_back(dive.get(), fn);
 		++count;
 	}
+	exportProfiles(profiles, cb);
 }
 
 void export_TeX(const char *filename, bool selected_only, bool plain, ExportCallback &cb)
@@ -129,16 +165,19 @@ void export_TeX(const char *filename, bool selected_only, bool plain, ExportCall
 
 	put_format(&buf, "\n%%%%%%%%%% Begin Dive Data: %%%%%%%%%%\n");
 
-	int todo = selected_only ? amount_selected : static_cast<int>(divelog.dives.size());
-	int done = 0;
-	auto profile = getPrintProfile();
+	// The profiles are by far the most expensive part. Export them first.
+	std::vector<std::pair<const dive *, QString>> profiles;
+	for (auto &dive: divelog.dives) {
+		if (!selected_only || dive->selected)
+			profiles.emplace_back(dive.get(), texdir.filePath(QString("profile%1.png").arg(dive->number)));
+	}
+	exportProfiles(profiles, cb);
+
 	for (auto &dive: divelog.dives) {
 		if (cb.canceled())
 			return;
 		if (selected_only && !dive->selected)
 			continue;
-		cb.setProgress(done++ * 1000 / todo);
-		exportProfile(*profile, *dive, texdir.filePath(QString("profile%1.png").arg(dive->number)));
 		struct tm tm;
 		utc_mkdate(dive->when, &tm);
 
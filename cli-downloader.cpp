@@ -1,15 +1,16 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "qt-models/diveimportedmodel.h"
+#include "commands/command.h"
+#include "core/device.h"
+#include "core/divesite.h"
+#include "core/format.h"
 
-void cliDownloader(const std::string &vendor, const std::string &product, const std::string &device)
-{
-	DiveImportedModel diveImportedModel;
-	DiveImportedModel::connect(&diveImportedModel, &DiveImportedModel::downloadFinished, [] {
-		// do something useful at the end of the download
-		printf("Finished\n");
-	});
+#include <QFile>
+#include <QtConcurrent>
+#include <iterator>
 
-	auto data = diveImportedModel.thread.data();
+static void setDevice(DCDeviceData *data, const std::string &vendor, const std::string &product, const std::string &device)
+{
 	data->setVendor(QString::fromStdString(vendor));
 	data->setProduct(QString::fromStdString(product));
 	data->setBluetoothMode(false);
@@ -24,6 +25,18 @@ void cliDownloader(const std::string &vendor, const std::string &product, const
 	} else {
 		data->setDevName(QString::fromStdString(device));
 	}
+}
+
+void cliDownloader(const std::string &vendor, const std::string &product, const std::string &device)
+{
+	DiveImportedModel diveImportedModel;
+	DiveImportedModel::connect(&diveImportedModel, &DiveImportedModel::downloadFinished, [] {
+		// do something useful at the end of the download
+		printf("Finished\n");
+	});
+
+	auto data = diveImportedModel.thread.data();
+	setDevice(data, vendor, product, device);
 
 	// some assumptions - should all be configurable
 	data->setForceDownload(false);
@@ -35,3 +48,103 @@ void cliDownloader(const std::string &vendor, const std::string &product, const
 	diveImportedModel.waitForDownload();
 	diveImportedModel.recordDives();
 }
+
+struct batch_download {
+	std::string vendor, product, device;
+	DCDeviceData data;	// not the global instance, which is for the single download
+	struct divelog log;
+	std::string error;
+};
+
+static void batchDownload(batch_download &dl)
+{
+	device_data_t *internalData = dl.data.internalData();
+	std::string error = download_from_dc(internalData);
+	if (!error.empty())
+		dl.error = format_string_std(error.c_str(), internalData->devname.c_str(),
+					     internalData->vendor.c_str(), internalData->product.c_str());
+}
+
+// Download from all dive computers listed in the given file in parallel,
+// one "vendor;product;device" per line, and import all dives in one go.
+void cliBatchDownloader(const std::string &filename)
+{
+	QFile file(QString::fromStdString(filename));
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		fprintf(stderr, "Cannot open list of dive computers %s\n", filename.c_str());
+		return;
+	}
+	std::vector<std::unique_ptr<batch_download>> downloads;
+	while (!file.atEnd()) {
+		QString line = QString::fromUtf8(file.readLine()).trimmed();
+		if (line.isEmpty() || line.startsWith('#'))
+			continue;
+		QStringList fields = line.split(';');
+		if (fields.size() != 3) {
+			fprintf(stderr, "Ignoring malformed dive computer \"%s\"\n", qPrintable(line));
+			continue;
+		}
+		auto dl = std::make_unique<batch_download>();
+		dl->vendor = fields[0].trimmed().toStdString();
+		dl->product = fields[1].trimmed().toStdString();
+		dl->device = fields[2].trimmed().toStdString();
+		setDevice(&dl->data, dl->vendor, dl->product, dl->device);
+		dl->data.setForceDownload(false);
+		// All downloads would write to the same libdivecomputer logfile
+		dl->data.setSaveLog(false);
+		dl->data.setSaveDump(false);
+		dl->data.setSyncTime(false);
+		device_data_t *internalData = dl->data.internalData();
+		internalData->descriptor = descriptorLookup.value(dl->data.vendor().toLower() + dl->data.product().toLower());
+		internalData->log = &dl->log;
+		if (!internalData->descriptor) {
+			fprintf(stderr, "Unknown dive computer %s %s\n", dl->vendor.c_str(), dl->product.c_str());
+			continue;
+		}
+		downloads.push_back(std::move(dl));
+	}
+	if (downloads.empty())
+		return;
+
+	// One thread per dive computer. The Uemis downloader keeps its state
+	// in globals, therefore those are downloaded one after the other.
+	import_thread_cancelled = false;
+	QThreadPool pool;
+	pool.setMaxThreadCount((int)downloads.size());
+	std::vector<QFuture<void>> futures;
+	std::vector<batch_download *> uemis;
+	for (auto &dl: downloads) {
+		if (dl->vendor == "Uemis")
+			uemis.push_back(dl.get());
+		else
+			futures.push_back(QtConcurrent::run(&pool, [d = dl.get()]() { batchDownload(*d); }));
+	}
+	if (!uemis.empty()) {
+		futures.push_back(QtConcurrent::run(&pool, [uemis]() {
+			for (batch_download *d: uemis)
+				batchDownload(*d);
+		}));
+	}
+	for (QFuture<void> &future: futures)
+		future.waitForFinished();
+
+	struct divelog log;
+	for (auto &dl: downloads) {
+		printf("%s %s (%s): %d dives %s\n", dl->vendor.c_str(), dl->product.c_str(), dl->device.c_str(),
+		       (int)dl->log.dives.size(), dl->error.c_str());
+		for (auto &d: dl->log.dives)
+			log.dives.put(std::move(d));
+		dl->log.dives.clear();
+		for (auto &ds: dl->log.sites)
+			log.sites.register_site(std::move(ds));
+		dl->log.sites.clear();
+		log.devices.insert(log.devices.end(), std::make_move_iterator(dl->log.devices.begin()),
+				   std::make_move_iterator(dl->log.devices.end()));
+		dl->log.devices.clear();
+	}
+
+	// A single import, so that the dive list is processed only once.
+	if (!log.dives.empty())
+		Command::importDives(&log, import_flags::prefer_imported | import_flags::is_downloaded, QString::fromStdString(filename));
+	printf("Finished\n");
+}
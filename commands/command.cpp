@@ -88,6 +88,11 @@ void deleteDiveComputer(dive *d, int dc_num)
 	execute(new DeleteDiveComputer(d, dc_num));
 }
 
+void reparseDives(const QVector<dive *> &dives)
+{
+	execute(new ReparseDives(dives));
+}
+
 void mergeDives(const QVector <dive *> &dives)
 {
 	execute(new MergeDives(dives));
@@ -30,10 +30,13 @@ void init();				// Setup signals to inform frontend of clean status.
 void clear();				// Reset the undo stack. Delete all commands.
 void setClean();			// Call after save - this marks a state where no changes need to be saved.
 bool isClean();				// Any changes need to be saved?
+void undo();				// Undo the last command.
+void redo();				// Redo the last undone command.
 QAction *undoAction(QObject *parent);	// Create an undo action.
 QAction *redoAction(QObject *parent);	// Create a redo action.
 QString changesMade();			// Return a string with the texts from all commands on the undo stack -> for commit message.
 bool placingCommand();			// Currently executing a new command -> might not have to update the field the user just edited.
+void setUndoMemoryLimit(size_t bytes);	// Discard the oldest commands when their undo data take more memory. 0: no limit (default).
 
 // 2) Dive-list related commands
 
@@ -56,6 +59,7 @@ void splitDives(dive *d, duration_t time);
 void splitDiveComputer(dive *d, int dc_num);
 void moveDiveComputerToFront(dive *d, int dc_num);
 void deleteDiveComputer(dive *d, int dc_num);
+void reparseDives(const QVector<dive *> &dives); // Only dives whose raw data was kept are changed.
 void mergeDives(const QVector <dive *> &dives);
 void applyGPSFixes(const std::vector<DiveAndLocation> &fixes);
 
@@ -3,14 +3,28 @@
 #include "command.h"
 #include "command_base.h"
 #include "core/divelog.h"
+#include "core/event.h"
 #include "core/globals.h"
+#include "core/perfcounters.h"
 #include "core/qthelper.h" // for updateWindowTitle()
+#include "core/sample.h"
 #include "core/subsurface-qt/divelistnotifier.h"
 #include <QVector>
 
 namespace Command {
 
 static QUndoStack *undoStack;
+static size_t undoMemoryLimit = 0;
+static perf_gauge undoStackSize("undo stack size", [] { return undoStack ? (int64_t)undoStack->count() : 0; });
+
+// While a command is executed, undone or redone, the changed dives are collected
+// and the frontend is notified once at the end (see DiveListNotifier::notifyDivesChanged()).
+namespace {
+	struct NotificationBatch {
+		NotificationBatch() { diveListNotifier.beginBatch(); }
+		~NotificationBatch() { diveListNotifier.endBatch(); }
+	};
+}
 
 // forward declaration
 QString changesMade();
@@ -39,20 +53,94 @@ bool isClean()
 	return undoStack->isClean();
 }
 
+void setUndoMemoryLimit(size_t bytes)
+{
+	undoMemoryLimit = bytes;
+}
+
+size_t Base::undoMemory() const
+{
+	return 0;
+}
+
+void Base::discardUndoData()
+{
+}
+
+// A rough estimate, dominated by the samples.
+size_t diveMemory(const struct dive &d)
+{
+	size_t res = sizeof(d) + d.notes.capacity() + d.cylinders.size() * sizeof(cylinder_t);
+	for (const divecomputer &dc: d.dcs) {
+		res += dc.samples.capacity() * sizeof(sample) + dc.packed_samples.capacity() +
+		       dc.events.size() * sizeof(event);
+	}
+	return res;
+}
+
+// Discard the oldest commands until the undo data of the remaining ones fit into
+// the limit. The last command is always kept. Discarded commands are marked obsolete,
+// which makes QUndoStack remove them instead of undoing them. Since only the oldest
+// commands are discarded, no remaining command depends on them.
+static void limitUndoMemory()
+{
+	if (!undoMemoryLimit)
+		return;
+	size_t total = 0;
+	int i = undoStack->index() - 1;
+	for (; i >= 0; --i) {
+		const Base *cmd = static_cast<const Base *>(undoStack->command(i));
+		if (cmd->isObsolete())
+			return; // The older ones are discarded already
+		total += cmd->undoMemory();
+		if (total > undoMemoryLimit)
+			break;
+	}
+	if (i == undoStack->index() - 1)
+		--i;
+	for (; i >= 0; --i) {
+		Base *cmd = static_cast<Base *>(const_cast<QUndoCommand *>(undoStack->command(i)));
+		if (cmd->isObsolete())
+			break;
+		cmd->discardUndoData();
+		cmd->setObsolete(true);
+	}
+}
+
 // this can be used to get access to the signals emitted by the QUndoStack
 QUndoStack *getUndoStack()
 {
 	return undoStack;
 }
 
+void undo()
+{
+	NotificationBatch batch;
+	undoStack->undo();
+}
+
+void redo()
+{
+	NotificationBatch batch;
+	undoStack->redo();
+}
+
+// The actions of QUndoStack keep track of the texts and the enabled state.
+// Only replace what they do when triggered.
 QAction *undoAction(QObject *parent)
 {
-	return undoStack->createUndoAction(parent, QCoreApplication::translate("Command", "&Undo"));
+	QAction *res = undoStack->createUndoAction(parent, QCoreApplication::translate("Command", "&Undo"));
+	QObject::disconnect(res, nullptr, undoStack, nullptr);
+	QObject::connect(res, &QAction::triggered, [] { undo(); });
+	return res;
 }
 
 QAction *redoAction(QObject *parent)
 {
-	return undoStack->createRedoAction(parent, QCoreApplication::translate("Command", "&Redo"));
+	QAction *res = undoStack->createRedoAction(parent, QCoreApplication::translate("Command", "&Redo"));
+	QObject::disconnect(res, nullptr, undoStack, nullptr);
+	QObject::connect(res, &QAction::triggered, [] { redo(); });
+	return res;
 }
 
 QString diveNumberOrDate(struct dive *d)
@@ -118,8 +206,12 @@ bool execute(Base *cmd)
 {
 	if (cmd->workToBeDone()) {
 		executingCommand = true;
-		undoStack->push(cmd);
+		{
+			NotificationBatch batch;
+			undoStack->push(cmd);
+		}
 		executingCommand = false;
+		limitUndoMemory();
 		emit diveListNotifier.commandExecuted();
 		return true;
 	} else {
@@ -166,6 +166,12 @@ public:
 	// Check whether work is to be done.
 	// TODO: replace by setObsolete (>Qt5.9)
 	virtual bool workToBeDone() = 0;
+
+	// The memory (roughly) held to undo the command. Once the undo stack
+	// exceeds the limit set by setUndoMemoryLimit(), the oldest commands are
+	// discarded: their data is released and they can't be undone anymore.
+	virtual size_t undoMemory() const;
+	virtual void discardUndoData();
 };
 
 // Put a command on the undoStack (and take ownership), but test whether there
@@ -179,6 +185,7 @@ QUndoStack *getUndoStack();
 QString diveNumberOrDate(struct dive *d);
 QString getListOfDives(const std::vector<dive *> &dives);
 QString getListOfDives(QVector<struct dive *> dives);
+size_t diveMemory(const struct dive &d);
 
 } // namespace Command
 
@@ -4,12 +4,18 @@
 #include "core/divefilter.h"
 #include "core/divelist.h"
 #include "core/divelog.h"
+#include "core/errorhelper.h"
+#include "core/libdivecomputer.h"
 #include "core/qthelper.h"
+#include "core/range.h"
 #include "core/selection.h"
 #include "core/subsurface-qt/divelistnotifier.h"
 #include "qt-models/filtermodels.h"
 #include "qt-models/divelocationmodel.h"
 
+#include <unordered_map>
+#include <unordered_set>
+
 namespace Command {
 
 // Helper function that takes care to unselect trips that are removed from the backend
@@ -21,10 +27,11 @@ static std::unique_ptr<dive_trip> remove_trip_from_backend(dive_trip *trip)
 	return std::move(t);
 }
 
-// This helper function removes a dive, takes ownership of the dive and adds it to a DiveToAdd structure.
+// This helper function prepares the removal of a dive and returns a DiveToAdd structure.
 // If the trip the dive belongs to becomes empty, it is removed and added to the tripsToAdd vector.
-// It is crucial that dives are added in reverse order of deletion, so that the indices are correctly
-// set and that the trips are added before they are used!
+// The dive itself is removed from the backend by the caller, which then takes ownership.
+// It is crucial that dives are added in reverse order of deletion, so that the trips are
+// added before they are used!
 DiveToAdd DiveListBase::removeDive(struct dive *d, std::vector<std::unique_ptr<dive_trip>> &tripsToAdd)
 {
 	// If the dive was the current dive, reset the current dive. The calling
@@ -45,14 +52,8 @@ DiveToAdd DiveListBase::removeDive(struct dive *d, std::vector<std::unique_ptr<d
 		tripsToAdd.push_back(std::move(trip));		// Take ownership of trip
 	}
 
-	size_t idx = divelog.dives.get_idx(d);
-	if (idx == std::string::npos)
-		qWarning("Deletion of unknown dive!");
-
 	DiveFilter::instance()->diveRemoved(d);
 
-	res.dive = divelog.dives.unregister_dive(idx);		// Remove dive from backend
-
 	return res;
 }
 
@@ -62,9 +63,9 @@ void DiveListBase::diveSiteCountChanged(struct dive_site *ds)
 		sitesCountChanged.push_back(ds);
 }
 
-// This helper function adds a dive and returns ownership to the backend. It may also add a dive trip.
-// It is crucial that dives are added in reverse order of deletion (see comment above)!
-// Returns pointer to added dive (which is owned by the backend!)
+// This helper function adds a dive to its trip and dive site. The caller passes ownership
+// of the dive to the backend. It is crucial that dives are added in reverse order of deletion
+// (see comment above)! Returns pointer to the dive.
 dive *DiveListBase::addDive(DiveToAdd &d)
 {
 	if (d.trip)
@@ -73,7 +74,7 @@ dive *DiveListBase::addDive(DiveToAdd &d)
 		d.site->add_dive(d.dive.get());
 		diveSiteCountChanged(d.site);
 	}
-	return divelog.dives.register_dive(std::move(d.dive));	// Transfer ownership to core and update fulltext index
+	return d.dive.get();
 }
 
 // Some signals are sent in batches per trip. To avoid writing the same loop
@@ -130,6 +131,18 @@ DivesAndTripsToAdd DiveListBase::removeDives(DivesAndSitesToRemove &divesAndSite
 
 	for (dive *d: divesAndSitesToDelete.dives)
 		divesToAdd.push_back(removeDive(d, tripsToAdd));
+
+	// Remove the dives from the backend in one pass and take ownership
+	std::unordered_map<const dive *, size_t> indexes;
+	for (auto [idx, d]: enumerated_range(divesAndSitesToDelete.dives))
+		indexes[d] = idx;
+	auto removed = divelog.dives.unregister_dives(divesAndSitesToDelete.dives);
+	if (removed.size() != divesToAdd.size())
+		qWarning("Deletion of unknown dive!");
+	for (auto &d: removed) {
+		size_t idx = indexes[d.get()];
+		divesToAdd[idx].dive = std::move(d);
+	}
 	divesAndSitesToDelete.dives.clear();
 
 	for (dive_site *ds: divesAndSitesToDelete.sites) {
@@ -158,6 +171,14 @@ DivesAndTripsToAdd DiveListBase::removeDives(DivesAndSitesToRemove &divesAndSite
 	if (oldShown != DiveFilter::instance()->shownDives())
 		emit diveListNotifier.numShownChanged();
 
+	// The removed dives are kept for undo (or redo) and may stay around for a long
+	// time. Keep their samples packed; they are unpacked when accessed after readding.
+	removedMemory = 0;
+	for (DiveToAdd &entry: divesToAdd) {
+		entry.dive->compact_samples();
+		removedMemory += diveMemory(*entry.dive);
+	}
+
 	return { std::move(divesToAdd), std::move(tripsToAdd), std::move(sitesToAdd) };
 }
 
@@ -170,6 +191,7 @@ DivesAndSitesToRemove DiveListBase::addDives(DivesAndTripsToAdd &toAdd)
 	std::vector<dive *> res;
 	std::vector<dive_site *> sites;
 	std::vector<std::pair<dive_trip *, dive *>> dives;
+	removedMemory = 0;
 	res.resize(toAdd.dives.size());
 	sites.reserve(toAdd.sites.size());
 	dives.reserve(toAdd.sites.size());
@@ -187,12 +209,16 @@ DivesAndSitesToRemove DiveListBase::addDives(DivesAndTripsToAdd &toAdd)
 	auto it2 = res.rbegin();
 	QVector<dive *> divesToFilter;
 	divesToFilter.reserve(toAdd.dives.size());
+	std::vector<std::unique_ptr<dive>> divesToRegister;
+	divesToRegister.reserve(toAdd.dives.size());
 	for (auto it = toAdd.dives.rbegin(); it != toAdd.dives.rend(); ++it, ++it2) {
 		*it2 = addDive(*it);
 		dives.push_back({ (*it2)->divetrip, *it2 });
 		divesToFilter.push_back(*it2);
+		divesToRegister.push_back(std::move(it->dive));
 	}
 	toAdd.dives.clear();
+	divelog.dives.register_dives(std::move(divesToRegister)); // Transfer ownership to core and update fulltext index
 
 	ShownChange change = DiveFilter::instance()->update(divesToFilter);
 
@@ -244,7 +270,7 @@ static void renumberDives(QVector<QPair<dive *, int>> &divesToRenumber)
 	}
 
 	// Send signals.
-	emit diveListNotifier.divesChanged(dives, DiveField::NR);
+	diveListNotifier.notifyDivesChanged(dives, DiveField::NR);
 }
 
 // This helper function moves a dive to a trip. The old trip is recorded in the
@@ -283,13 +309,13 @@ static void moveDivesBetweenTrips(DivesToTrip &dives)
 {
 	// We collect an array of created trips so that we can instruct
 	// the model to create a new entry
-	std::vector<dive_trip *> createdTrips;
+	std::unordered_set<dive_trip *> createdTrips;
 	createdTrips.reserve(dives.tripsToAdd.size());
 
 	// First, bring back the trip(s)
 	for (std::unique_ptr<dive_trip> &trip: dives.tripsToAdd) {
 		auto [t, idx] = divelog.trips.put(std::move(trip)); // Return ownership to backend
-		createdTrips.push_back(t);
+		createdTrips.insert(t);
 	}
 	dives.tripsToAdd.clear();
 
@@ -299,6 +325,9 @@ static void moveDivesBetweenTrips(DivesToTrip &dives)
 		if (tripToAdd)
 			dives.tripsToAdd.push_back(std::move(tripToAdd));
 	}
+	std::unordered_set<const dive_trip *> deletedTrips;
+	for (const std::unique_ptr<dive_trip> &trip: dives.tripsToAdd)
+		deletedTrips.insert(trip.get());
 
 	// We send one signal per from-trip/to-trip pair.
 	// First, collect all dives in a struct and sort by from-trip/to-trip.
@@ -333,25 +362,14 @@ static void moveDivesBetweenTrips(DivesToTrip &dives)
 			divesInTrip[k - i] = divesMoved[k].d;
 
 		// Check if the from-trip was deleted: If yes, it was recorded in the tripsToAdd structure.
-		// Only set the flag if this is that last time this trip is featured.
+		// Only set the flag if this is that last time this trip is featured. Since the dives are
+		// sorted by from-trip, that is the case if the next batch has a different from-trip.
 		bool deleteFrom = from &&
-				  std::find_if(divesMoved.begin() + j, divesMoved.end(), // Is this the last occurence of "from"?
-					       [from](const DiveMoved &entry) { return entry.from == from; }) == divesMoved.end() &&
-				  std::find_if(dives.tripsToAdd.begin(), dives.tripsToAdd.end(), // Is "from" in tripsToAdd?
-					       [from](const std::unique_ptr<dive_trip> &trip) { return trip.get() == from; }) != dives.tripsToAdd.end();
-		// Check if the to-trip has to be created. For this purpose, we saved an array of trips to be created.
-		bool createTo = false;
-		if (to) {
-			// Check if the element is there...
-			auto it = std::find(createdTrips.begin(), createdTrips.end(), to);
-
-			// ...if it is - remove it as we don't want the model to create the trip twice!
-			if (it != createdTrips.end()) {
-				createTo = true;
-				// erase/remove would be more performant, but this is irrelevant in the big scheme of things.
-				createdTrips.erase(it);
-			}
-		}
+				  (j == divesMoved.size() || divesMoved[j].from != from) &&
+				  deletedTrips.count(from);
+		// Check if the to-trip has to be created. For this purpose, we saved a set of trips to be created.
+		// If it is there, remove it as we don't want the model to create the trip twice!
+		bool createTo = to && createdTrips.erase(to);
 
 		// Finally, emit the signal
 		emit diveListNotifier.divesMovedBetweenTrips(from, to, deleteFrom, createTo, divesInTrip);
@@ -373,6 +391,11 @@ void DiveListBase::finishWork()
 		emit diveListNotifier.diveSiteDiveCountChanged(ds);
 }
 
+size_t DiveListBase::undoMemory() const
+{
+	return removedMemory;
+}
+
 void DiveListBase::undo()
 {
 	initWork();
@@ -459,9 +482,14 @@ ImportDives::ImportDives(struct divelog *log, int flags, const QString &source)
 	// this only matters if undoit were called before redoit
 	currentDive = nullptr;
 
-	auto [dives_to_add, dives_to_remove, trips_to_add, sites_to_add, devices_to_add] =
+	auto [dives_to_add, dives_to_remove, trips_to_add, sites_to_add, devices_to_add, likely_duplicates] =
 		divelog.process_imported_dives(*log, flags);
 
+	// Not merged, since they don't overlap in time. Let the user decide.
+	for (auto [newDive, oldDive]: likely_duplicates)
+		report_error("%s", qPrintable(Command::Base::tr("Imported dive at %1 looks like the dive at %2. Is the clock of the dive computer off?")
+					      .arg(get_dive_date_string(newDive->when), get_dive_date_string(oldDive->when))));
+
 	// Add devices to devicesToAddAndRemove structure
 	devicesToAddAndRemove = std::move(devices_to_add);
 
@@ -536,6 +564,12 @@ void ImportDives::redoit()
 	emit diveListNotifier.divesImported();
 }
 
+void ImportDives::discardUndoData()
+{
+	// After redo, these are the dives that were replaced by merged versions
+	divesToAdd = DivesAndTripsToAdd();
+}
+
 void ImportDives::undoit()
 {
 	// Add new dives and sites
@@ -589,6 +623,12 @@ void DeleteDive::undoit()
 	setSelection(divesToDelete.dives, currentDive, -1);
 }
 
+void DeleteDive::discardUndoData()
+{
+	divesToAdd = DivesAndTripsToAdd();
+	tripsToAdd.clear();
+}
+
 void DeleteDive::redoit()
 {
 	divesToAdd = removeDives(divesToDelete);
@@ -628,7 +668,7 @@ void ShiftTime::redoit()
 	// Send signals
 	QVector<dive *> dives = stdToQt<dive *>(diveList);
 	emit diveListNotifier.divesTimeChanged(timeChanged, dives);
-	emit diveListNotifier.divesChanged(dives, DiveField::DATETIME);
+	diveListNotifier.notifyDivesChanged(dives, DiveField::DATETIME);
 
 	// Select the changed dives
 	setSelection(diveList, diveList[0], -1);
@@ -820,6 +860,11 @@ void SplitDivesBase::redoit()
 	setSelection(divesToUnsplit.dives, divesToUnsplit.dives[0], -1);
 }
 
+void SplitDivesBase::discardUndoData()
+{
+	unsplitDive = DivesAndTripsToAdd();
+}
+
 void SplitDivesBase::undoit()
 {
 	// Note: reverse order with respect to redoit()
@@ -893,6 +938,11 @@ void DiveComputerBase::redoit()
 	std::swap(dc_nr_before, dc_nr_after);
 }
 
+void DiveComputerBase::discardUndoData()
+{
+	diveToAdd = DivesAndTripsToAdd();
+}
+
 void DiveComputerBase::undoit()
 {
 	// Undo and redo do the same
@@ -912,6 +962,49 @@ DeleteDiveComputer::DeleteDiveComputer(dive *d, int dc_num)
 	setText(Command::Base::tr("delete dive computer"));
 }
 
+ReparseDives::ReparseDives(const QVector<dive *> &dives)
+{
+	auto reparsed = libdc_reparse_dives(qtToStd(dives));
+	setText(Command::Base::tr("re-parse %n dive(s) from raw data", "", static_cast<int>(reparsed.size())));
+
+	divesToAdd.dives.reserve(reparsed.size());
+	for (auto &[old_dive, new_dive]: reparsed) {
+		divesToRemove.dives.push_back(old_dive);
+
+		// As in DiveComputerBase: the command manages selection, trip and site.
+		new_dive->selected = false;
+		new_dive->divetrip = nullptr;
+		new_dive->dive_site = nullptr;
+		divesToAdd.dives.push_back({ std::move(new_dive), old_dive->divetrip, old_dive->dive_site });
+	}
+}
+
+bool ReparseDives::workToBeDone()
+{
+	return !divesToRemove.dives.empty() || !divesToAdd.dives.empty();
+}
+
+void ReparseDives::redoit()
+{
+	DivesAndSitesToRemove addedDives = addDives(divesToAdd);
+	divesToAdd = removeDives(divesToRemove);
+	divesToRemove = std::move(addedDives);
+
+	// Select the re-parsed dives. This automatically replots the profile.
+	setSelection(divesToRemove.dives, divesToRemove.dives.back(), -1);
+}
+
+void ReparseDives::undoit()
+{
+	// Undo and redo do the same
+	redoit();
+}
+
+void ReparseDives::discardUndoData()
+{
+	divesToAdd = DivesAndTripsToAdd();
+}
+
 MergeDives::MergeDives(const QVector <dive *> &dives) : site(nullptr)
 {
 	setText(Command::Base::tr("merge dive"));
@@ -1016,6 +1109,11 @@ void MergeDives::redoit()
 	setSelection(diveToUnmerge.dives, diveToUnmerge.dives[0], -1);
 }
 
+void MergeDives::discardUndoData()
+{
+	unmergedDives = DivesAndTripsToAdd();
+}
+
 void MergeDives::undoit()
 {
 	divesToMerge = addDives(unmergedDives);
@@ -66,9 +66,13 @@ protected:
 	// Register dive sites where counts changed so that we can signal the frontend later.
 	void diveSiteCountChanged(struct dive_site *ds);
 
+	// After undo and redo, the command holds the dives that were removed last.
+	size_t undoMemory() const override;
+
 private:
 	// Keep track of dive sites where the number of dives changed
 	std::vector<dive_site *> sitesCountChanged;
+	size_t removedMemory = 0;
 	void initWork();
 	void finishWork(); // update dive site counts
 	void undo() override;
@@ -104,6 +108,7 @@ private:
 	void undoit() override;
 	void redoit() override;
 	bool workToBeDone() override;
+	void discardUndoData() override;
 
 	// For redo and undo
 	DivesAndTripsToAdd	divesToAdd;
@@ -130,6 +135,8 @@ private:
 	void redoit() override;
 	bool workToBeDone() override;
 
+	void discardUndoData() override;
+
 	// For redo
 	DivesAndSitesToRemove divesToDelete;
 
@@ -201,6 +208,7 @@ private:
 	void undoit() override;
 	void redoit() override;
 	bool workToBeDone() override;
+	void discardUndoData() override;
 
 	// For redo
 	// For each dive to split, we remove one from and put two dives into the backend
@@ -242,6 +250,7 @@ private:
 	void undoit() override;
 	void redoit() override;
 	bool workToBeDone() override;
+	void discardUndoData() override;
 
 protected:
 	// For redo and undo
@@ -260,6 +269,23 @@ public:
 	DeleteDiveComputer(dive *d, int dc_num);
 };
 
+// Replace the dive computers of dives by the ones parsed again from the raw
+// data that was kept when downloading. As above, we keep full copies of the
+// dives before and after.
+class ReparseDives : public DiveListBase {
+public:
+	ReparseDives(const QVector<dive *> &dives);
+private:
+	void undoit() override;
+	void redoit() override;
+	bool workToBeDone() override;
+	void discardUndoData() override;
+
+	// For redo and undo
+	DivesAndTripsToAdd	divesToAdd;
+	DivesAndSitesToRemove	divesToRemove;
+};
+
 class MergeDives : public DiveListBase {
 public:
 	MergeDives(const QVector<dive *> &dives);
@@ -267,6 +293,7 @@ private:
 	void undoit() override;
 	void redoit() override;
 	bool workToBeDone() override;
+	void discardUndoData() override;
 	void swapDivesite(); // Common code for undo and redo.
 
 	// For redo
@@ -3,6 +3,7 @@
 #include "command_divesite.h"
 #include "core/divelog.h"
 #include "core/divesite.h"
+#include "core/divesiteindex.h"
 #include "core/subsurface-qt/divelistnotifier.h"
 #include "core/qthelper.h"
 #include "core/subsurface-string.h"
@@ -35,7 +36,7 @@ static std::vector<dive_site *> addDiveSites(std::vector<std::unique_ptr<dive_si
 		emit diveListNotifier.diveSiteAdded(res.back(), add_res.idx); // Inform frontend of new dive site.
 	}
 
-	emit diveListNotifier.divesChanged(changedDives, DiveField::DIVESITE);
+	diveListNotifier.notifyDivesChanged(changedDives, DiveField::DIVESITE);
 
 	// Clear vector of unused owning pointers
 	sites.clear();
@@ -65,7 +66,7 @@ static std::vector<std::unique_ptr<dive_site>> removeDiveSites(std::vector<dive_
 		emit diveListNotifier.diveSiteDeleted(ds, pull_res.idx); // Inform frontend of removed dive site.
 	}
 
-	emit diveListNotifier.divesChanged(changedDives, DiveField::DIVESITE);
+	diveListNotifier.notifyDivesChanged(changedDives, DiveField::DIVESITE);
 
 	sites.clear();
 
@@ -98,10 +99,11 @@ ImportDiveSites::ImportDiveSites(dive_site_table sites, const QString &source)
 {
 	setText(Command::Base::tr("import dive sites from %1").arg(source));
 
+	dive_site_index index(divelog.sites);
 	for (auto &new_ds: sites) {
 		// Don't import dive sites that already exist.
 		// We might want to be smarter here and merge dive site data, etc.
-		if (divelog.sites.get_same(*new_ds))
+		if (index.get_same(*new_ds))
 			continue;
 		sitesToAdd.push_back(std::move(new_ds));
 	}
@@ -347,7 +349,7 @@ void MergeDiveSites::redo()
 			divesChanged.push_back(d);
 		}
 	}
-	emit diveListNotifier.divesChanged(divesChanged, DiveField::DIVESITE);
+	diveListNotifier.notifyDivesChanged(divesChanged, DiveField::DIVESITE);
 }
 
 void MergeDiveSites::undo()
@@ -366,7 +368,7 @@ void MergeDiveSites::undo()
 
 	sitesToRemove = addDiveSites(sitesToAdd);
 
-	emit diveListNotifier.divesChanged(divesChanged, DiveField::DIVESITE);
+	diveListNotifier.notifyDivesChanged(divesChanged, DiveField::DIVESITE);
 }
 
 ApplyGPSFixes::ApplyGPSFixes(const std::vector<DiveAndLocation> &fixes)
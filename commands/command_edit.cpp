@@ -156,7 +156,7 @@ void EditBase<T>::undo()
 
 	// Send signals.
 	DiveField id = fieldId();
-	emit diveListNotifier.divesChanged(stdToQt<dive *>(dives), id);
+	diveListNotifier.notifyDivesChanged(stdToQt<dive *>(dives), id);
 	if (!placingCommand())
 		setSelection(selectedDives, current, -1);
 }
@@ -547,7 +547,7 @@ void EditTagsBase::undo()
 
 	// Send signals.
 	DiveField id = fieldId();
-	emit diveListNotifier.divesChanged(stdToQt<dive *>(dives), id);
+	diveListNotifier.notifyDivesChanged(stdToQt<dive *>(dives), id);
 	setSelection(selectedDives, current, -1);
 }
 
@@ -772,7 +772,7 @@ void PasteDives::undo()
 	fields.tags = state.tags.has_value();
 	fields.datetime = state.when.has_value();
 	fields.nr = state.number.has_value();
-	emit diveListNotifier.divesChanged(divesToNotify, fields);
+	diveListNotifier.notifyDivesChanged(divesToNotify, fields);
 	if (state.cylinders.has_value())
 		emit diveListNotifier.cylindersReset(divesToNotify);
 	if (state.weightsystems.has_value())
@@ -810,6 +810,7 @@ ReplanDive::ReplanDive(dive *source) : d(current_dive),
 	// This resets the dive computers and cylinders of the source dive, avoiding deep copies.
 	std::swap(source->cylinders, cylinders);
 	std::swap(source->dcs[0], dc);
+	compact_samples(dc);
 
 	setText(Command::Base::tr("Replan dive"));
 }
@@ -823,13 +824,29 @@ bool ReplanDive::workToBeDone()
 	return !!d;
 }
 
+size_t ReplanDive::undoMemory() const
+{
+	return sizeof(*this) + dc.samples.capacity() * sizeof(sample) + dc.packed_samples.capacity() +
+	       dc.events.size() * sizeof(event) + cylinders.size() * sizeof(cylinder_t) + notes.capacity();
+}
+
+void ReplanDive::discardUndoData()
+{
+	dc = divecomputer();
+	cylinders.clear();
+	notes.clear();
+}
+
 void ReplanDive::undo()
 {
 	std::swap(d->when, when);
 	std::swap(d->maxdepth, maxdepth);
 	std::swap(d->meandepth, meandepth);
 	std::swap(d->cylinders, cylinders);
+	// The samples we keep are packed (see compact_samples()).
+	expand_samples(dc);
 	std::swap(d->dcs[0], dc);
+	compact_samples(dc);
 	std::swap(d->notes, notes);
 	std::swap(d->surface_pressure, surface_pressure);
 	std::swap(d->duration, duration);
@@ -841,7 +858,7 @@ void ReplanDive::undo()
 	// Note that we have to emit cylindersReset before divesChanged, because the divesChanged
 	// updates the profile, which is out-of-sync and gets confused.
 	emit diveListNotifier.cylindersReset(divesToNotify);
-	emit diveListNotifier.divesChanged(divesToNotify, DiveField::DATETIME | DiveField::DURATION | DiveField::DEPTH | DiveField::MODE |
+	diveListNotifier.notifyDivesChanged(divesToNotify, DiveField::DATETIME | DiveField::DURATION | DiveField::DEPTH | DiveField::MODE |
 							  DiveField::NOTES | DiveField::SALINITY | DiveField::ATM_PRESS);
 	if (!placingCommand())
 		setSelection({ d }, d, -1);
@@ -881,6 +898,7 @@ EditProfile::EditProfile(const dive *source, int dcNr, EditProfileType type, int
 
 	dc.samples = sdc->samples;
 	dc.events = sdc->events;
+	compact_samples(dc);
 
 	setText(editProfileTypeToString(type, count) + " " + diveNumberOrDate(d));
 }
@@ -894,12 +912,26 @@ bool EditProfile::workToBeDone()
 	return !!d;
 }
 
+size_t EditProfile::undoMemory() const
+{
+	return sizeof(*this) + dc.samples.capacity() * sizeof(sample) + dc.packed_samples.capacity() +
+	       dc.events.size() * sizeof(event);
+}
+
+void EditProfile::discardUndoData()
+{
+	dc = divecomputer();
+}
+
 void EditProfile::undo()
 {
 	struct divecomputer *sdc = d->get_dc(dcNr);
 	if (!sdc)
 		return;
+	// The samples we keep are packed (see compact_samples()).
+	expand_samples(dc);
 	std::swap(sdc->samples, dc.samples);
+	compact_samples(dc);
 	std::swap(sdc->events, dc.events);
 	std::swap(sdc->maxdepth, dc.maxdepth);
 	std::swap(d->maxdepth, maxdepth);
@@ -909,7 +941,7 @@ void EditProfile::undo()
 	d->invalidate_cache(); // Ensure that dive is written in git_save()
 
 	QVector<dive *> divesToNotify = { d };
-	emit diveListNotifier.divesChanged(divesToNotify, DiveField::DURATION | DiveField::DEPTH);
+	diveListNotifier.notifyDivesChanged(divesToNotify, DiveField::DURATION | DiveField::DEPTH);
 	if (!placingCommand())
 		setSelection({ d }, d, dcNr);
 }
@@ -1457,7 +1489,7 @@ void EditDive::exchangeDives()
 	}
 
 	// Send signals
-	emit diveListNotifier.divesChanged(dives, changedFields);
+	diveListNotifier.notifyDivesChanged(dives, changedFields);
 
 	// Select the changed dives
 	setSelection( { oldDive }, oldDive, -1);
@@ -342,6 +342,8 @@ private:
 	void undo() override;
 	void redo() override;
 	bool workToBeDone() override;
+	size_t undoMemory() const override;
+	void discardUndoData() override;
 };
 
 class EditProfile : public Base {
@@ -359,6 +361,8 @@ private:
 	void undo() override;
 	void redo() override;
 	bool workToBeDone() override;
+	size_t undoMemory() const override;
+	void discardUndoData() override;
 };
 
 class AddWeight : public EditDivesBase {
@@ -156,7 +156,7 @@ void RemoveEvent::post() const
 
 	// TODO: This is silly we send a DURATION change event so that the statistics are recalculated.
 	// We should instead define a proper DiveField that expresses the change caused by a gas switch.
-	emit diveListNotifier.divesChanged(QVector<dive *>{ d }, DiveField::DURATION | DiveField::DEPTH);
+	diveListNotifier.notifyDivesChanged(QVector<dive *>{ d }, DiveField::DURATION | DiveField::DEPTH);
 }
 
 AddGasSwitch::AddGasSwitch(struct dive *d, int dcNr, int seconds, int tank) : EventBase(d, dcNr)
@@ -212,7 +212,7 @@ void AddGasSwitch::redoit()
 
 	// TODO: This is silly we send a DURATION change event so that the statistics are recalculated.
 	// We should instead define a proper DiveField that expresses the change caused by a gas switch.
-	emit diveListNotifier.divesChanged(QVector<dive *>{ d }, DiveField::DURATION | DiveField::DEPTH);
+	diveListNotifier.notifyDivesChanged(QVector<dive *>{ d }, DiveField::DURATION | DiveField::DEPTH);
 }
 
 void AddGasSwitch::undoit()
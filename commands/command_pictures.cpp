@@ -201,7 +201,7 @@ void AddPictures::swapDiveSites()
 		std::swap(ds, entry.ds);
 		if (ds)
 			ds->add_dive(entry.d);
-		emit diveListNotifier.divesChanged(QVector<dive *>{ entry.d }, DiveField::DIVESITE);
+		diveListNotifier.notifyDivesChanged(QVector<dive *>{ entry.d }, DiveField::DIVESITE);
 	}
 
 	for (DiveSiteEditEntry &entry: sitesToEdit) {
@@ -0,0 +1,933 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "binarylog.h"
+#include "device.h"
+#include "dive.h"
+#include "divelog.h"
+#include "divesite.h"
+#include "errorhelper.h"
+#include "event.h"
+#include "extradata.h"
+#include "file.h"
+#include "filterconstraint.h"
+#include "filterpreset.h"
+#include "gettext.h"
+#include "mappedfile.h"
+#include "membuffer.h"
+#include "sample.h"
+#include "samplecodec.h"
+#include "subsurface-string.h"
+#include "trip.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static const char file_magic[8] = { 'S', 'S', 'R', 'F', 'B', 'I', 'N', 0 };
+static const char chunk_magic[4] = { 'C', 'H', 'N', 'K' };
+static const uint32_t byte_order_mark = 0x01020304;
+
+// Records refer to strings and arrays of the same chunk. Offsets
+// are in bytes from the start of the areas, counts in records.
+struct string_ref {
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct array_ref {
+	uint32_t offset;
+	uint32_t count;
+};
+
+#define FILE_AUTOGROUP 1
+
+struct file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct chunk_header {
+	char magic[4];
+	uint32_t size;			// of the chunk, without the header
+	uint32_t nr_sites, nr_trips, nr_dives;
+	uint32_t nr_devices, nr_fingerprints, nr_presets;
+	uint32_t arrays_offset, arrays_size;
+	uint32_t strings_offset, strings_size;
+	uint32_t samples_offset, samples_size;
+	uint32_t reserved;
+};
+
+// The tables of records come first, in this order
+struct site_record {
+	uint32_t uuid;
+	int32_t latitude, longitude;	// udeg
+	string_ref name, description, notes;
+	array_ref taxonomy;
+};
+
+struct taxonomy_record {
+	int32_t category, origin;
+	string_ref value;
+};
+
+struct trip_record {
+	string_ref location, notes;
+	uint32_t autogen;
+};
+
+#define DIVE_NOTRIP 1
+#define DIVE_INVALID 2
+
+struct dive_record {
+	int64_t when;
+	uint32_t site;			// uuid, 0 if none
+	int32_t trip;			// index in the trips of the chunk, -1 if none
+	int32_t number, rating;
+	int32_t wavesize, current, visibility, surge, chill;
+	int32_t sac, otu, cns, maxcns;
+	uint32_t mintemp, maxtemp, watertemp, airtemp;		// mK
+	int32_t maxdepth, meandepth, surface_pressure, duration;
+	int32_t salinity, user_salinity;
+	uint32_t flags;
+	string_ref notes, diveguide, buddy, suit;
+	array_ref cylinders, weightsystems, tags, dcs, pictures;
+};
+
+#define CYLINDER_MANUALLY_ADDED 1
+#define CYLINDER_BESTMIX_O2 2
+#define CYLINDER_BESTMIX_HE 4
+
+struct cylinder_record {
+	int32_t size, workingpressure;
+	string_ref description;
+	int32_t o2, he;
+	int32_t start, end, sample_start, sample_end;
+	int32_t depth;
+	int32_t gas_used, deco_gas_used;
+	int32_t use;
+	uint32_t flags;
+};
+
+struct weightsystem_record {
+	int32_t grams;
+	uint32_t auto_filled;
+	string_ref description;
+};
+
+struct picture_record {
+	string_ref filename;
+	int32_t offset;
+	int32_t latitude, longitude;
+};
+
+struct dc_record {
+	int64_t when;
+	int32_t duration, surfacetime, last_manual_time;
+	int32_t maxdepth, meandepth;
+	uint32_t airtemp, watertemp;
+	int32_t surface_pressure;
+	int32_t divemode, no_o2sensors, salinity;
+	string_ref model, serial, fw_version;
+	uint32_t deviceid, diveid;
+	array_ref events, extra_data;
+	uint32_t samples_offset, samples_size;	// in the samples area
+	uint32_t samples_count, samples_channels;
+};
+
+struct event_record {
+	int32_t time, type, flags, value;
+	int32_t index, o2, he;		// gas switches, the index is the divemode for mode changes
+	uint32_t hidden;
+	string_ref name;
+};
+
+struct extra_data_record {
+	string_ref key, value;
+};
+
+struct device_record {
+	string_ref model, serial, nickname;
+	uint32_t deviceid;
+};
+
+struct fingerprint_record_data {
+	uint32_t model, serial, deviceid, diveid;
+	string_ref data;
+};
+
+struct preset_record {
+	string_ref name, fulltext, fulltext_mode;
+	array_ref constraints;
+};
+
+struct constraint_record {
+	string_ref type, string_mode, range_mode, data;
+	uint32_t negate;
+};
+
+bool is_binary_log_filename(const char *filename)
+{
+	size_t len = strlen(filename);
+	return len > 5 && !strcasecmp(filename + len - 5, ".ssrb");
+}
+
+namespace {
+
+class chunk_writer {
+public:
+	void put_dive(const struct dive &d);
+	void put_site(const struct dive_site &ds);
+	void put_device(const struct device &dev);
+	void put_fingerprint(const struct fingerprint_record &fp);
+	void put_preset(const struct filter_preset &preset);
+	std::string finish();
+private:
+	string_ref put_string(const std::string &s);
+	string_ref put_bytes(const char *data, size_t size);
+	template <typename R>
+	array_ref put_array(const std::vector<R> &records);
+	int32_t put_trip(const struct dive_trip &trip);
+	dc_record put_dc(const struct divecomputer &dc);
+
+	chunk_header header = {};
+	std::string sites, trips, dives, devices, fingerprints, presets;
+	std::string arrays, strings, samples;
+	// Models, descriptions and so on are repeated over and over
+	std::unordered_map<std::string, string_ref> known_strings;
+	std::unordered_map<const dive_trip *, int32_t> trip_index;
+};
+
+}
+
+template <typename R>
+static void append_record(std::string &table, const R &r)
+{
+	table.append((const char *)&r, sizeof(r));
+}
+
+string_ref chunk_writer::put_bytes(const char *data, size_t size)
+{
+	string_ref res { (uint32_t)strings.size(), (uint32_t)size };
+	strings.append(data, size);
+	return res;
+}
+
+string_ref chunk_writer::put_string(const std::string &s)
+{
+	if (s.empty())
+		return string_ref { 0, 0 };
+	auto it = known_strings.find(s);
+	if (it != known_strings.end())
+		return it->second;
+	string_ref res = put_bytes(s.data(), s.size());
+	known_strings.emplace(s, res);
+	return res;
+}
+
+template <typename R>
+array_ref chunk_writer::put_array(const std::vector<R> &records)
+{
+	array_ref res { (uint32_t)arrays.size(), (uint32_t)records.size() };
+	if (!records.empty())
+		arrays.append((const char *)records.data(), records.size() * sizeof(R));
+	return res;
+}
+
+int32_t chunk_writer::put_trip(const struct dive_trip &trip)
+{
+	auto it = trip_index.find(&trip);
+	if (it != trip_index.end())
+		return it->second;
+	trip_record r = {};
+	r.location = put_string(trip.location);
+	r.notes = put_string(trip.notes);
+	r.autogen = trip.autogen;
+	append_record(trips, r);
+	int32_t idx = (int32_t)header.nr_trips++;
+	trip_index.emplace(&trip, idx);
+	return idx;
+}
+
+void chunk_writer::put_site(const struct dive_site &ds)
+{
+	std::vector<taxonomy_record> taxonomy;
+	for (const struct taxonomy &t: ds.taxonomy)
+		taxonomy.push_back({ t.category, t.origin, put_string(t.value) });
+
+	site_record r = {};
+	r.uuid = ds.uuid;
+	r.latitude = ds.location.lat.udeg;
+	r.longitude = ds.location.lon.udeg;
+	r.name = put_string(ds.name);
+	r.description = put_string(ds.description);
+	r.notes = put_string(ds.notes);
+	r.taxonomy = put_array(taxonomy);
+	append_record(sites, r);
+	header.nr_sites++;
+}
+
+dc_record chunk_writer::put_dc(const struct divecomputer &dc)
+{
+	std::vector<event_record> events;
+	for (const struct event &ev: dc.events) {
+		event_record e = {};
+		e.time = ev.time.seconds;
+		e.type = ev.type;
+		e.flags = ev.flags;
+		e.value = ev.value;
+		e.index = ev.gas.index;
+		e.o2 = ev.gas.mix.o2.permille;
+		e.he = ev.gas.mix.he.permille;
+		e.hidden = ev.hidden;
+		e.name = put_string(ev.name);
+		events.push_back(e);
+	}
+	std::vector<extra_data_record> extra_data;
+	for (const struct extra_data &ed: dc.extra_data)
+		extra_data.push_back({ put_string(ed.key), put_string(ed.value) });
+
+	dc_record r = {};
+	r.when = dc.when;
+	r.duration = dc.duration.seconds;
+	r.surfacetime = dc.surfacetime.seconds;
+	r.last_manual_time = dc.last_manual_time.seconds;
+	r.maxdepth = dc.maxdepth.mm;
+	r.meandepth = dc.meandepth.mm;
+	r.airtemp = dc.airtemp.mkelvin;
+	r.watertemp = dc.watertemp.mkelvin;
+	r.surface_pressure = dc.surface_pressure.mbar;
+	r.divemode = dc.divemode;
+	r.no_o2sensors = dc.no_o2sensors;
+	r.salinity = dc.salinity;
+	r.model = put_string(dc.model);
+	r.serial = put_string(dc.serial);
+	r.fw_version = put_string(dc.fw_version);
+	r.deviceid = dc.deviceid;
+	r.diveid = dc.diveid;
+	r.events = put_array(events);
+	r.extra_data = put_array(extra_data);
+
+	// Packed samples are written as they are
+	r.samples_offset = (uint32_t)samples.size();
+	if (dc.samples_pending && !dc.packed_samples.empty()) {
+		samples.append(dc.packed_samples);
+		r.samples_count = (uint32_t)dc.packed_count;
+		r.samples_channels = dc.packed_channels;
+	} else if (!dc.samples.empty()) {
+		membuffer b;
+		encode_samples(&b, dc.samples);
+		samples.append(b.buffer, b.len);
+		r.samples_count = (uint32_t)dc.samples.size();
+		r.samples_channels = sample_channels(dc.samples);
+	}
+	r.samples_size = (uint32_t)(samples.size() - r.samples_offset);
+	return r;
+}
+
+void chunk_writer::put_dive(const struct dive &d)
+{
+	// Samples that are still in the git repository have to be loaded
+	for (const divecomputer &dc: d.dcs) {
+		if (dc.samples_pending && dc.packed_samples.empty()) {
+			d.load_samples();
+			break;
+		}
+	}
+
+	std::vector<cylinder_record> cylinders;
+	for (const cylinder_t &cyl: d.cylinders) {
+		cylinder_record c = {};
+		c.size = cyl.type.size.mliter;
+		c.workingpressure = cyl.type.workingpressure.mbar;
+		c.description = put_string(cyl.type.description);
+		c.o2 = cyl.gasmix.o2.permille;
+		c.he = cyl.gasmix.he.permille;
+		c.start = cyl.start.mbar;
+		c.end = cyl.end.mbar;
+		c.sample_start = cyl.sample_start.mbar;
+		c.sample_end = cyl.sample_end.mbar;
+		c.depth = cyl.depth.mm;
+		c.gas_used = cyl.gas_used.mliter;
+		c.deco_gas_used = cyl.deco_gas_used.mliter;
+		c.use = cyl.cylinder_use;
+		c.flags = (cyl.manually_added ? CYLINDER_MANUALLY_ADDED : 0) |
+			  (cyl.bestmix_o2 ? CYLINDER_BESTMIX_O2 : 0) |
+			  (cyl.bestmix_he ? CYLINDER_BESTMIX_HE : 0);
+		cylinders.push_back(c);
+	}
+	std::vector<weightsystem_record> weightsystems;
+	for (const weightsystem_t &ws: d.weightsystems)
+		weightsystems.push_back({ ws.weight.grams, ws.auto_filled, put_string(ws.description) });
+	std::vector<string_ref> tags;
+	for (const divetag *tag: d.tags)
+		tags.push_back(put_string(tag->source.empty() ? tag->name : tag->source));
+	std::vector<dc_record> dcs;
+	for (const divecomputer &dc: d.dcs)
+		dcs.push_back(put_dc(dc));
+	std::vector<picture_record> pictures;
+	for (const picture &pic: d.pictures)
+		pictures.push_back({ put_string(pic.filename), pic.offset.seconds, pic.location.lat.udeg, pic.location.lon.udeg });
+
+	dive_record r = {};
+	r.when = d.when;
+	r.site = d.dive_site ? d.dive_site->uuid : 0;
+	r.trip = d.divetrip ? put_trip(*d.divetrip) : -1;
+	r.number = d.number;
+	r.rating = d.rating;
+	r.wavesize = d.wavesize;
+	r.current = d.current;
+	r.visibility = d.visibility;
+	r.surge = d.surge;
+	r.chill = d.chill;
+	r.sac = d.sac;
+	r.otu = d.otu;
+	r.cns = d.cns;
+	r.maxcns = d.maxcns;
+	r.mintemp = d.mintemp.mkelvin;
+	r.maxtemp = d.maxtemp.mkelvin;
+	r.watertemp = d.watertemp.mkelvin;
+	r.airtemp = d.airtemp.mkelvin;
+	r.maxdepth = d.maxdepth.mm;
+	r.meandepth = d.meandepth.mm;
+	r.surface_pressure = d.surface_pressure.mbar;
+	r.duration = d.duration.seconds;
+	r.salinity = d.salinity;
+	r.user_salinity = d.user_salinity;
+	r.flags = (d.notrip ? DIVE_NOTRIP : 0) | (d.invalid ? DIVE_INVALID : 0);
+	r.notes = put_string(d.notes);
+	r.diveguide = put_string(d.diveguide);
+	r.buddy = put_string(d.buddy);
+	r.suit = put_string(d.suit);
+	r.cylinders = put_array(cylinders);
+	r.weightsystems = put_array(weightsystems);
+	r.tags = put_array(tags);
+	r.dcs = put_array(dcs);
+	r.pictures = put_array(pictures);
+	append_record(dives, r);
+	header.nr_dives++;
+}
+
+void chunk_writer::put_device(const struct device &dev)
+{
+	device_record r = {};
+	r.model = put_string(dev.model);
+	r.serial = put_string(dev.serialNumber);
+	r.nickname = put_string(dev.nickName);
+	r.deviceid = dev.deviceId;
+	append_record(devices, r);
+	header.nr_devices++;
+}
+
+void chunk_writer::put_fingerprint(const struct fingerprint_record &fp)
+{
+	fingerprint_record_data r = {};
+	r.model = fp.model;
+	r.serial = fp.serial;
+	r.deviceid = fp.fdeviceid;
+	r.diveid = fp.fdiveid;
+	r.data = put_bytes((const char *)fp.raw_data.get(), fp.fsize);
+	append_record(fingerprints, r);
+	header.nr_fingerprints++;
+}
+
+void chunk_writer::put_preset(const struct filter_preset &preset)
+{
+	std::vector<constraint_record> constraints;
+	for (const filter_constraint &constraint: preset.data.constraints) {
+		constraint_record c = {};
+		c.type = put_string(filter_constraint_type_to_string(constraint.type));
+		if (filter_constraint_has_string_mode(constraint.type))
+			c.string_mode = put_string(filter_constraint_string_mode_to_string(constraint.string_mode));
+		if (filter_constraint_has_range_mode(constraint.type))
+			c.range_mode = put_string(filter_constraint_range_mode_to_string(constraint.range_mode));
+		c.data = put_string(filter_constraint_data_to_string(constraint));
+		c.negate = constraint.negate;
+		constraints.push_back(c);
+	}
+
+	preset_record r = {};
+	r.name = put_string(preset.name);
+	r.fulltext = put_string(preset.fulltext_query());
+	r.fulltext_mode = put_string(preset.fulltext_mode());
+	r.constraints = put_array(constraints);
+	append_record(presets, r);
+	header.nr_presets++;
+}
+
+std::string chunk_writer::finish()
+{
+	std::string res;
+	res.reserve(sizeof(header) + sites.size() + trips.size() + dives.size() + devices.size() +
+		    fingerprints.size() + presets.size() + arrays.size() + strings.size() + samples.size());
+	memcpy(header.magic, chunk_magic, sizeof(chunk_magic));
+	header.arrays_offset = (uint32_t)(sites.size() + trips.size() + dives.size() + devices.size() +
+					  fingerprints.size() + presets.size());
+	header.arrays_size = (uint32_t)arrays.size();
+	header.strings_offset = header.arrays_offset + header.arrays_size;
+	header.strings_size = (uint32_t)strings.size();
+	header.samples_offset = header.strings_offset + header.strings_size;
+	header.samples_size = (uint32_t)samples.size();
+	header.size = header.samples_offset + header.samples_size;
+	res.append((const char *)&header, sizeof(header));
+	for (const std::string *part: { &sites, &trips, &dives, &devices, &fingerprints, &presets, &arrays, &strings, &samples })
+		res.append(*part);
+	return res;
+}
+
+static bool write_all(int fd, const std::string &data)
+{
+	size_t done = 0;
+	while (done < data.size()) {
+		ssize_t n = write(fd, data.data() + done, data.size() - done);
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+int save_binary_log(const char *filename, const struct divelog &log, bool select_only)
+{
+	chunk_writer chunk;
+	for (const auto &ds: log.sites) {
+		/* Like the XML files: no empty sites, and only the used ones of a selection */
+		if (ds->is_empty() || (select_only && !ds->is_selected()))
+			continue;
+		chunk.put_site(*ds);
+	}
+	for (const auto &d: log.dives) {
+		if (!select_only || d->selected)
+			chunk.put_dive(*d);
+	}
+	for (const device &dev: log.devices)
+		chunk.put_device(dev);
+	for (const fingerprint_record &fp: fingerprints)
+		chunk.put_fingerprint(fp);
+	for (const filter_preset &preset: log.filter_presets)
+		chunk.put_preset(preset);
+
+	file_header header = {};
+	memcpy(header.magic, file_magic, sizeof(file_magic));
+	header.version = BINARYLOG_VERSION;
+	header.byte_order = byte_order_mark;
+	header.flags = log.autogroup ? FILE_AUTOGROUP : 0;
+	std::string data((const char *)&header, sizeof(header));
+	data += chunk.finish();
+
+	int fd = subsurface_open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (fd < 0)
+		return report_error(translate("gettextFromC", "Failed to save dives to %s (%s)"), filename, strerror(errno));
+	bool ok = write_all(fd, data);
+	if (close(fd))
+		ok = false;
+	if (!ok)
+		return report_error(translate("gettextFromC", "Failed to save dives to %s (%s)"), filename, strerror(errno));
+	return 0;
+}
+
+static bool check_header(const file_header &header)
+{
+	return !memcmp(header.magic, file_magic, sizeof(file_magic)) &&
+	       header.version == BINARYLOG_VERSION &&
+	       header.byte_order == byte_order_mark;
+}
+
+int append_binary_log(const char *filename, const std::vector<const dive *> &dives)
+{
+	if (dives.empty())
+		return 0;
+	chunk_writer chunk;
+	std::vector<const dive_site *> sites;
+	for (const dive *d: dives) {
+		if (d->dive_site && std::find(sites.begin(), sites.end(), d->dive_site) == sites.end()) {
+			sites.push_back(d->dive_site);
+			chunk.put_site(*d->dive_site);
+		}
+		chunk.put_dive(*d);
+	}
+	std::string data = chunk.finish();
+
+	int fd = subsurface_open(filename, O_RDWR | O_BINARY, 0666);
+	if (fd < 0)
+		return report_error(translate("gettextFromC", "Failed to save dives to %s (%s)"), filename, strerror(errno));
+	file_header header;
+	bool ok = read(fd, &header, sizeof(header)) == sizeof(header) && check_header(header);
+	if (!ok) {
+		close(fd);
+		return report_error(translate("gettextFromC", "'%s' is not a binary logbook"), filename);
+	}
+	ok = lseek(fd, 0, SEEK_END) >= 0 && write_all(fd, data);
+	if (close(fd))
+		ok = false;
+	if (!ok)
+		return report_error(translate("gettextFromC", "Failed to save dives to %s (%s)"), filename, strerror(errno));
+	return 0;
+}
+
+namespace {
+
+// Reads the records of a chunk. Every reference is checked against the
+// size of its area. A bad reference gives an empty result and marks the
+// chunk as corrupt.
+class chunk_reader {
+public:
+	chunk_reader(std::string_view data, const chunk_header &header);
+	bool ok = true;
+
+	template <typename R>
+	R record(size_t table_offset, size_t idx);
+	std::string string(string_ref ref);
+	template <typename R>
+	std::vector<R> array(array_ref ref);
+	std::string_view sample_block(uint32_t offset, uint32_t size);
+
+	size_t sites_offset, trips_offset, dives_offset;
+	size_t devices_offset, fingerprints_offset, presets_offset;
+private:
+	std::string_view data, arrays, strings, samples;
+};
+
+}
+
+chunk_reader::chunk_reader(std::string_view data_in, const chunk_header &header) : data(data_in)
+{
+	uint64_t tables = (uint64_t)header.nr_sites * sizeof(site_record) + (uint64_t)header.nr_trips * sizeof(trip_record) +
+			  (uint64_t)header.nr_dives * sizeof(dive_record) + (uint64_t)header.nr_devices * sizeof(device_record) +
+			  (uint64_t)header.nr_fingerprints * sizeof(fingerprint_record_data) +
+			  (uint64_t)header.nr_presets * sizeof(preset_record);
+	if (tables != header.arrays_offset ||
+	    (uint64_t)header.arrays_offset + header.arrays_size != header.strings_offset ||
+	    (uint64_t)header.strings_offset + header.strings_size != header.samples_offset ||
+	    (uint64_t)header.samples_offset + header.samples_size != data.size()) {
+		ok = false;
+		return;
+	}
+	sites_offset = 0;
+	trips_offset = sites_offset + header.nr_sites * sizeof(site_record);
+	dives_offset = trips_offset + header.nr_trips * sizeof(trip_record);
+	devices_offset = dives_offset + header.nr_dives * sizeof(dive_record);
+	fingerprints_offset = devices_offset + header.nr_devices * sizeof(device_record);
+	presets_offset = fingerprints_offset + header.nr_fingerprints * sizeof(fingerprint_record_data);
+	arrays = data.substr(header.arrays_offset, header.arrays_size);
+	strings = data.substr(header.strings_offset, header.strings_size);
+	samples = data.substr(header.samples_offset, header.samples_size);
+}
+
+template <typename R>
+R chunk_reader::record(size_t table_offset, size_t idx)
+{
+	R r;
+	memcpy(&r, data.data() + table_offset + idx * sizeof(R), sizeof(R));
+	return r;
+}
+
+std::string chunk_reader::string(string_ref ref)
+{
+	if ((uint64_t)ref.offset + ref.size > strings.size()) {
+		ok = false;
+		return std::string();
+	}
+	return std::string(strings.substr(ref.offset, ref.size));
+}
+
+template <typename R>
+std::vector<R> chunk_reader::array(array_ref ref)
+{
+	std::vector<R> res;
+	if ((uint64_t)ref.offset + (uint64_t)ref.count * sizeof(R) > arrays.size()) {
+		ok = false;
+		return res;
+	}
+	res.resize(ref.count);
+	if (ref.count)
+		memcpy(res.data(), arrays.data() + ref.offset, ref.count * sizeof(R));
+	return res;
+}
+
+std::string_view chunk_reader::sample_block(uint32_t offset, uint32_t size)
+{
+	if ((uint64_t)offset + size > samples.size()) {
+		ok = false;
+		return std::string_view();
+	}
+	return samples.substr(offset, size);
+}
+
+static void read_dc(chunk_reader &chunk, const dc_record &r, struct divecomputer &dc)
+{
+	dc.when = r.when;
+	dc.duration.seconds = r.duration;
+	dc.surfacetime.seconds = r.surfacetime;
+	dc.last_manual_time.seconds = r.last_manual_time;
+	dc.maxdepth.mm = r.maxdepth;
+	dc.meandepth.mm = r.meandepth;
+	dc.airtemp.mkelvin = r.airtemp;
+	dc.watertemp.mkelvin = r.watertemp;
+	dc.surface_pressure.mbar = r.surface_pressure;
+	dc.divemode = (divemode_t)r.divemode;
+	dc.no_o2sensors = (uint8_t)r.no_o2sensors;
+	dc.salinity = r.salinity;
+	dc.model = chunk.string(r.model);
+	dc.serial = chunk.string(r.serial);
+	dc.fw_version = chunk.string(r.fw_version);
+	dc.deviceid = r.deviceid;
+	dc.diveid = r.diveid;
+	for (const event_record &e: chunk.array<event_record>(r.events)) {
+		struct event ev;
+		ev.time.seconds = e.time;
+		ev.type = e.type;
+		ev.flags = e.flags;
+		ev.value = e.value;
+		ev.gas.index = e.index;
+		ev.gas.mix.o2.permille = e.o2;
+		ev.gas.mix.he.permille = e.he;
+		ev.hidden = e.hidden;
+		ev.name = chunk.string(e.name);
+		dc.events.push_back(std::move(ev));
+	}
+	for (const extra_data_record &ed: chunk.array<extra_data_record>(r.extra_data))
+		dc.extra_data.push_back({ chunk.string(ed.key), chunk.string(ed.value) });
+
+	// The samples are decoded when they are accessed
+	if (r.samples_count) {
+		std::string_view block = chunk.sample_block(r.samples_offset, r.samples_size);
+		dc.packed_samples.assign(block.data(), block.size());
+		dc.packed_count = r.samples_count;
+		dc.packed_channels = r.samples_channels;
+		dc.samples_pending = !dc.packed_samples.empty();
+	}
+}
+
+static std::unique_ptr<dive> read_dive(chunk_reader &chunk, const dive_record &r)
+{
+	auto d = std::make_unique<dive>();
+	d->when = r.when;
+	d->number = r.number;
+	d->rating = r.rating;
+	d->wavesize = r.wavesize;
+	d->current = r.current;
+	d->visibility = r.visibility;
+	d->surge = r.surge;
+	d->chill = r.chill;
+	d->sac = r.sac;
+	d->otu = r.otu;
+	d->cns = r.cns;
+	d->maxcns = r.maxcns;
+	d->mintemp.mkelvin = r.mintemp;
+	d->maxtemp.mkelvin = r.maxtemp;
+	d->watertemp.mkelvin = r.watertemp;
+	d->airtemp.mkelvin = r.airtemp;
+	d->maxdepth.mm = r.maxdepth;
+	d->meandepth.mm = r.meandepth;
+	d->surface_pressure.mbar = r.surface_pressure;
+	d->duration.seconds = r.duration;
+	d->salinity = r.salinity;
+	d->user_salinity = r.user_salinity;
+	d->notrip = r.flags & DIVE_NOTRIP;
+	d->invalid = r.flags & DIVE_INVALID;
+	d->notes = chunk.string(r.notes);
+	d->diveguide = chunk.string(r.diveguide);
+	d->buddy = chunk.string(r.buddy);
+	d->suit = chunk.string(r.suit);
+
+	for (const cylinder_record &c: chunk.array<cylinder_record>(r.cylinders)) {
+		cylinder_t cyl;
+		cyl.type.size.mliter = c.size;
+		cyl.type.workingpressure.mbar = c.workingpressure;
+		cyl.type.description = chunk.string(c.description);
+		cyl.gasmix.o2.permille = c.o2;
+		cyl.gasmix.he.permille = c.he;
+		cyl.start.mbar = c.start;
+		cyl.end.mbar = c.end;
+		cyl.sample_start.mbar = c.sample_start;
+		cyl.sample_end.mbar = c.sample_end;
+		cyl.depth.mm = c.depth;
+		cyl.gas_used.mliter = c.gas_used;
+		cyl.deco_gas_used.mliter = c.deco_gas_used;
+		cyl.cylinder_use = (cylinderuse)c.use;
+		cyl.manually_added = c.flags & CYLINDER_MANUALLY_ADDED;
+		cyl.bestmix_o2 = c.flags & CYLINDER_BESTMIX_O2;
+		cyl.bestmix_he = c.flags & CYLINDER_BESTMIX_HE;
+		d->cylinders.push_back(std::move(cyl));
+	}
+	for (const weightsystem_record &w: chunk.array<weightsystem_record>(r.weightsystems)) {
+		weight_t weight;
+		weight.grams = w.grams;
+		d->weightsystems.emplace_back(weight, chunk.string(w.description), w.auto_filled);
+	}
+	for (const string_ref &tag: chunk.array<string_ref>(r.tags))
+		taglist_add_tag(d->tags, chunk.string(tag));
+	std::vector<dc_record> dcs = chunk.array<dc_record>(r.dcs);
+	if (!dcs.empty()) {
+		d->dcs.clear();
+		d->dcs.resize(dcs.size());
+		for (size_t i = 0; i < dcs.size(); i++)
+			read_dc(chunk, dcs[i], d->dcs[i]);
+	}
+	for (const picture_record &p: chunk.array<picture_record>(r.pictures)) {
+		picture pic;
+		pic.filename = chunk.string(p.filename);
+		pic.offset.seconds = p.offset;
+		pic.location.lat.udeg = p.latitude;
+		pic.location.lon.udeg = p.longitude;
+		d->pictures.push_back(std::move(pic));
+	}
+	return d;
+}
+
+// Appended dives continue a trip of the previous chunks
+static const timestamp_t trip_continuation = 3 * 24 * 3600;
+
+static dive_trip *continued_trip(const struct divelog &log, const std::string &location,
+				 const std::string &notes, timestamp_t when)
+{
+	for (const auto &trip: log.trips) {
+		if (trip->dives.empty() || trip->location != location || trip->notes != notes)
+			continue;
+		timestamp_t first = trip->dives.front()->when, last = first;
+		for (const dive *d: trip->dives) {
+			first = std::min(first, d->when);
+			last = std::max(last, d->when + d->duration.seconds);
+		}
+		if (when >= first - trip_continuation && when <= last + trip_continuation)
+			return trip.get();
+	}
+	return nullptr;
+}
+
+static bool read_chunk(std::string_view data, const chunk_header &header, struct divelog *log)
+{
+	chunk_reader chunk(data, header);
+	if (!chunk.ok)
+		return false;
+
+	for (uint32_t i = 0; i < header.nr_sites; i++) {
+		site_record r = chunk.record<site_record>(chunk.sites_offset, i);
+		// A later version of a site replaces the earlier one
+		dive_site *ds = log->sites.alloc_or_get(r.uuid);
+		ds->location.lat.udeg = r.latitude;
+		ds->location.lon.udeg = r.longitude;
+		ds->name = chunk.string(r.name);
+		ds->description = chunk.string(r.description);
+		ds->notes = chunk.string(r.notes);
+		ds->taxonomy.clear();
+		for (const taxonomy_record &t: chunk.array<taxonomy_record>(r.taxonomy))
+			ds->taxonomy.push_back({ (taxonomy_category)t.category, chunk.string(t.value), (taxonomy_origin)t.origin });
+	}
+
+	std::vector<trip_record> trips(header.nr_trips);
+	for (uint32_t i = 0; i < header.nr_trips; i++)
+		trips[i] = chunk.record<trip_record>(chunk.trips_offset, i);
+	std::vector<dive_trip *> chunk_trips(header.nr_trips, nullptr);
+	std::vector<std::unique_ptr<dive_trip>> new_trips;
+
+	std::vector<std::unique_ptr<dive>> dives;
+	dives.reserve(header.nr_dives);
+	for (uint32_t i = 0; i < header.nr_dives; i++) {
+		dive_record r = chunk.record<dive_record>(chunk.dives_offset, i);
+		std::unique_ptr<dive> d = read_dive(chunk, r);
+		if (r.site) {
+			dive_site *ds = log->sites.get_by_uuid(r.site);
+			if (ds)
+				ds->add_dive(d.get());
+		}
+		if (r.trip >= 0 && (uint32_t)r.trip < header.nr_trips) {
+			dive_trip *&trip = chunk_trips[r.trip];
+			if (!trip) {
+				std::string location = chunk.string(trips[r.trip].location);
+				std::string notes = chunk.string(trips[r.trip].notes);
+				trip = continued_trip(*log, location, notes, d->when);
+				if (!trip) {
+					new_trips.push_back(std::make_unique<dive_trip>());
+					trip = new_trips.back().get();
+					trip->location = std::move(location);
+					trip->notes = std::move(notes);
+					trip->autogen = trips[r.trip].autogen;
+				}
+			}
+			trip->add_dive(d.get());
+		}
+		dives.push_back(std::move(d));
+	}
+	log->dives.put_multiple(std::move(dives));
+	for (auto &trip: new_trips)
+		log->trips.put(std::move(trip));
+
+	for (uint32_t i = 0; i < header.nr_devices; i++) {
+		device_record r = chunk.record<device_record>(chunk.devices_offset, i);
+		create_device_node(log->devices, chunk.string(r.model), chunk.string(r.serial), chunk.string(r.nickname));
+	}
+	for (uint32_t i = 0; i < header.nr_fingerprints; i++) {
+		fingerprint_record_data r = chunk.record<fingerprint_record_data>(chunk.fingerprints_offset, i);
+		std::string raw = chunk.string(r.data);
+		create_fingerprint_node(fingerprints, r.model, r.serial, (const unsigned char *)raw.data(),
+					(unsigned int)raw.size(), r.deviceid, r.diveid);
+	}
+	for (uint32_t i = 0; i < header.nr_presets; i++) {
+		preset_record r = chunk.record<preset_record>(chunk.presets_offset, i);
+		filter_preset preset;
+		preset.name = chunk.string(r.name);
+		preset.set_fulltext(chunk.string(r.fulltext), chunk.string(r.fulltext_mode));
+		for (const constraint_record &c: chunk.array<constraint_record>(r.constraints))
+			preset.add_constraint(chunk.string(c.type), chunk.string(c.string_mode), chunk.string(c.range_mode),
+					      c.negate, chunk.string(c.data));
+		log->filter_presets.add(preset);
+	}
+	return chunk.ok;
+}
+
+int load_binary_log(const char *filename, struct divelog *log)
+{
+	mapped_file file(filename);
+	if (file.status() < 0)
+		return report_error(translate("gettextFromC", "Failed to read '%s'"), filename);
+	std::string_view data = file.data();
+
+	file_header header;
+	if (data.size() < sizeof(header))
+		return report_error(translate("gettextFromC", "'%s' is not a binary logbook"), filename);
+	memcpy(&header, data.data(), sizeof(header));
+	if (memcmp(header.magic, file_magic, sizeof(file_magic)))
+		return report_error(translate("gettextFromC", "'%s' is not a binary logbook"), filename);
+	if (header.byte_order != byte_order_mark)
+		return report_error(translate("gettextFromC", "'%s' was written on a machine with a different byte order"), filename);
+	if (header.version != BINARYLOG_VERSION)
+		return report_error(translate("gettextFromC", "'%s' is of an unsupported version %d"), filename, (int)header.version);
+	if (header.flags & FILE_AUTOGROUP)
+		log->autogroup = true;
+
+	size_t pos = sizeof(header);
+	while (pos < data.size()) {
+		chunk_header chunk;
+		// A chunk that was cut short (say, by a crash while appending) ends the log
+		if (data.size() - pos < sizeof(chunk)) {
+			report_info("Ignoring truncated chunk in %s", filename);
+			break;
+		}
+		memcpy(&chunk, data.data() + pos, sizeof(chunk));
+		pos += sizeof(chunk);
+		if (memcmp(chunk.magic, chunk_magic, sizeof(chunk_magic)) || chunk.size > data.size() - pos) {
+			report_info("Ignoring truncated chunk in %s", filename);
+			break;
+		}
+		if (!read_chunk(data.substr(pos, chunk.size), chunk, log))
+			return report_error(translate("gettextFromC", "Corrupt binary logbook '%s'"), filename);
+		pos += chunk.size;
+	}
+	return 0;
+}
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0
+// Binary logbook format, which can be loaded without parsing.
+//
+// The file is a header followed by one or more chunks. Each chunk consists
+// of tables of fixed-size records (dive sites, trips, dives, devices,
+// fingerprints and filter presets), an area with the variable-length arrays
+// of the records (cylinders, dive computers, events, ...), an area with the
+// strings and an area with the samples. Records refer to strings and arrays
+// by offset and size. The samples of each dive computer are a block in the
+// column-wise encoding of samplecodec.h.
+//
+// Opening a log maps the file and copies the records into dives. The sample
+// blocks are not decoded: the dive computers keep them packed until the
+// samples are accessed, see compact_samples().
+//
+// New dives are appended as a new chunk, without touching the rest of the
+// file. On load, a dive site of a later chunk replaces the site with the same
+// uuid and a trip is continued if a trip with the same location and notes
+// ends at most three days before. Saving writes everything in a single chunk.
+//
+// All numbers are in native byte order. The header records it and logs
+// written by a machine with a different byte order are rejected.
+#ifndef BINARYLOG_H
+#define BINARYLOG_H
+
+#include <vector>
+
+struct dive;
+struct divelog;
+
+#define BINARYLOG_VERSION 1
+
+extern bool is_binary_log_filename(const char *filename);
+extern int save_binary_log(const char *filename, const struct divelog &log, bool select_only);
+extern int append_binary_log(const char *filename, const std::vector<const dive *> &dives);
+extern int load_binary_log(const char *filename, struct divelog *log);
+
+#endif
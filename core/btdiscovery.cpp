@@ -4,13 +4,13 @@
 #include "downloadfromdcthread.h"
 #include "libdivecomputer.h"
 #include "errorhelper.h"
+#include "pref.h"
 #include <QTimer>
 #include <QLoggingCategory>
 #include <QRegularExpression>
-#include <QElapsedTimer>
-#include <QCoreApplication>
-
-extern QMap<QString, dc_descriptor_t *> descriptorLookup;
+#include <QEventLoop>
+#include <iterator>
+#include <vector>
 
 namespace {
 	QHash<QString, QBluetoothDeviceInfo> btDeviceInfo;
@@ -92,9 +92,67 @@ static struct namePattern name[] = {
 	{ "DiveComputer", "Tecdiving", "DiveComputer.eu" }
 };
 
-static dc_descriptor_t *getDeviceType(QString btName)
+// The Pelagic model codes of the model table, indexed once.
+// A trie over the name prefixes. Of all the prefixes matching a name, the one that
+// comes first in the table wins, so that the order of the table is respected.
+namespace {
+	struct prefixNode {
+		QHash<QChar, int> children;
+		int pattern = -1;	// first entry of the name table ending here
+	};
+}
+
+static const namePattern *findNamePattern(const QString &btName)
+{
+	static const std::vector<prefixNode> trie = [] {
+		std::vector<prefixNode> res(1);
+		for (int i = 0; i < (int)std::size(name); i++) {
+			int node = 0;
+			for (QChar c: QString(name[i].prefix)) {
+				int child = res[node].children.value(c, -1);
+				if (child < 0) {
+					child = (int)res.size();
+					res[node].children.insert(c, child);
+					res.emplace_back();
+				}
+				node = child;
+			}
+			if (res[node].pattern < 0)
+				res[node].pattern = i;
+		}
+		return res;
+	}();
+
+	int best = -1;
+	int node = 0;
+	for (QChar c: btName) {
+		node = trie[node].children.value(c, -1);
+		if (node < 0)
+			break;
+		if (trie[node].pattern >= 0 && (best < 0 || trie[node].pattern < best))
+			best = trie[node].pattern;
+	}
+	return best >= 0 ? &name[best] : nullptr;
+}
+
+static const modelPattern *findModel(uint16_t code)
+{
+	static const QHash<uint16_t, const modelPattern *> models = [] {
+		QHash<uint16_t, const modelPattern *> res;
+		for (const modelPattern &m: model)
+			res.insert(m.model, &m);
+		return res;
+	}();
+	return models.value(code, nullptr);
+}
+
+static dc_descriptor_t *lookupDeviceType(const QString &btName)
 // central function to convert a BT name to a Subsurface known vendor/model pair
 {
+	static const QRegularExpression ratioName("^DS\\d{6}");
+	static const QRegularExpression ratio2021Name("^IX5M\\d{6}|^RATIO-\\d{6}");
+	static const QRegularExpression pelagicName("^[A-Z]{2}\\d{6}");
+	static const QRegularExpression pelagicModelName("^[A-Z]{2}\\d{6}$");
 	QString vendor, product;
 
 	if (btName.startsWith("OSTC")) {
@@ -109,18 +167,17 @@ static dc_descriptor_t *getDeviceType(QString btName)
 		// just use a default product that allows the code to download from the
 		// user's dive computer
 		else product = "OSTC 2";
-	} else if (btName.contains(QRegularExpression("^DS\\d{6}"))) {
+	} else if (btName.contains(ratioName)) {
 		// The Ratio bluetooth name looks like the Pelagic ones,
 		// but that seems to be just happenstance.
 		vendor = "Ratio";
 		product = "iX3M 2021 GPS Easy"; // we don't know which of the Bluetooth models, so set one that supports BLE
-	} else if (btName.contains(QRegularExpression("^IX5M\\d{6}")) ||
-		btName.contains(QRegularExpression("^RATIO-\\d{6}"))) {
+	} else if (btName.contains(ratio2021Name)) {
 		// The 2021 iX3M models (square buttons) report as iX5M,
 		// eventhough the physical model states iX3M.
 		vendor = "Ratio";
 		product = "iX3M 2021 GPS Easy"; // we don't know which of the Bluetooth models, so set one that supports BLE
-	} else if (btName.contains(QRegularExpression("^[A-Z]{2}\\d{6}"))) {
+	} else if (btName.contains(pelagicName)) {
 		// try the Pelagic/Aqualung name patterns
 		// the source of truth for this data is in libdivecomputer/src/descriptor.c
 		// we'd prefer to use the filter functions there but current design makes that really challenging
@@ -128,22 +185,15 @@ static dc_descriptor_t *getDeviceType(QString btName)
 		// show up with a two-byte model code followed by six bytes of serial
 		// number. The model code matches the hex model (so "FQ" is 0x4651,
 		// where 'F' is 46h and 'Q' is 51h in ASCII).
-		for (uint16_t i = 0; i < sizeof(model) / sizeof(struct modelPattern); i++) {
-			QString pattern = QString("^%1%2\\d{6}$").arg(QChar(model[i].model >> 8)).arg(QChar(model[i].model & 0xFF));
-			if (btName.contains(QRegularExpression(pattern))) {
-				vendor = model[i].vendor;
-				product = model[i].product;
-				break;
-			}
-		}
-	} else { // finally try all the string prefix based ones
-		for (uint16_t i = 0; i < sizeof(name) / sizeof(struct namePattern); i++) {
-			if (btName.startsWith(name[i].prefix)) {
-				vendor = name[i].vendor;
-				product = name[i].product;
-				break;
-			}
+		const modelPattern *m = btName.contains(pelagicModelName) ?
+			findModel((uint16_t)((btName[0].unicode() << 8) | btName[1].unicode())) : nullptr;
+		if (m) {
+			vendor = m->vendor;
+			product = m->product;
 		}
+	} else if (const namePattern *n = findNamePattern(btName)) { // finally try all the string prefix based ones
+		vendor = n->vendor;
+		product = n->product;
 	}
 
 	// check if we found a known dive computer
@@ -167,6 +217,41 @@ static dc_descriptor_t *getDeviceType(QString btName)
 	return nullptr;
 }
 
+// Discovery sees the same devices over and over again: remember the answers.
+static dc_descriptor_t *getDeviceType(const QString &btName)
+{
+	static QHash<QString, dc_descriptor_t *> deviceTypes;
+	auto it = deviceTypes.constFind(btName);
+	if (it != deviceTypes.cend())
+		return *it;
+	dc_descriptor_t *res = lookupDeviceType(btName);
+	// Before the list of computers is filled, nothing would be found.
+	if (!descriptorLookup.isEmpty())
+		deviceTypes.insert(btName, res);
+	return res;
+}
+
+// The dive computers downloaded from before are remembered in the preferences,
+// which makes them a cache of Bluetooth addresses of known dive computers.
+static const dive_computer_prefs_t *rememberedDiveComputer(const QString &address)
+{
+	QString needle = address.startsWith("LE:") ? address.mid(3) : address;
+	for (const dive_computer_prefs_t *dc: { &prefs.dive_computer, &prefs.dive_computer1, &prefs.dive_computer2,
+						&prefs.dive_computer3, &prefs.dive_computer4 }) {
+		QString device = QString::fromStdString(dc->device);
+		if (device.startsWith("LE:"))
+			device = device.mid(3);
+		if (!needle.isEmpty() && device.compare(needle, Qt::CaseInsensitive) == 0)
+			return dc;
+	}
+	return nullptr;
+}
+
+static dc_descriptor_t *rememberedDescriptor(const dive_computer_prefs_t *dc)
+{
+	return descriptorLookup.value(QString::fromStdString(dc->vendor).toLower() + QString::fromStdString(dc->product).toLower());
+}
+
 bool matchesKnownDiveComputerNames(QString btName)
 {
 	return getDeviceType(btName) != nullptr;
@@ -296,6 +381,7 @@ void BTDiscovery::btDeviceDiscoveryFinished()
 	for (QBluetoothDeviceInfo device: devList) {
 		report_info("%s %s", qPrintable(device.name()), qPrintable(device.address().toString()));
 	}
+	emit discoveryFinished();
 }
 
 void BTDiscovery::btDeviceDiscovered(const QBluetoothDeviceInfo &device)
@@ -317,6 +403,7 @@ void BTDiscovery::btDeviceDiscovered(const QBluetoothDeviceInfo &device)
 	// refer back to it and don't need to open the separate scanning dialog every
 	// time we try to download from a BT/BLE dive computer.
 	saveBtDeviceInfo(btDeviceAddress(&device, false), device);
+	emit btDeviceInfoSaved(btDeviceAddress(&device, false));
 #endif
 
 	btDeviceDiscoveredMain(this_d, false);
@@ -328,6 +415,11 @@ void BTDiscovery::btDeviceDiscoveredMain(const btPairedDevice &device, bool from
 
 	QString newDevice;
 	dc_descriptor_t *newDC = getDeviceType(device.name);
+	if (!newDC) {
+		// Not all devices advertise their name: maybe we know the address.
+		if (const dive_computer_prefs_t *dc = rememberedDiveComputer(device.address))
+			newDC = rememberedDescriptor(dc);
+	}
 	if (newDC)
 		newDevice = dc_descriptor_get_product(newDC);
 	else
@@ -456,6 +548,11 @@ void BTDiscovery::discoverAddress(QString address)
 	}
 }
 
+bool BTDiscovery::discoveryActive() const
+{
+	return discoveryAgent && discoveryAgent->isActive();
+}
+
 void BTDiscovery::stopAgent()
 {
 	if (!discoveryAgent)
@@ -505,20 +602,42 @@ QBluetoothDeviceInfo getBtDeviceInfo(const QString &devaddr)
 		BTDiscovery::instance()->stopAgent();
 		return btDeviceInfo[devaddr];
 	}
-	if(!btDeviceInfo.keys().contains(devaddr)) {
-		report_info("still looking scan is still running, we should just wait for a few moments");
-		// wait for a maximum of 30 more seconds
-		// yes, that seems crazy, but on my Mac I see this take more than 20 seconds
-		QElapsedTimer timer;
-		timer.start();
-		do {
-			if (btDeviceInfo.keys().contains(devaddr)) {
-				BTDiscovery::instance()->stopAgent();
-				return btDeviceInfo[devaddr];
-			}
-			QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
-			QThread::msleep(100);
-		} while (timer.elapsed() < 30000);
+	// A BLE dive computer we downloaded from before doesn't have to be discovered again:
+	// its address (or, on macOS and iOS, its UUID) is enough to connect to it.
+	const dive_computer_prefs_t *dc = rememberedDiveComputer(devaddr);
+	if (dc && QString::fromStdString(dc->device).startsWith("LE:") && rememberedDescriptor(dc)) {
+		report_info("using the remembered dive computer at %s", qPrintable(devaddr));
+#if defined(Q_OS_MACOS) || defined(Q_OS_IOS)
+		QBluetoothDeviceInfo deviceInfo(QBluetoothUuid(devaddr), QString::fromStdString(dc->device_name), 0);
+#else
+		QBluetoothDeviceInfo deviceInfo(QBluetoothAddress(devaddr), QString::fromStdString(dc->device_name), 0);
+#endif
+		deviceInfo.setCoreConfigurations(QBluetoothDeviceInfo::LowEnergyCoreConfiguration);
+		BTDiscovery::instance()->stopAgent();
+		return deviceInfo;
+	}
+
+	// Wait for the scan to report the device, for a maximum of 30 more seconds
+	// yes, that seems crazy, but on my Mac I see this take more than 20 seconds
+	report_info("still looking scan is still running, we should just wait for a few moments");
+	BTDiscovery *btd = BTDiscovery::instance();
+	QEventLoop loop;
+	QTimer timer;
+	timer.setSingleShot(true);
+	QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+	QObject::connect(btd, &BTDiscovery::discoveryFinished, &loop, &QEventLoop::quit);
+	QObject::connect(btd, &BTDiscovery::btDeviceInfoSaved, &loop, [&loop, &devaddr](const QString &address) {
+		if (address == devaddr)
+			loop.quit();
+	});
+	// It may have been found in the meantime.
+	if (!btDeviceInfo.contains(devaddr) && btd->discoveryActive()) {
+		timer.start(30000);
+		loop.exec();
+	}
+	if (btDeviceInfo.contains(devaddr)) {
+		btd->stopAgent();
+		return btDeviceInfo[devaddr];
 	}
 	report_info("notify user that we can't find %s", qPrintable(devaddr));
 	return QBluetoothDeviceInfo();
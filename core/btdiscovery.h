@@ -49,6 +49,7 @@ public:
 	bool btAvailable() const;
 	void showNonDiveComputers(bool show);
 	void stopAgent();
+	bool discoveryActive() const;
 
 #if defined(Q_OS_ANDROID)
 	void getBluetoothDevices();
@@ -77,5 +78,7 @@ signals:
 	void dcVendorChanged();
 	void dcProductChanged();
 	void dcBtChanged();
+	void btDeviceInfoSaved(const QString &address);
+	void discoveryFinished();
 };
 #endif // BTDISCOVERY_H
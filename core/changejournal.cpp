@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "changejournal.h"
+#include "dive.h"
+#include "divesite.h"
+#include "errorhelper.h"
+#include "membuffer.h"
+#include "parse.h"
+#include "picture.h"
+#include "pref.h"
+#include "trip.h"
+#include "subsurface-qt/divelistnotifier.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QSaveFile>
+#include <algorithm>
+#include <string.h>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// The journal is a cache that never leaves this machine, therefore
+// the numbers are stored in native byte order.
+static const char journal_magic[8] = { 'S', 'S', 'R', 'F', 'J', 'R', 'N', 'L' };
+static const quint32 journal_version = 1;
+static const char record_magic[4] = { 'J', 'R', 'N', 'L' };
+
+struct journal_header {
+	char magic[8];
+	quint32 version;
+	quint32 baseline_size;		// Number of dives in the baseline
+};
+
+struct record_header {
+	char magic[4];
+	quint32 size;			// Size of the payload
+	qint32 kind;
+	qint32 baseline;		// Index in the baseline, -1 for new dives
+	qint64 when;			// Start time of the baseline dive
+	qint32 id;			// Id of new dives
+	quint32 reserved;
+};
+
+// Don't bother compacting a journal with less garbage than that.
+static const qint64 min_garbage_for_compaction = 1024 * 1024;
+
+static void sync_file(QFile &file)
+{
+#ifdef WIN32
+	_commit(file.handle());
+#else
+	fsync(file.handle());
+#endif
+}
+
+ChangeJournal *ChangeJournal::instance()
+{
+	static ChangeJournal self(QString::fromStdString(system_default_directory()));
+	return &self;
+}
+
+ChangeJournal::ChangeJournal(const QString &directoryIn) : directory(directoryIn)
+{
+	// Collect the dives changed by a command and write them once
+	// the command is done, i.e. when we're back in the event loop.
+	flushTimer.setSingleShot(true);
+	flushTimer.setInterval(0);
+	connect(&flushTimer, &QTimer::timeout, this, &ChangeJournal::flush);
+
+	diveListNotifier.connectDiveChanges(this, [this](const dive *d) { touch(d); });
+}
+
+ChangeJournal::~ChangeJournal()
+{
+	// Don't remove the journal: if we get here without close(),
+	// the changes were neither saved nor dropped.
+	file.close();
+}
+
+QString ChangeJournal::journalFilename(const std::string &filename) const
+{
+	QByteArray hash = QCryptographicHash::hash(QByteArray::fromStdString(filename), QCryptographicHash::Sha1);
+	return directory + "/journal-" + hash.toHex() + ".sjr";
+}
+
+void ChangeJournal::touch(const dive *d)
+{
+	if (!d || !file.isOpen())
+		return;
+	// Note: the dive may be owned by an undo command. Only remember the
+	// id, the dive might be freed before the journal is flushed.
+	touchedIds.insert(d->id);
+	scheduleFlush();
+}
+
+void ChangeJournal::scheduleFlush()
+{
+	if (!flushTimer.isActive())
+		flushTimer.start();
+}
+
+int ChangeJournal::open(const std::string &filename)
+{
+	close();
+	if (filename.empty())
+		return 0;
+	logfile = filename;
+	recover();
+	startJournal();
+	return (int)(recoveredLog.dives.size() + recoveredRemoved.size());
+}
+
+void ChangeJournal::reset(const std::string &filename)
+{
+	touchedIds.clear();
+	flushTimer.stop();
+	if (filename != logfile && file.isOpen()) {
+		// Saved under a different name: the old log wasn't changed.
+		file.close();
+		file.remove();
+	}
+	logfile = filename;
+	if (!logfile.empty())
+		startJournal();
+}
+
+void ChangeJournal::close()
+{
+	flushTimer.stop();
+	touchedIds.clear();
+	if (file.isOpen()) {
+		file.close();
+		file.remove();
+	}
+	logfile.clear();
+	baseline.clear();
+	baselineWhen.clear();
+	index.clear();
+	liveBytes = deadBytes = 0;
+	recoveredLog.clear();
+	recoveredRemoved.clear();
+}
+
+// Start a new, empty, journal with the current dives as baseline.
+void ChangeJournal::startJournal()
+{
+	file.close();
+	index.clear();
+	liveBytes = deadBytes = 0;
+	baseline.clear();
+	baselineWhen.clear();
+	baselineWhen.reserve(divelog.dives.size());
+	for (auto &d: divelog.dives) {
+		baseline.emplace(d->id, (qint32)baselineWhen.size());
+		baselineWhen.push_back(d->when);
+	}
+
+	QDir().mkpath(directory);
+	file.setFileName(journalFilename(logfile));
+	if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+		report_info("Cannot open change journal %s", qPrintable(file.fileName()));
+		return;
+	}
+	journal_header header;
+	memcpy(header.magic, journal_magic, sizeof(journal_magic));
+	header.version = journal_version;
+	header.baseline_size = (quint32)baselineWhen.size();
+	if (file.write((const char *)&header, sizeof(header)) != sizeof(header) || !file.flush()) {
+		report_info("Cannot write change journal %s", qPrintable(file.fileName()));
+		file.close();
+		return;
+	}
+	sync_file(file);
+}
+
+// Read the journal of the previous session. A truncated record at the
+// end (say, after a crash while writing) is ignored.
+void ChangeJournal::recover()
+{
+	QFile old(journalFilename(logfile));
+	if (!old.open(QIODevice::ReadOnly))
+		return;
+	QByteArray data = old.readAll();
+	old.close();
+
+	journal_header header;
+	if (data.size() < (qint64)sizeof(header))
+		return;
+	memcpy(&header, data.constData(), sizeof(header));
+	if (memcmp(header.magic, journal_magic, sizeof(journal_magic)) != 0 || header.version != journal_version)
+		return;
+	if (header.baseline_size != divelog.dives.size()) {
+		report_info("Ignoring change journal %s: the log was changed", qPrintable(old.fileName()));
+		return;
+	}
+
+	// Only the last record of each dive counts
+	std::unordered_map<Key, qint64, KeyHash> last;
+	qint64 pos = sizeof(header);
+	while (pos + (qint64)sizeof(record_header) <= data.size()) {
+		record_header rec;
+		memcpy(&rec, data.constData() + pos, sizeof(rec));
+		qint64 payload = pos + sizeof(rec);
+		if (memcmp(rec.magic, record_magic, sizeof(record_magic)) != 0 || payload + rec.size > data.size())
+			break;
+		last[Key { rec.baseline, rec.id }] = pos;
+		pos = payload + rec.size;
+	}
+
+	// Apply in the order the changes were made
+	std::vector<qint64> records;
+	records.reserve(last.size());
+	for (auto [key, offset]: last)
+		records.push_back(offset);
+	std::sort(records.begin(), records.end());
+
+	for (qint64 offset: records) {
+		record_header rec;
+		memcpy(&rec, data.constData() + offset, sizeof(rec));
+		if (rec.baseline >= 0) {
+			if (rec.baseline >= (qint32)divelog.dives.size() || divelog.dives[rec.baseline]->when != rec.when) {
+				report_info("Ignoring change journal record of unknown dive");
+				continue;
+			}
+			recoveredRemoved.push_back(divelog.dives[rec.baseline].get());
+		}
+		if (rec.kind != RECORD_DIVE)
+			continue;
+		std::string xml(data.constData() + offset + sizeof(rec), rec.size);
+		if (parse_xml_buffer(qPrintable(old.fileName()), xml.c_str(), (int)xml.size(), &recoveredLog, nullptr))
+			report_info("Cannot parse change journal record");
+	}
+}
+
+void ChangeJournal::takeRecovered(struct divelog &log, std::vector<dive *> &removed)
+{
+	log = std::move(recoveredLog);
+	recoveredLog.clear();
+	removed = std::move(recoveredRemoved);
+	recoveredRemoved.clear();
+}
+
+void ChangeJournal::append(const Key &key, record_kind kind, const QByteArray &payload, qint64 pos, QByteArray &buf)
+{
+	record_header rec;
+	memcpy(rec.magic, record_magic, sizeof(record_magic));
+	rec.size = (quint32)payload.size();
+	rec.kind = kind;
+	rec.baseline = key.baseline;
+	rec.when = key.baseline >= 0 ? baselineWhen[key.baseline] : 0;
+	rec.id = key.id;
+	rec.reserved = 0;
+
+	Entry entry { pos + buf.size(), (quint32)(sizeof(rec) + payload.size()) };
+	buf.append((const char *)&rec, sizeof(rec));
+	buf.append(payload);
+
+	auto it = index.find(key);
+	if (it != index.end()) {
+		deadBytes += it->second.size;
+		liveBytes -= it->second.size;
+		it->second = entry;
+	} else {
+		index.emplace(key, entry);
+	}
+	liveBytes += entry.size;
+}
+
+void ChangeJournal::flush()
+{
+	flushTimer.stop();
+	if (!file.isOpen() || touchedIds.empty())
+		return;
+
+	std::unordered_map<int, const dive *> dives;
+	for (auto &d: divelog.dives) {
+		if (touchedIds.count(d->id))
+			dives.emplace(d->id, d.get());
+	}
+
+	// All records of one change in one write
+	QByteArray buf;
+	qint64 pos = file.size();
+	for (int id: touchedIds) {
+		auto it = baseline.find(id);
+		Key key { it != baseline.end() ? it->second : -1, id };
+		auto d = dives.find(id);
+		if (d == dives.end()) {
+			// A new dive that was deleted before it was written doesn't need a record.
+			if (key.baseline >= 0 || index.count(key))
+				append(key, RECORD_DELETED, QByteArray(), pos, buf);
+			continue;
+		}
+		membuffer mb;
+		save_one_dive_as_log_to_mb(&mb, *d->second);
+		append(key, RECORD_DIVE, QByteArray(mb.buffer, (int)mb.len), pos, buf);
+	}
+	touchedIds.clear();
+
+	if (!file.seek(pos) || file.write(buf) != buf.size() || !file.flush()) {
+		// Stop journalling, rather than writing an inconsistent journal.
+		report_info("Cannot write change journal %s", qPrintable(file.fileName()));
+		file.close();
+		return;
+	}
+	sync_file(file);
+
+	if (deadBytes > liveBytes && deadBytes > min_garbage_for_compaction)
+		compact();
+}
+
+// Rewrite the journal with only the last record of every dive, in the order of the old journal.
+void ChangeJournal::compact()
+{
+	std::vector<std::pair<Key, Entry>> entries(index.begin(), index.end());
+	std::sort(entries.begin(), entries.end(),
+		  [](const auto &e1, const auto &e2) { return e1.second.offset < e2.second.offset; });
+
+	QSaveFile out(file.fileName());
+	if (!out.open(QIODevice::WriteOnly))
+		return;
+	journal_header header;
+	memcpy(header.magic, journal_magic, sizeof(journal_magic));
+	header.version = journal_version;
+	header.baseline_size = (quint32)baselineWhen.size();
+	out.write((const char *)&header, sizeof(header));
+
+	qint64 pos = sizeof(header);
+	for (auto &[key, entry]: entries) {
+		if (!file.seek(entry.offset))
+			return;
+		QByteArray record = file.read(entry.size);
+		if (record.size() != (int)entry.size)
+			return;
+		out.write(record);
+		entry.offset = pos;
+		pos += entry.size;
+	}
+
+	// Release the old journal before it is replaced (required on Windows).
+	QString name = file.fileName();
+	file.close();
+	bool committed = out.commit();
+	if (!committed)
+		report_info("Cannot compact change journal %s", qPrintable(name));
+	if (!file.open(QIODevice::ReadWrite)) {
+		report_info("Cannot open change journal %s", qPrintable(name));
+		return;
+	}
+	if (committed) {
+		index.clear();
+		for (auto &[key, entry]: entries)
+			index.emplace(key, entry);
+		deadBytes = 0;
+	}
+}
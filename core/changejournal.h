@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0
+// Append-only journal of the unsaved changes to the dive log.
+//
+// Saving rewrites the whole log, which is too expensive to be done after
+// every edit. Instead, after every change to the dive list (that is, after
+// every executed, undone or redone command), the state of the changed
+// dives is appended to a journal file, which lives next to the preferences.
+// Each record is the XML of one dive (with its dive site and trip) or the
+// note that a dive was deleted, keyed by the position of the dive in the
+// log as it was loaded or last saved. A record supersedes the previous
+// records of the same dive; once the superseded records take more space
+// than the live ones, the journal is compacted.
+//
+// The journal is reset whenever the log is saved and removed when the log
+// is closed. Thus, if a journal is found when opening a log, the application
+// didn't quit cleanly and the changes can be recovered.
+#ifndef CHANGEJOURNAL_H
+#define CHANGEJOURNAL_H
+
+#include "divelog.h"
+#include "units.h"
+
+#include <QFile>
+#include <QObject>
+#include <QTimer>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct dive;
+struct dive_site;
+struct dive_trip;
+
+class ChangeJournal : public QObject {
+	Q_OBJECT
+public:
+	static ChangeJournal *instance();
+	ChangeJournal(const QString &directory);
+	~ChangeJournal();
+
+	// To be called after loading the log: recovers the changes of a
+	// crashed session and starts a new journal, with the dives of the
+	// global divelog as baseline. Returns the number of recovered dives.
+	int open(const std::string &filename);
+	// To be called after saving the log: the log is the new baseline.
+	void reset(const std::string &filename);
+	// To be called when closing the log: the user saved or dropped the changes.
+	void close();
+	// Write the pending changes now. Normally done from the event loop.
+	void flush();
+
+	// Moves the recovered new and modified dives into log and returns
+	// the dives of the global divelog that were modified or deleted.
+	void takeRecovered(struct divelog &log, std::vector<dive *> &removed);
+private:
+	enum record_kind {
+		RECORD_DIVE = 0,
+		RECORD_DELETED = 1
+	};
+	// Baseline dives are identified by their index in the baseline,
+	// new dives by their id (which is only valid during one session).
+	struct Key {
+		qint32 baseline;	// -1 for new dives
+		qint32 id;
+		bool operator==(const Key &k) const { return baseline == k.baseline && (baseline >= 0 || id == k.id); }
+	};
+	struct KeyHash {
+		size_t operator()(const Key &k) const { return std::hash<qint64>()(k.baseline >= 0 ? k.baseline : -(qint64)k.id - 1); }
+	};
+	struct Entry {
+		qint64 offset;		// Offset of the record header
+		quint32 size;		// Size of header and payload
+	};
+
+	QString journalFilename(const std::string &filename) const;
+	void touch(const dive *d);
+	void scheduleFlush();
+	void startJournal();
+	void recover();
+	void append(const Key &key, record_kind kind, const QByteArray &payload, qint64 pos, QByteArray &buf);
+	void compact();
+
+	QString directory;
+	QFile file;
+	QTimer flushTimer;
+	std::string logfile;
+	std::unordered_map<int, qint32> baseline;	// dive id -> index in the baseline
+	std::vector<timestamp_t> baselineWhen;		// to check that the log didn't change
+	std::unordered_set<int> touchedIds;
+	std::unordered_map<Key, Entry, KeyHash> index;
+	qint64 liveBytes = 0;
+	qint64 deadBytes = 0;
+
+	// The changes recovered from the previous session
+	struct divelog recoveredLog;
+	std::vector<dive *> recoveredRemoved;
+};
+
+#endif
@@ -5,6 +5,12 @@
 #include <QNetworkReply>
 #include <QEventLoop>
 #include <QHostAddress>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <algorithm>
+#include <functional>
+#include <vector>
 
 #include "pref.h"
 #include "qthelper.h"
@@ -18,8 +24,7 @@
 #include "checkcloudconnection.h"
 
 CheckCloudConnection::CheckCloudConnection(QObject *parent) :
-	QObject(parent),
-	reply(0)
+	QObject(parent)
 {
 }
 
@@ -31,60 +36,135 @@ CheckCloudConnection::CheckCloudConnection(QObject *parent) :
 #define TEAPOT "/make-latte?number-of-shots=3"
 #define HTTP_I_AM_A_TEAPOT 418
 #define MILK "Linus does not like non-fat milk"
+
+// A successful check is trusted for a minute, so that opening and then
+// syncing a repository doesn't probe the server twice.
+static const int verified_cache_ms = 60 * 1000;
+// The server that won the last race is used without looking up our
+// location for a day.
+static const qint64 picked_server_ttl = 24 * 3600;
+// Delay before racing the next server against the ones already probed.
+static const int probe_stagger_ms = 250;
+
+static QMutex verified_lock;
+static std::string verified_url;
+static QElapsedTimer verified_timer;
+
+// The configured server first, then the other cloud servers.
+static std::vector<std::string> candidate_servers()
+{
+	static const char *cloud_servers[] = { CLOUD_HOST_EU, CLOUD_HOST_US, CLOUD_HOST_E2, CLOUD_HOST_U2 };
+	std::vector<std::string> res { prefs.cloud_base_url };
+	for (const char *server: cloud_servers) {
+		if (!contains(prefs.cloud_base_url, server))
+			res.push_back(format_string_std("https://%s/", server));
+	}
+	return res;
+}
+
 bool CheckCloudConnection::checkServer()
 {
+	{
+		QMutexLocker l(&verified_lock);
+		if (verified_url == prefs.cloud_base_url && verified_timer.isValid() && verified_timer.elapsed() < verified_cache_ms)
+			return true;
+	}
 	if (verbose)
 		report_info("Checking cloud connection...");
 
+	// Probe the servers in a staggered race: if the configured server
+	// doesn't answer quickly (or fails), the next one is probed in parallel,
+	// and so on. The first correct answer wins.
+	std::vector<std::string> servers = candidate_servers();
+	std::vector<QNetworkReply *> replies;
+	size_t failed = 0;
+	std::string winner;
+	int seconds = 0;
+	int timeout = std::max(prefs.cloud_timeout, 1);
+	QNetworkAccessManager mgr;
 	QEventLoop loop;
-	QNetworkAccessManager *mgr = new QNetworkAccessManager();
-	do {
+	QTimer stagger, tick;
+
+	std::function<void()> startProbe;
+	startProbe = [&]() {
+		if (replies.size() >= servers.size())
+			return;
+		const std::string &server = servers[replies.size()];
+		if (!replies.empty()) {
+			report_info("no answer from %s yet, also trying %s", servers[replies.size() - 1].c_str(), server.c_str());
+			git_storage_update_progress(qPrintable(tr("Trying different cloud server...")));
+		}
 		QNetworkRequest request;
 		request.setRawHeader("Accept", "text/plain");
 		request.setRawHeader("User-Agent", getUserAgent().toUtf8());
-		request.setUrl(QString::fromStdString(prefs.cloud_base_url) + TEAPOT);
-		reply = mgr->get(request);
-		QTimer timer;
-		timer.setSingleShot(true);
-		connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
-		connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+		request.setUrl(QString::fromStdString(server) + TEAPOT);
+		QNetworkReply *reply = mgr.get(request);
+		replies.push_back(reply);
 		connect(reply, &QNetworkReply::sslErrors, this, &CheckCloudConnection::sslErrors);
-		for (int seconds = 1; seconds <= prefs.cloud_timeout; seconds++) {
-			timer.start(1000); // wait the given number of seconds (default 5)
-			loop.exec();
-			if (timer.isActive()) {
-				// didn't time out, did we get the right response?
-				timer.stop();
-				if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == HTTP_I_AM_A_TEAPOT &&
-						reply->readAll() == QByteArray(MILK)) {
-					reply->deleteLater();
-					mgr->deleteLater();
-					if (verbose)
-						qWarning() << "Cloud storage: successfully checked connection to cloud server";
-					return true;
-				}
-			} else if (seconds < prefs.cloud_timeout) {
-				QString text = tr("Waiting for cloud connection (%n second(s) passed)", "", seconds);
-				git_storage_update_progress(qPrintable(text));
-			} else {
-				disconnect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
-				reply->abort();
+		connect(reply, &QNetworkReply::finished, &loop, [&, reply, server]() {
+			if (!winner.empty())
+				return;
+			if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == HTTP_I_AM_A_TEAPOT &&
+			    reply->readAll() == QByteArray(MILK)) {
+				winner = server;
+				loop.quit();
+				return;
 			}
+			if (verbose)
+				report_info("connection test to cloud server %s failed %d %s %d", server.c_str(),
+					    static_cast<int>(reply->error()), qPrintable(reply->errorString()),
+					    reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+			if (++failed == servers.size())
+				loop.quit();
+			else if (failed == replies.size())
+				startProbe();	// don't wait for the stagger
+		});
+	};
+	connect(&stagger, &QTimer::timeout, &loop, startProbe);
+	connect(&tick, &QTimer::timeout, &loop, [&]() {
+		if (++seconds >= timeout) {
+			loop.quit();
+			return;
 		}
-		if (verbose)
-			report_info("connection test to cloud server %s failed %d %s %d %s", prefs.cloud_base_url.c_str(),
-				    static_cast<int>(reply->error()), qPrintable(reply->errorString()),
-				    reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(),
-				    qPrintable(reply->readAll()));
-	} while (nextServer());
-	// if none of the servers was reachable, update the user and switch to git_local_only
-	git_storage_update_progress(qPrintable(tr("Cloud connection failed")));
-	git_local_only = true;
-	reply->deleteLater();
-	mgr->deleteLater();
+		QString text = tr("Waiting for cloud connection (%n second(s) passed)", "", seconds);
+		git_storage_update_progress(qPrintable(text));
+	});
+
+	startProbe();
+	stagger.start(probe_stagger_ms);
+	tick.start(1000);
+	loop.exec();
+	stagger.stop();
+	tick.stop();
+	for (QNetworkReply *reply: replies) {
+		if (!reply->isFinished()) {
+			reply->disconnect();
+			reply->abort();
+		}
+	}
+
+	if (winner.empty()) {
+		// if none of the servers was reachable, update the user and switch to git_local_only
+		report_info("failed to connect to any of the Subsurface cloud servers, giving up");
+		git_storage_update_progress(qPrintable(tr("Cloud connection failed")));
+		git_local_only = true;
+		return false;
+	}
+	if (winner != prefs.cloud_base_url) {
+		report_info("failed to connect to %s in time, using %s", prefs.cloud_base_url.c_str(), winner.c_str());
+		prefs.cloud_base_url = winner;
+	}
+	// Start with the fastest server next time.
+	qPrefCloudStorage::store_cloud_base_url(QString::fromStdString(winner));
+	qPrefCloudStorage::set_cloud_server_checked(QDateTime::currentSecsSinceEpoch());
+	{
+		QMutexLocker l(&verified_lock);
+		verified_url = winner;
+		verified_timer.start();
+	}
 	if (verbose)
-		qWarning() << "Cloud storage: unable to connect to cloud server";
-	return false;
+		report_info("Cloud storage: successfully checked connection to cloud server %s", winner.c_str());
+	return true;
 }
 
 void CheckCloudConnection::sslErrors(const QList<QSslError> &errorList)
@@ -94,39 +174,15 @@ void CheckCloudConnection::sslErrors(const QList<QSslError> &errorList)
 		report_info("%s", qPrintable(err.errorString()));
 }
 
-bool CheckCloudConnection::nextServer()
-{
-	struct serverTried {
-		const char *server;
-		bool tried;
-	};
-	static struct serverTried cloudServers[] = {
-		{ CLOUD_HOST_EU, false },
-		{ CLOUD_HOST_US, false },
-		{ CLOUD_HOST_E2, false },
-		{ CLOUD_HOST_U2, false }
-	};
-	const char *server = nullptr;
-	for (serverTried &item: cloudServers) {
-		if (contains(prefs.cloud_base_url, item.server))
-			item.tried = true;
-		else if (item.tried == false)
-			server = item.server;
-	}
-	if (server) {
-		using namespace std::string_literals;
-		std::string base_url = "https://"s + server + "/"s;
-		report_info("failed to connect to %s next server to try: %s", prefs.cloud_base_url.c_str(), base_url.c_str());
-		prefs.cloud_base_url = std::move(base_url);
-		git_storage_update_progress(qPrintable(tr("Trying different cloud server...")));
-		return true;
-	}
-	report_info("failed to connect to any of the Subsurface cloud servers, giving up");
-	return false;
-}
-
 void CheckCloudConnection::pickServer()
 {
+	// A recent race between the servers is better than guessing from the location.
+	qint64 checked = qPrefCloudStorage::cloud_server_checked();
+	if (checked && QDateTime::currentSecsSinceEpoch() - checked < picked_server_ttl) {
+		if (verbose)
+			report_info("%s using recently picked cloud server", __func__);
+		return;
+	}
 	QNetworkRequest request(QString(GET_EXTERNAL_IP_API));
 	request.setRawHeader("Accept", "text/plain");
 	request.setRawHeader("User-Agent", getUserAgent().toUtf8());
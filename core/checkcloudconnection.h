@@ -12,9 +12,6 @@ public:
 	CheckCloudConnection(QObject *parent = 0);
 	bool checkServer();
 	void pickServer();
-private:
-	QNetworkReply *reply;
-	bool nextServer();
 private
 slots:
 	void sslErrors(const QList<QSslError> &errorList);
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "cloudsync.h"
+#include "dive.h"
+#include "divesite.h"
+#include "errorhelper.h"
+#include "git-access.h"
+
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
+// Delays between the sync attempts, in seconds.
+static const int retry_delays[] = { 2, 5, 15, 30 };
+
+CloudSync *CloudSync::instance()
+{
+	static CloudSync self;
+	return &self;
+}
+
+CloudSync::CloudSync()
+{
+	// One sync at a time, in the order the saves happened.
+	pool.setMaxThreadCount(1);
+}
+
+CloudSync::~CloudSync()
+{
+	pool.waitForDone();
+}
+
+void CloudSync::schedule(const struct git_info &info)
+{
+	QMutexLocker l(&lock);
+	pending = Repository { info.url, info.branch, info.username, info.localdir,
+			       (bool)info.is_subsurface_cloud, info.transport };
+	if (running)
+		return;	// The worker will pick it up
+	running = true;
+	QtConcurrent::run(&pool, [this]() { run(); });
+}
+
+bool CloudSync::busy() const
+{
+	QMutexLocker l(&lock);
+	return running;
+}
+
+void CloudSync::waitForFinished()
+{
+	pool.waitForDone();
+}
+
+void CloudSync::run()
+{
+	for (;;) {
+		Repository repository;
+		{
+			QMutexLocker l(&lock);
+			if (!pending) {
+				running = false;
+				return;
+			}
+			repository = std::move(*pending);
+			pending.reset();
+		}
+		emit syncFinished(syncOnce(repository));
+
+		// Nothing else to sync: use the idle time to tidy up the local cache.
+		// This blocks saving, but is only done once a day at most.
+		{
+			QMutexLocker l(&lock);
+			if (pending)
+				continue;
+		}
+		std::lock_guard<std::mutex> guard(git_storage_lock);
+		git_maintain_local_cache(repository.localdir);
+	}
+}
+
+bool CloudSync::syncOnce(const Repository &repository)
+{
+	struct git_info info;
+	info.url = repository.url;
+	info.branch = repository.branch;
+	info.username = repository.username;
+	info.localdir = repository.localdir;
+	info.is_subsurface_cloud = repository.is_subsurface_cloud;
+	info.transport = repository.transport;
+	if (git_repository_open(&info.repo, info.localdir.c_str())) {
+		report_info("cloud sync: cannot open local cache %s", info.localdir.c_str());
+		return false;
+	}
+
+	std::string before = get_sha(info.repo, info.branch);
+	bool success = false;
+	for (size_t attempt = 0; ; ++attempt) {
+		// A failed fetch switches to offline mode. Undo that
+		// as long as we are retrying.
+		git_local_only = false;
+		git_remote_sync_successful = false;
+		sync_with_remote(&info);
+		success = git_remote_sync_successful;
+		if (success || attempt >= std::size(retry_delays))
+			break;
+		report_info("cloud sync: attempt %d failed, retrying in %d s", (int)attempt + 1, retry_delays[attempt]);
+		QThread::sleep(retry_delays[attempt]);
+		// Another save came in while we were waiting. It will sync.
+		QMutexLocker l(&lock);
+		if (pending)
+			return false;
+	}
+	if (!success) {
+		git_local_only = true;
+		return false;
+	}
+
+	// The remote had changes which were merged into the local branch:
+	// load what changed, so that the UI can apply it to the dive list.
+	std::string after = get_sha(info.repo, info.branch);
+	if (!after.empty() && after != before) {
+		struct divelog log;
+		std::vector<git_dive_id> removed;
+		{
+			std::lock_guard<std::mutex> guard(git_storage_lock);
+			if (git_load_changed_dives(&info, before, &log, removed))
+				return true;
+		}
+		if (log.dives.empty() && removed.empty())
+			return true;
+		{
+			QMutexLocker l(&lock);
+			remoteLog = std::move(log);
+			remoteRemoved = std::move(removed);
+			remoteLocaldir = info.localdir;
+		}
+		emit remoteChanges();
+	}
+	return true;
+}
+
+void CloudSync::takeRemoteChanges(const std::string &filename, struct divelog &log, std::vector<dive *> &removed)
+{
+	std::string localdir;
+	std::vector<git_dive_id> removedIds;
+	{
+		QMutexLocker l(&lock);
+		log = std::move(remoteLog);
+		remoteLog.clear();
+		localdir = std::move(remoteLocaldir);
+		remoteLocaldir.clear();
+		removedIds = std::move(remoteRemoved);
+		remoteRemoved.clear();
+	}
+	removed.clear();
+
+	// The user may have opened another file in the meantime.
+	// (is_git_repository() resets the sync state, which is not ours to change.)
+	struct git_info info;
+	bool synced = git_remote_sync_successful;
+	bool same = is_git_repository(filename.c_str(), &info) && info.localdir == localdir;
+	git_remote_sync_successful = synced;
+	if (!same) {
+		log.clear();
+		return;
+	}
+
+	// Dives that were edited locally since loading have no valid id and
+	// are not removed. The importer will merge the remote version into them.
+	std::sort(removedIds.begin(), removedIds.end());
+	for (auto &d: divelog.dives) {
+		if (d->cache_is_valid() && std::binary_search(removedIds.begin(), removedIds.end(), d->git_id))
+			removed.push_back(d.get());
+	}
+
+	// Don't import the sites of the unchanged dives.
+	log.sites.erase(std::remove_if(log.sites.begin(), log.sites.end(),
+				       [](const std::unique_ptr<dive_site> &ds) { return ds->dives.empty(); }),
+			log.sites.end());
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0
+// Synchronization of the local git cache with the remote in the background.
+//
+// When enabled (git_background_sync), saving to a remote git repository
+// only creates the local commit. The fetch, merge and push are then done
+// by a worker thread, which retries with increasing delays if the remote
+// can't be reached. If the remote had changes, the dive directories that
+// differ from the previous commit are loaded and the UI is notified, so that
+// it can apply the new, modified and deleted dives.
+#ifndef CLOUDSYNC_H
+#define CLOUDSYNC_H
+
+#include "divelog.h"
+#include "git-access.h"
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <optional>
+#include <string>
+
+class CloudSync : public QObject {
+	Q_OBJECT
+public:
+	static CloudSync *instance();
+	~CloudSync();
+
+	void schedule(const struct git_info &info);
+	bool busy() const;
+	void waitForFinished();
+
+	// Moves the new and modified dives of the remote into log and returns
+	// the dives of the global divelog that were removed or replaced, if the
+	// changes are for the given file. To be called from the UI thread
+	// after remoteChanges().
+	void takeRemoteChanges(const std::string &filename, struct divelog &log, std::vector<dive *> &removed);
+signals:
+	void remoteChanges();
+	void syncFinished(bool success);
+private:
+	// What we need of a git_info to open the repository again (the
+	// git_info itself owns the repository handle of the saving thread).
+	struct Repository {
+		std::string url;
+		std::string branch;
+		std::string username;
+		std::string localdir;
+		bool is_subsurface_cloud;
+		enum remote_transport transport;
+	};
+	CloudSync();
+	void run();
+	bool syncOnce(const Repository &repository);
+
+	mutable QMutex lock;
+	QThreadPool pool;
+	std::optional<Repository> pending;
+	bool running = false;
+	struct divelog remoteLog;
+	std::vector<git_dive_id> remoteRemoved;
+	std::string remoteLocaldir;	// the local cache remoteLog was loaded from
+};
+
+#endif
@@ -24,6 +24,11 @@
 #include "divelog.h"
 
 #include <libdivecomputer/parser.h>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 #define POUND       0.45359237
 #define FEET        0.3048
@@ -594,9 +599,10 @@ static void cochran_parse_samples(struct dive *dive, const unsigned char *log,
 		*duration = sample_cnt * profile_period - 1;
 }
 
-static void cochran_parse_dive(const unsigned char *decode, unsigned mod,
-			       const unsigned char *in, unsigned size,
-			       struct dive_table &table)
+// Decodes one dive. Only reads the file and the global config, so that
+// the dives can be decoded in parallel. Returns null for corrupt dives.
+static std::unique_ptr<dive> cochran_parse_dive(const unsigned char *decode, unsigned mod,
+						const unsigned char *in, unsigned size)
 {
 	unsigned char *buf = (unsigned char *)malloc(size);
 	struct divecomputer *dc;
@@ -630,7 +636,7 @@ static void cochran_parse_dive(const unsigned char *decode, unsigned mod,
 	if (size < 0x4914 + config.logbook_size) {
 		// Analyst calls this a "Corrupt Beginning Summary"
 		free(buf);
-		return;
+		return nullptr;
 	}
 
 	// Decode log entry (512 bytes + random prefix)
@@ -779,22 +785,22 @@ static void cochran_parse_dive(const unsigned char *decode, unsigned mod,
 		dc->duration.seconds = duration;
 	}
 
-	table.record_dive(std::move(dive));
-
 	free(buf);
+	return dive;
 }
 
-int try_to_open_cochran(const char *, std::string &mem, struct divelog *log)
+int try_to_open_cochran(const char *, std::string_view mem, struct divelog *log)
 {
 	unsigned int i;
 	unsigned int mod;
-	unsigned int *offsets, dive1, dive2;
-	unsigned char *decode = (unsigned char *)mem.data() + 0x40001;
+	const unsigned int *offsets;
+	unsigned int dive1, dive2;
+	const unsigned char *decode = (const unsigned char *)mem.data() + 0x40001;
 
 	if (mem.size() < 0x40000)
 		return 0;
 
-	offsets = (unsigned int *) mem.data();
+	offsets = (const unsigned int *) mem.data();
 	dive1 = offsets[0];
 	dive2 = offsets[1];
 
@@ -804,7 +810,13 @@ int try_to_open_cochran(const char *, std::string &mem, struct divelog *log)
 	mod = decode[0x100] + 1;
 	cochran_parse_header(decode, mod, (unsigned char *)mem.data() + 0x40000, dive1 - 0x40000);
 
-	// Decode each dive
+	// Collect the dives from the offset table. They are independent of
+	// each other, so decode them in parallel and add them in file order.
+	struct cochran_record {
+		unsigned int offset, size;
+		std::unique_ptr<dive> dive;
+	};
+	std::vector<cochran_record> records;
 	for (i = 0; i < 65534; i++) {
 		dive1 = offsets[i];
 		dive2 = offsets[i + 1];
@@ -812,9 +824,22 @@ int try_to_open_cochran(const char *, std::string &mem, struct divelog *log)
 			break;
 		if (dive2 > mem.size())
 			break;
+		records.push_back({ dive1, dive2 - dive1, {} });
+	}
+
+	auto parse = [decode, mod, &mem](cochran_record &r) {
+		r.dive = cochran_parse_dive(decode, mod, (const unsigned char *)mem.data() + r.offset, r.size);
+	};
+#ifndef COCHRAN_DEBUG
+	if (records.size() > 1 && QThread::idealThreadCount() > 1)
+		QtConcurrent::blockingMap(records, parse);
+	else
+#endif
+		std::for_each(records.begin(), records.end(), parse);
 
-		cochran_parse_dive(decode, mod, (unsigned char *)mem.data() + dive1,
-						dive2 - dive1, log->dives);
+	for (auto &r: records) {
+		if (r.dive)
+			log->dives.record_dive(std::move(r.dive));
 	}
 
 	return 1; // no further processing needed
@@ -148,129 +148,99 @@ static void write_ostc_cf(unsigned char data[], unsigned char cf, unsigned char
 		progress_cb(device, DC_EVENT_PROGRESS, &progress, userdata); \
 	} while (0)
 
+// Every dc_device_read() and dc_device_write() is a round trip to the device,
+// so the settings are transferred in blocks of contiguous addresses.
+#define SUUNTO_VYPER_INFO_START           SUUNTO_VYPER_MAXDEPTH
+#define SUUNTO_VYPER_INFO_END             (SUUNTO_VYPER_CUSTOM_TEXT + SUUNTO_VYPER_CUSTOM_TEXT_LENGTH)
+#define SUUNTO_VYPER_SETTINGS_START       SUUNTO_VYPER_SAMPLING_RATE
+#define SUUNTO_VYPER_SETTINGS_END         (SUUNTO_VYPER_ALTITUDE_SAFETY + 1)
+#define SUUNTO_VYPER_ALARMS_START         SUUNTO_VYPER_UNITS
+#define SUUNTO_VYPER_ALARMS_END           (SUUNTO_VYPER_ALARM_DEPTH + 2)
+
 static dc_status_t read_suunto_vyper_settings(dc_device_t *device, DeviceDetails &deviceDetails, dc_event_callback_t progress_cb, void *userdata)
 {
-	unsigned char data[SUUNTO_VYPER_CUSTOM_TEXT_LENGTH + 1];
+	unsigned char info[SUUNTO_VYPER_INFO_END - SUUNTO_VYPER_INFO_START];
+	unsigned char settings[SUUNTO_VYPER_SETTINGS_END - SUUNTO_VYPER_SETTINGS_START];
+	unsigned char alarms[SUUNTO_VYPER_ALARMS_END - SUUNTO_VYPER_TIMEFORMAT];
 	dc_status_t rc;
 	dc_event_progress_t progress;
 	progress.current = 0;
-	progress.maximum = 16;
+	progress.maximum = 3;
 
-	rc = dc_device_read(device, SUUNTO_VYPER_COMPUTER_TYPE, data, 1);
-	if (rc == DC_STATUS_SUCCESS) {
-		dc_descriptor_t *desc = get_descriptor(DC_FAMILY_SUUNTO_VYPER, data[0]);
+	rc = dc_device_read(device, SUUNTO_VYPER_INFO_START, info, sizeof(info));
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+	auto at_info = [&info](int address) { return info + address - SUUNTO_VYPER_INFO_START; };
 
-		if (desc) {
-			// We found a supported device
-			// we can safely proceed with reading/writing to this device.
-			deviceDetails.model = dc_descriptor_get_product(desc);
-			dc_descriptor_free(desc);
-		} else {
-			return DC_STATUS_UNSUPPORTED;
-		}
+	dc_descriptor_t *desc = get_descriptor(DC_FAMILY_SUUNTO_VYPER, *at_info(SUUNTO_VYPER_COMPUTER_TYPE));
+	if (desc) {
+		// We found a supported device
+		// we can safely proceed with reading/writing to this device.
+		deviceDetails.model = dc_descriptor_get_product(desc);
+		dc_descriptor_free(desc);
+	} else {
+		return DC_STATUS_UNSUPPORTED;
 	}
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_MAXDEPTH, data, 2);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	const unsigned char *data = at_info(SUUNTO_VYPER_MAXDEPTH);
 	// in ft * 128.0
 	int depth = feet_to_mm(data[0] << 8 ^ data[1]) / 128;
 	deviceDetails.maxDepth = depth;
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_TOTAL_TIME, data, 2);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	data = at_info(SUUNTO_VYPER_TOTAL_TIME);
 	int total_time = data[0] << 8 ^ data[1];
 	deviceDetails.totalTime = total_time;
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_NUMBEROFDIVES, data, 2);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	data = at_info(SUUNTO_VYPER_NUMBEROFDIVES);
 	int number_of_dives = data[0] << 8 ^ data[1];
 	deviceDetails.numberOfDives = number_of_dives;
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_FIRMWARE, data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	data = at_info(SUUNTO_VYPER_FIRMWARE);
 	deviceDetails.firmwareVersion = QString::number(data[0]) + ".0.0";
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_SERIALNUMBER, data, 4);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	data = at_info(SUUNTO_VYPER_SERIALNUMBER);
 	int serial_number = data[0] * 1000000 + data[1] * 10000 + data[2] * 100 + data[3];
 	deviceDetails.serialNo = QString::number(serial_number);
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_CUSTOM_TEXT, data, SUUNTO_VYPER_CUSTOM_TEXT_LENGTH);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	data[SUUNTO_VYPER_CUSTOM_TEXT_LENGTH] = 0;
-	deviceDetails.customText = (const char *)data;
+	data = at_info(SUUNTO_VYPER_CUSTOM_TEXT);
+	deviceDetails.customText = QByteArray((const char *)data, SUUNTO_VYPER_CUSTOM_TEXT_LENGTH).constData();
 	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_SAMPLING_RATE, data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	deviceDetails.samplingRate = (int)data[0];
-	EMIT_PROGRESS();
-
-	rc = dc_device_read(device, SUUNTO_VYPER_ALTITUDE_SAFETY, data, 1);
+	rc = dc_device_read(device, SUUNTO_VYPER_SETTINGS_START, settings, sizeof(settings));
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
+	deviceDetails.samplingRate = (int)settings[SUUNTO_VYPER_SAMPLING_RATE - SUUNTO_VYPER_SETTINGS_START];
+	data = settings + SUUNTO_VYPER_ALTITUDE_SAFETY - SUUNTO_VYPER_SETTINGS_START;
 	deviceDetails.altitude = data[0] & 0x03;
 	deviceDetails.personalSafety = data[0] >> 2 & 0x03;
 	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_TIMEFORMAT, data, 1);
+	// The time format is read along, the setting in between is skipped when writing.
+	rc = dc_device_read(device, SUUNTO_VYPER_TIMEFORMAT, alarms, sizeof(alarms));
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
-	deviceDetails.timeFormat = data[0] & 0x01;
-	EMIT_PROGRESS();
-
-	rc = dc_device_read(device, SUUNTO_VYPER_UNITS, data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	deviceDetails.units = data[0] & 0x01;
-	EMIT_PROGRESS();
+	auto at_alarms = [&alarms](int address) { return alarms + address - SUUNTO_VYPER_TIMEFORMAT; };
 
-	rc = dc_device_read(device, SUUNTO_VYPER_MODEL, data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	deviceDetails.diveMode = data[0] & 0x03;
-	EMIT_PROGRESS();
+	deviceDetails.timeFormat = *at_alarms(SUUNTO_VYPER_TIMEFORMAT) & 0x01;
+	deviceDetails.units = *at_alarms(SUUNTO_VYPER_UNITS) & 0x01;
+	deviceDetails.diveMode = *at_alarms(SUUNTO_VYPER_MODEL) & 0x03;
 
-	rc = dc_device_read(device, SUUNTO_VYPER_LIGHT, data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	data = at_alarms(SUUNTO_VYPER_LIGHT);
 	deviceDetails.lightEnabled = data[0] >> 7;
 	deviceDetails.light = data[0] & 0x7F;
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_ALARM_DEPTH_TIME, data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	data = at_alarms(SUUNTO_VYPER_ALARM_DEPTH_TIME);
 	deviceDetails.alarmTimeEnabled = data[0] & 0x01;
 	deviceDetails.alarmDepthEnabled = data[0] >> 1 & 0x01;
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_ALARM_TIME, data, 2);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	data = at_alarms(SUUNTO_VYPER_ALARM_TIME);
 	int time = data[0] << 8 ^ data[1];
 	// The stinger stores alarm time in seconds instead of minutes.
 	if (deviceDetails.model == "Stinger")
 		time /= 60;
 	deviceDetails.alarmTime = time;
-	EMIT_PROGRESS();
 
-	rc = dc_device_read(device, SUUNTO_VYPER_ALARM_DEPTH, data, 2);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	data = at_alarms(SUUNTO_VYPER_ALARM_DEPTH);
 	depth = feet_to_mm(data[0] << 8 ^ data[1]) / 128;
 	deviceDetails.alarmDepth = depth;
 	EMIT_PROGRESS();
@@ -283,9 +253,11 @@ static dc_status_t write_suunto_vyper_settings(dc_device_t *device, DeviceDetail
 	dc_status_t rc;
 	dc_event_progress_t progress;
 	progress.current = 0;
-	progress.maximum = 10;
+	progress.maximum = 4;
 	unsigned char data;
-	unsigned char data2[2];
+	unsigned char settings[SUUNTO_VYPER_SETTINGS_END - SUUNTO_VYPER_SETTINGS_START];
+	unsigned char alarms[SUUNTO_VYPER_ALARMS_END - SUUNTO_VYPER_ALARMS_START];
+	auto at_alarms = [&alarms](int address) { return alarms + address - SUUNTO_VYPER_ALARMS_START; };
 	int time;
 
 	// Maybee we should read the model from the device to sanity check it here too..
@@ -301,14 +273,9 @@ static dc_status_t write_suunto_vyper_settings(dc_device_t *device, DeviceDetail
 		return rc;
 	EMIT_PROGRESS();
 
-	data = deviceDetails.samplingRate;
-	rc = dc_device_write(device, SUUNTO_VYPER_SAMPLING_RATE, &data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	EMIT_PROGRESS();
-
-	data = deviceDetails.personalSafety << 2 ^ deviceDetails.altitude;
-	rc = dc_device_write(device, SUUNTO_VYPER_ALTITUDE_SAFETY, &data, 1);
+	settings[SUUNTO_VYPER_SAMPLING_RATE - SUUNTO_VYPER_SETTINGS_START] = deviceDetails.samplingRate;
+	settings[SUUNTO_VYPER_ALTITUDE_SAFETY - SUUNTO_VYPER_SETTINGS_START] = deviceDetails.personalSafety << 2 ^ deviceDetails.altitude;
+	rc = dc_device_write(device, SUUNTO_VYPER_SETTINGS_START, settings, sizeof(settings));
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 	EMIT_PROGRESS();
@@ -319,44 +286,19 @@ static dc_status_t write_suunto_vyper_settings(dc_device_t *device, DeviceDetail
 		return rc;
 	EMIT_PROGRESS();
 
-	data = deviceDetails.units;
-	rc = dc_device_write(device, SUUNTO_VYPER_UNITS, &data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	EMIT_PROGRESS();
-
-	data = deviceDetails.diveMode;
-	rc = dc_device_write(device, SUUNTO_VYPER_MODEL, &data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	EMIT_PROGRESS();
-
-	data = deviceDetails.lightEnabled << 7 ^ (deviceDetails.light & 0x7F);
-	rc = dc_device_write(device, SUUNTO_VYPER_LIGHT, &data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	EMIT_PROGRESS();
-
-	data = deviceDetails.alarmDepthEnabled << 1 ^ deviceDetails.alarmTimeEnabled;
-	rc = dc_device_write(device, SUUNTO_VYPER_ALARM_DEPTH_TIME, &data, 1);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	EMIT_PROGRESS();
-
+	*at_alarms(SUUNTO_VYPER_UNITS) = deviceDetails.units;
+	*at_alarms(SUUNTO_VYPER_MODEL) = deviceDetails.diveMode;
+	*at_alarms(SUUNTO_VYPER_LIGHT) = deviceDetails.lightEnabled << 7 ^ (deviceDetails.light & 0x7F);
+	*at_alarms(SUUNTO_VYPER_ALARM_DEPTH_TIME) = deviceDetails.alarmDepthEnabled << 1 ^ deviceDetails.alarmTimeEnabled;
 	// The stinger stores alarm time in seconds instead of minutes.
 	time = deviceDetails.alarmTime;
 	if (deviceDetails.model == "Stinger")
 		time *= 60;
-	data2[0] = time >> 8;
-	data2[1] = time & 0xFF;
-	rc = dc_device_write(device, SUUNTO_VYPER_ALARM_TIME, data2, 2);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-	EMIT_PROGRESS();
-
-	data2[0] = (int)(mm_to_feet(deviceDetails.alarmDepth) * 128) >> 8;
-	data2[1] = (int)(mm_to_feet(deviceDetails.alarmDepth) * 128) & 0x0FF;
-	rc = dc_device_write(device, SUUNTO_VYPER_ALARM_DEPTH, data2, 2);
+	at_alarms(SUUNTO_VYPER_ALARM_TIME)[0] = time >> 8;
+	at_alarms(SUUNTO_VYPER_ALARM_TIME)[1] = time & 0xFF;
+	at_alarms(SUUNTO_VYPER_ALARM_DEPTH)[0] = (int)(mm_to_feet(deviceDetails.alarmDepth) * 128) >> 8;
+	at_alarms(SUUNTO_VYPER_ALARM_DEPTH)[1] = (int)(mm_to_feet(deviceDetails.alarmDepth) * 128) & 0x0FF;
+	rc = dc_device_write(device, SUUNTO_VYPER_ALARMS_START, alarms, sizeof(alarms));
 	EMIT_PROGRESS();
 	return rc;
 }
@@ -573,10 +573,10 @@ bail:
  * Parses the header of the .add file, returns the number of dives in
  * the archive (must be the same than number of dives in .log file).
  */
-static int wlog_header_parser (std::string &mem)
+static int wlog_header_parser (std::string_view mem)
 {
 	int tmp;
-	unsigned char *runner = (unsigned char *) mem.data();
+	const unsigned char *runner = (const unsigned char *) mem.data();
 	if (!runner)
 		return -1;
 	if (!memcmp(runner, "\x52\x02", 2)) {
@@ -591,7 +591,7 @@ static int wlog_header_parser (std::string &mem)
 
 #define NOTES_LENGTH 256
 #define SUIT_LENGTH 26
-static void wlog_compl_parser(std::string &wl_mem, struct dive *dt_dive, int dcount)
+static void wlog_compl_parser(std::string_view wl_mem, struct dive *dt_dive, int dcount)
 {
 	int tmp = 0, offset = 12 + (dcount * 850),
 	    pos_weight =  offset + 256,
@@ -599,7 +599,7 @@ static void wlog_compl_parser(std::string &wl_mem, struct dive *dt_dive, int dco
 	    pos_tank_init = offset + 266,
 	    pos_suit = offset + 268;
 	char *wlog_notes = NULL, *wlog_suit = NULL;
-	unsigned char *runner = (unsigned char *) wl_mem.data();
+	const unsigned char *runner = (const unsigned char *) wl_mem.data();
 
 	/*
 	 * Extended notes string. Fixed length 256 bytes. 0 padded if not complete
@@ -661,12 +661,12 @@ static void wlog_compl_parser(std::string &wl_mem, struct dive *dt_dive, int dco
  * Main function call from file.c data is allocated (and freed) there.
  * If parsing is aborted due to errors, stores correctly parsed dives.
  */
-int datatrak_import(std::string &mem, std::string &wl_mem, struct divelog *log)
+int datatrak_import(std::string_view mem, std::string_view wl_mem, struct divelog *log)
 {
 	char *runner;
 	int i = 0, numdives = 0, rc = 0;
 
-	char *maxbuf = mem.data() + mem.size();
+	char *maxbuf = (char *)mem.data() + mem.size();
 
 	// Verify fileheader,  get number of dives in datatrak divelog, zero on error
 	numdives = read_file_header((unsigned char *)mem.data());
@@ -679,11 +679,11 @@ int datatrak_import(std::string &mem, std::string &wl_mem, struct divelog *log)
 		int compl_dives_n = wlog_header_parser(wl_mem);
 		if (compl_dives_n != numdives) {
 			report_error("ERROR: Not the same number of dives in .log %d and .add file %d.\nWill not parse .add file", numdives , compl_dives_n);
-			wl_mem.clear();
+			wl_mem = {};
 		}
 	}
 	// Point to the expected begining of 1st. dive data
-	runner = mem.data();
+	runner = (char *)mem.data();
 	JUMP(runner, 12);
 
 	// Sequential parsing. Abort if received NULL from dt_dive_parser.
@@ -19,10 +19,13 @@
 #include <math.h>
 #include <string.h>
 #include <assert.h>
+#include <mutex>
+#include <vector>
 
 #include "deco.h"
 #include "dive.h"
 #include "gas.h"
+#include "perfcounters.h"
 #include "subsurface-string.h"
 #include "errorhelper.h"
 #include "planner.h"
@@ -40,17 +43,13 @@ struct buehlmann_config {
 	double satmult;			//! safety at inert gas accumulation as percentage of effect (more than 100).
 	double desatmult;		//! safety at inert gas depletion as percentage of effect (less than 100).
 	int last_deco_stop_in_mtr;	//! depth of last_deco_stop.
-	double gf_high;			//! gradient factor high (at surface).
-	double gf_low;			//! gradient factor low (at bottom/start of deco calculation).
 	double gf_low_position_min;	//! gf_low_position below surface_min_shallow.
 };
 
-struct buehlmann_config buehlmann_config = {
+static const struct buehlmann_config buehlmann_config = {
 	.satmult = 1.0,
 	.desatmult = 1.0,
 	.last_deco_stop_in_mtr =  0,
-	.gf_high = 0.75,
-	.gf_low = 0.35,
 	.gf_low_position_min = 1.0,
 };
 
@@ -64,10 +63,9 @@ struct vpmb_config {
 	double skin_compression_gammaC;   //! Skin compression gammaC (N / bar = m2).
 	double regeneration_time;         //! Time needed for the bubble to regenerate to the start radius (min).
 	double other_gases_pressure;      //! Always present pressure of other gasses in tissues (bar).
-	short conservatism;		  //! VPM-B conservatism level (0-4)
 };
 
-static struct vpmb_config vpmb_config = {
+static const struct vpmb_config vpmb_config = {
 	.crit_radius_N2 = 0.55,
 	.crit_radius_He = 0.45,
 	.crit_volume_lambda = 199.58,
@@ -76,9 +74,37 @@ static struct vpmb_config vpmb_config = {
 	.skin_compression_gammaC = 2.6040525,	// = 0.257 N/msw
 	.regeneration_time = 20160.0,
 	.other_gases_pressure = 0.1359888,
-	.conservatism = 3
 };
 
+/* The configuration new deco states start out with, see set_gf() and set_vpmb_conservatism() */
+static struct deco_config default_deco_config;
+static std::mutex default_deco_config_lock;
+
+struct deco_config get_deco_config()
+{
+	std::lock_guard<std::mutex> lock(default_deco_config_lock);
+	return default_deco_config;
+}
+
+static thread_local struct deco_stats stats;
+static perf_counter add_segment_calls("add_segment calls");
+
+struct deco_stats &thread_deco_stats()
+{
+	return stats;
+}
+
+deco_copy_counter::deco_copy_counter(const deco_copy_counter &)
+{
+	stats.state_copies++;
+}
+
+deco_copy_counter &deco_copy_counter::operator=(const deco_copy_counter &)
+{
+	stats.state_copies++;
+	return *this;
+}
+
 static const double buehlmann_N2_a[] = { 1.1696, 1.0, 0.8618, 0.7562,
 					 0.62, 0.5043, 0.441, 0.4,
 					 0.375, 0.35, 0.3295, 0.3065,
@@ -153,17 +179,17 @@ static const double vpmb_conservatism_lvls[] = { 1.0, 1.05, 1.12, 1.22, 1.35 };
 
 #define TISSUE_ARRAY_SZ sizeof(ds->tissue_n2_sat)
 
-static double get_crit_radius_He()
+static double get_crit_radius_He(const struct deco_state *ds)
 {
-	if (vpmb_config.conservatism <= 4)
-		return vpmb_config.crit_radius_He * vpmb_conservatism_lvls[vpmb_config.conservatism] * subsurface_conservatism_factor;
+	if (ds->config.vpmb_conservatism <= 4)
+		return vpmb_config.crit_radius_He * vpmb_conservatism_lvls[ds->config.vpmb_conservatism] * subsurface_conservatism_factor;
 	return vpmb_config.crit_radius_He;
 }
 
-static double get_crit_radius_N2()
+static double get_crit_radius_N2(const struct deco_state *ds)
 {
-	if (vpmb_config.conservatism <= 4)
-		return vpmb_config.crit_radius_N2 * vpmb_conservatism_lvls[vpmb_config.conservatism] * subsurface_conservatism_factor;
+	if (ds->config.vpmb_conservatism <= 4)
+		return vpmb_config.crit_radius_N2 * vpmb_conservatism_lvls[ds->config.vpmb_conservatism] * subsurface_conservatism_factor;
 	return vpmb_config.crit_radius_N2;
 }
 
@@ -219,8 +245,8 @@ double tissue_tolerance_calc(struct deco_state *ds, const struct dive *dive, dou
 {
 	int ci = -1;
 	double ret_tolerance_limit_ambient_pressure = 0.0;
-	double gf_high = buehlmann_config.gf_high;
-	double gf_low = buehlmann_config.gf_low;
+	double gf_high = ds->config.gf_high;
+	double gf_low = ds->config.gf_low;
 	double surface = dive->get_surface_pressure().mbar / 1000.0;
 	double lowest_ceiling = 0.0;
 	double tissue_lowest_ceiling[16];
@@ -306,6 +332,47 @@ static double factor(int period_in_seconds, int ci, enum gas_component gas)
 		return 1.0 - exp(-period_in_seconds * 1.155245301e-02 / buehlmann_He_t_halflife[ci]);
 }
 
+/*
+ * The factors of all compartments for one period length. Profiles and
+ * plans use a handful of short periods (the sample interval, one second,
+ * the planner timestep) over and over again. The factors for periods up
+ * to FACTOR_TABLE_PERIODS seconds are therefore computed once, for other
+ * periods the factors of the last period are kept.
+ */
+#define FACTOR_TABLE_PERIODS 300
+
+struct period_factors {
+	int period = -1;
+	double n2[16];
+	double he[16];
+};
+
+static void fill_period_factors(struct period_factors &f, int period_in_seconds)
+{
+	for (int ci = 0; ci < 16; ci++) {
+		f.n2[ci] = factor(period_in_seconds, ci, N2);
+		f.he[ci] = factor(period_in_seconds, ci, HE);
+	}
+	f.period = period_in_seconds;
+}
+
+static const struct period_factors &get_period_factors(int period_in_seconds)
+{
+	static const std::vector<period_factors> table = [] {
+		std::vector<period_factors> res(FACTOR_TABLE_PERIODS + 1);
+		for (int period = 0; period <= FACTOR_TABLE_PERIODS; period++)
+			fill_period_factors(res[period], period);
+		return res;
+	}();
+	static thread_local struct period_factors cache;
+
+	if (period_in_seconds >= 0 && period_in_seconds <= FACTOR_TABLE_PERIODS)
+		return table[period_in_seconds];
+	if (cache.period != period_in_seconds)
+		fill_period_factors(cache, period_in_seconds);
+	return cache;
+}
+
 static double calc_surface_phase(double surface_pressure, double he_pressure, double n2_pressure, double he_time_constant, double n2_time_constant, bool in_planner)
 {
 	double inspired_n2 = (surface_pressure - ((in_planner && (decoMode(true) == VPMB)) ? WV_PRESSURE_SCHREINER : WV_PRESSURE)) * NITROGEN_FRACTION;
@@ -385,11 +452,11 @@ void nuclear_regeneration(struct deco_state *ds, double time)
 	double crushing_radius_N2, crushing_radius_He;
 	for (ci = 0; ci < 16; ++ci) {
 		//rm
-		crushing_radius_N2 = 1.0 / (ds->max_n2_crushing_pressure[ci] / (2.0 * (vpmb_config.skin_compression_gammaC - vpmb_config.surface_tension_gamma)) + 1.0 / get_crit_radius_N2());
-		crushing_radius_He = 1.0 / (ds->max_he_crushing_pressure[ci] / (2.0 * (vpmb_config.skin_compression_gammaC - vpmb_config.surface_tension_gamma)) + 1.0 / get_crit_radius_He());
+		crushing_radius_N2 = 1.0 / (ds->max_n2_crushing_pressure[ci] / (2.0 * (vpmb_config.skin_compression_gammaC - vpmb_config.surface_tension_gamma)) + 1.0 / get_crit_radius_N2(ds));
+		crushing_radius_He = 1.0 / (ds->max_he_crushing_pressure[ci] / (2.0 * (vpmb_config.skin_compression_gammaC - vpmb_config.surface_tension_gamma)) + 1.0 / get_crit_radius_He(ds));
 		//rs
-		ds->n2_regen_radius[ci] = crushing_radius_N2 + (get_crit_radius_N2() - crushing_radius_N2) * (1.0 - exp (-time / vpmb_config.regeneration_time));
-		ds->he_regen_radius[ci] = crushing_radius_He + (get_crit_radius_He() - crushing_radius_He) * (1.0 - exp (-time / vpmb_config.regeneration_time));
+		ds->n2_regen_radius[ci] = crushing_radius_N2 + (get_crit_radius_N2(ds) - crushing_radius_N2) * (1.0 - exp (-time / vpmb_config.regeneration_time));
+		ds->he_regen_radius[ci] = crushing_radius_He + (get_crit_radius_He(ds) - crushing_radius_He) * (1.0 - exp (-time / vpmb_config.regeneration_time));
 	}
 }
 
@@ -429,8 +496,8 @@ void calc_crushing_pressure(struct deco_state *ds, double pressure)
 			if (ds->max_ambient_pressure >= pressure)
 				return;
 
-			n2_inner_pressure = calc_inner_pressure(get_crit_radius_N2(), ds->crushing_onset_tension[ci], pressure);
-			he_inner_pressure = calc_inner_pressure(get_crit_radius_He(), ds->crushing_onset_tension[ci], pressure);
+			n2_inner_pressure = calc_inner_pressure(get_crit_radius_N2(ds), ds->crushing_onset_tension[ci], pressure);
+			he_inner_pressure = calc_inner_pressure(get_crit_radius_He(ds), ds->crushing_onset_tension[ci], pressure);
 
 			n2_crushing_pressure = pressure - n2_inner_pressure;
 			he_crushing_pressure = pressure - he_inner_pressure;
@@ -449,23 +516,29 @@ void add_segment(struct deco_state *ds, double pressure, struct gasmix gasmix, i
 	gas_pressures pressures = fill_pressures(pressure - ((in_planner && (decoMode(true) == VPMB)) ? WV_PRESSURE_SCHREINER : WV_PRESSURE),
 		       gasmix, (double) ccpo2 / 1000.0, divemode);
 
+	stats.add_segment_calls++;
+	add_segment_calls.add();
+	const struct period_factors &f = get_period_factors(period_in_seconds);
+	double satmult = buehlmann_config.satmult;
+	double desatmult = buehlmann_config.desatmult;
+
+	// Report ICD if N2 is more on-gasing than He off-gasing in leading tissue
+	ci = ds->ci_pointing_to_guiding_tissue;
+	double pn2_lead = pressures.n2 - ds->tissue_n2_sat[ci];
+	double phe_lead = pressures.he - ds->tissue_he_sat[ci];
+	if (pn2_lead > 0.0 && phe_lead < 0.0 && pn2_lead * satmult * f.n2[ci] + phe_lead * desatmult * f.he[ci] > 0)
+		icd = true;
+
+	// No branches and no calls, so that the compiler can vectorize this
 	for (ci = 0; ci < 16; ci++) {
 		double pn2_oversat = pressures.n2 - ds->tissue_n2_sat[ci];
 		double phe_oversat = pressures.he - ds->tissue_he_sat[ci];
-		double n2_f = factor(period_in_seconds, ci, N2);
-		double he_f = factor(period_in_seconds, ci, HE);
-		double n2_satmult = pn2_oversat > 0 ? buehlmann_config.satmult : buehlmann_config.desatmult;
-		double he_satmult = phe_oversat > 0 ? buehlmann_config.satmult : buehlmann_config.desatmult;
-
-		// Report ICD if N2 is more on-gasing than He off-gasing in leading tissue
-		if (ci == ds->ci_pointing_to_guiding_tissue && pn2_oversat > 0.0 && phe_oversat < 0.0 &&
-		    pn2_oversat * n2_satmult * n2_f + phe_oversat * he_satmult * he_f > 0)
-			icd = true;
-
-		ds->tissue_n2_sat[ci] += n2_satmult * pn2_oversat * n2_f;
-		ds->tissue_he_sat[ci] += he_satmult * phe_oversat * he_f;
-		ds->tissue_inertgas_saturation[ci] = ds->tissue_n2_sat[ci] + ds->tissue_he_sat[ci];
+		double n2_satmult = pn2_oversat > 0 ? satmult : desatmult;
+		double he_satmult = phe_oversat > 0 ? satmult : desatmult;
 
+		ds->tissue_n2_sat[ci] += n2_satmult * pn2_oversat * f.n2[ci];
+		ds->tissue_he_sat[ci] += he_satmult * phe_oversat * f.he[ci];
+		ds->tissue_inertgas_saturation[ci] = ds->tissue_n2_sat[ci] + ds->tissue_he_sat[ci];
 	}
 	if (decoMode(in_planner) == VPMB)
 		calc_crushing_pressure(ds, pressure);
@@ -473,6 +546,58 @@ void add_segment(struct deco_state *ds, double pressure, struct gasmix gasmix, i
 	return;
 }
 
+/*
+ * Add period_in_seconds over which the pressure changes linearly from
+ * start_pressure to end_pressure. This is the Schreiner equation
+ *	P(t) = P0 + (Pi0 - P0) * (1 - exp(-kt)) + R * (t - (1 - exp(-kt)) / k)
+ * with the inspired inert gas pressure Pi0 at the start and its rate of
+ * change R. It is exact for open circuit, where the inspired pressures are
+ * linear in the ambient pressure. For rebreathers, they are interpolated
+ * between the ends of the segment.
+ *
+ * The closed form only exists for equal on- and off-gassing rates, which
+ * is what buehlmann_config uses.
+ */
+void add_linear_segment(struct deco_state *ds, double start_pressure, double end_pressure, struct gasmix gasmix, int period_in_seconds, int ccpo2, enum divemode_t divemode, int sac, bool in_planner)
+{
+	if (period_in_seconds <= 0 || start_pressure == end_pressure) {
+		add_segment(ds, end_pressure, gasmix, period_in_seconds, ccpo2, divemode, sac, in_planner);
+		return;
+	}
+
+	int ci;
+	bool icd = false;
+	double wv_pressure = (in_planner && (decoMode(true) == VPMB)) ? WV_PRESSURE_SCHREINER : WV_PRESSURE;
+	gas_pressures start = fill_pressures(start_pressure - wv_pressure, gasmix, (double) ccpo2 / 1000.0, divemode);
+	gas_pressures end = fill_pressures(end_pressure - wv_pressure, gasmix, (double) ccpo2 / 1000.0, divemode);
+
+	stats.add_segment_calls++;
+	add_segment_calls.add();
+	const struct period_factors &f = get_period_factors(period_in_seconds);
+	// ln(2)/60 = 1.155245301e-02, see factor()
+	double kt = period_in_seconds * 1.155245301e-02;
+
+	// Report ICD if N2 is more on-gasing than He off-gasing in leading tissue
+	ci = ds->ci_pointing_to_guiding_tissue;
+	double pn2_lead = end.n2 - ds->tissue_n2_sat[ci];
+	double phe_lead = end.he - ds->tissue_he_sat[ci];
+	if (pn2_lead > 0.0 && phe_lead < 0.0 && pn2_lead * f.n2[ci] + phe_lead * f.he[ci] > 0)
+		icd = true;
+
+	for (ci = 0; ci < 16; ci++) {
+		// The part of the change of the inspired pressure the tissue has followed
+		double n2_lag = 1.0 - f.n2[ci] * buehlmann_N2_t_halflife[ci] / kt;
+		double he_lag = 1.0 - f.he[ci] * buehlmann_He_t_halflife[ci] / kt;
+
+		ds->tissue_n2_sat[ci] += (start.n2 - ds->tissue_n2_sat[ci]) * f.n2[ci] + (end.n2 - start.n2) * n2_lag;
+		ds->tissue_he_sat[ci] += (start.he - ds->tissue_he_sat[ci]) * f.he[ci] + (end.he - start.he) * he_lag;
+		ds->tissue_inertgas_saturation[ci] = ds->tissue_n2_sat[ci] + ds->tissue_he_sat[ci];
+	}
+	if (decoMode(in_planner) == VPMB)
+		calc_crushing_pressure(ds, end_pressure);
+	ds->icd_warning = icd;
+}
+
 #if DECO_CALC_DEBUG
 void dump_tissues(struct deco_state *ds)
 {
@@ -499,19 +624,22 @@ void clear_vpmb_state(struct deco_state *ds)
 	ds->max_bottom_ceiling_pressure = 0_bar;
 }
 
+/* Note: the configuration of the deco state is kept */
 void clear_deco(struct deco_state *ds, double surface_pressure, bool in_planner)
 {
 	int ci;
+	struct deco_config config = ds->config;
 
 	*ds = deco_state();
+	ds->config = config;
 	clear_vpmb_state(ds);
 	for (ci = 0; ci < 16; ci++) {
 		ds->tissue_n2_sat[ci] = (surface_pressure - ((in_planner && (decoMode(true) == VPMB)) ? WV_PRESSURE_SCHREINER : WV_PRESSURE)) * N2_IN_AIR / 1000;
 		ds->tissue_he_sat[ci] = 0.0;
 		ds->max_n2_crushing_pressure[ci] = 0.0;
 		ds->max_he_crushing_pressure[ci] = 0.0;
-		ds->n2_regen_radius[ci] = get_crit_radius_N2();
-		ds->he_regen_radius[ci] = get_crit_radius_He();
+		ds->n2_regen_radius[ci] = get_crit_radius_N2(ds);
+		ds->he_regen_radius[ci] = get_crit_radius_He(ds);
 	}
 	ds->gf_low_pressure_this_dive = surface_pressure + buehlmann_config.gf_low_position_min;
 	ds->max_ambient_pressure = 0.0;
@@ -540,7 +668,53 @@ void deco_state_cache::restore(struct deco_state *target, bool keep_vpmb_state)
 		data->first_ceiling_pressure = target->first_ceiling_pressure;
 		data->max_bottom_ceiling_pressure = target->max_bottom_ceiling_pressure;
 	}
+	// The configuration belongs to the calculation, not to the cached state
+	struct deco_config config = target->config;
 	*target = *data;
+	target->config = config;
+}
+
+/* The fields of the deco state that are read by add_segment() */
+static bool same_tissues(const struct deco_state *a, const struct deco_state *b)
+{
+	return !memcmp(a->tissue_n2_sat, b->tissue_n2_sat, sizeof(a->tissue_n2_sat)) &&
+	       !memcmp(a->tissue_he_sat, b->tissue_he_sat, sizeof(a->tissue_he_sat)) &&
+	       !memcmp(a->max_n2_crushing_pressure, b->max_n2_crushing_pressure, sizeof(a->max_n2_crushing_pressure)) &&
+	       !memcmp(a->max_he_crushing_pressure, b->max_he_crushing_pressure, sizeof(a->max_he_crushing_pressure)) &&
+	       !memcmp(a->crushing_onset_tension, b->crushing_onset_tension, sizeof(a->crushing_onset_tension)) &&
+	       a->config.vpmb_conservatism == b->config.vpmb_conservatism &&
+	       a->max_ambient_pressure == b->max_ambient_pressure &&
+	       a->ci_pointing_to_guiding_tissue == b->ci_pointing_to_guiding_tissue;
+}
+
+bool deco_checkpoint::matches(const struct deco_state *ds, bool in_planner_in) const
+{
+	return in_planner == in_planner_in &&
+	       deco_mode == decoMode(in_planner_in) &&
+	       planner_deco_mode == decoMode(true) &&
+	       same_tissues(&before, ds);
+}
+
+void deco_checkpoint::store(const struct deco_state *before_in, const struct deco_state *after_in, bool in_planner_in)
+{
+	in_planner = in_planner_in;
+	deco_mode = decoMode(in_planner_in);
+	planner_deco_mode = decoMode(true);
+	before = *before_in;
+	after = *after_in;
+}
+
+/* Set the fields of the deco state that are written by add_segment() */
+void deco_checkpoint::restore(struct deco_state *target) const
+{
+	memcpy(target->tissue_n2_sat, after.tissue_n2_sat, sizeof(target->tissue_n2_sat));
+	memcpy(target->tissue_he_sat, after.tissue_he_sat, sizeof(target->tissue_he_sat));
+	memcpy(target->tissue_inertgas_saturation, after.tissue_inertgas_saturation, sizeof(target->tissue_inertgas_saturation));
+	memcpy(target->max_n2_crushing_pressure, after.max_n2_crushing_pressure, sizeof(target->max_n2_crushing_pressure));
+	memcpy(target->max_he_crushing_pressure, after.max_he_crushing_pressure, sizeof(target->max_he_crushing_pressure));
+	memcpy(target->crushing_onset_tension, after.crushing_onset_tension, sizeof(target->crushing_onset_tension));
+	target->max_ambient_pressure = after.max_ambient_pressure;
+	target->icd_warning = after.icd_warning;
 }
 
 int deco_allowed_depth(double tissues_tolerance, double surface_pressure, const struct dive *dive, bool smooth)
@@ -562,29 +736,51 @@ int deco_allowed_depth(double tissues_tolerance, double surface_pressure, const
 	return depth;
 }
 
-void set_gf(short gflow, short gfhigh)
+static void set_config_gf(struct deco_config &config, short gflow, short gfhigh)
 {
 	if (gflow != -1)
-		buehlmann_config.gf_low = (double)gflow / 100.0;
+		config.gf_low = (double)gflow / 100.0;
 	if (gfhigh != -1)
-		buehlmann_config.gf_high = (double)gfhigh / 100.0;
+		config.gf_high = (double)gfhigh / 100.0;
 }
 
-void set_vpmb_conservatism(short conservatism)
+static void set_config_vpmb_conservatism(struct deco_config &config, short conservatism)
 {
 	if (conservatism < 0)
-		vpmb_config.conservatism = 0;
+		config.vpmb_conservatism = 0;
 	else if (conservatism > 4)
-		vpmb_config.conservatism = 4;
+		config.vpmb_conservatism = 4;
 	else
-		vpmb_config.conservatism = conservatism;
+		config.vpmb_conservatism = conservatism;
+}
+
+void set_gf(short gflow, short gfhigh)
+{
+	std::lock_guard<std::mutex> lock(default_deco_config_lock);
+	set_config_gf(default_deco_config, gflow, gfhigh);
+}
+
+void set_vpmb_conservatism(short conservatism)
+{
+	std::lock_guard<std::mutex> lock(default_deco_config_lock);
+	set_config_vpmb_conservatism(default_deco_config, conservatism);
+}
+
+void set_gf(struct deco_state *ds, short gflow, short gfhigh)
+{
+	set_config_gf(ds->config, gflow, gfhigh);
+}
+
+void set_vpmb_conservatism(struct deco_state *ds, short conservatism)
+{
+	set_config_vpmb_conservatism(ds->config, conservatism);
 }
 
 double get_gf(struct deco_state *ds, double ambpressure_bar, const struct dive *dive)
 {
 	double surface_pressure_bar = dive->get_surface_pressure().mbar / 1000.0;
-	double gf_low = buehlmann_config.gf_low;
-	double gf_high = buehlmann_config.gf_high;
+	double gf_low = ds->config.gf_low;
+	double gf_high = ds->config.gf_high;
 	double gf;
 	if (ds->gf_low_pressure_this_dive > surface_pressure_bar)
 		gf = std::max((double)gf_low, (ambpressure_bar - surface_pressure_bar) /
@@ -11,7 +11,35 @@ struct dive;
 struct divecomputer;
 struct decostop;
 
+/* The gradient factors and the VPM-B conservatism of a deco calculation */
+struct deco_config {
+	double gf_low = 0.35;
+	double gf_high = 0.75;
+	short vpmb_conservatism = 3;
+};
+
+/* The configuration set by set_gf() and set_vpmb_conservatism() */
+extern struct deco_config get_deco_config();
+
+/* What the deco calculations of the calling thread did, for benchmarks */
+struct deco_stats {
+	long add_segment_calls = 0;
+	long state_copies = 0;
+};
+extern struct deco_stats &thread_deco_stats();
+
+/* Counts the copies of the deco state that it is part of in deco_stats */
+struct deco_copy_counter {
+	deco_copy_counter() = default;
+	deco_copy_counter(const deco_copy_counter &);
+	deco_copy_counter(deco_copy_counter &&) = default;
+	deco_copy_counter &operator=(const deco_copy_counter &);
+	deco_copy_counter &operator=(deco_copy_counter &&) = default;
+};
+
 struct deco_state {
+	deco_copy_counter copy_counter;
+	struct deco_config config = get_deco_config();
 	double tissue_n2_sat[16] = {};
 	double tissue_he_sat[16] = {};
 	double tolerated_by_tissue[16] = {};
@@ -51,8 +79,12 @@ extern int deco_allowed_depth(double tissues_tolerance, double surface_pressure,
 double get_gf(struct deco_state *ds, double ambpressure_bar, const struct dive *dive);
 extern void clear_deco(struct deco_state *ds, double surface_pressure, bool in_planner);
 extern void dump_tissues(struct deco_state *ds);
+/* set the configuration that new deco states start with */
 extern void set_gf(short gflow, short gfhigh);
 extern void set_vpmb_conservatism(short conservatism);
+/* set the configuration of a single deco calculation */
+extern void set_gf(struct deco_state *ds, short gflow, short gfhigh);
+extern void set_vpmb_conservatism(struct deco_state *ds, short conservatism);
 extern void nuclear_regeneration(struct deco_state *ds, double time);
 extern void vpmb_start_gradient(struct deco_state *ds);
 extern void vpmb_next_gradient(struct deco_state *ds, double deco_time, double surface_pressure, bool in_planner);
@@ -61,6 +93,7 @@ extern void calc_crushing_pressure(struct deco_state *ds, double pressure);
 extern void vpmb_start_gradient(struct deco_state *ds);
 extern void clear_vpmb_state(struct deco_state *ds);
 extern void add_segment(struct deco_state *ds, double pressure, struct gasmix gasmix, int period_in_seconds, int setpoint, enum divemode_t divemode, int sac, bool in_planner);
+extern void add_linear_segment(struct deco_state *ds, double start_pressure, double end_pressure, struct gasmix gasmix, int period_in_seconds, int setpoint, enum divemode_t divemode, int sac, bool in_planner);
 
 extern double regressiona(const struct deco_state *ds);
 extern double regressionb(const struct deco_state *ds);
@@ -78,4 +111,21 @@ private:
 	std::unique_ptr<deco_state> data;
 };
 
+/*
+ * The tissue loading caused by a dive only depends on the tissues before
+ * the dive, the dive itself and a few settings. It is kept with the dive
+ * (see dive_table::init_decompression()), so that the deco state of a
+ * repetitive dive doesn't have to be recalculated from the earlier dives
+ * over and over again. dive::invalidate_cache() drops it.
+ */
+struct deco_checkpoint {
+	bool matches(const struct deco_state *ds, bool in_planner) const;
+	void store(const struct deco_state *before, const struct deco_state *after, bool in_planner);
+	void restore(struct deco_state *target) const;
+private:
+	bool in_planner = false;
+	int deco_mode = 0, planner_deco_mode = 0;
+	deco_state before, after;
+};
+
 #endif // DECO_H
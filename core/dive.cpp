@@ -5,8 +5,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include "dive.h"
+#include "deco.h"
 #include "gettext.h"
 #include "subsurface-string.h"
 #include "libdivecomputer.h"
@@ -19,10 +22,12 @@
 #include "extradata.h"
 #include "format.h"
 #include "fulltext.h"
+#include "git-access.h"
 #include "interpolate.h"
 #include "qthelper.h"
 #include "membuffer.h"
 #include "picture.h"
+#include "profile.h"
 #include "range.h"
 #include "sample.h"
 #include "tag.h"
@@ -172,9 +177,8 @@ struct gasmix dive::get_gasmix_from_event(const struct event &ev) const
 // - that's why we have the silly initial number and increment by 3 :-)
 int dive_getUniqID()
 {
-	static int maxId = 83529;
-	maxId += 3;
-	return maxId;
+	static std::atomic<int> maxId = 83529;
+	return maxId += 3;
 }
 
 static void dc_cylinder_renumber(struct dive &dive, struct divecomputer &dc, const int mapping[]);
@@ -1020,6 +1024,10 @@ static void fixup_dc_sample_sensors(struct dive &dive, struct divecomputer &dc)
 
 static void fixup_dive_dc(struct dive &dive, struct divecomputer &dc)
 {
+	/* Samples not loaded yet: this is done once they are, see dive::load_samples() */
+	if (dc.samples_pending)
+		return;
+
 	/* Fixup duration and mean depth */
 	fixup_dc_duration(dc);
 
@@ -1052,6 +1060,14 @@ static void fixup_dive_dc(struct dive &dive, struct divecomputer &dc)
 }
 
 void dive::fixup_no_cylinder()
+{
+	fixup_local();
+	fixup_register_equipment();
+}
+
+// Since this doesn't access any global data, it may run on
+// several dives in parallel.
+void dive::fixup_local()
 {
 	sanitize_cylinder_info(*this);
 	maxcns = cns;
@@ -1074,13 +1090,17 @@ void dive::fixup_no_cylinder()
 	fixup_watertemp(*this);
 	fixup_airtemp(*this);
 	for (auto &cyl: cylinders) {
-		add_cylinder_description(cyl.type);
 		if (same_rounded_pressure(cyl.sample_start, cyl.start))
 			cyl.start = 0_bar;
 		if (same_rounded_pressure(cyl.sample_end, cyl.end))
 			cyl.end = 0_bar;
 	}
+}
 
+void dive::fixup_register_equipment() const
+{
+	for (auto &cyl: cylinders)
+		add_cylinder_description(cyl.type);
 	for (auto &ws: weightsystems)
 		add_weightsystem_description(ws);
 }
@@ -1118,13 +1138,13 @@ static void merge_one_sample(const struct sample &sample, struct divecomputer &d
 			surface.ndl = prev.ndl;
 			surface.time.seconds = last_time + 20;
 
-			append_sample(surface, &dc);
+			dc.samples.push_back(surface);
 
 			surface.time = sample.time - 20_sec;
-			append_sample(surface, &dc);
+			dc.samples.push_back(surface);
 		}
 	}
-	append_sample(sample, &dc);
+	dc.samples.push_back(sample);
 }
 
 static void renumber_last_sample(struct divecomputer &dc, const int mapping[]);
@@ -1157,6 +1177,11 @@ static void merge_samples(struct divecomputer &res,
 		std::swap(cylinders_map_a, cylinders_map_b);
 	}
 
+	/* Every input sample gives at most one output sample, plus the odd
+	 * pair of surface samples. Day-long logs have a lot of samples,
+	 * so avoid growing the vector step by step. */
+	res.samples.reserve(res.samples.size() + (a_end - as) + (b_end - bs) + 4);
+
 	for (;;) {
 		int at = as != a_end ? as->time.seconds : -1;
 		int bt = bs != b_end ? bs->time.seconds + offset : -1;
@@ -1311,6 +1336,7 @@ static void merge_events(struct dive &d, struct divecomputer &res,
 
 	auto a = src1->events.begin();
 	auto b = src2->events.begin();
+	res.events.reserve(res.events.size() + src1->events.size() + src2->events.size() + 2);
 
 	while (a != src1->events.end() || b != src2->events.end()) {
 		int s = 0;
@@ -2047,7 +2073,7 @@ static void remove_redundant_dc(struct dive &d, bool prefer_downloaded)
 		// Remove all following DCs that compare as equal.
 		// Use the (infamous) erase-remove idiom.
 		auto it2 = std::remove_if(std::next(it), d.dcs.end(),
-			    [d, prefer_downloaded, &it] (const divecomputer &dc) {
+			    [prefer_downloaded, &it] (const divecomputer &dc) {
 				return same_dc(*it, dc) ||
 				       (prefer_downloaded && might_be_same_device(*it, dc));
 			    });
@@ -2066,11 +2092,31 @@ static const struct divecomputer *find_matching_computer(const struct divecomput
 	return nullptr;
 }
 
+/*
+ * Copy everything but the samples and events, which are merged
+ * afterwards. Copying them only to throw them away is expensive
+ * for long logs.
+ */
 static void copy_dive_computer(struct divecomputer &res, const struct divecomputer &a)
 {
-	res = a;
-	res.samples.clear();
-	res.events.clear();
+	res.when = a.when;
+	res.duration = a.duration;
+	res.surfacetime = a.surfacetime;
+	res.last_manual_time = a.last_manual_time;
+	res.maxdepth = a.maxdepth;
+	res.meandepth = a.meandepth;
+	res.airtemp = a.airtemp;
+	res.watertemp = a.watertemp;
+	res.surface_pressure = a.surface_pressure;
+	res.divemode = a.divemode;
+	res.no_o2sensors = a.no_o2sensors;
+	res.salinity = a.salinity;
+	res.model = a.model;
+	res.serial = a.serial;
+	res.fw_version = a.fw_version;
+	res.deviceid = a.deviceid;
+	res.diveid = a.diveid;
+	res.extra_data = a.extra_data;
 }
 
 /*
@@ -2086,6 +2132,7 @@ static void interleave_dive_computers(struct dive &res,
 				      const int cylinders_map_a[], const int cylinders_map_b[])
 {
 	res.dcs.clear();
+	res.dcs.reserve(a.dcs.size());
 	for (const auto &dc1: a.dcs) {
 		res.dcs.emplace_back();
 		divecomputer &newdc = res.dcs.back();
@@ -2124,6 +2171,7 @@ static void join_dive_computers(struct dive &d,
 				bool prefer_downloaded)
 {
 	d.dcs.clear();
+	d.dcs.reserve(a.dcs.size() + b.dcs.size());
 	if (!a.dcs[0].model.empty() && b.dcs[0].model.empty()) {
 		copy_dc_renumber(d, a, cylinders_map_a);
 		return;
@@ -2161,6 +2209,9 @@ std::unique_ptr<dive> dive::create_merged_dive(const struct dive &a, const struc
 {
 	auto res = std::make_unique<dive>();
 
+	a.load_samples();
+	b.load_samples();
+
 	if (offset) {
 		/*
 		 * If "likely_same_dive()" returns true, that means that
@@ -2359,6 +2410,9 @@ static constexpr std::array<unsigned char, 20> null_id = {};
 void dive::invalidate_cache()
 {
 	git_id = null_id;
+	deco_cache.reset();
+	invalidate_timelines();
+	invalidate_plot_info_cache(this);
 }
 
 bool dive::cache_is_valid() const
@@ -2491,12 +2545,51 @@ int dive::number_of_computers() const
 	return static_cast<int>(dcs.size());
 }
 
+/*
+ * Parse the samples of a divecomputer of a lazily loaded git logbook
+ * and do the fixups that were skipped because the samples were missing.
+ */
+static void load_dc_samples(struct dive &dive, struct divecomputer &dc)
+{
+	static std::mutex lock;
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (!dc.samples_pending)
+		return;
+	/* Packed samples were fixed up before they were packed */
+	if (!dc.packed_samples.empty()) {
+		expand_samples(dc);
+		return;
+	}
+	git_load_samples(dive, dc);
+	dc.samples_pending = false;
+	fixup_dive_dc(dive, dc);
+}
+
 struct divecomputer *dive::get_dc(int nr)
 {
 	if (dcs.empty()) // Can't happen!
 		return NULL;
 	nr = std::max(0, nr);
-	return &dcs[static_cast<size_t>(nr) % dcs.size()];
+	struct divecomputer *dc = &dcs[static_cast<size_t>(nr) % dcs.size()];
+	if (dc->samples_pending)
+		load_dc_samples(*this, *dc);
+	return dc;
+}
+
+void dive::load_samples() const
+{
+	struct dive &d = const_cast<dive &>(*this);
+	for (auto &dc: d.dcs) {
+		if (dc.samples_pending)
+			load_dc_samples(d, dc);
+	}
+}
+
+void dive::compact_samples()
+{
+	for (auto &dc: dcs)
+		::compact_samples(dc);
 }
 
 const struct divecomputer *dive::get_dc(int nr) const
@@ -2636,6 +2729,100 @@ bool gasmix_loop::has_next() const
 	return first_run || (!dive.cylinders.empty() && next_event);
 }
 
+dc_timeline::dc_timeline(const struct dive &d, const struct divecomputer &dc) :
+	dive(d), dc(&dc), events(dc.events.data()), nr_events(dc.events.size()),
+	nr_cylinders(d.cylinders.size()), initial_divemode(dc.divemode)
+{
+	// Collect the gas changes the same way as gasmix_loop does.
+	if (!d.cylinders.empty()) {
+		gasmix_loop loop(d, dc);
+		for (;;) {
+			auto [idx, time] = loop.next_cylinder_index();
+			if (time == INT_MAX)
+				break;
+			gas.push_back({ time, idx });
+		}
+	}
+	for (const struct event &ev: dc.events) {
+		if (ev.name == "modechange")
+			modes.push_back({ (int)ev.time.seconds, static_cast<divemode_t>(ev.value) });
+	}
+}
+
+bool dc_timeline::matches(const struct divecomputer &dc_in) const
+{
+	return dc == &dc_in && events == dc_in.events.data() && nr_events == dc_in.events.size() &&
+	       nr_cylinders == dive.cylinders.size() && initial_divemode == dc_in.divemode;
+}
+
+std::pair<int, int> dc_timeline::cylinder_index_at(int time) const
+{
+	if (gas.empty())
+		return std::make_pair(-1, INT_MAX);
+
+	// The first gas is used up to the first switch, even before its start time.
+	auto it = std::upper_bound(std::next(gas.begin()), gas.end(), time,
+				   [](int t, const gas_change &change) { return t < change.time; });
+	const gas_change &change = *std::prev(it);
+	return std::make_pair(change.cylinder_index, change.time);
+}
+
+std::pair<gasmix, int> dc_timeline::gasmix_at(int time) const
+{
+	if (dive.cylinders.empty())
+		// return air if we don't have any cylinders
+		return std::make_pair(gasmix_air, 0);
+
+	auto [idx, switch_time] = cylinder_index_at(time);
+	return std::make_pair(idx < 0 ? gasmix_invalid : dive.get_cylinder(idx)->gasmix, switch_time);
+}
+
+divemode_t dc_timeline::divemode_at(int time) const
+{
+	auto it = std::upper_bound(modes.begin(), modes.end(), time,
+				   [](int t, const mode_change &change) { return t < change.time; });
+	return it == modes.begin() ? initial_divemode : std::prev(it)->divemode;
+}
+
+const std::vector<dc_timeline::gas_change> &dc_timeline::gas_changes() const
+{
+	return gas;
+}
+
+const std::vector<dc_timeline::mode_change> &dc_timeline::mode_changes() const
+{
+	return modes;
+}
+
+static std::mutex timeline_cache_lock;
+
+void dive::invalidate_timelines() const
+{
+	std::lock_guard<std::mutex> lock(timeline_cache_lock);
+	timelines.timelines.clear();
+}
+
+/* The timeline is rebuilt if the events of the dive computer obviously
+ * changed, but code that edits events in place has to call invalidate_cache()
+ * or invalidate_timelines(). Dive computers that are not part of this dive
+ * get a fresh, uncached timeline.
+ */
+std::shared_ptr<const dc_timeline> dive::get_timeline(const struct divecomputer &dc) const
+{
+	auto it = std::find_if(dcs.begin(), dcs.end(), [&dc](const divecomputer &dc2) { return &dc2 == &dc; });
+	if (it == dcs.end())
+		return std::make_shared<const dc_timeline>(*this, dc);
+	size_t nr = it - dcs.begin();
+
+	std::lock_guard<std::mutex> lock(timeline_cache_lock);
+	auto &cache = timelines.timelines;
+	if (cache.size() != dcs.size())
+		cache.resize(dcs.size());
+	if (!cache[nr] || !cache[nr]->matches(dc))
+		cache[nr] = std::make_shared<const dc_timeline>(*this, dc);
+	return cache[nr];
+}
+
 /* get the gas at a certain time during the dive */
 /* If there is a gasswitch at that time, it returns the new gasmix */
 struct gasmix dive::get_gasmix_at_time(const struct divecomputer &dc, duration_t time) const
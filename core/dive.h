@@ -21,8 +21,10 @@ extern int last_xml_version;
 extern const char *divemode_text_ui[];
 extern const char *divemode_text[];
 
+struct deco_checkpoint;
 struct dive_site;
 struct dive_table;
+class dc_timeline;
 struct dive_trip;
 struct full_text_cache;
 struct event;
@@ -41,6 +43,17 @@ struct non_copying_unique_ptr : public std::unique_ptr<T> {
 	void operator=(const non_copying_unique_ptr<T> &) { }
 };
 
+/* The gas and divemode timelines of the dive computers, see
+ * dive::get_timeline(). Contrary to the non_copying_unique_ptr, assigning
+ * a dive clears them: the events of the dive computers were replaced.
+ */
+struct timeline_cache {
+	std::vector<std::shared_ptr<const dc_timeline>> timelines;
+	timeline_cache() = default;
+	timeline_cache(const timeline_cache &) { }
+	timeline_cache &operator=(const timeline_cache &) { timelines.clear(); return *this; }
+};
+
 struct dive {
 	struct dive_trip *divetrip = nullptr;
 	timestamp_t when = 0;
@@ -72,6 +85,8 @@ struct dive {
 	bool selected = false;
 	bool hidden_by_filter = false;
 	non_copying_unique_ptr<full_text_cache> full_text; /* word cache for full text search */
+	mutable non_copying_unique_ptr<deco_checkpoint> deco_cache; /* tissue loading, see init_decompression() */
+	mutable timeline_cache timelines;
 	bool invalid = false;
 
 	dive();
@@ -82,13 +97,19 @@ struct dive {
 
 	void invalidate_cache();
 	bool cache_is_valid() const;
+	void invalidate_timelines() const;
+	std::shared_ptr<const dc_timeline> get_timeline(const struct divecomputer &dc) const;
 
 	struct divecomputer *get_dc(int nr);
 	const struct divecomputer *get_dc(int nr) const;
+	void load_samples() const;		/* make sure lazily loaded samples of all divecomputers are there */
+	void compact_samples();			/* keep the samples packed until they are accessed, see compact_samples() */
 
 	void clear();
 	int number_of_computers() const;
 	void fixup_no_cylinder();		/* to fix cylinders, we need the divelist (to calculate cns) */
+	void fixup_local();			/* the part of fixup_no_cylinder() that only touches this dive */
+	void fixup_register_equipment() const;	/* the rest: adds the cylinder and weight types to the global lists */
 	timestamp_t endtime() const;		/* maximum over divecomputers (with samples) */
 	duration_t totaltime() const;		/* maximum over divecomputers (with samples) */
 	temperature_t dc_airtemp() const;	/* average over divecomputers */
@@ -179,6 +200,7 @@ extern int save_dive_sites_logic(const char *filename, const struct dive_site *s
 
 struct membuffer;
 extern void save_one_dive_to_mb(struct membuffer *b, const struct dive &dive, bool anonymize);
+extern void save_one_dive_as_log_to_mb(struct membuffer *b, const struct dive &dive);
 
 extern void copy_dive(const struct dive *s, struct dive *d);
 
@@ -4,8 +4,10 @@
 #include "errorhelper.h"
 #include "event.h"
 #include "extradata.h"
+#include "membuffer.h"
 #include "pref.h"
 #include "sample.h"
+#include "samplecodec.h"
 #include "subsurface-string.h"
 
 #include <string.h>
@@ -290,6 +292,52 @@ void fixup_dc_duration(struct divecomputer &dc)
 	}
 }
 
+/*
+ * Most dive computers record only a few channels, but every sample
+ * has room for all of them. Dives whose profile isn't looked at can
+ * therefore keep their samples encoded, which typically takes a few
+ * bytes per sample. The samples are decoded on first access via
+ * dive::get_dc() or dive::load_samples(), like lazily loaded samples
+ * of git logbooks. Code that accesses dc.samples directly has to call
+ * dive::load_samples() first.
+ */
+void compact_samples(struct divecomputer &dc)
+{
+	if (dc.samples_pending || dc.samples.empty())
+		return;
+
+	membuffer b;
+	encode_samples(&b, dc.samples);
+	dc.packed_samples.assign(b.buffer, b.len);
+	dc.packed_count = dc.samples.size();
+	dc.packed_channels = sample_channels(dc.samples);
+	std::vector<sample>().swap(dc.samples);
+	dc.samples_pending = true;
+}
+
+void expand_samples(struct divecomputer &dc)
+{
+	if (!dc.samples_pending || dc.packed_samples.empty())
+		return;
+
+	if (!decode_samples(dc.packed_samples.data(), dc.packed_samples.size(), dc.packed_count, dc.samples))
+		report_error("Corrupt packed samples");
+	std::string().swap(dc.packed_samples);
+	dc.packed_count = 0;
+	dc.samples_pending = false;
+}
+
+/*
+ * The channels can be queried without decoding packed samples.
+ * Lazily loaded git samples are not known until they are loaded.
+ */
+uint32_t get_sample_channels(const struct divecomputer &dc)
+{
+	if (dc.samples_pending)
+		return dc.packed_samples.empty() ? 0 : dc.packed_channels;
+	return sample_channels(dc.samples);
+}
+
 static bool operator<(const event &ev1, const event &ev2)
 {
 	return std::tie(ev1.time.seconds, ev1.name) <
@@ -4,6 +4,7 @@
 
 #include "divemode.h"
 #include "units.h"
+#include <array>
 #include <string>
 #include <vector>
 
@@ -43,6 +44,17 @@ struct divecomputer {
 	std::vector<struct sample> samples;
 	std::vector<struct event> events;
 	std::vector<struct extra_data> extra_data;
+	// Git logbooks may be loaded without samples. Then samples_pending
+	// is set and samples_id is the blob the samples will be parsed from
+	// on first access via dive::get_dc() or dive::load_samples().
+	std::array<unsigned char, 20> samples_id = {};
+	bool samples_pending = false;
+	// Samples may also be kept packed in memory (see compact_samples()).
+	// Then samples_pending is set as well, packed_samples holds the encoded
+	// samples (see samplecodec.h) and they are decoded on first access.
+	std::string packed_samples;
+	size_t packed_count = 0;
+	uint32_t packed_channels = 0;
 
 	divecomputer();
 	~divecomputer();
@@ -57,6 +69,9 @@ extern int get_depth_at_time(const struct divecomputer *dc, unsigned int time);
 extern struct sample *prepare_sample(struct divecomputer *dc);
 extern void append_sample(const struct sample &sample, struct divecomputer *dc);
 extern void fixup_dc_duration(struct divecomputer &dc);
+extern void compact_samples(struct divecomputer &dc);
+extern void expand_samples(struct divecomputer &dc);
+extern uint32_t get_sample_channels(const struct divecomputer &dc);
 extern int add_event_to_dc(struct divecomputer *dc, struct event ev); // event structure is consumed, returns index of inserted event
 extern struct event *add_event(struct divecomputer *dc, unsigned int time, int type, int flags, int value, const std::string &name);
 extern struct event remove_event_from_dc(struct divecomputer *dc, int idx);
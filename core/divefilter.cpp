@@ -4,10 +4,16 @@
 #include "divelist.h"
 #include "divelog.h"
 #include "gettextfromc.h"
+#include "perfcounters.h"
 #include "qthelper.h"
 #include "range.h"
 #include "selection.h"
+#include "trace.h"
 #include "subsurface-qt/divelistnotifier.h"
+#include <algorithm>
+#include <numeric>
+#include <QThread>
+#include <QtConcurrent>
 #if !defined(SUBSURFACE_MOBILE) && !defined(SUBSURFACE_DOWNLOADER)
 #include "desktop-widgets/mapwidget.h"
 #include "desktop-widgets/mainwindow.h"
@@ -53,6 +59,18 @@ bool FilterData::validFilter() const
 	return fullText.doit() || !constraints.empty();
 }
 
+// Each of the old constraints must be narrowed by one of the new constraints.
+// The fulltext query must be the same.
+bool FilterData::narrows(const FilterData &old) const
+{
+	if (fullText.originalQuery != old.fullText.originalQuery || fulltextStringMode != old.fulltextStringMode)
+		return false;
+	return std::all_of(old.constraints.begin(), old.constraints.end(), [this](const filter_constraint &o) {
+		return std::any_of(constraints.begin(), constraints.end(),
+				   [&o](const filter_constraint &c) { return filter_constraint_narrows(c, o); });
+	});
+}
+
 ShownChange DiveFilter::update(const QVector<dive *> &dives) const
 {
 	ShownChange res;
@@ -60,6 +78,8 @@ ShownChange DiveFilter::update(const QVector<dive *> &dives) const
 	bool doFullText = filterData.fullText.doit();
 	std::vector<dive *> selection = getDiveSelection();
 	std::vector<dive *> removeFromSelection;
+	for (const filter_constraint &c: filterData.constraints)
+		filter_constraint_prepare(c);
 	for (dive *d: dives) {
 		// There are three modes: divesite, fulltext, normal
 		bool newStatus = doDS        ? range_contains(dive_sites, d->dive_site) :
@@ -80,28 +100,65 @@ void DiveFilter::reset()
 	updateAll();
 }
 
+// Below this number of dives, the overhead of the thread pool isn't worth it.
+static const size_t parallelFilterThreshold = 1000;
+
+static perf_counter filter_evaluations("filter evaluations");
+static perf_counter filter_time("filter evaluation time [us]");
+
 ShownChange DiveFilter::updateAll() const
 {
+	TRACE_ZONE("DiveFilter::updateAll");
+	perf_timer timer(filter_time);
+	filter_evaluations.add();
 	ShownChange res;
 	std::vector<dive *> selection = getDiveSelection();
 	std::vector<dive *> removeFromSelection;
+	for (const filter_constraint &c: filterData.constraints)
+		filter_constraint_prepare(c);
+	// If the filter was only narrowed, e.g. by moving the slider of a range,
+	// the hidden dives stay hidden. Only the shown dives have to be checked.
+	bool onlyShown = !diveSiteMode() && appliedFilterValid &&
+			 appliedDisplayInvalidDives == prefs.display_invalid_dives &&
+			 filterData.narrows(appliedFilter);
 	// There are three modes: divesite, fulltext, normal
 	if (diveSiteMode()) {
 		for (auto &d: divelog.dives) {
 			bool newStatus = range_contains(dive_sites, d->dive_site);
 			updateDiveStatus(d.get(), newStatus, res, removeFromSelection);
 		}
-	} else if (filterData.fullText.doit()) {
-		FullTextResult ft = fulltext_find_dives(filterData.fullText, filterData.fulltextStringMode);
-		for (auto &d: divelog.dives) {
-			bool newStatus = ft.dive_matches(d.get()) && showDive(d.get());
-			updateDiveStatus(d.get(), newStatus, res, removeFromSelection);
-		}
 	} else {
+		bool doFullText = filterData.fullText.doit();
+		FullTextResult ft;
+		if (doFullText)
+			ft = fulltext_find_dives(filterData.fullText, filterData.fulltextStringMode);
+		std::vector<dive *> dives;
+		dives.reserve(divelog.dives.size());
 		for (auto &d: divelog.dives) {
-			bool newStatus = showDive(d.get());
-			updateDiveStatus(d.get(), newStatus, res, removeFromSelection);
+			if (!onlyShown || !d->hidden_by_filter)
+				dives.push_back(d.get());
 		}
+		// Checking the dives only reads them. With many dives, do it on the
+		// thread pool. The UI thread waits, so no dive changes meanwhile.
+		std::vector<char> newStatus(dives.size());
+		auto check = [&](size_t i) {
+			newStatus[i] = (!doFullText || ft.dive_matches(dives[i])) && showDive(dives[i]);
+		};
+		if (dives.size() >= parallelFilterThreshold && QThread::idealThreadCount() > 1) {
+			std::vector<size_t> idx(dives.size());
+			std::iota(idx.begin(), idx.end(), 0);
+			QtConcurrent::blockingMap(idx, [&check](size_t i) { check(i); });
+		} else {
+			for (size_t i = 0; i < dives.size(); ++i)
+				check(i);
+		}
+		for (size_t i = 0; i < dives.size(); ++i)
+			updateDiveStatus(dives[i], newStatus[i], res, removeFromSelection);
+	}
+	appliedFilterValid = !diveSiteMode();
+	if (appliedFilterValid) {
+		appliedFilter = filterData;
+		appliedDisplayInvalidDives = prefs.display_invalid_dives;
 	}
 	updateSelection(selection, std::vector<dive *>(), removeFromSelection);
 	res.currentChanged = setSelectionKeepCurrent(selection);
@@ -116,6 +173,8 @@ DiveFilter *DiveFilter::instance()
 
 DiveFilter::DiveFilter() :
 	shown_dives(0),
+	appliedFilterValid(false),
+	appliedDisplayInvalidDives(false),
 	diveSiteRefCount(0)
 {
 }
@@ -212,9 +271,36 @@ int DiveFilter::shownDives() const
 	return shown_dives;
 }
 
+// A rough estimate of how long it takes to check a constraint for a dive.
+// Constraints on plain fields of the dive are cheap, constraints that loop
+// over the cylinders or weights are moderate and string constraints, which
+// have to create and compare QStrings, are expensive.
+static int constraint_cost(const filter_constraint &c)
+{
+	if (filter_constraint_is_string(c.type))
+		return 2;
+	switch (c.type) {
+	case FILTER_CONSTRAINT_WEIGHT:
+	case FILTER_CONSTRAINT_CYLINDER_SIZE:
+	case FILTER_CONSTRAINT_CYLINDER_N2:
+	case FILTER_CONSTRAINT_CYLINDER_O2:
+	case FILTER_CONSTRAINT_CYLINDER_HE:
+	case FILTER_CONSTRAINT_DATE_TIME:
+	case FILTER_CONSTRAINT_TIME_OF_DAY:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
 void DiveFilter::setFilter(const FilterData &data)
 {
 	filterData = data;
+	// All constraints have to match. Check the cheap ones first, so that the
+	// expensive ones are only evaluated for the dives that passed the others.
+	std::stable_sort(filterData.constraints.begin(), filterData.constraints.end(),
+			 [](const filter_constraint &c1, const filter_constraint &c2)
+			 { return constraint_cost(c1) < constraint_cost(c2); });
 	emit diveListNotifier.filterReset();
 }
 
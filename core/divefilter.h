@@ -32,6 +32,7 @@ struct FilterData {
 	StringFilterMode fulltextStringMode = StringFilterMode::STARTSWITH;
 	std::vector<filter_constraint> constraints;
 	bool validFilter() const;
+	bool narrows(const FilterData &old) const; // true if this filter shows a subset of the dives shown by old
 	bool operator==(const FilterData &) const;
 };
 
@@ -66,6 +67,12 @@ private:
 	FilterData filterData;
 	mutable int shown_dives;
 
+	// The filter that was last applied to all dives. If the current filter
+	// is narrower, updateAll() only has to check the dives that are shown.
+	mutable FilterData appliedFilter;
+	mutable bool appliedFilterValid;
+	mutable bool appliedDisplayInvalidDives;
+
 	// We use ref-counting for the dive site mode. The reason is that when switching
 	// between two tabs that both need dive site mode, the following course of
 	// events may happen:
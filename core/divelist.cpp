@@ -24,6 +24,12 @@
 #include "version.h"
 
 #include <time.h>
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+#include <unordered_map>
+#include <QThread>
+#include <QtConcurrent>
 
 void dive_table::record_dive(std::unique_ptr<dive> d)
 {
@@ -419,10 +425,9 @@ static int calculate_sac(const struct dive &dive)
 /* for now we do this based on the first divecomputer */
 static void add_dive_to_deco(struct deco_state *ds, const struct dive &dive, bool in_planner)
 {
-	const struct divecomputer *dc = &dive.dcs[0];
+	const struct divecomputer *dc = dive.get_dc(0);
 
-	gasmix_loop loop(dive, dive.dcs[0]);
-	divemode_loop loop_d(dive.dcs[0]);
+	auto timeline = dive.get_timeline(*dc);
 	for (auto [psample, sample]: pairwise_range(dc->samples)) {
 		int t0 = psample.time.seconds;
 		int t1 = sample.time.seconds;
@@ -430,14 +435,37 @@ static void add_dive_to_deco(struct deco_state *ds, const struct dive &dive, boo
 
 		for (j = t0; j < t1; j++) {
 			int depth = interpolate(psample.depth.mm, sample.depth.mm, j - t0, t1 - t0);
-			auto gasmix = loop.at(j).first;
+			auto gasmix = timeline->gasmix_at(j).first;
 			add_segment(ds, dive.depth_to_bar(depth), gasmix, 1, sample.setpoint.mbar,
-				    loop_d.at(j), dive.sac,
+				    timeline->divemode_at(j), dive.sac,
 				    in_planner);
 		}
 	}
 }
 
+/* the checkpoints may be used by the planner and the profile at the same time */
+static std::mutex deco_cache_lock;
+
+/* add the dive to the deco calculation, reusing its checkpoint if the tissues match */
+static void add_dive_to_deco_cached(struct deco_state *ds, const struct dive &dive, bool in_planner)
+{
+	{
+		std::lock_guard<std::mutex> lock(deco_cache_lock);
+		if (dive.deco_cache && dive.deco_cache->matches(ds, in_planner)) {
+			dive.deco_cache->restore(ds);
+			return;
+		}
+	}
+
+	struct deco_state before = *ds;
+	add_dive_to_deco(ds, dive, in_planner);
+
+	std::lock_guard<std::mutex> lock(deco_cache_lock);
+	if (!dive.deco_cache)
+		dive.deco_cache = std::make_unique<deco_checkpoint>();
+	dive.deco_cache->store(&before, ds, in_planner);
+}
+
 /* take into account previous dives until there is a 48h gap between dives */
 /* return last surface time before this dive or dummy value of 48h */
 /* return negative surface time if dives are overlapping */
@@ -564,7 +592,7 @@ int dive_table::init_decompression(struct deco_state *ds, const struct dive *div
 #endif
 		}
 
-		add_dive_to_deco(ds, pdive, in_planner);
+		add_dive_to_deco_cached(ds, pdive, in_planner);
 
 		last_starttime = pdive.when;
 		last_endtime = pdive.endtime();
@@ -606,6 +634,32 @@ int dive_table::init_decompression(struct deco_state *ds, const struct dive *div
 	return surface_time;
 }
 
+/*
+ * Batched record_dive() for the file loaders. The fixups that only depend
+ * on the dive itself walk the samples and are run on the thread pool. The
+ * CNS carries over from the previous dives and is therefore calculated
+ * afterwards, adding one dive after the other as record_dive() would.
+ */
+void dive_table::record_dives(std::vector<std::unique_ptr<dive>> dives)
+{
+	auto fn = [](std::unique_ptr<dive> &d) {
+		d->fixup_local();
+		d->sac = calculate_sac(*d);
+		d->otu = calculate_otu(*d);
+	};
+	if (dives.size() < 100 || QThread::idealThreadCount() <= 1)
+		std::for_each(dives.begin(), dives.end(), fn);
+	else
+		QtConcurrent::blockingMap(dives, fn);
+
+	for (auto &d: dives) {
+		d->fixup_register_equipment();
+		if (d->maxcns == 0)
+			d->maxcns = calculate_cns(*d);
+		put(std::move(d));
+	}
+}
+
 void dive_table::update_cylinder_related_info(struct dive &dive) const
 {
 	dive.sac = calculate_sac(dive);
@@ -614,6 +668,80 @@ void dive_table::update_cylinder_related_info(struct dive &dive) const
 		dive.maxcns = calculate_cns(dive);
 }
 
+/* CNS at the end of the last dive of a sequence, see calculate_cns() */
+struct cns_state {
+	double cns = 0.0;
+	timestamp_t last_starttime = 0, last_endtime = 0;
+};
+
+static void add_dive_to_cns(struct cns_state &state, const struct dive &dive, double dive_cns)
+{
+	/* a surface interval of more than 12h starts a new sequence */
+	if (state.last_endtime && state.last_endtime + 12 * 60 * 60 < dive.when)
+		state = cns_state();
+
+	/* CNS reduced with 90min halftime during surface interval */
+	if (state.last_endtime)
+		state.cns /= pow(2, (dive.when - state.last_endtime) / (90.0 * 60.0));
+	state.cns += dive_cns;
+	state.last_starttime = dive.when;
+	state.last_endtime = dive.endtime();
+}
+
+/*
+ * Calling calculate_cns() for every dive walks back through the previous
+ * dives each time, which is quadratic for long sequences of dives. Since
+ * the table is sorted, the CNS can instead be carried forward from dive
+ * to dive: through all dives for dives outside of a trip, and through the
+ * dives of the trip otherwise. This gives the same values as calling
+ * update_cylinder_related_info() on every dive.
+ * The per-dive values only depend on the dive itself. They walk the
+ * samples and are therefore calculated on the thread pool first.
+ */
+void dive_table::update_all_cylinder_related_info() const
+{
+	struct cns_state all_dives;
+	std::unordered_map<const dive_trip *, cns_state> trips;
+	std::vector<double> cns(size());
+
+	auto fn = [this, &cns](size_t i) {
+		struct dive &d = *(*this)[i];
+		cns[i] = calculate_cns_dive(d);
+		d.sac = calculate_sac(d);
+		d.otu = calculate_otu(d);
+	};
+	if (size() < 100 || QThread::idealThreadCount() <= 1) {
+		for (size_t i = 0; i < size(); i++)
+			fn(i);
+	} else {
+		std::vector<size_t> idx(size());
+		std::iota(idx.begin(), idx.end(), 0);
+		QtConcurrent::blockingMap(idx, [&fn](size_t i) { fn(i); });
+	}
+
+	for (auto [i, d]: enumerated_range(*this)) {
+		double dive_cns = cns[i];
+		struct cns_state &state = d->divetrip ? trips[d->divetrip] : all_dives;
+
+		if (d->maxcns == 0) {
+			/* dives starting at the same time don't count for each other */
+			if (state.last_endtime && state.last_starttime >= d->when) {
+				d->maxcns = calculate_cns(*d);
+			} else if (!d->cns) {
+				struct cns_state dive_state = state;
+				add_dive_to_cns(dive_state, *d, dive_cns);
+				d->cns = lrint(dive_state.cns);
+				d->maxcns = d->cns;
+			} else {
+				d->maxcns = d->cns;
+			}
+		}
+		add_dive_to_cns(all_dives, *d, dive_cns);
+		if (d->divetrip)
+			add_dive_to_cns(trips[d->divetrip], *d, dive_cns);
+	}
+}
+
 /* Compare list of dive computers by model name */
 static int comp_dc(const struct dive *d1, const struct dive *d2)
 {
@@ -727,6 +855,30 @@ struct dive *dive_table::register_dive(std::unique_ptr<dive> d)
 	return res;
 }
 
+/* Like register_dive(), but sort and merge all dives at once. */
+void dive_table::register_dives(std::vector<std::unique_ptr<dive>> dives)
+{
+	for (auto &d: dives) {
+		d->hidden_by_filter = true;
+		fulltext_register(d.get());
+		d->invalidate_cache();
+	}
+	put_multiple(std::move(dives));
+}
+
+/* Like unregister_dive(), but remove all dives in a single pass. */
+std::vector<std::unique_ptr<dive>> dive_table::unregister_dives(const std::vector<dive *> &dives)
+{
+	auto res = pull_multiple(std::vector<const dive *>(dives.begin(), dives.end()));
+	for (auto &d: res) {
+		fulltext_unregister(d.get());
+		if (d->selected)
+			amount_selected--;
+		d->selected = false;
+	}
+	return res;
+}
+
 /* return the number a dive gets when inserted at the given index.
  * this function is supposed to be called *before* a dive was added.
  * this returns:
@@ -929,6 +1081,8 @@ std::array<std::unique_ptr<dive>, 2> dive_table::split_dive_at(const struct dive
 {
 	size_t nr = get_idx(&dive);
 
+	dive.load_samples();
+
 	/* if we can't find the dive in the dive list, don't bother */
 	if (nr == std::string::npos)
 		return {};
@@ -939,9 +1093,14 @@ std::array<std::unique_ptr<dive>, 2> dive_table::split_dive_at(const struct dive
 	if (a < 3 || static_cast<size_t>(b + 4) > dive.dcs[0].samples.size())
 		return {};
 
-	/* We're not trying to be efficient here.. */
+	/* Copy the samples only once: take them out of the first
+	 * copy, copy the rest of the dive and then distribute
+	 * the samples over the two dives below. */
 	auto d1 = std::make_unique<struct dive>(dive);
-	auto d2 = std::make_unique<struct dive>(dive);
+	std::vector<std::vector<sample>> samples(d1->dcs.size());
+	for (auto [i, dc]: enumerated_range(d1->dcs))
+		std::swap(dc.samples, samples[i]);
+	auto d2 = std::make_unique<struct dive>(*d1);
 	d1->id = dive_getUniqID();
 	d2->id = dive_getUniqID();
 	d1->divetrip = d2->divetrip = nullptr;
@@ -954,25 +1113,22 @@ std::array<std::unique_ptr<dive>, 2> dive_table::split_dive_at(const struct dive
 	struct divecomputer &dc1 = d1->dcs[0];
 	struct divecomputer &dc2 = d2->dcs[0];
 	/*
-	 * Cut off the samples of d1 at the beginning
-	 * of the interval.
+	 * The samples of d1 end at the beginning of the
+	 * interval, the samples of d2 start after the 'b'
+	 * first samples.
 	 */
-	dc1.samples.resize(a);
-
-	/* And get rid of the 'b' first samples of d2 */
-	dc2.samples.erase(dc2.samples.begin(), dc2.samples.begin() + b);
+	dc2.samples.assign(samples[0].begin() + b, samples[0].end());
+	samples[0].resize(a);
+	dc1.samples = std::move(samples[0]);
 
 	/* Now the secondary dive computers */
 	int32_t t = dc2.samples[0].time.seconds;
-	for (auto it1 = d1->dcs.begin() + 1; it1 != d1->dcs.end(); ++it1) {
-		auto it = std::find_if(it1->samples.begin(), it1->samples.end(),
+	for (size_t i = 1; i < samples.size(); i++) {
+		auto it = std::find_if(samples[i].begin(), samples[i].end(),
 				       [t](auto &sample) { return sample.time.seconds >= t; });
-		it1->samples.erase(it, it1->samples.end());
-	}
-	for (auto it2 = d2->dcs.begin() + 1; it2 != d2->dcs.end(); ++it2) {
-		auto it = std::find_if(it2->samples.begin(), it2->samples.end(),
-				       [t](auto &sample) { return sample.time.seconds >= t; });
-		it2->samples.erase(it2->samples.begin(), it);
+		d2->dcs[i].samples.assign(it, samples[i].end());
+		samples[i].erase(it, samples[i].end());
+		d1->dcs[i].samples = std::move(samples[i]);
 	}
 
 	/*
@@ -1042,7 +1198,7 @@ static bool should_split(const struct divecomputer *dc, int t1, int t2)
  */
 std::array<std::unique_ptr<dive>, 2> dive_table::split_dive(const struct dive &dive) const
 {
-	const struct divecomputer *dc = &dive.dcs[0];
+	const struct divecomputer *dc = dive.get_dc(0);
 	bool at_surface = true;
 	if (dc->samples.empty())
 		return {};
@@ -1078,6 +1234,7 @@ std::array<std::unique_ptr<dive>, 2> dive_table::split_dive(const struct dive &d
 
 std::array<std::unique_ptr<dive>, 2> dive_table::split_dive_at_time(const struct dive &dive, duration_t time) const
 {
+	dive.load_samples();
 	auto it = std::find_if(dive.dcs[0].samples.begin(), dive.dcs[0].samples.end(),
 			       [time](auto &sample) { return sample.time.seconds >= time.seconds; });
 	if (it == dive.dcs[0].samples.end())
@@ -24,8 +24,11 @@ struct merge_result {
 struct dive_table : public sorted_owning_table<dive, &comp_dives> {
 	dive *get_by_uniq_id(int id) const;
 	void record_dive(std::unique_ptr<dive> d);	// call fixup_dive() before adding dive to table.
+	void record_dives(std::vector<std::unique_ptr<dive>> dives);	// batched record_dive()
 	struct dive *register_dive(std::unique_ptr<dive> d);
 	std::unique_ptr<dive> unregister_dive(int idx);
+	void register_dives(std::vector<std::unique_ptr<dive>> dives);	// batched register_dive()
+	std::vector<std::unique_ptr<dive>> unregister_dives(const std::vector<dive *> &dives); // batched, returns dives in table order
 	std::unique_ptr<dive> default_dive();		// generate a sensible looking defaultdive 1h from now.
 
 	// Some of these functions act on dives, but need data from adjacent dives,
@@ -35,6 +38,7 @@ struct dive_table : public sorted_owning_table<dive, &comp_dives> {
 	void force_fixup_dive(struct dive &d) const;
 	int init_decompression(struct deco_state *ds, const struct dive *dive, bool in_planner) const;
 	void update_cylinder_related_info(struct dive &dive) const;
+	void update_all_cylinder_related_info() const;	// same for all dives, in a single pass
 	int get_dive_nr_at_idx(int idx) const;
 	timestamp_t get_surface_interval(timestamp_t when) const;
 	struct dive *find_next_visible_dive(timestamp_t when);
@@ -2,16 +2,22 @@
 #include "divelog.h"
 #include "divelist.h"
 #include "divesite.h"
+#include "divesiteindex.h"
 #include "device.h"
 #include "dive.h"
 #include "errorhelper.h"
 #include "filterpreset.h"
 #include "filterpresettable.h"
+#include "profilesignature.h"
 #include "qthelper.h" // for emit_reset_signal() -> should be removed
 #include "range.h"
 #include "selection.h" // clearly, a layering violation -> should be removed
 #include "trip.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
 struct divelog divelog;
 
 divelog::divelog() = default;
@@ -208,7 +214,8 @@ static bool merge_dive_tables(const std::vector<dive *> &dives_from, struct dive
 
 	/* Merge newly imported dives into the dive table.
 	 * Since both lists (old and new) are sorted, we can step
-	 * through them concurrently and locate the insertions points.
+	 * through them concurrently and locate the insertions points
+	 * by binary search.
 	 * Once found, check if the new dive can be merged in the
 	 * previous or next dive.
 	 * Note that this doesn't consider pathological cases such as:
@@ -227,9 +234,11 @@ static bool merge_dive_tables(const std::vector<dive *> &dives_from, struct dive
 			continue;
 		}
 
-		/* Find insertion point. */
-		while (j < dives_to.size() && dive_less_than(*dives_to[j], *dive_to_add))
-			j++;
+		/* Find insertion point. The insertion points are ascending,
+		 * so only search past the previous one. Use a binary search,
+		 * since typically only few dives are imported into a large log. */
+		j = std::lower_bound(dives_to.begin() + j, dives_to.end(), dive_to_add.get(), dive_less_than_ptr)
+			- dives_to.begin();
 
 		/* Try to merge into previous dive.
 		 * We are extra-careful to not merge into the same dive twice, as that
@@ -266,6 +275,46 @@ static bool merge_dive_tables(const std::vector<dive *> &dives_from, struct dive
 	return sequence_changed;
 }
 
+/* Helper function for process_imported_dives():
+ * Find the existing dives that are likely the same as an added dive,
+ * judging by the profile, but which weren't merged because they don't
+ * overlap in time. Typically because the clock of a dive computer was off.
+ * Only the dives within the maximum clock offset of the added dives are
+ * indexed, since that means loading their samples. */
+static std::vector<std::pair<dive *, dive *>> find_likely_duplicates(const dive_table &dives, const dive_table &dives_to_add,
+								      const std::vector<dive *> &dives_to_remove)
+{
+	std::vector<std::pair<dive *, dive *>> res;
+	if (dives.empty() || dives_to_add.empty())
+		return res;
+
+	timestamp_t from = dives_to_add.front()->when;
+	timestamp_t to = dives_to_add.front()->endtime();
+	for (auto &d: dives_to_add) {
+		from = std::min(from, d->when);
+		to = std::max(to, d->endtime());
+	}
+	from -= profile_signature_index::max_clock_offset;
+	to += profile_signature_index::max_clock_offset;
+
+	std::vector<dive *> candidates;
+	for (auto &d: dives) {
+		if (d->when >= from && d->when <= to &&
+		    !std::binary_search(dives_to_remove.begin(), dives_to_remove.end(), d.get(), dive_less_than_ptr))
+			candidates.push_back(d.get());
+	}
+	if (candidates.empty())
+		return res;
+
+	profile_signature_index index(candidates);
+	for (auto &d: dives_to_add) {
+		struct dive *old_dive = index.find_duplicate(*d);
+		if (old_dive && (old_dive->endtime() <= d->when || d->endtime() <= old_dive->when))
+			res.emplace_back(d.get(), old_dive);
+	}
+	return res;
+}
+
 /* Helper function for process_imported_dives():
  * Try to merge a trip into one of the existing trips.
  * The bool pointed to by "sequence_changed" is set to true, if the sequence of
@@ -368,23 +417,31 @@ divelog::process_imported_dives_result divelog::process_imported_dives(struct di
 		autogroup_dives(import_log);
 
 	/* If dive sites already exist, use the existing versions. */
+	std::unordered_set<const dive_site *> used_sites;
+	for (auto &d: import_log.dives)
+		used_sites.insert(d->dive_site);
+	std::unordered_map<const dive_site *, dive_site *> replaced_sites;
+	dive_site_index site_index(sites);
 	for (auto &new_ds: import_log.sites) {
 		/* Check if it dive site is actually used by new dives. */
-		if (std::none_of(import_log.dives.begin(), import_log.dives.end(), [ds=new_ds.get()]
-				 (auto &d) { return d->dive_site == ds; }))
+		if (used_sites.count(new_ds.get()) == 0)
 			continue;
 
-		struct dive_site *old_ds = sites.get_same(*new_ds);
+		struct dive_site *old_ds = site_index.get_same(*new_ds);
 		if (!old_ds) {
 			/* Dive site doesn't exist. Add it to list of dive sites to be added. */
 			new_ds->dives.clear(); /* Caller is responsible for adding dives to site */
 			res.sites_to_add.put(std::move(new_ds));
 		} else {
 			/* Dive site already exists - use the old one. */
-			for (auto &d: import_log.dives) {
-				if (d->dive_site == new_ds.get())
-					d->dive_site = old_ds;
-			}
+			replaced_sites[new_ds.get()] = old_ds;
+		}
+	}
+	if (!replaced_sites.empty()) {
+		for (auto &d: import_log.dives) {
+			auto it = replaced_sites.find(d->dive_site);
+			if (it != replaced_sites.end())
+				d->dive_site = it->second;
 		}
 	}
 	import_log.sites.clear();
@@ -460,6 +517,8 @@ divelog::process_imported_dives_result divelog::process_imported_dives(struct di
 			(*it)->number = ++nr;
 	}
 
+	res.likely_duplicates = find_likely_duplicates(dives, res.dives_to_add, res.dives_to_remove);
+
 	return res;
 }
 
@@ -482,6 +541,21 @@ void divelog::process_loaded_dives()
 	select_newest_visible_dive();
 }
 
+/*
+ * Take over a log that was parsed in the background (see parse_files_async())
+ * and publish it like process_loaded_dives(). Normally we start out empty and
+ * can simply take the tables. Otherwise the dives are merged in as an import.
+ */
+void divelog::process_loaded_log(struct divelog &log)
+{
+	if (!dives.empty() || !trips.empty() || !sites.empty()) {
+		add_imported_dives(log, import_flags::merge_all_trips);
+		return;
+	}
+	*this = std::move(log);
+	process_loaded_dives();
+}
+
 /* Merge the dives of the trip "from" and the dive_table "dives_from" into the trip "to"
  * and dive_table "dives_to". If "prefer_imported" is true, dive data of "from" takes
  * precedence */
@@ -489,9 +563,13 @@ void divelog::add_imported_dives(struct divelog &import_log, int flags)
 {
 	/* Process imported dives and generate lists of dives
 	 * to-be-added and to-be-removed */
-	auto [dives_to_add, dives_to_remove, trips_to_add, dive_sites_to_add, devices_to_add] =
+	auto [dives_to_add, dives_to_remove, trips_to_add, dive_sites_to_add, devices_to_add, likely_duplicates] =
 		process_imported_dives(import_log, flags);
 
+	for (auto [new_dive, old_dive]: likely_duplicates)
+		report_info("imported dive at %s is likely the same as the dive at %s",
+			    get_dive_date_c_string(new_dive->when).c_str(), get_dive_date_c_string(old_dive->when).c_str());
+
 	/* Start by deselecting all dives, so that we don't end up with an invalid selection */
 	select_single_dive(NULL);
 
@@ -44,11 +44,15 @@ struct divelog {
 		trip_table trips_to_add;
 		dive_site_table sites_to_add;
 		std::vector<device> devices_to_add;
+		// Added and existing dives with matching profiles that weren't
+		// merged because they don't overlap in time, see profilesignature.h
+		std::vector<std::pair<dive *, dive *>> likely_duplicates;
 	};
 
 	/* divelist core logic functions */
 	process_imported_dives_result process_imported_dives(struct divelog &import_log, int flags); // import_log will be consumed
 	void process_loaded_dives();
+	void process_loaded_log(struct divelog &log); // log will be consumed
 	void add_imported_dives(struct divelog &log, int flags); // log will be consumed
 };
 
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "divelogsnapshot.h"
+#include "dive.h"
+#include "divelog.h"
+#include "divesite.h"
+#include "trip.h"
+#include "subsurface-qt/divelistnotifier.h"
+
+DiveLogSnapshots *DiveLogSnapshots::instance()
+{
+	static DiveLogSnapshots self;
+	return &self;
+}
+
+DiveLogSnapshots::DiveLogSnapshots()
+{
+	// Note: the dive may be owned by an undo command. Only remember
+	// the id, the dive might be freed before the next snapshot.
+	// As long as no snapshot was taken, everything will be copied anyway.
+	diveListNotifier.connectDiveChanges(this, [this](const dive *d) {
+		if (d && !diveVersions.empty())
+			touchedDives.insert(d->id);
+	});
+	connect(&diveListNotifier, &DiveListNotifier::tripChanged, this, [this](dive_trip *trip, TripField) {
+		if (trip && !tripVersions.empty())
+			touchedTrips.insert(trip->id);
+	});
+	auto touchSite = [this](dive_site *ds) {
+		if (ds && !siteVersions.empty())
+			touchedSites.insert(ds->uuid);
+	};
+	connect(&diveListNotifier, &DiveListNotifier::diveSiteAdded, this, touchSite);
+	connect(&diveListNotifier, &DiveListNotifier::diveSiteChanged, this, touchSite);
+	connect(&diveListNotifier, &DiveListNotifier::dataReset, this, &DiveLogSnapshots::reset);
+}
+
+// A new log was loaded: the ids of the sites may be reused for different sites.
+void DiveLogSnapshots::reset()
+{
+	diveVersions.clear();
+	tripVersions.clear();
+	siteVersions.clear();
+	touchedDives.clear();
+	touchedTrips.clear();
+	touchedSites.clear();
+}
+
+// Returns the version of an object in the previous snapshots, if it is still
+// alive and wasn't changed, or otherwise a copy with an empty list of dives.
+template <typename T, typename Id>
+static std::shared_ptr<const T> get_version(const T &obj, Id id,
+					    const std::unordered_map<Id, std::weak_ptr<const T>> &versions,
+					    const std::unordered_set<Id> &touched)
+{
+	if (!touched.count(id)) {
+		auto it = versions.find(id);
+		if (it != versions.end()) {
+			if (auto version = it->second.lock())
+				return version;
+		}
+	}
+	auto copy = std::make_shared<T>(obj);
+	copy->dives.clear();
+	return copy;
+}
+
+template <typename T>
+static const T *find_copy(const std::unordered_map<const T *, const T *> &copies, const T *obj)
+{
+	auto it = copies.find(obj);
+	return it != copies.end() ? it->second : nullptr;
+}
+
+std::shared_ptr<const divelog_snapshot> DiveLogSnapshots::take()
+{
+	auto res = std::make_shared<divelog_snapshot>();
+
+	std::unordered_map<int, std::weak_ptr<const dive_trip>> trips;
+	std::unordered_map<const dive_trip *, const dive_trip *> tripCopies;
+	res->trips.reserve(divelog.trips.size());
+	for (auto &trip: divelog.trips) {
+		auto version = get_version(*trip, trip->id, tripVersions, touchedTrips);
+		tripCopies[trip.get()] = version.get();
+		trips[trip->id] = version;
+		res->trips.push_back(std::move(version));
+	}
+
+	std::unordered_map<uint32_t, std::weak_ptr<const dive_site>> sites;
+	std::unordered_map<const dive_site *, const dive_site *> siteCopies;
+	res->sites.reserve(divelog.sites.size());
+	for (auto &ds: divelog.sites) {
+		auto version = get_version(*ds, ds->uuid, siteVersions, touchedSites);
+		siteCopies[ds.get()] = version.get();
+		sites[ds->uuid] = version;
+		res->sites.push_back(std::move(version));
+	}
+
+	// Dives are shared only if they still point to the current
+	// versions of their trip and dive site.
+	std::unordered_map<int, std::weak_ptr<const dive>> dives;
+	res->dives.reserve(divelog.dives.size());
+	for (auto &d: divelog.dives) {
+		const dive_trip *trip = find_copy(tripCopies, (const dive_trip *)d->divetrip);
+		const dive_site *site = find_copy(siteCopies, (const dive_site *)d->dive_site);
+		std::shared_ptr<const dive> version;
+		auto it = diveVersions.find(d->id);
+		if (it != diveVersions.end() && !touchedDives.count(d->id)) {
+			version = it->second.lock();
+			if (version && (version->divetrip != trip || version->dive_site != site))
+				version.reset();
+		}
+		if (!version) {
+			auto copy = std::make_shared<dive>(*d);
+			// Snapshots are immutable: readers must not change the trips
+			// and sites they reach through the dives either.
+			copy->divetrip = const_cast<dive_trip *>(trip);
+			copy->dive_site = const_cast<dive_site *>(site);
+			version = std::move(copy);
+		}
+		dives[d->id] = version;
+		res->dives.push_back(std::move(version));
+	}
+
+	diveVersions = std::move(dives);
+	tripVersions = std::move(trips);
+	siteVersions = std::move(sites);
+	touchedDives.clear();
+	touchedTrips.clear();
+	touchedSites.clear();
+	return res;
+}
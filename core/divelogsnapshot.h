@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0
+// Read-only snapshots of the dive log for background threads.
+//
+// The undo commands edit the dives, trips and dive sites of the global
+// divelog in place on the UI thread, therefore other threads must not read
+// them. Instead, background work is given a snapshot: a consistent copy of
+// the dive log that nobody modifies and that may be kept as long as needed.
+//
+// Taking a snapshot only copies what changed since the previous snapshot.
+// The unchanged dives, trips and sites are shared with it. Versions that
+// are not part of any snapshot anymore are freed with the last snapshot
+// referring to them, the snapshots don't have to be released in order.
+//
+// In the snapshot, the trip and dive site pointers of the dives point to
+// the copies in the same snapshot. The dive lists of the trips and sites
+// are empty: sharing a trip between snapshots would be impossible otherwise.
+// To find the dives of a trip or site, walk the dives.
+#ifndef DIVELOGSNAPSHOT_H
+#define DIVELOGSNAPSHOT_H
+
+#include <QObject>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct dive;
+struct dive_site;
+struct dive_trip;
+
+struct divelog_snapshot {
+	std::vector<std::shared_ptr<const dive>> dives;		// in the order of divelog.dives
+	std::vector<std::shared_ptr<const dive_trip>> trips;	// in the order of divelog.trips
+	std::vector<std::shared_ptr<const dive_site>> sites;	// in the order of divelog.sites
+};
+
+class DiveLogSnapshots : public QObject {
+	Q_OBJECT
+public:
+	static DiveLogSnapshots *instance();
+
+	// A snapshot of the current state of the global divelog. To be called
+	// on the UI thread, the snapshot may then be passed to any thread.
+	std::shared_ptr<const divelog_snapshot> take();
+private:
+	DiveLogSnapshots();
+	void reset();
+
+	// The latest versions, by id of the dive or trip and uuid of the site.
+	// These are weak: when no snapshot is alive, there is nothing to share.
+	std::unordered_map<int, std::weak_ptr<const dive>> diveVersions;
+	std::unordered_map<int, std::weak_ptr<const dive_trip>> tripVersions;
+	std::unordered_map<uint32_t, std::weak_ptr<const dive_site>> siteVersions;
+	std::unordered_set<int> touchedDives;
+	std::unordered_set<int> touchedTrips;
+	std::unordered_set<uint32_t> touchedSites;
+};
+
+#endif
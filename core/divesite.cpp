@@ -33,10 +33,19 @@ dive_site *dive_site_table::get_by_uuid(uint32_t uuid) const
 	return it != end() && (*it)->uuid == uuid ? it->get() : NULL;
 }
 
-/* there could be multiple sites of the same name - return the first one */
+/* there could be multiple sites of the same name - return the first one found */
 dive_site *dive_site_table::get_by_name(const std::string &name) const
 {
-	return get_by_predicate(*this, [&name](const auto &ds) { return ds->name == name; });
+	auto it = name_cache.find(name);
+	if (it != name_cache.end()) {
+		dive_site *ds = get_by_uuid(it->second);
+		if (ds && ds->name == name)
+			return ds;
+	}
+	dive_site *ds = get_by_predicate(*this, [&name](const auto &ds) { return ds->name == name; });
+	if (ds)
+		name_cache[name] = ds->uuid;
+	return ds;
 }
 
 /* there could be multiple sites at the same GPS fix - return the first one */
@@ -59,7 +68,13 @@ dive_site *dive_site_table::get_by_gps_proximity(location_t loc, int distance) c
 {
 	struct dive_site *res = nullptr;
 	unsigned int cur_distance, min_distance = distance;
+	// The distance is at least the difference in latitude, which is cheap
+	// to calculate. Skip the sites that can't be closer than the closest
+	// one found so far. The 0.5 accounts for the rounding in get_distance().
+	double meters_per_udeg = 6371000.0 * udeg_to_radians(1);
 	for (const auto &ds: *this) {
+		if (fabs((double)ds->location.lat.udeg - loc.lat.udeg) * meters_per_udeg - 0.5 >= min_distance)
+			continue;
 		if (ds->has_gps_location() &&
 		    (cur_distance = get_distance(ds->location, loc)) < min_distance) {
 			min_distance = cur_distance;
@@ -182,17 +197,17 @@ static void merge_string(std::string &a, const std::string &b)
  * Taxonomy is not compared, as no taxonomy is generated on
  * import.
  */
-static bool same(const struct dive_site &a, const struct dive_site &b)
+bool dive_site::is_same(const struct dive_site &b) const
 {
-	return a.name == b.name
-	    && a.location == b.location
-	    && a.description == b.description
-	    && a.notes == b.notes;
+	return name == b.name
+	    && location == b.location
+	    && description == b.description
+	    && notes == b.notes;
 }
 
 dive_site *dive_site_table::get_same(const struct dive_site &site) const
 {
-	return get_by_predicate(*this, [site](const auto &ds) { return same(*ds, site); });
+	return get_by_predicate(*this, [&site](const auto &ds) { return ds->is_same(site); });
 }
 
 void dive_site::merge(dive_site &b)
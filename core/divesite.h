@@ -27,6 +27,7 @@ struct dive_site
 	bool is_selected() const;
 	bool is_empty() const;
 	bool has_gps_location() const;
+	bool is_same(const struct dive_site &b) const;
 	void merge(struct dive_site &b); // Note: b is consumed
 	void add_dive(struct dive *d);
 };
@@ -9,53 +9,141 @@
 #include "errorhelper.h"
 #include "subsurface-string.h"
 #include "qthelper.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QNetworkAccessManager>
+#include <QSaveFile>
 #include <QUrlQuery>
 #include <QEventLoop>
-#include <QTimer>
 #include <QRegularExpression>
-#include <memory>
+#include <algorithm>
 
-/** Performs a REST get request to a service returning a JSON object. */
-static QJsonObject doAsyncRESTGetRequest(const QString& url, int msTimeout)
+static const QString geonamesNearbyURL = QStringLiteral("http://api.geonames.org/findNearbyJSON?lang=%1&lat=%2&lng=%3&radius=50&username=dirkhh");
+static const QString geonamesNearbyPlaceNameURL = QStringLiteral("http://api.geonames.org/findNearbyPlaceNameJSON?lang=%1&lat=%2&lng=%3&radius=50&username=dirkhh");
+static const QString geonamesOceanURL = QStringLiteral("http://api.geonames.org/oceanJSON?lang=%1&lat=%2&lng=%3&radius=50&username=dirkhh");
+
+static const int request_timeout = 5000;	// ms
+static const int max_requests_in_flight = 2;
+
+// The free geonames.org service allows 1000 requests per hour for the
+// account. Allow bursts of a few requests, but on average stay below that.
+static const double rate_burst = 50.0;
+static const int rate_interval = 3600;		// ms per request
+
+// Status values of geonames.org meaning that we exceeded the daily,
+// hourly or weekly limit. No point in sending more requests.
+static bool geonamesLimitExceeded(int status)
 {
-	// By making the QNetworkAccessManager static and local to this function,
-	// only one manager exists for all geo-lookups and it is only initialized
-	// on first call to this function.
-	static QNetworkAccessManager rgl;
-	QNetworkRequest request;
-	QEventLoop loop;
-	QTimer timer;
+	return status >= 18 && status <= 20;
+}
 
-	request.setRawHeader("Accept", "text/json");
-	request.setRawHeader("User-Agent", getUserAgent().toUtf8());
-	QObject::connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+// The request budget is shared by all lookups. Returns the time to wait
+// for the next request in ms, or 0 if the request may be sent now.
+static int takeRequestToken()
+{
+	static QElapsedTimer timer;
+	static double tokens = rate_burst;
+
+	if (timer.isValid())
+		tokens = std::min(rate_burst, tokens + (double)timer.restart() / rate_interval);
+	else
+		timer.start();
+	if (tokens < 1.0)
+		return std::max(1, (int)lrint((1.0 - tokens) * rate_interval));
+	tokens -= 1.0;
+	return 0;
+}
+
+/*
+ * The cache of the lookups, keyed by the language and the location
+ * rounded to millidegrees (about 100 m). It is small, therefore it is
+ * simply rewritten after each batch of lookups.
+ */
+static const quint32 geocache_version = 1;
+static QHash<QString, taxonomy_data> geocache;
+static bool geocacheLoaded = false;
+
+static QString geocacheName()
+{
+	return QString::fromStdString(system_default_directory() + "/geocache");
+}
+
+static void loadGeocache()
+{
+	if (geocacheLoaded)
+		return;
+	geocacheLoaded = true;
+
+	QFile f(geocacheName());
+	if (!f.open(QIODevice::ReadOnly))
+		return;
+	QDataStream stream(&f);
+	quint32 version, count;
+	stream >> version >> count;
+	if (version != geocache_version)
+		return;
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+		QString key;
+		quint32 n;
+		stream >> key >> n;
+		taxonomy_data taxonomy;
+		for (quint32 j = 0; j < n && stream.status() == QDataStream::Ok; j++) {
+			qint32 category, origin;
+			QString value;
+			stream >> category >> origin >> value;
+			if (category <= TC_NONE || category >= TC_NR_CATEGORIES)
+				continue;
+			taxonomy.push_back({ (taxonomy_category)category, value.toStdString(), (taxonomy_origin)origin });
+		}
+		if (stream.status() == QDataStream::Ok)
+			geocache.insert(key, std::move(taxonomy));
+	}
+}
+
+static void saveGeocache()
+{
+	QSaveFile f(geocacheName());
+	if (!f.open(QIODevice::WriteOnly))
+		return;
+	QDataStream stream(&f);
+	stream << geocache_version << (quint32)geocache.size();
+	for (auto it = geocache.cbegin(); it != geocache.cend(); ++it) {
+		stream << it.key() << (quint32)it->size();
+		for (const taxonomy &t: *it)
+			stream << (qint32)t.category << (qint32)t.origin << QString::fromStdString(t.value);
+	}
+	if (!f.commit())
+		report_info("Cannot write geocoding cache %s", qPrintable(geocacheName()));
+}
 
-	request.setUrl(url);
+static QString lookupLanguage()
+{
+	return getUiLanguage().section(QRegularExpression("[-_ ]"), 0, 0);
+}
 
-	// By using a std::unique_ptr<>, we can exit from the function at any point
-	// and the reply will be freed. Likewise, when overwriting the pointer with
-	// a new value. According to Qt's documentation it is fine the delete the
-	// reply as long as we're not in a slot connected to error() or finish().
-	std::unique_ptr<QNetworkReply> reply(rgl.get(request));
-	timer.setSingleShot(true);
-	QObject::connect(&*reply, SIGNAL(finished()), &loop, SLOT(quit()));
-	timer.start(msTimeout);
-	loop.exec();
+static QString geocacheKey(const QString &language, location_t location)
+{
+	return QStringLiteral("%1:%2:%3").arg(language)
+					 .arg(lrint(location.lat.udeg / 1000.0))
+					 .arg(lrint(location.lon.udeg / 1000.0));
+}
 
-	if (!timer.isActive()) {
+/** Checks the reply of a REST get request to a service returning a JSON object. */
+static QJsonObject parseRESTReply(QNetworkReply *reply, bool &ok)
+{
+	QString url = reply->url().toString();
+	ok = false;
+	if (reply->error() == QNetworkReply::OperationCanceledError) {
 		report_error("timeout accessing %s", qPrintable(url));
-		QObject::disconnect(&*reply, SIGNAL(finished()), &loop, SLOT(quit()));
-		reply->abort();
 		return QJsonObject{};
 	}
-
-	timer.stop();
 	if (reply->error() > 0) {
 		report_error("got error accessing %s: %s", qPrintable(url), qPrintable(reply->errorString()));
 		return QJsonObject{};
@@ -72,58 +160,194 @@ static QJsonObject doAsyncRESTGetRequest(const QString& url, int msTimeout)
 		return QJsonObject{};
 	}
 	// Success, return JSON response from server
+	ok = true;
 	return jsonDoc.object();
 }
 
-/// Performs a reverse-geo-lookup of the coordinates and returns the taxonomy data.
-taxonomy_data reverseGeoLookup(degrees_t latitude, degrees_t longitude)
+ReverseGeoLookup::ReverseGeoLookup(QObject *parent) : QObject(parent),
+	cacheChanged(false)
 {
-	const QString geonamesNearbyURL = QStringLiteral("http://api.geonames.org/findNearbyJSON?lang=%1&lat=%2&lng=%3&radius=50&username=dirkhh");
-	const QString geonamesNearbyPlaceNameURL = QStringLiteral("http://api.geonames.org/findNearbyPlaceNameJSON?lang=%1&lat=%2&lng=%3&radius=50&username=dirkhh");
-	const QString geonamesOceanURL = QStringLiteral("http://api.geonames.org/oceanJSON?lang=%1&lat=%2&lng=%3&radius=50&username=dirkhh");
+	rateTimer.setSingleShot(true);
+	connect(&rateTimer, &QTimer::timeout, this, &ReverseGeoLookup::schedule);
+}
 
-	QString url;
-	QJsonObject obj;
-	taxonomy_data taxonomy;
+ReverseGeoLookup::~ReverseGeoLookup()
+{
+	cancel();
+}
 
-	// check the oceans API to figure out the body of water
-	url = geonamesOceanURL.arg(getUiLanguage().section(QRegularExpression("[-_ ]"), 0, 0)).arg(latitude.udeg / 1000000.0).arg(longitude.udeg / 1000000.0);
-	obj = doAsyncRESTGetRequest(url, 5000); // 5 secs. timeout
-	QVariantMap oceanName = obj.value("ocean").toVariant().toMap();
-	if (oceanName["name"].isValid())
-		taxonomy_set_category(taxonomy, TC_OCEAN, oceanName["name"].toString().toStdString(), taxonomy_origin::GEOCODED);
-
-	// check the findNearbyPlaces API from geonames - that should give us country, state, city
-	url = geonamesNearbyPlaceNameURL.arg(getUiLanguage().section(QRegularExpression("[-_ ]"), 0, 0)).arg(latitude.udeg / 1000000.0).arg(longitude.udeg / 1000000.0);
-	obj = doAsyncRESTGetRequest(url, 5000); // 5 secs. timeout
-	QVariantList geoNames = obj.value("geonames").toVariant().toList();
-	if (geoNames.count() == 0) {
-		// check the findNearby API from geonames if the previous search came up empty - that should give us country, state, location
-		url = geonamesNearbyURL.arg(getUiLanguage().section(QRegularExpression("[-_ ]"), 0, 0)).arg(latitude.udeg / 1000000.0).arg(longitude.udeg / 1000000.0);
-		obj = doAsyncRESTGetRequest(url, 5000); // 5 secs. timeout
-		geoNames = obj.value("geonames").toVariant().toList();
+bool ReverseGeoLookup::busy() const
+{
+	return !ready.empty() || !replies.empty();
+}
+
+void ReverseGeoLookup::cancel()
+{
+	ready.clear();
+	rateTimer.stop();
+	// Take the replies out first: abort() emits finished().
+	std::vector<QNetworkReply *> old;
+	std::swap(old, replies);
+	for (QNetworkReply *reply: old) {
+		reply->disconnect(this);
+		reply->abort();
+		reply->deleteLater();
 	}
-	if (geoNames.count() > 0) {
-		QVariantMap firstData = geoNames.at(0).toMap();
-
-		// fill out all the data - start at COUNTRY since we already got OCEAN above
-		for (int idx = TC_COUNTRY; idx < TC_NR_CATEGORIES; idx++) {
-			if (firstData[taxonomy_api_names[idx]].isValid()) {
-				QString value = firstData[taxonomy_api_names[idx]].toString();
-				taxonomy_set_category(taxonomy, (taxonomy_category)idx, value.toStdString(), taxonomy_origin::GEOCODED);
-			}
+	if (cacheChanged)
+		saveGeocache();
+	cacheChanged = false;
+}
+
+void ReverseGeoLookup::lookup(const std::vector<location_t> &locations)
+{
+	cancel();
+	loadGeocache();
+
+	QString language = lookupLanguage();
+	for (size_t i = 0; i < locations.size(); i++) {
+		QString key = geocacheKey(language, locations[i]);
+		auto it = geocache.constFind(key);
+		if (it != geocache.cend())
+			emit found((int)i, *it);
+		else
+			ready.push_back(Job { (int)i, locations[i], key, OCEAN, taxonomy_data(), false });
+	}
+	if (ready.empty())
+		emit finished();
+	else
+		schedule();
+}
+
+// Send requests of the waiting jobs, as far as the limits allow.
+void ReverseGeoLookup::schedule()
+{
+	while (!ready.empty() && (int)replies.size() < max_requests_in_flight) {
+		int wait = takeRequestToken();
+		if (wait > 0) {
+			rateTimer.start(wait);
+			return;
 		}
-		std::string l3 = taxonomy_get_value(taxonomy, TC_ADMIN_L3);
-		std::string lt = taxonomy_get_value(taxonomy, TC_LOCALNAME);
-		if (!l3.empty() && !lt.empty()) {
-			// basically this means we did get a local name (what we call town), but just like most places
-			// we didn't get an adminName_3 - which in some regions is the actual city that town belongs to,
-			// then we copy the town into the city
-			taxonomy_set_category(taxonomy, TC_ADMIN_L3, lt, taxonomy_origin::GEOCOPIED);
+		Job job = std::move(ready.front());
+		ready.pop_front();
+		sendRequest(std::move(job));
+	}
+}
+
+void ReverseGeoLookup::sendRequest(Job job)
+{
+	// By making the QNetworkAccessManager static and local to this function,
+	// only one manager exists for all geo-lookups and it is only initialized
+	// on first call to this function.
+	static QNetworkAccessManager rgl;
+	const QString &url = job.stage == OCEAN ? geonamesOceanURL :
+			     job.stage == NEARBY_PLACE ? geonamesNearbyPlaceNameURL : geonamesNearbyURL;
+	QNetworkRequest request;
+	request.setRawHeader("Accept", "text/json");
+	request.setRawHeader("User-Agent", getUserAgent().toUtf8());
+	request.setUrl(url.arg(lookupLanguage()).arg(job.location.lat.udeg / 1000000.0).arg(job.location.lon.udeg / 1000000.0));
+
+	QNetworkReply *reply = rgl.get(request);
+	replies.push_back(reply);
+	// abort() finishes the reply with OperationCanceledError. The reply
+	// is the context object: the timer dies with it.
+	QTimer::singleShot(request_timeout, reply, &QNetworkReply::abort);
+	connect(reply, &QNetworkReply::finished, this,
+		[this, reply, job = std::move(job)]() { requestFinished(reply, job); });
+}
+
+void ReverseGeoLookup::requestFinished(QNetworkReply *reply, Job job)
+{
+	replies.erase(std::remove(replies.begin(), replies.end(), reply), replies.end());
+	reply->deleteLater();
+
+	bool ok;
+	bool limitExceeded = false;
+	QJsonObject obj = parseRESTReply(reply, ok);
+	QJsonObject status = obj.value("status").toObject();
+	if (!status.isEmpty()) {
+		report_error("geonames.org: %s", qPrintable(status.value("message").toString()));
+		ok = false;
+		limitExceeded = geonamesLimitExceeded(status.value("value").toInt());
+	}
+	if (!ok)
+		job.failed = true;
+
+	if (job.stage == OCEAN) {
+		// check the oceans API to figure out the body of water
+		QVariantMap oceanName = obj.value("ocean").toVariant().toMap();
+		if (oceanName["name"].isValid())
+			taxonomy_set_category(job.taxonomy, TC_OCEAN, oceanName["name"].toString().toStdString(), taxonomy_origin::GEOCODED);
+		// next, check the findNearbyPlaces API from geonames - that should give us country, state, city
+		job.stage = NEARBY_PLACE;
+	} else {
+		QVariantList geoNames = obj.value("geonames").toVariant().toList();
+		if (geoNames.count() == 0 && job.stage == NEARBY_PLACE) {
+			// check the findNearby API from geonames if the previous search came up empty - that should give us country, state, location
+			job.stage = NEARBY;
+		} else {
+			job.stage = DONE;
+			if (geoNames.count() > 0) {
+				QVariantMap firstData = geoNames.at(0).toMap();
+
+				// fill out all the data - start at COUNTRY since we already got OCEAN above
+				for (int idx = TC_COUNTRY; idx < TC_NR_CATEGORIES; idx++) {
+					if (firstData[taxonomy_api_names[idx]].isValid()) {
+						QString value = firstData[taxonomy_api_names[idx]].toString();
+						taxonomy_set_category(job.taxonomy, (taxonomy_category)idx, value.toStdString(), taxonomy_origin::GEOCODED);
+					}
+				}
+				std::string l3 = taxonomy_get_value(job.taxonomy, TC_ADMIN_L3);
+				std::string lt = taxonomy_get_value(job.taxonomy, TC_LOCALNAME);
+				if (!l3.empty() && !lt.empty()) {
+					// basically this means we did get a local name (what we call town), but just like most places
+					// we didn't get an adminName_3 - which in some regions is the actual city that town belongs to,
+					// then we copy the town into the city
+					taxonomy_set_category(job.taxonomy, TC_ADMIN_L3, lt, taxonomy_origin::GEOCOPIED);
+				}
+			} else {
+				report_error("geonames.org did not provide reverse lookup information");
+			}
 		}
+	}
+
+	if (job.stage == DONE) {
+		jobFinished(job);
 	} else {
-		report_error("geonames.org did not provide reverse lookup information");
+		// Finish the started jobs before starting new ones
+		ready.push_front(std::move(job));
+	}
+	if (limitExceeded)
+		ready.clear();
+	schedule();
+	if (!busy()) {
+		if (cacheChanged)
+			saveGeocache();
+		cacheChanged = false;
+		emit finished();
 	}
+}
+
+void ReverseGeoLookup::jobFinished(const Job &job)
+{
+	if (!job.failed) {
+		geocache.insert(job.key, job.taxonomy);
+		cacheChanged = true;
+	}
+	emit found(job.index, job.taxonomy);
+}
+
+/// Performs a reverse-geo-lookup of the coordinates and returns the taxonomy data.
+taxonomy_data reverseGeoLookup(degrees_t latitude, degrees_t longitude)
+{
+	ReverseGeoLookup lookup;
+	QEventLoop loop;
+	taxonomy_data taxonomy;
 
+	QObject::connect(&lookup, &ReverseGeoLookup::found,
+			 [&taxonomy](int, const taxonomy_data &t) { taxonomy = t; });
+	QObject::connect(&lookup, &ReverseGeoLookup::finished, &loop, &QEventLoop::quit);
+	lookup.lookup({ location_t { latitude, longitude } });
+	if (lookup.busy())
+		loop.exec();
 	return taxonomy;
 }
@@ -5,8 +5,64 @@
 #include "taxonomy.h"
 #include "units.h"
 
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <deque>
+#include <vector>
+
+class QNetworkReply;
+
 /// Performs a reverse geo-lookup and returns the data.
 /// It is up to the caller to merge the data with any existing data.
 taxonomy_data reverseGeoLookup(degrees_t latitude, degrees_t longitude);
 
+/// Reverse geo-lookup of many locations in the background.
+///
+/// Locations within about 100 m of a location that was looked up before are
+/// answered from a persistent cache. The others are sent to geonames.org with
+/// at most two requests in flight, and at a rate that stays within the hourly
+/// limit of the free service (short bursts are allowed).
+class ReverseGeoLookup : public QObject {
+	Q_OBJECT
+public:
+	ReverseGeoLookup(QObject *parent = nullptr);
+	~ReverseGeoLookup();
+
+	// Cancels a running lookup and starts a new one. Locations found in the
+	// cache are reported right away, i.e. found() and even finished() may be
+	// emitted before this returns.
+	void lookup(const std::vector<location_t> &locations);
+	void cancel();
+	bool busy() const;
+signals:
+	// index is the position of the location in the list passed to lookup().
+	void found(int index, const taxonomy_data &taxonomy);
+	void finished();
+private:
+	enum Stage {
+		OCEAN,
+		NEARBY_PLACE,
+		NEARBY,		// Only if NEARBY_PLACE didn't find anything
+		DONE
+	};
+	struct Job {
+		int index;
+		location_t location;
+		QString key;	// Of the cache
+		Stage stage;	// The next request to send
+		taxonomy_data taxonomy;
+		bool failed;	// Don't cache incomplete results
+	};
+	void schedule();
+	void sendRequest(Job job);
+	void requestFinished(QNetworkReply *reply, Job job);
+	void jobFinished(const Job &job);
+
+	std::deque<Job> ready;			// Jobs waiting for their next request
+	std::vector<QNetworkReply *> replies;	// Requests in flight
+	QTimer rateTimer;
+	bool cacheChanged;
+};
+
 #endif // DIVESITEHELPERS_H
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "divesiteindex.h"
+#include "divesite.h"
+#include "divesitetable.h"
+
+#include <algorithm>
+#include <math.h>
+
+static uint64_t location_key(const location_t &loc)
+{
+	return ((uint64_t)(uint32_t)loc.lat.udeg << 32) | (uint32_t)loc.lon.udeg;
+}
+
+std::string dive_site_index::normalize_name(const std::string &name)
+{
+	std::string res;
+	res.reserve(name.size());
+	bool space = false;
+	for (char c: name) {
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			space = !res.empty();
+			continue;
+		}
+		if (space)
+			res += ' ';
+		space = false;
+		res += (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+	}
+	return res;
+}
+
+dive_site_index::dive_site_index(const dive_site_table &table)
+{
+	sites.reserve(table.size());
+	by_location.reserve(table.size());
+	by_name.reserve(table.size());
+	for (const auto &ds: table) {
+		size_t idx = sites.size();
+		sites.push_back(ds.get());
+		by_location.emplace(location_key(ds->location), idx);	// doesn't replace the first one
+		by_name.emplace(normalize_name(ds->name), idx);
+		if (ds->has_gps_location())
+			by_latitude.push_back({ ds->location, idx });
+	}
+	std::sort(by_latitude.begin(), by_latitude.end(),
+		  [](const located_site &s1, const located_site &s2)
+		  { return std::tie(s1.location.lat.udeg, s1.idx) < std::tie(s2.location.lat.udeg, s2.idx); });
+}
+
+dive_site *dive_site_index::get_by_gps(const location_t &loc) const
+{
+	auto it = by_location.find(location_key(loc));
+	return it != by_location.end() ? sites[it->second] : nullptr;
+}
+
+dive_site *dive_site_index::get_same(const dive_site &site) const
+{
+	size_t res = sites.size();
+	auto [from, to] = by_name.equal_range(normalize_name(site.name));
+	for (auto it = from; it != to; ++it) {
+		if (it->second < res && sites[it->second]->is_same(site))
+			res = it->second;
+	}
+	return res < sites.size() ? sites[res] : nullptr;
+}
+
+// Walk away from the latitude of loc in both directions. The distance to a site
+// is at least the difference in latitude, thus we can stop once that is larger
+// than the closest distance found. The 0.5 accounts for the rounding in get_distance().
+dive_site *dive_site_index::get_by_gps_proximity(location_t loc, int distance, unsigned int *distance_out) const
+{
+	double meters_per_udeg = 6371000.0 * udeg_to_radians(1);
+	size_t res = sites.size();
+	unsigned int min_distance = distance;
+	// Returns false if the site and all sites further away in latitude can be skipped.
+	// Sites at the same distance as the closest one found may still win on the index.
+	auto check = [&](const located_site &s) {
+		bool found = res < sites.size();
+		double lat_distance = fabs((double)s.location.lat.udeg - loc.lat.udeg) * meters_per_udeg - 0.5;
+		if (found ? lat_distance > min_distance : lat_distance >= min_distance)
+			return false;
+		unsigned int cur_distance = get_distance(s.location, loc);
+		if (cur_distance < min_distance || (found && cur_distance == min_distance && s.idx < res)) {
+			min_distance = cur_distance;
+			res = s.idx;
+		}
+		return true;
+	};
+	auto it = std::lower_bound(by_latitude.begin(), by_latitude.end(), loc.lat.udeg,
+				   [](const located_site &s, int32_t lat) { return s.location.lat.udeg < lat; });
+	for (auto up = it; up != by_latitude.end() && check(*up); ++up)
+		;
+	for (auto down = it; down != by_latitude.begin() && check(*(down - 1)); --down)
+		;
+	if (res >= sites.size())
+		return nullptr;
+	if (distance_out)
+		*distance_out = min_distance;
+	return sites[res];
+}
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0
+// Index of the sites of a dive site table for the duplicate checks on import.
+//
+// Importing a site database compared every imported site with every
+// existing one. The index finds the candidates by a hash of the normalized
+// name and of the exact location, and the nearest site by bisecting the
+// sites sorted by latitude. The results are the same as those of the
+// corresponding dive_site_table functions.
+//
+// The index is a snapshot: it must not be used after sites were added,
+// removed, renamed or moved. The location lookups only use the copies of the
+// locations in the index and can be done from any thread. get_same() also
+// compares the sites themselves.
+#ifndef DIVESITEINDEX_H
+#define DIVESITEINDEX_H
+
+#include "units.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct dive_site;
+class dive_site_table;
+
+class dive_site_index {
+public:
+	dive_site_index(const dive_site_table &table);
+	dive_site *get_by_gps(const location_t &loc) const;
+	dive_site *get_by_gps_proximity(location_t loc, int distance, unsigned int *distance_out = nullptr) const;
+	dive_site *get_same(const dive_site &site) const;
+
+	// Lower case, with runs of white space replaced by a single space.
+	static std::string normalize_name(const std::string &name);
+private:
+	struct located_site {
+		location_t location;
+		size_t idx;	// index in the table, the first one wins on ties
+	};
+	std::vector<dive_site *> sites;				// in table order
+	std::vector<located_site> by_latitude;			// the sites with a location
+	std::unordered_map<uint64_t, size_t> by_location;	// the first site at each location
+	std::unordered_multimap<std::string, size_t> by_name;	// normalized name
+};
+
+#endif
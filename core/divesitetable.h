@@ -5,6 +5,8 @@
 #include "owning_table.h"
 #include "units.h"
 
+#include <unordered_map>
+
 struct dive_site;
 int divesite_comp_uuid(const dive_site &ds1, const dive_site &ds2);
 
@@ -22,6 +24,11 @@ public:
 	dive_site *get_by_gps_proximity(location_t, int distance) const;
 	dive_site *get_same(const struct dive_site &) const;
 	void purge_empty();
+private:
+	// The parsers look up the site name of every dive. Remember the uuid
+	// of the site found for each name. Since sites may be renamed or
+	// removed at any time, an entry is only used after checking the site.
+	mutable std::unordered_map<std::string, uint32_t> name_cache;
 };
 
 #endif // DIVESITETABLE_H
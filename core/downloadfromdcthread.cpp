@@ -14,7 +14,7 @@
 QStringList vendorList;
 QHash<QString, QStringList> productList;
 static QHash<QString, QStringList> mobileProductList; // BT, BLE or FTDI supported DCs for mobile
-QMap<QString, dc_descriptor_t *> descriptorLookup;
+QHash<QString, dc_descriptor_t *> descriptorLookup;
 ConnectionListModel connectionListModel;
 
 static void updateRememberedDCs()
@@ -76,16 +76,8 @@ DownloadThread::DownloadThread() : m_data(DCDeviceData::instance())
 {
 }
 
-void DownloadThread::run()
+std::string download_from_dc(device_data_t *internalData)
 {
-	auto internalData = m_data->internalData();
-	internalData->descriptor = descriptorLookup[m_data->vendor().toLower() + m_data->product().toLower()];
-	internalData->log = &log;
-	internalData->btname = m_data->devBluetoothName().toStdString();
-	if (!internalData->descriptor) {
-		report_info("No download possible when DC type is unknown");
-		return;
-	}
 	// get the list of transports that this device supports and filter depending on Bluetooth option
 	unsigned int transports = dc_descriptor_get_transports(internalData->descriptor);
 	if (internalData->bluetooth_mode)
@@ -97,16 +89,28 @@ void DownloadThread::run()
 
 	report_info("Starting download from %s", qPrintable(getTransportString(transports)));
 	report_info("downloading %s dives", internalData->force_download ? "all" : "only new");
-	log.clear();
+	internalData->log->clear();
 
-	Q_ASSERT(internalData->log != nullptr);
-	std::string errorText;
-	import_thread_cancelled = false;
-	error.clear();
 	if (internalData->vendor == "Uemis")
-		errorText = do_uemis_import(internalData);
+		return do_uemis_import(internalData);
 	else
-		errorText = do_libdivecomputer_import(internalData);
+		return do_libdivecomputer_import(internalData);
+}
+
+void DownloadThread::run()
+{
+	auto internalData = m_data->internalData();
+	internalData->descriptor = descriptorLookup.value(m_data->vendor().toLower() + m_data->product().toLower());
+	internalData->log = &log;
+	internalData->btname = m_data->devBluetoothName().toStdString();
+	if (!internalData->descriptor) {
+		report_info("No download possible when DC type is unknown");
+		return;
+	}
+
+	import_thread_cancelled = false;
+	error.clear();
+	std::string errorText = download_from_dc(internalData);
 	if (!errorText.empty()) {
 		error = format_string_std(errorText.c_str(), internalData->devname.c_str(),
 					  internalData->vendor.c_str(), internalData->product.c_str());
@@ -126,13 +130,13 @@ void DownloadThread::run()
 
 void fill_computer_list()
 {
-	dc_iterator_t *iterator = NULL;
-	dc_descriptor_t *descriptor = NULL;
+	// Filled at startup; other users (e.g. the configuration dialog) get the same lists.
+	if (!descriptorLookup.isEmpty())
+		return;
 
 	unsigned int transportMask = get_supported_transports(NULL);
 
-	dc_descriptor_iterator(&iterator);
-	while (dc_iterator_next(iterator, &descriptor) == DC_STATUS_SUCCESS) {
+	for (dc_descriptor_t *descriptor: all_descriptors()) {
 		// mask out the transports that aren't supported
 		unsigned int transports = dc_descriptor_get_transports(descriptor) & transportMask;
 		if (transports == 0)
@@ -148,7 +152,6 @@ void fill_computer_list()
 
 		descriptorLookup[QString(vendor).toLower() + QString(product).toLower()] = descriptor;
 	}
-	dc_iterator_free(iterator);
 	for (const QString &vendor: vendorList) {
 		auto &l = productList[vendor];
 		std::sort(l.begin(), l.end());
@@ -190,7 +193,7 @@ void show_computer_list()
 	for (const QString &vendor: vendorList) {
 		QString msg = vendor + ": ";
 		for (const QString &product: productList[vendor]) {
-			dc_descriptor_t *descriptor = descriptorLookup[vendor.toLower() + product.toLower()];
+			dc_descriptor_t *descriptor = descriptorLookup.value(vendor.toLower() + product.toLower());
 			unsigned int transport = dc_descriptor_get_transports(descriptor) & transportMask;
 			QString transportString = getTransportString(transport);
 			msg += product + " (" + transportString + "), ";
@@ -220,6 +223,7 @@ DCDeviceData::DCDeviceData()
 	data.androidUsbDeviceDescriptor = nullptr;
 #endif
 	data.sync_time = false;
+	data.keep_raw = false;
 }
 
 DCDeviceData *DCDeviceData::instance()
@@ -288,6 +292,11 @@ bool DCDeviceData::syncTime() const
 	return data.sync_time;
 }
 
+bool DCDeviceData::keepRaw() const
+{
+	return data.keep_raw;
+}
+
 void DCDeviceData::setVendor(const QString &vendor)
 {
 	data.vendor = vendor.toStdString();
@@ -352,6 +361,11 @@ void DCDeviceData::setSyncTime(bool syncTime)
 	data.sync_time = syncTime;
 }
 
+void DCDeviceData::setKeepRaw(bool keepRaw)
+{
+	data.keep_raw = keepRaw;
+}
+
 void DCDeviceData::setSaveDump(bool save)
 {
 	data.libdc_dump = save;
@@ -33,6 +33,7 @@ public:
 	bool saveLog() const;
 	int diveId() const;
 	bool syncTime() const;
+	bool keepRaw() const;
 
 	/* this needs to be a pointer to make the C-API happy */
 	device_data_t *internalData();
@@ -56,6 +57,7 @@ public:
 	void setUsbDevice(const android_usb_serial_device_descriptor &usbDescriptor);
 #endif
 	void setSyncTime(bool syncTime);
+	void setKeepRaw(bool keepRaw);
 private:
 #if defined(Q_OS_ANDROID)
 	struct android_usb_serial_device_descriptor androidUsbDescriptor;
@@ -95,9 +97,12 @@ struct mydescriptor {
 * stay like this for now.
 */
 void fill_computer_list();
+/* Download the dives of the dive computer described by data into data->log,
+ * whose descriptor must be set. Returns the error text, if any. */
+std::string download_from_dc(device_data_t *data);
 void show_computer_list();
 extern QStringList vendorList;
 extern QHash<QString, QStringList> productList;
-extern QMap<QString, dc_descriptor_t *> descriptorLookup;
+extern QHash<QString, dc_descriptor_t *> descriptorLookup;
 extern ConnectionListModel connectionListModel;
 #endif
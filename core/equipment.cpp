@@ -21,6 +21,8 @@
 #include "range.h"
 #include "subsurface-string.h"
 
+#include <unordered_map>
+
 cylinder_t::cylinder_t() = default;
 cylinder_t::~cylinder_t() = default;
 
@@ -74,6 +76,48 @@ enum cylinderuse cylinderuse_from_text(const char *text)
 	return static_cast<enum cylinderuse>(-1);
 }
 
+/*
+ * The tank and weight system names are looked up for every cylinder and
+ * weight system of every loaded dive. Therefore, index the tables by name.
+ * The tables only grow, except when the tank table is reset, which
+ * invalidates the index. New entries are indexed when looking up.
+ */
+template <typename T>
+class name_index {
+public:
+	name_index(bool translated = false) : translated(translated)
+	{
+	}
+	// Returns the index of the first entry of that name or table.size().
+	size_t find(const std::vector<T> &table, const std::string &name)
+	{
+		if (&table != indexed_table || indexed > table.size()) {
+			index.clear();
+			indexed = 0;
+			indexed_table = &table;
+		}
+		for (; indexed < table.size(); ++indexed) {
+			const std::string &key = table[indexed].name;
+			index.emplace(translated ? std::string(translate("gettextFromC", key.c_str())) : key, indexed);
+		}
+		auto it = index.find(name);
+		return it != index.end() ? it->second : table.size();
+	}
+	void invalidate()
+	{
+		indexed_table = nullptr;
+	}
+private:
+	bool translated;
+	const std::vector<T> *indexed_table = nullptr;
+	size_t indexed = 0;
+	std::unordered_map<std::string, size_t> index;
+};
+
+static name_index<tank_info> tank_info_index;
+static name_index<ws_info> ws_info_index;
+static name_index<ws_info> ws_info_translated_index(true);
+
 /* Add a metric or an imperial tank info structure. Copies the passed-in string. */
 static void add_tank_info_metric(std::vector<tank_info> &table, const std::string &name, int ml, int bar)
 {
@@ -87,9 +131,8 @@ static void add_tank_info_imperial(std::vector<tank_info> &table, const std::str
 
 struct tank_info *get_tank_info(std::vector<tank_info> &table, const std::string &name)
 {
-	auto it = std::find_if(table.begin(), table.end(), [&name](const tank_info &info)
-			       { return info.name == name; });
-	return it != table.end() ? &*it : nullptr;
+	size_t idx = tank_info_index.find(table, name);
+	return idx < table.size() ? &table[idx] : nullptr;
 }
 
 void set_tank_info_data(std::vector<tank_info> &table, const std::string &name, volume_t size, pressure_t working_pressure)
@@ -124,11 +167,9 @@ std::pair<volume_t, pressure_t> extract_tank_info(const struct tank_info &info)
 
 std::pair<volume_t, pressure_t> get_tank_info_data(const std::vector<tank_info> &table, const std::string &name)
 {
-	// Here, we would need a const version of get_tank_info().
-	auto it = std::find_if(table.begin(), table.end(), [&name](const tank_info &info)
-			       { return info.name == name; });
-	return it != table.end() ? extract_tank_info(*it)
-				 : std::make_pair(volume_t(), pressure_t());
+	size_t idx = tank_info_index.find(table, name);
+	return idx < table.size() ? extract_tank_info(table[idx])
+				  : std::make_pair(volume_t(), pressure_t());
 }
 
 void add_cylinder_description(const cylinder_type_t &type)
@@ -136,8 +177,7 @@ void add_cylinder_description(const cylinder_type_t &type)
 	const std::string &desc = type.description;
 	if (desc.empty())
 		return;
-	if (std::any_of(tank_info_table.begin(), tank_info_table.end(),
-			[&desc](const tank_info &info) { return info.name == desc; }))
+	if (tank_info_index.find(tank_info_table, desc) < tank_info_table.size())
 		return;
 	add_tank_info_metric(tank_info_table, desc, type.size.mliter,
 			     type.workingpressure.mbar / 1000);
@@ -148,11 +188,9 @@ void add_weightsystem_description(const weightsystem_t &weightsystem)
 	if (weightsystem.description.empty())
 		return;
 
-	auto it = std::find_if(ws_info_table.begin(), ws_info_table.end(),
-			       [&weightsystem](const ws_info &info)
-			       { return info.name == weightsystem.description; });
-	if (it != ws_info_table.end()) {
-		it->weight = weightsystem.weight;
+	size_t idx = ws_info_index.find(ws_info_table, weightsystem.description);
+	if (idx < ws_info_table.size()) {
+		ws_info_table[idx].weight = weightsystem.weight;
 		return;
 	}
 	ws_info_table.push_back(ws_info { std::string(weightsystem.description), weightsystem.weight });
@@ -161,10 +199,9 @@ void add_weightsystem_description(const weightsystem_t &weightsystem)
 weight_t get_weightsystem_weight(const std::string &name)
 {
 	// Also finds translated names (TODO: should only consider non-user items).
-	auto it = std::find_if(ws_info_table.begin(), ws_info_table.end(),
-			       [&name](const ws_info &info)
-			       { return info.name == name || translate("gettextFromC", info.name.c_str()) == name; });
-	return it != ws_info_table.end() ? it->weight : weight_t();
+	size_t idx = std::min(ws_info_index.find(ws_info_table, name),
+			      ws_info_translated_index.find(ws_info_table, name));
+	return idx < ws_info_table.size() ? ws_info_table[idx].weight : weight_t();
 }
 
 void cylinder_table::add(int idx, cylinder_t cyl)
@@ -179,9 +216,14 @@ bool weightsystem_t::operator==(const weightsystem_t &w2) const
 }
 
 volume_t cylinder_t::gas_volume(pressure_t p) const
+{
+	return gas_volume(p, gas_compressibility(gasmix));
+}
+
+volume_t cylinder_t::gas_volume(pressure_t p, const gas_compressibility &z) const
 {
 	double bar = p.mbar / 1000.0;
-	double z_factor = gas_compressibility_factor(gasmix, bar);
+	double z_factor = z.factor(bar);
 	return volume_t { .mliter = int_cast<int>(type.size.mliter * bar_to_atm(bar) / z_factor) };
 }
 
@@ -261,6 +303,7 @@ std::vector<tank_info> tank_info_table;
 void reset_tank_info_table(std::vector<tank_info> &table)
 {
 	table.clear();
+	tank_info_index.invalidate();
 	if (prefs.display_default_tank_infos)
 		add_default_tank_infos(table);
 
@@ -352,22 +395,20 @@ void fill_default_cylinder(const struct dive *dive, cylinder_t *cyl)
 
 	if (cyl_name.empty())
 		return;
-	for (auto &ti: tank_info_table) {
-		if (ti.name == cyl_name) {
-			cyl->type.description = ti.name;
-			if (ti.ml) {
-				cyl->type.size.mliter = ti.ml;
-				cyl->type.workingpressure.mbar = ti.bar * 1000;
-			} else {
-				cyl->type.workingpressure.mbar = psi_to_mbar(ti.psi);
-				if (ti.psi)
-					cyl->type.size.mliter = lrint(cuft_to_l(ti.cuft) * 1000 / bar_to_atm(psi_to_bar(ti.psi)));
-			}
-			// MOD of air
-			cyl->depth = dive->gas_mod(cyl->gasmix, pO2, 1);
-			return;
-		}
+	const struct tank_info *ti = get_tank_info(tank_info_table, cyl_name);
+	if (!ti)
+		return;
+	cyl->type.description = ti->name;
+	if (ti->ml) {
+		cyl->type.size.mliter = ti->ml;
+		cyl->type.workingpressure.mbar = ti->bar * 1000;
+	} else {
+		cyl->type.workingpressure.mbar = psi_to_mbar(ti->psi);
+		if (ti->psi)
+			cyl->type.size.mliter = lrint(cuft_to_l(ti->cuft) * 1000 / bar_to_atm(psi_to_bar(ti->psi)));
 	}
+	// MOD of air
+	cyl->depth = dive->gas_mod(cyl->gasmix, pO2, 1);
 }
 
 cylinder_t default_cylinder(const struct dive *d)
@@ -41,6 +41,7 @@ struct cylinder_t
 	cylinder_t &operator=(cylinder_t &&) = default;
 
 	volume_t gas_volume(pressure_t p) const; /* Volume of a cylinder at pressure 'p' */
+	volume_t gas_volume(pressure_t p, const gas_compressibility &z) const; /* Same, with the precomputed Z of gasmix */
 };
 
 /* Table of cylinders.
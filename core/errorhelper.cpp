@@ -1,8 +1,11 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "errorhelper.h"
 #include "format.h"
+#include "gettext.h"
+#include "messagering.h"
 
 #include <stdarg.h>
+#include <mutex>
 
 #if !defined(Q_OS_ANDROID) && !defined(__ANDROID__)
 #define LOG_MSG(fmt, s)	fprintf(stderr, fmt, s)
@@ -23,6 +26,13 @@ void report_info(const char *fmt, ...)
 }
 
 static void (*error_cb)(std::string) = NULL;
+static void (*error_notify_cb)() = NULL;
+
+// Errors may be reported by parser worker threads. A broken file can
+// produce thousands of them, therefore they are queued and passed to
+// the UI in batches.
+static MessageRing error_queue(256);
+static std::mutex error_cb_lock; // without notify callback, flush_errors() is called by the workers
 
 int report_error(const char *fmt, ...)
 {
@@ -33,12 +43,39 @@ int report_error(const char *fmt, ...)
 	LOG_MSG("ERROR: %s\n", s.c_str());
 
 	/* if there is no error callback registered, don't produce errors */
-	if (error_cb)
-		error_cb(std::move(s));
+	if (!error_cb)
+		return -1;
+	bool first = error_queue.push(0, std::move(s));
+	if (!error_notify_cb)
+		flush_errors();
+	else if (first)
+		error_notify_cb();
 	return -1;
 }
 
+void flush_errors()
+{
+	std::lock_guard<std::mutex> lock(error_cb_lock);
+	int dropped;
+	std::vector<MessageRing::Message> messages = error_queue.drain(dropped);
+	if (!error_cb)
+		return;
+	for (MessageRing::Message &m: messages) {
+		if (m.count > 1)
+			error_cb(format_string_std(translate("gettextFromC", "%s (repeated %d times)"), m.text.c_str(), m.count));
+		else
+			error_cb(std::move(m.text));
+	}
+	if (dropped > 0)
+		error_cb(format_string_std(translate("gettextFromC", "%d more errors were not shown"), dropped));
+}
+
 void set_error_cb(void(*cb)(std::string))
 {
 	error_cb = cb;
 }
+
+void set_error_notify_cb(void(*cb)())
+{
+	error_notify_cb = cb;
+}
@@ -17,4 +17,12 @@ extern int __printf(1, 2) report_error(const char *fmt, ...);
 extern void __printf(1, 2) report_info(const char *fmt, ...);
 extern void set_error_cb(void(*cb)(std::string s));	// Callback takes ownership of passed string
 
+// By default, the error callback is called by report_error() on the reporting
+// thread. If a notify callback is set, the errors are queued instead and the
+// notify callback is called (on the reporting thread) when the first error of
+// a batch was queued. The UI then calls flush_errors() on its own thread,
+// which passes the errors to the error callback, identical errors collapsed.
+extern void set_error_notify_cb(void(*cb)());
+extern void flush_errors();
+
 #endif
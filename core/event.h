@@ -7,6 +7,7 @@
 #include "units.h"
 
 #include <string>
+#include <vector>
 #include <libdivecomputer/parser.h>
 
 struct divecomputer;
@@ -101,6 +102,48 @@ public:
 	divemode_t at(int time);
 };
 
+/*
+ * The gas and divemode changes of a dive computer, collected once, for
+ * lookups by time in O(log n). Use dive::get_timeline() to get the cached
+ * timeline of a dive computer of a dive. Only cylinder indexes are stored,
+ * the gasmixes are looked up in the cylinders of the dive.
+ */
+class dc_timeline {
+public:
+	struct gas_change {
+		int time;
+		int cylinder_index; // -1 -> unknown cylinder
+	};
+	struct mode_change {
+		int time;
+		divemode_t divemode;
+	};
+	dc_timeline(const struct dive &dive, const struct divecomputer &dc);
+
+	// Same as gasmix_loop::cylinder_index_at() and gasmix_loop::at(),
+	// but the times don't have to be increasing.
+	std::pair<int, int> cylinder_index_at(int time) const; // -1 -> no cylinders
+	std::pair<gasmix, int> gasmix_at(int time) const; // gasmix_invalid -> unknown cylinder
+	divemode_t divemode_at(int time) const;
+
+	// The changes at increasing timestamps, like gasmix_loop::next_cylinder_index()
+	// returns them (including the potentially imaginary first gas switch to cylinder 0).
+	const std::vector<gas_change> &gas_changes() const;
+	const std::vector<mode_change> &mode_changes() const;
+
+	// Was this timeline built from this dive computer in its current state?
+	bool matches(const struct divecomputer &dc) const;
+private:
+	const struct dive &dive;
+	const struct divecomputer *dc;
+	const struct event *events;
+	size_t nr_events;
+	size_t nr_cylinders;
+	divemode_t initial_divemode;
+	std::vector<gas_change> gas;
+	std::vector<mode_change> modes;
+};
+
 extern const struct event *get_first_event(const struct divecomputer &dc, const std::string &name);
 extern struct event *get_first_event(struct divecomputer &dc, const std::string &name);
 
@@ -7,6 +7,8 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include <unordered_map>
 
 struct event_type {
 	std::string name;
@@ -21,38 +23,58 @@ struct event_type {
 };
 
 static std::vector<event_type> event_types;
-
-static bool operator==(const event_type &en1, const event_type &en2)
+// The indexes of the event types by name. Mostly, a name comes with only one severity.
+static std::unordered_map<std::string, std::vector<int>> event_type_index;
+static std::mutex event_types_lock; // events are created by the parallel git loader
+
+// This is called for every event when loading and drawing profiles.
+// Therefore, look up the event directly instead of creating an
+// event_type, which would copy the name for every comparison.
+int event_type_id(const struct event *ev)
 {
-	return en1.name == en2.name && en1.severity == en2.severity;
+	auto it = event_type_index.find(ev->name);
+	if (it == event_type_index.end())
+		return -1;
+	event_severity severity = ev->get_severity();
+	for (int idx: it->second) {
+		if (event_types[idx].severity == severity)
+			return idx;
+	}
+	return -1;
 }
 
 void clear_event_types()
 {
 	event_types.clear();
+	event_type_index.clear();
 }
 
 void remember_event_type(const struct event *ev)
 {
 	if (ev->name.empty())
 		return;
-	event_type type(ev);
-	if (std::find(event_types.begin(), event_types.end(), type) != event_types.end())
+	std::lock_guard<std::mutex> lock(event_types_lock);
+	if (event_type_id(ev) >= 0)
 		return;
-	event_types.push_back(std::move(type));
+	event_type_index[ev->name].push_back((int)event_types.size());
+	event_types.emplace_back(ev);
+}
+
+bool is_event_type_hidden(int id)
+{
+	return id >= 0 && id < (int)event_types.size() && !event_types[id].plot;
 }
 
 bool is_event_type_hidden(const struct event *ev)
 {
-	auto it = std::find(event_types.begin(), event_types.end(), ev);
-	return it != event_types.end() && !it->plot;
+	return is_event_type_hidden(event_type_id(ev));
 }
 
 void hide_event_type(const struct event *ev)
 {
-	auto it = std::find(event_types.begin(), event_types.end(), ev);
-	if (it != event_types.end())
-		it->plot = false;
+	int id = event_type_id(ev);
+	if (id >= 0)
+		event_types[id].plot = false;
 }
 
 void show_all_event_types()
@@ -9,6 +9,9 @@
 extern void clear_event_types();
 extern void remember_event_type(const struct event *ev);
 extern bool is_event_type_hidden(const struct event *ev);
+// The index of the type of an event, or -1. Valid until clear_event_types().
+extern int event_type_id(const struct event *ev);
+extern bool is_event_type_hidden(int id);
 extern void hide_event_type(const struct event *ev);
 extern void show_all_event_types();
 extern void show_event_type(int idx);
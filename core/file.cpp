@@ -7,10 +7,15 @@
 #include <errno.h>
 #include "gettext.h"
 #include <zip.h>
+#include <zlib.h>
 #include <time.h>
 
+#include "binarylog.h"
 #include "dive.h"
 #include "divelog.h"
+#include "divesite.h"
+#include "device.h"
+#include "filterpreset.h"
 #include "subsurface-string.h"
 #include "format.h"
 #include "errorhelper.h"
@@ -18,13 +23,20 @@
 #include "git-access.h"
 #include "qthelper.h"
 #include "import-csv.h"
+#include "mappedfile.h"
 #include "parse.h"
+#include "perfcounters.h"
+#include "trace.h"
 
 /* For SAMPLE_* */
 #include <libdivecomputer/parser.h>
 
 /* to check XSLT version number */
 #include <libxslt/xsltconfig.h>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <numeric>
 
 /* Crazy windows sh*t */
 #ifndef O_BINARY
@@ -33,37 +45,14 @@
 
 std::pair<std::string, int> readfile(const char *filename)
 {
-	int ret, fd;
-	struct stat st;
+	mapped_file file(filename);
 
-	std::string res;
-	fd = subsurface_open(filename, O_RDONLY | O_BINARY, 0);
-	if (fd < 0)
-		return std::make_pair(res, fd);
-	ret = fstat(fd, &st);
-	if (ret < 0)
-		return std::make_pair(res, ret);
-	if (!S_ISREG(st.st_mode))
-		return std::make_pair(res, -EINVAL);
-	if (!st.st_size)
-		return std::make_pair(res, 0);
-	// Sadly, this 0-initializes the string, just before overwriting it.
-	// However, we use std::string, because that automatically 0-terminates
+	// We use std::string, because that automatically 0-terminates
 	// the data and the code expects that.
-	res.resize(st.st_size);
-	ret = read(fd, res.data(), res.size());
-	if (ret < 0)
-		return std::make_pair(res, ret);
-	// converting to int loses a bit but size will never be that big
-	if (ret == (int)res.size()) {
-		return std::make_pair(res, ret);
-	} else {
-		errno = EIO;
-		return std::make_pair(res, -1);
-	}
+	return std::make_pair(std::string(file.data()), file.status());
 }
 
-static void zip_read(struct zip_file *file, const char *filename, struct divelog *log)
+static void zip_read_buffered(struct zip_file *file, const char *filename, struct divelog *log)
 {
 	int size = 1024, n, read = 0;
 	std::vector<char> mem(size + 1);
@@ -77,30 +66,132 @@ static void zip_read(struct zip_file *file, const char *filename, struct divelog
 	(void) parse_xml_buffer(filename, mem.data(), read, log, NULL);
 }
 
+static int zip_stream_read(void *context, char *buffer, int len)
+{
+	return (int)zip_fread((struct zip_file *)context, buffer, len);
+}
+
+/*
+ * Native entries are parsed as they are decompressed. Anything else
+ * (e.g. divelogs.de exports) needs the whole document for the XSLT
+ * transformation, so the entry is read again into memory.
+ */
+static bool zip_read(struct zip *zip, zip_uint64_t index, const char *filename, struct divelog *log)
+{
+	struct zip_file *file = zip_fopen_index(zip, index, 0);
+	if (!file)
+		return false;
+	int res = parse_xml_io(filename, zip_stream_read, file, log);
+	zip_fclose(file);
+	if (res != 1)
+		return true;
+	file = zip_fopen_index(zip, index, 0);
+	if (!file)
+		return false;
+	zip_read_buffered(file, filename, log);
+	zip_fclose(file);
+	return true;
+}
+
+/* Moves the dives of a zip entry parsed into a log of its own into the log of the archive */
+static void append_log(struct divelog &to, struct divelog &from)
+{
+	// Sites with the same uuid in different entries are the same site,
+	// just as if they had been parsed into the same log.
+	for (auto &ds: from.sites) {
+		dive_site *existing = to.sites.get_by_uuid(ds->uuid);
+		if (!existing)
+			existing = to.sites.get_same(*ds);
+		if (existing) {
+			existing->merge(*ds);
+			for (struct dive *d: std::vector<dive *>(ds->dives)) {
+				unregister_dive_from_dive_site(d);
+				existing->add_dive(d);
+			}
+		} else {
+			to.sites.register_site(std::move(ds));
+		}
+	}
+	from.sites.clear();
+	to.dives.put_multiple(std::move(from.dives));
+	from.dives.clear();
+	to.trips.put_multiple(std::move(from.trips));
+	from.trips.clear();
+	for (const device &dev: from.devices)
+		add_to_device_table(to.devices, dev);
+	for (const filter_preset &preset: from.filter_presets)
+		to.filter_presets.add(preset);
+}
+
+// Archives with less entries than that are parsed on the calling thread.
+static const size_t min_entries_for_threads = 16;
+
 int try_to_open_zip(const char *filename, struct divelog *log)
 {
-	int success = 0;
 	/* Grr. libzip needs to re-open the file, it can't take a buffer */
 	struct zip *zip = subsurface_zip_open_readonly(filename, ZIP_CHECKCONS, NULL);
+	if (!zip)
+		return 0;
 
-	if (zip) {
-		int index;
-		for (index = 0;; index++) {
-			struct zip_file *file = zip_fopen_index(zip, index, 0);
-			if (!file)
-				break;
-			/* skip parsing the divelogs.de pictures */
-			if (strstr(zip_get_name(zip, index, 0), "pictures/"))
-				continue;
-			zip_read(file, filename, log);
-			zip_fclose(file);
-			success++;
-		}
-		subsurface_zip_close(zip);
+	std::vector<zip_uint64_t> entries;
+	zip_int64_t num_entries = zip_get_num_entries(zip, 0);
+	for (zip_int64_t index = 0; index < num_entries; index++) {
+		const char *name = zip_get_name(zip, index, 0);
+		/* skip parsing the divelogs.de pictures */
+		if (name && !strstr(name, "pictures/"))
+			entries.push_back(index);
+	}
 
-		if (!success)
-			return report_error(translate("gettextFromC", "No dives in the input file '%s'"), filename);
+	int success = 0;
+	int threads = QThread::idealThreadCount();
+	if (entries.size() < min_entries_for_threads || threads <= 1) {
+		for (zip_uint64_t index: entries) {
+			if (zip_read(zip, index, filename, log))
+				success++;
+		}
+	} else {
+		// Every chunk is parsed with its own handle of the archive (libzip
+		// handles can't be shared between threads) into a log of its own.
+		// The logs are appended in order, so the result is the same as if
+		// the entries had been parsed one after the other.
+		size_t num_chunks = std::min((size_t)threads, entries.size() / 4);
+		std::vector<struct divelog> logs(num_chunks);
+		std::vector<int> parsed(num_chunks, 0);
+		std::vector<size_t> chunks(num_chunks);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		QtConcurrent::blockingMap(chunks, [&](size_t chunk) {
+			size_t begin = chunk * entries.size() / num_chunks;
+			size_t end = (chunk + 1) * entries.size() / num_chunks;
+			struct zip *own = subsurface_zip_open_readonly(filename, 0, NULL);
+			if (!own) {
+				parsed[chunk] = -1;
+				return;
+			}
+			for (size_t i = begin; i < end; i++) {
+				if (zip_read(own, entries[i], filename, &logs[chunk]))
+					parsed[chunk]++;
+			}
+			subsurface_zip_close(own);
+		});
+		for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+			if (parsed[chunk] < 0) {
+				// Couldn't open the archive again: parse on this thread
+				size_t begin = chunk * entries.size() / num_chunks;
+				size_t end = (chunk + 1) * entries.size() / num_chunks;
+				parsed[chunk] = 0;
+				for (size_t i = begin; i < end; i++) {
+					if (zip_read(zip, entries[i], filename, &logs[chunk]))
+						parsed[chunk]++;
+				}
+			}
+			append_log(*log, logs[chunk]);
+			success += parsed[chunk];
+		}
 	}
+	subsurface_zip_close(zip);
+
+	if (!success)
+		return report_error(translate("gettextFromC", "No dives in the input file '%s'"), filename);
 	return success;
 }
 
@@ -109,7 +200,13 @@ static int db_test_func(void *, int, char **data, char **)
 	return *data[0] == '0';
 }
 
-static int try_to_open_db(const char *filename, std::string &mem, struct divelog *log)
+static void close_db(sqlite3 *handle)
+{
+	sqlite3_exec(handle, "COMMIT", NULL, NULL, NULL);
+	sqlite3_close(handle);
+}
+
+static int try_to_open_db(const char *filename, std::string_view mem, struct divelog *log)
 {
 	sqlite3 *handle;
 	char dm4_test[] = "select count(*) from sqlite_master where type='table' and name='Dive' and sql like '%ProfileBlob%'";
@@ -128,11 +225,14 @@ static int try_to_open_db(const char *filename, std::string &mem, struct divelog
 		return 1;
 	}
 
+	/* Read the whole database in one transaction, instead of one per query */
+	sqlite3_exec(handle, "BEGIN", NULL, NULL, NULL);
+
 	/* Testing if DB schema resembles Suunto DM5 database format */
 	retval = sqlite3_exec(handle, dm5_test, &db_test_func, 0, NULL);
 	if (!retval) {
 		retval = parse_dm5_buffer(handle, filename, mem.data(), mem.size(), log);
-		sqlite3_close(handle);
+		close_db(handle);
 		return retval;
 	}
 
@@ -140,7 +240,7 @@ static int try_to_open_db(const char *filename, std::string &mem, struct divelog
 	retval = sqlite3_exec(handle, dm4_test, &db_test_func, 0, NULL);
 	if (!retval) {
 		retval = parse_dm4_buffer(handle, filename, mem.data(), mem.size(), log);
-		sqlite3_close(handle);
+		close_db(handle);
 		return retval;
 	}
 
@@ -148,7 +248,7 @@ static int try_to_open_db(const char *filename, std::string &mem, struct divelog
 	retval = sqlite3_exec(handle, shearwater_test, &db_test_func, 0, NULL);
 	if (!retval) {
 		retval = parse_shearwater_buffer(handle, filename, mem.data(), mem.size(), log);
-		sqlite3_close(handle);
+		close_db(handle);
 		return retval;
 	}
 
@@ -156,7 +256,7 @@ static int try_to_open_db(const char *filename, std::string &mem, struct divelog
 	retval = sqlite3_exec(handle, shearwater_cloud_test, &db_test_func, 0, NULL);
 	if (!retval) {
 		retval = parse_shearwater_cloud_buffer(handle, filename, mem.data(), mem.size(), log);
-		sqlite3_close(handle);
+		close_db(handle);
 		return retval;
 	}
 
@@ -164,7 +264,7 @@ static int try_to_open_db(const char *filename, std::string &mem, struct divelog
 	retval = sqlite3_exec(handle, cobalt_test, &db_test_func, 0, NULL);
 	if (!retval) {
 		retval = parse_cobalt_buffer(handle, filename, mem.data(), mem.size(), log);
-		sqlite3_close(handle);
+		close_db(handle);
 		return retval;
 	}
 
@@ -172,7 +272,7 @@ static int try_to_open_db(const char *filename, std::string &mem, struct divelog
 	retval = sqlite3_exec(handle, divinglog_test, &db_test_func, 0, NULL);
 	if (!retval) {
 		retval = parse_divinglog_buffer(handle, filename, mem.data(), mem.size(), log);
-		sqlite3_close(handle);
+		close_db(handle);
 		return retval;
 	}
 
@@ -180,12 +280,11 @@ static int try_to_open_db(const char *filename, std::string &mem, struct divelog
 	retval = sqlite3_exec(handle, seacsync_test, &db_test_func, 0, NULL);
 	if (!retval) {
 		retval = parse_seac_buffer(handle, filename, mem.data(), mem.size(), log);
-		sqlite3_close(handle);
+		close_db(handle);
 		return retval;
 	}
 
-
-	sqlite3_close(handle);
+	close_db(handle);
 
 	return retval;
 }
@@ -206,7 +305,14 @@ static int try_to_open_db(const char *filename, std::string &mem, struct divelog
  *
  * Followed by the data values (all comma-separated, all one long line).
  */
-static int open_by_filename(const char *filename, const char *fmt, std::string &mem, struct divelog *log)
+/* The CSV parser needs a zero-terminated buffer */
+static int open_csv_buffer(std::string_view mem, enum csv_format type, struct divelog *log)
+{
+	std::string buf(mem);
+	return try_to_open_csv(buf, type, log);
+}
+
+static int open_by_filename(const char *filename, const char *fmt, std::string_view mem, struct divelog *log)
 {
 	// hack to be able to provide a comment for the translated string
 	static struct { const char *s; const char *comment; } csv_warning =
@@ -226,28 +332,82 @@ static int open_by_filename(const char *filename, const char *fmt, std::string &
 		return try_to_open_cochran(filename, mem, log);
 	/* Cochran export comma-separated-value files */
 	if (!strcasecmp(fmt, "DPT"))
-		return try_to_open_csv(mem, CSV_DEPTH, log);
+		return open_csv_buffer(mem, CSV_DEPTH, log);
 	if (!strcasecmp(fmt, "LVD"))
 		return try_to_open_liquivision(filename, mem, log);
 	if (!strcasecmp(fmt, "TMP"))
-		return try_to_open_csv(mem, CSV_TEMP, log);
+		return open_csv_buffer(mem, CSV_TEMP, log);
 	if (!strcasecmp(fmt, "HP1"))
-		return try_to_open_csv(mem, CSV_PRESSURE, log);
+		return open_csv_buffer(mem, CSV_PRESSURE, log);
 
 	return 0;
 }
 
-static int parse_file_buffer(const char *filename, std::string &mem, struct divelog *log)
+static bool is_gzip(std::string_view mem)
+{
+	return mem.size() >= 2 && (unsigned char)mem[0] == 0x1f && (unsigned char)mem[1] == 0x8b;
+}
+
+/* Decompress gzip data, e.g. of a compressed .ssrf file */
+static bool gunzip(std::string_view mem, std::string &out)
+{
+	z_stream stream = {};
+	char buffer[64 * 1024];
+	int ret;
+
+	/* 16 + MAX_WBITS: expect a gzip header */
+	if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+		return false;
+	stream.next_in = (Bytef *)mem.data();
+	stream.avail_in = mem.size();
+	do {
+		stream.next_out = (Bytef *)buffer;
+		stream.avail_out = sizeof(buffer);
+		ret = inflate(&stream, Z_NO_FLUSH);
+		out.append(buffer, sizeof(buffer) - stream.avail_out);
+	} while (ret == Z_OK);
+	inflateEnd(&stream);
+	return ret == Z_STREAM_END;
+}
+
+static int parse_file_buffer(const char *filename, std::string_view mem, struct divelog *log)
 {
 	int ret;
 	const char *fmt = strrchr(filename, '.');
 	if (fmt && (ret = open_by_filename(filename, fmt + 1, mem, log)) != 0)
 		return ret;
 
-	if (mem.empty())
+	/* The XML parser needs a zero-terminated buffer */
+	std::string buf;
+	if (is_gzip(mem)) {
+		if (!gunzip(mem, buf))
+			return report_error(translate("gettextFromC", "Failed to read '%s'"), filename);
+	} else {
+		buf = mem;
+	}
+	if (buf.empty())
 		return report_error("Out of memory parsing file %s\n", filename);
 
-	return parse_xml_buffer(filename, mem.data(), mem.size(), log, NULL);
+	return parse_xml_buffer(filename, buf.data(), buf.size(), log, NULL);
+}
+
+/*
+ * Native Subsurface XML files are parsed as they are read, without
+ * loading the whole file into memory first. Returns 1 if the file
+ * has to go through the generic path.
+ */
+static int parse_xml_file(const char *filename, struct divelog *log)
+{
+	struct stat st;
+	int ret = 1, fd;
+
+	fd = subsurface_open(filename, O_RDONLY | O_BINARY, 0);
+	if (fd < 0)
+		return 1;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size)
+		ret = parse_xml_stream(filename, fd, st.st_size, log);
+	close(fd);
+	return ret;
 }
 
 bool remote_repo_uptodate(const char *filename, struct git_info *info)
@@ -267,8 +427,12 @@ bool remote_repo_uptodate(const char *filename, struct git_info *info)
 	return false;
 }
 
+static perf_counter parse_time("parse time [us]");
+
 int parse_file(const char *filename, struct divelog *log)
 {
+	TRACE_ZONE("parse_file");
+	perf_timer timer(parse_time);
 	struct git_info info;
 	const char *fmt;
 
@@ -286,7 +450,19 @@ int parse_file(const char *filename, struct divelog *log)
 		return ret;
 	}
 
-	auto [mem, err] = readfile(filename);
+	fmt = strrchr(filename, '.');
+	if (fmt && (!strcasecmp(fmt + 1, "SSRF") || !strcasecmp(fmt + 1, "GZ"))) {
+		int ret = parse_xml_file(filename, log);
+		if (ret <= 0)
+			return ret;
+	}
+
+	if (fmt && !strcasecmp(fmt + 1, "SSRB"))
+		return load_binary_log(filename, log);
+
+	mapped_file file(filename);
+	int err = file.status();
+	std::string_view mem = file.data();
 	if (err < 0) {
 		/* we don't want to display an error if this was the default file  */
 		if (filename == prefs.default_filename)
@@ -297,7 +473,6 @@ int parse_file(const char *filename, struct divelog *log)
 		return report_error(translate("gettextFromC", "Empty file '%s'"), filename);
 	}
 
-	fmt = strrchr(filename, '.');
 	if (fmt && (!strcasecmp(fmt + 1, "DB") || !strcasecmp(fmt + 1, "BAK") || !strcasecmp(fmt + 1, "SQL"))) {
 		if (!try_to_open_db(filename, mem, log))
 			return 0;
@@ -305,18 +480,16 @@ int parse_file(const char *filename, struct divelog *log)
 
 	/* Divesoft Freedom */
 	if (fmt && (!strcasecmp(fmt + 1, "DLF")))
-		return parse_dlf_buffer((unsigned char *)mem.data(), mem.size(), log);
+		return parse_dlf_buffer((const unsigned char *)mem.data(), mem.size(), log);
 
 	/* DataTrak/Wlog */
 	if (fmt && !strcasecmp(fmt + 1, "LOG")) {
 		const char *t = strrchr(filename, '.');
 		std::string wl_name = std::string(filename, t - filename) + ".add";
-		auto [wl_mem, err] = readfile(wl_name.c_str());
-		if (err < 0) {
+		mapped_file wl_file(wl_name.c_str());
+		if (wl_file.status() < 0)
 			report_info("No file %s found. No WLog extensions.", wl_name.c_str());
-			wl_mem.clear();
-		}
-		return datatrak_import(mem, wl_mem, log);
+		return datatrak_import(mem, wl_file.data(), log);
 	}
 
 	/* OSTCtools */
@@ -327,3 +500,24 @@ int parse_file(const char *filename, struct divelog *log)
 
 	return parse_file_buffer(filename, mem, log);
 }
+
+/*
+ * Parse the files on a worker thread, so that the caller's event loop
+ * keeps running while a big log is loaded. The dives end up in "log",
+ * which must not be touched until the future has finished. The result
+ * is the list of files that could be parsed.
+ *
+ * Progress and errors are reported through the usual callbacks, which
+ * are then called from the worker thread.
+ */
+QFuture<std::vector<std::string>> parse_files_async(std::vector<std::string> filenames, struct divelog *log)
+{
+	return QtConcurrent::run([filenames = std::move(filenames), log]() {
+		std::vector<std::string> parsed;
+		for (const std::string &filename: filenames) {
+			if (!parse_file(filename.c_str(), log))
+				parsed.push_back(filename);
+		}
+		return parsed;
+	});
+}
@@ -7,7 +7,10 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <vector>
+#include <string>
+#include <string_view>
 #include <utility>
+#include <QFuture>
 
 struct divelog;
 struct zip;
@@ -15,6 +18,7 @@ struct zip;
 extern void ostctools_import(const char *file, struct divelog *log);
 
 extern int parse_file(const char *filename, struct divelog *log);
+extern QFuture<std::vector<std::string>> parse_files_async(std::vector<std::string> filenames, struct divelog *log);
 extern int try_to_open_zip(const char *filename, struct divelog *log);
 
 // Platform specific functions
@@ -28,8 +32,8 @@ extern int subsurface_stat(const char *path, struct stat *buf);
 extern struct zip *subsurface_zip_open_readonly(const char *path, int flags, int *errorp);
 extern int subsurface_zip_close(struct zip *zip);
 extern std::pair<std::string, int> readfile(const char *filename); // return data, errorcode pair.
-extern int try_to_open_cochran(const char *filename, std::string &mem, struct divelog *log);
-extern int try_to_open_liquivision(const char *filename, std::string &mem, struct divelog *log);
-extern int datatrak_import(std::string &mem, std::string &wl_mem, struct divelog *log);
+extern int try_to_open_cochran(const char *filename, std::string_view mem, struct divelog *log);
+extern int try_to_open_liquivision(const char *filename, std::string_view mem, struct divelog *log);
+extern int datatrak_import(std::string_view mem, std::string_view wl_mem, struct divelog *log);
 
 #endif // FILE_H
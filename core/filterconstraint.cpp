@@ -539,7 +539,8 @@ filter_constraint::filter_constraint(const filter_constraint &c) :
 	type(c.type),
 	string_mode(c.string_mode),
 	range_mode(c.range_mode),
-	negate(c.negate)
+	negate(c.negate),
+	tag_matches(c.tag_matches)
 {
 	if (filter_constraint_is_timestamp(type))
 		data.timestamp_range = c.data.timestamp_range;
@@ -589,6 +590,7 @@ filter_constraint &filter_constraint::operator=(const filter_constraint &c)
 	string_mode = c.string_mode;
 	range_mode = c.range_mode;
 	negate = c.negate;
+	tag_matches = c.tag_matches;
 	if (filter_constraint_is_timestamp(type))
 		data.timestamp_range = c.data.timestamp_range;
 	else if (filter_constraint_is_string(type))
@@ -616,6 +618,43 @@ bool filter_constraint::operator==(const filter_constraint &f2) const
 		       data.numerical_range.to == f2.data.numerical_range.to;
 }
 
+template <typename T>
+static bool range_narrows(enum filter_constraint_range_mode mode, T from, T to, T old_from, T old_to)
+{
+	switch (mode) {
+	case FILTER_CONSTRAINT_EQUAL:
+		return from == old_from;
+	case FILTER_CONSTRAINT_LESS:
+		return to <= old_to;
+	case FILTER_CONSTRAINT_GREATER:
+		return from >= old_from;
+	case FILTER_CONSTRAINT_RANGE:
+		return from >= old_from && to <= old_to;
+	}
+	return false;
+}
+
+// Returns true if all dives matching c also match old. This is only
+// determined for the common case of a narrowed range or fewer choices,
+// otherwise false is returned.
+bool filter_constraint_narrows(const filter_constraint &c, const filter_constraint &old)
+{
+	if (c == old)
+		return true;
+	// Negated constraints would have to widen. Time of day
+	// is special, because its ranges wrap around midnight.
+	if (c.type != old.type || c.range_mode != old.range_mode || c.negate || old.negate ||
+	    filter_constraint_is_string(c.type) || c.type == FILTER_CONSTRAINT_TIME_OF_DAY)
+		return false;
+	if (filter_constraint_is_multiple_choice(c.type))
+		return (c.data.multiple_choice & ~old.data.multiple_choice) == 0;
+	if (filter_constraint_is_timestamp(c.type))
+		return range_narrows(c.range_mode, c.data.timestamp_range.from, c.data.timestamp_range.to,
+				     old.data.timestamp_range.from, old.data.timestamp_range.to);
+	return range_narrows(c.range_mode, c.data.numerical_range.from, c.data.numerical_range.to,
+			     old.data.numerical_range.from, old.data.numerical_range.to);
+}
+
 filter_constraint::~filter_constraint()
 {
 	if (filter_constraint_is_string(type))
@@ -799,28 +838,86 @@ static bool listContainsSuperstring(const QStringList &list, const QString &s, S
 			   { return strchk(s2, s); } );
 }
 
-// Check whether any of the items of the first list is in the second list as a super string.
-// The mode is controlled by the second argument
-static bool check(const filter_constraint &c, const QStringList &list)
+static StrCheck get_strcheck(const filter_constraint &c)
 {
-	StrCheck strchk =
-		c.string_mode == FILTER_CONSTRAINT_SUBSTRING ?
+	return c.string_mode == FILTER_CONSTRAINT_SUBSTRING ?
 			[](const QString &s1, const QString &s2) { return s1.contains(s2, Qt::CaseInsensitive); } :
 		c.string_mode == FILTER_CONSTRAINT_STARTS_WITH ?
 			[](const QString &s1, const QString &s2) { return s1.startsWith(s2, Qt::CaseInsensitive); } :
 		/* FILTER_CONSTRAINT_EXACT */
 			[](const QString &s1, const QString &s2) { return s1.compare(s2, Qt::CaseInsensitive) == 0; };
+}
+
+// Check whether any of the items of the first list is in the second list as a super string.
+// The mode is controlled by the second argument
+static bool check(const filter_constraint &c, const QStringList &list)
+{
+	StrCheck strchk = get_strcheck(c);
 	return std::any_of(c.data.string_list->begin(), c.data.string_list->end(),
 			   [&list, strchk](const QString &item)
 			   { return listContainsSuperstring(list, item, strchk); }) != c.negate;
 }
 
+// Same as check(), but for a range of items that are converted to strings one by one.
+// Thus, as soon as one item matches no further strings are created.
+template <typename Range, typename ToString>
+static bool check_each(const filter_constraint &c, const Range &range, ToString to_string)
+{
+	StrCheck strchk = get_strcheck(c);
+	const QStringList &needles = *c.data.string_list;
+	bool found = std::any_of(std::begin(range), std::end(range), [&](const auto &item) {
+		QString s = to_string(item);
+		return std::any_of(needles.begin(), needles.end(),
+				   [&s, strchk](const QString &needle) { return strchk(s, needle); });
+	});
+	return found != c.negate;
+}
+
+static QString tag_string(const divetag *tag)
+{
+	return QString::fromStdString(tag->name).trimmed();
+}
+
+// There are few tags, but many dives. Therefore, the strings of a tag
+// constraint are compared to all known tags once and the tags of the
+// dives are compared to the resulting set (a bit operation). This is
+// valid as long as no tags were added and the constraint didn't change.
+struct filter_tag_matches {
+	size_t tag_count;
+	filter_constraint_string_mode string_mode;
+	QStringList needles;
+	tag_set tags;
+
+	bool valid_for(const filter_constraint &c) const
+	{
+		return tag_count == g_tag_list.size() && string_mode == c.string_mode &&
+		       needles == *c.data.string_list;
+	}
+};
+
+void filter_constraint_prepare(const filter_constraint &c)
+{
+	if (c.type != FILTER_CONSTRAINT_TAGS || (c.tag_matches && c.tag_matches->valid_for(c)))
+		return;
+	auto res = std::make_shared<filter_tag_matches>();
+	res->tag_count = g_tag_list.size();
+	res->string_mode = c.string_mode;
+	res->needles = *c.data.string_list;
+	StrCheck strchk = get_strcheck(c);
+	for (const std::unique_ptr<divetag> &tag: g_tag_list) {
+		QString s = tag_string(tag.get());
+		if (std::any_of(res->needles.begin(), res->needles.end(),
+				[&s, strchk](const QString &needle) { return strchk(s, needle); }))
+			res->tags.set(tag->index);
+	}
+	c.tag_matches = std::move(res);
+}
+
 static bool has_tags(const filter_constraint &c, const struct dive *d)
 {
-	QStringList dive_tags;
-	for (const divetag *tag: d->tags)
-		dive_tags.push_back(QString::fromStdString(tag->name).trimmed());
-	return check(c, dive_tags);
+	if (c.tag_matches && c.tag_matches->valid_for(c))
+		return d->tags.bits().intersects(c.tag_matches->tags) != c.negate;
+	return check_each(c, d->tags, tag_string);
 }
 
 static bool has_people(const filter_constraint &c, const struct dive *d)
@@ -847,20 +944,12 @@ static bool has_locations(const filter_constraint &c, const struct dive *d)
 
 static bool has_weight_type(const filter_constraint &c, const struct dive *d)
 {
-	QStringList weightsystemTypes;
-	for (auto &ws: d->weightsystems)
-		weightsystemTypes.push_back(QString::fromStdString(ws.description));
-
-	return check(c, weightsystemTypes);
+	return check_each(c, d->weightsystems, [](const weightsystem_t &ws) { return QString::fromStdString(ws.description); });
 }
 
 static bool has_cylinder_type(const filter_constraint &c, const struct dive *d)
 {
-	QStringList cylinderTypes;
-	for (const cylinder_t &cyl: d->cylinders)
-		cylinderTypes.push_back(QString::fromStdString(cyl.type.description));
-
-	return check(c, cylinderTypes);
+	return check_each(c, d->cylinders, [](const cylinder_t &cyl) { return QString::fromStdString(cyl.type.description); });
 }
 
 static bool has_suits(const filter_constraint &c, const struct dive *d)
@@ -6,8 +6,10 @@
 
 #include "units.h"
 #include <QStringList>
+#include <memory>
 
 struct dive;
+struct filter_tag_matches;
 
 enum filter_constraint_type {
 	FILTER_CONSTRAINT_DATE,
@@ -76,6 +78,8 @@ struct filter_constraint {
 		QStringList *string_list;
 		uint64_t multiple_choice; // bit-field for multiple choice lists. currently, we support 64 items, extend if needed.
 	} data;
+	// For tag constraints: the tags that match, see filter_constraint_prepare()
+	mutable std::shared_ptr<const filter_tag_matches> tag_matches;
 	// For C++, define constructors, assignment operators and destructor to make our lives easier.
 	filter_constraint(filter_constraint_type type);
 	filter_constraint(const std::string &type, const std::string &string_mode,
@@ -108,6 +112,7 @@ extern bool filter_constraint_has_date_widget(enum filter_constraint_type);
 extern bool filter_constraint_has_time_widget(enum filter_constraint_type);
 extern int filter_constraint_num_decimals(enum filter_constraint_type);
 extern bool filter_constraint_is_valid(const struct filter_constraint *constraint);
+extern bool filter_constraint_narrows(const filter_constraint &c, const filter_constraint &old); // c matches a subset of the dives old matches
 
 QString filter_constraint_type_to_string_translated(enum filter_constraint_type);
 QString filter_constraint_negate_to_string_translated(bool negate);
@@ -136,7 +141,8 @@ void filter_constraint_set_float_to(filter_constraint &c, double to); // convert
 void filter_constraint_set_timestamp_from(filter_constraint &c, timestamp_t from); // convert according to current units (metric or imperial)
 void filter_constraint_set_timestamp_to(filter_constraint &c, timestamp_t to); // convert according to current units (metric or imperial)
 void filter_constraint_set_multiple_choice(filter_constraint &c, uint64_t);
-bool filter_constraint_match_dive(const filter_constraint &c, const struct dive *d);
+void filter_constraint_prepare(const filter_constraint &c); // precompute what can be, before matching dives (not thread safe)
+bool filter_constraint_match_dive(const filter_constraint &c, const struct dive *d); // thread safe
 std::string filter_constraint_data_to_string(const struct filter_constraint &constraint); // caller takes ownership of returned string
 
 #endif
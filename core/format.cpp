@@ -353,6 +353,15 @@ std::string casprintf_loc(const char *cformat, ...)
 	return std::string(utf8.constData(), utf8.size());
 }
 
+void append_format_loc(std::string &buf, const char *cformat, ...)
+{
+	va_list ap;
+	va_start(ap, cformat);
+	QByteArray utf8 = vqasprintf_loc(cformat, ap).toUtf8();
+	va_end(ap);
+	buf.append(utf8.constData(), utf8.size());
+}
+
 std::string format_string_std(const char *fmt, ...)
 {
 	va_list ap;
@@ -377,3 +386,18 @@ std::string vformat_string_std(const char *fmt, va_list ap)
 	vsnprintf(res.data(), stringsize + 1, fmt, ap);
 	return res;
 }
+
+void append_format_std(std::string &buf, const char *fmt, ...)
+{
+	va_list ap, ap2;
+	va_start(ap, fmt);
+	va_copy(ap2, ap);
+	size_t old_size = buf.size();
+	size_t stringsize = vsnprintf(NULL, 0, fmt, ap2);
+	va_end(ap2);
+	// Format in place, including the terminal null-byte, which is then cut off again.
+	buf.resize(old_size + stringsize + 1);
+	vsnprintf(buf.data() + old_size, stringsize + 1, fmt, ap);
+	buf.resize(old_size + stringsize);
+	va_end(ap);
+}
@@ -13,5 +13,8 @@ __printf(1, 0) QString vqasprintf_loc(const char *cformat, va_list ap);
 __printf(1, 2) std::string casprintf_loc(const char *cformat, ...);
 __printf(1, 0) std::string vformat_string_std(const char *fmt, va_list ap);
 __printf(1, 2) std::string format_string_std(const char *fmt, ...);
+// Append to a buffer, without a temporary string
+__printf(2, 3) void append_format_loc(std::string &buf, const char *cformat, ...);
+__printf(2, 3) void append_format_std(std::string &buf, const char *fmt, ...);
 
 #endif
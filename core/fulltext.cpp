@@ -8,20 +8,32 @@
 #include "trip.h"
 #include "qthelper.h"
 #include <QLocale>
+#include <algorithm>
+#include <iterator>
 #include <map>
+#include <set>
+#include <unordered_map>
 
 // The FullText-search class
 class FullText {
-	std::map<QString, std::vector<dive *>> words; // Dives that belong to each word
+	// Dives that belong to each word. The dives are sorted by address,
+	// so that they can be combined and intersected by merging.
+	std::map<QString, std::vector<dive *>> words;
+	// For substring searches: the words that contain each trigram.
+	// The words point to the keys of the words map, which are stable.
+	std::unordered_map<uint64_t, std::set<const QString *>> trigrams;
 public:
 	void populate(); // Rebuild from current dive_table
 	void registerDive(struct dive *d); // Note: can be called repeatedly
 	void unregisterDive(struct dive *d); // Note: can be called repeatedly
 	void unregisterAll(); // Unregister all dives in the dive table
 	FullTextResult find(const FullTextQuery &q, StringFilterMode mode) const; // Find dives matchin all words.
+	size_t memoryUsage() const;
 private:
 	void registerWords(struct dive *d, const std::vector<QString> &w);
 	void unregisterWords(struct dive *d, const std::vector<QString> &w);
+	void registerTrigrams(const QString &word);
+	void unregisterTrigrams(const QString &word);
 	std::vector<dive *> findDives(const QString &s, StringFilterMode mode) const; // Find dives matching a given word.
 };
 
@@ -45,6 +57,11 @@ void fulltext_unregister_all()
 	self.unregisterAll();
 }
 
+size_t fulltext_memory_usage()
+{
+	return self.memoryUsage();
+}
+
 void fulltext_populate()
 {
 	self.populate();
@@ -171,15 +188,68 @@ void FullText::unregisterAll()
 	for (auto &d: divelog.dives)
 		d->full_text.reset();
 	words.clear();
+	trigrams.clear();
+}
+
+// The trigrams of a word, i.e. its substrings of three characters,
+// each packed into an integer. Words shorter than three characters have none.
+// Only counts the payload, not the overhead of the map and set nodes.
+size_t FullText::memoryUsage() const
+{
+	size_t res = 0;
+	for (auto &d: divelog.dives) {
+		if (!d->full_text)
+			continue;
+		for (const QString &word: d->full_text->words)
+			res += sizeof(word) + word.capacity() * sizeof(QChar);
+	}
+	for (auto &[word, dives]: words)
+		res += word.capacity() * sizeof(QChar) + dives.capacity() * sizeof(dive *);
+	for (auto &[trigram, w]: trigrams)
+		res += sizeof(trigram) + w.size() * sizeof(const QString *);
+	return res;
+}
+
+static std::vector<uint64_t> getTrigrams(const QString &word)
+{
+	std::vector<uint64_t> res;
+	for (int i = 0; i + 3 <= word.size(); ++i) {
+		res.push_back(((uint64_t)word[i].unicode() << 32) |
+			      ((uint64_t)word[i + 1].unicode() << 16) |
+			      (uint64_t)word[i + 2].unicode());
+	}
+	return res;
+}
+
+void FullText::registerTrigrams(const QString &word)
+{
+	for (uint64_t trigram: getTrigrams(word))
+		trigrams[trigram].insert(&word);
+}
+
+void FullText::unregisterTrigrams(const QString &word)
+{
+	for (uint64_t trigram: getTrigrams(word)) {
+		auto it = trigrams.find(trigram);
+		if (it == trigrams.end())
+			continue;
+		it->second.erase(&word);
+		if (it->second.empty())
+			trigrams.erase(it);
+	}
 }
 
 // Register words of a dive.
 void FullText::registerWords(struct dive *d, const std::vector<QString> &w)
 {
 	for (const QString &word: w) {
-		std::vector<dive *> &entry = words[word];
-		if (std::find(entry.begin(), entry.end(), d) == entry.end())
-			entry.push_back(d);
+		auto [it, inserted] = words.try_emplace(word);
+		if (inserted)
+			registerTrigrams(it->first);
+		std::vector<dive *> &entry = it->second;
+		auto pos = std::lower_bound(entry.begin(), entry.end(), d);
+		if (pos == entry.end() || *pos != d)
+			entry.insert(pos, d);
 	}
 }
 
@@ -193,19 +263,28 @@ void FullText::unregisterWords(struct dive *d, const std::vector<QString> &w)
 			continue;
 		}
 		std::vector<dive *> &entry = it->second;
-		entry.erase(std::remove(entry.begin(), entry.end(), d));
-		if (entry.empty())
+		auto pos = std::lower_bound(entry.begin(), entry.end(), d);
+		if (pos != entry.end() && *pos == d)
+			entry.erase(pos);
+		if (entry.empty()) {
+			unregisterTrigrams(it->first);
 			words.erase(it);
+		}
 	}
 }
 
-// Add dives from second array to first, if not yet there
-void combineDives(std::vector<dive *> &to, const std::vector<dive *> &from)
+// Add dives from second array to first. Call sortDives() once all dives were added.
+static void combineDives(std::vector<dive *> &to, const std::vector<dive *> &from)
 {
-	for (dive *d: from) {
-		if (std::find(to.begin(), to.end(), d) == to.end())
-			to.push_back(d);
-	}
+	to.insert(to.end(), from.begin(), from.end());
+}
+
+// Sort by address and remove duplicates
+static std::vector<dive *> sortDives(std::vector<dive *> dives)
+{
+	std::sort(dives.begin(), dives.end());
+	dives.erase(std::unique(dives.begin(), dives.end()), dives.end());
+	return dives;
 }
 
 std::vector<dive *> FullText::findDives(const QString &s, StringFilterMode mode) const
@@ -232,16 +311,34 @@ std::vector<dive *> FullText::findDives(const QString &s, StringFilterMode mode)
 			combineDives(res, it->second);
 			++it;
 		}
-		return res;
+		return sortDives(std::move(res));
 	}
 	case StringFilterMode::SUBSTRING: {
-		// Find all words that contain a substring. Here, we have to check all words!
 		std::vector<dive *> res;
-		for (auto it = words.begin(); it != words.end(); ++it) {
-			if (it->first.contains(s))
-				combineDives(res, it->second);
+		std::vector<uint64_t> searchTrigrams = getTrigrams(s);
+		if (searchTrigrams.empty()) {
+			// Search string too short to use the trigrams. Check all words.
+			for (auto it = words.begin(); it != words.end(); ++it) {
+				if (it->first.contains(s))
+					combineDives(res, it->second);
+			}
+			return sortDives(std::move(res));
+		}
+		// All matching words contain all trigrams of the search string.
+		// Check the words of the rarest one.
+		const std::set<const QString *> *candidates = nullptr;
+		for (uint64_t trigram: searchTrigrams) {
+			auto it = trigrams.find(trigram);
+			if (it == trigrams.end())
+				return {};
+			if (!candidates || it->second.size() < candidates->size())
+				candidates = &it->second;
+		}
+		for (const QString *word: *candidates) {
+			if (word->contains(s))
+				combineDives(res, words.at(*word));
 		}
-		return res;
+		return sortDives(std::move(res));
 	}
 	}
 }
@@ -253,10 +350,13 @@ FullTextResult FullText::find(const FullTextQuery &q, StringFilterMode mode) con
 
 	std::vector<dive *> res = findDives(q.words[0], mode);
 	for (size_t i = 1; i < q.words.size(); ++i) {
+		if (res.empty())
+			break;
 		std::vector<dive *> res2 = findDives(q.words[i], mode);
 		// Remove dives from res that are not in res2
-		res.erase(std::remove_if(res.begin(), res.end(),
-				[&res2] (dive *d) { return std::find(res2.begin(), res2.end(), d) == res2.end(); }), res.end());
+		std::vector<dive *> both;
+		std::set_intersection(res.begin(), res.end(), res2.begin(), res2.end(), std::back_inserter(both));
+		res = std::move(both);
 	}
 
 	return { std::move(res) };
@@ -277,5 +377,5 @@ bool FullTextQuery::doit() const
 
 bool FullTextResult::dive_matches(const struct dive *d) const
 {
-	return std::find(dives.begin(), dives.end(), d) != dives.end();
+	return std::binary_search(dives.begin(), dives.end(), d);
 }
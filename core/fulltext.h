@@ -17,6 +17,7 @@ void fulltext_register(struct dive *d); // Note: can be called repeatedly
 void fulltext_unregister(struct dive *d); // Note: can be called repeatedly
 void fulltext_unregister_all(); // Unregisters all dives in the dive table
 void fulltext_populate(); // Registers all dives in the dive table
+size_t fulltext_memory_usage(); // Approximate size of the index in bytes
 
 enum class StringFilterMode {
 	SUBSTRING = 0,
@@ -39,7 +40,7 @@ struct FullTextQuery {
 
 // Describes the result of a fulltext search
 struct FullTextResult {
-	std::vector<dive *> dives;
+	std::vector<dive *> dives; // sorted by address
 	bool dive_matches(const struct dive *d) const;
 };
 
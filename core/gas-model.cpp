@@ -6,12 +6,6 @@
 #include <stdlib.h>
 #include "dive.h"
 
-/* "Virial minus one" - the virial cubic form without the initial 1.0 */
-static double virial_m1(const double coeff[], double x)
-{
-	return x*coeff[0] + x*x*coeff[1] + x*x*x*coeff[2];
-}
-
 /*
  * Z = pV/nRT
  *
@@ -30,7 +24,7 @@ static double virial_m1(const double coeff[], double x)
  * NOTE! Helium coefficients are a linear mix operation between the
  * 323K and one for 273K isotherms, to make everything be at 300K.
  */
-double gas_compressibility_factor(struct gasmix gas, double bar)
+gas_compressibility::gas_compressibility(struct gasmix gas)
 {
 	static const double o2_coefficients[3] = {
 		-7.18092073703e-04,
@@ -48,6 +42,24 @@ double gas_compressibility_factor(struct gasmix gas, double bar)
 		+5.33304543646e-11
 	};
 
+	int o2 = get_o2(gas);
+	int he = get_he(gas);
+	int n2 = 1000 - o2 - he;
+
+	/*
+	 * Z is linear in the gas fractions, so the polynomials of the
+	 * components can be mixed once per gas mix instead of being
+	 * evaluated separately for every pressure.
+	 *
+	 * The * 0.001 is because we do the linear mixing using the
+	 * raw permille gas values.
+	 */
+	for (int i = 0; i < 3; i++)
+		coefficients[i] = (o2_coefficients[i] * o2 + he_coefficients[i] * he + n2_coefficients[i] * n2) * 0.001;
+}
+
+double gas_compressibility::factor(double bar) const
+{
 	/*
 	 * The curve fitting range is only [0,500] bar.
 	 * Anything else is way out of range for cylinder
@@ -55,21 +67,16 @@ double gas_compressibility_factor(struct gasmix gas, double bar)
 	 */
 	bar = std::clamp(bar, 0.0, 500.0);
 
-	int o2 = get_o2(gas);
-	int he = get_he(gas);
-
-	double Z = virial_m1(o2_coefficients, bar) * o2 +
-		   virial_m1(he_coefficients, bar) * he +
-		   virial_m1(n2_coefficients, bar) * (1000 - o2 - he);
-
 	/*
 	 * We add the 1.0 at the very end - the linear mixing of the
 	 * three 1.0 terms is still 1.0 regardless of the gas mix.
-	 *
-	 * The * 0.001 is because we did the linear mixing using the
-	 * raw permille gas values.
 	 */
-	return Z * 0.001 + 1.0;
+	return ((coefficients[2] * bar + coefficients[1]) * bar + coefficients[0]) * bar + 1.0;
+}
+
+double gas_compressibility_factor(struct gasmix gas, double bar)
+{
+	return gas_compressibility(gas).factor(bar);
 }
 
 /* Compute the new pressure when compressing (expanding) volome v1 at pressure p1 bar to volume v2
@@ -77,7 +84,8 @@ double gas_compressibility_factor(struct gasmix gas, double bar)
 
 double isothermal_pressure(struct gasmix gas, double p1, int volume1, int volume2)
 {
-	double p_ideal = p1 * volume1 / volume2 / gas_compressibility_factor(gas, p1);
+	gas_compressibility z(gas);
+	double p_ideal = p1 * volume1 / volume2 / z.factor(p1);
 
-	return p_ideal * gas_compressibility_factor(gas, p_ideal);
+	return p_ideal * z.factor(p_ideal);
 }
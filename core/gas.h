@@ -36,6 +36,15 @@ struct icd_data { // This structure provides communication between function isob
 
 extern bool isobaric_counterdiffusion(struct gasmix oldgasmix, struct gasmix newgasmix, struct icd_data *results);
 
+// The compressibility factor Z of a gas mix as a function of the pressure.
+// Construct once per gas mix when computing Z for many pressures.
+struct gas_compressibility {
+	explicit gas_compressibility(struct gasmix gas);
+	double factor(double bar) const;
+private:
+	double coefficients[3];	// Virial coefficients of the mix, without the 1.0 term
+};
+
 extern double gas_compressibility_factor(struct gasmix gas, double bar);
 extern double isothermal_pressure(struct gasmix gas, double p1, int volume1, int volume2);
 extern int same_gasmix(struct gasmix a, struct gasmix b);
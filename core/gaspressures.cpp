@@ -10,6 +10,9 @@
  *  populate_pressure_information() -> calc_pressure_time()
  *                                  -> fill_missing_tank_pressures() -> fill_missing_segment_pressures()
  *                                                                   -> get_pr_interpolate_data()
+ *
+ *  All of these are linear in the number of plot entries: the segments are visited in
+ *  order of time and the pressure-time integrals are taken from cumulative sums.
  */
 
 #include "dive.h"
@@ -18,6 +21,7 @@
 #include "gaspressures.h"
 #include "pref.h"
 
+#include <algorithm>
 #include <stdlib.h>
 #include <vector>
 
@@ -152,27 +156,35 @@ void dump_pr_interpolate(int i, pr_interpolate_t interpolate_pr)
 #endif
 
 
-static pr_interpolate_t get_pr_interpolate_data(const pr_track_t &segment, struct plot_info &pi, int cur)
+/*
+ * acc_pt[i] is the sum of the pressure-times of the entries 0..i-1, so that the
+ * pressure-time of the entries from..to-1 is acc_pt[to] - acc_pt[from].
+ */
+static std::vector<int> accumulate_pressure_time(const struct plot_info &pi)
+{
+	std::vector<int> acc_pt(pi.nr + 1, 0);
+	for (int i = 0; i < pi.nr; i++)
+		acc_pt[i + 1] = acc_pt[i] + pi.entry[i].pressure_time;
+	return acc_pt;
+}
+
+static pr_interpolate_t get_pr_interpolate_data(const pr_track_t &segment, const struct plot_info &pi, const std::vector<int> &acc_pt, int cur)
 { // cur = index to pi.entry corresponding to t_end of segment;
 	pr_interpolate_t interpolate;
-	int i;
+	auto begin = pi.entry.begin(), end = pi.entry.begin() + pi.nr;
+	auto by_time = [](const plot_data &entry, int sec) { return entry.sec < sec; };
+
+	// The segment covers the entries from the first one at or after t_start
+	// up to and including the first one at or after t_end.
+	int from = std::lower_bound(begin, end, segment.t_start, by_time) - begin;
+	int to = std::lower_bound(begin + from, end, segment.t_end, by_time) - begin;
+	int last = std::min(to + 1, pi.nr);
+	int acc_last = std::clamp(cur + 1, from, std::min(to, pi.nr));
 
 	interpolate.start = segment.start;
 	interpolate.end = segment.end;
-	interpolate.acc_pressure_time = 0;
-	interpolate.pressure_time = 0;
-
-	for (i = 0; i < pi.nr; i++) {
-		const plot_data &entry = pi.entry[i];
-
-		if (entry.sec < segment.t_start)
-			continue;
-		interpolate.pressure_time += entry.pressure_time;
-		if (entry.sec >= segment.t_end)
-			break;
-		if (i <= cur)
-			interpolate.acc_pressure_time += entry.pressure_time;
-	}
+	interpolate.pressure_time = acc_pt[last] - acc_pt[from];
+	interpolate.acc_pressure_time = acc_pt[acc_last] - acc_pt[from];
 	return interpolate;
 }
 
@@ -208,7 +220,9 @@ static void fill_missing_tank_pressures(const struct dive *dive, struct plot_inf
 	 *
 	 * The first two pi structures are "fillers", but in case we don't have a sample
 	 * at time 0 we need to process the second of them here, therefore i=1 */
+	std::vector<int> acc_pt = accumulate_pressure_time(pi);
 	auto last_segment = track_pr.end();
+	auto it = track_pr.begin();
 	for (i = 1; i < pi.nr; i++) { // For each point on the profile:
 		const struct plot_data &entry = pi.entry[i];
 
@@ -221,7 +235,7 @@ static void fill_missing_tank_pressures(const struct dive *dive, struct plot_inf
 		}
 		// If there is NO valid pressure value..
 		// Find the pressure segment corresponding to this entry..
-		auto it = track_pr.begin();
+		// The entries are sorted by time, so continue from the previous segment.
 		while (it != track_pr.end() && it->t_end < entry.sec) // Find the track_pr with end time..
 			++it;					       // ..that matches the plot_info time (entry.sec)
 
@@ -244,7 +258,7 @@ static void fill_missing_tank_pressures(const struct dive *dive, struct plot_inf
 			interpolate.acc_pressure_time += entry.pressure_time;
 		} else {
 			// Set up an interpolation structure
-			interpolate = get_pr_interpolate_data(*it, pi, i);
+			interpolate = get_pr_interpolate_data(*it, pi, acc_pt, i);
 			last_segment = it;
 		}
 
@@ -350,8 +364,7 @@ void populate_pressure_information(const struct dive *dive, const struct divecom
 	 */
 	cyl = sensor;
 	bool has_gaschange = dive->has_gaschange_event(dc, sensor);
-	gasmix_loop loop_gas(*dive, *dc);
-	divemode_loop loop_mode(*dc);
+	auto timeline = dive->get_timeline(*dc);
 
 	for (int i = first; i <= last; i++) {
 		struct plot_data &entry = pi.entry[i];
@@ -359,12 +372,12 @@ void populate_pressure_information(const struct dive *dive, const struct divecom
 		int time = entry.sec;
 
 		if (has_gaschange) {
-			cyl = loop_gas.cylinder_index_at(time).first;
+			cyl = timeline->cylinder_index_at(time).first;
 			if (cyl < 0)
 				cyl = sensor;
 		}
 
-		divemode_t dmode = loop_mode.at(time);
+		divemode_t dmode = timeline->divemode_at(time);
 
 		if (current != std::string::npos) { // calculate pressure-time, taking into account the dive mode for this specific segment.
 			entry.pressure_time = (int)(calc_pressure_time(dive, pi.entry[i - 1], entry) * gasfactor[dmode] + 0.5);
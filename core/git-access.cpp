@@ -16,9 +16,19 @@
 #include <fcntl.h>
 #include <stdarg.h>
 #include <git2.h>
+#include <QCoreApplication>
 #include <QString>
+#include <QThread>
 #include <QRegularExpression>
 #include <QNetworkProxy>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "subsurface-string.h"
 #include "format.h"
@@ -28,6 +38,7 @@
 #include "errorhelper.h"
 #include "git-access.h"
 #include "gettext.h"
+#include "progressreporter.h"
 #include "sha1.h"
 
 // the mobile app assumes that it shouldn't talk to the cloud
@@ -38,7 +49,17 @@ bool git_local_only = true;
 bool git_local_only = false;
 #endif
 bool git_remote_sync_successful = false;
-
+bool git_background_sync = false;
+std::mutex git_storage_lock;
+
+// Shallow fetches are supported since libgit2 1.7. The local cache of a
+// remote repository starts out with only the tip of the branch, and is
+// deepened when a merge needs more of the history.
+#if LIBGIT2_VER_MAJOR > 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 7)
+#define HAVE_SHALLOW_FETCH
+static const int initial_clone_depth = 1;
+static const int deepen_steps[] = { 20, 200, 2000, GIT_FETCH_DEPTH_UNSHALLOW };
+#endif
 
 int (*update_progress_cb)(const char *) = NULL;
 
@@ -68,19 +89,32 @@ void set_git_update_cb(int(*cb)(const char *))
 // proportional - some parts are based on compute performance, some on network speed)
 // they also provide information where in the process we are so we can analyze the log
 // to understand which parts of the process take how much time.
+static bool git_storage_progress_shown()
+{
+	// The callback updates the UI, which a background sync must not touch.
+	if (QCoreApplication::instance() && QThread::currentThread() != QCoreApplication::instance()->thread())
+		return false;
+	return update_progress_cb != NULL;
+}
+
 int git_storage_update_progress(const char *text)
 {
-	int ret = 0;
-	if (update_progress_cb)
-		ret = (*update_progress_cb)(text);
-	return ret;
+	if (!git_storage_progress_shown())
+		return 0;
+	return (*update_progress_cb)(text);
 }
 
+// The transfer callbacks are called for every object. Only format
+// and pass on the updates that are due and that somebody sees.
+static progress_reporter checkout_progress, transfer_progress, push_progress;
+
 // the checkout_progress_cb doesn't allow canceling of the operation
 // map the git progress to 20% of overall progress
 static void progress_cb(const char *, size_t completed_steps, size_t total_steps, void *)
 {
 	char buf[80];
+	if (!checkout_progress.update(completed_steps, total_steps) || !git_storage_progress_shown())
+		return;
 	snprintf(buf, sizeof(buf),  translate("gettextFromC", "Checkout from storage (%lu/%lu)"), completed_steps, total_steps);
 	(void)git_storage_update_progress(buf);
 }
@@ -110,6 +144,8 @@ static int transfer_progress_cb(const git_transfer_progress *stats, void *)
 	 */
 	if (done > last_done) {
 		last_done = done;
+		if (!transfer_progress.update(done, total) || !git_storage_progress_shown())
+			return 0;
 		snprintf(buf, sizeof(buf), translate("gettextFromC", "Transfer from storage (%d/%d)"), done, total);
 		return git_storage_update_progress(buf);
 	}
@@ -119,6 +155,8 @@ static int transfer_progress_cb(const git_transfer_progress *stats, void *)
 // the initial push to sync the repos is mapped to 10% of overall progress
 static int push_transfer_progress_cb(unsigned int current, unsigned int total, size_t, void *)
 {
+	if (!push_progress.update(current, total) || !git_storage_progress_shown())
+		return 0;
 	std::string buf = casprintf_loc(translate("gettextFromC", "Transfer to storage (%d/%d)"), current, total);
 	return git_storage_update_progress(buf.c_str());
 }
@@ -155,6 +193,76 @@ std::string get_local_dir(const std::string &url, const std::string &branch)
 			hash[4], hash[5], hash[6], hash[7]);
 }
 
+bool git_is_shard_entry(const git_tree_entry *entry)
+{
+	const char *name = git_tree_entry_name(entry);
+
+	if (git_tree_entry_filemode(entry) != GIT_FILEMODE_COMMIT || strlen(name) != 4)
+		return false;
+	return isdigit(name[0]) && isdigit(name[1]) && isdigit(name[2]) && isdigit(name[3]);
+}
+
+std::string git_shard_ref(const std::string &branch, const std::string &year)
+{
+	return "refs/shards/" + branch + "/" + year;
+}
+
+/*
+ * The shards are not covered by the default refspecs. The remote
+ * versions are fetched next to the local ones, which are updated
+ * from the branch after syncing.
+ */
+static std::string shard_fetch_refspec(const std::string &branch)
+{
+	return "+refs/shards/" + branch + "/*:refs/shards-origin/" + branch + "/*";
+}
+
+/* The shards linked from the tip of the branch: name of the shard ref and commit */
+static std::vector<std::pair<std::string, git_oid>> branch_shards(git_repository *repo, const std::string &branch)
+{
+	std::vector<std::pair<std::string, git_oid>> res;
+	git_reference *ref;
+	git_commit *commit;
+	git_tree *tree;
+
+	if (git_branch_lookup(&ref, repo, branch.c_str(), GIT_BRANCH_LOCAL))
+		return res;
+	const git_oid *id = git_reference_target(ref);
+	int error = !id || git_commit_lookup(&commit, repo, id);
+	git_reference_free(ref);
+	if (error)
+		return res;
+	error = git_commit_tree(&tree, commit);
+	git_commit_free(commit);
+	if (error)
+		return res;
+	for (size_t i = 0; i < git_tree_entrycount(tree); i++) {
+		const git_tree_entry *entry = git_tree_entry_byindex(tree, i);
+		if (git_is_shard_entry(entry))
+			res.emplace_back(git_shard_ref(branch, git_tree_entry_name(entry)), *git_tree_entry_id(entry));
+	}
+	git_tree_free(tree);
+	return res;
+}
+
+bool git_branch_is_sharded(git_repository *repo, const std::string &branch)
+{
+	return !branch_shards(repo, branch).empty();
+}
+
+/* Point the shard refs to the shards of the branch, after it was updated from the remote */
+static void update_shard_refs(git_repository *repo, const std::string &branch)
+{
+	for (auto &[name, id]: branch_shards(repo, branch)) {
+		git_reference *ref;
+		if (git_reference_create(&ref, repo, name.c_str(), &id, 1, "Update to remote")) {
+			report_info("git storage: cannot update shard %s (%s)", name.c_str(), giterr_last() ? giterr_last()->message : "(unspecified)");
+			continue;
+		}
+		git_reference_free(ref);
+	}
+}
+
 static std::string move_local_cache(struct git_info *info)
 {
 	std::string old_path = get_local_dir(info->url, info->branch);
@@ -311,13 +419,20 @@ static int update_remote(struct git_info *info, git_remote *origin, git_referenc
 {
 	git_push_options opts = GIT_PUSH_OPTIONS_INIT;
 	git_strarray refspec;
-	const char *name = git_reference_name(local);
+	std::vector<std::string> names;
+	std::vector<char *> strings;
 
 	if (verbose)
 		report_info("git storage: update remote\n");
 
-	refspec.count = 1;
-	refspec.strings = (char **)&name;
+	/* The shards first, since the branch links to them */
+	for (auto &shard: branch_shards(info->repo, info->branch))
+		names.push_back(std::move(shard.first));
+	names.push_back(git_reference_name(local));
+	for (std::string &name: names)
+		strings.push_back(name.data());
+	refspec.count = strings.size();
+	refspec.strings = strings.data();
 
 	auth_attempt = 0;
 	opts.callbacks.push_transfer_progress = &push_transfer_progress_cb;
@@ -340,6 +455,135 @@ static int update_remote(struct git_info *info, git_remote *origin, git_referenc
 
 int update_git_checkout(git_repository *repo, git_object *parent, git_tree *tree);
 
+static int merge_shard(struct git_info *info, const git_merge_options *options, const char *name,
+		       const git_oid *ancestor, const git_oid *ours, const git_oid *theirs, git_oid *result);
+
+/*
+ * Resolve the conflicts of a merge as well as we can: files that were
+ * removed on one side are removed, other conflicting files are dropped.
+ * Shards (see save-git.cpp) that were changed on both sides are merged
+ * in turn. Returns false if anything was lost.
+ */
+static bool resolve_merge_conflicts(struct git_info *info, const git_merge_options *options, git_index *index)
+{
+	struct shard_conflict {
+		std::string path;
+		bool has_ancestor;
+		git_oid ancestor, ours, theirs;
+	};
+	std::vector<shard_conflict> shards;
+	bool clean = true;
+	int error;
+	const git_index_entry *ancestor = NULL,
+			*ours = NULL,
+			*theirs = NULL;
+	git_index_conflict_iterator *iter = NULL;
+
+	error = git_index_conflict_iterator_new(&iter, index);
+	while (git_index_conflict_next(&ancestor, &ours, &theirs, iter)
+	       != GIT_ITEROVER) {
+		/* Mark this conflict as resolved */
+		report_info("git storage: conflict in %s / %s / %s -- ",
+			ours ? ours->path : "-",
+			theirs ? theirs->path : "-",
+			ancestor ? ancestor->path : "-");
+		if (ours && theirs && ours->mode == GIT_FILEMODE_COMMIT && theirs->mode == GIT_FILEMODE_COMMIT) {
+			/* Merged once the conflicts are cleaned up */
+			shards.push_back({ ours->path, ancestor != NULL, ancestor ? ancestor->id : git_oid(), ours->id, theirs->id });
+			continue;
+		}
+		clean = false;
+		if ((!ours && theirs && ancestor) ||
+		    (ours && !theirs && ancestor)) {
+			// the file was removed on one side or the other - just remove it
+			report_info("git storage: looks like a delete on one side; removing the file from the index\n");
+			error = git_index_remove(index, ours ? ours->path : theirs->path, GIT_INDEX_STAGE_ANY);
+		} else if (ancestor) {
+			error = git_index_conflict_remove(index, ours ? ours->path : theirs ? theirs->path : ancestor->path);
+		}
+		if (error) {
+			report_info("git storage: error at conflict resolution (%s)", giterr_last()->message);
+		}
+	}
+	git_index_conflict_cleanup(index);
+	git_index_conflict_iterator_free(iter);
+
+	for (shard_conflict &shard: shards) {
+		git_index_entry entry;
+		git_oid merged;
+		int ret = merge_shard(info, options, shard.path.c_str(), shard.has_ancestor ? &shard.ancestor : NULL,
+				      &shard.ours, &shard.theirs, &merged);
+		if (ret) {
+			clean = false;
+			/* Keep the local version of a shard we couldn't merge */
+			if (ret < 0)
+				merged = shard.ours;
+		}
+		memset(&entry, 0, sizeof(entry));
+		entry.mode = GIT_FILEMODE_COMMIT;
+		entry.id = merged;
+		entry.path = shard.path.c_str();
+		if (git_index_add(index, &entry)) {
+			report_info("git storage: cannot add merged shard %s (%s)", shard.path.c_str(), giterr_last()->message);
+			clean = false;
+		}
+	}
+	return clean;
+}
+
+/*
+ * Merge the local and remote version of a shard like the main tree, and
+ * commit the result with both as parents. Returns 0 on success, 1 if
+ * conflicts were resolved by dropping changes and -1 on failure.
+ */
+static int merge_shard(struct git_info *info, const git_merge_options *options, const char *name,
+		       const git_oid *ancestor, const git_oid *ours, const git_oid *theirs, git_oid *result)
+{
+	git_commit *ours_commit = NULL, *theirs_commit = NULL, *base_commit = NULL;
+	git_tree *ours_tree = NULL, *theirs_tree = NULL, *base_tree = NULL, *merged_tree = NULL;
+	git_index *index = NULL;
+	git_signature *author = NULL;
+	git_oid base, tree_id;
+	membuffer msg;
+	int ret = -1;
+
+	if (verbose)
+		report_info("git storage: merging shard %s\n", name);
+	if (git_commit_lookup(&ours_commit, info->repo, ours) || git_commit_tree(&ours_tree, ours_commit) ||
+	    git_commit_lookup(&theirs_commit, info->repo, theirs) || git_commit_tree(&theirs_tree, theirs_commit))
+		goto out;
+	/* The shard has a history of its own, which may have a closer base */
+	if (!git_merge_base(&base, info->repo, ours, theirs))
+		ancestor = &base;
+	if (ancestor && !git_commit_lookup(&base_commit, info->repo, ancestor))
+		git_commit_tree(&base_tree, base_commit);
+	if (git_merge_trees(&index, info->repo, base_tree, ours_tree, theirs_tree, options))
+		goto out;
+	ret = git_index_has_conflicts(index) && !resolve_merge_conflicts(info, options, index) ? 1 : 0;
+	if (git_index_write_tree_to(&tree_id, index, info->repo) || git_tree_lookup(&merged_tree, info->repo, &tree_id) ||
+	    get_authorship(info->repo, &author) < 0) {
+		ret = -1;
+		goto out;
+	}
+	put_format(&msg, "Automatic merge of %s\n\nCreated by %s\n", name, subsurface_user_agent().c_str());
+	if (git_commit_create_v(result, info->repo, NULL, author, author, NULL, mb_cstring(&msg), merged_tree, 2, ours_commit, theirs_commit))
+		ret = -1;
+
+out:
+	if (ret < 0)
+		report_info("git storage: merging shard %s failed (%s)", name, giterr_last() ? giterr_last()->message : "(unspecified)");
+	git_signature_free(author);
+	git_index_free(index);
+	git_tree_free(merged_tree);
+	git_tree_free(base_tree);
+	git_tree_free(theirs_tree);
+	git_tree_free(ours_tree);
+	git_commit_free(base_commit);
+	git_commit_free(theirs_commit);
+	git_commit_free(ours_commit);
+	return ret;
+}
+
 static int try_to_git_merge(struct git_info *info, git_reference **local_p, git_reference *, git_oid *base, const git_oid *local_id, const git_oid *remote_id)
 {
 	git_tree *local_tree, *remote_tree, *base_tree;
@@ -389,36 +633,8 @@ static int try_to_git_merge(struct git_info *info, git_reference **local_p, git_
 		// this is the one where I want to report more detail to the user - can't quite explain why
 		return report_error(translate("gettextFromC", "Remote storage and local data diverged. Error: merge failed (%s)"), giterr_last()->message);
 	}
-	if (git_index_has_conflicts(merged_index)) {
-		int error;
-		const git_index_entry *ancestor = NULL,
-				*ours = NULL,
-				*theirs = NULL;
-		git_index_conflict_iterator *iter = NULL;
-		error = git_index_conflict_iterator_new(&iter, merged_index);
-		while (git_index_conflict_next(&ancestor, &ours, &theirs, iter)
-		       != GIT_ITEROVER) {
-			/* Mark this conflict as resolved */
-			report_info("git storage: conflict in %s / %s / %s -- ",
-				ours ? ours->path : "-",
-				theirs ? theirs->path : "-",
-				ancestor ? ancestor->path : "-");
-			if ((!ours && theirs && ancestor) ||
-			    (ours && !theirs && ancestor)) {
-				// the file was removed on one side or the other - just remove it
-				report_info("git storage: looks like a delete on one side; removing the file from the index\n");
-				error = git_index_remove(merged_index, ours ? ours->path : theirs->path, GIT_INDEX_STAGE_ANY);
-			} else if (ancestor) {
-				error = git_index_conflict_remove(merged_index, ours ? ours->path : theirs ? theirs->path : ancestor->path);
-			}
-			if (error) {
-				report_info("git storage: error at conflict resolution (%s)", giterr_last()->message);
-			}
-		}
-		git_index_conflict_cleanup(merged_index);
-		git_index_conflict_iterator_free(iter);
+	if (git_index_has_conflicts(merged_index) && !resolve_merge_conflicts(info, &merge_options, merged_index))
 		report_error("%s", translate("gettextFromC", "Remote storage and local data diverged. Cannot combine local and remote changes"));
-	}
 	{
 		git_oid merge_oid, commit_oid;
 		git_tree *merged_tree;
@@ -447,6 +663,7 @@ static int try_to_git_merge(struct git_info *info, git_reference **local_p, git_
 		if (git_reference_set_target(local_p, *local_p, &commit_oid, "Subsurface merge event"))
 			goto write_error;
 		set_git_id(&commit_oid);
+		update_shard_refs(info->repo, info->branch);
 		git_signature_free(author);
 		if (verbose)
 			report_info("git storage: successfully merged repositories");
@@ -472,6 +689,71 @@ static int cleanup_local_cache(struct git_info *info)
 	return -1;
 }
 
+static void set_fetch_callbacks(struct git_info *info, git_remote_callbacks *callbacks)
+{
+	callbacks->transfer_progress = &transfer_progress_cb;
+	auth_attempt = 0;
+	if (info->transport == RT_SSH)
+		callbacks->credentials = credential_ssh_cb;
+	else if (info->transport == RT_HTTPS)
+		callbacks->credentials = credential_https_cb;
+	callbacks->certificate_check = certificate_check_cb;
+}
+
+/*
+ * Fetch the shards of our branch, and unless shards_only is set, what
+ * the configured refspecs of the remote fetch. Only the shards that
+ * changed on the remote transfer any objects.
+ */
+static int fetch_remote(struct git_info *info, git_remote *origin, const git_fetch_options *opts, bool shards_only)
+{
+	git_strarray configured = { NULL, 0 };
+	std::string shards = shard_fetch_refspec(info->branch);
+	std::vector<char *> strings;
+
+	if (!shards_only && git_remote_get_fetch_refspecs(&configured, origin) == 0)
+		strings.assign(configured.strings, configured.strings + configured.count);
+	strings.push_back(shards.data());
+	git_strarray refspecs = { strings.data(), strings.size() };
+	int error = git_remote_fetch(origin, &refspecs, opts, NULL);
+#if LIBGIT2_VER_MAJOR > 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 1)
+	git_strarray_dispose(&configured);
+#else
+	git_strarray_free(&configured);
+#endif
+	return error;
+}
+
+/*
+ * Find the merge base of the local and the remote branch. If the local
+ * cache is a shallow clone, the merge base may be beyond the part of
+ * the history we have, so fetch more of it until we find one.
+ */
+static int find_merge_base(struct git_info *info, git_remote *origin, git_oid *base, const git_oid *local_id, const git_oid *remote_id)
+{
+	if (!git_merge_base(base, info->repo, local_id, remote_id))
+		return 0;
+#ifdef HAVE_SHALLOW_FETCH
+	for (int depth: deepen_steps) {
+		if (git_repository_is_shallow(info->repo) != 1)
+			break;
+		if (verbose)
+			report_info("git storage: no merge base in shallow clone, deepen to %d\n", depth);
+		git_storage_update_progress(translate("gettextFromC", "Fetch more history from cloud storage"));
+		git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
+		set_fetch_callbacks(info, &opts.callbacks);
+		opts.depth = depth;
+		if (git_remote_fetch(origin, NULL, &opts, NULL)) {
+			report_info("git storage: deepening fetch failed (%s)\n", giterr_last() ? giterr_last()->message : "authentication failed");
+			break;
+		}
+		if (!git_merge_base(base, info->repo, local_id, remote_id))
+			return 0;
+	}
+#endif
+	return -1;
+}
+
 static int try_to_update(struct git_info *info, git_remote *origin, git_reference *local, git_reference *remote)
 {
 	git_oid base;
@@ -506,7 +788,7 @@ static int try_to_update(struct git_info *info, git_remote *origin, git_referenc
 		else
 			return report_error("Unable to get local or remote SHA1");
 	}
-	if (git_merge_base(&base, info->repo, local_id, remote_id)) {
+	if (find_merge_base(info, origin, &base, local_id, remote_id)) {
 		// TODO:
 		// if they have no merge base, they actually are different repos
 		// so instead merge this as merging a commit into a repo - git_merge() appears to do that
@@ -523,7 +805,10 @@ static int try_to_update(struct git_info *info, git_remote *origin, git_referenc
 		if (verbose)
 			report_info("git storage: remote is newer than local, update local");
 		git_storage_update_progress(translate("gettextFromC", "Update local storage to match cloud storage"));
-		return reset_to_remote(info, local, remote_id);
+		ret = reset_to_remote(info, local, remote_id);
+		if (!ret)
+			update_shard_refs(info->repo, info->branch);
+		return ret;
 	}
 
 	/* Is the local repo the more recent one? See if we can update upstream */
@@ -716,15 +1001,9 @@ int sync_with_remote(struct git_info *info)
 	if (verbose)
 		report_info("git storage: fetch remote %s\n", git_remote_url(origin));
 	git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
-	opts.callbacks.transfer_progress = &transfer_progress_cb;
-	auth_attempt = 0;
-	if (info->transport == RT_SSH)
-		opts.callbacks.credentials = credential_ssh_cb;
-	else if (info->transport == RT_HTTPS)
-		opts.callbacks.credentials = credential_https_cb;
-	opts.callbacks.certificate_check = certificate_check_cb;
+	set_fetch_callbacks(info, &opts.callbacks);
 	git_storage_update_progress(translate("gettextFromC", "Successful cloud connection, fetch remote"));
-	error = git_remote_fetch(origin, NULL, &opts, NULL);
+	error = fetch_remote(info, origin, &opts, false);
 	// NOTE! A fetch error is not fatal, we just report it
 	if (error) {
 		if (info->is_subsurface_cloud)
@@ -737,6 +1016,7 @@ int sync_with_remote(struct git_info *info)
 		git_local_only = true;
 		error = 0;
 	} else {
+		std::lock_guard<std::mutex> guard(git_storage_lock);
 		error = check_remote_status(info, origin);
 	}
 	git_remote_free(origin);
@@ -744,6 +1024,147 @@ int sync_with_remote(struct git_info *info)
 	return error;
 }
 
+/*
+ * Every save adds a few loose objects to the local cache, and after a
+ * few years there are so many that loading slows down. Therefore, once
+ * in a while, all reachable objects are packed into a single pack, and
+ * the loose objects and old packs it makes redundant are removed.
+ */
+static const int maintenance_min_loose_objects = 1000;
+static const int maintenance_interval = 24 * 3600;
+// Unreachable objects are only removed after that time, like git gc does
+static const int prune_grace_period = 14 * 24 * 3600;
+
+static int object_missing_cb(const git_oid *id, void *payload)
+{
+	return git_odb_exists((git_odb *)payload, id) ? 0 : 1;
+}
+
+// An odb made of the given pack only
+static git_odb *open_pack(const QString &pack)
+{
+	git_odb *odb;
+	git_odb_backend *backend;
+	QString index = pack.left(pack.size() - 5) + ".idx";
+
+	if (git_odb_new(&odb))
+		return nullptr;
+	if (git_odb_backend_one_pack(&backend, qPrintable(index)) || git_odb_add_backend(odb, backend, 1)) {
+		git_odb_free(odb);
+		return nullptr;
+	}
+	return odb;
+}
+
+void git_maintain_local_cache(const std::string &localdir)
+{
+	git_repository *repo;
+	if (git_repository_open(&repo, localdir.c_str()))
+		return;
+	QString gitdir = QString::fromUtf8(git_repository_path(repo));
+	QString stamp = gitdir + "subsurface-maintenance";
+	QDateTime now = QDateTime::currentDateTime();
+	QFileInfo stampInfo(stamp);
+	if (stampInfo.exists() && stampInfo.lastModified().secsTo(now) < maintenance_interval) {
+		git_repository_free(repo);
+		return;
+	}
+
+	QDir objects(gitdir + "objects");
+	QStringList loose;
+	for (const QString &dir: objects.entryList(QStringList("??"), QDir::Dirs | QDir::NoDotAndDotDot)) {
+		for (const QString &file: QDir(objects.filePath(dir)).entryList(QDir::Files))
+			loose.append(dir + "/" + file);
+	}
+	if (loose.size() < maintenance_min_loose_objects) {
+		git_repository_free(repo);
+		return;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	QDir packDir(objects.filePath("pack"));
+	QStringList oldPacks = packDir.entryList(QStringList("pack-*.pack"), QDir::Files);
+
+	git_packbuilder *pb = nullptr;
+	git_revwalk *walk = nullptr;
+	if (git_packbuilder_new(&pb, repo) || git_revwalk_new(&walk, repo) ||
+	    git_revwalk_push_glob(walk, "refs/*")) {
+		report_info("git storage: cannot start maintenance of %s (%s)", localdir.c_str(), giterr_last() ? giterr_last()->message : "(unspecified)");
+		git_revwalk_free(walk);
+		git_packbuilder_free(pb);
+		git_repository_free(repo);
+		return;
+	}
+	git_packbuilder_set_threads(pb, 0);
+	if (git_packbuilder_insert_walk(pb, walk) || git_packbuilder_write(pb, NULL, 0, NULL, NULL)) {
+		report_info("git storage: packing %s failed (%s)", localdir.c_str(), giterr_last() ? giterr_last()->message : "(unspecified)");
+		git_revwalk_free(walk);
+		git_packbuilder_free(pb);
+		git_repository_free(repo);
+		return;
+	}
+	size_t packed = git_packbuilder_object_count(pb);
+#if LIBGIT2_VER_MAJOR > 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 5)
+	QString newPack = QString("pack-%1.pack").arg(git_packbuilder_name(pb));
+#else
+	char hex[GIT_OID_HEXSZ + 1];
+	git_oid_tostr(hex, sizeof(hex), git_packbuilder_hash(pb));
+	QString newPack = QString("pack-%1.pack").arg(hex);
+#endif
+	git_revwalk_free(walk);
+	git_packbuilder_free(pb);
+	git_repository_free(repo);
+
+	git_odb *odb = open_pack(packDir.filePath(newPack));
+	if (!odb) {
+		report_info("git storage: cannot open new pack %s", qPrintable(newPack));
+		return;
+	}
+
+	// Loose objects that are now packed, or unreachable and old enough
+	int removedLoose = 0;
+	for (const QString &name: loose) {
+		git_oid oid;
+		QString path = objects.filePath(name);
+		if (git_oid_fromstr(&oid, qPrintable(QString(name).remove('/'))))
+			continue;
+		if ((git_odb_exists(odb, &oid) || QFileInfo(path).lastModified().secsTo(now) > prune_grace_period) &&
+		    QFile::remove(path))
+			removedLoose++;
+	}
+	for (const QString &dir: objects.entryList(QStringList("??"), QDir::Dirs | QDir::NoDotAndDotDot))
+		objects.rmdir(dir);	// only succeeds if empty
+
+	// Old packs whose objects are all in the new one, or that are old enough
+	int removedPacks = 0;
+	for (const QString &pack: oldPacks) {
+		if (pack == newPack)
+			continue;
+		QString base = pack.left(pack.size() - 5);
+		if (packDir.exists(base + ".keep"))
+			continue;
+		bool redundant = QFileInfo(packDir.filePath(pack)).lastModified().secsTo(now) > prune_grace_period;
+		if (!redundant) {
+			git_odb *old = open_pack(packDir.filePath(pack));
+			redundant = old && git_odb_foreach(old, object_missing_cb, odb) == 0;
+			git_odb_free(old);
+		}
+		if (!redundant)
+			continue;
+		for (const char *ext: { ".pack", ".idx", ".rev", ".bitmap" })
+			packDir.remove(base + ext);
+		removedPacks++;
+	}
+	git_odb_free(odb);
+
+	QFile stampFile(stamp);
+	if (stampFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		stampFile.close();
+	report_info("git storage: maintenance of %s packed %zu objects, removed %d of %d loose objects and %d old packs in %lld ms",
+		    localdir.c_str(), packed, removedLoose, (int)loose.size(), removedPacks, (long long)timer.elapsed());
+}
+
 static bool update_local_repo(struct git_info *info)
 {
 	git_reference *head;
@@ -842,14 +1263,14 @@ static bool create_local_repo(struct git_info *info)
 	if (verbose)
 		report_info("git storage: create_local_repo\n");
 
-	auth_attempt = 0;
-	opts.fetch_opts.callbacks.transfer_progress = &transfer_progress_cb;
-	if (info->transport == RT_SSH)
-		opts.fetch_opts.callbacks.credentials = credential_ssh_cb;
-	else if (info->transport == RT_HTTPS)
-		opts.fetch_opts.callbacks.credentials = credential_https_cb;
+	set_fetch_callbacks(info, &opts.fetch_opts.callbacks);
 	opts.repository_cb = repository_create_cb;
-	opts.fetch_opts.callbacks.certificate_check = certificate_check_cb;
+#ifdef HAVE_SHALLOW_FETCH
+	// Only the tip is needed to show the dives. (The local
+	// transport doesn't support shallow clones.)
+	if (info->transport != RT_LOCAL)
+		opts.fetch_opts.depth = initial_clone_depth;
+#endif
 
 	opts.checkout_branch = info->branch.c_str();
 	if (info->is_subsurface_cloud && !canReachCloudServer(info)) {
@@ -861,6 +1282,17 @@ static bool create_local_repo(struct git_info *info)
 	error = git_clone(&info->repo, info->url.c_str(), info->localdir.c_str(), &opts);
 	if (verbose > 1)
 		report_info("git storage: returned from git_clone() with return value %d\n", error);
+	if (!error) {
+		/* The clone only fetched the branches, not the shards of a sharded logbook */
+		git_remote *origin;
+		if (!git_remote_lookup(&origin, info->repo, "origin")) {
+			if (fetch_remote(info, origin, &opts.fetch_opts, true))
+				report_info("git storage: fetching the shards of %s failed (%s)", info->url.c_str(),
+					    giterr_last() ? giterr_last()->message : "(unspecified)");
+			git_remote_free(origin);
+			update_shard_refs(info->repo, info->branch);
+		}
+	}
 	if (error) {
 		report_info("git storage: clone of %s failed", info->url.c_str());
 		const char *msg = "";
@@ -995,7 +1427,7 @@ std::string extract_username(struct git_info *info, const std::string &url)
 	return url.substr(at + 1 - url.c_str());
 }
 
-git_info::git_info() : repo(nullptr), is_subsurface_cloud(0), transport(RT_LOCAL)
+git_info::git_info() : repo(nullptr), is_subsurface_cloud(0), lazy_samples(false), transport(RT_LOCAL)
 {
 }
 
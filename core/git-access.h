@@ -4,7 +4,10 @@
 
 #include "git2.h"
 #include "filterpreset.h"
+#include <array>
+#include <mutex>
 #include <string>
+#include <vector>
 
 struct dive_log;
 struct git_oid;
@@ -22,6 +25,11 @@ enum remote_transport { RT_LOCAL, RT_HTTPS, RT_SSH, RT_OTHER };
 
 extern bool git_local_only;
 extern bool git_remote_sync_successful;
+extern bool git_background_sync;	// sync with the remote after saving in the background (see cloudsync.h)
+extern std::mutex git_storage_lock;	// taken while changing the local branch
+extern bool git_load_fast_samples;
+extern bool git_binary_samples;
+extern bool git_sharded_layout;	// save every year as a shard of its own (see save-git.cpp)
 extern void clear_git_id();
 extern void set_git_id(const struct git_oid *);
 void set_git_update_cb(int(*)(const char *));
@@ -35,6 +43,8 @@ struct git_info {
 	std::string localdir;
 	struct git_repository *repo;
 	unsigned is_subsurface_cloud:1;
+	bool lazy_samples;		// don't parse samples until they are accessed
+
 	enum remote_transport transport;
 	git_info();
 	~git_info();
@@ -47,9 +57,19 @@ extern bool is_git_repository(const char *filename, struct git_info *info);
 extern bool open_git_repository(struct git_info *info);
 extern bool remote_repo_uptodate(const char *filename, struct git_info *info);
 extern int sync_with_remote(struct git_info *);
+extern void git_maintain_local_cache(const std::string &localdir);	// pack the loose objects, throttled
 extern int git_save_dives(struct git_info *, bool select_only);
 extern int git_load_dives(struct git_info *, struct divelog *log);
+using git_dive_id = std::array<unsigned char, 20>;	// id of the tree of a dive directory, see dive::git_id
+extern int git_load_changed_dives(struct git_info *, const std::string &old_sha, struct divelog *log, std::vector<git_dive_id> &removed);
+extern void git_load_samples(const struct dive &dive, struct divecomputer &dc);
 extern int do_git_save(struct git_info *, bool select_only, bool create_empty);
 extern int git_create_local_repo(const std::string &filename);
 
+// The shards of the sharded layout are gitlinks named after the year in the
+// top-level tree, whose commits are kept by the ref git_shard_ref().
+extern bool git_is_shard_entry(const git_tree_entry *entry);
+extern std::string git_shard_ref(const std::string &branch, const std::string &year);
+extern bool git_branch_is_sharded(git_repository *repo, const std::string &branch);
+
 #endif // GITACCESS_H
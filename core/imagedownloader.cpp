@@ -8,12 +8,17 @@
 #include "videoframeextractor.h"
 #include "qt-models/divepicturemodel.h"
 #include "metadata.h"
+#include "perfcounters.h"
+#include "thumbnailstore.h"
+#include "core/settings/qPrefMedia.h"
 #include <unistd.h>
 #include <QString>
 #include <QImageReader>
 #include <QSvgRenderer>
 #include <QDataStream>
 #include <QPainter>
+#include <QTimer>
+#include <algorithm>
 #ifdef LIBRAW_SUPPORT
 #include <libraw/libraw.h>
 #endif
@@ -29,6 +34,11 @@ ImageDownloader *ImageDownloader::instance()
 	return &imageDownloader;
 }
 
+// Don't flood the network (and the memory of mobile devices) with hundreds
+// of simultaneous requests, when a log with remote pictures is opened.
+static const int max_concurrent_downloads = 4;
+static const int max_download_attempts = 3;
+
 ImageDownloader::ImageDownloader()
 {
 	connect(&manager, &QNetworkAccessManager::finished, this, &ImageDownloader::saveImage);
@@ -36,42 +46,133 @@ ImageDownloader::ImageDownloader()
 
 void ImageDownloader::load(QUrl url, QString filename)
 {
-	QNetworkRequest request(url);
-	request.setAttribute(QNetworkRequest::User, filename);
-	manager.get(request);
+	queue.enqueue({ std::move(url), std::move(filename), 0 });
+	startDownloads();
+}
+
+void ImageDownloader::startDownloads()
+{
+	while (!queue.isEmpty() && (int)running.size() < max_concurrent_downloads)
+		start(queue.dequeue());
+}
+
+static QString cachedImagePath(const QString &filename)
+{
+	QString path = QStandardPaths::standardLocations(QStandardPaths::CacheLocation).first();
+	QDir dir(path);
+	if (!dir.exists())
+		dir.mkpath(path);
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(filename.toUtf8());
+	return path.append("/").append(hash.result().toHex());
+}
+
+// The ETag of a downloaded image is stored next to it, for revalidation.
+static QString etagPath(const QString &path)
+{
+	return path + ".etag";
+}
+
+void ImageDownloader::start(const Download &download)
+{
+	QString path = cachedImagePath(download.filename);
+	QNetworkRequest request(download.url);
+	request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+
+	// If we downloaded this image before, ask the server whether it changed.
+	QFileInfo info(path);
+	if (info.exists()) {
+		request.setHeader(QNetworkRequest::IfModifiedSinceHeader, info.lastModified());
+		QFile etagFile(etagPath(path));
+		if (etagFile.open(QIODevice::ReadOnly))
+			request.setRawHeader("If-None-Match", etagFile.readAll());
+	}
+
+	QNetworkReply *reply = manager.get(request);
+	running[reply] = { download, std::move(path), {} };
+	connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { readData(reply); });
+}
+
+// Write the data to the file as it comes in, instead of buffering the whole image.
+void ImageDownloader::readData(QNetworkReply *reply)
+{
+	auto it = running.find(reply);
+	if (it == running.end())
+		return;
+	Transfer &transfer = it->second;
+	if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304)
+		return; // Not modified
+	if (!transfer.file) {
+		transfer.file = std::make_unique<QSaveFile>(transfer.path);
+		if (!transfer.file->open(QIODevice::WriteOnly))
+			report_info("Cannot write image to %s", qPrintable(transfer.path));
+	}
+	QByteArray data = reply->readAll();
+	if (transfer.file->isOpen())
+		transfer.file->write(data);
+}
+
+static bool isTransientError(QNetworkReply *reply)
+{
+	switch (reply->error()) {
+	case QNetworkReply::TimeoutError:
+	case QNetworkReply::RemoteHostClosedError:
+	case QNetworkReply::TemporaryNetworkFailureError:
+	case QNetworkReply::NetworkSessionFailedError:
+	case QNetworkReply::ProxyTimeoutError:
+	case QNetworkReply::ServiceUnavailableError:
+	case QNetworkReply::InternalServerError:
+	case QNetworkReply::UnknownServerError:
+		return true;
+	default:
+		return false;
+	}
 }
 
 void ImageDownloader::saveImage(QNetworkReply *reply)
 {
-	QString filename = reply->request().attribute(QNetworkRequest::User).toString();
+	reply->deleteLater();
+	if (reply->error() == QNetworkReply::NoError)
+		readData(reply); // Write what is left
+	auto it = running.find(reply);
+	if (it == running.end())
+		return;
+	Transfer transfer = std::move(it->second);
+	running.erase(it);
+	QString filename = transfer.download.filename;
 
 	if (reply->error() != QNetworkReply::NoError) {
-		emit failed(std::move(filename));
+		if (isTransientError(reply) && transfer.download.attempt + 1 < max_download_attempts) {
+			// Try again later, waiting 1, 2, 4... seconds.
+			Download download = std::move(transfer.download);
+			int delay = 1000 << download.attempt++;
+			QTimer::singleShot(delay, this, [this, download]() { queue.enqueue(download); startDownloads(); });
+		} else {
+			emit failed(std::move(filename));
+		}
+	} else if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
+		// Our copy is still up to date.
+		learnPictureFilename(filename, transfer.path);
+		emit loaded(std::move(filename));
 	} else {
-		QByteArray imageData = reply->readAll();
-		if (imageData.isEmpty()) {
+		if (!transfer.file || !transfer.file->isOpen() || transfer.file->size() == 0) {
 			emit failed(std::move(filename));
-		} else {
-			QString path = QStandardPaths::standardLocations(QStandardPaths::CacheLocation).first();
-			QDir dir(path);
-			if (!dir.exists())
-				dir.mkpath(path);
-			QCryptographicHash hash(QCryptographicHash::Sha1);
-			hash.addData(filename.toUtf8());
-			QFile imageFile(path.append("/").append(hash.result().toHex()));
-			if (imageFile.open(QIODevice::WriteOnly)) {
-				report_info("Write image to %s", qPrintable(imageFile.fileName()));
-				QDataStream stream(&imageFile);
-				stream.writeRawData(imageData.data(), imageData.length());
-				imageFile.waitForBytesWritten(-1);
-				imageFile.close();
-				learnPictureFilename(filename, imageFile.fileName());
-			}
+		} else if (transfer.file->commit()) {
+			report_info("Wrote image to %s", qPrintable(transfer.path));
+			QByteArray etag = reply->rawHeader("ETag");
+			QFile etagFile(etagPath(transfer.path));
+			if (etag.isEmpty())
+				etagFile.remove();
+			else if (etagFile.open(QIODevice::WriteOnly))
+				etagFile.write(etag);
+			learnPictureFilename(filename, transfer.path);
 			emit loaded(std::move(filename));
+		} else {
+			emit failed(std::move(filename));
 		}
 	}
 
-	reply->deleteLater();
+	startDownloads();
 }
 
 static bool hasVideoFileExtension(const QString &filename)
@@ -212,6 +313,8 @@ Thumbnailer::Thumbnailer() : failImage(QPixmap(":filter-close").scaled(maxThumbn
 	connect(VideoFrameExtractor::instance(), &VideoFrameExtractor::extracted, this, &Thumbnailer::frameExtracted);
 	connect(VideoFrameExtractor::instance(), &VideoFrameExtractor::failed, this, &Thumbnailer::frameExtractionFailed);
 	connect(VideoFrameExtractor::instance(), &VideoFrameExtractor::failed, this, &Thumbnailer::frameExtractionInvalid);
+	setCacheSize(prefs.thumbnail_cache_size);
+	connect(qPrefMedia::instance(), &qPrefMedia::thumbnail_cache_sizeChanged, this, &Thumbnailer::setCacheSize);
 }
 
 Thumbnailer *Thumbnailer::instance()
@@ -275,30 +378,28 @@ Thumbnailer::Thumbnail Thumbnailer::getVideoThumbnailFromStream(QDataStream &str
 // If Thumbnail::QImage is null, the thumbnail is scheduled for recreation.
 Thumbnailer::Thumbnail Thumbnailer::getThumbnailFromCache(const QString &picture_filename)
 {
-	QString filename = thumbnailFileName(picture_filename);
-	if (filename.isEmpty())
+	if (picture_filename.isEmpty())
+		return { QImage(), MEDIATYPE_UNKNOWN, duration_t() };
+	QByteArray data;
+	QDateTime thumbnailTime;
+	if (!ThumbnailStore::instance().get(picture_filename, data, thumbnailTime))
 		return { QImage(), MEDIATYPE_UNKNOWN, duration_t() };
-	QFile file(filename);
 
 	if (prefs.auto_recalculate_thumbnails) {
 		// Check if thumbnails is older than the (local) image file
 		QString filenameLocal = localFilePath(qPrintable(picture_filename));
 		QFileInfo pictureInfo(filenameLocal);
-		QFileInfo thumbnailInfo(file);
-		if (pictureInfo.exists() && thumbnailInfo.exists()) {
+		if (pictureInfo.exists()) {
 			QDateTime pictureTime = pictureInfo.lastModified();
-			QDateTime thumbnailTime = thumbnailInfo.lastModified();
 			if (pictureTime.isValid() && thumbnailTime.isValid() && thumbnailTime < pictureTime) {
-				// Both files exist, have valid timestamps and thumbnail was calculated before picture.
+				// Picture exists, has a valid timestamp and thumbnail was calculated before picture.
 				// Return an empty thumbnail to signal recalculation of the thumbnail
 				return { QImage(), MEDIATYPE_UNKNOWN, duration_t() };
 			}
 		}
 	}
 
-	if (!file.open(QIODevice::ReadOnly))
-		return { QImage(), MEDIATYPE_UNKNOWN, duration_t() };
-	QDataStream stream(&file);
+	QDataStream stream(data);
 
 	// Each thumbnail file is composed of a media-type and an image file.
 	quint32 type;
@@ -323,26 +424,23 @@ Thumbnailer::Thumbnail Thumbnailer::addVideoThumbnailToCache(const QString &pict
 	//	for each picture:
 	//		uint32	offset in msec from begining of video
 	//		QImage	frame
-	QString filename = thumbnailFileName(picture_filename);
-	QSaveFile file(filename);
-	if (file.open(QIODevice::WriteOnly)) {
-		QDataStream stream(&file);
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
 
-		stream << (quint32)MEDIATYPE_VIDEO;
-		stream << (quint32)duration.seconds;
+	stream << (quint32)MEDIATYPE_VIDEO;
+	stream << (quint32)duration.seconds;
 
-		if (image.isNull()) {
-			// No image provided
-			stream << (quint32)0;
-		} else {
-			// Currently, we support at most one image
-			stream << (quint32)1;
-			stream << (quint32)position.seconds;
-			stream << image;
-		}
-
-		file.commit();
+	if (image.isNull()) {
+		// No image provided
+		stream << (quint32)0;
+	} else {
+		// Currently, we support at most one image
+		stream << (quint32)1;
+		stream << (quint32)position.seconds;
+		stream << image;
 	}
+
+	ThumbnailStore::instance().put(picture_filename, data);
 	return { videoImage, MEDIATYPE_VIDEO, duration };
 }
 
@@ -365,26 +463,21 @@ Thumbnailer::Thumbnail Thumbnailer::addPictureThumbnailToCache(const QString &pi
 	// The format of a picture-thumbnail is very simple:
 	// 	uint32	MEDIATYPE_PICTURE
 	// 	QImage	thumbnail
-	QString filename = thumbnailFileName(picture_filename);
-	QSaveFile file(filename);
-	if (file.open(QIODevice::WriteOnly)) {
-		QDataStream stream(&file);
-
-		stream << (quint32)MEDIATYPE_PICTURE;
-		stream << thumbnail;
-		file.commit();
-	}
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+
+	stream << (quint32)MEDIATYPE_PICTURE;
+	stream << thumbnail;
+	ThumbnailStore::instance().put(picture_filename, data);
 	return { thumbnail, MEDIATYPE_PICTURE, duration_t() };
 }
 
 Thumbnailer::Thumbnail Thumbnailer::addUnknownThumbnailToCache(const QString &picture_filename)
 {
-	QString filename = thumbnailFileName(picture_filename);
-	QSaveFile file(filename);
-	if (file.open(QIODevice::WriteOnly)) {
-		QDataStream stream(&file);
-		stream << (quint32)MEDIATYPE_UNKNOWN;
-	}
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+	stream << (quint32)MEDIATYPE_UNKNOWN;
+	ThumbnailStore::instance().put(picture_filename, data);
 	return { unknownImage, MEDIATYPE_UNKNOWN, duration_t() };
 }
 
@@ -399,6 +492,7 @@ void Thumbnailer::frameExtracted(QString filename, QImage thumbnail, duration_t
 		markVideoThumbnail(thumbnail);
 		addVideoThumbnailToCache(filename, duration, thumbnail, offset);
 		QMutexLocker l(&lock);
+		cacheThumbnail(filename, { thumbnail, MEDIATYPE_VIDEO, duration });
 		workingOn.remove(filename);
 		emit thumbnailChanged(filename, std::move(thumbnail), duration);
 	}
@@ -423,6 +517,7 @@ void Thumbnailer::frameExtractionInvalid(QString filename, duration_t)
 	// to recalculate thumbnails with an updated ffmpeg binary..?
 	addUnknownThumbnailToCache(filename);
 	QMutexLocker l(&lock);
+	imageCache.remove(filename);
 	workingOn.remove(filename);
 }
 
@@ -437,6 +532,7 @@ void Thumbnailer::recalculate(QString filename)
 		return;
 
 	QMutexLocker l(&lock);
+	cacheThumbnail(filename, thumbnail);
 	emit thumbnailChanged(filename, thumbnail.img, thumbnail.duration);
 	workingOn.remove(filename);
 }
@@ -444,6 +540,7 @@ void Thumbnailer::recalculate(QString filename)
 void Thumbnailer::processItem(QString filename, bool tryDownload)
 {
 	Thumbnail thumbnail = getThumbnailFromCache(filename);
+	bool failed = false;
 
 	if (thumbnail.img.isNull()) {
 		thumbnail = getHashedImage(filename, tryDownload);
@@ -452,6 +549,7 @@ void Thumbnailer::processItem(QString filename, bool tryDownload)
 
 		if (thumbnail.img.isNull()) {
 			thumbnail.img = failImage;
+			failed = true;
 		} else {
 			int size = maxThumbnailSize();
 			thumbnail.img = thumbnail.img.scaled(size, size, Qt::KeepAspectRatio);
@@ -459,6 +557,9 @@ void Thumbnailer::processItem(QString filename, bool tryDownload)
 	}
 
 	QMutexLocker l(&lock);
+	// Don't remember failures: the picture might show up later.
+	if (!failed)
+		cacheThumbnail(filename, thumbnail);
 	emit thumbnailChanged(filename, thumbnail.img, thumbnail.duration);
 	workingOn.remove(filename);
 }
@@ -467,7 +568,8 @@ void Thumbnailer::imageDownloaded(QString filename)
 {
 	// Image was downloaded -> try thumbnailing again.
 	QMutexLocker l(&lock);
-	workingOn[filename] = QtConcurrent::run(&pool, [this, filename]() { processItem(filename, false); });
+	workingOn.remove(filename);
+	schedule(filename, Job::FetchNoDownload, PriorityBackground);
 }
 
 void Thumbnailer::imageDownloadFailed(QString filename)
@@ -477,41 +579,105 @@ void Thumbnailer::imageDownloadFailed(QString filename)
 	workingOn.remove(filename);
 }
 
-QImage Thumbnailer::fetchThumbnail(const QString &filename, bool synchronous)
+static perf_counter thumbnail_cache_hits("thumbnail cache hits");
+static perf_counter thumbnail_cache_misses("thumbnail cache misses");
+
+QImage Thumbnailer::fetchThumbnail(const QString &filename, bool synchronous, Priority priority)
 {
+	QMutexLocker l(&lock);
+	if (const Thumbnail *cached = imageCache.object(filename)) {
+		++cacheHits;
+		thumbnail_cache_hits.add();
+		// The duration of videos is only passed on by the signal.
+		if (cached->duration.seconds > 0)
+			emit thumbnailChanged(filename, cached->img, cached->duration);
+		return cached->img;
+	}
+	++cacheMisses;
+	thumbnail_cache_misses.add();
+
 	if (synchronous) {
+		l.unlock();
+
 		// In synchronous mode, first try the thumbnail cache.
 		Thumbnail thumbnail = getThumbnailFromCache(filename);
-		if (!thumbnail.img.isNull())
-			return thumbnail.img;
+		if (thumbnail.img.isNull()) {
+			// If that didn't work, try to thumbnail the image.
+			thumbnail = getHashedImage(filename, false);
+			if (thumbnail.type == MEDIATYPE_STILL_LOADING || thumbnail.img.isNull())
+				return failImage; // No support for delayed thumbnails (web).
 
-		// If that didn't work, try to thumbnail the image.
-		thumbnail = getHashedImage(filename, false);
-		if (thumbnail.type == MEDIATYPE_STILL_LOADING || thumbnail.img.isNull())
-			return failImage; // No support for delayed thumbnails (web).
+			int size = maxThumbnailSize();
+			thumbnail.img = thumbnail.img.scaled(size, size, Qt::KeepAspectRatio);
+		}
 
-		int size = maxThumbnailSize();
-		return thumbnail.img.scaled(size, size, Qt::KeepAspectRatio);
+		l.relock();
+		cacheThumbnail(filename, thumbnail);
+		return thumbnail.img;
 	}
 
+	schedule(filename, Job::Fetch, priority);
+	return dummyImage;
+}
+
+void Thumbnailer::calculateThumbnails(const QVector<QString> &filenames)
+{
 	QMutexLocker l(&lock);
+	for (const QString &filename: filenames)
+		schedule(filename, Job::Recalculate, PriorityBackground);
+}
+
+Thumbnailer::QueueKey Thumbnailer::queueKey(Priority priority)
+{
+	++requestCounter;
+	return { priority, priority == PriorityBackground ? requestCounter : -requestCounter };
+}
 
-	// We are not currently fetching this thumbnail - add it to the list.
-	if (!workingOn.contains(filename)) {
-		workingOn.insert(filename,
-				 QtConcurrent::run(&pool, [this, filename]() { processItem(filename, true); }));
+void Thumbnailer::schedule(const QString &filename, Job job, Priority priority)
+{
+	// Don't queue thumbnails that we are already working on.
+	if (workingOn.contains(filename)) {
+		raisePriority(filename, priority);
+		return;
 	}
-	return dummyImage;
+	QueueKey key = queueKey(priority);
+	workingOn.insert(filename);
+	queued.insert(filename, { job, key });
+	queue.emplace(key, filename);
+	QtConcurrent::run(&pool, [this]() { runNext(); });
 }
 
-void Thumbnailer::calculateThumbnails(const QVector<QString> &filenames)
+void Thumbnailer::prioritize(const QString &filename, Priority priority)
 {
 	QMutexLocker l(&lock);
-	for (const QString &filename: filenames) {
-		if (!workingOn.contains(filename)) {
-			workingOn.insert(filename,
-					 QtConcurrent::run(&pool, [this, filename]() { recalculate(filename); }));
-		}
+	raisePriority(filename, priority);
+}
+
+void Thumbnailer::raisePriority(const QString &filename, Priority priority)
+{
+	auto it = queued.find(filename);
+	if (it == queued.end() || it->key.first > priority)
+		return;
+	queue.erase(it->key);
+	it->key = queueKey(priority);
+	queue.emplace(it->key, filename);
+}
+
+void Thumbnailer::runNext()
+{
+	QMutexLocker l(&lock);
+	// The queue might have been cleared in the meantime.
+	if (queue.empty())
+		return;
+	QString filename = std::move(queue.begin()->second);
+	queue.erase(queue.begin());
+	Job job = queued.take(filename).job;
+	l.unlock();
+
+	switch (job) {
+	case Job::Fetch:		return processItem(filename, true);
+	case Job::FetchNoDownload:	return processItem(filename, false);
+	case Job::Recalculate:		return recalculate(filename);
 	}
 }
 
@@ -522,11 +688,44 @@ void Thumbnailer::clearWorkQueue()
 	VideoFrameExtractor::instance()->clearWorkQueue();
 
 	QMutexLocker l(&lock);
-	for (auto it = workingOn.begin(); it != workingOn.end(); ++it)
-		it->cancel();
+	pool.clear();
+	queue.clear();
+	queued.clear();
 	workingOn.clear();
 }
 
+void Thumbnailer::finish()
+{
+	clearWorkQueue();
+	pool.waitForDone();
+}
+
+void Thumbnailer::cacheThumbnail(const QString &filename, const Thumbnail &thumbnail)
+{
+	if (thumbnail.img.isNull())
+		return;
+	imageCache.insert(filename, new Thumbnail(thumbnail), (int)(thumbnail.img.sizeInBytes() / 1024) + 1);
+}
+
+void Thumbnailer::setCacheSize(int mb)
+{
+	QMutexLocker l(&lock);
+	imageCache.setMaxCost(std::max(mb, 0) * 1024);
+}
+
+Thumbnailer::CacheStatistics Thumbnailer::cacheStatistics() const
+{
+	QMutexLocker l(&lock);
+	return { cacheHits, cacheMisses, (int)imageCache.count(), (int)imageCache.totalCost() };
+}
+
+void Thumbnailer::reportCacheStatistics() const
+{
+	CacheStatistics stats = cacheStatistics();
+	report_info("thumbnail cache: %d hits, %d misses, %d thumbnails, %d kB",
+		    stats.hits, stats.misses, stats.count, stats.kb);
+}
+
 static const int maxZoom = 3;	// Maximum zoom: thrice of standard size
 
 int Thumbnailer::defaultThumbnailSize()
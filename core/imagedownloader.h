@@ -3,10 +3,16 @@
 #define IMAGEDOWNLOADER_H
 
 #include "metadata.h"
+#include <QCache>
 #include <QImage>
-#include <QFuture>
 #include <QNetworkReply>
+#include <QQueue>
+#include <QSaveFile>
 #include <QThreadPool>
+#include <QSet>
+#include <map>
+#include <memory>
+#include <unordered_map>
 
 class ImageDownloader : public QObject {
 	Q_OBJECT
@@ -19,8 +25,23 @@ signals:
 	void loaded(QString filename);
 	void failed(QString filename);
 private:
+	struct Download {
+		QUrl url;
+		QString filename;
+		int attempt;
+	};
+	// A running download, which is written to the cache file as the data comes in.
+	struct Transfer {
+		Download download;
+		QString path;
+		std::unique_ptr<QSaveFile> file;
+	};
 	QNetworkAccessManager manager;
-	void loadFromUrl(const QString &filename, const QUrl &);
+	QQueue<Download> queue;
+	std::unordered_map<QNetworkReply *, Transfer> running;
+	void startDownloads();
+	void start(const Download &download);
+	void readData(QNetworkReply *reply);
 	void saveImage(QNetworkReply *reply);
 };
 
@@ -30,6 +51,13 @@ class Thumbnailer : public QObject {
 public:
 	static Thumbnailer *instance();
 
+	// Thumbnails are processed in order of priority.
+	enum Priority {
+		PriorityBackground,
+		PriorityNeighbour,	// Close to the visible thumbnails
+		PriorityVisible
+	};
+
 	// Schedule a thumbnail for fetching or calculation.
 	// If synchronous is false, returns a placeholder thumbnail.
 	// The actual thumbnail will be sent via a signal later.
@@ -37,16 +65,34 @@ public:
 	// In this mode only precalculated thumbnails or thumbnails
 	// from pictures are returned. Video extraction and remote
 	// images are not supported.
-	QImage fetchThumbnail(const QString &filename, bool synchronous);
+	QImage fetchThumbnail(const QString &filename, bool synchronous, Priority priority = PriorityBackground);
+
+	// Raise the priority of a queued thumbnail, for example because it
+	// was scrolled into view. Among thumbnails of the same priority the
+	// last one raised is processed first. No-op for thumbnails that are
+	// not queued or that already have a higher priority.
+	void prioritize(const QString &filename, Priority priority);
 
 	// Schedule multiple thumbnails for forced recalculation
 	void calculateThumbnails(const QVector<QString> &filenames);
 
 	// If we change dive, clear all unfinished thumbnail creations
 	void clearWorkQueue();
+	// On exit: drop the queued thumbnails and wait for the running ones,
+	// so that no thumbnail is written to the cache anymore.
+	void finish();
 	static int maxThumbnailSize();
 	static int defaultThumbnailSize();
 	static int thumbnailSize(double zoomLevel);
+
+	// Decoded thumbnails are kept in memory, see prefs.thumbnail_cache_size.
+	struct CacheStatistics {
+		int hits, misses;
+		int count;		// Number of cached thumbnails
+		int kb;
+	};
+	CacheStatistics cacheStatistics() const;
+	void reportCacheStatistics() const; // Writes the numbers to the log via report_info()
 public slots:
 	void imageDownloaded(QString filename);
 	void imageDownloadFailed(QString filename);
@@ -76,6 +122,17 @@ private:
 	Thumbnail fetchImage(const QString &filename, const QString &originalFilename, bool tryDownload);
 	Thumbnail getHashedImage(const QString &filename, bool tryDownload);
 	void markVideoThumbnail(QImage &img);
+	void cacheThumbnail(const QString &filename, const Thumbnail &thumbnail); // Call with lock held
+	void setCacheSize(int mb);
+
+	enum class Job {
+		Fetch,
+		FetchNoDownload,
+		Recalculate
+	};
+	void schedule(const QString &filename, Job job, Priority priority); // Call with lock held
+	void raisePriority(const QString &filename, Priority priority); // Call with lock held
+	void runNext();
 
 	mutable QMutex lock;
 	QThreadPool pool;
@@ -85,7 +142,30 @@ private:
 	QImage videoOverlayImage;	// Overlay for video thumbnails
 	QImage unknownImage;		// Place holder for files where we couldn't determine the type
 
-	QMap<QString,QFuture<void>> workingOn;
+	// Thumbnails that are queued or being worked on
+	QSet<QString> workingOn;
+
+	// The queued thumbnails. A pool job is started for each of them, but
+	// the jobs take the thumbnail with the highest priority when they run.
+	// Within a priority, visible and neighbouring thumbnails are sorted by
+	// decreasing time of request, background thumbnails by increasing time.
+	using QueueKey = std::pair<int, qint64>; // priority, time of request
+	struct QueueKeyCompare {
+		bool operator()(const QueueKey &k1, const QueueKey &k2) const
+		{
+			return k1.first != k2.first ? k1.first > k2.first : k1.second < k2.second;
+		}
+	};
+	struct QueuedItem {
+		Job job;
+		QueueKey key;
+	};
+	std::map<QueueKey, QString, QueueKeyCompare> queue;
+	QHash<QString, QueuedItem> queued;
+	qint64 requestCounter = 0;
+	QueueKey queueKey(Priority priority);
+	QCache<QString,Thumbnail> imageCache;	// Cost in kB
+	int cacheHits = 0, cacheMisses = 0;
 };
 
 #endif // IMAGEDOWNLOADER_H
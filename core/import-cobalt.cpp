@@ -18,6 +18,28 @@
 #include "membuffer.h"
 #include "gettext.h"
 
+enum cobalt_item {
+	COBALT_LOCATION = 0,
+	COBALT_SITE = 1,
+	COBALT_VISIBILITY = 3,
+	COBALT_BUDDY = 4
+};
+
+struct cobalt_state : parser_state {
+	cobalt_state(sqlite3 *handle);
+	sql_query profile, cylinders, items;
+	std::string location, location_site;
+};
+
+cobalt_state::cobalt_state(sqlite3 *handle) :
+	profile(handle, "select runtime*60,(DepthPressure*10000/SurfacePressure)-10000,p.Temperature from Dive AS d JOIN TrackPoints AS p ON d.Id=p.DiveId where d.Id=?1"),
+	cylinders(handle, "select FO2,FHe,StartingPressure,EndingPressure,TankSize,TankPressure,TotalConsumption from GasMixes where DiveID=?1 and StartingPressure>0 and EndingPressure > 0 group by FO2,FHe"),
+	// All the free text items of a dive in one go
+	items(handle, "select l.Type,l.Data from Items AS i, List AS l ON i.Value1=l.Id where i.DiveId=?1 and l.Type in (0,1,3,4)")
+{
+	sql_handle = handle;
+}
+
 static int cobalt_profile_sample(void *param, int, char **data, char **)
 {
 	struct parser_state *state = (struct parser_state *)param;
@@ -58,30 +80,30 @@ static int cobalt_cylinders(void *param, int, char **data, char **)
 	return 0;
 }
 
-static int cobalt_buddies(void *param, int, char **data, char **)
-{
-	struct parser_state *state = (struct parser_state *)param;
-
-	if (data[0])
-		utf8_string_std(data[0], &state->cur_dive->buddy);
-
-	return 0;
-}
-
-/*
- * We still need to figure out how to map free text visibility to
- * Subsurface star rating.
- */
-
-static int cobalt_visibility(void *, int, char **, char **)
-{
-	return 0;
-}
-
-static int cobalt_location(void *param, int, char **data, char **)
+static int cobalt_items(void *param, int, char **data, char **)
 {
-	std::string *location = (std::string *)param;
-	*location = data[0] ? data[0] : NULL;
+	struct cobalt_state *state = (struct cobalt_state *)param;
+
+	if (!data[0])
+		return 0;
+	switch (atoi(data[0])) {
+	case COBALT_BUDDY:
+		if (data[1])
+			utf8_string_std(data[1], &state->cur_dive->buddy);
+		break;
+	/*
+	 * We still need to figure out how to map free text visibility to
+	 * Subsurface star rating.
+	 */
+	case COBALT_VISIBILITY:
+		break;
+	case COBALT_LOCATION:
+		state->location = data[1] ? data[1] : "";
+		break;
+	case COBALT_SITE:
+		state->location_site = data[1] ? data[1] : "";
+		break;
+	}
 	return 0;
 }
 
@@ -89,16 +111,7 @@ static int cobalt_location(void *param, int, char **data, char **)
 static int cobalt_dive(void *param, int, char **data, char **)
 {
 	int retval = 0;
-	struct parser_state *state = (struct parser_state *)param;
-	sqlite3 *handle = state->sql_handle;
-	std::string location, location_site;
-	char get_profile_template[] = "select runtime*60,(DepthPressure*10000/SurfacePressure)-10000,p.Temperature from Dive AS d JOIN TrackPoints AS p ON d.Id=p.DiveId where d.Id=%d";
-	char get_cylinder_template[] = "select FO2,FHe,StartingPressure,EndingPressure,TankSize,TankPressure,TotalConsumption from GasMixes where DiveID=%d and StartingPressure>0 and EndingPressure > 0 group by FO2,FHe";
-	char get_buddy_template[] = "select l.Data from Items AS i, List AS l ON i.Value1=l.Id where i.DiveId=%d and l.Type=4";
-	char get_visibility_template[] = "select l.Data from Items AS i, List AS l ON i.Value1=l.Id where i.DiveId=%d and l.Type=3";
-	char get_location_template[] = "select l.Data from Items AS i, List AS l ON i.Value1=l.Id where i.DiveId=%d and l.Type=0";
-	char get_site_template[] = "select l.Data from Items AS i, List AS l ON i.Value1=l.Id where i.DiveId=%d and l.Type=1";
-	char get_buffer[1024];
+	struct cobalt_state *state = (struct cobalt_state *)param;
 
 	dive_start(state);
 	state->cur_dive->number = atoi(data[0]);
@@ -144,48 +157,26 @@ static int cobalt_dive(void *param, int, char **data, char **)
 		state->cur_dive->dcs[0].model = "Cobalt import";
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_buffer, &cobalt_cylinders, state, NULL);
+	retval = state->cylinders.exec(state->cur_dive->number, &cobalt_cylinders, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query cobalt_cylinders failed.");
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_buddy_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_buffer, &cobalt_buddies, state, NULL);
-	if (retval != SQLITE_OK) {
-		report_info("Database query cobalt_buddies failed.");
-		return 1;
-	}
-
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_visibility_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_buffer, &cobalt_visibility, state, NULL);
-	if (retval != SQLITE_OK) {
-		report_info("Database query cobalt_visibility failed.");
-		return 1;
-	}
-
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_location_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_buffer, &cobalt_location, &location, NULL);
-	if (retval != SQLITE_OK) {
-		report_info("Database query cobalt_location failed.");
-		return 1;
-	}
-
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_site_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_buffer, &cobalt_location, &location_site, NULL);
+	state->location.clear();
+	state->location_site.clear();
+	retval = state->items.exec(state->cur_dive->number, &cobalt_items, state);
 	if (retval != SQLITE_OK) {
-		report_info("Database query cobalt_location (site) failed.");
+		report_info("Database query cobalt_items failed.");
 		return 1;
 	}
 
-	if (!location.empty() && !location_site.empty()) {
-		std::string tmp = location + " / " + location_site;
+	if (!state->location.empty() && !state->location_site.empty()) {
+		std::string tmp = state->location + " / " + state->location_site;
 		state->log->sites.find_or_create(tmp)->add_dive(state->cur_dive.get());
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_buffer, &cobalt_profile_sample, state, NULL);
+	retval = state->profile.exec(state->cur_dive->number, &cobalt_profile_sample, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query cobalt_profile_sample failed.");
 		return 1;
@@ -199,10 +190,9 @@ static int cobalt_dive(void *param, int, char **data, char **)
 int parse_cobalt_buffer(sqlite3 *handle, const char *url, const char *, int, struct divelog *log)
 {
 	int retval;
-	struct parser_state state;
+	struct cobalt_state state(handle);
 
 	state.log = log;
-	state.sql_handle = handle;
 
 	char get_dives[] = "select Id,strftime('%s',DiveStartTime),LocationId,'buddy','notes',Units,(MaxDepthPressure*10000/SurfacePressure)-10000,DiveMinutes,SurfacePressure,SerialNumber,'model' from Dive where IsViewDeleted = 0";
 
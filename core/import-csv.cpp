@@ -1,10 +1,17 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <algorithm>
+#include <cmath>
+#include <string_view>
+#include <vector>
 #include <libdivecomputer/parser.h>
+#include <QThread>
+#include <QtConcurrent>
 
 #include "dive.h"
 #include "errorhelper.h"
+#include "subsurface-float.h"
 #include "subsurface-string.h"
 #include "divelist.h"
 #include "divelog.h"
@@ -269,6 +276,599 @@ static int parse_dan_format(const char *filename, struct xml_params *params, str
 	return ret;
 }
 
+/*
+ * Native import for the plain "csv" template.
+ *
+ * The csv2xml.xslt stylesheet walks the file recursively, one template
+ * call per line, which makes large per-second logs slow to import and
+ * eventually runs into the XSLT recursion limit. For the parameters the
+ * import dialog sets up for plain sample files we can do the same work
+ * directly: split the file into chunks at line boundaries, convert the
+ * rows in parallel and then add the samples to the divecomputer in file
+ * order.
+ *
+ * The conversions follow what the stylesheet and the XML parser do to
+ * the values, so both paths give the same dive. Anything the native
+ * code doesn't handle (quoted fields, the Seabear header fields, the
+ * sample interval mode) is left to the XSLT.
+ */
+bool csv_native_import = true;
+
+enum csv_value {
+	CSV_VALUE_DEPTH = 1 << 0,
+	CSV_VALUE_TEMPERATURE = 1 << 1,
+	CSV_VALUE_SETPOINT = 1 << 2,
+	CSV_VALUE_SENSOR1 = 1 << 3,
+	CSV_VALUE_SENSOR2 = 1 << 4,
+	CSV_VALUE_SENSOR3 = 1 << 5,
+	CSV_VALUE_CNS = 1 << 6,
+	CSV_VALUE_NDL = 1 << 7,
+	CSV_VALUE_TTS = 1 << 8,
+	CSV_VALUE_STOPDEPTH = 1 << 9,
+	CSV_VALUE_IN_DECO = 1 << 10,
+	CSV_VALUE_PRESSURE = 1 << 11,
+	CSV_VALUE_HEARTBEAT = 1 << 12
+};
+
+struct csv_columns {
+	int time, depth, temperature, po2;
+	int sensor[3];
+	int cns, ndl, tts, stopdepth, pressure, heartbeat;
+	char separator;
+	bool metric;
+	bool apd;
+};
+
+/* The values of one row, and which of them the row sets */
+struct csv_row {
+	unsigned int values = 0;
+	duration_t time;
+	depth_t depth, stopdepth;
+	temperature_t temperature;
+	o2pressure_t setpoint;
+	o2pressure_t sensor[3];
+	pressure_t pressure;
+	duration_t ndl, tts;
+	uint16_t cns = 0;
+	uint8_t heartbeat = 0;
+	bool in_deco = false;
+};
+
+struct csv_chunk {
+	const char *begin, *end;
+	std::vector<csv_row> rows;
+};
+
+static const char *csv_param(const struct xml_params *params, const char *key)
+{
+	for (int i = 0; i < xml_params_count(params); i++) {
+		if (!strcmp(xml_params_get_key(params, i), key))
+			return xml_params_get_value(params, i);
+	}
+	return NULL;
+}
+
+/* The parameters are XPath expressions, strings come quoted */
+static std::string csv_param_string(const struct xml_params *params, const char *key)
+{
+	const char *value = csv_param(params, key);
+	if (!value)
+		return std::string();
+	size_t len = strlen(value);
+	if (len >= 2 && (value[0] == '"' || value[0] == '\'') && value[len - 1] == value[0])
+		return std::string(value + 1, len - 2);
+	return std::string(value);
+}
+
+static int csv_param_int(const struct xml_params *params, const char *key)
+{
+	const char *value = csv_param(params, key);
+	return value && *value ? atoi(value) : -1;
+}
+
+static bool csv_is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool csv_is_blank(std::string_view s)
+{
+	for (char c: s) {
+		if (!csv_is_space(c))
+			return false;
+	}
+	return true;
+}
+
+/* XPath number(): whitespace, an optional minus, digits with an optional fraction, whitespace */
+static bool csv_number(std::string_view s, double &val)
+{
+	size_t i = 0, n = s.size();
+	bool digits = false;
+
+	while (i < n && csv_is_space(s[i]))
+		i++;
+	size_t start = i;
+	if (i < n && s[i] == '-')
+		i++;
+	while (i < n && isdigit((unsigned char)s[i])) {
+		digits = true;
+		i++;
+	}
+	if (i < n && s[i] == '.') {
+		i++;
+		while (i < n && isdigit((unsigned char)s[i])) {
+			digits = true;
+			i++;
+		}
+	}
+	size_t end = i;
+	while (i < n && csv_is_space(s[i]))
+		i++;
+	if (!digits || i != n)
+		return false;
+	val = ascii_strtod(std::string(s.substr(start, end - start)).c_str(), NULL);
+	return true;
+}
+
+static double csv_number(std::string_view s)
+{
+	double val;
+	return csv_number(s, val) ? val : NAN;
+}
+
+/* Same as parse_float() in the XML parser */
+static bool csv_float(const std::string &s, double &val)
+{
+	const char *end;
+
+	val = ascii_strtod(s.c_str(), &end);
+	if (end == s.c_str())
+		return false;
+	if (*end == ',' && nearly_equal(val, rint(val)))
+		val = permissive_strtod(s.c_str(), &end);
+	return true;
+}
+
+static std::string csv_translate_comma(std::string_view s)
+{
+	std::string res(s);
+	std::replace(res.begin(), res.end(), ',', '.');
+	return res;
+}
+
+/* What the stylesheet does to imperial values: drop everything but digits, commas and dots */
+static double csv_imperial_number(std::string_view s)
+{
+	std::string res;
+	for (char c: s) {
+		if (isdigit((unsigned char)c) || c == '.')
+			res += c;
+		else if (c == ',')
+			res += '.';
+	}
+	return csv_number(res);
+}
+
+/* XSLT format-number() rounding to the given scale */
+static double csv_round(double val, double scale)
+{
+	if (val < 0)
+		return -floor(-val * scale + 0.5) / scale;
+	return floor(val * scale + 0.5) / scale;
+}
+
+/* Same as sampletime() in the XML parser */
+static int csv_sampletime(const char *buffer)
+{
+	int hr, min, sec;
+
+	switch (sscanf(buffer, "%d:%d:%d", &hr, &min, &sec)) {
+	case 1:
+		return hr;
+	case 2:
+		return hr * 60 + min;
+	case 3:
+		return (hr * 60 + min) * 60 + sec;
+	default:
+		return 0;
+	}
+}
+
+/* The stylesheet's sec2time, converts seconds to "m:ss" */
+static int csv_sec2time(double sec)
+{
+	if (!std::isfinite(sec))
+		return 0;
+	return lrint(floor(sec / 60) * 60 + csv_round(fmod(sec, 60), 1));
+}
+
+/* The time column, or false if the row is not a sample */
+static bool csv_time(std::string_view value, const struct csv_columns &cols, duration_t &time)
+{
+	std::string translated = csv_translate_comma(value);
+	size_t colon = value.find(':');
+	double val;
+
+	if (csv_number(translated, val)) {
+		size_t dot = value.find('.'), comma = value.find(',');
+
+		/* We assume time in seconds with possibly fractions, or min.sec */
+		if (dot != std::string_view::npos && dot + 1 < value.size() && !cols.apd)
+			val = csv_number(value.substr(0, dot)) * 60 + csv_number(translated.substr(dot)) * 60;
+		else if (comma != std::string_view::npos && comma + 1 < value.size())
+			val = csv_number(value.substr(0, comma)) * 60 + csv_number(translated.substr(comma)) * 60;
+		time.seconds = csv_sec2time(val);
+		return true;
+	}
+	if (colon == std::string_view::npos || !csv_number(value.substr(0, colon), val))
+		return false;
+
+	std::string_view rest = value.substr(colon + 1);
+	size_t colon2 = rest.find(':');
+	if (colon2 == std::string_view::npos) {
+		/* m:s */
+		val = val * 60 + csv_number(rest);
+		time.seconds = std::isfinite(val) ? (int)trunc(val) : 0;
+		return true;
+	}
+
+	/* h:m:s */
+	val = val * 60 + csv_number(rest.substr(0, colon2));
+	if (!std::isfinite(val))
+		time.seconds = 0;
+	else if (val != trunc(val))
+		time.seconds = (int)trunc(val);
+	else
+		time.seconds = csv_sampletime(format_string_std("%.0f:%s", val, std::string(rest.substr(colon2 + 1)).c_str()).c_str());
+	return true;
+}
+
+static void csv_depth(std::string_view value, bool metric, unsigned int flag, depth_t &depth, struct csv_row &row)
+{
+	double val;
+
+	if (metric) {
+		if (csv_is_blank(value) || !csv_float(csv_translate_comma(value), val))
+			return;
+	} else {
+		val = csv_round(csv_imperial_number(value) * 0.3048, 1000);
+		if (std::isnan(val))
+			return;
+	}
+	depth.mm = lrint(val * 1000.0);
+	row.values |= flag;
+}
+
+static void csv_temperature(std::string_view value, const struct csv_columns &cols, struct csv_row &row)
+{
+	double val;
+
+	if (csv_is_blank(value))
+		return;
+	if (cols.metric) {
+		if (!csv_float(csv_translate_comma(value), val))
+			return;
+	} else {
+		val = csv_round((csv_imperial_number(value) - 32) * 5 / 9, 10);
+		if (std::isnan(val))
+			return;
+	}
+	row.temperature.mkelvin = C_to_mkelvin(val);
+	/* temperatures outside -40C .. +70C should be ignored */
+	if (row.temperature.mkelvin < ZERO_C_IN_MKELVIN - 40000 ||
+	    row.temperature.mkelvin > ZERO_C_IN_MKELVIN + 70000)
+		row.temperature = 0_K;
+	row.values |= CSV_VALUE_TEMPERATURE;
+}
+
+static void csv_o2pressure(std::string_view value, unsigned int flag, o2pressure_t &o2pressure, struct csv_row &row)
+{
+	if (csv_is_blank(value))
+		return;
+	o2pressure.mbar = lrint(ascii_strtod(std::string(value).c_str(), NULL) * 1000.0);
+	row.values |= flag;
+}
+
+static void csv_pressure(std::string_view value, const struct csv_columns &cols, struct csv_row &row)
+{
+	double val;
+
+	if (!csv_number(value, val) || val < 0)
+		return;
+	if (cols.metric) {
+		if (!csv_float(std::string(value), val))
+			return;
+	} else {
+		val = csv_round(val / 14.5037738007, 1);
+	}
+	/* Just ignore zero values, assume mbar, but if it's really small, it's bar */
+	if (!val)
+		return;
+	double mbar = fabs(val) < 5000 ? val * 1000 : val;
+	if (fabs(mbar) > 5 && fabs(mbar) < 5000000) {
+		row.pressure.mbar = lrint(mbar);
+		row.values |= CSV_VALUE_PRESSURE;
+	}
+}
+
+static std::string_view csv_field(const std::vector<std::string_view> &fields, int idx)
+{
+	return idx >= 0 && (size_t)idx < fields.size() ? fields[idx] : std::string_view();
+}
+
+static bool parse_csv_row(std::string_view line, const struct csv_columns &cols, std::vector<std::string_view> &fields, struct csv_row &row)
+{
+	fields.clear();
+	for (;;) {
+		size_t sep = line.find(cols.separator);
+		fields.push_back(line.substr(0, sep));
+		if (sep == std::string_view::npos)
+			break;
+		line.remove_prefix(sep + 1);
+	}
+
+	if (!csv_time(csv_field(fields, cols.time), cols, row.time))
+		return false;
+	csv_depth(csv_field(fields, cols.depth), cols.metric, CSV_VALUE_DEPTH, row.depth, row);
+	if (cols.temperature >= 0)
+		csv_temperature(csv_field(fields, cols.temperature), cols, row);
+	if (cols.po2 >= 0)
+		csv_o2pressure(csv_field(fields, cols.po2), CSV_VALUE_SETPOINT, row.setpoint, row);
+	for (int i = 0; i < 3; i++) {
+		if (cols.sensor[i] >= 0)
+			csv_o2pressure(csv_field(fields, cols.sensor[i]), CSV_VALUE_SENSOR1 << i, row.sensor[i], row);
+	}
+	if (cols.cns >= 0 && !csv_is_blank(csv_field(fields, cols.cns))) {
+		row.cns = atoi(std::string(csv_field(fields, cols.cns)).c_str());
+		row.values |= CSV_VALUE_CNS;
+	}
+	if (cols.ndl >= 0 && !csv_is_blank(csv_field(fields, cols.ndl))) {
+		row.ndl.seconds = csv_sampletime(std::string(csv_field(fields, cols.ndl)).c_str());
+		row.values |= CSV_VALUE_NDL;
+	}
+	if (cols.tts >= 0 && !csv_is_blank(csv_field(fields, cols.tts))) {
+		row.tts.seconds = csv_sampletime(std::string(csv_field(fields, cols.tts)).c_str());
+		row.values |= CSV_VALUE_TTS;
+	}
+	if (cols.stopdepth >= 0) {
+		std::string_view stopdepth = csv_field(fields, cols.stopdepth);
+		if (cols.metric)
+			csv_depth(stopdepth, true, CSV_VALUE_STOPDEPTH, row.stopdepth, row);
+		else
+			csv_depth(format_string_std("%.2f", csv_round(csv_number(stopdepth) * 0.3048, 100)), true,
+				  CSV_VALUE_STOPDEPTH, row.stopdepth, row);
+		row.in_deco = csv_number(stopdepth) > 0;
+		row.values |= CSV_VALUE_IN_DECO;
+	}
+	if (cols.pressure >= 0)
+		csv_pressure(csv_field(fields, cols.pressure), cols, row);
+	if (cols.heartbeat >= 0 && !csv_is_blank(csv_field(fields, cols.heartbeat))) {
+		row.heartbeat = atoi(std::string(csv_field(fields, cols.heartbeat)).c_str());
+		row.values |= CSV_VALUE_HEARTBEAT;
+	}
+	return true;
+}
+
+static std::string_view csv_next_line(const char *p, const char *end)
+{
+	const char *nl = (const char *)memchr(p, '\n', end - p);
+	return nl ? std::string_view(p, nl - p) : std::string_view();
+}
+
+/*
+ * Only lines terminated by a newline count, and like the stylesheet we
+ * skip a line that is identical to the one following it.
+ */
+static void parse_csv_chunk(const char *file_end, const struct csv_columns &cols, struct csv_chunk &chunk)
+{
+	std::vector<std::string_view> fields;
+	const char *p = chunk.begin;
+
+	while (p < chunk.end) {
+		const char *nl = (const char *)memchr(p, '\n', file_end - p);
+		if (!nl)
+			break;
+		std::string_view line(p, nl - p);
+		p = nl + 1;
+		if (line == csv_next_line(p, file_end))
+			continue;
+		csv_row row;
+		if (parse_csv_row(line, cols, fields, row))
+			chunk.rows.push_back(row);
+	}
+}
+
+static void add_csv_row(struct parser_state *state, const struct csv_row &row)
+{
+	sample_start(state);
+	struct sample *sample = state->cur_sample;
+
+	sample->time = row.time;
+	if (row.values & CSV_VALUE_DEPTH)
+		sample->depth = row.depth;
+	if (row.values & CSV_VALUE_TEMPERATURE)
+		sample->temperature = row.temperature;
+	if (row.values & CSV_VALUE_SETPOINT)
+		sample->setpoint = row.setpoint;
+	for (int i = 0; i < 3; i++) {
+		if (row.values & (CSV_VALUE_SENSOR1 << i))
+			sample->o2sensor[i] = row.sensor[i];
+	}
+	if (row.values & CSV_VALUE_CNS)
+		sample->cns = row.cns;
+	if (row.values & CSV_VALUE_NDL)
+		sample->ndl = row.ndl;
+	if (row.values & CSV_VALUE_TTS)
+		sample->tts = row.tts;
+	if (row.values & CSV_VALUE_STOPDEPTH)
+		sample->stopdepth = row.stopdepth;
+	if (row.values & CSV_VALUE_IN_DECO)
+		sample->in_deco = row.in_deco;
+	if (row.values & CSV_VALUE_PRESSURE)
+		sample->pressure[0] = row.pressure;
+	if (row.values & CSV_VALUE_HEARTBEAT)
+		sample->heartbeat = row.heartbeat;
+	sample_end(state);
+}
+
+static bool csv_native_supported(const std::string &mem, const struct xml_params *params)
+{
+	/* Header derived and Seabear specific values are only handled by the stylesheet */
+	static const char *xslt_params[] = {
+		"diveMode", "Firmware", "Serial", "GF", "maxDepth", "meanDepth", "airTemp", "waterTemp"
+	};
+
+	if (mem.empty() || csv_param_int(params, "timeField") < 0 || csv_param_int(params, "depthField") < 0)
+		return false;
+	if (csv_param(params, "dateField") && csv_param_int(params, "dateField") >= 0)
+		return false;
+	if (csv_param(params, "starttimeField") && csv_param_int(params, "starttimeField") >= 0)
+		return false;
+	if (csv_param(params, "numberField") && csv_param_int(params, "numberField") >= 0)
+		return false;
+	if (csv_param(params, "delta") && csv_number(csv_param(params, "delta")) > 0)
+		return false;
+	for (const char *key: xslt_params) {
+		if (csv_param(params, key))
+			return false;
+	}
+	/* Quoted fields need the stylesheet's unquoting */
+	return mem.find('"') == std::string::npos;
+}
+
+/*
+ * Returns 1 if the file or the parameters need the stylesheet,
+ * otherwise the dive (if any) has been added to the log.
+ */
+int parse_csv_native(std::string &mem, const struct xml_params *params, struct divelog *log)
+{
+	if (!csv_native_supported(mem, params))
+		return 1;
+
+	struct csv_columns cols;
+	cols.time = csv_param_int(params, "timeField");
+	cols.depth = csv_param_int(params, "depthField");
+	cols.temperature = csv_param_int(params, "tempField");
+	cols.po2 = csv_param_int(params, "setpointField");
+	if (cols.po2 < 0)
+		cols.po2 = csv_param_int(params, "po2Field");
+	cols.sensor[0] = csv_param_int(params, "o2sensor1Field");
+	cols.sensor[1] = csv_param_int(params, "o2sensor2Field");
+	cols.sensor[2] = csv_param_int(params, "o2sensor3Field");
+	cols.cns = csv_param_int(params, "cnsField");
+	cols.ndl = csv_param_int(params, "ndlField");
+	cols.tts = csv_param_int(params, "ttsField");
+	cols.stopdepth = csv_param_int(params, "stopdepthField");
+	cols.pressure = csv_param_int(params, "pressureField");
+	cols.heartbeat = csv_param_int(params, "heartBeat");
+	switch (csv_param_int(params, "separatorIndex")) {
+	case 0:
+		cols.separator = '\t';
+		break;
+	case 2:
+		cols.separator = ';';
+		break;
+	case 3:
+		cols.separator = '|';
+		break;
+	default:
+		cols.separator = ',';
+	}
+	cols.metric = csv_param_int(params, "units") == 0;
+	std::string hw = csv_param_string(params, "hw");
+	cols.apd = hw.find("APD") != std::string::npos;
+
+	/* Line ends are normalized to a newline, the same as the XML parser does */
+	if (mem.find('\r') != std::string::npos) {
+		size_t out = 0;
+		for (size_t i = 0; i < mem.size(); i++) {
+			if (mem[i] == '\r') {
+				mem[out++] = '\n';
+				if (i + 1 < mem.size() && mem[i + 1] == '\n')
+					i++;
+			} else {
+				mem[out++] = mem[i];
+			}
+		}
+		mem.resize(out);
+	}
+
+	const char *begin = mem.data(), *end = mem.data() + mem.size();
+	size_t num_threads = std::max(QThread::idealThreadCount(), 1);
+	size_t num_chunks = std::max(std::min(num_threads, mem.size() / 65536), (size_t)1);
+	size_t chunk_size = mem.size() / num_chunks;
+	std::vector<csv_chunk> chunks;
+	for (const char *p = begin; p < end; ) {
+		const char *chunk_end = end;
+		if ((size_t)(end - p) > chunk_size && chunks.size() + 1 < num_chunks) {
+			chunk_end = (const char *)memchr(p + chunk_size, '\n', end - p - chunk_size);
+			chunk_end = chunk_end ? chunk_end + 1 : end;
+		}
+		chunks.push_back({ p, chunk_end, {} });
+		p = chunk_end;
+	}
+	if (chunks.size() > 1)
+		QtConcurrent::blockingMap(chunks, [end, &cols](csv_chunk &chunk) { parse_csv_chunk(end, cols, chunk); });
+	else
+		parse_csv_chunk(end, cols, chunks[0]);
+
+	struct parser_state state;
+	state.log = log;
+	dive_start(&state);
+	struct dive *dive = state.cur_dive.get();
+
+	std::string date = csv_param_string(params, "date");
+	std::string time = csv_param_string(params, "time");
+	int y, m, d, hh, mm;
+	if (sscanf(date.substr(0, 4).c_str(), "%d", &y) == 1 && sscanf(date.substr(std::min<size_t>(4, date.size()), 2).c_str(), "%d", &m) == 1 &&
+	    sscanf(date.substr(std::min<size_t>(6, date.size()), 2).c_str(), "%d", &d) == 1) {
+		state.cur_tm.tm_year = y;
+		state.cur_tm.tm_mon = m - 1;
+		state.cur_tm.tm_mday = d;
+		dive->when = utc_mktime(&state.cur_tm);
+		if (sscanf(time.substr(std::min<size_t>(1, time.size()), 2).c_str(), "%d", &hh) == 1 &&
+		    sscanf(time.substr(std::min<size_t>(3, time.size()), 2).c_str(), "%d", &mm) == 1) {
+			state.cur_tm.tm_hour = hh;
+			state.cur_tm.tm_min = mm;
+			dive->when = utc_mktime(&state.cur_tm);
+		}
+	}
+	std::string number = csv_param_string(params, "diveNro");
+	if (!number.empty())
+		dive->number = atoi(number.c_str());
+
+	/* If the dive is CCR, create oxygen and diluent cylinders */
+	bool ccr = cols.po2 >= 0 || cols.sensor[0] >= 0 || cols.sensor[1] >= 0 || cols.sensor[2] >= 0;
+	if (ccr) {
+		cylinder_t *cyl = cylinder_start(&state);
+		cyl->type.description = "oxygen";
+		cyl->gasmix.o2 = 1000_permille;
+		cyl->cylinder_use = OXYGEN;
+		state.o2pressure_sensor = 0;
+		cylinder_end(&state);
+		cyl = cylinder_start(&state);
+		cyl->type.description = "diluent";
+		cyl->gasmix.o2 = 210_permille;
+		cyl->cylinder_use = DILUENT;
+		cylinder_end(&state);
+	}
+
+	divecomputer_start(&state);
+	state.cur_dc->model = hw.empty() ? "Imported from CSV" : hw;
+	if (ccr) {
+		state.cur_dc->divemode = CCR;
+		state.cur_dc->no_o2sensors = (cols.sensor[0] >= 0) + (cols.sensor[1] >= 0) + (cols.sensor[2] >= 0);
+	}
+	for (const csv_chunk &chunk: chunks) {
+		for (const csv_row &row: chunk.rows)
+			add_csv_row(&state, row);
+	}
+	divecomputer_end(&state);
+	dive_end(&state);
+	return 0;
+}
+
 int parse_csv_file(const char *filename, struct xml_params *params, const char *csvtemplate, struct divelog *log)
 {
 	int ret;
@@ -302,6 +902,16 @@ int parse_csv_file(const char *filename, struct xml_params *params, const char *
 		xml_params_add(params, "time", tmpbuf);
 	}
 
+	if (csv_native_import && !strcmp("csv", csvtemplate)) {
+		auto [mem2, err] = readfile(filename);
+		if (err < 0)
+			return report_error(translate("gettextFromC", "Failed to read '%s'"), filename);
+		mem = std::move(mem2);
+		ret = parse_csv_native(mem, params, log);
+		if (ret != 1)
+			return ret;
+	}
+
 	if (try_to_xslt_open_csv(filename, mem, csvtemplate))
 		return -1;
 
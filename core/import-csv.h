@@ -21,7 +21,10 @@ enum csv_format {
 
 #define MAXCOLDIGITS 10
 
+extern bool csv_native_import;
+
 int parse_csv_file(const char *filename, struct xml_params *params, const char *csvtemplate, struct divelog *log);
+int parse_csv_native(std::string &mem, const struct xml_params *params, struct divelog *log);
 int try_to_open_csv(std::string &mem, enum csv_format type, struct divelog *log);
 int parse_txt_file(const char *filename, const char *csv, struct divelog *log);
 
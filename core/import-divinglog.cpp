@@ -25,6 +25,17 @@ static int atoi_n(const char *ptr, size_t len)
 	return res;
 }
 
+struct divinglog_state : parser_state {
+	divinglog_state(sqlite3 *handle);
+	sql_query cylinders;
+};
+
+divinglog_state::divinglog_state(sqlite3 *handle) :
+	cylinders(handle, "select TankID,TankSize,PresS,PresE,PresW,O2,He,DblTank from Tank where LogID = ?1 order by TankID")
+{
+	sql_handle = handle;
+}
+
 static int divinglog_cylinder(void *param, int, char **data, char **)
 {
 	struct parser_state *state = (struct parser_state *)param;
@@ -271,12 +282,7 @@ static int divinglog_profile(void *param, int, char **data, char **)
 static int divinglog_dive(void *param, int, char **data, char **)
 {
 	int retval = 0, diveid;
-	struct parser_state *state = (struct parser_state *)param;
-	sqlite3 *handle = state->sql_handle;
-	char get_profile_template[] = "select ProfileInt,Profile,Profile2,Profile3,Profile4,Profile5 from Logbook where ID = %d";
-	char get_cylinder0_template[] = "select 0,TankSize,PresS,PresE,PresW,O2,He,DblTank from Logbook where ID = %d";
-	char get_cylinder_template[] = "select TankID,TankSize,PresS,PresE,PresW,O2,He,DblTank from Tank where LogID = %d order by TankID";
-	char get_buffer[1024];
+	struct divinglog_state *state = (struct divinglog_state *)param;
 
 	dive_start(state);
 	diveid = atoi(data[13]);
@@ -344,15 +350,10 @@ static int divinglog_dive(void *param, int, char **data, char **)
 		state->cur_settings.dc.model = "Divinglog import";
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder0_template, diveid);
-	retval = sqlite3_exec(handle, get_buffer, &divinglog_cylinder, state, NULL);
-	if (retval != SQLITE_OK) {
-		report_info("Database query divinglog_cylinder0 failed.");
-		return 1;
-	}
+	/* The first cylinder is stored in the logbook, the others in Tank */
+	divinglog_cylinder(state, 8, data + 16, NULL);
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder_template, diveid);
-	retval = sqlite3_exec(handle, get_buffer, &divinglog_cylinder, state, NULL);
+	retval = state->cylinders.exec(diveid, &divinglog_cylinder, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query divinglog_cylinder failed.");
 		return 1;
@@ -381,12 +382,7 @@ static int divinglog_dive(void *param, int, char **data, char **)
 		state->cur_dive->dcs[0].model = "Divinglog import";
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template, diveid);
-	retval = sqlite3_exec(handle, get_buffer, &divinglog_profile, state, NULL);
-	if (retval != SQLITE_OK) {
-		report_info("Database query divinglog_profile failed.");
-		return 1;
-	}
+	divinglog_profile(state, 6, data + 24, NULL);
 
 	dive_end(state);
 
@@ -397,12 +393,14 @@ static int divinglog_dive(void *param, int, char **data, char **)
 int parse_divinglog_buffer(sqlite3 *handle, const char *url, const char *, int, struct divelog *log)
 {
 	int retval;
-	struct parser_state state;
+	struct divinglog_state state(handle);
 
 	state.log = log;
-	state.sql_handle = handle;
 
-	char get_dives[] = "select Number,strftime('%s',Divedate || ' ' || ifnull(Entrytime,'00:00')),Country || ' - ' || City || ' - ' || Place,Buddy,Comments,Depth,Divetime,Divemaster,Airtemp,Watertemp,Weight,Divesuit,Computer,ID,Visibility,SupplyType from Logbook where UUID not in (select UUID from DeletedRecords)";
+	/* Columns 16-23 are the first cylinder, 24-29 the profile */
+	char get_dives[] = "select Number,strftime('%s',Divedate || ' ' || ifnull(Entrytime,'00:00')),Country || ' - ' || City || ' - ' || Place,Buddy,Comments,Depth,Divetime,Divemaster,Airtemp,Watertemp,Weight,Divesuit,Computer,ID,Visibility,SupplyType,"
+			   "0,TankSize,PresS,PresE,PresW,O2,He,DblTank,"
+			   "ProfileInt,Profile,Profile2,Profile3,Profile4,Profile5 from Logbook where UUID not in (select UUID from DeletedRecords)";
 
 	retval = sqlite3_exec(handle, get_dives, &divinglog_dive, &state, NULL);
 
@@ -21,6 +21,41 @@
 #include <string.h>
 #include "divecomputer.h"
 
+/* The samples query is prepared once and reset after every dive. */
+struct seac_state : parser_state {
+	seac_state(sqlite3 *handle);
+	~seac_state();
+	sqlite3_stmt *samples = nullptr;
+};
+
+seac_state::seac_state(sqlite3 *handle)
+{
+	const char *get_samples = "SELECT dive_number, runtime_s, depth_cm, temperature_mCx10, active_O2_fr, first_stop_depth_cm, first_stop_time_s, ndl_tts_s, cns, gf_l, gf_h FROM dive_data WHERE dive_number = ? AND dive_id = ? ORDER BY runtime_s ASC";
+		/*  0 = dive_number
+		 *  1 = runtime_s
+		 *  2 = depth_cm
+		 *  3 = temperature_mCx10  - eg dC
+		 *  4 = active_O2_fr
+		 *  5 = first_stop_depth_cm
+		 *  6 = first_stop_time_s
+		 *  7 = ndl_tts_s
+		 *  8 = cns
+		 *  9 = gf-l
+		 * 10 = gf-h
+		 */
+
+	sql_handle = handle;
+	if (sqlite3_prepare_v2(handle, get_samples, -1, &samples, 0) != SQLITE_OK) {
+		sqlite3_finalize(samples);
+		samples = nullptr;
+	}
+}
+
+seac_state::~seac_state()
+{
+	sqlite3_finalize(samples);
+}
+
 /* Process gas change event for seac database.
  * Create gas change event at the time of the
  * current sample.
@@ -48,23 +83,8 @@ static int seac_dive(void *param, int, char **data, char **)
 	int year, month, day, hour, min, sec, tz;
 	time_t divetime;
 	struct gasmix lastgas, curgas;
-	struct parser_state *state = (struct parser_state *)param;
-	sqlite3 *handle = state->sql_handle;
-	sqlite3_stmt *sqlstmt;
-
-	const char *get_samples = "SELECT dive_number, runtime_s, depth_cm, temperature_mCx10, active_O2_fr, first_stop_depth_cm, first_stop_time_s, ndl_tts_s, cns, gf_l, gf_h FROM dive_data WHERE dive_number = ? AND dive_id = ? ORDER BY runtime_s ASC";
-		/*  0 = dive_number
-		 *  1 = runtime_s
-		 *  2 = depth_cm
-		 *  3 = temperature_mCx10  - eg dC
-		 *  4 = active_O2_fr
-		 *  5 = first_stop_depth_cm
-		 *  6 = first_stop_time_s
-		 *  7 = ndl_tts_s
-		 *  8 = cns
-		 *  9 = gf-l
-		 * 10 = gf-h
-		 */
+	struct seac_state *state = (struct seac_state *)param;
+	sqlite3_stmt *sqlstmt = state->samples;
 
 	dive_start(state);
 	state->cur_dive->number = atoi(data[0]);
@@ -184,9 +204,7 @@ static int seac_dive(void *param, int, char **data, char **)
 		state->cur_dive->dcs[0].maxdepth.mm = 10 * atoi(data[11]);
 	}
 
-	// Create sql_stmt type to query DB
-	retval = sqlite3_prepare_v2(handle, get_samples, -1, &sqlstmt, 0);
-	if (retval != SQLITE_OK) {
+	if (!sqlstmt) {
 		report_info("Preparing SQL object failed when getting SeacSync dives.");
 		return 1;
 	}
@@ -199,6 +217,7 @@ static int seac_dive(void *param, int, char **data, char **)
 	retval = sqlite3_step(sqlstmt);
 	if (retval == SQLITE_ERROR) {
 		report_info("Getting dive data from SeacSync DB failed.");
+		sqlite3_reset(sqlstmt);
 		return 1;
 	}
 
@@ -249,7 +268,7 @@ static int seac_dive(void *param, int, char **data, char **)
 		retval = sqlite3_step(sqlstmt);
 	}
 
-	sqlite3_finalize(sqlstmt);
+	sqlite3_reset(sqlstmt);
 	dive_end(state);
 
 	return SQLITE_OK;
@@ -265,10 +284,9 @@ int parse_seac_buffer(sqlite3 *handle, const char *url, const char *, int, struc
 {
 	int retval;
 	char *err = NULL;
-	struct parser_state state;
+	struct seac_state state(handle);
 
 	state.log = log;
-	state.sql_handle = handle;
 
 	const char *get_dives = "SELECT dive_number, device_sn, date, timezone, time, elapsed_surface_time, dive_type, start_mode, water_type, comment, total_dive_time, max_depth, firmware_version, dive_id FROM headers_dive";
 		/*  0 = dive_number
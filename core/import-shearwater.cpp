@@ -17,6 +17,43 @@
 
 #include <stdlib.h>
 
+/*
+ * The queries are prepared once per import and run with the dive id
+ * of each dive. The statements differ between desktop and cloud logs.
+ */
+struct shearwater_state : parser_state {
+	shearwater_state(sqlite3 *handle, bool cloud);
+	sql_query mode, cylinders, first_gas, changes, profile_ai, profile;
+	bool ai;			// the log has the pressures of the AI sensors
+	int sample_number = 0;		// of the cloud logs, to calculate the sample time
+};
+
+shearwater_state::shearwater_state(sqlite3 *handle, bool cloud) :
+	mode(handle, "select distinct currentCircuitSetting from dive_log_records where diveLogId = ?1"),
+	cylinders(handle, cloud ?
+		"select fractionO2 / 100,fractionHe / 100 from dive_log_records where diveLogId = ?1 group by fractionO2,fractionHe" :
+		"select fractionO2,fractionHe from dive_log_records where diveLogId = ?1 group by fractionO2,fractionHe"),
+	first_gas(handle, "select currentTime, fractionO2 / 100, fractionHe / 100 from dive_log_records where diveLogId = ?1 limit 1"),
+	changes(handle, cloud ?
+		"select a.currentTime,a.fractionO2 / 100,a.fractionHe /100 from dive_log_records as a,dive_log_records as b where (a.id - 1) = b.id and (a.fractionO2 != b.fractionO2 or a.fractionHe != b.fractionHe) and a.diveLogId=b.divelogId and a.diveLogId = ?1 and a.fractionO2 > 0 and b.fractionO2 > 0" :
+		"select a.currentTime,a.fractionO2,a.fractionHe from dive_log_records as a,dive_log_records as b where (a.id - 1) = b.id and (a.fractionO2 != b.fractionO2 or a.fractionHe != b.fractionHe) and a.diveLogId=b.divelogId and a.diveLogId = ?1"),
+	/*
+	 * Since Shearwater reported sample time can be totally bogus, the
+	 * samples of the cloud logs are counted in the order of the records.
+	 * The sample number is multiplied by the sample interval giving us
+	 * the correct sample time.
+	 */
+	profile_ai(handle, cloud ?
+		"select currentTime,currentDepth,waterTemp,averagePPO2,currentNdl,CNSPercent,decoCeiling,aiSensor0_PressurePSI,aiSensor1_PressurePSI,firstStopDepth,firstStopTime from dive_log_records where diveLogId = ?1 and currentTime > 0 order by id" :
+		"select currentTime,currentDepth,waterTemp,averagePPO2,currentNdl,CNSPercent,decoCeiling,aiSensor0_PressurePSI,aiSensor1_PressurePSI,firstStopDepth,firstStopTime from dive_log_records where diveLogId = ?1"),
+	profile(handle, cloud ?
+		"select currentTime,currentDepth,waterTemp,averagePPO2,currentNdl,CNSPercent,decoCeiling,firstStopDepth,firstStopTime from dive_log_records where diveLogId = ?1 and currentTime > 0 order by id" :
+		"select currentTime,currentDepth,waterTemp,averagePPO2,currentNdl,CNSPercent,decoCeiling,firstStopDepth,firstStopTime from dive_log_records where diveLogId = ?1"),
+	ai(profile_ai.valid())
+{
+	sql_handle = handle;
+}
+
 static int shearwater_cylinders(void *param, int, char **data, char **)
 {
 	struct parser_state *state = (struct parser_state *)param;
@@ -77,7 +114,7 @@ static int shearwater_changes(void *param, int columns, char **data, char **)
 
 static int shearwater_profile_sample(void *param, int, char **data, char **)
 {
-	struct parser_state *state = (struct parser_state *)param;
+	struct shearwater_state *state = (struct shearwater_state *)param;
 	int d6, d7;
 
 	sample_start(state);
@@ -89,8 +126,8 @@ static int shearwater_profile_sample(void *param, int, char **data, char **)
 	 * provided by Shearwater as is.
 	 */
 
-	if (data[9] && state->sample_rate)
-		state->cur_sample->time.seconds = atoi(data[9]) * state->sample_rate;
+	if (state->sample_rate)
+		state->cur_sample->time.seconds = state->sample_number++ * state->sample_rate;
 	else if (data[0])
 		state->cur_sample->time.seconds = atoi(data[0]);
 
@@ -137,7 +174,7 @@ static int shearwater_profile_sample(void *param, int, char **data, char **)
 
 static int shearwater_ai_profile_sample(void *param, int, char **data, char **)
 {
-	struct parser_state *state = (struct parser_state *)param;
+	struct shearwater_state *state = (struct shearwater_state *)param;
 	int d6, d9;
 
 	sample_start(state);
@@ -149,8 +186,8 @@ static int shearwater_ai_profile_sample(void *param, int, char **data, char **)
 	 * provided by Shearwater as is.
 	 */
 
-	if (data[11] && state->sample_rate)
-		state->cur_sample->time.seconds = atoi(data[11]) * state->sample_rate;
+	if (state->sample_rate)
+		state->cur_sample->time.seconds = state->sample_number++ * state->sample_rate;
 	else if (data[0])
 		state->cur_sample->time.seconds = atoi(data[0]);
 
@@ -217,21 +254,14 @@ static int shearwater_mode(void *param, int, char **data, char **)
 static int shearwater_dive(void *param, int, char **data, char **)
 {
 	int retval = 0;
-	struct parser_state *state = (struct parser_state *)param;
-	sqlite3 *handle = state->sql_handle;
-	char get_profile_template[] = "select currentTime,currentDepth,waterTemp,averagePPO2,currentNdl,CNSPercent,decoCeiling,firstStopDepth,firstStopTime from dive_log_records where diveLogId=%ld";
-	char get_profile_template_ai[] = "select currentTime,currentDepth,waterTemp,averagePPO2,currentNdl,CNSPercent,decoCeiling,aiSensor0_PressurePSI,aiSensor1_PressurePSI,firstStopDepth,firstStopTime from dive_log_records where diveLogId = %ld";
-	char get_cylinder_template[] = "select fractionO2,fractionHe from dive_log_records where diveLogId = %ld group by fractionO2,fractionHe";
-	char get_changes_template[] = "select a.currentTime,a.fractionO2,a.fractionHe from dive_log_records as a,dive_log_records as b where (a.id - 1) = b.id and (a.fractionO2 != b.fractionO2 or a.fractionHe != b.fractionHe) and a.diveLogId=b.divelogId and a.diveLogId = %ld";
-	char get_mode_template[] = "select distinct currentCircuitSetting from dive_log_records where diveLogId = %ld";
-	char get_buffer[1024];
+	struct shearwater_state *state = (struct shearwater_state *)param;
 
 	dive_start(state);
 	state->cur_dive->number = atoi(data[0]);
 
 	state->cur_dive->when = (time_t)(atol(data[1]));
 
-	long int dive_id = atol(data[11]);
+	sqlite3_int64 dive_id = atoll(data[11]);
 
 	if (data[2])
 		add_dive_site(data[2], state->cur_dive.get(), state);
@@ -292,37 +322,32 @@ static int shearwater_dive(void *param, int, char **data, char **)
 	}
 
 	if (data[11]) {
-		snprintf(get_buffer, sizeof(get_buffer) - 1, get_mode_template, dive_id);
-		retval = sqlite3_exec(handle, get_buffer, &shearwater_mode, state, NULL);
+		retval = state->mode.exec(dive_id, &shearwater_mode, state);
 		if (retval != SQLITE_OK) {
 			report_info("Database query shearwater_mode failed.");
 			return 1;
 		}
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder_template, dive_id);
-	retval = sqlite3_exec(handle, get_buffer, &shearwater_cylinders, state, NULL);
+	retval = state->cylinders.exec(dive_id, &shearwater_cylinders, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query shearwater_cylinders failed.");
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_changes_template, dive_id);
-	retval = sqlite3_exec(handle, get_buffer, &shearwater_changes, state, NULL);
+	retval = state->changes.exec(dive_id, &shearwater_changes, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query shearwater_changes failed.");
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template_ai, dive_id);
-	retval = sqlite3_exec(handle, get_buffer, &shearwater_ai_profile_sample, state, NULL);
+	if (state->ai)
+		retval = state->profile_ai.exec(dive_id, &shearwater_ai_profile_sample, state);
+	else
+		retval = state->profile.exec(dive_id, &shearwater_profile_sample, state);
 	if (retval != SQLITE_OK) {
-		snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template, dive_id);
-		retval = sqlite3_exec(handle, get_buffer, &shearwater_profile_sample, state, NULL);
-		if (retval != SQLITE_OK) {
-			report_info("Database query shearwater_profile_sample failed.");
-			return 1;
-		}
+		report_info("Database query shearwater_profile_sample failed.");
+		return 1;
 	}
 
 	dive_end(state);
@@ -333,31 +358,14 @@ static int shearwater_dive(void *param, int, char **data, char **)
 static int shearwater_cloud_dive(void *param, int, char **data, char **)
 {
 	int retval = 0;
-	struct parser_state *state = (struct parser_state *)param;
-	sqlite3 *handle = state->sql_handle;
-
-	/*
-	 * Since Shearwater reported sample time can be totally bogus,
-	 * we need to calculate the sample number by ourselves. The
-	 * calculated sample number is multiplied by sample interval
-	 * giving us correct sample time.
-	 */
-
-	char get_profile_template[] = "select currentTime,currentDepth,waterTemp,averagePPO2,currentNdl,CNSPercent,decoCeiling,firstStopDepth,firstStopTime,(select count(0) from dive_log_records r where r.id < d.id and r.diveLogId = %ld and r.currentTime > 0) as row from dive_log_records d where d.diveLogId=%ld and d.currentTime > 0";
-	char get_profile_template_ai[] = "select currentTime,currentDepth,waterTemp,averagePPO2,currentNdl,CNSPercent,decoCeiling,aiSensor0_PressurePSI,aiSensor1_PressurePSI,firstStopDepth,firstStopTime,(select count(0) from dive_log_records r where r.id < d.id and r.diveLogId = %ld and r.currentTime > 0) as row from dive_log_records d where d.diveLogId = %ld and d.currentTime > 0";
-
-	char get_cylinder_template[] = "select fractionO2 / 100,fractionHe / 100 from dive_log_records where diveLogId = %ld group by fractionO2,fractionHe";
-	char get_first_gas_template[] = "select currentTime, fractionO2 / 100, fractionHe / 100 from dive_log_records where diveLogId = %ld limit 1";
-	char get_changes_template[] = "select a.currentTime,a.fractionO2 / 100,a.fractionHe /100 from dive_log_records as a,dive_log_records as b where (a.id - 1) = b.id and (a.fractionO2 != b.fractionO2 or a.fractionHe != b.fractionHe) and a.diveLogId=b.divelogId and a.diveLogId = %ld and a.fractionO2 > 0 and b.fractionO2 > 0";
-	char get_mode_template[] = "select distinct currentCircuitSetting from dive_log_records where diveLogId = %ld";
-	char get_buffer[1024];
+	struct shearwater_state *state = (struct shearwater_state *)param;
 
 	dive_start(state);
 	state->cur_dive->number = atoi(data[0]);
 
 	state->cur_dive->when = (time_t)(atol(data[1]));
 
-	long int dive_id = atol(data[11]);
+	sqlite3_int64 dive_id = atoll(data[11]);
 	if (data[12])
 		state->sample_rate = atoi(data[12]);
 	else
@@ -422,44 +430,39 @@ static int shearwater_cloud_dive(void *param, int, char **data, char **)
 	}
 
 	if (data[11]) {
-		snprintf(get_buffer, sizeof(get_buffer) - 1, get_mode_template, dive_id);
-		retval = sqlite3_exec(handle, get_buffer, &shearwater_mode, state, NULL);
+		retval = state->mode.exec(dive_id, &shearwater_mode, state);
 		if (retval != SQLITE_OK) {
 			report_info("Database query shearwater_mode failed.");
 			return 1;
 		}
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_cylinder_template, dive_id);
-	retval = sqlite3_exec(handle, get_buffer, &shearwater_cylinders, state, NULL);
+	retval = state->cylinders.exec(dive_id, &shearwater_cylinders, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query shearwater_cylinders failed.");
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_first_gas_template, dive_id);
-	retval = sqlite3_exec(handle, get_buffer, &shearwater_changes, state, NULL);
+	retval = state->first_gas.exec(dive_id, &shearwater_changes, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query shearwater_changes failed.");
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_changes_template, dive_id);
-	retval = sqlite3_exec(handle, get_buffer, &shearwater_changes, state, NULL);
+	retval = state->changes.exec(dive_id, &shearwater_changes, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query shearwater_changes failed.");
 		return 1;
 	}
 
-	snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template_ai, dive_id, dive_id);
-	retval = sqlite3_exec(handle, get_buffer, &shearwater_ai_profile_sample, state, NULL);
+	state->sample_number = 0;
+	if (state->ai)
+		retval = state->profile_ai.exec(dive_id, &shearwater_ai_profile_sample, state);
+	else
+		retval = state->profile.exec(dive_id, &shearwater_profile_sample, state);
 	if (retval != SQLITE_OK) {
-		snprintf(get_buffer, sizeof(get_buffer) - 1, get_profile_template, dive_id, dive_id);
-		retval = sqlite3_exec(handle, get_buffer, &shearwater_profile_sample, state, NULL);
-		if (retval != SQLITE_OK) {
-			report_info("Database query shearwater_profile_sample failed.");
-			return 1;
-		}
+		report_info("Database query shearwater_profile_sample failed.");
+		return 1;
 	}
 
 	dive_end(state);
@@ -470,10 +473,9 @@ static int shearwater_cloud_dive(void *param, int, char **data, char **)
 int parse_shearwater_buffer(sqlite3 *handle, const char *url, const char *, int, struct divelog *log)
 {
 	int retval;
-	struct parser_state state;
+	struct shearwater_state state(handle, false);
 
 	state.log = log;
-	state.sql_handle = handle;
 
 	// So far have not seen any sample rate in Shearwater Desktop
 	state.sample_rate = 0;
@@ -493,10 +495,9 @@ int parse_shearwater_buffer(sqlite3 *handle, const char *url, const char *, int,
 int parse_shearwater_cloud_buffer(sqlite3 *handle, const char *url, const char *, int, struct divelog *log)
 {
 	int retval;
-	struct parser_state state;
+	struct shearwater_state state(handle, true);
 
 	state.log = log;
-	state.sql_handle = handle;
 
 	char get_dives[] = "select l.number,strftime('%s', DiveDate),location||' / '||site,buddy,notes,imperialUnits,maxDepth,DiveLengthTime,startSurfacePressure,computerSerial,computerModel,d.diveId,l.sampleRateMs / 1000 FROM dive_details AS d JOIN dive_logs AS l ON d.diveId=l.diveId";
 
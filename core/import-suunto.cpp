@@ -18,6 +18,61 @@
 
 #include <stdlib.h>
 
+/*
+ * The queries of DM4 and DM5 logs. The per-dive queries are prepared
+ * once and run with the dive id. The dives query is kept here, because
+ * the dive callbacks need the size of the sample blobs.
+ */
+struct dm_state : parser_state {
+	dm_state(sqlite3 *handle, const char *get_dives);
+	sql_query dives, events, tags, cylinders, gaschange;
+};
+
+dm_state::dm_state(sqlite3 *handle, const char *get_dives) :
+	dives(handle, get_dives),
+	events(handle, "select * from Mark where DiveId = ?1"),
+	tags(handle, "select Text from DiveTag where DiveId = ?1"),
+	cylinders(handle, "select * from DiveMixture where DiveId = ?1"),
+	gaschange(handle, "select GasChangeTime,Oxygen,Helium from DiveGasChange join DiveMixture on DiveGasChange.DiveMixtureId=DiveMixture.DiveMixtureId where DiveId = ?1")
+{
+	sql_handle = handle;
+}
+
+/*
+ * The DM4 profile: one float depth, one byte temperature and one int
+ * pressure per sample, each in its own blob.
+ */
+static void dm4_profile(struct dm_state *state, char **data, int interval)
+{
+	float *profileBlob = (float *)data[17];
+	unsigned char *tempBlob = (unsigned char *)data[18];
+	int *pressureBlob = (int *)data[19];
+	int depths = state->dives.size(17) / (int)sizeof(float);
+	int temperatures = state->dives.size(18);
+	int pressures = state->dives.size(19) / (int)sizeof(int);
+	int count = interval ? (state->cur_dive->duration.seconds + interval - 1) / interval : 0;
+
+	/* Don't read past the end of the profile */
+	if (profileBlob && count > depths)
+		count = depths;
+	if (count > 0)
+		get_dc(state)->samples.reserve(count);
+	for (int i = 0; i < count; i++) {
+		sample_start(state);
+		state->cur_sample->time.seconds = i * interval;
+		if (profileBlob)
+			state->cur_sample->depth.mm = lrintf(profileBlob[i] * 1000.0f);
+		else
+			state->cur_sample->depth.mm = state->cur_dive->dcs[0].maxdepth.mm;
+
+		if (data[18] && data[18][0] && i < temperatures)
+			state->cur_sample->temperature.mkelvin = C_to_mkelvin(tempBlob[i]);
+		if (data[19] && data[19][0] && i < pressures)
+			state->cur_sample->pressure[0].mbar = pressureBlob[i];
+		sample_end(state);
+	}
+}
+
 static int dm4_events(void *param, int, char **data, char **)
 {
 	using namespace std::string_literals;
@@ -162,16 +217,8 @@ static int dm4_tags(void *param, int, char **data, char **)
 
 static int dm4_dive(void *param, int, char **data, char **)
 {
-	int i;
 	int interval, retval = 0;
-	struct parser_state *state = (struct parser_state *)param;
-	sqlite3 *handle = state->sql_handle;
-	float *profileBlob;
-	unsigned char *tempBlob;
-	int *pressureBlob;
-	char get_events_template[] = "select * from Mark where DiveId = %d";
-	char get_tags_template[] = "select Text from DiveTag where DiveId = %d";
-	char get_events[64];
+	struct dm_state *state = (struct dm_state *)param;
 	cylinder_t *cyl;
 
 	dive_start(state);
@@ -240,33 +287,15 @@ static int dm4_dive(void *param, int, char **data, char **)
 		state->cur_dive->dcs[0].surface_pressure.mbar = (atoi(data[14]) * 1000);
 
 	interval = data[16] ? atoi(data[16]) : 0;
-	profileBlob = (float *)data[17];
-	tempBlob = (unsigned char *)data[18];
-	pressureBlob = (int *)data[19];
-	for (i = 0; interval && i * interval < state->cur_dive->duration.seconds; i++) {
-		sample_start(state);
-		state->cur_sample->time.seconds = i * interval;
-		if (profileBlob)
-			state->cur_sample->depth.mm = lrintf(profileBlob[i] * 1000.0f);
-		else
-			state->cur_sample->depth.mm = state->cur_dive->dcs[0].maxdepth.mm;
-
-		if (data[18] && data[18][0])
-			state->cur_sample->temperature.mkelvin = C_to_mkelvin(tempBlob[i]);
-		if (data[19] && data[19][0])
-			state->cur_sample->pressure[0].mbar = pressureBlob[i];
-		sample_end(state);
-	}
+	dm4_profile(state, data, interval);
 
-	snprintf(get_events, sizeof(get_events) - 1, get_events_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_events, &dm4_events, state, NULL);
+	retval = state->events.exec(state->cur_dive->number, &dm4_events, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query dm4_events failed.");
 		return 1;
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_tags_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_events, &dm4_tags, state, NULL);
+	retval = state->tags.exec(state->cur_dive->number, &dm4_tags, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query dm4_tags failed.");
 		return 1;
@@ -280,21 +309,18 @@ static int dm4_dive(void *param, int, char **data, char **)
 int parse_dm4_buffer(sqlite3 *handle, const char *url, const char *, int, struct divelog *log)
 {
 	int retval;
-	char *err = NULL;
-	struct parser_state state;
-
-	state.log = log;
-	state.sql_handle = handle;
 
 	/* StartTime is converted from Suunto's nano seconds to standard
 	 * time. We also need epoch, not seconds since year 1. */
 	char get_dives[] = "select D.DiveId,StartTime/10000000-62135596800,Note,Duration,SourceSerialNumber,Source,MaxDepth,SampleInterval,StartTemperature,BottomTemperature,D.StartPressure,D.EndPressure,Size,CylinderWorkPressure,SurfacePressure,DiveTime,SampleInterval,ProfileBlob,TemperatureBlob,PressureBlob,Oxygen,Helium,MIX.StartPressure,MIX.EndPressure FROM Dive AS D JOIN DiveMixture AS MIX ON D.DiveId=MIX.DiveId";
 
-	retval = sqlite3_exec(handle, get_dives, &dm4_dive, &state, &err);
+	struct dm_state state(handle, get_dives);
+	state.log = log;
+
+	retval = state.dives.exec(&dm4_dive, &state);
 
 	if (retval != SQLITE_OK) {
-		report_info("Database query failed '%s': %s.", url, err);
-		sqlite3_free(err);
+		report_info("Database query failed '%s': %s.", url, sqlite3_errmsg(handle));
 		return 1;
 	}
 
@@ -351,17 +377,11 @@ static int dm5_gaschange(void *param, int, char **data, char **)
 
 static int dm5_dive(void *param, int, char **data, char **)
 {
-	int i;
+	int i, count = 0;
 	int tempformat = 0;
-	int interval, retval = 0, block_size;
-	struct parser_state *state = (struct parser_state *)param;
-	sqlite3 *handle = state->sql_handle;
+	int interval, retval = 0, block_size = 16;
+	struct dm_state *state = (struct dm_state *)param;
 	unsigned const char *sampleBlob;
-	char get_events_template[] = "select * from Mark where DiveId = %d";
-	char get_tags_template[] = "select Text from DiveTag where DiveId = %d";
-	char get_cylinders_template[] = "select * from DiveMixture where DiveId = %d";
-	char get_gaschange_template[] = "select GasChangeTime,Oxygen,Helium from DiveGasChange join DiveMixture on DiveGasChange.DiveMixtureId=DiveMixture.DiveMixtureId where DiveId = %d";
-	char get_events[512];
 
 	dive_start(state);
 	state->cur_dive->number = atoi(data[0]);
@@ -417,8 +437,7 @@ static int dm5_dive(void *param, int, char **data, char **)
 		}
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_cylinders_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_events, &dm5_cylinders, state, NULL);
+	retval = state->cylinders.exec(state->cur_dive->number, &dm5_cylinders, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query dm5_cylinders failed.");
 		return 1;
@@ -467,9 +486,15 @@ static int dm5_dive(void *param, int, char **data, char **)
 				block_size = 16;
 				break;
 		}
+		count = interval ? (state->cur_dive->duration.seconds + interval - 1) / interval : 0;
+		/* Don't read past the end of the blob */
+		if (count > state->dives.size(24) / block_size)
+			count = state->dives.size(24) / block_size;
+		if (count > 0)
+			get_dc(state)->samples.reserve(count);
 	}
 
-	for (i = 0; interval && sampleBlob && i * interval < state->cur_dive->duration.seconds; i++) {
+	for (i = 0; i < count; i++) {
 		float *depth = (float *)&sampleBlob[i * block_size + 3];
 		int32_t pressure = (sampleBlob[i * block_size + 9] << 16) + (sampleBlob[i * block_size + 8] << 8) + sampleBlob[i * block_size + 7];
 
@@ -499,46 +524,22 @@ static int dm5_dive(void *param, int, char **data, char **)
 	 * from DM4 format
 	 */
 
-	if (i == 0) {
-		float *profileBlob;
-		unsigned char *tempBlob;
-		int *pressureBlob;
-
-		profileBlob = (float *)data[17];
-		tempBlob = (unsigned char *)data[18];
-		pressureBlob = (int *)data[19];
-		for (i = 0; interval && i * interval < state->cur_dive->duration.seconds; i++) {
-			sample_start(state);
-			state->cur_sample->time.seconds = i * interval;
-			if (profileBlob)
-				state->cur_sample->depth.mm = lrintf(profileBlob[i] * 1000.0f);
-			else
-				state->cur_sample->depth.mm = state->cur_dive->dcs[0].maxdepth.mm;
-
-			if (data[18] && data[18][0])
-				state->cur_sample->temperature.mkelvin = C_to_mkelvin(tempBlob[i]);
-			if (data[19] && data[19][0])
-				state->cur_sample->pressure[0].mbar = pressureBlob[i];
-			sample_end(state);
-		}
-	}
+	if (i == 0)
+		dm4_profile(state, data, interval);
 
-	snprintf(get_events, sizeof(get_events) - 1, get_gaschange_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_events, &dm5_gaschange, state, NULL);
+	retval = state->gaschange.exec(state->cur_dive->number, &dm5_gaschange, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query dm5_gaschange failed.");
 		return 1;
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_events_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_events, &dm4_events, state, NULL);
+	retval = state->events.exec(state->cur_dive->number, &dm4_events, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query dm4_events failed.");
 		return 1;
 	}
 
-	snprintf(get_events, sizeof(get_events) - 1, get_tags_template, state->cur_dive->number);
-	retval = sqlite3_exec(handle, get_events, &dm4_tags, state, NULL);
+	retval = state->tags.exec(state->cur_dive->number, &dm4_tags, state);
 	if (retval != SQLITE_OK) {
 		report_info("Database query dm4_tags failed.");
 		return 1;
@@ -552,21 +553,18 @@ static int dm5_dive(void *param, int, char **data, char **)
 int parse_dm5_buffer(sqlite3 *handle, const char *url, const char *, int, struct divelog *log)
 {
 	int retval;
-	char *err = NULL;
-	struct parser_state state;
-
-	state.log = log;
-	state.sql_handle = handle;
 
 	/* StartTime is converted from Suunto's nano seconds to standard
 	 * time. We also need epoch, not seconds since year 1. */
 	char get_dives[] = "select DiveId,StartTime/10000000-62135596800,Note,Duration,coalesce(SourceSerialNumber,SerialNumber),Source,MaxDepth,SampleInterval,StartTemperature,BottomTemperature,StartPressure,EndPressure,'','',SurfacePressure,DiveTime,SampleInterval,ProfileBlob,TemperatureBlob,PressureBlob,'','','','',SampleBlob,Mode FROM Dive where Deleted is null";
 
-	retval = sqlite3_exec(handle, get_dives, &dm5_dive, &state, &err);
+	struct dm_state state(handle, get_dives);
+	state.log = log;
+
+	retval = state.dives.exec(&dm5_dive, &state);
 
 	if (retval != SQLITE_OK) {
-		report_info("Database query failed '%s': %s.", url, err);
-		sqlite3_free(err);
+		report_info("Database query failed '%s': %s.", url, sqlite3_errmsg(handle));
 		return 1;
 	}
 
@@ -24,6 +24,7 @@
 #include "dive.h"
 #include "errorhelper.h"
 #include "event.h"
+#include "progressreporter.h"
 #include "sha1.h"
 #include "subsurface-time.h"
 
@@ -38,18 +39,67 @@
 #include "core/version.h"
 #include "core/qthelper.h"
 #include "core/file.h"
+#include "core/range.h"
 #include <array>
 #include <charconv>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <QFile>
+#include <QSaveFile>
+#include <QtConcurrent>
 
 std::string dumpfile_name;
 std::string logfile_name;
 std::string progress_bar_text;
 void (*progress_callback)(const std::string &text) = NULL;
-double progress_bar_fraction = 0.0;
+std::atomic<double> progress_bar_fraction = 0.0;
+double transfer_rate = 0.0;
 
-static int stoptime, stopdepth, ndl, po2, cns, heartbeat, bearing;
-static bool in_deco, first_temp_is_air;
-static int current_gas_index;
+transfer_meter::transfer_meter(const char *transport) : transport(transport)
+{
+}
+
+transfer_meter::~transfer_meter()
+{
+	if (!reads)
+		return;
+	long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	report_info("%s: received %llu bytes in %llu reads in %lld ms (%.1f kB/s)", transport,
+		    (unsigned long long)bytes, (unsigned long long)reads, ms, ms > 0 ? bytes / (double)ms : 0.0);
+}
+
+// The first second is rather dominated by the latency.
+void transfer_meter::received(size_t size)
+{
+	auto now = std::chrono::steady_clock::now();
+	if (!reads++)
+		start = now;
+	bytes += size;
+	long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+	if (ms > 1000)
+		transfer_rate = bytes * 1000.0 / ms;
+}
+
+// The state of a download is per thread, so that the dives of several
+// dive computers can be downloaded at the same time.
+static thread_local bool first_temp_is_air;
+
+/*
+ * The values that stick from one sample to the next. These are per
+ * dive, so that the samples of different dives can be parsed in parallel.
+ */
+struct sample_state {
+	struct divecomputer *dc;
+	int stoptime = 0, stopdepth = 0, ndl = -1, po2 = 0, cns = 0, heartbeat = 0, bearing = -1;
+	bool in_deco = false;
+	unsigned int nsensor = 0;
+	sample_state(struct divecomputer *dc) : dc(dc)
+	{
+	}
+};
 
 #define INFO(fmt, ...) report_info("INFO: " fmt, ##__VA_ARGS__)
 #define ERROR(fmt, ...)	report_info("ERROR: " fmt, ##__VA_ARGS__)
@@ -312,7 +362,6 @@ static dc_status_t parse_gasmixes(device_data_t *devdata, struct dive *dive, dc_
 static void handle_event(struct divecomputer *dc, const struct sample &sample, dc_sample_value_t value)
 {
 	int type, time;
-	struct event *ev;
 
 	/* we mark these for translation here, but we store the untranslated strings
 	 * and only translate them when they are displayed on screen */
@@ -362,9 +411,7 @@ static void handle_event(struct divecomputer *dc, const struct sample &sample, d
 	time = value.event.time;
 	time += sample.time.seconds;
 
-	ev = add_event(dc, time, type, value.event.flags, value.event.value, name);
-	if (ev->is_gaschange() && ev->gas.index >= 0)
-		current_gas_index = ev->gas.index;
+	add_event(dc, time, type, value.event.flags, value.event.value, name);
 }
 
 static void handle_gasmix(struct divecomputer *dc, const struct sample &sample, int idx)
@@ -373,14 +420,13 @@ static void handle_gasmix(struct divecomputer *dc, const struct sample &sample,
 	if (idx < 0)
 		return;
 	add_event(dc, sample.time.seconds, SAMPLE_EVENT_GASCHANGE2, idx+1, 0, "gaschange");
-	current_gas_index = idx;
 }
 
-void
+static void
 sample_cb(dc_sample_type_t type, const dc_sample_value_t *pvalue, void *userdata)
 {
-	static unsigned int nsensor = 0;
-	struct divecomputer *dc = (divecomputer *)userdata;
+	struct sample_state *state = (sample_state *)userdata;
+	struct divecomputer *dc = state->dc;
 	dc_sample_value_t value = *pvalue;
 
 	/*
@@ -388,7 +434,7 @@ sample_cb(dc_sample_type_t type, const dc_sample_value_t *pvalue, void *userdata
 	 * Other types fill in an existing sample.
 	 */
 	if (type == DC_SAMPLE_TIME) {
-		nsensor = 0;
+		state->nsensor = 0;
 
 		// Create a new sample.
 		// Mark depth as negative
@@ -398,14 +444,14 @@ sample_cb(dc_sample_type_t type, const dc_sample_value_t *pvalue, void *userdata
 		// The current sample gets some sticky values
 		// that may have been around from before, these
 		// values will be overwritten by new data if available
-		sample->in_deco = in_deco;
-		sample->ndl.seconds = ndl;
-		sample->stoptime.seconds = stoptime;
-		sample->stopdepth.mm = stopdepth;
-		sample->setpoint.mbar = po2;
-		sample->cns = cns;
-		sample->heartbeat = heartbeat;
-		sample->bearing.degrees = bearing;
+		sample->in_deco = state->in_deco;
+		sample->ndl.seconds = state->ndl;
+		sample->stoptime.seconds = state->stoptime;
+		sample->stopdepth.mm = state->stopdepth;
+		sample->setpoint.mbar = state->po2;
+		sample->cns = state->cns;
+		sample->heartbeat = state->heartbeat;
+		sample->bearing.degrees = state->bearing;
 		return;
 	}
 
@@ -438,10 +484,10 @@ sample_cb(dc_sample_type_t type, const dc_sample_value_t *pvalue, void *userdata
 		break;
 #endif
 	case DC_SAMPLE_HEARTBEAT:
-		sample.heartbeat = heartbeat = value.heartbeat;
+		sample.heartbeat = state->heartbeat = value.heartbeat;
 		break;
 	case DC_SAMPLE_BEARING:
-		sample.bearing.degrees = bearing = value.bearing;
+		sample.bearing.degrees = state->bearing = value.bearing;
 		break;
 #ifdef DEBUG_DC_VENDOR
 	case DC_SAMPLE_VENDOR:
@@ -454,36 +500,36 @@ sample_cb(dc_sample_type_t type, const dc_sample_value_t *pvalue, void *userdata
 #endif
 	case DC_SAMPLE_SETPOINT:
 		/* for us a setpoint means constant pO2 from here */
-		sample.setpoint.mbar = po2 = lrint(value.setpoint * 1000);
+		sample.setpoint.mbar = state->po2 = lrint(value.setpoint * 1000);
 		break;
 	case DC_SAMPLE_PPO2:
-		if (nsensor < MAX_O2_SENSORS)
-			sample.o2sensor[nsensor].mbar = lrint(value.ppo2.value * 1000);
+		if (state->nsensor < MAX_O2_SENSORS)
+			sample.o2sensor[state->nsensor].mbar = lrint(value.ppo2.value * 1000);
 		else
-			report_error("%d is more o2 sensors than we can handle", nsensor);
-		nsensor++;
+			report_error("%d is more o2 sensors than we can handle", state->nsensor);
+		state->nsensor++;
 		// Set the amount of detected o2 sensors
-		if (nsensor > dc->no_o2sensors)
-			dc->no_o2sensors = nsensor;
+		if (state->nsensor > dc->no_o2sensors)
+			dc->no_o2sensors = state->nsensor;
 		break;
 	case DC_SAMPLE_CNS:
-		sample.cns = cns = lrint(value.cns * 100);
+		sample.cns = state->cns = lrint(value.cns * 100);
 		break;
 	case DC_SAMPLE_DECO:
 		if (value.deco.type == DC_DECO_NDL) {
-			sample.ndl.seconds = ndl = value.deco.time;
-			sample.stopdepth.mm = stopdepth = lrint(value.deco.depth * 1000.0);
-			sample.in_deco = in_deco = false;
+			sample.ndl.seconds = state->ndl = value.deco.time;
+			sample.stopdepth.mm = state->stopdepth = lrint(value.deco.depth * 1000.0);
+			sample.in_deco = state->in_deco = false;
 		} else if (value.deco.type == DC_DECO_DECOSTOP ||
 			   value.deco.type == DC_DECO_DEEPSTOP) {
-			sample.stopdepth.mm = stopdepth = lrint(value.deco.depth * 1000.0);
-			sample.stoptime.seconds = stoptime = value.deco.time;
-			sample.in_deco = in_deco = stopdepth > 0;
-			ndl = 0;
+			sample.stopdepth.mm = state->stopdepth = lrint(value.deco.depth * 1000.0);
+			sample.stoptime.seconds = state->stoptime = value.deco.time;
+			sample.in_deco = state->in_deco = state->stopdepth > 0;
+			state->ndl = 0;
 		} else if (value.deco.type == DC_DECO_SAFETYSTOP) {
-			sample.in_deco = in_deco = false;
-			sample.stopdepth.mm = stopdepth = lrint(value.deco.depth * 1000.0);
-			sample.stoptime.seconds = stoptime = value.deco.time;
+			sample.in_deco = state->in_deco = false;
+			sample.stopdepth.mm = state->stopdepth = lrint(value.deco.depth * 1000.0);
+			sample.stoptime.seconds = state->stoptime = value.deco.time;
 		}
 		sample.tts.seconds = value.deco.tts;
 	default:
@@ -493,11 +539,14 @@ sample_cb(dc_sample_type_t type, const dc_sample_value_t *pvalue, void *userdata
 
 static void dev_info(const char *fmt, ...)
 {
+	static std::mutex lock;
 	va_list ap;
 
 	va_start(ap, fmt);
-	progress_bar_text = vformat_string_std(fmt, ap);
+	std::string text = vformat_string_std(fmt, ap);
 	va_end(ap);
+	std::lock_guard<std::mutex> guard(lock);
+	progress_bar_text = std::move(text);
 	if (verbose)
 		INFO("dev_info: %s", progress_bar_text.c_str());
 
@@ -505,7 +554,7 @@ static void dev_info(const char *fmt, ...)
 		(*progress_callback)(progress_bar_text);
 }
 
-static int import_dive_number = 0;
+static thread_local int import_dive_number = 0;
 
 static void download_error(const char *fmt, ...)
 {
@@ -517,12 +566,27 @@ static void download_error(const char *fmt, ...)
 	report_error("Dive %d: %s", import_dive_number, buffer.c_str());
 }
 
-static dc_status_t parse_samples(device_data_t *, struct divecomputer *dc, dc_parser_t *parser)
+static dc_status_t parse_samples(struct divecomputer *dc, dc_parser_t *parser)
 {
 	// Parse the sample data.
-	return dc_parser_samples_foreach(parser, sample_cb, dc);
+	sample_state state(dc);
+	return dc_parser_samples_foreach(parser, sample_cb, &state);
 }
 
+/*
+ * A dive whose header has been parsed and whose samples are being
+ * parsed on the thread pool, so that the download is not held up.
+ * The parser refers to the raw data, therefore we keep a copy of it.
+ */
+struct pending_dive {
+	int number;
+	std::vector<unsigned char> data;
+	dc_parser_t *parser = nullptr;
+	std::unique_ptr<struct dive> dive;
+	QFuture<dc_status_t> samples;
+};
+static thread_local std::vector<std::unique_ptr<pending_dive>> pending_dives;
+
 static int might_be_same_dc(const struct divecomputer &a, const struct divecomputer &b)
 {
 	if (a.model.empty() || b.model.empty())
@@ -534,35 +598,54 @@ static int might_be_same_dc(const struct divecomputer &a, const struct divecompu
 	return a.deviceid == b.deviceid;
 }
 
-static bool match_one_dive(const struct divecomputer &a, const struct dive &dive)
-{
-	/*
-	 * Walk the existing dive computer data,
-	 * see if we have a match (or an anti-match:
-	 * the same dive computer but a different
-	 * dive ID).
-	 */
-	for (auto &b: dive.dcs) {
-		if (match_one_dc(a, b) > 0)
-			return true;
-	}
+/*
+ * The dive computers of the dives we had before the download, to recognize
+ * the dives that were downloaded before. A downloaded dive matches either
+ * by dive id (which requires the same start time, see match_one_dc()) or by
+ * start time. Either way, only dive computers with the same start time can
+ * match, so they are indexed by start time. The index is built when the
+ * download starts; the downloaded dives go to a separate log.
+ */
+struct known_dive_index {
+	std::unordered_multimap<timestamp_t, const struct divecomputer *> by_time;
+	std::unordered_set<uint64_t> ids;	// deviceid << 32 | diveid
 
-	/* Ok, no exact dive computer match. Does the date match? */
-	for (auto &b: dive.dcs) {
-		if (a.when == b.when && might_be_same_dc(a, b))
-			return true;
+	static uint64_t id_key(uint32_t deviceid, uint32_t diveid)
+	{
+		return ((uint64_t)deviceid << 32) | diveid;
 	}
-
-	return false;
-}
+	void build(const dive_table &dives)
+	{
+		clear();
+		for (auto &d: dives) {
+			for (auto &dc: d->dcs) {
+				by_time.emplace(dc.when, &dc);
+				ids.insert(id_key(dc.deviceid, dc.diveid));
+			}
+		}
+	}
+	void clear()
+	{
+		by_time.clear();
+		ids.clear();
+	}
+	bool has_dive(uint32_t deviceid, uint32_t diveid) const
+	{
+		return ids.count(id_key(deviceid, diveid)) > 0;
+	}
+};
+static thread_local known_dive_index known_dives;
 
 /*
  * Check if this dive already existed before the import
  */
-static bool find_dive(const struct divecomputer &match)
+static bool find_dive(const struct divecomputer &a)
 {
-	return std::any_of(divelog.dives.rbegin(), divelog.dives.rend(),
-			   [&match] (auto &old) { return match_one_dive(match, *old);} );
+	auto [from, to] = known_dives.by_time.equal_range(a.when);
+	return std::any_of(from, to, [&a](auto &it) {
+		const struct divecomputer &b = *it.second;
+		return match_one_dc(a, b) > 0 || might_be_same_dc(a, b);
+	});
 }
 
 /*
@@ -778,6 +861,165 @@ static dc_status_t libdc_header_parser(dc_parser_t *parser, device_data_t *devda
 	return DC_STATUS_SUCCESS;
 }
 
+#ifndef O_BINARY
+  #define O_BINARY 0
+#endif
+
+static std::string fingerprint_file(device_data_t *devdata)
+{
+	uint32_t model, serial;
+
+	// Model hash and libdivecomputer 32-bit 'serial number' for the file name
+	model = calculate_string_hash(devdata->model.c_str());
+	serial = devdata->devinfo.serial;
+
+	return format_string_std("%s/fingerprints/%04x.%u",
+		system_default_directory().c_str(),
+		model, serial);
+}
+
+/*
+ * Keeping the dives of interrupted downloads.
+ *
+ * libdivecomputer always starts a download with the newest dive and can
+ * only be told where to stop (the fingerprint), so after an interruption
+ * the dives transferred before can't be skipped. But at least they are
+ * not lost: the raw data of every downloaded dive is appended to a
+ * ".partial" file next to the fingerprint file. If the next attempt is
+ * interrupted again before getting that far, the remaining dives are
+ * taken from that file. After a complete download, the file is removed.
+ *
+ * A record is made of a magic, the sizes of fingerprint and dive data
+ * (native byte order, this never leaves the machine) and the data itself.
+ */
+struct resume_dive {
+	std::vector<unsigned char> fingerprint;
+	std::vector<unsigned char> data;
+	bool seen = false;	// Downloaded again in this attempt
+};
+static thread_local std::vector<resume_dive> resume_dives;
+static thread_local std::string resume_file;
+static const char resume_magic[4] = { 'D', 'I', 'V', 'E' };
+
+static void load_resume_data(device_data_t *devdata)
+{
+	resume_dives.clear();
+	resume_file = fingerprint_file(devdata) + ".partial";
+
+	auto [mem, err] = readfile(resume_file.c_str());
+	if (err <= 0)
+		return;
+	const unsigned char *begin = (const unsigned char *)mem.data();
+	const unsigned char *p = begin, *end = begin + mem.size();
+	while (end - p >= 12 && !memcmp(p, resume_magic, 4)) {
+		uint32_t fsize, size;
+		memcpy(&fsize, p + 4, 4);
+		memcpy(&size, p + 8, 4);
+		if ((size_t)(end - p - 12) < (size_t)fsize + size)
+			break;
+		p += 12;
+		resume_dive d;
+		d.fingerprint.assign(p, p + fsize);
+		d.data.assign(p + fsize, p + fsize + size);
+		resume_dives.push_back(std::move(d));
+		p += fsize + size;
+	}
+	// Cut off a partially written record, so that we can append to the file.
+	if (p != end)
+		QFile::resize(QString::fromStdString(resume_file), p - begin);
+	if (!resume_dives.empty())
+		dev_info(translate("gettextFromC", "Found %d dives of an interrupted download"), (int)resume_dives.size());
+}
+
+static void save_resume_dive(const unsigned char *fingerprint, unsigned int fsize, const unsigned char *data, unsigned int size)
+{
+	// Without a fingerprint we can't tell whether we have seen the dive before.
+	if (resume_file.empty() || !fingerprint || !fsize)
+		return;
+	for (resume_dive &d: resume_dives) {
+		if (d.fingerprint.size() == fsize && std::equal(d.fingerprint.begin(), d.fingerprint.end(), fingerprint)) {
+			d.seen = true;
+			return;
+		}
+	}
+
+	std::string dir = system_default_directory() + "/fingerprints";
+	subsurface_mkdir(dir.c_str());
+	int fd = subsurface_open(resume_file.c_str(), O_WRONLY | O_BINARY | O_CREAT | O_APPEND, 0666);
+	if (fd < 0)
+		return;
+	std::vector<unsigned char> record(12);
+	memcpy(record.data(), resume_magic, 4);
+	memcpy(record.data() + 4, &fsize, 4);
+	memcpy(record.data() + 8, &size, 4);
+	record.insert(record.end(), fingerprint, fingerprint + fsize);
+	record.insert(record.end(), data, data + size);
+	// One write, so that an interruption leaves at most one broken record.
+	if (write(fd, record.data(), record.size()) != (ssize_t)record.size())
+		report_info("Cannot write to %s", resume_file.c_str());
+	close(fd);
+}
+
+/*
+ * Keeping the raw data of the dives.
+ *
+ * If enabled, the data of every new dive is stored as sent by the dive
+ * computer, so that the dive can be parsed again when libdivecomputer
+ * learns more about the format. There is one file per dive, named after
+ * the device id and the dive id, in the "raw" directory next to the
+ * fingerprints. It contains what is needed to create a parser (the
+ * family and model of the descriptor and the device info), followed by
+ * the compressed data. As for the resume data, this never leaves the
+ * machine and the numbers are stored in native byte order.
+ */
+struct raw_dive_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t family, model;
+	uint32_t devinfo_model, devinfo_firmware, devinfo_serial;
+	uint32_t size;		// of the uncompressed data
+};
+static const char raw_dive_magic[4] = { 'R', 'A', 'W', 'D' };
+static const uint32_t raw_dive_version = 1;
+
+static std::string raw_dive_file(const struct divecomputer &dc)
+{
+	return format_string_std("%s/fingerprints/raw/%08x.%08x",
+		system_default_directory().c_str(), dc.deviceid, dc.diveid);
+}
+
+static void save_raw_dive(const device_data_t *devdata, const struct divecomputer &dc, const unsigned char *data, unsigned int size)
+{
+	// Without the ids we couldn't find the file again.
+	if (!devdata->descriptor || !dc.deviceid || !dc.diveid)
+		return;
+
+	raw_dive_header header;
+	memcpy(header.magic, raw_dive_magic, 4);
+	header.version = raw_dive_version;
+	header.family = dc_descriptor_get_type(devdata->descriptor);
+	header.model = dc_descriptor_get_model(devdata->descriptor);
+	header.devinfo_model = devdata->devinfo.model;
+	header.devinfo_firmware = devdata->devinfo.firmware;
+	header.devinfo_serial = devdata->devinfo.serial;
+	header.size = size;
+	QByteArray record((const char *)&header, sizeof(header));
+	record.append(qCompress(data, size));
+
+	std::string dir = system_default_directory() + "/fingerprints";
+	subsurface_mkdir(dir.c_str());
+	dir += "/raw";
+	subsurface_mkdir(dir.c_str());
+	QSaveFile f(QString::fromStdString(raw_dive_file(dc)));
+	if (!f.open(QIODevice::WriteOnly) || f.write(record) != record.size() || !f.commit())
+		report_info("Cannot write raw dive data to %s", qPrintable(f.fileName()));
+}
+
+bool libdc_has_raw_dive(const struct divecomputer &dc)
+{
+	return dc.deviceid && dc.diveid && QFile::exists(QString::fromStdString(raw_dive_file(dc)));
+}
+
 /* returns true if we want libdivecomputer's dc_device_foreach() to continue,
  *  false otherwise */
 static int dive_cb(const unsigned char *data, unsigned int size,
@@ -785,49 +1027,39 @@ static int dive_cb(const unsigned char *data, unsigned int size,
 		   void *userdata)
 {
 	dc_status_t rc;
-	dc_parser_t *parser = NULL;
 	device_data_t *devdata = (device_data_t *)userdata;
 
-	/* reset static data, that is only valid per dive */
-	stoptime = stopdepth = po2 = cns = heartbeat = 0;
-	ndl = bearing = -1;
-	in_deco = false;
-	current_gas_index = -1;
-
 	import_dive_number++;
 
-	rc = dc_parser_new(&parser, devdata->device, data, size);
+	auto pending = std::make_unique<pending_dive>();
+	pending->number = import_dive_number;
+	pending->data.assign(data, data + size);
+	rc = dc_parser_new(&pending->parser, devdata->device, pending->data.data(), size);
 	if (rc != DC_STATUS_SUCCESS) {
 		download_error(translate("gettextFromC", "Unable to create parser for %s %s: %d"), devdata->vendor.c_str(), devdata->product.c_str(), errmsg(rc));
 		return true;
 	}
 
-	auto dive = std::make_unique<struct dive>();
+	pending->dive = std::make_unique<struct dive>();
+	struct dive *dive = pending->dive.get();
 
 	// Fill in basic fields
 	dive->dcs[0].model = devdata->model;
 	dive->dcs[0].diveid = calculate_diveid(fingerprint, fsize);
 
-	// Parse the dive's header data
-	rc = libdc_header_parser (parser, devdata, dive.get());
+	// Parse the dive's header data. This is needed right away
+	// to decide whether we have already seen this dive.
+	rc = libdc_header_parser (pending->parser, devdata, dive);
 	if (rc != DC_STATUS_SUCCESS) {
 		download_error(translate("getextFromC", "Error parsing the header: %s"), errmsg(rc));
-		goto error_exit;
-	}
-
-	// Initialize the sample data.
-	rc = parse_samples(devdata, &dive->dcs[0], parser);
-	if (rc != DC_STATUS_SUCCESS) {
-		download_error(translate("gettextFromC", "Error parsing the samples: %s"), errmsg(rc));
-		goto error_exit;
+		dc_parser_destroy(pending->parser);
+		return true;
 	}
 
-	dc_parser_destroy(parser);
-
 	/*
 	 * Save off fingerprint data.
 	 *
-	 * NOTE! We do this after parsing the dive fully, so that
+	 * NOTE! We do this after parsing the header, so that
 	 * we have the final deviceid here.
 	 */
 	if (fingerprint && fsize && !devdata->fingerprint) {
@@ -844,34 +1076,79 @@ static int dive_cb(const unsigned char *data, unsigned int size,
 	if (!devdata->force_download && find_dive(dive->dcs[0])) {
 		std::string date_string = get_dive_date_c_string(dive->when);
 		dev_info(translate("gettextFromC", "Already downloaded dive at %s"), date_string.c_str());
+		dc_parser_destroy(pending->parser);
 		return false;
 	}
 
-	/* Various libdivecomputer interface fixups */
-	if (dive->dcs[0].airtemp.mkelvin == 0 && first_temp_is_air && !dive->dcs[0].samples.empty()) {
-		dive->dcs[0].airtemp = dive->dcs[0].samples[0].temperature;
-		dive->dcs[0].samples[0].temperature = 0_K;
+	save_resume_dive(fingerprint, fsize, data, size);
+	if (devdata->keep_raw)
+		save_raw_dive(devdata, dive->dcs[0], data, size);
+
+	// The samples are parsed in the background, while we are
+	// fetching the next dive from the device.
+	dc_parser_t *parser = pending->parser;
+	pending->samples = QtConcurrent::run([parser, dive]() { return parse_samples(&dive->dcs[0], parser); });
+	pending_dives.push_back(std::move(pending));
+	return true;
+}
+
+/*
+ * After a complete download, forget the dives of earlier attempts. Otherwise
+ * add those that we didn't get to this time. These are older than the ones we
+ * got, i.e. they come last in download order.
+ */
+static void finish_resume_data(device_data_t *devdata, bool complete)
+{
+	if (complete) {
+		if (!resume_file.empty())
+			unlink(resume_file.c_str());
+	} else {
+		for (resume_dive &d: resume_dives) {
+			if (d.seen)
+				continue;
+			if (!dive_cb(d.data.data(), d.data.size(), d.fingerprint.data(), d.fingerprint.size(), devdata))
+				break;
+		}
+	}
+	resume_dives.clear();
+	resume_file.clear();
+}
+
+/* Various libdivecomputer interface fixups */
+static void fixup_samples(struct divecomputer &dc)
+{
+	if (dc.airtemp.mkelvin == 0 && first_temp_is_air && !dc.samples.empty()) {
+		dc.airtemp = dc.samples[0].temperature;
+		dc.samples[0].temperature = 0_K;
 	}
 
 	/* special case for bug in Tecdiving DiveComputer.eu
 	 * often the first sample has a water temperature of 0C, followed by the correct
 	 * temperature in the next sample */
-	if (dive->dcs[0].model == "Tecdiving DiveComputer.eu" && !dive->dcs[0].samples.empty() &&
-	    dive->dcs[0].samples[0].temperature.mkelvin == ZERO_C_IN_MKELVIN &&
-	    dive->dcs[0].samples[1].temperature.mkelvin > dive->dcs[0].samples[0].temperature.mkelvin)
-		dive->dcs[0].samples[0].temperature.mkelvin = dive->dcs[0].samples[1].temperature.mkelvin;
+	if (dc.model == "Tecdiving DiveComputer.eu" && !dc.samples.empty() &&
+	    dc.samples[0].temperature.mkelvin == ZERO_C_IN_MKELVIN &&
+	    dc.samples[1].temperature.mkelvin > dc.samples[0].temperature.mkelvin)
+		dc.samples[0].temperature.mkelvin = dc.samples[1].temperature.mkelvin;
+}
 
-	devdata->log->dives.record_dive(std::move(dive));
-	return true;
+/* Wait for the background sample parsing and add the dives in the order they were downloaded. */
+static void record_pending_dives(device_data_t *devdata)
+{
+	for (auto &pending: pending_dives) {
+		dc_status_t rc = pending->samples.result();
+		dc_parser_destroy(pending->parser);
+		if (rc != DC_STATUS_SUCCESS) {
+			std::string msg = format_string_std(translate("gettextFromC", "Error parsing the samples: %s"), errmsg(rc));
+			report_error("Dive %d: %s", pending->number, msg.c_str());
+			continue;
+		}
 
-error_exit:
-	dc_parser_destroy(parser);
-	return true;
+		fixup_samples(pending->dive->dcs[0]);
+		devdata->log->dives.record_dive(std::move(pending->dive));
+	}
+	pending_dives.clear();
 }
 
-#ifndef O_BINARY
-  #define O_BINARY 0
-#endif
 static void do_save_fingerprint(device_data_t *devdata, const char *tmp, const char *final)
 {
 	int fd, written = -1;
@@ -902,19 +1179,6 @@ static void do_save_fingerprint(device_data_t *devdata, const char *tmp, const c
 	unlink(tmp);
 }
 
-static std::string fingerprint_file(device_data_t *devdata)
-{
-	uint32_t model, serial;
-
-	// Model hash and libdivecomputer 32-bit 'serial number' for the file name
-	model = calculate_string_hash(devdata->model.c_str());
-	serial = devdata->devinfo.serial;
-
-	return format_string_std("%s/fingerprints/%04x.%u",
-		system_default_directory().c_str(),
-		model, serial);
-}
-
 /*
  * Save the fingerprint after a successful download
  *
@@ -983,7 +1247,7 @@ static void verify_fingerprint(dc_device_t *device, device_data_t *devdata, cons
 	if (verbose)
 		dev_info(" ... fingerprinted dive %08x:%08x", deviceid, diveid);
 	/* Only use it if we *have* that dive! */
-	if (!divelog.dives.has_dive(deviceid, diveid)) {
+	if (!known_dives.has_dive(deviceid, diveid)) {
 		if (verbose)
 			dev_info(" ... dive not found");
 		return;
@@ -1025,7 +1289,8 @@ static void lookup_fingerprint(dc_device_t *device, device_data_t *devdata)
 
 static void event_cb(dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
 {
-	static unsigned int last = 0;
+	// Per thread, like the rest of the state of a download
+	static thread_local progress_reporter download_progress;
 	const dc_event_progress_t *progress = (dc_event_progress_t *)data;
 	const dc_event_devinfo_t *devinfo = (dc_event_devinfo_t *)data;
 	const dc_event_clock_t *clock = (dc_event_clock_t *)data;
@@ -1039,17 +1304,13 @@ static void event_cb(dc_device_t *device, dc_event_type_t event, const void *dat
 	case DC_EVENT_PROGRESS:
 		/* this seems really dumb... but having no idea what is happening on long
 		 * downloads makes people think that the app is hung;
-		 * since the progress is in bytes downloaded (usually), simply give updates in 10k increments
+		 * since the progress is in bytes downloaded (usually), say how much was read.
+		 * Fast transports report all the time, so only pass some of the updates on.
 		 */
-		if (progress->current < last)
-			/* this is a new communication with the divecomputer */
-			last = progress->current;
-		if (progress->current > last + 10240) {
-			last = progress->current;
-			dev_info(translate("gettextFromC", "read %dkb"), progress->current / 1024);
-		}
 		if (progress->maximum)
 			progress_bar_fraction = (double)progress->current / (double)progress->maximum;
+		if (download_progress.update(progress->current, progress->maximum) && progress->current > 10240)
+			dev_info(translate("gettextFromC", "read %dkb"), progress->current / 1024);
 		break;
 	case DC_EVENT_DEVINFO:
 		if (dc_descriptor_get_model(devdata->descriptor) != devinfo->model) {
@@ -1077,6 +1338,8 @@ static void event_cb(dc_device_t *device, dc_event_type_t event, const void *dat
 
 		devdata->devinfo = *devinfo;
 		lookup_fingerprint(device, devdata);
+		if (resume_file.empty())
+			load_resume_data(devdata);
 
 		break;
 	case DC_EVENT_CLOCK:
@@ -1157,6 +1420,8 @@ static std::string do_device_import(device_data_t *data)
 		}
 	} else {
 		rc = dc_device_foreach(device, dive_cb, data);
+		finish_resume_data(data, rc == DC_STATUS_SUCCESS);
+		record_pending_dives(data);
 
 		if (rc != DC_STATUS_SUCCESS) {
 			progress_bar_fraction = 0.0;
@@ -1432,6 +1697,9 @@ std::string do_libdivecomputer_import(device_data_t *data)
 
 	import_dive_number = 0;
 	first_temp_is_air = 0;
+	transfer_rate = 0.0;
+	resume_dives.clear();
+	resume_file.clear();
 	data->device = NULL;
 	data->context = NULL;
 	data->iostream = NULL;
@@ -1446,6 +1714,7 @@ std::string do_libdivecomputer_import(device_data_t *data)
 	rc = dc_context_new(&data->context);
 	if (rc != DC_STATUS_SUCCESS)
 		return translate("gettextFromC", "Unable to create libdivecomputer context");
+	known_dives.build(divelog.dives);
 
 	if (fp) {
 		dc_context_set_loglevel(data->context, DC_LOGLEVEL_ALL);
@@ -1508,24 +1777,30 @@ std::string do_libdivecomputer_import(device_data_t *data)
 
 	dc_context_free(data->context);
 	data->context = NULL;
+	known_dives.clear();
 
 	if (fp) {
 		fclose(fp);
 	}
 
 	/*
-	 * Note that we save the fingerprint unconditionally.
+	 * Note that we save the fingerprint of any complete download.
 	 * This is ok because we only have fingerprint data if
 	 * we got a dive header, and because we will use the
 	 * dive id to verify that we actually have the dive
 	 * it refers to before we use the fingerprint data.
 	 *
+	 * After an interrupted download the fingerprint (which is
+	 * that of the newest dive) is not saved, since the next
+	 * download would then stop before the dives we didn't get.
+	 *
 	 * For now we save the fingerprint both to the local file system
 	 * and to the global fingerprint table (to be then saved out with
 	 * the dive log data).
 	 */
-	save_fingerprint(data);
-	if (data->fingerprint && data->fdiveid)
+	if (err.empty())
+		save_fingerprint(data);
+	if (err.empty() && data->fingerprint && data->fdiveid)
 		create_fingerprint_node(fingerprints, calculate_string_hash(data->model.c_str()), data->devinfo.serial,
 					data->fingerprint, data->fsize, data->fdeviceid, data->fdiveid);
 	free(data->fingerprint);
@@ -1575,7 +1850,7 @@ dc_status_t libdc_buffer_parser(struct dive *dive, device_data_t *data, unsigned
 			report_error("Error parsing the dive header data. Dive # %d: %s", dive->number, errmsg(rc));
 		}
 	}
-	rc = dc_parser_samples_foreach (parser, sample_cb, &dive->dcs[0]);
+	rc = parse_samples(&dive->dcs[0], parser);
 	if (rc != DC_STATUS_SUCCESS) {
 		report_error("Error parsing the sample data. Dive # %d: %s", dive->number, errmsg(rc));
 		dc_parser_destroy (parser);
@@ -1586,30 +1861,163 @@ dc_status_t libdc_buffer_parser(struct dive *dive, device_data_t *data, unsigned
 }
 
 /*
- * Returns a dc_descriptor_t structure based on dc model's number and family.
- *
- * That dc_descriptor_t needs to be freed with dc_descriptor_free by the reciver.
+ * Parse the stored raw data of a dive computer again. Returns a dive of
+ * its own with the newly parsed dive computer, or null if there is no
+ * usable raw data. Creates its own libdivecomputer context, so that many
+ * dives can be parsed in parallel.
  */
-dc_descriptor_t *get_descriptor(dc_family_t type, unsigned int model)
+static std::unique_ptr<dive> reparse_raw_dive(const struct divecomputer &dc)
+{
+	auto [mem, err] = readfile(raw_dive_file(dc).c_str());
+	if (err <= 0 || mem.size() < sizeof(raw_dive_header))
+		return nullptr;
+	raw_dive_header header;
+	memcpy(&header, mem.data(), sizeof(header));
+	if (memcmp(header.magic, raw_dive_magic, 4) || header.version != raw_dive_version)
+		return nullptr;
+	QByteArray data = qUncompress((const unsigned char *)mem.data() + sizeof(header), mem.size() - sizeof(header));
+	if ((uint32_t)data.size() != header.size)
+		return nullptr;
+
+	struct divelog log;	// Takes the dive sites found by the parser, which we don't use
+	device_data_t devdata;
+	devdata.descriptor = get_descriptor((dc_family_t)header.family, header.model);
+	if (!devdata.descriptor)
+		return nullptr;
+	devdata.devinfo.model = header.devinfo_model;
+	devdata.devinfo.firmware = header.devinfo_firmware;
+	devdata.devinfo.serial = header.devinfo_serial;
+	devdata.log = &log;
+	if (dc_context_new(&devdata.context) != DC_STATUS_SUCCESS)
+		return nullptr;
+
+	auto res = std::make_unique<dive>();
+	res->dcs[0].model = dc.model;
+	res->dcs[0].diveid = dc.diveid;
+	first_temp_is_air = false;
+	dc_parser_t *parser = nullptr;
+	dc_status_t rc = dc_parser_new2(&parser, devdata.context, devdata.descriptor,
+					(const unsigned char *)data.constData(), data.size());
+	if (rc == DC_STATUS_SUCCESS) {
+		rc = libdc_header_parser(parser, &devdata, res.get());
+		if (rc == DC_STATUS_SUCCESS)
+			rc = parse_samples(&res->dcs[0], parser);
+		dc_parser_destroy(parser);
+	}
+	dc_context_free(devdata.context);
+	res->dive_site = nullptr;
+	if (rc != DC_STATUS_SUCCESS) {
+		report_info("Cannot parse the raw data of dive %08x.%08x: %s", dc.deviceid, dc.diveid, errmsg(rc));
+		return nullptr;
+	}
+	fixup_samples(res->dcs[0]);
+	return res;
+}
+
+std::vector<std::pair<dive *, std::unique_ptr<dive>>> libdc_reparse_dives(const std::vector<dive *> &dives)
 {
-	dc_descriptor_t *descriptor = NULL, *needle = NULL;
+	struct reparse_job {
+		dive *d;
+		int dc_nr;
+		std::unique_ptr<dive> parsed;
+	};
+	std::vector<reparse_job> jobs;
+	for (dive *d: dives) {
+		for (auto [nr, dc]: enumerated_range(d->dcs)) {
+			if (libdc_has_raw_dive(dc))
+				jobs.push_back({ d, nr, {} });
+		}
+	}
+	QtConcurrent::blockingMap(jobs, [](reparse_job &job) { job.parsed = reparse_raw_dive(job.d->dcs[job.dc_nr]); });
+
+	// The jobs of a dive are consecutive: make one copy per dive.
+	std::vector<std::pair<dive *, std::unique_ptr<dive>>> res;
+	for (reparse_job &job: jobs) {
+		if (!job.parsed)
+			continue;
+		if (res.empty() || res.back().first != job.d) {
+			auto copy = std::make_unique<dive>(*job.d);
+			copy->id = dive_getUniqID();
+			res.emplace_back(job.d, std::move(copy));
+		}
+		struct dive &copy = *res.back().second;
+		struct divecomputer &dc = copy.dcs[job.dc_nr];
+		struct divecomputer parsed = std::move(job.parsed->dcs[0]);
+
+		// Keep the identity of the dive computer and the time, which may
+		// have been shifted by the user (and not all parsers can tell the
+		// time without the clock of the device).
+		parsed.when = dc.when;
+		parsed.deviceid = dc.deviceid;
+		parsed.diveid = dc.diveid;
+		parsed.model = dc.model;
+		dc = std::move(parsed);
+
+		// The cylinders are the user's, but the samples may refer to more of them.
+		for (size_t i = copy.cylinders.size(); i < job.parsed->cylinders.size(); i++)
+			copy.cylinders.add(static_cast<int>(i), job.parsed->cylinders[i]);
+	}
+	for (auto &[d, copy]: res)
+		divelog.dives.force_fixup_dive(*copy);
+	return res;
+}
+
+/*
+ * The descriptors of libdivecomputer, indexed once for the whole process.
+ * They are libdivecomputer's static tables: dc_descriptor_free() is a no-op
+ * on them, so they can be handed out to any number of users.
+ */
+namespace {
+struct descriptor_index {
+	std::vector<dc_descriptor_t *> descriptors;
+	std::unordered_map<uint64_t, dc_descriptor_t *> by_model;	// family << 32 | model
+	descriptor_index();
+};
+}
+
+static uint64_t model_key(dc_family_t type, unsigned int model)
+{
+	return ((uint64_t)type << 32) | model;
+}
+
+descriptor_index::descriptor_index()
+{
+	dc_descriptor_t *descriptor = NULL;
 	dc_iterator_t *iterator = NULL;
 	dc_status_t rc;
 
 	rc = dc_descriptor_iterator(&iterator);
 	if (rc != DC_STATUS_SUCCESS) {
 		report_info("Error creating the device descriptor iterator: %s", errmsg(rc));
-		return NULL;
+		return;
 	}
 	while ((dc_iterator_next(iterator, &descriptor)) == DC_STATUS_SUCCESS) {
-		unsigned int desc_model = dc_descriptor_get_model(descriptor);
-		dc_family_t desc_type = dc_descriptor_get_type(descriptor);
-		if (model == desc_model && type == desc_type) {
-			needle = descriptor;
-			break;
-		}
-		dc_descriptor_free(descriptor);
+		descriptors.push_back(descriptor);
+		// As with a linear search, the first descriptor of a model wins.
+		by_model.emplace(model_key(dc_descriptor_get_type(descriptor), dc_descriptor_get_model(descriptor)), descriptor);
 	}
 	dc_iterator_free(iterator);
-	return needle;
+}
+
+static const descriptor_index &get_descriptor_index()
+{
+	static const descriptor_index index;
+	return index;
+}
+
+const std::vector<dc_descriptor_t *> &all_descriptors()
+{
+	return get_descriptor_index().descriptors;
+}
+
+/*
+ * Returns a dc_descriptor_t structure based on dc model's number and family.
+ *
+ * Freeing it with dc_descriptor_free is allowed, but not required.
+ */
+dc_descriptor_t *get_descriptor(dc_family_t type, unsigned int model)
+{
+	const auto &by_model = get_descriptor_index().by_model;
+	auto it = by_model.find(model_key(type, model));
+	return it != by_model.end() ? it->second : NULL;
 }
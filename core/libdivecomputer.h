@@ -4,7 +4,11 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <vector>
 
 /* libdivecomputer */
 
@@ -22,6 +26,7 @@
 #endif
 
 struct dive;
+struct divecomputer;
 struct divelog;
 struct devices;
 
@@ -41,6 +46,7 @@ struct device_data_t {
 	bool libdc_dump = false;
 	bool bluetooth_mode = false;
 	bool sync_time = false;
+	bool keep_raw = false;		// Store the raw data of the dives, so that they can be parsed again
 	FILE *libdc_logfile = nullptr;
 	struct divelog *log = nullptr;
 	void *androidUsbDeviceDescriptor = nullptr;
@@ -55,13 +61,42 @@ struct device_data_t {
 const char *errmsg (dc_status_t rc);
 std::string do_libdivecomputer_import(device_data_t *data);
 dc_status_t libdc_buffer_parser(struct dive *dive, device_data_t *data, unsigned char *buffer, int size);
+// Whether the raw data of this dive computer was kept when downloading.
+bool libdc_has_raw_dive(const struct divecomputer &dc);
+// Parse the kept raw data of the dives again, in parallel. Returns the dives
+// for which there was raw data, each with a copy in which these dive computers
+// were replaced by the newly parsed ones. Start times and user data are kept.
+std::vector<std::pair<dive *, std::unique_ptr<dive>>> libdc_reparse_dives(const std::vector<dive *> &dives);
 void logfunc(dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg, void *userdata);
+// All descriptors known to libdivecomputer, enumerated once per process.
+const std::vector<dc_descriptor_t *> &all_descriptors();
 dc_descriptor_t *get_descriptor(dc_family_t type, unsigned int model);
 
 extern int import_thread_cancelled;
 extern std::string progress_bar_text;
 extern void (*progress_callback)(const std::string &text);
-extern double progress_bar_fraction;
+extern std::atomic<double> progress_bar_fraction;	// polled by the UI
+extern double transfer_rate; // bytes per second, 0 if unknown
+
+// Counts what a transport receives, for the transfer rate shown to the
+// user and for the download log, to which it is written when the meter
+// goes away (i.e. when the transport is closed).
+class transfer_meter {
+public:
+	transfer_meter(const char *transport);	// a string literal, it is not copied
+	~transfer_meter();
+	void received(size_t bytes);
+private:
+	const char *transport;
+	std::chrono::steady_clock::time_point start;
+	uint64_t bytes = 0;
+	uint64_t reads = 0;
+};
+
+#if defined(SERIAL_FTDI)
+extern int ftdi_latency_timer;	// in ms, 1 to 255
+extern int ftdi_chunk_size;	// of the USB transfers, in bytes, 0 for the default of libftdi
+#endif
 
 dc_status_t ble_packet_open(dc_iostream_t **iostream, dc_context_t *context, const char* devaddr, void *userdata);
 dc_status_t rfcomm_stream_open(dc_iostream_t **iostream, dc_context_t *context, const char* devaddr);
@@ -414,7 +414,7 @@ static void parse_dives(int log_version, const unsigned char *buf, unsigned int
 	} // while
 }
 
-int try_to_open_liquivision(const char *, std::string &mem, struct divelog *log)
+int try_to_open_liquivision(const char *, std::string_view mem, struct divelog *log)
 {
 	const unsigned char *buf = (unsigned char *)mem.data();
 	unsigned int buf_size = (unsigned int)mem.size();
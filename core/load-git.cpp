@@ -9,9 +9,15 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <git2.h>
+#include <algorithm>
 #include <array>
 #include <memory>
+#include <iterator>
+#include <map>
+#include <set>
 #include <libdivecomputer/parser.h>
+#include <QtConcurrent>
+#include <QThread>
 
 #include "gettext.h"
 
@@ -23,21 +29,40 @@
 #include "event.h"
 #include "format.h"
 #include "git-access.h"
+#include "perfcounters.h"
 #include "picture.h"
 #include "qthelper.h"
+#include "range.h"
 #include "sample.h"
+#include "samplecodec.h"
 #include "subsurface-string.h"
 #include "subsurface-time.h"
+#include "summarycache.h"
 #include "tag.h"
+#include "trace.h"
 #include "trip.h"
 #include "version.h"
 
 // TODO: Should probably be moved to struct divelog to allow for multi-document
 std::string saved_git_id;
 
+/*
+ * Parsing the divecomputer blobs (i.e. the samples) is by far the
+ * most expensive part of loading a git repository. Therefore, the
+ * tree walk only records which blob belongs to which divecomputer
+ * and the blobs are parsed on a thread pool once the walk is done.
+ */
+struct divecomputer_job {
+	struct dive *dive;
+	size_t dc_idx;
+	int o2pressure_sensor;
+	git_oid id;
+};
+
 struct git_parser_state {
 	git_repository *repo = nullptr;
 	struct divecomputer *active_dc = nullptr;
+	const struct dive *dc_dive = nullptr;	// dive the active_dc belongs to
 	std::unique_ptr<dive> active_dive;
 	std::unique_ptr<dive_trip> active_trip;
 	std::string fulltext_mode;
@@ -54,6 +79,22 @@ struct git_parser_state {
 	int o2pressure_sensor = 0;
 	std::vector<std::string> converted_strings;
 	size_t act_converted_string = 0;
+	bool lazy_samples = false;
+	std::vector<divecomputer_job> dc_jobs;
+	std::vector<std::unique_ptr<dive>> loaded_dives;	// recorded once the divecomputers are parsed
+	// For loading only the changes between two commits, see git_load_changed_dives()
+	bool collect_dive_ids = false;		// only collect the ids of the dive directories
+	std::set<git_dive_id> dive_ids;		// collected dive directories
+	const std::set<git_dive_id> *skip_dive_ids = nullptr;	// these are not loaded, but marked as seen
+	std::set<git_dive_id> seen_dive_ids;
+	// For the sharded layout, see load_shards()
+	std::string root_prefix;		// path of the shard that is walked
+	std::vector<std::pair<std::string, git_oid>> shards;	// found in the main tree
+	bool defer_shared = false;		// the sites and tags belong to another thread
+	std::vector<std::pair<dive *, uint32_t>> site_refs;
+	std::vector<std::pair<dive *, std::string>> tag_refs;
+	std::map<git_dive_id, std::set<git_dive_id>> shard_dive_ids;	// collected dive directories, per shard commit
+	const std::map<git_dive_id, std::set<git_dive_id>> *skip_shards = nullptr;	// unchanged shards
 };
 
 struct keyword_action {
@@ -146,11 +187,14 @@ static void update_time(timestamp_t *when, const char *line)
 	*when = utc_mktime(&tm);
 }
 
+/* Note: this is used on non-zero-terminated blob data, so no sscanf() here */
 static duration_t get_duration(const char *line)
 {
-	int m = 0, s = 0;
+	char *end;
+	int m = strtol(line, &end, 10), s = 0;
 	duration_t d;
-	sscanf(line, "%d:%d", &m, &s);
+	if (*end == ':')
+		s = strtol(end + 1, NULL, 10);
 	d.seconds = m * 60 + s;
 	return d;
 }
@@ -245,7 +289,12 @@ static void parse_dive_notes(char *, struct git_parser_state *state)
 { state->active_dive->notes = get_first_converted_string(state); }
 
 static void parse_dive_divesiteid(char *line, struct git_parser_state *state)
-{ state->log->sites.get_by_uuid(get_hex(line))->add_dive(state->active_dive.get()); }
+{
+	if (state->defer_shared)
+		state->site_refs.emplace_back(state->active_dive.get(), get_hex(line));
+	else
+		state->log->sites.get_by_uuid(get_hex(line))->add_dive(state->active_dive.get());
+}
 
 /*
  * We can have multiple tags.
@@ -253,7 +302,11 @@ static void parse_dive_divesiteid(char *line, struct git_parser_state *state)
 static void parse_dive_tags(char *, struct git_parser_state *state)
 {
 	for  (const std::string &tag: state->converted_strings) {
-		if (!tag.empty())
+		if (tag.empty())
+			continue;
+		if (state->defer_shared)
+			state->tag_refs.emplace_back(state->active_dive.get(), tag);
+		else
 			taglist_add_tag(state->active_dive->tags, tag.c_str());
 	}
 }
@@ -518,102 +571,124 @@ static int match_action(char *line, void *data, const std::array<keyword_action,
 	return match_action(line, data, &action[0], N);
 }
 
-/* FIXME! We should do the array thing here too. */
-static void parse_sample_keyvalue(void *_sample, const char *key, const std::string &value)
+static void parse_sample_sensor(struct sample *sample, const char *value)
+{ sample->sensor[0] = atoi(value); }
+
+static void parse_sample_ndl(struct sample *sample, const char *value)
+{ sample->ndl = get_duration(value); }
+
+static void parse_sample_tts(struct sample *sample, const char *value)
+{ sample->tts = get_duration(value); }
+
+static void parse_sample_in_deco(struct sample *sample, const char *value)
+{ sample->in_deco = atoi(value); }
+
+static void parse_sample_stoptime(struct sample *sample, const char *value)
+{ sample->stoptime = get_duration(value); }
+
+static void parse_sample_stopdepth(struct sample *sample, const char *value)
+{ sample->stopdepth = get_depth(value); }
+
+static void parse_sample_cns(struct sample *sample, const char *value)
+{ sample->cns = atoi(value); }
+
+static void parse_sample_rbt(struct sample *sample, const char *value)
+{ sample->rbt = get_duration(value); }
+
+static void parse_sample_po2(struct sample *sample, const char *value)
+{ sample->setpoint = get_o2pressure(value); }
+
+template <int N>
+static void parse_sample_o2sensor(struct sample *sample, const char *value)
+{ sample->o2sensor[N] = get_o2pressure(value); }
+
+static void parse_sample_o2pressure(struct sample *sample, const char *value)
+{ sample->pressure[1] = get_pressure(value); }
+
+static void parse_sample_heartbeat(struct sample *sample, const char *value)
+{ sample->heartbeat = atoi(value); }
+
+static void parse_sample_bearing(struct sample *sample, const char *value)
+{ sample->bearing.degrees = atoi(value); }
+
+/*
+ * The sample keywords are looked up in a perfect hash table, which
+ * is built and checked for collisions at compile time. If you add
+ * a keyword and get a collision, tweak sample_keyword_hash().
+ */
+typedef void (sample_keyword_fn_t)(struct sample *, const char *);
+
+struct sample_keyword {
+	const char *keyword = nullptr;
+	size_t len = 0;
+	sample_keyword_fn_t *fn = nullptr;
+};
+
+static constexpr size_t sample_keyword_table_size = 32;
+
+static constexpr unsigned sample_keyword_hash(const char *key, size_t len)
 {
-	struct sample *sample = (struct sample *)_sample;
+	return (2 * (unsigned char)key[0] + (unsigned char)key[len - 1] + 2 * len) % sample_keyword_table_size;
+}
 
-	if (!strcmp(key, "sensor")) {
-		sample->sensor[0] = atoi(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "ndl")) {
-		sample->ndl = get_duration(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "tts")) {
-		sample->tts = get_duration(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "in_deco")) {
-		sample->in_deco = atoi(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "stoptime")) {
-		sample->stoptime = get_duration(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "stopdepth")) {
-		sample->stopdepth = get_depth(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "cns")) {
-		sample->cns = atoi(value.c_str());
-		return;
-	}
+struct sample_keyword_table {
+	std::array<sample_keyword, sample_keyword_table_size> entries;
+	bool collision = false;
+};
 
-	if (!strcmp(key, "rbt")) {
-		sample->rbt = get_duration(value.c_str());
-		return;
+static constexpr sample_keyword_table make_sample_keyword_table(std::initializer_list<std::pair<const char *, sample_keyword_fn_t *>> keywords)
+{
+	sample_keyword_table res;
+	for (auto [keyword, fn]: keywords) {
+		size_t len = 0;
+		while (keyword[len])
+			len++;
+		sample_keyword &entry = res.entries[sample_keyword_hash(keyword, len)];
+		if (entry.fn)
+			res.collision = true;
+		entry.keyword = keyword;
+		entry.len = len;
+		entry.fn = fn;
 	}
+	return res;
+}
 
-	if (!strcmp(key, "po2")) {
-		sample->setpoint = get_o2pressure(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "sensor1")) {
-		sample->o2sensor[0] = get_o2pressure(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "sensor2")) {
-		sample->o2sensor[1] = get_o2pressure(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "sensor3")) {
-		sample->o2sensor[2] = get_o2pressure(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "sensor4")) {
-		sample->o2sensor[3] = get_o2pressure(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "sensor5")) {
-		sample->o2sensor[4] = get_o2pressure(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "sensor6")) {
-		sample->o2sensor[5] = get_o2pressure(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "o2pressure")) {
-		sample->pressure[1] = get_pressure(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "heartbeat")) {
-		sample->heartbeat = atoi(value.c_str());
-		return;
-	}
-	if (!strcmp(key, "bearing")) {
-		sample->bearing.degrees = atoi(value.c_str());
-		return;
-	}
+static constexpr sample_keyword_table sample_keywords = make_sample_keyword_table({
+	{ "bearing", parse_sample_bearing }, { "cns", parse_sample_cns },
+	{ "heartbeat", parse_sample_heartbeat }, { "in_deco", parse_sample_in_deco },
+	{ "ndl", parse_sample_ndl }, { "o2pressure", parse_sample_o2pressure },
+	{ "po2", parse_sample_po2 }, { "rbt", parse_sample_rbt },
+	{ "sensor", parse_sample_sensor }, { "sensor1", parse_sample_o2sensor<0> },
+	{ "sensor2", parse_sample_o2sensor<1> }, { "sensor3", parse_sample_o2sensor<2> },
+	{ "sensor4", parse_sample_o2sensor<3> }, { "sensor5", parse_sample_o2sensor<4> },
+	{ "sensor6", parse_sample_o2sensor<5> }, { "stopdepth", parse_sample_stopdepth },
+	{ "stoptime", parse_sample_stoptime }, { "tts", parse_sample_tts }
+});
+static_assert(!sample_keywords.collision, "collision in the sample keyword hash table");
 
-	report_error("Unexpected sample key/value pair (%s/%s)", key, value.c_str());
+static sample_keyword_fn_t *lookup_sample_keyword(const char *key, size_t len)
+{
+	if (!len)
+		return nullptr;
+	const sample_keyword &entry = sample_keywords.entries[sample_keyword_hash(key, len)];
+	return entry.len == len && !memcmp(entry.keyword, key, len) ? entry.fn : nullptr;
 }
 
-static char *parse_sample_unit(struct sample *sample, double val, char *unit)
+static void parse_sample_keyvalue(void *_sample, const char *key, const std::string &value)
 {
-	unsigned int sensor;
-	char *end = unit, c;
+	struct sample *sample = (struct sample *)_sample;
+	sample_keyword_fn_t *fn = lookup_sample_keyword(key, strlen(key));
 
-	/* Skip over the unit */
-	while ((c = *end) != 0) {
-		if (isspace(c)) {
-			*end++ = 0;
-			break;
-		}
-		end++;
-	}
+	if (fn)
+		fn(sample, value.c_str());
+	else
+		report_error("Unexpected sample key/value pair (%s/%s)", key, value.c_str());
+}
+
+/* The unit is not zero-terminated, it ends after len characters */
+static void set_sample_value(struct sample *sample, double val, const char *unit, size_t len)
+{
+	unsigned int sensor;
 
 	/* The units are "°C", "m" or "bar", so let's just look at the first character */
 	/* The cylinder pressure may also be of the form '123.0bar:4' to indicate sensor */
@@ -623,7 +698,7 @@ static char *parse_sample_unit(struct sample *sample, double val, char *unit)
 		break;
 	case 'b':
 		sensor = sample->sensor[0];
-		if (end > unit + 4 && unit[3] == ':')
+		if (len > 4 && unit[3] == ':')
 			sensor = atoi(unit + 4);
 		add_sample_pressure(sample, sensor, lrint(1000 * val));
 		break;
@@ -631,6 +706,21 @@ static char *parse_sample_unit(struct sample *sample, double val, char *unit)
 		sample->temperature.mkelvin = C_to_mkelvin(val);
 		break;
 	}
+}
+
+static char *parse_sample_unit(struct sample *sample, double val, char *unit)
+{
+	char *end = unit, c;
+
+	/* Skip over the unit */
+	while ((c = *end) != 0) {
+		if (isspace(c))
+			break;
+		end++;
+	}
+	set_sample_value(sample, val, unit, end - unit);
+	if (c)
+		*end++ = 0;
 
 	return end;
 }
@@ -670,8 +760,8 @@ static struct sample *new_sample(struct git_parser_state *state)
 		sample->pressure[0] = 0_bar;
 		sample->pressure[1] = 0_bar;
 	} else {
-		sample->sensor[0] = sanitize_sensor_id(state->active_dive.get(), !state->o2pressure_sensor);
-		sample->sensor[1] = sanitize_sensor_id(state->active_dive.get(), state->o2pressure_sensor);
+		sample->sensor[0] = sanitize_sensor_id(state->dc_dive, !state->o2pressure_sensor);
+		sample->sensor[1] = sanitize_sensor_id(state->dc_dive, state->o2pressure_sensor);
 	}
 	return sample;
 }
@@ -681,6 +771,7 @@ static void sample_parser(char *line, struct git_parser_state *state)
 	int m, s = 0;
 	struct sample *sample = new_sample(state);
 
+	samples_parsed.add();
 	m = strtol(line, &line, 10);
 	if (*line == ':')
 		s = strtol(line + 1, &line, 10);
@@ -709,6 +800,72 @@ static void sample_parser(char *line, struct git_parser_state *state)
 	}
 }
 
+/*
+ * Sample lines make up the bulk of a git logbook and they never contain
+ * strings. Therefore, parse them directly from the blob without copying
+ * the line or the values (see sample_parser() for the general case).
+ * The blob is not zero-terminated, so this is only done for lines that
+ * end in a newline, which stops all the number parsing functions.
+ *
+ * Returns the number of bytes consumed or 0 if the line has to go
+ * through the general path.
+ */
+static unsigned parse_sample_line(const char *buf, unsigned size, struct git_parser_state *state)
+{
+	const char *eol = (const char *)memchr(buf, '\n', size);
+	const char *p = buf;
+
+	if (!eol || memchr(buf, '"', eol - buf))
+		return 0;
+	while (p < eol && *p == ' ')
+		p++;
+	if (p == eol || !isdigit(*p))
+		return 0;
+
+	struct sample *sample = new_sample(state);
+	char *end;
+	int m = strtol(p, &end, 10), s = 0;
+	if (*end == ':')
+		s = strtol(end + 1, &end, 10);
+	sample->time.seconds = m * 60 + s;
+
+	for (p = end;;) {
+		while (p < eol && isspace(*p))
+			p++;
+		if (p == eol)
+			break;
+		/* Less common sample entries have a name */
+		if (*p >= 'a' && *p <= 'z') {
+			const char *key = p, *value = "";
+			while (p < eol && !isspace(*p) && *p != '=')
+				p++;
+			size_t len = p - key;
+			if (*p == '=') {
+				if (!isspace(*++p))
+					value = p;
+				while (p < eol && !isspace(*p))
+					p++;
+			}
+			sample_keyword_fn_t *fn = lookup_sample_keyword(key, len);
+			if (fn)
+				fn(sample, value);
+			else
+				report_error("Unexpected sample key/value pair (%.*s)", (int)(p - key), key);
+		} else {
+			const char *unit;
+			double val = ascii_strtod(p, &unit);
+			if (unit == p) {
+				report_error("Odd sample data: %.*s", (int)(eol - p), p);
+				break;
+			}
+			for (p = unit; p < eol && !isspace(*p); p++)
+				;
+			set_sample_value(sample, val, unit, p - unit);
+		}
+	}
+	return eol + 1 - buf;
+}
+
 static void parse_dc_airtemp(char *line, struct git_parser_state *state)
 { state->active_dc->airtemp = get_temperature(line); }
 
@@ -1066,6 +1223,22 @@ static void divecomputer_parser(char *line, struct git_parser_state *state)
 	match_action(line, state, dc_action);
 }
 
+/* For lazy loading: parse everything but the samples ... */
+static void divecomputer_header_parser(char *line, struct git_parser_state *state)
+{
+	char c = *line;
+	if (c >= 'a' && c <= 'z')
+		match_action(line, state, dc_action);
+}
+
+/* ... and later the samples only. */
+static void divecomputer_sample_parser(char *line, struct git_parser_state *state)
+{
+	char c = *line;
+	if (c < 'a' || c > 'z')
+		sample_parser(line, state);
+}
+
 /* These need to be sorted! */
 static const std::array dive_action {
 #undef D
@@ -1361,6 +1534,88 @@ static void for_each_line(git_blob *blob, line_fn_t *fn, struct git_parser_state
 	}
 }
 
+/* Set to false to parse all divecomputer lines via the general path (for testing) */
+bool git_load_fast_samples = true;
+
+/*
+ * Divecomputer files are parsed in one go or, for lazy loading,
+ * the header and the samples separately.
+ */
+enum dc_parse_mode {
+	DC_PARSE_ALL,
+	DC_PARSE_HEADER,
+	DC_PARSE_SAMPLES
+};
+
+/*
+ * Binary samples (see samplecodec.h) are stored as a
+ * "samples <version> <count> <size>" line followed by
+ * <size> bytes of sample data.
+ *
+ * Returns the number of bytes consumed.
+ */
+static unsigned parse_binary_samples(const char *buf, unsigned size, enum dc_parse_mode mode, struct git_parser_state *state)
+{
+	const char *eol = (const char *)memchr(buf, '\n', size);
+	char *end;
+
+	if (!eol) {
+		report_error("Corrupt binary sample data");
+		return size;
+	}
+	int version = strtol(buf + 8, &end, 10);
+	unsigned long count = strtoul(end, &end, 10);
+	unsigned long len = strtoul(end, &end, 10);
+	unsigned header = eol + 1 - buf;
+	if (end != eol || len > size - header) {
+		report_error("Corrupt binary sample data");
+		return size;
+	}
+	if (mode == DC_PARSE_HEADER)
+		return header + len;
+	if (version != SAMPLECODEC_VERSION)
+		report_error("Unsupported binary sample data version %d", version);
+	else if (!decode_samples(eol + 1, len, count, state->active_dc->samples))
+		report_error("Corrupt binary sample data");
+	else
+		samples_parsed.add(count);
+	return header + len;
+}
+
+static void for_each_dc_line(git_blob *blob, enum dc_parse_mode mode, struct git_parser_state *state)
+{
+	const char *content = (const char *)git_blob_rawcontent(blob);
+	unsigned int size = git_blob_rawsize(blob);
+	line_fn_t *fn = mode == DC_PARSE_HEADER ? divecomputer_header_parser :
+			mode == DC_PARSE_SAMPLES ? divecomputer_sample_parser :
+						   divecomputer_parser;
+
+	/* Pre-size the samples: text samples take one line each */
+	if (mode != DC_PARSE_HEADER)
+		state->active_dc->samples.reserve(std::count(content, content + size, '\n'));
+
+	while (size) {
+		unsigned int n = 0;
+		if (size > 8 && !memcmp(content, "samples ", 8)) {
+			n = parse_binary_samples(content, size, mode, state);
+		} else if (git_load_fast_samples && (*content == ' ' || isdigit(*content))) {
+			if (mode == DC_PARSE_HEADER) {
+				const char *eol = (const char *)memchr(content, '\n', size);
+				n = eol ? eol + 1 - content : size;
+			} else {
+				n = parse_sample_line(content, size, state);
+			}
+		}
+		if (!n) {
+			state->converted_strings.clear();
+			state->act_converted_string = 0;
+			n = parse_one_line(content, size, fn, state);
+		}
+		content += n;
+		size -= n;
+	}
+}
+
 #define GIT_WALK_OK   0
 #define GIT_WALK_SKIP 1
 
@@ -1372,10 +1627,14 @@ static void finish_active_trip(struct git_parser_state *state)
 		state->log->trips.put(std::move(trip));
 }
 
+/*
+ * Recording a dive runs the fixup code, which needs the samples.
+ * Therefore, keep the dive around until the divecomputers were parsed.
+ */
 static void finish_active_dive(struct git_parser_state *state)
 {
 	if (state->active_dive)
-		state->log->dives.record_dive(std::move(state->active_dive));
+		state->loaded_dives.push_back(std::move(state->active_dive));
 }
 
 static void create_new_dive(timestamp_t when, struct git_parser_state *state)
@@ -1504,9 +1763,19 @@ static int dive_directory(const char *root, const git_tree_entry *entry, const c
 	tm.tm_mon = mm-1;
 	tm.tm_mday = dd;
 
+	git_dive_id id;
+	memcpy(id.data(), git_tree_entry_id(entry)->id, 20);
+	if (state->collect_dive_ids) {
+		state->dive_ids.insert(id);
+		return GIT_WALK_SKIP;
+	}
 	finish_active_dive(state);
+	if (state->skip_dive_ids && state->skip_dive_ids->count(id)) {
+		state->seen_dive_ids.insert(id);
+		return GIT_WALK_SKIP;
+	}
 	create_new_dive(utc_mktime(&tm), state);
-	memcpy(state->active_dive->git_id.data(), git_tree_entry_id(entry)->id, 20);
+	state->active_dive->git_id = id;
 	return GIT_WALK_OK;
 }
 
@@ -1639,23 +1908,101 @@ static struct divecomputer *create_new_dc(struct dive *dive)
 }
 
 /*
- * We should *really* try to delay the dive computer data parsing
- * until necessary, in order to reduce load-time. The parsing is
- * cheap, but the loading of the git blob into memory can be pretty
- * costly.
+ * The dive computer data is not parsed here, we only remember the blob
+ * and parse it in parse_divecomputer_jobs() after the tree was walked.
+ * Note that the "Dive" file sorts before the "Divecomputer" files,
+ * therefore the cylinders of the dive are known at this point.
  */
 static int parse_divecomputer_entry(struct git_parser_state *state, const git_tree_entry *entry, const char *)
 {
-	git_blob *blob = git_tree_entry_blob(state->repo, entry);
+	struct dive *dive = state->active_dive.get();
+	struct divecomputer *dc = create_new_dc(dive);
 
-	if (!blob)
-		return report_error("Unable to read divecomputer file");
+	state->dc_jobs.push_back({ dive, static_cast<size_t>(dc - &dive->dcs[0]),
+				   state->o2pressure_sensor, *git_tree_entry_id(entry) });
+	return 0;
+}
 
-	state->active_dc = create_new_dc(state->active_dive.get());
-	for_each_line(blob, divecomputer_parser, state);
+static void parse_divecomputer_job(struct git_parser_state *state, const divecomputer_job &job)
+{
+	git_blob *blob;
+
+	if (git_blob_lookup(&blob, state->repo, &job.id)) {
+		report_error("Unable to read divecomputer file");
+		return;
+	}
+
+	state->dc_dive = job.dive;
+	state->active_dc = &job.dive->dcs[job.dc_idx];
+	state->o2pressure_sensor = job.o2pressure_sensor;
+	if (state->lazy_samples) {
+		for_each_dc_line(blob, DC_PARSE_HEADER, state);
+		memcpy(state->active_dc->samples_id.data(), job.id.id, 20);
+		state->active_dc->samples_pending = true;
+	} else {
+		for_each_dc_line(blob, DC_PARSE_ALL, state);
+	}
 	git_blob_free(blob);
 	state->active_dc = NULL;
-	return 0;
+	state->dc_dive = NULL;
+}
+
+/*
+ * Every worker gets its own parser state and its own handle to the
+ * repository, since libgit2 objects must not be shared between threads.
+ * Every job writes only into its own divecomputer, so the result does
+ * not depend on the order in which the chunks are processed.
+ */
+struct divecomputer_chunk {
+	const divecomputer_job *begin, *end;
+	bool done = false;
+};
+
+static void parse_divecomputer_chunk(const char *path, bool lazy_samples, divecomputer_chunk &chunk)
+{
+	struct git_parser_state state;
+
+	state.lazy_samples = lazy_samples;
+	if (git_repository_open(&state.repo, path))
+		return;
+	for (const divecomputer_job *job = chunk.begin; job != chunk.end; ++job)
+		parse_divecomputer_job(&state, *job);
+	git_repository_free(state.repo);
+	chunk.done = true;
+}
+
+static void parse_divecomputer_jobs(struct git_parser_state *state)
+{
+	const std::vector<divecomputer_job> &jobs = state->dc_jobs;
+	const char *path = git_repository_path(state->repo);
+	size_t num_threads = std::max(QThread::idealThreadCount(), 1);
+	size_t num_chunks = std::min(num_threads, jobs.size() / 64);
+
+	/* Not worth spinning up the thread pool for small logs */
+	if (num_chunks <= 1 || !path) {
+		for (const divecomputer_job &job: jobs)
+			parse_divecomputer_job(state, job);
+		return;
+	}
+
+	std::vector<divecomputer_chunk> chunks;
+	size_t chunk_size = (jobs.size() + num_chunks - 1) / num_chunks;
+	for (size_t i = 0; i < jobs.size(); i += chunk_size) {
+		const divecomputer_job *begin = jobs.data() + i;
+		chunks.push_back({ begin, begin + std::min(chunk_size, jobs.size() - i) });
+	}
+
+	bool lazy_samples = state->lazy_samples;
+	QtConcurrent::blockingMap(chunks, [path, lazy_samples](divecomputer_chunk &chunk)
+				  { parse_divecomputer_chunk(path, lazy_samples, chunk); });
+
+	/* If a worker couldn't open the repository, parse its chunk here */
+	for (divecomputer_chunk &chunk: chunks) {
+		if (chunk.done)
+			continue;
+		for (const divecomputer_job *job = chunk.begin; job != chunk.end; ++job)
+			parse_divecomputer_job(state, *job);
+	}
 }
 
 /*
@@ -1807,17 +2154,143 @@ static int walk_tree_cb(const char *root, const git_tree_entry *entry, void *pay
 	struct git_parser_state *state = (git_parser_state *)payload;
 	git_filemode_t mode = git_tree_entry_filemode(entry);
 
+	if (!*root && git_is_shard_entry(entry)) {
+		state->shards.emplace_back(git_tree_entry_name(entry), *git_tree_entry_id(entry));
+		return GIT_WALK_OK;
+	}
+
+	/* Within a shard, the paths are relative to the year directory */
+	std::string path;
+	if (!state->root_prefix.empty()) {
+		path = state->root_prefix + root;
+		root = path.c_str();
+	}
+
 	if (mode == GIT_FILEMODE_TREE)
 		return walk_tree_directory(root, entry, state);
 
+	if (state->collect_dive_ids)
+		return GIT_WALK_OK;
 	walk_tree_file(root, entry, state);
 	/* Ignore failed blob loads */
 	return GIT_WALK_OK;
 }
 
+/*
+ * In the sharded layout (see save-git.cpp), the main tree links to one
+ * commit per year. The years are walked once the main tree, and thus the
+ * dive sites, were loaded. They are independent, so every year is walked
+ * with a parser state of its own, on the thread pool if there are a few.
+ */
+struct shard_job {
+	std::string name;
+	git_oid id;
+	struct git_parser_state state;
+	struct divelog log;	// collects the trips
+	bool done = false;
+};
+
+static void walk_shard(git_repository *repo, shard_job &job)
+{
+	git_commit *commit;
+	git_tree *tree;
+
+	job.done = true;
+	if (git_commit_lookup(&commit, repo, &job.id)) {
+		report_error("Unable to look up the dives of %s", job.name.c_str());
+		return;
+	}
+	if (git_commit_tree(&tree, commit)) {
+		git_commit_free(commit);
+		report_error("Could not look up the tree of the dives of %s", job.name.c_str());
+		return;
+	}
+	job.state.repo = repo;
+	job.state.root_prefix = job.name + "/";
+	git_tree_walk(tree, GIT_TREEWALK_PRE, walk_tree_cb, &job.state);
+	finish_active_dive(&job.state);
+	finish_active_trip(&job.state);
+	git_object_free((git_object *)tree);
+	git_commit_free(commit);
+}
+
+static void walk_shard_in_own_repo(const char *path, shard_job &job)
+{
+	git_repository *repo;
+
+	if (git_repository_open(&repo, path))
+		return;
+	walk_shard(repo, job);
+	job.state.repo = nullptr;
+	git_repository_free(repo);
+}
+
+static void load_shards(struct git_parser_state *state)
+{
+	if (state->shards.empty())
+		return;
+	finish_active_dive(state);
+	finish_active_trip(state);
+
+	std::vector<std::unique_ptr<shard_job>> jobs;
+	for (auto &[name, id]: state->shards) {
+		git_dive_id shard_id;
+		memcpy(shard_id.data(), id.id, 20);
+		if (state->skip_shards) {
+			auto it = state->skip_shards->find(shard_id);
+			if (it != state->skip_shards->end()) {
+				state->seen_dive_ids.insert(it->second.begin(), it->second.end());
+				continue;
+			}
+		}
+		auto job = std::make_unique<shard_job>();
+		job->name = name;
+		job->id = id;
+		job->state.log = &job->log;
+		job->state.defer_shared = true;
+		job->state.lazy_samples = state->lazy_samples;
+		job->state.collect_dive_ids = state->collect_dive_ids;
+		job->state.skip_dive_ids = state->skip_dive_ids;
+		jobs.push_back(std::move(job));
+	}
+	state->shards.clear();
+
+	const char *path = git_repository_path(state->repo);
+	if (jobs.size() > 1 && path && QThread::idealThreadCount() > 1)
+		QtConcurrent::blockingMap(jobs, [path](std::unique_ptr<shard_job> &job)
+					  { walk_shard_in_own_repo(path, *job); });
+
+	/* Merge in the order of the years. If a worker couldn't open the repository, walk its shard here */
+	for (auto &job: jobs) {
+		if (!job->done)
+			walk_shard(state->repo, *job);
+		git_parser_state &s = job->state;
+		for (auto [d, uuid]: s.site_refs) {
+			struct dive_site *ds = state->log->sites.get_by_uuid(uuid);
+			if (ds)
+				ds->add_dive(d);
+		}
+		for (auto &[d, tag]: s.tag_refs)
+			taglist_add_tag(d->tags, tag);
+		for (auto &trip: job->log.trips)
+			state->log->trips.put(std::move(trip));
+		job->log.trips.clear();
+		std::move(s.loaded_dives.begin(), s.loaded_dives.end(), std::back_inserter(state->loaded_dives));
+		state->dc_jobs.insert(state->dc_jobs.end(), s.dc_jobs.begin(), s.dc_jobs.end());
+		state->seen_dive_ids.insert(s.seen_dive_ids.begin(), s.seen_dive_ids.end());
+		if (state->collect_dive_ids) {
+			git_dive_id shard_id;
+			memcpy(shard_id.data(), job->id.id, 20);
+			state->dive_ids.insert(s.dive_ids.begin(), s.dive_ids.end());
+			state->shard_dive_ids[shard_id] = std::move(s.dive_ids);
+		}
+	}
+}
+
 static int load_dives_from_tree(git_repository *repo, git_tree *tree, struct git_parser_state *state)
 {
 	git_tree_walk(tree, GIT_TREEWALK_PRE, walk_tree_cb, state);
+	load_shards(state);
 	return 0;
 }
 
@@ -1877,6 +2350,56 @@ std::string get_sha(git_repository *repo, const std::string &branch)
 	return std::string(git_id_buffer);
 }
 
+/*
+ * Lazily loaded samples are parsed from the repository the logbook
+ * was read from. Keep our own handle, since the caller's git_info
+ * may be long gone when the samples are accessed.
+ */
+static std::string lazy_samples_path;
+static git_repository *lazy_samples_repo = nullptr;
+
+static void set_lazy_samples_repo(git_repository *repo)
+{
+	const char *path = git_repository_path(repo);
+	if (!path || lazy_samples_path == path)
+		return;
+	if (lazy_samples_repo)
+		git_repository_free(lazy_samples_repo);
+	lazy_samples_repo = nullptr;
+	lazy_samples_path = path;
+}
+
+/* Called by dive::get_dc() and dive::load_samples(), which serialize the calls. */
+void git_load_samples(const struct dive &dive, struct divecomputer &dc)
+{
+	git_blob *blob;
+	git_oid id;
+
+	if (!lazy_samples_repo && git_repository_open(&lazy_samples_repo, lazy_samples_path.c_str())) {
+		lazy_samples_repo = nullptr;
+		report_error("Unable to open git repository '%s' to load samples", lazy_samples_path.c_str());
+		return;
+	}
+	memcpy(id.id, dc.samples_id.data(), 20);
+	if (git_blob_lookup(&blob, lazy_samples_repo, &id)) {
+		report_error("Unable to read divecomputer file");
+		return;
+	}
+
+	struct git_parser_state state;
+	state.repo = lazy_samples_repo;
+	state.dc_dive = &dive;
+	state.active_dc = &dc;
+	/* Same logic as in parse_dive_cylinder() */
+	state.o2pressure_sensor = 1;
+	for (auto [idx, cyl]: enumerated_range(dive.cylinders)) {
+		if (cyl.cylinder_use == OXYGEN)
+			state.o2pressure_sensor = idx;
+	}
+	for_each_dc_line(blob, DC_PARSE_SAMPLES, &state);
+	git_blob_free(blob);
+}
+
 /*
  * Like git_save_dives(), this silently returns a negative
  * value if it's not a git repository at all (so that you
@@ -1887,15 +2410,95 @@ std::string get_sha(git_repository *repo, const std::string &branch)
  */
 int git_load_dives(struct git_info *info, struct divelog *log)
 {
+	TRACE_ZONE("git_load_dives");
 	int ret;
 	struct git_parser_state state;
+	summary_cache cache;
+	std::string sha, repo_path;
 	state.repo = info->repo;
 	state.log = log;
 
 	if (!info->repo)
 		return report_error("Unable to open git repository '%s[%s]'", info->url.c_str(), info->branch.c_str());
+
+	/*
+	 * Only parse the samples lazily if the values derived from
+	 * them were cached for this very commit.
+	 */
+	if (info->lazy_samples) {
+		sha = get_sha(info->repo, info->branch);
+		repo_path = git_repository_path(info->repo);
+		state.lazy_samples = log->dives.empty() && cache.read(repo_path, sha);
+	}
+	if (state.lazy_samples)
+		set_lazy_samples_repo(info->repo);
 	ret = do_git_load(info->repo, info->branch.c_str(), &state);
 	finish_active_dive(&state);
 	finish_active_trip(&state);
+	parse_divecomputer_jobs(&state);
+	log->dives.record_dives(std::move(state.loaded_dives));
+
+	if (state.lazy_samples && !cache.apply(log->dives)) {
+		report_info("git storage: summary cache doesn't match, loading all samples");
+		for (auto &d: log->dives) {
+			d->load_samples();
+			log->dives.fixup_dive(*d);
+		}
+	} else if (info->lazy_samples && !state.lazy_samples && !ret) {
+		summary_cache::write(repo_path, sha, log->dives);
+	}
 	return ret;
 }
+
+/*
+ * Load only what changed since the commit old_sha, typically after merging
+ * remote changes. Since the id of a dive directory is the hash of all its
+ * content, a dive whose directory id also exists in the old commit is
+ * unchanged and not parsed at all. The dive directories of the old commit
+ * that don't exist anymore are returned in "removed" (a modified dive shows
+ * up as removed and loaded). Dive sites are always loaded, they are cheap.
+ */
+int git_load_changed_dives(struct git_info *info, const std::string &old_sha, struct divelog *log, std::vector<git_dive_id> &removed)
+{
+	git_commit *old_commit;
+	git_tree *old_tree;
+	struct divelog scratch;
+	struct git_parser_state old_state;
+
+	removed.clear();
+	if (!info->repo)
+		return report_error("Unable to open git repository '%s[%s]'", info->url.c_str(), info->branch.c_str());
+	if (find_commit(info->repo, old_sha.c_str(), &old_commit))
+		return -1;
+	if (git_commit_tree(&old_tree, old_commit))
+		return report_error("Could not look up tree of commit '%s'", old_sha.c_str());
+	git_commit_free(old_commit);
+	old_state.repo = info->repo;
+	old_state.log = &scratch;
+	old_state.collect_dive_ids = true;
+	load_dives_from_tree(info->repo, old_tree, &old_state);
+	git_object_free((git_object *)old_tree);
+
+	struct git_parser_state state;
+	state.repo = info->repo;
+	state.log = log;
+	state.skip_dive_ids = &old_state.dive_ids;
+	state.skip_shards = &old_state.shard_dive_ids;
+	int ret = do_git_load(info->repo, info->branch.c_str(), &state);
+	finish_active_dive(&state);
+	finish_active_trip(&state);
+	parse_divecomputer_jobs(&state);
+	log->dives.record_dives(std::move(state.loaded_dives));
+	if (ret)
+		return ret;
+
+	std::set_difference(old_state.dive_ids.begin(), old_state.dive_ids.end(),
+			    state.seen_dive_ids.begin(), state.seen_dive_ids.end(),
+			    std::back_inserter(removed));
+
+	// Trips whose dives are all unchanged came out empty.
+	log->trips.erase(std::remove_if(log->trips.begin(), log->trips.end(),
+					[](const std::unique_ptr<dive_trip> &t) { return t->dives.empty(); }),
+			 log->trips.end());
+	return 0;
+}
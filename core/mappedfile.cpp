@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "mappedfile.h"
+#include "file.h"
+
+#include <QtGlobal>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if !defined(Q_OS_WIN) && !defined(Q_OS_ANDROID) && !defined(Q_OS_IOS)
+#define USE_MMAP
+#include <sys/mman.h>
+#endif
+
+/* Crazy windows sh*t */
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+mapped_file::mapped_file(const char *filename)
+{
+	struct stat st;
+	int fd;
+
+	fd = subsurface_open(filename, O_RDONLY | O_BINARY, 0);
+	if (fd < 0) {
+		err = fd;
+		return;
+	}
+	if (fstat(fd, &st) < 0) {
+		err = -1;
+	} else if (!S_ISREG(st.st_mode)) {
+		err = -EINVAL;
+	} else if (st.st_size) {
+		size = st.st_size;
+		// converting to int loses a bit but size will never be that big
+		err = (int)size;
+#ifdef USE_MMAP
+		void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			mem = (const char *)p;
+			mapped = true;
+		}
+#endif
+		if (!mapped) {
+			buffer.resize(size);
+			ssize_t ret = read(fd, buffer.data(), size);
+			if (ret < 0) {
+				err = ret;
+				buffer.clear();
+			} else if ((size_t)ret != size) {
+				errno = EIO;
+				err = -1;
+				buffer.clear();
+			}
+			mem = buffer.data();
+		}
+		if (err < 0)
+			size = 0;
+	}
+	close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+#ifdef USE_MMAP
+	if (mapped)
+		munmap((void *)mem, size);
+#endif
+}
+
+int mapped_file::status() const
+{
+	return err;
+}
+
+std::string_view mapped_file::data() const
+{
+	return std::string_view(mem, size);
+}
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-2.0
+// Read-only access to the contents of a file without copying it to the heap.
+// On desktop systems the file is memory-mapped, on mobile (and if mapping
+// fails) it is read into a buffer.
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+
+class mapped_file {
+public:
+	mapped_file(const char *filename);
+	~mapped_file();
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	// Same convention as readfile(): negative on error, 0 for an
+	// empty file and the size of the file otherwise.
+	int status() const;
+	std::string_view data() const; // Attn: not zero-terminated!
+private:
+	const char *mem = nullptr;
+	size_t size = 0;
+	bool mapped = false;
+	std::string buffer;
+	int err = 0;
+};
+
+#endif
@@ -8,27 +8,70 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 #include "units.h"
 #include "membuffer.h"
 
+/*
+ * Saving a dive log creates and destroys membuffers all the time, and
+ * every one of them would grow its buffer with a series of realloc()
+ * calls. Instead of freeing the storage, we keep a few buffers per
+ * thread around and hand them out to the next membuffer that needs
+ * room. Really big buffers are not worth keeping.
+ */
+#define MB_POOL_SIZE 8
+#define MB_POOL_MAX_ALLOC (1024 * 1024)
+
+struct membuffer_pool {
+	unsigned int nr = 0;
+	bool dead = false;
+	char *buffer[MB_POOL_SIZE];
+	unsigned int alloc[MB_POOL_SIZE];
+
+	~membuffer_pool()
+	{
+		while (nr)
+			free(buffer[--nr]);
+		dead = true;
+	}
+};
+
+static thread_local membuffer_pool pool;
+
+static void recycle_buffer(struct membuffer *b)
+{
+	if (b->buffer && !pool.dead && pool.nr < MB_POOL_SIZE && b->alloc <= MB_POOL_MAX_ALLOC) {
+		pool.buffer[pool.nr] = b->buffer;
+		pool.alloc[pool.nr] = b->alloc;
+		pool.nr++;
+	} else {
+		free(b->buffer);
+	}
+	b->buffer = NULL;
+	b->len = 0;
+	b->alloc = 0;
+}
+
 membuffer::membuffer()
 {
 }
 
 membuffer::~membuffer()
 {
-	free(buffer);
+	recycle_buffer(this);
 }
 
 void flush_buffer(struct membuffer *b, FILE *f)
 {
 	if (b->len) {
 		fwrite(b->buffer, 1, b->len, f);
-		free(b->buffer);
-		b->buffer = NULL;
-		b->len = 0;
-		b->alloc = 0;
+		recycle_buffer(b);
 	}
 }
 
@@ -53,6 +96,11 @@ static void oom()
 void make_room(struct membuffer *b, unsigned int size)
 {
 	unsigned int needed = b->len + size;
+	if (!b->buffer && pool.nr) {
+		pool.nr--;
+		b->buffer = pool.buffer[pool.nr];
+		b->alloc = pool.alloc[pool.nr];
+	}
 	if (needed > b->alloc) {
 		char *n;
 		/* round it up to not reallocate all the time.. */
@@ -131,6 +179,22 @@ void put_format(struct membuffer *b, const char *fmt, ...)
 	va_end(args);
 }
 
+/*
+ * Fast paths for the common number formats, so that we don't have to
+ * go through vsnprintf() for every depth, pressure and temperature.
+ */
+static void put_uint(struct membuffer *b, unsigned int v, int width)
+{
+	char buf[16], *p = buf + sizeof(buf);
+
+	do {
+		*--p = (v % 10) + '0';
+		v /= 10;
+		width--;
+	} while (v || width > 0);
+	put_bytes(b, p, buf + sizeof(buf) - p);
+}
+
 void put_milli(struct membuffer *b, const char *pre, int value, const char *post)
 {
 	int i;
@@ -154,7 +218,12 @@ void put_milli(struct membuffer *b, const char *pre, int value, const char *post
 			buf[1] = 0;
 	}
 
-	put_format(b, "%s%s%u.%s%s", pre, sign, v, buf, post);
+	put_string(b, pre);
+	put_string(b, sign);
+	put_uint(b, v, 0);
+	put_bytes(b, ".", 1);
+	put_string(b, buf);
+	put_string(b, post);
 }
 
 void put_temperature(struct membuffer *b, temperature_t temp, const char *pre, const char *post)
@@ -171,8 +240,13 @@ void put_depth(struct membuffer *b, depth_t depth, const char *pre, const char *
 
 void put_duration(struct membuffer *b, duration_t duration, const char *pre, const char *post)
 {
-	if (duration.seconds)
-		put_format(b, "%s%u:%02u%s", pre, FRACTION_TUPLE(duration.seconds, 60), post);
+	if (duration.seconds) {
+		put_string(b, pre);
+		put_uint(b, (unsigned)duration.seconds / 60, 0);
+		put_bytes(b, ":", 1);
+		put_uint(b, (unsigned)duration.seconds % 60, 2);
+		put_string(b, post);
+	}
 }
 
 void put_pressure(struct membuffer *b, pressure_t pressure, const char *pre, const char *post)
@@ -196,7 +270,12 @@ void put_degrees(struct membuffer *b, degrees_t value, const char *pre, const ch
 		udeg = -udeg;
 		sign = "-";
 	}
-	put_format(b, "%s%s%u.%06u%s", pre, sign, FRACTION_TUPLE(udeg, 1000000), post);
+	put_string(b, pre);
+	put_string(b, sign);
+	put_uint(b, (unsigned)udeg / 1000000, 0);
+	put_bytes(b, ".", 1);
+	put_uint(b, (unsigned)udeg % 1000000, 6);
+	put_string(b, post);
 }
 
 void put_location(struct membuffer *b, const location_t *loc, const char *pre, const char *post)
@@ -207,13 +286,90 @@ void put_location(struct membuffer *b, const location_t *loc, const char *pre, c
 	}
 }
 
+#if !defined(__SSE2__)
+static bool is_plain(char c, const char *specials)
+{
+	return (unsigned char)c >= ' ' && !strchr(specials, c);
+}
+#endif
+
+/*
+ * Skip the bytes that never have to be escaped: returns the first control
+ * character (including the terminating NUL) or byte of specials (at most
+ * eight) at or after p. All the quoting functions spend most of their time
+ * looking for the next character to escape, so look at 16 bytes at a time.
+ * The loads are aligned and therefore never cross a page boundary, even if
+ * they read past the end of the string.
+ */
+const char *skip_plain_text(const char *p, const char *specials)
+{
+#if defined(__SSE2__)
+	const __m128i minus_one = _mm_set1_epi8(-1);
+	const __m128i space = _mm_set1_epi8(' ');
+	__m128i special[8];
+	int nr = 0;
+
+	while (nr < 8 && specials[nr]) {
+		special[nr] = _mm_set1_epi8(specials[nr]);
+		nr++;
+	}
+
+	uintptr_t misalign = (uintptr_t)p & 15;
+	const char *block = p - misalign;
+	unsigned int mask = 0xffffu << misalign;
+	for (;;) {
+		__m128i v = _mm_load_si128((const __m128i *)block);
+		// Bytes 0 to 31 (the UTF-8 bytes >= 128 are negative)
+		__m128i hit = _mm_and_si128(_mm_cmpgt_epi8(v, minus_one), _mm_cmplt_epi8(v, space));
+		for (int i = 0; i < nr; i++)
+			hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, special[i]));
+		unsigned int bits = (unsigned int)_mm_movemask_epi8(hit) & mask;
+		if (bits)
+			return block + __builtin_ctz(bits);
+		block += 16;
+		mask = 0xffffu;
+	}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	const uint8x16_t space = vdupq_n_u8(' ');
+	uint8x16_t special[8];
+	int nr = 0;
+
+	while (nr < 8 && specials[nr]) {
+		special[nr] = vdupq_n_u8((uint8_t)specials[nr]);
+		nr++;
+	}
+
+	for (; (uintptr_t)p & 15; p++) {
+		if (!is_plain(*p, specials))
+			return p;
+	}
+	for (;; p += 16) {
+		uint8x16_t v = vld1q_u8((const uint8_t *)p);
+		uint8x16_t hit = vcltq_u8(v, space);
+		for (int i = 0; i < nr; i++)
+			hit = vorrq_u8(hit, vceqq_u8(v, special[i]));
+		if (vmaxvq_u8(hit))
+			break;
+	}
+	while (is_plain(*p, specials))
+		p++;
+	return p;
+#else
+	while (is_plain(*p, specials))
+		p++;
+	return p;
+#endif
+}
+
 void put_quoted(struct membuffer *b, const char *text, int is_attribute, int is_html)
 {
+	const char *specials = is_attribute ? "<>&'\"" : "<>&";
 	const char *p = text;
 
 	for (;text;) {
 		const char *escape;
 
+		p = skip_plain_text(p, specials);
 		switch (*p++) {
 		default:
 			continue;
@@ -47,6 +47,7 @@ extern void flush_buffer(struct membuffer *, FILE *);
 extern void put_bytes(struct membuffer *, const char *, int);
 extern void put_string(struct membuffer *, const char *);
 extern void put_quoted(struct membuffer *, const char *, int, int);
+extern const char *skip_plain_text(const char *, const char *);
 extern void strip_mb(struct membuffer *);
 
 /* The pointer obtained by mb_cstring is invalidated by any modifictation to the membuffer! */
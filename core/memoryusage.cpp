@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "memoryusage.h"
+#include "dive.h"
+#include "divelog.h"
+#include "errorhelper.h"
+#include "event.h"
+#include "extradata.h"
+#include "fulltext.h"
+#include "profile.h"
+#include "sample.h"
+
+std::vector<memory_usage> get_memory_usage()
+{
+	size_t dives = 0, samples = 0, packed_samples = 0, events = 0, extra_data = 0;
+
+	for (auto &d: divelog.dives) {
+		dives += sizeof(*d) + d->cylinders.capacity() * sizeof(d->cylinders[0]) +
+			 d->weightsystems.capacity() * sizeof(d->weightsystems[0]) +
+			 d->dcs.capacity() * sizeof(d->dcs[0]);
+		for (const divecomputer &dc: d->dcs) {
+			samples += dc.samples.capacity() * sizeof(dc.samples[0]);
+			packed_samples += dc.packed_samples.capacity();
+			events += dc.events.capacity() * sizeof(dc.events[0]);
+			for (const event &ev: dc.events)
+				events += ev.name.capacity();
+			extra_data += dc.extra_data.capacity() * sizeof(dc.extra_data[0]);
+			for (const struct extra_data &ed: dc.extra_data)
+				extra_data += ed.key.capacity() + ed.value.capacity();
+		}
+	}
+
+	return {
+		{ "dives", dives },
+		{ "samples", samples },
+		{ "packed samples", packed_samples },
+		{ "events", events },
+		{ "extra data", extra_data },
+		{ "fulltext index", fulltext_memory_usage() },
+		{ "plot info cache", plot_info_cache_memory_usage() }
+	};
+}
+
+void report_memory_usage()
+{
+	size_t total = 0;
+	for (const memory_usage &usage: get_memory_usage()) {
+		report_info("memory usage: %-16s %10zu kB", usage.subsystem, usage.bytes / 1024);
+		total += usage.bytes;
+	}
+	report_info("memory usage: %-16s %10zu kB", "total", total / 1024);
+}
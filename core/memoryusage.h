@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: GPL-2.0
+// Rough accounting of the memory used by the big data structures of the
+// dive log. Meant for diagnostics: the numbers count the payload of the
+// containers, not the allocator overhead.
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <stddef.h>
+#include <vector>
+
+struct memory_usage {
+	const char *subsystem;
+	size_t bytes;
+};
+
+extern std::vector<memory_usage> get_memory_usage();
+extern void report_memory_usage(); // Writes the numbers to the log via report_info()
+
+#endif
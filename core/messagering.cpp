@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0
+// The queue follows Dmitry Vyukov's bounded MPMC queue: every slot carries
+// a sequence number, which tells the producers whether the slot is free
+// and the consumer whether the message was completely written.
+#include "messagering.h"
+
+#include <unordered_map>
+
+MessageRing::MessageRing(size_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity)
+		size *= 2;
+	slots = std::make_unique<Slot[]>(size);
+	mask = size - 1;
+	for (size_t i = 0; i < size; ++i)
+		slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool MessageRing::push(int level, std::string text)
+{
+	size_t pos = head.load(std::memory_order_relaxed);
+	Slot *slot;
+	for (;;) {
+		slot = &slots[pos & mask];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+		if (diff == 0) {
+			if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			// Full: the consumer is already behind
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return !pending.exchange(true, std::memory_order_acq_rel);
+		} else {
+			pos = head.load(std::memory_order_relaxed);
+		}
+	}
+	slot->level = level;
+	slot->text = std::move(text);
+	slot->sequence.store(pos + 1, std::memory_order_release);
+	return !pending.exchange(true, std::memory_order_acq_rel);
+}
+
+std::vector<MessageRing::Message> MessageRing::drain(int &droppedOut)
+{
+	std::lock_guard<std::mutex> guard(drainLock);
+
+	// Reset the flag first: a message pushed from now on wakes up the
+	// consumer again. The exchange also makes the messages of the
+	// producers that saw the flag set visible.
+	pending.exchange(false, std::memory_order_acq_rel);
+	droppedOut = dropped.exchange(0, std::memory_order_relaxed);
+
+	std::vector<Message> res;
+	std::unordered_map<std::string, size_t> seen;	// text -> index in res
+	for (;;) {
+		Slot &slot = slots[tail & mask];
+		if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+			break;
+		auto it = seen.find(slot.text);
+		if (it != seen.end() && res[it->second].level == slot.level) {
+			++res[it->second].count;
+			slot.text.clear();
+		} else {
+			seen.emplace(slot.text, res.size());
+			res.push_back({ slot.level, std::move(slot.text), 1 });
+		}
+		slot.sequence.store(tail + mask + 1, std::memory_order_release);
+		++tail;
+	}
+	return res;
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0
+// Bounded queue of log and error messages, filled by any number of threads
+// and drained in batches by the UI.
+//
+// Pushing doesn't take a lock, so that a parser on a worker thread
+// can report thousands of problems without contending with the UI.
+// Only the first message after a drain asks for the consumer to be woken
+// up, thus the UI gets at most one event per batch. If the consumer
+// can't keep up, the excess messages are dropped and counted. Draining
+// collapses identical messages of a batch into one, with a count.
+#ifndef MESSAGERING_H
+#define MESSAGERING_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class MessageRing {
+public:
+	struct Message {
+		int level;
+		std::string text;
+		int count;		// Number of identical messages in the batch
+	};
+
+	// The capacity is rounded up to a power of two.
+	MessageRing(size_t capacity);
+
+	// Can be called from any thread. Returns true if this is the first
+	// message since the last drain, i.e. if the consumer should be woken up.
+	bool push(int level, std::string text);
+
+	// Returns the queued messages in order of their first occurrence and
+	// the number of messages that were dropped because the queue was full.
+	std::vector<Message> drain(int &dropped);
+private:
+	struct Slot {
+		std::atomic<size_t> sequence;
+		int level;
+		std::string text;
+	};
+	std::unique_ptr<Slot[]> slots;
+	size_t mask;
+	std::atomic<size_t> head { 0 };		// Next slot to be written
+	size_t tail = 0;			// Next slot to be read, protected by drainLock
+	std::atomic<bool> pending { false };	// The consumer was asked to drain
+	std::atomic<int> dropped { 0 };
+	std::mutex drainLock;			// One consumer at a time
+};
+
+#endif
@@ -7,6 +7,9 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <algorithm>
 #ifdef LIBRAW_SUPPORT
 #include <libraw/libraw.h>
 #endif
@@ -68,13 +71,50 @@ static inline T getLE(QFile &f, T def=0)
 	return getLE<T>(buf);
 }
 
+// Size of the reads when parsing JPEG files. For practically all files,
+// the EXIF segment is found in the first chunk, so that a single read
+// suffices even for huge pictures on slow network shares.
+static const qint64 jpeg_chunk_size = 64 * 1024;
+
+// Gives access to a file through a buffer of at least jpeg_chunk_size bytes,
+// which is only refilled if a range outside of the buffer is accessed.
+class chunked_reader {
+	QFile &f;
+	QByteArray buf;
+	qint64 start = 0;
+public:
+	chunked_reader(QFile &fIn) : f(fIn)
+	{
+	}
+	// Returns a pointer to the size bytes at position pos or null on IO error.
+	const char *get(qint64 pos, qint64 size)
+	{
+		if (pos < start || pos + size > start + buf.size()) {
+			if (!f.seek(pos))
+				return nullptr;
+			buf = f.read(std::max(size, jpeg_chunk_size));
+			start = pos;
+			if (buf.size() < size)
+				return nullptr;
+		}
+		return buf.constData() + (pos - start);
+	}
+};
+
 static bool parseExif(QFile &f, struct metadata *metadata)
 {
-	f.seek(0);
-	if (getBE<uint16_t>(f) != 0xffd8)
+	chunked_reader reader(f);
+	const char *p = reader.get(0, 2);
+	if (!p || getBE<uint16_t>(p) != 0xffd8)
 		return false;
+	qint64 pos = 2;
 	for (;;) {
-		switch (getBE<uint16_t>(f)) {
+		// Each segment starts with a marker followed by the length of the segment,
+		// which includes the length field, but not the marker.
+		if (!(p = reader.get(pos, 4)))
+			return false;
+		uint16_t len = getBE<uint16_t>(p + 2);
+		switch (getBE<uint16_t>(p)) {
 		case 0xffc0:
 		case 0xffc2:
 		case 0xffc4:
@@ -84,22 +124,20 @@ static bool parseExif(QFile &f, struct metadata *metadata)
 		case 0xffe0:
 		case 0xffe2 ... 0xffef:
 		case 0xfffe: {
-			uint16_t len = getBE<uint16_t>(f);
 			if (len < 2)
 				return false;
-			f.seek(f.pos() + len - 2); // TODO: switch to QFile::skip()
+			pos += 2 + len;
 			break;
 		}
 		case 0xffe1: {
-			uint16_t len = getBE<uint16_t>(f);
 			if (len < 2)
 				return false;
 			len -= 2;
-			QByteArray data = f.read(len);
-			if (data.size() != len)
+			const char *data = reader.get(pos + 4, len);
+			if (!data)
 				return false;
 			easyexif::EXIFInfo exif;
-			if (exif.parseFromEXIFSegment(reinterpret_cast<const unsigned char *>(data.constData()), len) != PARSE_EXIF_SUCCESS)
+			if (exif.parseFromEXIFSegment(reinterpret_cast<const unsigned char *>(data), len) != PARSE_EXIF_SUCCESS)
 				return false;
 			metadata->location = create_location(exif.GeoLocation.Latitude, exif.GeoLocation.Longitude);
 			metadata->timestamp = exif.epoch();
@@ -563,27 +601,31 @@ static bool parseRaw(const char *fn, metadata *metadata)
 }
 #endif
 
-mediatype_t get_metadata(const char *filename_in, metadata *data)
+static mediatype_t read_metadata(const char *filename_in, const QString &filename, metadata *data)
 {
 	data->timestamp = 0;
 	data->duration = 0_sec;
 	data->location.lat.udeg = 0;
 	data->location.lon.udeg = 0;
 
+	QFile f(filename);
+	bool opened = f.open(QIODevice::ReadOnly);
+
+	// Try JPEG first: it is by far the most common format and LibRaw would
+	// needlessly parse the file before giving up on it.
+	if (opened && parseExif(f, data))
+		return MEDIATYPE_PICTURE;
+
 #ifdef LIBRAW_SUPPORT
 	if (parseRaw(filename_in, data))
 		return MEDIATYPE_PICTURE;
 #endif
 
-	QString filename = localFilePath(QString(filename_in));
-	QFile f(filename);
-	if (!f.open(QIODevice::ReadOnly))
+	if (!opened)
 		return MEDIATYPE_IO_ERROR;
 
 	mediatype_t res = MEDIATYPE_UNKNOWN;
-	if (parseExif(f, data))
-		res = MEDIATYPE_PICTURE;
-	else if(parseMP4(f, data))
+	if(parseMP4(f, data))
 		res = MEDIATYPE_VIDEO;
 	else if(parseAVI(f, data))
 		res = MEDIATYPE_VIDEO;
@@ -601,6 +643,44 @@ mediatype_t get_metadata(const char *filename_in, metadata *data)
 	return res;
 }
 
+// The metadata of the files we have seen, keyed by filename and
+// checked against the modification time and size of the file.
+// Thus, matching the same pictures again doesn't touch their contents.
+struct metadata_cache_entry {
+	QDateTime mtime;
+	qint64 size;
+	mediatype_t type;
+	metadata data;
+};
+static QMutex metadata_cache_lock;
+static QHash<QString, metadata_cache_entry> metadata_cache;
+
+mediatype_t get_metadata(const char *filename_in, metadata *data)
+{
+	QString filename = localFilePath(QString(filename_in));
+	QFileInfo info(filename);
+	if (!info.exists())
+		return read_metadata(filename_in, filename, data);
+	QDateTime mtime = info.lastModified();
+	qint64 size = info.size();
+
+	{
+		QMutexLocker l(&metadata_cache_lock);
+		auto it = metadata_cache.constFind(filename);
+		if (it != metadata_cache.cend() && it->mtime == mtime && it->size == size) {
+			*data = it->data;
+			return it->type;
+		}
+	}
+
+	mediatype_t res = read_metadata(filename_in, filename, data);
+	if (res != MEDIATYPE_IO_ERROR) {
+		QMutexLocker l(&metadata_cache_lock);
+		metadata_cache.insert(filename, { mtime, size, res, *data });
+	}
+	return res;
+}
+
 timestamp_t picture_get_timestamp(const char *filename)
 {
 	struct metadata data;
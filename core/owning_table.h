@@ -104,6 +104,26 @@ public:
 		}
 		return { pull_at(idx), idx };
 	}
+	// Remove multiple items in a single pass over the table, instead of
+	// moving the tail of the table for every item. Returns the removed
+	// items in the order of the table. Unknown items are ignored.
+	std::vector<std::unique_ptr<T>> pull_multiple(std::vector<const T *> items) {
+		std::sort(items.begin(), items.end());
+		std::vector<std::unique_ptr<T>> res;
+		res.reserve(items.size());
+		auto to = this->begin();
+		for (auto it = this->begin(); it != this->end(); ++it) {
+			if (std::binary_search(items.begin(), items.end(), it->get())) {
+				res.push_back(std::move(*it));
+				continue;
+			}
+			if (to != it)
+				*to = std::move(*it);
+			++to;
+		}
+		this->erase(to, this->end());
+		return res;
+	}
 };
 
 // Note: there must not be any elements that compare equal!
@@ -125,6 +145,18 @@ public:
 		return { ptr, idx };
 	}
 
+	// Add multiple items at once. The items are sorted and then merged
+	// into the table, instead of moving the tail of the table for every item.
+	void put_multiple(std::vector<std::unique_ptr<T>> items) {
+		auto cmp = [](const auto &i1, const auto &i2) { return CMP(*i1, *i2) < 0; };
+		std::sort(items.begin(), items.end(), cmp);
+		size_t old_size = this->size();
+		this->reserve(old_size + items.size());
+		for (auto &item: items)
+			this->push_back(std::move(item));
+		std::inplace_merge(this->begin(), this->begin() + old_size, this->end(), cmp);
+	}
+
 	// Optimized version of get_idx(), which uses binary search
 	// If not found, fall back to linear search and emit a warning.
 	// Note: this is probaly slower than a linesr search. But for now,
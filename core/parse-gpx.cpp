@@ -5,22 +5,18 @@
 #include "core/namecmp.h"
 #include <QFile>
 #include <QXmlStreamReader>
+#include <algorithm>
+#include <cmath>
 
-// Find the coordinates at the time specified in coords.start_dive
-// by searching the gpx file "fileName". Here is a typical trkpt element in GPX:
+// Read the track points of the gpx file "fileName". Here is a typical trkpt element in GPX:
 // <trkpt lat="-26.84" lon="32.88"><ele>-53.7</ele><time>2017-08-06T04:56:42Z</time></trkpt>
-int getCoordsFromGPXFile(struct dive_coords *coords, const QString &fileName)
+// The file is read as a stream, only the location and time of each trkpt is kept.
+int readGPXFile(gpx_track &track, const QString &fileName)
 {
 	struct tm tm1;
-	time_t trkpt_time = 0;
-	time_t divetime;
-	int64_t time_offset = coords->settingsDiff_offset + coords->timeZone_offset;
 	double lon = 0, lat = 0;
-	int line = 0;
-	bool first_line = true;
-	bool found = false;
-	bool trkpt_found = false;
-	divetime = coords->start_dive;
+	bool in_trkpt = false;
+	track.clear();
 	QFile gpxFile;
 	gpxFile.setFileName(fileName);
 	if (!gpxFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
@@ -30,32 +26,18 @@ int getCoordsFromGPXFile(struct dive_coords *coords, const QString &fileName)
 		return 1;
 	}
 
-#ifdef GPSDEBUG
-	struct tm time; // decode the time of start of dive:
-	utc_mkdate(divetime, &time);
-	int dyr,dmon,dday,dhr,dmin;
-	dyr = time.tm_year;
-	dmon = time.tm_mon;
-	dday = time.tm_mday;
-	dhr = time.tm_hour;
-	dmin = time.tm_min;
-#endif
-
 	QXmlStreamReader gpxReader(&gpxFile);
 	while (!gpxReader.atEnd()) {
 		gpxReader.readNext();
-		if (gpxReader.isStartElement()) {
+		if (gpxReader.isEndElement() && nameCmp(gpxReader, "trkpt") == 0) {
+			in_trkpt = false;
+		} else if (gpxReader.isStartElement()) {
 			if (nameCmp(gpxReader, "trkpt") == 0) {
-				trkpt_found = true;
-				line++;
-				for (const QXmlStreamAttribute &attr: gpxReader.attributes()) {
-					if (attr.name().toString() == QLatin1String("lat"))
-						lat = attr.value().toString().toDouble();
-					else if (attr.name().toString() == QLatin1String("lon"))
-						lon = attr.value().toString().toDouble();
-				}
-			}
-			if (nameCmp(gpxReader, "time") == 0 && trkpt_found) {  // Ignore the <time> element in the GPX file header
+				in_trkpt = true;
+				QXmlStreamAttributes attributes = gpxReader.attributes();
+				lat = attributes.value(QLatin1String("lat")).toDouble();
+				lon = attributes.value(QLatin1String("lon")).toDouble();
+			} else if (nameCmp(gpxReader, "time") == 0 && in_trkpt) {  // Ignore the <time> element in the GPX file header
 				QString dateTimeString = gpxReader.readElementText();
 				bool ok;
 				tm1.tm_year = dateTimeString.left(4).toInt(&ok, 10);  // Extract the date/time components:
@@ -64,27 +46,51 @@ int getCoordsFromGPXFile(struct dive_coords *coords, const QString &fileName)
 				tm1.tm_hour = dateTimeString.mid(11,2).toInt(&ok,10);
 				tm1.tm_min  = dateTimeString.mid(14,2).toInt(&ok,10);
 				tm1.tm_sec  = dateTimeString.mid(17,2).toInt(&ok,10);
-				trkpt_time = utc_mktime(&tm1) + time_offset;
-				if (first_line) {
-					first_line = false;
-					coords->start_track = trkpt_time;   // Local time of start of GPS track
-				}
-				if (trkpt_time >= divetime && found == false) {   // This GPS local time corresponds to the start time of the dive
-					coords->lon = lon; // save the coordinates
-					coords->lat = lat;
-					found = true;
-				}
-
-#ifdef GPSDEBUG
-				utc_mkdate(trkpt_time, &time); // print coordinates and time of each trkpt element of the GPX file as well as dive start time
-				report_info(" %02d: lat=%f lon=%f timestamp=%ld (%ld) %02d/%02d/%02d %02d:%02d  dt=%ld  %02d/%02d/%02d %02d:%02d", line, lat,
-				lon, trkpt_time, time_offset, time.tm_year, time.tm_mon+1, time.tm_mday, time.tm_hour, time.tm_min, divetime, dyr, dmon+1, dday,dhr, dmin);
-#endif
-
+				track.push_back({ utc_mktime(&tm1), (int32_t)lrint(lat * 1000000), (int32_t)lrint(lon * 1000000) });
 			}
 		}
 	} // while !at.End() // This loop executes until EOF causes a break out of the loop
-	coords->end_track = trkpt_time;  // This is the local time of the end of the GPS track
 	gpxFile.close();
+
+	// Tracks are written in chronological order. Make sure nonetheless, so that we can bisect.
+	if (!std::is_sorted(track.begin(), track.end(), [](const gpx_point &p1, const gpx_point &p2) { return p1.time < p2.time; }))
+		std::stable_sort(track.begin(), track.end(), [](const gpx_point &p1, const gpx_point &p2) { return p1.time < p2.time; });
+	track.shrink_to_fit();
+	return 0;
+}
+
+// Find the coordinates at the time specified in coords.start_dive,
+// i.e. of the first track point at or after the start of the dive.
+void getCoordsFromGPXTrack(struct dive_coords *coords, const gpx_track &track)
+{
+	int64_t time_offset = coords->settingsDiff_offset + coords->timeZone_offset;
+	if (track.empty()) {
+		coords->end_track = 0;
+		return;
+	}
+	coords->start_track = track.front().time + time_offset;   // Local time of start of GPS track
+	coords->end_track = track.back().time + time_offset;      // This is the local time of the end of the GPS track
+
+	auto it = std::lower_bound(track.begin(), track.end(), (int64_t)coords->start_dive - time_offset,
+				   [](const gpx_point &p, int64_t t) { return p.time < t; });
+	if (it != track.end()) {   // This GPS local time corresponds to the start time of the dive
+		coords->lat = it->lat_udeg / 1000000.0; // save the coordinates
+		coords->lon = it->lon_udeg / 1000000.0;
+	}
+
+#ifdef GPSDEBUG
+	struct tm time;
+	utc_mkdate(coords->start_dive, &time);
+	report_info("dive start %02d/%02d/%02d %02d:%02d: %ld of %ld track points before, lat=%f lon=%f", time.tm_year, time.tm_mon + 1,
+		    time.tm_mday, time.tm_hour, time.tm_min, (long)(it - track.begin()), (long)track.size(), coords->lat, coords->lon);
+#endif
+}
+
+int getCoordsFromGPXFile(struct dive_coords *coords, const QString &fileName)
+{
+	gpx_track track;
+	if (readGPXFile(track, fileName))
+		return 1;
+	getCoordsFromGPXTrack(coords, track);
 	return 0;
 }
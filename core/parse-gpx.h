@@ -3,6 +3,8 @@
 #define PARSE_GPX_H
 
 #include <QString>
+#include <stdint.h>
+#include <vector>
 
 struct dive_coords {         // This structure holds important information after parsing the GPX file:
 	time_t start_dive;            // Start time of the current dive, obtained using current_dive (local time)
@@ -15,6 +17,17 @@ struct dive_coords {         // This structure holds important information after
 	int64_t timeZone_offset;      // UTC international time zone offset of dive site
 };
 
+// Only the timestamped track points of a GPX file are kept, in a compact
+// form: tracks of a whole week have hundreds of thousands of them.
+struct gpx_point {
+	int64_t time;                 // UTC, as in the file
+	int32_t lat_udeg;
+	int32_t lon_udeg;
+};
+using gpx_track = std::vector<gpx_point>;  // Sorted by time
+
+int readGPXFile(gpx_track &track, const QString &fileName);
+void getCoordsFromGPXTrack(dive_coords *coords, const gpx_track &track);
 int getCoordsFromGPXFile(dive_coords *coords, const QString &fileName);
 
 #endif
@@ -10,11 +10,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
+#include <array>
 #include <libxml/parser.h>
 #include <libxml/parserInternals.h>
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
 #include <libxslt/transform.h>
 #include <libdivecomputer/parser.h>
+#include <zlib.h>
 
 #include "gettext.h"
 
@@ -22,6 +25,7 @@
 #include "divelog.h"
 #include "divesite.h"
 #include "errorhelper.h"
+#include "git-access.h"
 #include "parse.h"
 #include "format.h"
 #include "subsurface-float.h"
@@ -781,173 +785,222 @@ static void try_to_fill_event(const char *name, char *buf, struct parser_state *
 	nonmatch("event", name, buf);
 }
 
-static int match_dc_data_fields(struct divecomputer *dc, const char *name, char *buf, struct parser_state *state)
+/*
+ * For the most common elements, the names are dispatched through perfect
+ * hash tables generated at compile time instead of chains of MATCH() calls.
+ * A name "a.b" is looked up as "a.b" and then as "a", which gives the same
+ * result as the MATCH() chains did, since the build checks that no pattern
+ * "a" shadows a later pattern "a.b" (that would be an unreachable entry).
+ *
+ * The match functions return false if they can't handle the value, e.g.
+ * cylinder data without a cylinder, so that the name is matched further.
+ */
+template <typename T>
+struct name_match {
+	const char *pattern;
+	bool (*fn)(T *, char *buf, struct parser_state *state);
+};
+
+#define NAME_MATCH(type, pattern, ...) \
+	{ pattern, []([[maybe_unused]] type *obj, [[maybe_unused]] char *buf, [[maybe_unused]] struct parser_state *state) -> bool { __VA_ARGS__; return true; } }
+
+static constexpr size_t name_length(const char *s)
 {
-	if (MATCH_STATE("maxdepth", depth, &dc->maxdepth))
-		return 1;
-	if (MATCH_STATE("meandepth", depth, &dc->meandepth))
-		return 1;
-	if (MATCH_STATE("max.depth", depth, &dc->maxdepth))
-		return 1;
-	if (MATCH_STATE("mean.depth", depth, &dc->meandepth))
-		return 1;
-	if (MATCH("duration", duration, &dc->duration))
-		return 1;
-	if (MATCH("divetime", duration, &dc->duration))
-		return 1;
-	if (MATCH("divetimesec", duration, &dc->duration))
-		return 1;
-	if (MATCH("last-manual-time", duration, &dc->last_manual_time))
-		return 1;
-	if (MATCH("surfacetime", duration, &dc->surfacetime))
-		return 1;
-	if (MATCH_STATE("airtemp", temperature, &dc->airtemp))
-		return 1;
-	if (MATCH_STATE("watertemp", temperature, &dc->watertemp))
-		return 1;
-	if (MATCH_STATE("air.temperature", temperature, &dc->airtemp))
-		return 1;
-	if (MATCH_STATE("water.temperature", temperature, &dc->watertemp))
-		return 1;
-	if (MATCH_STATE("pressure.surface", pressure, &dc->surface_pressure))
-		return 1;
-	if (MATCH("salinity.water", salinity, &dc->salinity))
-		return 1;
-	if (MATCH("key.extradata", utf8_string_std, &state->cur_extra_data.key))
-		return 1;
-	if (MATCH("value.extradata", utf8_string_std, &state->cur_extra_data.value))
-		return 1;
-	if (MATCH("divemode", get_dc_type, &dc->divemode))
-		return 1;
-	if (MATCH("salinity", salinity, &dc->salinity))
-		return 1;
-	if (MATCH_STATE("atmospheric", pressure, &dc->surface_pressure))
-		return 1;
-	return 0;
+	size_t len = 0;
+	while (s[len])
+		len++;
+	return len;
+}
+
+/* FNV-1a */
+static constexpr uint32_t name_hash(const char *name, size_t len, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ seed;
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char)name[i]) * 16777619u;
+	return h;
+}
+
+/* The compile time version of match_name() */
+static constexpr bool name_matches(const char *pattern, const char *name)
+{
+	while (*pattern == *name && *pattern) {
+		pattern++;
+		name++;
+	}
+	return *pattern == '\0' && (*name == '\0' || *name == '.');
 }
 
+template <typename T, size_t N>
+struct name_match_table {
+	struct bucket {
+		const char *pattern = nullptr;
+		size_t len = 0;
+		bool (*fn)(T *, char *buf, struct parser_state *state) = nullptr;
+	};
+	static constexpr size_t size = [] { size_t s = 1; while (s < 4 * N) s *= 2; return s; }();
+
+	std::array<bucket, size> buckets;
+	uint32_t seed = 0;
+	bool valid = false;
+
+	bool match_len(T *obj, const char *name, size_t len, char *buf, struct parser_state *state) const
+	{
+		const bucket &s = buckets[name_hash(name, len, seed) & (size - 1)];
+		return s.len == len && !memcmp(s.pattern, name, len) && s.fn(obj, buf, state);
+	}
+
+	bool match(T *obj, const char *name, char *buf, struct parser_state *state) const
+	{
+		size_t len = strlen(name);
+		if (match_len(obj, name, len, buf, state))
+			return true;
+		const char *dot = (const char *)memchr(name, '.', len);
+		return dot && match_len(obj, name, dot - name, buf, state);
+	}
+
+	/* No name may be matched by both tables, so that the order doesn't matter */
+	template <typename T2, size_t N2>
+	constexpr bool disjoint(const name_match_table<T2, N2> &other) const
+	{
+		for (const bucket &a: buckets) {
+			for (const auto &b: other.buckets) {
+				if (a.pattern && b.pattern && (name_matches(a.pattern, b.pattern) || name_matches(b.pattern, a.pattern)))
+					return false;
+			}
+		}
+		return true;
+	}
+};
+
+template <typename T, size_t N>
+static constexpr name_match_table<T, N> make_name_match_table(const name_match<T> (&list)[N])
+{
+	for (size_t i = 0; i < N; i++) {
+		for (size_t j = i + 1; j < N; j++) {
+			if (name_matches(list[i].pattern, list[j].pattern))
+				return {};
+		}
+	}
+	for (uint32_t seed = 0; seed < 10000; seed++) {
+		name_match_table<T, N> res;
+		res.seed = seed;
+		res.valid = true;
+		for (const name_match<T> &m: list) {
+			size_t len = name_length(m.pattern);
+			auto &bucket = res.buckets[name_hash(m.pattern, len, seed) & (res.size - 1)];
+			if (bucket.fn) {
+				res.valid = false;
+				break;
+			}
+			bucket = { m.pattern, len, m.fn };
+		}
+		if (res.valid)
+			return res;
+	}
+	return {};
+}
+
+#define DC_MATCH(pattern, ...) NAME_MATCH(struct divecomputer, pattern, [[maybe_unused]] struct divecomputer *dc = obj; __VA_ARGS__)
+static constexpr name_match<struct divecomputer> dc_data_fields[] = {
+	DC_MATCH("maxdepth", depth(buf, &dc->maxdepth, state)),
+	DC_MATCH("meandepth", depth(buf, &dc->meandepth, state)),
+	DC_MATCH("max.depth", depth(buf, &dc->maxdepth, state)),
+	DC_MATCH("mean.depth", depth(buf, &dc->meandepth, state)),
+	DC_MATCH("duration", duration(buf, &dc->duration)),
+	DC_MATCH("divetime", duration(buf, &dc->duration)),
+	DC_MATCH("divetimesec", duration(buf, &dc->duration)),
+	DC_MATCH("last-manual-time", duration(buf, &dc->last_manual_time)),
+	DC_MATCH("surfacetime", duration(buf, &dc->surfacetime)),
+	DC_MATCH("airtemp", temperature(buf, &dc->airtemp, state)),
+	DC_MATCH("watertemp", temperature(buf, &dc->watertemp, state)),
+	DC_MATCH("air.temperature", temperature(buf, &dc->airtemp, state)),
+	DC_MATCH("water.temperature", temperature(buf, &dc->watertemp, state)),
+	DC_MATCH("pressure.surface", pressure(buf, &dc->surface_pressure, state)),
+	DC_MATCH("salinity.water", salinity(buf, &dc->salinity)),
+	DC_MATCH("key.extradata", utf8_string_std(buf, &state->cur_extra_data.key)),
+	DC_MATCH("value.extradata", utf8_string_std(buf, &state->cur_extra_data.value)),
+	DC_MATCH("divemode", get_dc_type(buf, &dc->divemode)),
+	DC_MATCH("salinity", salinity(buf, &dc->salinity)),
+	DC_MATCH("atmospheric", pressure(buf, &dc->surface_pressure, state))
+};
+static constexpr auto dc_data_matches = make_name_match_table(dc_data_fields);
+static_assert(dc_data_matches.valid, "divecomputer data fields can't be hashed");
+
+static constexpr name_match<struct divecomputer> dc_fields[] = {
+	DC_MATCH("date", divedate(buf, &dc->when, state)),
+	DC_MATCH("time", divetime(buf, &dc->when, state)),
+	DC_MATCH("model", utf8_string_std(buf, &dc->model)),
+	DC_MATCH("deviceid", uint32_t deviceid; hex_value(buf, &deviceid)),
+	DC_MATCH("diveid", hex_value(buf, &dc->diveid)),
+	DC_MATCH("dctype", get_dc_type(buf, &dc->divemode)),
+	DC_MATCH("no_o2sensors", get_uint8(buf, &dc->no_o2sensors))
+};
+static constexpr auto dc_matches = make_name_match_table(dc_fields);
+static_assert(dc_matches.valid && dc_matches.disjoint(dc_data_matches), "divecomputer fields can't be hashed");
+
 /* We're in the top-level dive xml. Try to convert whatever value to a dive value */
 static void try_to_fill_dc(struct divecomputer *dc, const char *name, char *buf, struct parser_state *state)
 {
-	unsigned int deviceid;
-
 	start_match("divecomputer", name, buf);
 
-	if (MATCH_STATE("date", divedate, &dc->when))
-		return;
-	if (MATCH_STATE("time", divetime, &dc->when))
-		return;
-	if (MATCH("model", utf8_string_std, &dc->model))
-		return;
-	if (MATCH("deviceid", hex_value, &deviceid))
-		return;
-	if (MATCH("diveid", hex_value, &dc->diveid))
-		return;
-	if (MATCH("dctype", get_dc_type, &dc->divemode))
+	if (dc_matches.match(dc, name, buf, state))
 		return;
-	if (MATCH("no_o2sensors", get_uint8, &dc->no_o2sensors))
-		return;
-	if (match_dc_data_fields(dc, name, buf, state))
+	if (dc_data_matches.match(dc, name, buf, state))
 		return;
 
 	nonmatch("divecomputer", name, buf);
 }
 
+#define SAMPLE_MATCH(pattern, ...) NAME_MATCH(struct sample, pattern, [[maybe_unused]] struct sample *sample = obj; __VA_ARGS__)
+static constexpr name_match<struct sample> sample_fields[] = {
+	SAMPLE_MATCH("pressure.sample", pressure(buf, &sample->pressure[0], state)),
+	SAMPLE_MATCH("cylpress.sample", pressure(buf, &sample->pressure[0], state)),
+	SAMPLE_MATCH("pdiluent.sample", pressure(buf, &sample->pressure[0], state)),
+	SAMPLE_MATCH("o2pressure.sample", pressure(buf, &sample->pressure[1], state)),
+	/* Christ, this is ugly */
+	SAMPLE_MATCH("pressure0.sample", pressure_t p; pressure(buf, &p, state); add_sample_pressure(sample, 0, p.mbar)),
+	SAMPLE_MATCH("pressure1.sample", pressure_t p; pressure(buf, &p, state); add_sample_pressure(sample, 1, p.mbar)),
+	SAMPLE_MATCH("pressure2.sample", pressure_t p; pressure(buf, &p, state); add_sample_pressure(sample, 2, p.mbar)),
+	SAMPLE_MATCH("pressure3.sample", pressure_t p; pressure(buf, &p, state); add_sample_pressure(sample, 3, p.mbar)),
+	SAMPLE_MATCH("pressure4.sample", pressure_t p; pressure(buf, &p, state); add_sample_pressure(sample, 4, p.mbar)),
+	SAMPLE_MATCH("cylinderindex.sample", get_cylinderindex(buf, &sample->sensor[0], state)),
+	SAMPLE_MATCH("sensor.sample", get_sensor(buf, &sample->sensor[0])),
+	SAMPLE_MATCH("depth.sample", depth(buf, &sample->depth, state)),
+	SAMPLE_MATCH("temp.sample", temperature(buf, &sample->temperature, state)),
+	SAMPLE_MATCH("temperature.sample", temperature(buf, &sample->temperature, state)),
+	SAMPLE_MATCH("sampletime.sample", sampletime(buf, &sample->time)),
+	SAMPLE_MATCH("time.sample", sampletime(buf, &sample->time)),
+	SAMPLE_MATCH("ndl.sample", sampletime(buf, &sample->ndl)),
+	SAMPLE_MATCH("tts.sample", sampletime(buf, &sample->tts)),
+	SAMPLE_MATCH("in_deco.sample", int in_deco; get_index(buf, &in_deco); sample->in_deco = (in_deco == 1)),
+	SAMPLE_MATCH("stoptime.sample", sampletime(buf, &sample->stoptime)),
+	SAMPLE_MATCH("stopdepth.sample", depth(buf, &sample->stopdepth, state)),
+	SAMPLE_MATCH("cns.sample", get_uint16(buf, &sample->cns)),
+	SAMPLE_MATCH("rbt.sample", sampletime(buf, &sample->rbt)),
+	SAMPLE_MATCH("sensor1.sample", double_to_o2pressure(buf, &sample->o2sensor[0])), // CCR O2 sensor data
+	SAMPLE_MATCH("sensor2.sample", double_to_o2pressure(buf, &sample->o2sensor[1])),
+	SAMPLE_MATCH("sensor3.sample", double_to_o2pressure(buf, &sample->o2sensor[2])),
+	SAMPLE_MATCH("sensor4.sample", double_to_o2pressure(buf, &sample->o2sensor[3])),
+	SAMPLE_MATCH("sensor5.sample", double_to_o2pressure(buf, &sample->o2sensor[4])),
+	SAMPLE_MATCH("sensor6.sample", double_to_o2pressure(buf, &sample->o2sensor[5])), // up to 6 CCR sensors
+	SAMPLE_MATCH("po2.sample", double_to_o2pressure(buf, &sample->setpoint)),
+	SAMPLE_MATCH("heartbeat", get_uint8(buf, &sample->heartbeat)),
+	SAMPLE_MATCH("bearing", get_bearing(buf, &sample->bearing)),
+	SAMPLE_MATCH("setpoint.sample", double_to_o2pressure(buf, &sample->setpoint)),
+	SAMPLE_MATCH("ppo2.sample", double_to_o2pressure(buf, &sample->o2sensor[state->next_o2_sensor]); state->next_o2_sensor++),
+	SAMPLE_MATCH("deco.sample", parse_libdc_deco(buf, sample)),
+	SAMPLE_MATCH("time.deco", sampletime(buf, &sample->stoptime)),
+	SAMPLE_MATCH("depth.deco", depth(buf, &sample->stopdepth, state))
+};
+static constexpr auto sample_matches = make_name_match_table(sample_fields);
+static_assert(sample_matches.valid, "sample fields can't be hashed");
+
 /* We're in samples - try to convert the random xml value to something useful */
 static void try_to_fill_sample(struct sample *sample, const char *name, char *buf, struct parser_state *state)
 {
-	int in_deco;
-	pressure_t p;
-
 	start_match("sample", name, buf);
-	if (MATCH_STATE("pressure.sample", pressure, &sample->pressure[0]))
-		return;
-	if (MATCH_STATE("cylpress.sample", pressure, &sample->pressure[0]))
-		return;
-	if (MATCH_STATE("pdiluent.sample", pressure, &sample->pressure[0]))
-		return;
-	if (MATCH_STATE("o2pressure.sample", pressure, &sample->pressure[1]))
-		return;
-	/* Christ, this is ugly */
-	if (MATCH_STATE("pressure0.sample", pressure, &p)) {
-		add_sample_pressure(sample, 0, p.mbar);
-		return;
-	}
-	if (MATCH_STATE("pressure1.sample", pressure, &p)) {
-		add_sample_pressure(sample, 1, p.mbar);
-		return;
-	}
-	if (MATCH_STATE("pressure2.sample", pressure, &p)) {
-		add_sample_pressure(sample, 2, p.mbar);
-		return;
-	}
-	if (MATCH_STATE("pressure3.sample", pressure, &p)) {
-		add_sample_pressure(sample, 3, p.mbar);
-		return;
-	}
-	if (MATCH_STATE("pressure4.sample", pressure, &p)) {
-		add_sample_pressure(sample, 4, p.mbar);
-		return;
-	}
-	if (MATCH_STATE("cylinderindex.sample", get_cylinderindex, &sample->sensor[0]))
-		return;
-	if (MATCH("sensor.sample", get_sensor, &sample->sensor[0]))
-		return;
-	if (MATCH_STATE("depth.sample", depth, &sample->depth))
-		return;
-	if (MATCH_STATE("temp.sample", temperature, &sample->temperature))
-		return;
-	if (MATCH_STATE("temperature.sample", temperature, &sample->temperature))
-		return;
-	if (MATCH("sampletime.sample", sampletime, &sample->time))
-		return;
-	if (MATCH("time.sample", sampletime, &sample->time))
-		return;
-	if (MATCH("ndl.sample", sampletime, &sample->ndl))
-		return;
-	if (MATCH("tts.sample", sampletime, &sample->tts))
-		return;
-	if (MATCH("in_deco.sample", get_index, &in_deco)) {
-		sample->in_deco = (in_deco == 1);
-		return;
-	}
-	if (MATCH("stoptime.sample", sampletime, &sample->stoptime))
-		return;
-	if (MATCH_STATE("stopdepth.sample", depth, &sample->stopdepth))
-		return;
-	if (MATCH("cns.sample", get_uint16, &sample->cns))
-		return;
-	if (MATCH("rbt.sample", sampletime, &sample->rbt))
-		return;
-	if (MATCH("sensor1.sample", double_to_o2pressure, &sample->o2sensor[0])) // CCR O2 sensor data
-		return;
-	if (MATCH("sensor2.sample", double_to_o2pressure, &sample->o2sensor[1]))
-		return;
-	if (MATCH("sensor3.sample", double_to_o2pressure, &sample->o2sensor[2]))
-		return;
-	if (MATCH("sensor4.sample", double_to_o2pressure, &sample->o2sensor[3]))
-		return;
-	if (MATCH("sensor5.sample", double_to_o2pressure, &sample->o2sensor[4]))
-		return;
-	if (MATCH("sensor6.sample", double_to_o2pressure, &sample->o2sensor[5])) // up to 6 CCR sensors
-		return;
-	if (MATCH("po2.sample", double_to_o2pressure, &sample->setpoint))
-		return;
-	if (MATCH("heartbeat", get_uint8, &sample->heartbeat))
-		return;
-	if (MATCH("bearing", get_bearing, &sample->bearing))
-		return;
-	if (MATCH("setpoint.sample", double_to_o2pressure, &sample->setpoint))
-		return;
-	if (MATCH("ppo2.sample", double_to_o2pressure, &sample->o2sensor[state->next_o2_sensor])) {
-		state->next_o2_sensor++;
-		return;
-	}
-	if (MATCH("deco.sample", parse_libdc_deco, sample))
-		return;
-	if (MATCH("time.deco", sampletime, &sample->stoptime))
-		return;
-	if (MATCH_STATE("depth.deco", depth, &sample->stopdepth))
+	if (sample_matches.match(sample, name, buf, state))
 		return;
 
 	switch (state->import_source) {
@@ -1227,14 +1280,83 @@ static void gps_picture_location(const char *buffer, struct picture *pic)
 	parse_location(buffer, &pic->location);
 }
 
+static cylinder_t *last_cylinder(struct dive *dive)
+{
+	return !dive->cylinders.empty() ? &dive->cylinders.back() : NULL;
+}
+
+static weightsystem_t *last_weightsystem(struct dive *dive)
+{
+	return !dive->weightsystems.empty() ? &dive->weightsystems.back() : NULL;
+}
+
+#define DIVE_MATCH(pattern, ...) NAME_MATCH(struct dive, pattern, [[maybe_unused]] struct dive *dive = obj; __VA_ARGS__)
+#define CYL_MATCH(pattern, ...) DIVE_MATCH(pattern, cylinder_t *cyl = last_cylinder(dive); if (!cyl) return false; __VA_ARGS__)
+#define WS_MATCH(pattern, ...) DIVE_MATCH(pattern, weightsystem_t *ws = last_weightsystem(dive); if (!ws) return false; __VA_ARGS__)
+static constexpr name_match<struct dive> dive_fields[] = {
+	DIVE_MATCH("divesiteid", dive_site(buf, dive, state)),
+	DIVE_MATCH("number", get_index(buf, &dive->number)),
+	DIVE_MATCH("tags", divetags(buf, &dive->tags)),
+	DIVE_MATCH("tripflag", get_notrip(buf, &dive->notrip)),
+	DIVE_MATCH("date", divedate(buf, &dive->when, state)),
+	DIVE_MATCH("time", divetime(buf, &dive->when, state)),
+	DIVE_MATCH("datetime", divedatetime(buf, &dive->when, state)),
+	DIVE_MATCH("filename.picture", utf8_string_std(buf, &state->cur_picture.filename)),
+	DIVE_MATCH("offset.picture", offsettime(buf, &state->cur_picture.offset)),
+	DIVE_MATCH("gps.picture", gps_picture_location(buf, &state->cur_picture)),
+	/* Legacy -> ignore. */
+	DIVE_MATCH("hash.picture", ),
+	DIVE_MATCH("cylinderstartpressure", pressure_t p; pressure(buf, &p, state); dive->get_or_create_cylinder(0)->start = p),
+	DIVE_MATCH("cylinderendpressure", pressure_t p; pressure(buf, &p, state); dive->get_or_create_cylinder(0)->end = p),
+	DIVE_MATCH("gps", gps_in_dive(buf, dive, state)),
+	DIVE_MATCH("Place", gps_in_dive(buf, dive, state)),
+	DIVE_MATCH("latitude", gps_lat(buf, dive, state)),
+	DIVE_MATCH("sitelat", gps_lat(buf, dive, state)),
+	DIVE_MATCH("lat", gps_lat(buf, dive, state)),
+	DIVE_MATCH("longitude", gps_long(buf, dive, state)),
+	DIVE_MATCH("sitelon", gps_long(buf, dive, state)),
+	DIVE_MATCH("lon", gps_long(buf, dive, state)),
+	DIVE_MATCH("location", add_dive_site(buf, dive, state)),
+	DIVE_MATCH("name.dive", add_dive_site(buf, dive, state)),
+	DIVE_MATCH("suit", utf8_string_std(buf, &dive->suit)),
+	DIVE_MATCH("divesuit", utf8_string_std(buf, &dive->suit)),
+	DIVE_MATCH("notes", utf8_string_std(buf, &dive->notes)),
+	// For historic reasons, we accept dive guide as well as dive master
+	DIVE_MATCH("diveguide", utf8_string_std(buf, &dive->diveguide)),
+	DIVE_MATCH("divemaster", utf8_string_std(buf, &dive->diveguide)),
+	DIVE_MATCH("buddy", utf8_string_std(buf, &dive->buddy)),
+	DIVE_MATCH("watersalinity", salinity(buf, &dive->user_salinity)),
+	DIVE_MATCH("rating.dive", get_rating(buf, &dive->rating)),
+	DIVE_MATCH("visibility.dive", get_rating(buf, &dive->visibility)),
+	DIVE_MATCH("wavesize.dive", get_rating(buf, &dive->wavesize)),
+	DIVE_MATCH("current.dive", get_rating(buf, &dive->current)),
+	DIVE_MATCH("surge.dive", get_rating(buf, &dive->surge)),
+	DIVE_MATCH("chill.dive", get_rating(buf, &dive->chill)),
+	DIVE_MATCH("airpressure.dive", pressure(buf, &dive->surface_pressure, state)),
+	WS_MATCH("description.weightsystem", utf8_string_std(buf, &ws->description)),
+	WS_MATCH("weight.weightsystem", weight(buf, &ws->weight, state)),
+	DIVE_MATCH("weight", weightsystem_t ws; weight(buf, &ws.weight, state); dive->weightsystems.push_back(std::move(ws))),
+	CYL_MATCH("size.cylinder", cylindersize(buf, &cyl->type.size)),
+	CYL_MATCH("workpressure.cylinder", pressure(buf, &cyl->type.workingpressure, state)),
+	CYL_MATCH("description.cylinder", utf8_string_std(buf, &cyl->type.description)),
+	CYL_MATCH("start.cylinder", pressure(buf, &cyl->start, state)),
+	CYL_MATCH("end.cylinder", pressure(buf, &cyl->end, state)),
+	CYL_MATCH("use.cylinder", cylinder_use(buf, &cyl->cylinder_use, state)),
+	CYL_MATCH("depth.cylinder", depth(buf, &cyl->depth, state)),
+	CYL_MATCH("o2", gasmix(buf, &cyl->gasmix.o2, state)),
+	CYL_MATCH("o2percent", gasmix(buf, &cyl->gasmix.o2, state)),
+	CYL_MATCH("n2", gasmix_nitrogen(buf, &cyl->gasmix)),
+	CYL_MATCH("he", gasmix(buf, &cyl->gasmix.he, state)),
+	DIVE_MATCH("air.divetemperature", temperature(buf, &dive->airtemp, state)),
+	DIVE_MATCH("water.divetemperature", temperature(buf, &dive->watertemp, state)),
+	DIVE_MATCH("invalid", get_bool(buf, &dive->invalid))
+};
+static constexpr auto dive_matches = make_name_match_table(dive_fields);
+static_assert(dive_matches.valid && dive_matches.disjoint(dc_data_matches), "dive fields can't be hashed");
+
 /* We're in the top-level dive xml. Try to convert whatever value to a dive value */
 static void try_to_fill_dive(struct dive *dive, const char *name, char *buf, struct parser_state *state)
 {
-	cylinder_t *cyl = !dive->cylinders.empty() ? &dive->cylinders.back() : NULL;
-	weightsystem_t *ws = !dive->weightsystems.empty() > 0 ?
-		&dive->weightsystems.back() : NULL;
-	pressure_t p;
-	weight_t w;
 	start_match("dive", name, buf);
 
 	switch (state->import_source) {
@@ -1251,135 +1373,13 @@ static void try_to_fill_dive(struct dive *dive, const char *name, char *buf, str
 	default:
 		break;
 	}
-	if (MATCH_STATE("divesiteid", dive_site, dive))
-		return;
-	if (MATCH("number", get_index, &dive->number))
-		return;
-	if (MATCH("tags", divetags, &dive->tags))
-		return;
-	if (MATCH("tripflag", get_notrip, &dive->notrip))
-		return;
-	if (MATCH_STATE("date", divedate, &dive->when))
-		return;
-	if (MATCH_STATE("time", divetime, &dive->when))
-		return;
-	if (MATCH_STATE("datetime", divedatetime, &dive->when))
+	if (dive_matches.match(dive, name, buf, state))
 		return;
 	/*
 	 * Legacy format note: per-dive depths and duration get saved
 	 * in the first dive computer entry
 	 */
-	if (match_dc_data_fields(&dive->dcs[0], name, buf, state))
-		return;
-
-	if (MATCH("filename.picture", utf8_string_std, &state->cur_picture.filename))
-		return;
-	if (MATCH("offset.picture", offsettime, &state->cur_picture.offset))
-		return;
-	if (MATCH("gps.picture", gps_picture_location, &state->cur_picture))
-		return;
-	if (std::string hash; MATCH("hash.picture", utf8_string_std, &hash)) {
-		/* Legacy -> ignore. */
-		return;
-	}
-	if (MATCH_STATE("cylinderstartpressure", pressure, &p)) {
-		dive->get_or_create_cylinder(0)->start = p;
-		return;
-	}
-	if (MATCH_STATE("cylinderendpressure", pressure, &p)) {
-		dive->get_or_create_cylinder(0)->end = p;
-		return;
-	}
-	if (MATCH_STATE("gps", gps_in_dive, dive))
-		return;
-	if (MATCH_STATE("Place", gps_in_dive, dive))
-		return;
-	if (MATCH_STATE("latitude", gps_lat, dive))
-		return;
-	if (MATCH_STATE("sitelat", gps_lat, dive))
-		return;
-	if (MATCH_STATE("lat", gps_lat, dive))
-		return;
-	if (MATCH_STATE("longitude", gps_long, dive))
-		return;
-	if (MATCH_STATE("sitelon", gps_long, dive))
-		return;
-	if (MATCH_STATE("lon", gps_long, dive))
-		return;
-	if (MATCH_STATE("location", add_dive_site, dive))
-		return;
-	if (MATCH_STATE("name.dive", add_dive_site, dive))
-		return;
-	if (MATCH("suit", utf8_string_std, &dive->suit))
-		return;
-	if (MATCH("divesuit", utf8_string_std, &dive->suit))
-		return;
-	if (MATCH("notes", utf8_string_std, &dive->notes))
-		return;
-	// For historic reasons, we accept dive guide as well as dive master
-	if (MATCH("diveguide", utf8_string_std, &dive->diveguide))
-		return;
-	if (MATCH("divemaster", utf8_string_std, &dive->diveguide))
-		return;
-	if (MATCH("buddy", utf8_string_std, &dive->buddy))
-		return;
-	if (MATCH("watersalinity", salinity, &dive->user_salinity))
-		return;
-	if (MATCH("rating.dive", get_rating, &dive->rating))
-		return;
-	if (MATCH("visibility.dive", get_rating, &dive->visibility))
-		return;
-	if (MATCH("wavesize.dive", get_rating, &dive->wavesize))
-		return;
-	if (MATCH("current.dive", get_rating, &dive->current))
-		return;
-	if (MATCH("surge.dive", get_rating, &dive->surge))
-		return;
-	if (MATCH("chill.dive", get_rating, &dive->chill))
-		return;
-	if (MATCH_STATE("airpressure.dive", pressure, &dive->surface_pressure))
-		return;
-	if (ws) {
-		if (MATCH("description.weightsystem", utf8_string_std, &ws->description))
-			return;
-		if (MATCH_STATE("weight.weightsystem", weight, &ws->weight))
-			return;
-	}
-	if (MATCH_STATE("weight", weight, &w)) {
-		weightsystem_t ws;
-		ws.weight = w;
-		dive->weightsystems.push_back(std::move(ws));
-		return;
-	}
-	if (cyl) {
-		if (MATCH("size.cylinder", cylindersize, &cyl->type.size))
-			return;
-		if (MATCH_STATE("workpressure.cylinder", pressure, &cyl->type.workingpressure))
-			return;
-		if (MATCH("description.cylinder", utf8_string_std, &cyl->type.description))
-			return;
-		if (MATCH_STATE("start.cylinder", pressure, &cyl->start))
-			return;
-		if (MATCH_STATE("end.cylinder", pressure, &cyl->end))
-			return;
-		if (MATCH_STATE("use.cylinder", cylinder_use, &cyl->cylinder_use))
-			return;
-		if (MATCH_STATE("depth.cylinder", depth, &cyl->depth))
-			return;
-		if (MATCH_STATE("o2", gasmix, &cyl->gasmix.o2))
-			return;
-		if (MATCH_STATE("o2percent", gasmix, &cyl->gasmix.o2))
-			return;
-		if (MATCH("n2", gasmix_nitrogen, &cyl->gasmix))
-			return;
-		if (MATCH_STATE("he", gasmix, &cyl->gasmix.he))
-			return;
-	}
-	if (MATCH_STATE("air.divetemperature", temperature, &dive->airtemp))
-		return;
-	if (MATCH_STATE("water.divetemperature", temperature, &dive->watertemp))
-		return;
-	if (MATCH("invalid", get_bool, &dive->invalid))
+	if (dc_data_matches.match(&dive->dcs[0], name, buf, state))
 		return;
 
 	nonmatch("dive", name, buf);
@@ -1532,23 +1532,15 @@ static bool entry(const char *name, char *buf, struct parser_state *state)
 	return true;
 }
 
-static const char *nodename(xmlNode *node, char *buf, int len)
+/* Lower-case "name.parent" into buf, parent may be NULL */
+static const char *join_nodename(const char *name, const char *parent, char *buf, int len)
 {
-	int levels = 2;
 	char *p = buf;
 
-	if (!node || (node->type != XML_CDATA_SECTION_NODE && !node->name)) {
-		return "root";
-	}
-
-	if (node->type == XML_CDATA_SECTION_NODE || (node->parent && !strcmp((const char *)node->name, "text")))
-		node = node->parent;
-
 	/* Make sure it's always NUL-terminated */
 	p[--len] = 0;
 
 	for (;;) {
-		const char *name = (const char *)node->name;
 		char c;
 		while ((c = *name++) != 0) {
 			/* Cheaper 'tolower()' for ASCII */
@@ -1558,17 +1550,29 @@ static const char *nodename(xmlNode *node, char *buf, int len)
 				return buf;
 		}
 		*p = 0;
-		node = node->parent;
-		if (!node || !node->name)
+		if (!parent)
 			return buf;
 		*p++ = '.';
 		if (!--len)
 			return buf;
-		if (!--levels)
-			return buf;
+		name = parent;
+		parent = NULL;
 	}
 }
 
+static const char *nodename(xmlNode *node, char *buf, int len)
+{
+	if (!node || (node->type != XML_CDATA_SECTION_NODE && !node->name)) {
+		return "root";
+	}
+
+	if (node->type == XML_CDATA_SECTION_NODE || (node->parent && !strcmp((const char *)node->name, "text")))
+		node = node->parent;
+
+	const char *parent = node->parent && node->parent->name ? (const char *)node->parent->name : NULL;
+	return join_nodename((const char *)node->name, parent, buf, len);
+}
+
 #define MAXNAME 32
 
 static bool visit_one_node(xmlNode *node, struct parser_state *state)
@@ -1669,28 +1673,49 @@ static struct nesting {
 	  { NULL, }
 };
 
+/* Returns the terminating entry without start and end functions if there is no rule */
+static const struct nesting *find_nesting(const char *name)
+{
+	const struct nesting *rule = nesting;
+
+	do {
+		if (!strcmp(rule->name, name))
+			break;
+		rule++;
+	} while (rule->name);
+	return rule;
+}
+
+/* The document is in memory, so we know the number of samples up front */
+static void reserve_samples(xmlNode *node, struct divecomputer *dc)
+{
+	size_t count = 0;
+
+	for (xmlNode *n = node->children; n; n = n->next) {
+		if (n->type == XML_ELEMENT_NODE && !strcmp((const char *)n->name, "sample"))
+			count++;
+	}
+	dc->samples.reserve(dc->samples.size() + count);
+}
+
 static bool traverse(xmlNode *root, struct parser_state *state)
 {
 	xmlNode *n;
 	bool ret = true;
 
 	for (n = root; n; n = n->next) {
-		struct nesting *rule = nesting;
-
 		if (!n->name) {
 			if ((ret = visit(n, state)) == false)
 				break;
 			continue;
 		}
 
-		do {
-			if (!strcmp(rule->name, (const char *)n->name))
-				break;
-			rule++;
-		} while (rule->name);
+		const struct nesting *rule = find_nesting((const char *)n->name);
 
 		if (rule->start)
 			rule->start(state);
+		if (rule->start == divecomputer_start && state->cur_dc)
+			reserve_samples(n, state->cur_dc);
 		if ((ret = visit(n, state)) == false)
 			break;
 		if (rule->end)
@@ -1770,11 +1795,169 @@ int parse_xml_buffer(const char *url, const char *buffer, int, struct divelog *l
 	return ret;
 }
 
+static bool is_blank(const xmlChar *s)
+{
+	while (IS_BLANK_CH(*s))
+		s++;
+	return !*s;
+}
+
+/*
+ * Feed one text or attribute value to the parser - the same as
+ * visit_one_node() does for document trees.
+ */
+static bool stream_entry(const char *name, const char *parent, const xmlChar *value,
+			 std::string &buf, struct parser_state *state)
+{
+	char buffer[MAXNAME];
+
+	if (!value || is_blank(value))
+		return true;
+	/* entry() may modify the buffer, so don't pass libxml2's string */
+	buf.assign((const char *)value);
+	return entry(join_nodename(name, parent, buffer, sizeof(buffer)), buf.data(), state);
+}
+
+struct stream_element {
+	std::string name;
+	const struct nesting *rule;
+};
+
+/*
+ * Native divelog files don't need an XSLT transformation, so they can
+ * be parsed with libxml2's xmlTextReader as the data is read, instead of
+ * building the whole document tree in memory. The nesting rules and
+ * entries are visited in the same order as by traverse().
+ *
+ * Returns 1 without touching the divelog if this is not a native file.
+ */
+static int parse_xml_reader(xmlTextReaderPtr reader, const char *url, struct divelog *log, gzFile gz, size_t size)
+{
+	struct parser_state state;
+	std::vector<stream_element> stack;
+	std::string buf;
+	int ret = 0, res, last_percent = 0;
+	bool started = false;
+
+	state.log = log;
+	state.fingerprints = &fingerprints; // simply use the global table for now
+	reset_all(&state);
+
+	while ((res = xmlTextReaderRead(reader)) == 1) {
+		bool ok = true;
+
+		if (!started && xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT &&
+		    strcmp((const char *)xmlTextReaderConstLocalName(reader), "divelog"))
+			break;
+
+		switch (xmlTextReaderNodeType(reader)) {
+		case XML_READER_TYPE_ELEMENT: {
+			const char *name = (const char *)xmlTextReaderConstLocalName(reader);
+			bool empty = xmlTextReaderIsEmptyElement(reader);
+			if (!started) {
+				dive_start(&state);
+				started = true;
+			}
+			const struct nesting *rule = find_nesting(name);
+			if (rule->start)
+				rule->start(&state);
+			stack.push_back({ name, rule });
+
+			const char *element = stack.back().name.c_str();
+			while (ok && xmlTextReaderMoveToNextAttribute(reader) == 1) {
+				if (!xmlTextReaderIsNamespaceDecl(reader))
+					ok = stream_entry((const char *)xmlTextReaderConstLocalName(reader), element,
+							  xmlTextReaderConstValue(reader), buf, &state);
+			}
+			xmlTextReaderMoveToElement(reader);
+			if (!empty)
+				break;
+		}
+		/* an empty element ends right away */
+		[[fallthrough]];
+		case XML_READER_TYPE_END_ELEMENT:
+			if (!stack.empty()) {
+				const struct nesting *rule = stack.back().rule;
+				stack.pop_back();
+				if (rule->end)
+					rule->end(&state);
+			}
+			break;
+		case XML_READER_TYPE_TEXT:
+		case XML_READER_TYPE_CDATA:
+			if (!stack.empty())
+				ok = stream_entry(stack.back().name.c_str(),
+						  stack.size() > 1 ? stack[stack.size() - 2].name.c_str() : NULL,
+						  xmlTextReaderConstValue(reader), buf, &state);
+			break;
+		}
+		if (!ok) {
+			// we decided to give up on parsing... why?
+			ret = -1;
+			break;
+		}
+
+		/* Progress is measured in bytes of the (possibly compressed) file */
+		int percent = gz && size ? (int)(gzoffset(gz) * 100 / size) : 0;
+		if (percent >= last_percent + 10) {
+			char msg[80];
+			last_percent = percent - percent % 10;
+			snprintf(msg, sizeof(msg), translate("gettextFromC", "Parsing dive file (%d%%)"), last_percent);
+			(void)git_storage_update_progress(msg);
+		}
+	}
+	xmlFreeTextReader(reader);
+
+	/* unreadable or a foreign format - let the generic code deal with it */
+	if (!started)
+		return 1;
+	dive_end(&state);
+	if (res < 0)
+		return report_error(translate("gettextFromC", "Failed to parse '%s'"), url);
+	return ret;
+}
+
+static int gz_read(void *context, char *buffer, int len)
+{
+	return gzread((gzFile)context, buffer, len);
+}
+
+static int gz_close(void *context)
+{
+	return gzclose((gzFile)context) == Z_OK ? 0 : -1;
+}
+
+int parse_xml_stream(const char *url, int fd, size_t size, struct divelog *log)
+{
+	/* zlib reads gzip-compressed and plain files alike */
+	int gzfd = dup(fd);
+	gzFile gz = gzfd >= 0 ? gzdopen(gzfd, "rb") : NULL;
+	if (!gz) {
+		if (gzfd >= 0)
+			close(gzfd);
+		return 1;
+	}
+	gzbuffer(gz, 128 * 1024);
+	xmlTextReaderPtr reader = xmlReaderForIO(gz_read, gz_close, gz, url, NULL, XML_PARSE_HUGE);
+	if (!reader)
+		return 1;
+	return parse_xml_reader(reader, url, log, gz, size);
+}
+
+/* The same for data that comes from a callback, e.g. an entry of a zip archive */
+int parse_xml_io(const char *url, int (*read)(void *context, char *buffer, int len), void *context, struct divelog *log)
+{
+	xmlTextReaderPtr reader = xmlReaderForIO(read, NULL, context, url, NULL, XML_PARSE_HUGE);
+	if (!reader)
+		return 1;
+	return parse_xml_reader(reader, url, log, NULL, 0);
+}
+
 /*
  * Parse a unsigned 32-bit integer in little-endian mode,
  * that is seconds since Jan 1, 2000.
  */
-static timestamp_t parse_dlf_timestamp(unsigned char *buffer)
+static timestamp_t parse_dlf_timestamp(const unsigned char *buffer)
 {
 	timestamp_t offset;
 
@@ -1788,10 +1971,10 @@ static timestamp_t parse_dlf_timestamp(unsigned char *buffer)
 	return offset + 946684800;
 }
 
-int parse_dlf_buffer(unsigned char *buffer, size_t size, struct divelog *log)
+int parse_dlf_buffer(const unsigned char *buffer, size_t size, struct divelog *log)
 {
 	using namespace std::string_literals;
-	unsigned char *ptr = buffer;
+	const unsigned char *ptr = buffer;
 	unsigned char event;
 	bool found;
 	unsigned int time = 0;
@@ -2340,7 +2523,6 @@ static xmlDoc *test_xslt_transforms(xmlDoc *doc, const struct xml_params *params
 		}
 		transformed = xsltApplyStylesheet(xslt, doc, xml_params_get(params));
 		xmlFreeDoc(doc);
-		xsltFreeStylesheet(xslt);
 
 		return transformed;
 	}
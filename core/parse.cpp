@@ -12,6 +12,7 @@
 #include "divesite.h"
 #include "errorhelper.h"
 #include "format.h"
+#include "perfcounters.h"
 #include "sample.h"
 #include "subsurface-string.h"
 #include "picture.h"
@@ -20,7 +21,71 @@
 #include "gettext.h"
 
 parser_state::parser_state() = default;
-parser_state::~parser_state() = default;
+
+parser_state::~parser_state()
+{
+	if (log)
+		log->dives.record_dives(std::move(parsed_dives));
+}
+
+sql_query::sql_query(sqlite3 *handle, const char *sql)
+{
+	if (sqlite3_prepare_v2(handle, sql, -1, &stmt, NULL) != SQLITE_OK) {
+		sqlite3_finalize(stmt);
+		stmt = nullptr;
+		return;
+	}
+	int columns = sqlite3_column_count(stmt);
+	data.resize(columns);
+	names.resize(columns);
+	for (int i = 0; i < columns; i++)
+		names[i] = (char *)sqlite3_column_name(stmt, i);
+}
+
+sql_query::~sql_query()
+{
+	sqlite3_finalize(stmt);
+}
+
+bool sql_query::valid() const
+{
+	return stmt != nullptr;
+}
+
+int sql_query::exec(callback_t callback, void *param)
+{
+	int retval;
+
+	if (!stmt)
+		return SQLITE_ERROR;
+	while ((retval = sqlite3_step(stmt)) == SQLITE_ROW) {
+		for (size_t i = 0; i < data.size(); i++) {
+			if (sqlite3_column_type(stmt, i) == SQLITE_BLOB)
+				data[i] = (char *)sqlite3_column_blob(stmt, i);
+			else
+				data[i] = (char *)sqlite3_column_text(stmt, i);
+		}
+		if (callback(param, (int)data.size(), data.data(), names.data())) {
+			retval = SQLITE_ABORT;
+			break;
+		}
+	}
+	sqlite3_reset(stmt);
+	return retval == SQLITE_DONE ? SQLITE_OK : retval;
+}
+
+int sql_query::exec(sqlite3_int64 id, callback_t callback, void *param)
+{
+	if (!stmt)
+		return SQLITE_ERROR;
+	sqlite3_bind_int64(stmt, 1, id);
+	return exec(callback, param);
+}
+
+int sql_query::size(int column) const
+{
+	return sqlite3_column_bytes(stmt, column);
+}
 
 /*
  * If we don't have an explicit dive computer,
@@ -262,8 +327,7 @@ void dive_end(struct parser_state *state)
 	if (is_dive(state)) {
 		if (state->cur_trip)
 			state->cur_trip->add_dive(state->cur_dive.get());
-		// This would add dives in a sorted way:
-		state->log->dives.record_dive(std::move(state->cur_dive));
+		state->parsed_dives.push_back(std::move(state->cur_dive));
 	}
 	state->cur_dive.reset();
 	state->cur_dc = NULL;
@@ -357,6 +421,7 @@ void sample_start(struct parser_state *state)
 	}
 	state->cur_sample = sample;
 	state->next_o2_sensor = 0;
+	samples_parsed.add();
 }
 
 void sample_end(struct parser_state *state)
@@ -42,6 +42,8 @@ struct parser_settings {
  * "owning" marks pointers to objects that are freed in the destructor.
  * In contrast, "non-owning" marks pointers to objects that are owned
  * by other data-structures.
+ * The parsed dives are collected and added to the log in one batch when
+ * the parser_state is destroyed, see dive_table::record_dives().
  */
 struct parser_state {
 	enum import_source {
@@ -57,6 +59,7 @@ struct parser_state {
 
 	struct divecomputer *cur_dc = nullptr;			/* non-owning */
 	std::unique_ptr<dive> cur_dive;				/* owning */
+	std::vector<std::unique_ptr<dive>> parsed_dives;	/* owning */
 	std::unique_ptr<dive_site> cur_dive_site;		/* owning */
 	location_t cur_location;
 	std::unique_ptr<dive_trip> cur_trip;			/* owning */
@@ -94,6 +97,32 @@ struct parser_state {
 	~parser_state();
 };
 
+/*
+ * A prepared statement of the SQL based parsers. It is prepared once per
+ * import and then run for every dive, with the dive id bound to the
+ * parameter "?1" (which may appear several times in the statement).
+ */
+struct sql_query {
+	using callback_t = int (*)(void *param, int columns, char **data, char **names);
+
+	sql_query(sqlite3 *handle, const char *sql);
+	~sql_query();
+	sql_query(const sql_query &) = delete;
+	sql_query &operator=(const sql_query &) = delete;
+
+	bool valid() const;
+	// Like sqlite3_exec(): calls callback for every row, with the columns
+	// as text (blobs are passed as is), until it returns non-zero.
+	int exec(callback_t callback, void *param);
+	int exec(sqlite3_int64 id, callback_t callback, void *param);
+	// Size in bytes of a column of the row passed to the callback.
+	int size(int column) const;
+private:
+	sqlite3_stmt *stmt = nullptr;
+	std::vector<char *> data;
+	std::vector<char *> names;
+};
+
 void event_start(struct parser_state *state);
 void event_end(struct parser_state *state);
 struct divecomputer *get_dc(struct parser_state *state);
@@ -142,6 +171,8 @@ void nonmatch(const char *type, const char *name, char *buffer);
 
 void parse_xml_init();
 int parse_xml_buffer(const char *url, const char *buf, int size, struct divelog *log, const struct xml_params *params);
+int parse_xml_stream(const char *url, int fd, size_t size, struct divelog *log);
+int parse_xml_io(const char *url, int (*read)(void *context, char *buffer, int len), void *context, struct divelog *log);
 void parse_xml_exit();
 int parse_dm4_buffer(sqlite3 *handle, const char *url, const char *buf, int size, struct divelog *log);
 int parse_dm5_buffer(sqlite3 *handle, const char *url, const char *buf, int size, struct divelog *log);
@@ -150,7 +181,7 @@ int parse_shearwater_buffer(sqlite3 *handle, const char *url, const char *buf, i
 int parse_shearwater_cloud_buffer(sqlite3 *handle, const char *url, const char *buf, int size, struct divelog *log);
 int parse_cobalt_buffer(sqlite3 *handle, const char *url, const char *buf, int size, struct divelog *log);
 int parse_divinglog_buffer(sqlite3 *handle, const char *url, const char *buf, int size, struct divelog *log);
-int parse_dlf_buffer(unsigned char *buffer, size_t size, struct divelog *log);
+int parse_dlf_buffer(const unsigned char *buffer, size_t size, struct divelog *log);
 std::string trimspace(const char *buffer);
 
 #endif
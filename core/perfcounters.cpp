@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "perfcounters.h"
+#include "format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+// The shards have a fixed size, so that they never have to be reallocated
+// while other threads read them. Increase if needed.
+static constexpr int max_counters = 64;
+
+struct perf_shard {
+	std::atomic<uint64_t> values[max_counters];
+	perf_shard();
+	~perf_shard();
+};
+
+// Function-local statics, because the counters are registered during
+// static initialization of other translation units.
+struct perf_registry {
+	std::mutex lock;
+	std::vector<const char *> names;
+	std::vector<std::pair<const char *, std::function<int64_t()>>> gauges;
+	std::vector<perf_shard *> shards;
+	uint64_t retired[max_counters] = { 0 };	// The counts of the threads that exited
+};
+
+static perf_registry &registry()
+{
+	static perf_registry *self = new perf_registry;	// Not freed: threads may exit after main()
+	return *self;
+}
+
+perf_shard::perf_shard()
+{
+	for (auto &v: values)
+		v.store(0, std::memory_order_relaxed);
+	perf_registry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	r.shards.push_back(this);
+}
+
+perf_shard::~perf_shard()
+{
+	perf_registry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	for (int i = 0; i < max_counters; ++i)
+		r.retired[i] += values[i].load(std::memory_order_relaxed);
+	r.shards.erase(std::remove(r.shards.begin(), r.shards.end(), this), r.shards.end());
+}
+
+static perf_shard &thread_shard()
+{
+	thread_local perf_shard shard;
+	return shard;
+}
+
+perf_counter::perf_counter(const char *name)
+{
+	perf_registry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	index = (int)r.names.size();
+	if (index >= max_counters) {
+		index = max_counters - 1;	// Programming error: share the last slot
+		return;
+	}
+	r.names.push_back(name);
+}
+
+void perf_counter::add(uint64_t n)
+{
+	// Only this thread writes to the shard: no atomic read-modify-write needed.
+	std::atomic<uint64_t> &v = thread_shard().values[index];
+	v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+uint64_t perf_counter::value() const
+{
+	perf_registry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	uint64_t res = r.retired[index];
+	for (const perf_shard *shard: r.shards)
+		res += shard->values[index].load(std::memory_order_relaxed);
+	return res;
+}
+
+perf_gauge::perf_gauge(const char *name, std::function<int64_t()> get)
+{
+	perf_registry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	r.gauges.emplace_back(name, std::move(get));
+}
+
+static uint64_t now_us()
+{
+	using namespace std::chrono;
+	return (uint64_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+perf_timer::perf_timer(perf_counter &counterIn) : counter(counterIn), start(now_us())
+{
+}
+
+perf_timer::~perf_timer()
+{
+	counter.add(now_us() - start);
+}
+
+// Rates that are more telling than the raw counts: name, numerator,
+// denominator and the factor to apply.
+static const struct {
+	const char *name, *num, *den;
+	double factor;
+} derived[] = {
+	{ "samples parsed per second", "samples parsed", "parse time [us]", 1e6 },
+	{ "git objects written per save", "git objects written", "git saves", 1.0 },
+};
+
+std::vector<std::pair<std::string, int64_t>> perf_counters()
+{
+	std::vector<std::pair<std::string, int64_t>> res;
+	std::vector<std::pair<const char *, std::function<int64_t()>>> gauges;
+	perf_registry &r = registry();
+	{
+		std::lock_guard<std::mutex> guard(r.lock);
+		for (size_t i = 0; i < r.names.size(); ++i) {
+			uint64_t v = r.retired[i];
+			for (const perf_shard *shard: r.shards)
+				v += shard->values[i].load(std::memory_order_relaxed);
+			res.emplace_back(r.names[i], (int64_t)v);
+		}
+		gauges = r.gauges;
+	}
+	// The gauges are called without holding the lock: they may count themselves.
+	for (const auto &[name, get]: gauges)
+		res.emplace_back(name, get());
+
+	auto find = [&res](const char *name) -> int64_t {
+		for (const auto &[n, v]: res) {
+			if (n == name)
+				return v;
+		}
+		return 0;
+	};
+	for (const auto &d: derived) {
+		int64_t den = find(d.den);
+		if (den > 0)
+			res.emplace_back(d.name, (int64_t)((double)find(d.num) * d.factor / (double)den));
+	}
+	return res;
+}
+
+std::string perf_counters_json()
+{
+	std::string res = "{";
+	bool first = true;
+	for (const auto &[name, value]: perf_counters()) {
+		res += format_string_std("%s\n  \"%s\": %lld", first ? "" : ",", name.c_str(), (long long)value);
+		first = false;
+	}
+	res += "\n}\n";
+	return res;
+}
+
+std::string perf_counters_text()
+{
+	std::string res;
+	for (const auto &[name, value]: perf_counters())
+		res += format_string_std("%s: %lld\n", name.c_str(), (long long)value);
+	return res;
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-2.0
+// Always-on, cheap performance counters.
+//
+// A counter is a static object in the module that counts:
+//	static perf_counter samples_parsed("samples parsed");
+//	samples_parsed.add(n);
+// Each thread counts in its own shard, so that counting is a plain store
+// that never contends with other threads. Reading a counter sums over the
+// shards of all threads, including those of threads that have exited.
+//
+// Gauges give the current value of some quantity, such as the size of
+// the undo stack. They are read by calling a function.
+//
+// The counters are shown in the About dialog and the developer page of
+// the mobile app, and can be dumped as JSON.
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+class perf_counter {
+public:
+	// The name must be a string literal (it is not copied)
+	perf_counter(const char *name);
+	void add(uint64_t n = 1);
+	uint64_t value() const;
+	perf_counter(const perf_counter &) = delete;
+	perf_counter &operator=(const perf_counter &) = delete;
+private:
+	int index;
+};
+
+class perf_gauge {
+public:
+	perf_gauge(const char *name, std::function<int64_t()> get);
+};
+
+// Measures the time until the end of the scope in microseconds.
+class perf_timer {
+public:
+	perf_timer(perf_counter &counter);
+	~perf_timer();
+private:
+	perf_counter &counter;
+	uint64_t start;
+};
+
+// The values of all counters and gauges, in the order of registration,
+// followed by the derived rates.
+std::vector<std::pair<std::string, int64_t>> perf_counters();
+std::string perf_counters_json();
+std::string perf_counters_text();
+
+#endif
@@ -43,30 +43,38 @@ static timestamp_t time_from_dive(const struct dive &d, timestamp_t timestamp)
 		return 0;
 }
 
-/* Return dive closest selected dive to given timestamp or NULL if no dives are selected. */
-static struct dive *nearest_selected_dive(timestamp_t timestamp)
+picture_matcher::picture_matcher()
 {
-	struct dive *res = NULL;
-	timestamp_t min = 0;
-
 	for (auto &d: divelog.dives) {
-		if (!d->selected)
-			continue;
-		timestamp_t offset = time_from_dive(*d, timestamp);
-		if (!res || offset < min) {
-			res = d.get();
-			min = offset;
-		}
-
-		/* We suppose that dives are sorted chronologically. Thus
-		 * if the offset starts to increase, we can end. This ignores
-		 * pathological cases such as overlapping dives. In such a
-		 * case the user will have to add pictures manually.
-		 */
-		if (offset == 0 || offset > min)
-			break;
+		if (d->selected)
+			dives.push_back(d.get());
 	}
-	return res;
+	std::stable_sort(dives.begin(), dives.end(),
+			 [](const dive *d1, const dive *d2) { return d1->when < d2->when; });
+	latest_end.reserve(dives.size());
+	for (size_t i = 0; i < dives.size(); ++i) {
+		if (i == 0 || dives[i]->endtime() > dives[latest_end.back()]->endtime())
+			latest_end.push_back(i);
+		else
+			latest_end.push_back(latest_end.back());
+	}
+}
+
+/* Of the dives that start before the timestamp, the one that ends last is the
+ * closest. Of the dives that start after the timestamp, the first one is.
+ * Thus, this works for overlapping dives, too.
+ */
+struct dive *picture_matcher::nearest_dive(timestamp_t timestamp) const
+{
+	auto it = std::upper_bound(dives.begin(), dives.end(), timestamp,
+				   [](timestamp_t t, const dive *d) { return t < d->when; });
+	size_t after = it - dives.begin();
+	struct dive *before = after > 0 ? dives[latest_end[after - 1]] : nullptr;
+	if (after >= dives.size())
+		return before;
+	if (!before || time_from_dive(*dives[after], timestamp) < time_from_dive(*before, timestamp))
+		return dives[after];
+	return before;
 }
 
 // only add pictures that have timestamps between 30 minutes before the dive and
@@ -77,18 +85,24 @@ static bool dive_check_picture_time(const struct dive &d, timestamp_t timestamp)
 	return time_from_dive(d, timestamp) < d30min;
 }
 
+bool picture_matcher::check_time(timestamp_t timestamp) const
+{
+	struct dive *d = nearest_dive(timestamp);
+	return d && dive_check_picture_time(*d, timestamp);
+}
+
 /* Creates a picture and indicates the dive to which this picture should be added.
  * The caller is responsible for actually adding the picture to the dive.
  * If no appropriate dive was found, no picture is created and null is returned.
  */
-std::pair<std::optional<picture>, dive *> create_picture(const std::string &filename, timestamp_t shift_time, bool match_all)
+std::pair<std::optional<picture>, dive *> create_picture(const picture_matcher &matcher, const std::string &filename, timestamp_t shift_time, bool match_all)
 {
 	struct metadata metadata;
 	timestamp_t timestamp;
 
 	get_metadata(filename.c_str(), &metadata);
 	timestamp = metadata.timestamp + shift_time;
-	struct dive *dive = nearest_selected_dive(timestamp);
+	struct dive *dive = matcher.nearest_dive(timestamp);
 
 	if (!dive)
 		return { {}, nullptr };
@@ -104,10 +118,13 @@ std::pair<std::optional<picture>, dive *> create_picture(const std::string &file
 	return { picture, dive };
 }
 
+std::pair<std::optional<picture>, dive *> create_picture(const std::string &filename, timestamp_t shift_time, bool match_all)
+{
+	return create_picture(picture_matcher(), filename, shift_time, match_all);
+}
+
 bool picture_check_valid_time(timestamp_t timestamp, timestamp_t shift_time)
 {
-	return std::any_of(divelog.dives.begin(), divelog.dives.end(),
-			   [t = timestamp + shift_time] (auto &d)
-			   { return d->selected && dive_check_picture_time(*d, t); });
+	return picture_matcher().check_time(timestamp + shift_time);
 }
 #endif
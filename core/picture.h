@@ -29,6 +29,20 @@ extern void add_to_picture_table(picture_table &, int idx, struct picture pic);
 extern void add_picture(picture_table &, struct picture newpic);
 extern int get_picture_idx(const picture_table &, const std::string &filename); /* Return -1 if not found */
 
+/* Finds the selected dive closest to a picture time in O(log n).
+ * Create one for a batch of pictures. Invalidated when dives are changed.
+ */
+class picture_matcher {
+public:
+	picture_matcher(); /* from the selected dives of the global divelog */
+	struct dive *nearest_dive(timestamp_t timestamp) const; /* null if no dive is selected */
+	bool check_time(timestamp_t timestamp) const; /* close to a selected dive? */
+private:
+	std::vector<struct dive *> dives;	/* sorted by start time */
+	std::vector<size_t> latest_end;		/* index of the latest ending dive of dives[0..i] */
+};
+
+extern std::pair<std::optional<picture>, dive *> create_picture(const picture_matcher &matcher, const std::string &filename, timestamp_t shift_time, bool match_all);
 extern std::pair<std::optional<picture>, dive *> create_picture(const std::string &filename, timestamp_t shift_time, bool match_all);
 extern bool picture_check_valid_time(timestamp_t timestamp, timestamp_t shift_time);
 
@@ -22,20 +22,26 @@
 #include "planner.h"
 #include "range.h"
 #include "subsurface-time.h"
+#include "trace.h"
 #include "gettext.h"
 #include "libdivecomputer/parser.h"
 #include "qthelper.h"
 #include "version.h"
 
+#include <chrono>
+#include <QThread>
+#include <QtConcurrent>
+
 static constexpr int base_timestep = 2; // seconds
+static constexpr size_t max_cva_iterations = 10; // VPM-B plans that haven't converged by then are taken as they are
 
-static int decostoplevels_metric[] = { 0, 3000, 6000, 9000, 12000, 15000, 18000, 21000, 24000, 27000,
+static const int decostoplevels_metric[] = { 0, 3000, 6000, 9000, 12000, 15000, 18000, 21000, 24000, 27000,
 					30000, 33000, 36000, 39000, 42000, 45000, 48000, 51000, 54000, 57000,
 					60000, 63000, 66000, 69000, 72000, 75000, 78000, 81000, 84000, 87000,
 					90000, 100000, 110000, 120000, 130000, 140000, 150000, 160000, 170000,
 					180000, 190000, 200000, 220000, 240000, 260000, 280000, 300000,
 					320000, 340000, 360000, 380000 };
-static int decostoplevels_imperial[] = { 0, 3048, 6096, 9144, 12192, 15240, 18288, 21336, 24384, 27432,
+static const int decostoplevels_imperial[] = { 0, 3048, 6096, 9144, 12192, 15240, 18288, 21336, 24384, 27432,
 					30480, 33528, 36576, 39624, 42672, 45720, 48768, 51816, 54864, 57912,
 					60960, 64008, 67056, 70104, 73152, 76200, 79248, 82296, 85344, 88392,
 					91440, 101600, 111760, 121920, 132080, 142240, 152400, 162560, 172720,
@@ -110,8 +116,59 @@ static void interpolate_transition(struct deco_state *ds, struct dive *dive, dur
 		calc_crushing_pressure(ds, dive->depth_to_bar(d1.mm));
 }
 
+/* One segment between two samples of the user-entered part of a plan */
+struct plan_segment {
+	duration_t t0, t1;
+	depth_t d0, d1;
+	o2pressure_t setpoint;
+	struct gasmix gasmix;
+	enum divemode_t divemode;
+	// The conversion from depth to pressure of the dive
+	int surface_mbar, mbar_at_10m;
+	deco_checkpoint tissues;
+
+	bool same_segment(const plan_segment &b) const
+	{
+		return t0.seconds == b.t0.seconds && t1.seconds == b.t1.seconds &&
+		       d0.mm == b.d0.mm && d1.mm == b.d1.mm &&
+		       setpoint.mbar == b.setpoint.mbar && same_gasmix(gasmix, b.gasmix) &&
+		       divemode == b.divemode &&
+		       surface_mbar == b.surface_mbar && mbar_at_10m == b.mbar_at_10m;
+	}
+};
+
+plan_checkpoints::plan_checkpoints()
+{
+}
+
+plan_checkpoints::~plan_checkpoints()
+{
+}
+
+void plan_checkpoints::clear()
+{
+	segments.clear();
+}
+
+/* Add segment idx to the tissues, unless the checkpoint of an identical segment that started with the same tissues exists */
+static void checkpointed_transition(struct deco_state *ds, struct dive *dive, struct plan_checkpoints &checkpoints, size_t idx, plan_segment segment)
+{
+	std::vector<plan_segment> &segments = checkpoints.segments;
+
+	if (idx < segments.size() && segments[idx].same_segment(segment) && segments[idx].tissues.matches(ds, true)) {
+		segments[idx].tissues.restore(ds);
+		return;
+	}
+	// This and all later segments have to be recalculated
+	segments.resize(idx);
+	struct deco_state before = *ds;
+	interpolate_transition(ds, dive, segment.t0, segment.t1, segment.d0, segment.d1, segment.gasmix, segment.setpoint, segment.divemode);
+	segment.tissues.store(&before, ds, true);
+	segments.push_back(std::move(segment));
+}
+
 /* returns the tissue tolerance at the end of this (partial) dive */
-static int tissue_at_end(struct deco_state *ds, struct dive *dive, const struct divecomputer *dc, deco_state_cache &cache)
+static int tissue_at_end(struct deco_state *ds, struct dive *dive, const struct divecomputer *dc, deco_state_cache &cache, struct plan_checkpoints *checkpoints)
 {
 	depth_t lastdepth;
 	duration_t t0;
@@ -128,7 +185,10 @@ static int tissue_at_end(struct deco_state *ds, struct dive *dive, const struct
 	if (dc->samples.empty())
 		return 0;
 
+	if (decoMode(true) == VPMB)
+		checkpoints = nullptr;
 	const struct sample *psample = nullptr;
+	size_t idx = 0;
 	divemode_loop loop(*dc);
 	for (auto &sample: dc->samples) {
 		o2pressure_t setpoint = psample ? psample->setpoint
@@ -162,10 +222,18 @@ static int tissue_at_end(struct deco_state *ds, struct dive *dive, const struct
 		}
 
 		divemode_t divemode = loop.at(t0.seconds + 1);
-		interpolate_transition(ds, dive, t0, t1, lastdepth, sample.depth, gas, setpoint, divemode);
+		if (checkpoints)
+			checkpointed_transition(ds, dive, *checkpoints, idx++,
+						{ t0, t1, lastdepth, sample.depth, setpoint, gas, divemode,
+						  dive->depth_to_mbar(0), dive->depth_to_mbar(10000), {} });
+		else
+			interpolate_transition(ds, dive, t0, t1, lastdepth, sample.depth, gas, setpoint, divemode);
 		psample = &sample;
 		t0 = t1;
 	}
+	// The plan may have become shorter
+	if (checkpoints)
+		checkpoints->segments.resize(idx);
 	return surface_interval;
 }
 
@@ -220,6 +288,7 @@ static void create_dive_from_plan(struct diveplan &diveplan, struct dive *dive,
 	dc->salinity = diveplan.salinity;
 	dc->samples.clear();
 	dc->events.clear();
+	dive->invalidate_timelines();
 	/* Create first sample at time = 0, not based on dp because
 	 * there is no real dp for time = 0, set first cylinder to 0
 	 * O2 setpoint for this sample will be filled later from next dp */
@@ -400,7 +469,7 @@ static std::vector<gaschanges> analyze_gaslist(const struct diveplan &diveplan,
 }
 
 /* sort all the stops into one ordered list */
-static std::vector<int> sort_stops(int dstops[], size_t dnr, std::vector<gaschanges> gstops)
+static std::vector<int> sort_stops(const int dstops[], size_t dnr, std::vector<gaschanges> gstops)
 {
 	int total = dnr + gstops.size();
 	std::vector<int> stoplevels(total);
@@ -493,16 +562,17 @@ static void track_ascent_gas(int depth, struct dive *dive, int cylinder_id, int
 }
 
 // Determine whether ascending to the next stop will break the ceiling.  Return true if the ascent is ok, false if it isn't.
-static bool trial_ascent(struct deco_state *ds, int wait_time, int trial_depth, int stoplevel, int avg_depth, int bottom_time, struct gasmix gasmix, int po2, double surface_pressure, struct dive *dive, enum divemode_t divemode)
+// The trial works on a copy of the deco state on the stack, so that ds is left untouched.
+static bool trial_ascent(const struct deco_state *ds_in, int wait_time, int trial_depth, int stoplevel, int avg_depth, int bottom_time, struct gasmix gasmix, int po2, double surface_pressure, struct dive *dive, enum divemode_t divemode)
 {
 
 	bool clear_to_ascend = true;
-	deco_state_cache trial_cache;
+	struct deco_state trial = *ds_in;
+	struct deco_state *ds = &trial;
 
 	// For consistency with other VPM-B implementations, we should not start the ascent while the ceiling is
 	// deeper than the next stop (thus the offgasing during the ascent is ignored).
 	// However, we still need to make sure we don't break the ceiling due to on-gassing during ascent.
-	trial_cache.cache(ds);
 	if (wait_time)
 		add_segment(ds, dive->depth_to_bar(trial_depth),
 			    gasmix,
@@ -510,10 +580,8 @@ static bool trial_ascent(struct deco_state *ds, int wait_time, int trial_depth,
 	if (decoMode(true) == VPMB) {
 		double tolerance_limit = tissue_tolerance_calc(ds, dive, dive->depth_to_bar(stoplevel), true);
 		update_regression(ds, dive);
-		if (deco_allowed_depth(tolerance_limit, surface_pressure, dive, 1) > stoplevel) {
-			trial_cache.restore(ds, false);
+		if (deco_allowed_depth(tolerance_limit, surface_pressure, dive, 1) > stoplevel)
 			return false;
-		}
 	}
 
 	while (trial_depth > stoplevel) {
@@ -534,7 +602,6 @@ static bool trial_ascent(struct deco_state *ds, int wait_time, int trial_depth,
 		}
 		trial_depth -= deltad;
 	}
-	trial_cache.restore(ds, false);
 	return clear_to_ascend;
 }
 
@@ -556,26 +623,62 @@ static bool enough_gas(const struct dive *dive, int current_cylinder)
 		return true;
 }
 
-/* Do a binary search for the time the ceiling is clear to ascent to target_depth.
- * Minimal solution is min + 1, and the solution should be an integer multiple of stepsize.
- * leap is a guess for the maximum but there is no guarantee that leap is an upper limit.
- * So we always test at the upper bundary, not in the middle!
+/* Search for the time the ceiling is clear to ascent to target_depth.
+ * The solution is later than clock and an integer multiple of stepsize.
+ * leap is a guess for the length of the stop, but there is no guarantee that it is an upper limit.
+ * So we first double the leap until we find a time that is clear and then bisect between that
+ * time and the latest time that wasn't. Every trial starts from the deco state at the beginning
+ * of the stop: a stop of any length is a single add_segment() call.
+ * If the guess is likely to be right (close_guess), the step before it is tried first.
  */
-static int wait_until(struct deco_state *ds, struct dive *dive, int clock, int min, int leap, int stepsize, int depth, int target_depth, int avg_depth, int bottom_time, struct gasmix gasmix, int po2, double surface_pressure, enum divemode_t divemode)
+static int wait_until(const struct deco_state *ds, struct dive *dive, int clock, int leap, bool close_guess, int stepsize, int depth, int target_depth, int avg_depth, int bottom_time, struct gasmix gasmix, int po2, double surface_pressure, enum divemode_t divemode)
 {
-	// When a deco stop exceeds two days, there is something wrong...
-	if (min >= 48 * 3600)
-		return 50 * 3600;
-	// Round min + leap up to the next multiple of stepsize
-	int upper = min + leap + stepsize - 1 - (min + leap - 1) % stepsize;
-	// Is the upper boundary too small?
-	if (!trial_ascent(ds, upper - clock, depth, target_depth, avg_depth, bottom_time, gasmix, po2, surface_pressure, dive, divemode))
-		return wait_until(ds, dive, clock, upper, leap, stepsize, depth, target_depth, avg_depth, bottom_time, gasmix, po2, surface_pressure, divemode);
-
-	if (upper - min <= stepsize)
+	// Round up to the next multiple of stepsize
+	auto round_up = [stepsize](int t) { return t + stepsize - 1 - (t - 1) % stepsize; };
+	auto clear_at = [&](int t) {
+		return trial_ascent(ds, t - clock, depth, target_depth, avg_depth, bottom_time, gasmix, po2, surface_pressure, dive, divemode);
+	};
+
+	// lower is the latest time that is known not to be clear, upper the earliest that is.
+	int lower = clock;
+	int upper = round_up(clock + std::max(leap, 1));
+	while (!clear_at(upper)) {
+		lower = upper;
+		// When a deco stop exceeds two days, there is something wrong...
+		if (lower >= 48 * 3600)
+			return 50 * 3600;
+		leap = std::max(leap, stepsize) * 2;
+		upper = round_up(lower + leap);
+		close_guess = false;
+	}
+	if (close_guess && upper - lower > stepsize && !clear_at(upper - stepsize))
 		return upper;
 
-	return wait_until(ds, dive, clock, min, leap / 2, stepsize, depth, target_depth, avg_depth, bottom_time, gasmix, po2, surface_pressure, divemode);
+	while (upper - lower > stepsize) {
+		// The number of candidate times in (lower, upper]
+		int candidates = (upper - lower + stepsize - 1) / stepsize;
+		int mid = upper - candidates / 2 * stepsize;
+		if (clear_at(mid)) {
+			upper = mid;
+		} else {
+			lower = mid;
+			if (lower >= 48 * 3600)
+				return 50 * 3600;
+		}
+	}
+	return upper;
+}
+
+/* The length of the next stop at depth in the stops of the previous CVA iteration, or 0 if there was none */
+static int previous_stop_time(const std::vector<decostop> &stops, size_t &idx, int depth)
+{
+	for (size_t i = idx; i < stops.size() && stops[i].depth >= depth; i++) {
+		if (stops[i].depth == depth && stops[i].time > 0) {
+			idx = i + 1;
+			return stops[i].time;
+		}
+	}
+	return 0;
 }
 
 static void average_max_depth(const struct diveplan &dive, int *avg_depth, int *max_depth)
@@ -602,8 +705,10 @@ static void average_max_depth(const struct diveplan &dive, int *avg_depth, int *
 		*avg_depth = *max_depth = 0;
 }
 
-std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, struct dive *dive, int dcNr, int timestep, deco_state_cache &cache, bool is_planner, bool show_disclaimer)
+std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, struct dive *dive, int dcNr, int timestep, deco_state_cache &cache, bool is_planner, bool show_disclaimer,
+			   struct plan_checkpoints *checkpoints)
 {
+	TRACE_ZONE("plan");
 
 	int bottom_depth;
 	int bottom_gi;
@@ -617,8 +722,7 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 	int current_cylinder, stop_cylinder;
 	size_t stopidx;
 	int depth;
-	int *decostoplevels;
-	size_t decostoplevelcount;
+	std::vector<int> decostoplevels;
 	std::vector<int> stoplevels;
 	bool stopping = false;
 	bool pendinggaschange = false;
@@ -637,8 +741,8 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 	struct divecomputer *dc = dive->get_dc(dcNr);
 	enum divemode_t divemode = dc->divemode;
 
-	set_gf(diveplan.gflow, diveplan.gfhigh);
-	set_vpmb_conservatism(diveplan.vpmb_conservatism);
+	set_gf(ds, diveplan.gflow, diveplan.gfhigh);
+	set_vpmb_conservatism(ds, diveplan.vpmb_conservatism);
 
 	if (diveplan.surface_pressure.mbar == 0) {
 		// Lets use dive's surface pressure in planner, if have one...
@@ -657,21 +761,18 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 
 	// Do we want deco stop array in metres or feet?
 	if (prefs.units.length == units::METERS ) {
-		decostoplevels = decostoplevels_metric;
-		decostoplevelcount = std::size(decostoplevels_metric);
+		decostoplevels.assign(std::begin(decostoplevels_metric), std::end(decostoplevels_metric));
 	} else {
-		decostoplevels = decostoplevels_imperial;
-		decostoplevelcount = std::size(decostoplevels_imperial);
+		decostoplevels.assign(std::begin(decostoplevels_imperial), std::end(decostoplevels_imperial));
 	}
 
 	/* If the user has selected last stop to be at 6m/20', we need to get rid of the 3m/10' stop.
 	 * Otherwise reinstate the last stop 3m/10' stop.
-	 * Remark: not reentrant, but the user probably won't change preferences while this is running.
 	 */
 	if (prefs.last_stop)
-		*(decostoplevels + 1) = 0;
+		decostoplevels[1] = 0;
 	else
-		*(decostoplevels + 1) = M_OR_FT(3,10);
+		decostoplevels[1] = M_OR_FT(3,10);
 
 	/* Let's start at the last 'sample', i.e. the last manually entered waypoint. */
 	const struct sample &sample = dc->samples.back();
@@ -716,19 +817,19 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 	}
 
 	/* Find the first potential decostopdepth above current depth */
-	for (stopidx = 0; stopidx < decostoplevelcount; stopidx++)
+	for (stopidx = 0; stopidx < decostoplevels.size(); stopidx++)
 		if (decostoplevels[stopidx] > depth)
 			break;
 	if (stopidx > 0)
 		stopidx--;
 	/* Stoplevels are either depths of gas changes or potential deco stop depths. */
-	stoplevels = sort_stops(decostoplevels, stopidx + 1, gaschanges);
+	stoplevels = sort_stops(decostoplevels.data(), stopidx + 1, gaschanges);
 	stopidx += gaschanges.size();
 
 	gi = static_cast<int>(gaschanges.size()) - 1;
 
 	/* Set tissue tolerance and initial vpmb gradient at start of ascent phase */
-	diveplan.surface_interval = tissue_at_end(ds, dive, dc, cache);
+	diveplan.surface_interval = tissue_at_end(ds, dive, dc, cache, checkpoints);
 	nuclear_regeneration(ds, clock);
 	vpmb_start_gradient(ds);
 	if (decoMode(true) == RECREATIONAL) {
@@ -794,7 +895,7 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 	}
 
 	// VPM-B or Buehlmann Deco
-	tissue_at_end(ds, dive, dc, cache);
+	tissue_at_end(ds, dive, dc, cache, checkpoints);
 	if ((divemode == CCR || divemode == PSCR) && prefs.dobailout) {
 		divemode = OC;
 		po2 = 0;
@@ -814,10 +915,16 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 	bottom_stopidx = stopidx;
 
 	//CVA
-	std::vector<decostop> decostoptable;
+	std::vector<decostop> decostoptable, previous_decostoptable;
+	diveplan.cva_iteration_usec.clear();
 	do {
+		auto iteration_start = std::chrono::steady_clock::now();
+		// Each iteration starts its stop searches at the stops of the previous one
+		previous_decostoptable = std::move(decostoptable);
 		decostoptable.clear();
-		is_final_plan = (decoMode(true) == BUEHLMANN) || (previous_deco_time - ds->deco_time < 10);  // CVA time converges
+		size_t previous_stop = 0;
+		is_final_plan = (decoMode(true) == BUEHLMANN) || (previous_deco_time - ds->deco_time < 10) || // CVA time converges
+				diveplan.cva_iteration_usec.size() + 1 >= max_cva_iterations;
 		if (ds->deco_time != 10000000)
 			vpmb_next_gradient(ds, ds->deco_time, diveplan.surface_pressure.mbar / 1000.0, true);
 
@@ -968,8 +1075,10 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 					pendinggaschange = false;
 				}
 
-				int new_clock = wait_until(ds, dive, clock, clock, laststoptime * 2 + 1, timestep, depth, stoplevels[stopidx], avg_depth,
-					bottom_time, dive->get_cylinder(current_cylinder)->gasmix, po2, diveplan.surface_pressure.mbar / 1000.0, divemode);
+				int previous_time = previous_stop_time(previous_decostoptable, previous_stop, depth);
+				int new_clock = wait_until(ds, dive, clock, previous_time ? previous_time : laststoptime * 2 + 1, previous_time != 0, timestep,
+					depth, stoplevels[stopidx], avg_depth, bottom_time, dive->get_cylinder(current_cylinder)->gasmix, po2,
+					diveplan.surface_pressure.mbar / 1000.0, divemode);
 				laststoptime = new_clock - clock;
 				/* Finish infinite deco */
 				if (laststoptime >= 48 * 3600 && depth >= 6000) {
@@ -1037,6 +1146,8 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 		 * if the ascent rate is slower, which is completely nonsensical.
 		 * Assume final ascent takes 20s, which is the time taken to ascend at 9m/min from 3m */
 		ds->deco_time = clock - bottom_time - (M_OR_FT(3,10) * ( prefs.last_stop ? 2 : 1)) / last_ascend_rate + 20;
+		diveplan.cva_iteration_usec.push_back((int)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - iteration_start).count());
 	} while (!is_final_plan && error == PLAN_OK);
 
 	plan_add_segment(diveplan, clock - previous_point_time, 0, current_cylinder, po2, false, divemode);
@@ -1059,3 +1170,42 @@ std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, str
 	fixup_dc_duration(*dc);
 	return decostoptable;
 }
+
+static void plan_one_variant(plan_variant &variant, const struct deco_state *ds, const struct dive *dive, int dcNr, int timestep)
+{
+	struct dive d;
+	struct deco_state state = *ds;
+	deco_state_cache cache;
+
+	copy_dive(dive, &d);
+	variant.stops = plan(&state, variant.plan, &d, dcNr, timestep, cache, true, false);
+	variant.runtime = d.get_dc(dcNr)->duration;
+	for (const decostop &stop: variant.stops) {
+		if (stop.time <= 0)
+			continue;
+		variant.deco_time.seconds += stop.time;
+		variant.first_stop.mm = std::max(variant.first_stop.mm, stop.depth);
+	}
+	variant.cns = d.maxcns;
+	variant.otu = d.otu;
+}
+
+std::vector<plan_variant> plan_variants(const struct deco_state *ds, const std::vector<diveplan> &variants, const struct dive *dive, int dcNr, int timestep,
+					const std::function<bool()> &cancelled)
+{
+	std::vector<plan_variant> res(variants.size());
+
+	for (size_t i = 0; i < variants.size(); i++)
+		res[i].plan = variants[i];
+	auto fn = [ds, dive, dcNr, timestep, &cancelled](plan_variant &variant) {
+		if (!cancelled || !cancelled())
+			plan_one_variant(variant, ds, dive, dcNr, timestep);
+	};
+	if (res.size() > 1 && QThread::idealThreadCount() > 1) {
+		QtConcurrent::blockingMap(res, fn);
+	} else {
+		for (plan_variant &variant: res)
+			fn(variant);
+	}
+	return res;
+}
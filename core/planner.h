@@ -4,6 +4,7 @@
 
 #include "units.h"
 #include "divemode.h"
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -49,6 +50,7 @@ struct diveplan {
 	std::vector<divedatapoint> dp;
 	int eff_gflow = 0, eff_gfhigh = 0;
 	int surface_interval = 0;
+	std::vector<int> cva_iteration_usec; /* the duration of each VPM-B ascent iteration of the last plan() */
 
 	bool is_empty() const;
 	void add_plan_to_notes(struct dive &dive, bool show_disclaimer, planner_error_t error);
@@ -57,6 +59,21 @@ struct diveplan {
 
 struct deco_state_cache;
 
+/*
+ * The tissues after each segment of the user-entered part of a plan.
+ * The caller keeps them between calls of plan() for the same dive, so
+ * that moving a waypoint only recalculates the tissues from that
+ * waypoint on. Not used for VPM-B, whose bottom ceiling depends on
+ * more than the tissues.
+ */
+struct plan_segment;
+struct plan_checkpoints {
+	plan_checkpoints();
+	~plan_checkpoints();
+	void clear();
+	std::vector<plan_segment> segments;
+};
+
 extern int get_cylinderid_at_time(struct dive *dive, struct divecomputer *dc, duration_t time);
 extern const char *get_planner_disclaimer();
 
@@ -70,5 +87,27 @@ struct decostop {
 };
 
 extern std::string get_planner_disclaimer_formatted();
-extern std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, struct dive *dive, int dcNr, int timestep, deco_state_cache &cache, bool is_planner, bool show_disclaimer);
+extern std::vector<decostop> plan(struct deco_state *ds, struct diveplan &diveplan, struct dive *dive, int dcNr, int timestep, deco_state_cache &cache, bool is_planner, bool show_disclaimer,
+				  struct plan_checkpoints *checkpoints = nullptr);
+
+/* One row of the comparison made by plan_variants() */
+struct plan_variant {
+	struct diveplan plan;		/* the input variant, completed by the planner */
+	std::vector<decostop> stops;
+	duration_t runtime;
+	duration_t deco_time;		/* total time at the stops */
+	depth_t first_stop;
+	int cns = 0, otu = 0;
+};
+
+/*
+ * Plan all variants of the given dive, e.g. with different gradient
+ * factors, gases or bottom times, starting from the tissue state ds.
+ * Each variant is planned on its own copies of the dive and deco state,
+ * on a thread pool if there are enough of them.
+ * If cancelled returns true, the variants that haven't been started yet
+ * are skipped and left without stops.
+ */
+extern std::vector<plan_variant> plan_variants(const struct deco_state *ds, const std::vector<diveplan> &variants, const struct dive *dive, int dcNr, int timestep,
+					       const std::function<bool()> &cancelled = {});
 #endif // PLANNER_H
@@ -48,22 +48,21 @@ int diveplan::duration() const
  *             5) Pointers to gas mixes in the gas change: gas-from and gas-to.
  * Returns:    The size of the output buffer that has been used after the new results have been added.
  */
-static std::string icd_entry(struct icd_data *icdvalues, bool printheader, int time_seconds, int ambientpressure_mbar, struct gasmix gas_from, struct gasmix gas_to)
+static void add_icd_entry(std::string &b, struct icd_data *icdvalues, bool printheader, int time_seconds, int ambientpressure_mbar, struct gasmix gas_from, struct gasmix gas_to)
 {
-	std::string b;
 	if (printheader) { // Create a table description and a table header if no icd data have been written yet.
-		b += format_string_std("<div>%s:", translate("gettextFromC","Isobaric counterdiffusion information"));
-		b += format_string_std("<table><tr><td align='left'><b>%s</b></td>", translate("gettextFromC", "runtime"));
-		b += format_string_std("<td align='center'><b>%s</b></td>", translate("gettextFromC", "gaschange"));
-		b += format_string_std("<td style='padding-left: 15px;'><b>%s</b></td>", translate("gettextFromC", "&#916;He"));
-		b += format_string_std("<td style='padding-left: 20px;'><b>%s</b></td>", translate("gettextFromC", "&#916;N&#8322;"));
-		b += format_string_std("<td style='padding-left: 10px;'><b>%s</b></td></tr>", translate("gettextFromC", "max &#916;N&#8322;"));
+		append_format_std(b, "<div>%s:", translate("gettextFromC","Isobaric counterdiffusion information"));
+		append_format_std(b, "<table><tr><td align='left'><b>%s</b></td>", translate("gettextFromC", "runtime"));
+		append_format_std(b, "<td align='center'><b>%s</b></td>", translate("gettextFromC", "gaschange"));
+		append_format_std(b, "<td style='padding-left: 15px;'><b>%s</b></td>", translate("gettextFromC", "&#916;He"));
+		append_format_std(b, "<td style='padding-left: 20px;'><b>%s</b></td>", translate("gettextFromC", "&#916;N&#8322;"));
+		append_format_std(b, "<td style='padding-left: 10px;'><b>%s</b></td></tr>", translate("gettextFromC", "max &#916;N&#8322;"));
 	}		// Add one entry to the icd table:
-	b += casprintf_loc(
+	append_format_loc(b, 
 		"<tr><td rowspan='2' style= 'vertical-align:top;'>%3d%s</td>"
 		"<td rowspan=2 style= 'vertical-align:top;'>%s&#10137;",
 		(time_seconds + 30) / 60, translate("gettextFromC", "min"), gas_from.name().c_str());
-	b += casprintf_loc(
+	append_format_loc(b, 
 		"%s</td><td style='padding-left: 10px;'>%+5.1f%%</td>"
 		"<td style= 'padding-left: 15px; color:%s;'>%+5.1f%%</td>"
 		"<td style='padding-left: 15px;'>%+5.1f%%</td></tr>"
@@ -75,7 +74,6 @@ static std::string icd_entry(struct icd_data *icdvalues, bool printheader, int t
 		ambientpressure_mbar * icdvalues->dHe / 1e6f, translate("gettextFromC", "bar"), ((5 * icdvalues->dN2) > -icdvalues->dHe) ? "red" : "#383838",
 		ambientpressure_mbar * icdvalues->dN2 / 1e6f, translate("gettextFromC", "bar"),
 		ambientpressure_mbar * -icdvalues->dHe / 5e6f, translate("gettextFromC", "bar"));
-	return b;
 }
 
 const char *get_planner_disclaimer()
@@ -94,54 +92,17 @@ extern std::string get_planner_disclaimer_formatted()
 	return format_string_std(get_planner_disclaimer(), deco);
 }
 
-void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planner_error_t error)
-{
+// The ICD table of the plan, filled by add_icd_entry().
+struct icd_table {
 	std::string buf;
-	std::string icdbuf;
-	const char *segmentsymbol;
-	int lastdepth = 0, lasttime = 0, lastsetpoint = -1, newdepth = 0, lastprintdepth = 0, lastprintsetpoint = -1;
-	struct gasmix lastprintgasmix = gasmix_invalid;
-	bool plan_verbatim = prefs.verbatim_plan;
-	bool plan_display_runtime = prefs.display_runtime;
-	bool plan_display_duration = prefs.display_duration;
-	bool plan_display_transitions = prefs.display_transitions;
-	bool rebreatherchange_after = !plan_verbatim;
-	bool rebreatherchange_before;
-	enum divemode_t lastdivemode = UNDEF_COMP_TYPE;
-	bool lastentered = true;
-	bool icdwarning = false, icdtableheader = true;
-	struct divedatapoint *lastbottomdp = nullptr;
-	struct icd_data icdvalues;
-
-	if (dp.empty())
-		return;
-
-	if (error != PLAN_OK) {
-		const char *message;
-		switch (error) {
-		case PLAN_ERROR_TIMEOUT:
-			message = translate("gettextFromC", "Decompression calculation aborted due to excessive time");
-
-			break;
-		case PLAN_ERROR_INAPPROPRIATE_GAS:
-			message = translate("gettextFromC", "One or more tanks with a tank use type inappropriate for the selected dive mode are included in the dive plan. "
-				"Please change them to appropriate tanks to enable the generation of a dive plan.");
-
-			break;
-		default:
-			message = translate("gettextFromC", "An error occurred during dive plan generation");
-
-			break;
-		}
-
-		buf += format_string_std("<span style='color: red;'>%s </span> %s<br/>",
-			translate("gettextFromC", "Warning:"), message);
-
-		dive.notes = std::move(buf);
-
-		return;
-	}
+	bool header = true;	// No entry yet: the next one writes the header
+	bool warning = false;
+};
 
+// The notes are made of the following sections, which append to one buffer.
+// Returns false if the plan overlaps with other dives, in which case there is nothing more to say.
+static bool add_plan_header(std::string &buf, const diveplan &plan, bool show_disclaimer)
+{
 	if (show_disclaimer) {
 		buf += "<div><b>";
 		buf += get_planner_disclaimer_formatted();
@@ -149,49 +110,68 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 	}
 
 	buf += "<div>\n<b>";
-	if (surface_interval < 0) {
-		buf += format_string_std("%s (%s) %s",
+	if (plan.surface_interval < 0) {
+		append_format_std(buf, "%s (%s) %s",
 			translate("gettextFromC", "Subsurface"),
 			subsurface_canonical_version(),
 			translate("gettextFromC", "dive plan</b> (overlapping dives detected)"));
-		dive.notes = std::move(buf);
-		return;
-	} else if (surface_interval >= 48 * 60 *60) {
-		buf += format_string_std("%s (%s) %s %s",
+		return false;
+	} else if (plan.surface_interval >= 48 * 60 *60) {
+		append_format_std(buf, "%s (%s) %s %s",
 			translate("gettextFromC", "Subsurface"),
 			subsurface_canonical_version(),
 			translate("gettextFromC", "dive plan</b> created on"),
 			get_current_date().c_str());
 	} else {
-		buf += casprintf_loc("%s (%s) %s %d:%02d) %s %s",
+		append_format_loc(buf, "%s (%s) %s %d:%02d) %s %s",
 			translate("gettextFromC", "Subsurface"),
 			subsurface_canonical_version(),
 			translate("gettextFromC", "dive plan</b> (surface interval "),
-			FRACTION_TUPLE(surface_interval / 60, 60),
+			FRACTION_TUPLE(plan.surface_interval / 60, 60),
 			translate("gettextFromC", "created on"),
 			get_current_date().c_str());
 	}
 	buf += "<br/>\n";
 
 	if (prefs.display_variations && decoMode(true) != RECREATIONAL)
-		buf += casprintf_loc(translate("gettextFromC", "Runtime: %dmin%s"),
-			duration(), "VARIATIONS");
+		append_format_loc(buf, translate("gettextFromC", "Runtime: %dmin%s"),
+			plan.duration(), "VARIATIONS");
 	else
-		buf += casprintf_loc(translate("gettextFromC", "Runtime: %dmin%s"),
-			duration(), "");
+		append_format_loc(buf, translate("gettextFromC", "Runtime: %dmin%s"),
+			plan.duration(), "");
 	buf += "<br/>\n</div>\n";
+	return true;
+}
+
+// The table (or the verbatim list) of the waypoints. Returns the last user-entered
+// waypoint before the ascent, for the minimum gas calculation.
+static struct divedatapoint *add_plan_waypoints(std::string &buf, icd_table &icd, std::vector<divedatapoint> &dps, const struct dive &dive)
+{
+	const char *segmentsymbol;
+	int lastdepth = 0, lasttime = 0, lastsetpoint = -1, newdepth = 0, lastprintdepth = 0, lastprintsetpoint = -1;
+	struct gasmix lastprintgasmix = gasmix_invalid;
+	bool plan_verbatim = prefs.verbatim_plan;
+	bool plan_display_runtime = prefs.display_runtime;
+	bool plan_display_duration = prefs.display_duration;
+	bool plan_display_transitions = prefs.display_transitions;
+	bool rebreatherchange_after = !plan_verbatim;
+	bool rebreatherchange_before;
+	enum divemode_t lastdivemode = UNDEF_COMP_TYPE;
+	bool lastentered = true;
+	struct divedatapoint *lastbottomdp = nullptr;
+	struct icd_data icdvalues;
 
 	if (!plan_verbatim) {
-		buf += format_string_std("<table>\n<thead>\n<tr><th></th><th>%s</th>", translate("gettextFromC", "depth"));
+		append_format_std(buf, "<table>\n<thead>\n<tr><th></th><th>%s</th>", translate("gettextFromC", "depth"));
 		if (plan_display_duration)
-			buf += format_string_std("<th style='padding-left: 10px;'>%s</th>", translate("gettextFromC", "duration"));
+			append_format_std(buf, "<th style='padding-left: 10px;'>%s</th>", translate("gettextFromC", "duration"));
 		if (plan_display_runtime)
-			buf += format_string_std("<th style='padding-left: 10px;'>%s</th>", translate("gettextFromC", "runtime"));
-		buf += format_string_std("<th style='padding-left: 10px; float: left;'>%s</th></tr>\n</thead>\n<tbody style='float: left;'>\n",
+			append_format_std(buf, "<th style='padding-left: 10px;'>%s</th>", translate("gettextFromC", "runtime"));
+		append_format_std(buf, "<th style='padding-left: 10px; float: left;'>%s</th></tr>\n</thead>\n<tbody style='float: left;'>\n",
 				translate("gettextFromC", "gas"));
 	}
 
-	for (auto dp = this->dp.begin(); dp != this->dp.end(); ++dp) {
+	for (auto dp = dps.begin(); dp != dps.end(); ++dp) {
 		auto nextdp = std::next(dp);
 		struct gasmix gasmix, newgasmix = {};
 		const char *depth_unit;
@@ -204,9 +184,9 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 		gasmix = dive.get_cylinder(dp->cylinderid)->gasmix;
 		depthvalue = get_depth_units(dp->depth.mm, &decimals, &depth_unit);
 		/* analyze the dive points ahead */
-		while (nextdp != this->dp.end() && nextdp->time == 0)
+		while (nextdp != dps.end() && nextdp->time == 0)
 			++nextdp;
-		bool atend = nextdp == this->dp.end();
+		bool atend = nextdp == dps.end();
 		if (!atend)
 			newgasmix = dive.get_cylinder(nextdp->cylinderid)->gasmix;
 		bool gaschange_after = (!atend && (gasmix_distance(gasmix, newgasmix)));
@@ -243,7 +223,7 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 			if (dp->depth.mm != lastprintdepth) {
 				if (plan_display_transitions || dp->entered || atend || (gaschange_after && !atend && dp->depth.mm != nextdp->depth.mm)) {
 					if (dp->setpoint) {
-						buf += casprintf_loc(translate("gettextFromC", "%s to %.*f %s in %d:%02d min - runtime %d:%02u on %s (SP = %.1fbar)"),
+						append_format_loc(buf, translate("gettextFromC", "%s to %.*f %s in %d:%02d min - runtime %d:%02u on %s (SP = %.1fbar)"),
 							     dp->depth.mm < lastprintdepth ? translate("gettextFromC", "Ascend") : translate("gettextFromC", "Descend"),
 							     decimals, depthvalue, depth_unit,
 							     FRACTION_TUPLE(dp->time - lasttime, 60),
@@ -251,7 +231,7 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 							     gasmix.name().c_str(),
 							     (double) dp->setpoint / 1000.0);
 					} else {
-						buf += casprintf_loc(translate("gettextFromC", "%s to %.*f %s in %d:%02d min - runtime %d:%02u on %s"),
+						append_format_loc(buf, translate("gettextFromC", "%s to %.*f %s in %d:%02d min - runtime %d:%02u on %s"),
 							     dp->depth.mm < lastprintdepth ? translate("gettextFromC", "Ascend") : translate("gettextFromC", "Descend"),
 							     decimals, depthvalue, depth_unit,
 							     FRACTION_TUPLE(dp->time - lasttime, 60),
@@ -266,14 +246,14 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 			} else {
 				if ((!atend && dp->depth.mm != nextdp->depth.mm) || gaschange_after) {
 					if (dp->setpoint) {
-						buf += casprintf_loc(translate("gettextFromC", "Stay at %.*f %s for %d:%02d min - runtime %d:%02u on %s (SP = %.1fbar CCR)"),
+						append_format_loc(buf, translate("gettextFromC", "Stay at %.*f %s for %d:%02d min - runtime %d:%02u on %s (SP = %.1fbar CCR)"),
 							     decimals, depthvalue, depth_unit,
 							     FRACTION_TUPLE(dp->time - lasttime, 60),
 							     FRACTION_TUPLE(dp->time, 60),
 							     gasmix.name().c_str(),
 							     (double) dp->setpoint / 1000.0);
 					} else {
-						buf += casprintf_loc(translate("gettextFromC", "Stay at %.*f %s for %d:%02d min - runtime %d:%02u on %s %s"),
+						append_format_loc(buf, translate("gettextFromC", "Stay at %.*f %s for %d:%02d min - runtime %d:%02u on %s %s"),
 							     decimals, depthvalue, depth_unit,
 							     FRACTION_TUPLE(dp->time - lasttime, 60),
 							     FRACTION_TUPLE(dp->time, 60),
@@ -318,17 +298,17 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 				else
 					segmentsymbol = "-";        // minus sign (a.k.a. horizontal line) for deco stop
 
-				buf += format_string_std("<tr><td style='padding-left: 10px; float: right;'>%s</td>", segmentsymbol);
+				append_format_std(buf, "<tr><td style='padding-left: 10px; float: right;'>%s</td>", segmentsymbol);
 
 				std::string temp = casprintf_loc(translate("gettextFromC", "%3.0f%s"), depthvalue, depth_unit);
-				buf += format_string_std("<td style='padding-left: 10px; float: right;'>%s</td>", temp.c_str());
+				append_format_std(buf, "<td style='padding-left: 10px; float: right;'>%s</td>", temp.c_str());
 				if (plan_display_duration) {
 					temp = casprintf_loc(translate("gettextFromC", "%3dmin"), (dp->time - lasttime + 30) / 60);
-					buf += format_string_std("<td style='padding-left: 10px; float: right;'>%s</td>", temp.c_str());
+					append_format_std(buf, "<td style='padding-left: 10px; float: right;'>%s</td>", temp.c_str());
 				}
 				if (plan_display_runtime) {
 					temp = casprintf_loc(translate("gettextFromC", "%3dmin"), (dp->time + 30) / 60);
-					buf += format_string_std("<td style='padding-left: 10px; float: right;'>%s</td>", temp.c_str());
+					append_format_std(buf, "<td style='padding-left: 10px; float: right;'>%s</td>", temp.c_str());
 				}
 
 				/* Normally a gas change is displayed on the stopping segment, so only display a gas change at the end of
@@ -337,17 +317,17 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 				if (isascent && gaschange_after && !atend && nextdp->entered) {
 					if (nextdp->setpoint) {
 						temp = casprintf_loc(translate("gettextFromC", "(SP = %.1fbar CCR)"), nextdp->setpoint / 1000.0);
-						buf += format_string_std("<td style='padding-left: 10px; color: red; float: left;'><b>%s %s</b></td>",
+						append_format_std(buf, "<td style='padding-left: 10px; color: red; float: left;'><b>%s %s</b></td>",
 							newgasmix.name().c_str(), temp.c_str());
 					} else {
-						buf += format_string_std("<td style='padding-left: 10px; color: red; float: left;'><b>%s %s</b></td>",
+						append_format_std(buf, "<td style='padding-left: 10px; color: red; float: left;'><b>%s %s</b></td>",
 							newgasmix.name().c_str(), dp->divemode == UNDEF_COMP_TYPE || dp->divemode == nextdp->divemode ? "" : translate("gettextFromC", divemode_text_ui[nextdp->divemode]));
 						if (isascent && (get_he(lastprintgasmix) > 0)) { // For a trimix gas change on ascent, save ICD info if previous cylinder had helium
 							if (isobaric_counterdiffusion(lastprintgasmix, newgasmix, &icdvalues)) // Do icd calulations
-								icdwarning = true;
+								icd.warning = true;
 							if (icdvalues.dN2 > 0) { // If the gas change involved helium as well as an increase in nitrogen..
-								icdbuf += icd_entry(&icdvalues, icdtableheader, dp->time, dive.depth_to_mbar(dp->depth.mm), lastprintgasmix, newgasmix); // .. then print calculations to buffer.
-								icdtableheader = false;
+								add_icd_entry(icd.buf, &icdvalues, icd.header, dp->time, dive.depth_to_mbar(dp->depth.mm), lastprintgasmix, newgasmix); // .. then print calculations to buffer.
+								icd.header = false;
 							}
 						}
 					}
@@ -359,16 +339,16 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 					// If a new gas has been used for this segment, now is the time to show it
 					if (dp->setpoint) {
 						temp = casprintf_loc(translate("gettextFromC", "(SP = %.1fbar CCR)"), (double) dp->setpoint / 1000.0);
-						buf += format_string_std("<td style='padding-left: 10px; color: red; float: left;'><b>%s %s</b></td>", gasmix.name().c_str(), temp.c_str());
+						append_format_std(buf, "<td style='padding-left: 10px; color: red; float: left;'><b>%s %s</b></td>", gasmix.name().c_str(), temp.c_str());
 					} else {
-						buf += format_string_std("<td style='padding-left: 10px; color: red; float: left;'><b>%s %s</b></td>", gasmix.name().c_str(),
+						append_format_std(buf, "<td style='padding-left: 10px; color: red; float: left;'><b>%s %s</b></td>", gasmix.name().c_str(),
 							   lastdivemode == UNDEF_COMP_TYPE || lastdivemode == dp->divemode ? "" : translate("gettextFromC", divemode_text_ui[dp->divemode]));
 						if (get_he(lastprintgasmix) > 0) {  // For a trimix gas change, save ICD info if previous cylinder had helium
 							if (isobaric_counterdiffusion(lastprintgasmix, gasmix, &icdvalues))  // Do icd calculations
-								icdwarning = true;
+								icd.warning = true;
 							if (icdvalues.dN2 > 0) { // If the gas change involved helium as well as an increase in nitrogen..
-								icdbuf += icd_entry(&icdvalues, icdtableheader, lasttime, dive.depth_to_mbar(dp->depth.mm), lastprintgasmix, gasmix); // .. then print data to buffer.
-								icdtableheader = false;
+								add_icd_entry(icd.buf, &icdvalues, icd.header, lasttime, dive.depth_to_mbar(dp->depth.mm), lastprintgasmix, gasmix); // .. then print data to buffer.
+								icd.header = false;
 							}
 						}
 					}
@@ -391,15 +371,15 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 			if (plan_verbatim) {
 				if (lastsetpoint >= 0) {
 					if (!atend && nextdp->setpoint) {
-						buf += casprintf_loc(translate("gettextFromC", "Switch gas to %s (SP = %.1fbar)"), newgasmix.name().c_str(), (double) nextdp->setpoint / 1000.0);
+						append_format_loc(buf, translate("gettextFromC", "Switch gas to %s (SP = %.1fbar)"), newgasmix.name().c_str(), (double) nextdp->setpoint / 1000.0);
 					} else {
-						buf += format_string_std(translate("gettextFromC", "Switch gas to %s"), newgasmix.name().c_str());
+						append_format_std(buf, translate("gettextFromC", "Switch gas to %s"), newgasmix.name().c_str());
 						if ((isascent) && (get_he(lastprintgasmix) > 0)) {          // For a trimix gas change on ascent:
 							if (isobaric_counterdiffusion(lastprintgasmix, newgasmix, &icdvalues)) // Do icd calculations
-								icdwarning = true;
+								icd.warning = true;
 							if (icdvalues.dN2 > 0) { // If the gas change involved helium as well as an increase in nitrogen..
-								icdbuf += icd_entry(&icdvalues, icdtableheader, dp->time, dive.depth_to_mbar(dp->depth.mm), lastprintgasmix, newgasmix); // ... then print data to buffer.
-								icdtableheader = false;
+								add_icd_entry(icd.buf, &icdvalues, icd.header, dp->time, dive.depth_to_mbar(dp->depth.mm), lastprintgasmix, newgasmix); // ... then print data to buffer.
+								icd.header = false;
 							}
 						}
 					}
@@ -416,39 +396,46 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 	}
 	if (!plan_verbatim)
 		buf += "</tbody>\n</table>\n<br/>\n";
+	return lastbottomdp;
+}
 
-	/* Print the CNS and OTU next.*/
+static void add_cns_otu(std::string &buf, struct dive &dive)
+{
 	dive.cns = 0;
 	dive.maxcns = 0;
 	divelog.dives.update_cylinder_related_info(dive);
-	buf += casprintf_loc("<div>\n%s: %i%%", translate("gettextFromC", "CNS"), dive.cns);
-	buf += casprintf_loc("<br/>\n%s: %i<br/>\n</div>\n", translate("gettextFromC", "OTU"), dive.otu);
+	append_format_loc(buf, "<div>\n%s: %i%%", translate("gettextFromC", "CNS"), dive.cns);
+	append_format_loc(buf, "<br/>\n%s: %i<br/>\n</div>\n", translate("gettextFromC", "OTU"), dive.otu);
+}
 
-	/* Print the settings for the diveplan next. */
+static void add_deco_settings(std::string &buf, const diveplan &plan)
+{
 	buf += "<div>\n";
 	if (decoMode(true) == BUEHLMANN) {
-		buf += casprintf_loc(translate("gettextFromC", "Deco model: Bühlmann ZHL-16C with GFLow = %d%% and GFHigh = %d%%"), gflow, gfhigh);
+		append_format_loc(buf, translate("gettextFromC", "Deco model: Bühlmann ZHL-16C with GFLow = %d%% and GFHigh = %d%%"), plan.gflow, plan.gfhigh);
 	} else if (decoMode(true) == VPMB) {
-		if (vpmb_conservatism == 0)
+		if (plan.vpmb_conservatism == 0)
 			buf += translate("gettextFromC", "Deco model: VPM-B at nominal conservatism");
 		else
-			buf += casprintf_loc(translate("gettextFromC", "Deco model: VPM-B at +%d conservatism"), vpmb_conservatism);
-		if (eff_gflow)
-			buf += casprintf_loc( translate("gettextFromC", ", effective GF=%d/%d"), eff_gflow, eff_gfhigh);
+			append_format_loc(buf, translate("gettextFromC", "Deco model: VPM-B at +%d conservatism"), plan.vpmb_conservatism);
+		if (plan.eff_gflow)
+			append_format_loc(buf,  translate("gettextFromC", ", effective GF=%d/%d"), plan.eff_gflow, plan.eff_gfhigh);
 	} else if (decoMode(true) == RECREATIONAL) {
-		buf += casprintf_loc(translate("gettextFromC", "Deco model: Recreational mode based on Bühlmann ZHL-16B with GFLow = %d%% and GFHigh = %d%%"),
-			     gflow, gfhigh);
+		append_format_loc(buf, translate("gettextFromC", "Deco model: Recreational mode based on Bühlmann ZHL-16B with GFLow = %d%% and GFHigh = %d%%"),
+			     plan.gflow, plan.gfhigh);
 	}
 	buf += "<br/>\n";
 
 	{
 		const char *depth_unit;
-		int altitude = (int) get_depth_units((int) (pressure_to_altitude(surface_pressure)), NULL, &depth_unit);
+		int altitude = (int) get_depth_units((int) (pressure_to_altitude(plan.surface_pressure)), NULL, &depth_unit);
 
-		buf += casprintf_loc(translate("gettextFromC", "ATM pressure: %dmbar (%d%s)<br/>\n</div>\n"), surface_pressure, altitude, depth_unit);
+		append_format_loc(buf, translate("gettextFromC", "ATM pressure: %dmbar (%d%s)<br/>\n</div>\n"), plan.surface_pressure.mbar, altitude, depth_unit);
 	}
+}
 
-	/* Get SAC values and units for printing it in gas consumption */
+static void add_gas_consumption(std::string &buf, const struct dive &dive, struct divedatapoint *lastbottomdp)
+{
 	{
 		double bottomsacvalue, decosacvalue;
 		int sacdecimals;
@@ -467,7 +454,7 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 		else
 			temp = casprintf_loc("%s %.*f|%.*f%s/min):", translate("gettextFromC", "Gas consumption (based on SAC"),
 				     sacdecimals, bottomsacvalue, sacdecimals, decosacvalue, sacunit);
-		buf += format_string_std("<div>\n%s<br/>\n", temp.c_str());
+		append_format_std(buf, "<div>\n%s<br/>\n", temp.c_str());
 	}
 
 	/* Print gas consumption: This loop covers all cylinders */
@@ -483,7 +470,8 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 		volume = get_volume_units(cyl.gas_used.mliter, NULL, &unit);
 		deco_volume = get_volume_units(cyl.deco_gas_used.mliter, NULL, &unit);
 		if (cyl.type.size.mliter) {
-			int remaining_gas = lrint((double)cyl.end.mbar * cyl.type.size.mliter / 1000.0 / gas_compressibility_factor(cyl.gasmix, cyl.end.mbar / 1000.0));
+			double end_compressibility = gas_compressibility_factor(cyl.gasmix, cyl.end.mbar / 1000.0);
+			int remaining_gas = lrint((double)cyl.end.mbar * cyl.type.size.mliter / 1000.0 / end_compressibility);
 			double deco_pressure_mbar = isothermal_pressure(cyl.gasmix, 1.0, remaining_gas + cyl.deco_gas_used.mliter,
 				cyl.type.size.mliter) * 1000 - cyl.end.mbar;
 			deco_pressure = get_pressure_units(lrint(deco_pressure_mbar), &pressure_unit);
@@ -496,7 +484,7 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 					translate("gettextFromC", "Warning:"),
 					translate("gettextFromC", "this is more gas than available in the specified cylinder!"));
 			else
-				if (cyl.end.mbar / 1000.0 * cyl.type.size.mliter / gas_compressibility_factor(cyl.gasmix, cyl.end.mbar / 1000.0)
+				if (cyl.end.mbar / 1000.0 * cyl.type.size.mliter / end_compressibility
 				    < cyl.deco_gas_used.mliter)
 					warning = format_string_std("<br/>\n&nbsp;&mdash; <span style='color: red;'>%s </span> %s",
 						translate("gettextFromC", "Warning:"),
@@ -560,65 +548,127 @@ void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planne
 			}
 		}
 		/* Gas consumption: Now finally print all strings to output */
-		buf += format_string_std("%s%s%s<br/>\n", temp.c_str(), warning.c_str(), mingas.c_str());
+		append_format_std(buf, "%s%s%s<br/>\n", temp.c_str(), warning.c_str(), mingas.c_str());
 	}
 	buf += "</div>\n";
+}
 
-	/* For trimix OC dives, if an icd table header and icd data were printed to buffer, then add the ICD table here */
-	if (!icdtableheader && prefs.show_icd) {
-		icdbuf += "</tbody></table>\n"; // End the ICD table
-		buf += icdbuf;
-		if (icdwarning) { // If necessary, add warning
-			buf += format_string_std("<span style='color: red;'>%s</span> %s",
+/* For trimix OC dives, if an icd table header and icd data were printed to buffer, then add the ICD table here */
+static void add_icd_table(std::string &buf, const icd_table &icd)
+{
+	if (!icd.header && prefs.show_icd) {
+		buf += icd.buf;
+		buf += "</tbody></table>\n"; // End the ICD table
+		if (icd.warning) { // If necessary, add warning
+			append_format_std(buf, "<span style='color: red;'>%s</span> %s",
 				translate("gettextFromC", "Warning:"),
 				translate("gettextFromC", "Isobaric counterdiffusion conditions exceeded"));
 		}
 		buf += "<br/></div>\n";
 	}
+}
 
-	/* Print warnings for pO2 (move into separate function?) */
-	{
-		bool o2warning_exist = false;
-		double amb;
-
-		divemode_loop loop(dive.dcs[0]);
-		if (dive.dcs[0].divemode != CCR) {
-			for (auto &dp: this->dp) {
-				if (dp.time != 0) {
-					std::string temp;
-					struct gasmix gasmix = dive.get_cylinder(dp.cylinderid)->gasmix;
-
-					divemode_t current_divemode = loop.at(dp.time);
-					amb = dive.depth_to_atm(dp.depth.mm);
-					gas_pressures pressures = fill_pressures(amb, gasmix, (current_divemode == OC) ? 0.0 : amb * gasmix.o2.permille / 1000.0, current_divemode);
-
-					if (pressures.o2 > (dp.entered ? prefs.bottompo2 : prefs.decopo2) / 1000.0) {
-						const char *depth_unit;
-						int decimals;
-						double depth_value = get_depth_units(dp.depth.mm, &decimals, &depth_unit);
-						if (!o2warning_exist)
-							buf += "<div>\n";
-						o2warning_exist = true;
-						temp = casprintf_loc(translate("gettextFromC", "high pO₂ value %.2f at %d:%02u with gas %s at depth %.*f %s"),
-							pressures.o2, FRACTION_TUPLE(dp.time, 60), gasmix.name().c_str(), decimals, depth_value, depth_unit);
-						buf += format_string_std("<span style='color: red;'>%s </span> %s<br/>\n", translate("gettextFromC", "Warning:"), temp.c_str());
-					} else if (pressures.o2 < 0.16) {
-						const char *depth_unit;
-						int decimals;
-						double depth_value = get_depth_units(dp.depth.mm, &decimals, &depth_unit);
-						if (!o2warning_exist)
-							buf += "<div>";
-						o2warning_exist = true;
-						temp = casprintf_loc(translate("gettextFromC", "low pO₂ value %.2f at %d:%02u with gas %s at depth %.*f %s"),
-							pressures.o2, FRACTION_TUPLE(dp.time, 60), gasmix.name().c_str(), decimals, depth_value, depth_unit);
-						buf += format_string_std("<span style='color: red;'>%s </span> %s<br/>\n", translate("gettextFromC", "Warning:"), temp.c_str());
-					}
+/* Print warnings for pO2 */
+static void add_po2_warnings(std::string &buf, const std::vector<divedatapoint> &dps, const struct dive &dive)
+{
+	bool o2warning_exist = false;
+	double amb;
+
+	divemode_loop loop(dive.dcs[0]);
+	if (dive.dcs[0].divemode != CCR) {
+		for (auto &dp: dps) {
+			if (dp.time != 0) {
+				std::string temp;
+				struct gasmix gasmix = dive.get_cylinder(dp.cylinderid)->gasmix;
+
+				divemode_t current_divemode = loop.at(dp.time);
+				amb = dive.depth_to_atm(dp.depth.mm);
+				gas_pressures pressures = fill_pressures(amb, gasmix, (current_divemode == OC) ? 0.0 : amb * gasmix.o2.permille / 1000.0, current_divemode);
+
+				if (pressures.o2 > (dp.entered ? prefs.bottompo2 : prefs.decopo2) / 1000.0) {
+					const char *depth_unit;
+					int decimals;
+					double depth_value = get_depth_units(dp.depth.mm, &decimals, &depth_unit);
+					if (!o2warning_exist)
+						buf += "<div>\n";
+					o2warning_exist = true;
+					temp = casprintf_loc(translate("gettextFromC", "high pO₂ value %.2f at %d:%02u with gas %s at depth %.*f %s"),
+						pressures.o2, FRACTION_TUPLE(dp.time, 60), gasmix.name().c_str(), decimals, depth_value, depth_unit);
+					append_format_std(buf, "<span style='color: red;'>%s </span> %s<br/>\n", translate("gettextFromC", "Warning:"), temp.c_str());
+				} else if (pressures.o2 < 0.16) {
+					const char *depth_unit;
+					int decimals;
+					double depth_value = get_depth_units(dp.depth.mm, &decimals, &depth_unit);
+					if (!o2warning_exist)
+						buf += "<div>";
+					o2warning_exist = true;
+					temp = casprintf_loc(translate("gettextFromC", "low pO₂ value %.2f at %d:%02u with gas %s at depth %.*f %s"),
+						pressures.o2, FRACTION_TUPLE(dp.time, 60), gasmix.name().c_str(), decimals, depth_value, depth_unit);
+					append_format_std(buf, "<span style='color: red;'>%s </span> %s<br/>\n", translate("gettextFromC", "Warning:"), temp.c_str());
 				}
 			}
 		}
-		if (o2warning_exist)
-			buf += "</div>\n";
 	}
+	if (o2warning_exist)
+		buf += "</div>\n";
+}
+
+void diveplan::add_plan_to_notes(struct dive &dive, bool show_disclaimer, planner_error_t error)
+{
+	std::string buf;
+
+	if (dp.empty())
+		return;
+
+	if (error != PLAN_OK) {
+		const char *message;
+		switch (error) {
+		case PLAN_ERROR_TIMEOUT:
+			message = translate("gettextFromC", "Decompression calculation aborted due to excessive time");
+
+			break;
+		case PLAN_ERROR_INAPPROPRIATE_GAS:
+			message = translate("gettextFromC", "One or more tanks with a tank use type inappropriate for the selected dive mode are included in the dive plan. "
+				"Please change them to appropriate tanks to enable the generation of a dive plan.");
+
+			break;
+		default:
+			message = translate("gettextFromC", "An error occurred during dive plan generation");
+
+			break;
+		}
+
+		append_format_std(buf, "<span style='color: red;'>%s </span> %s<br/>",
+			translate("gettextFromC", "Warning:"), message);
+
+		dive.notes = std::move(buf);
+
+		return;
+	}
+
+	// Build the notes in one buffer, which is large enough for the usual plans.
+	buf.reserve(2048 + 256 * dp.size() + 512 * dive.cylinders.size());
+
+	if (!add_plan_header(buf, *this, show_disclaimer)) {
+		dive.notes = std::move(buf);
+		return;
+	}
+
+	icd_table icd;
+	struct divedatapoint *lastbottomdp = add_plan_waypoints(buf, icd, dp, dive);
+	add_cns_otu(buf, dive);
+	add_deco_settings(buf, *this);
+	add_gas_consumption(buf, dive, lastbottomdp);
+	add_icd_table(buf, icd);
+	add_po2_warnings(buf, dp, dive);
+#ifdef DEBUG_PLANNER_NOTES
+	if (decoMode(true) == VPMB && !cva_iteration_usec.empty()) {
+		append_format_loc(buf, "<div>\nCVA iterations: %d (", (int)cva_iteration_usec.size());
+		for (size_t i = 0; i < cva_iteration_usec.size(); i++)
+			append_format_loc(buf, "%s%.2f ms", i ? ", " : "", cva_iteration_usec[i] / 1000.0);
+		buf += ")<br/>\n</div>\n";
+	}
+#endif
 	dive.notes = std::move(buf);
 #ifdef DEBUG_PLANNER_NOTES
 	printf("<!DOCTYPE html>\n<html>\n\t<head><title>plannernotes</title><meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\"/></head>\n\t<body>\n%s\t</body>\n</html>\n", dive.notes);
@@ -14,6 +14,7 @@ preferences::preferences() :
 	cloud_timeout(5),
 #endif
 	sync_dc_time(false),
+	keep_raw_dives(false),
 	display_invalid_dives(false),
 	font_size(-1),
 	mobile_scale(1.0),
@@ -25,6 +26,7 @@ preferences::preferences() :
 	auto_recalculate_thumbnails(true),
 	extract_video_thumbnails(true),
 	extract_video_thumbnails_position(20),		// The first fifth seems like a reasonable place
+	thumbnail_cache_size(64),
 	defaultsetpoint(1100),
 	default_file_behavior(LOCAL_DEFAULT_FILE),
 	o2consumption(720),
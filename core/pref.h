@@ -93,6 +93,7 @@ struct preferences {
 	dive_computer_prefs_t dive_computer3;
 	dive_computer_prefs_t dive_computer4;
 	bool sync_dc_time;
+	bool keep_raw_dives;
 
 	// ********** Display *************
 	bool        display_invalid_dives;
@@ -112,6 +113,7 @@ struct preferences {
 	bool        auto_recalculate_thumbnails;
 	bool	    extract_video_thumbnails;
 	int	    extract_video_thumbnails_position; // position in stream: 0=first 100=last second
+	int	    thumbnail_cache_size; // in MiB, for decoded thumbnails kept in memory
 	std::string ffmpeg_executable; // path of ffmpeg binary
 	std::string	subtitles_format_string; // Format string for subtitles generated from the dive data
 	int         defaultsetpoint; // default setpoint in mbar
@@ -7,6 +7,13 @@
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+#include <QThread>
+#include <QtConcurrent>
 
 #include "dive.h"
 #include "divelist.h"
@@ -27,6 +34,8 @@
 #include "qthelper.h"
 #include "range.h"
 #include "format.h"
+#include "perfcounters.h"
+#include "trace.h"
 
 //#define DEBUG_GAS 1
 
@@ -314,6 +323,8 @@ static plot_data &add_entry(struct plot_info &pi)
 {
 	pi.entry.emplace_back();
 	pi.pressures.resize(pi.pressures.size() + pi.nr_cylinders);
+	if (!pi.o2sensors.empty())
+		pi.o2sensors.resize(pi.o2sensors.size() + MAX_O2_SENSORS);
 	return pi.entry.back();
 }
 
@@ -325,6 +336,8 @@ static void insert_entry(struct plot_info &pi, int time, int depth, int sac)
 	struct plot_data &entry = add_entry(pi);
 	struct plot_data &prev = pi.entry[pi.entry.size() - 2];
 	entry = prev;
+	if (!pi.o2sensors.empty())
+		std::copy_n(pi.o2sensors.end() - 2 * MAX_O2_SENSORS, MAX_O2_SENSORS, pi.o2sensors.end() - MAX_O2_SENSORS);
 	entry.sec = time;
 	entry.depth = depth;
 	entry.running_sum = prev.running_sum + (time - prev.sec) * (depth + prev.depth) / 2;
@@ -336,6 +349,7 @@ static void insert_entry(struct plot_info &pi, int time, int depth, int sac)
 static void populate_plot_entries(const struct dive *dive, const struct divecomputer *dc, struct plot_info &pi)
 {
 	pi.nr_cylinders = static_cast<int>(dive->cylinders.size());
+	bool has_o2sensors = dc->divemode == CCR || (dc->divemode == PSCR && dc->no_o2sensors);
 
 	/*
 	 * To avoid continuous reallocation, allocate the expected number of entries.
@@ -350,10 +364,14 @@ static void populate_plot_entries(const struct dive *dive, const struct divecomp
 	size_t nr = dc->samples.size() + 6 + pi.maxtime / 10 + dc->events.size();
 	pi.entry.reserve(nr);
 	pi.pressures.reserve(nr * pi.nr_cylinders);
+	if (has_o2sensors)
+		pi.o2sensors.reserve(nr * MAX_O2_SENSORS);
 
 	// The two extra events at the start
 	pi.entry.resize(2);
 	pi.pressures.resize(pi.nr_cylinders * 2);
+	if (has_o2sensors)
+		pi.o2sensors.resize(MAX_O2_SENSORS * 2);
 
 	int lastdepth = 0;
 	int lasttime = 0;
@@ -410,11 +428,11 @@ static void populate_plot_entries(const struct dive *dive, const struct divecomp
 		entry.tts = sample.tts.seconds;
 		entry.in_deco = sample.in_deco;
 		entry.cns = sample.cns;
-		if (dc->divemode == CCR || (dc->divemode == PSCR && dc->no_o2sensors)) {
+		if (has_o2sensors) {
 			entry.o2pressure.mbar = entry.o2setpoint.mbar = sample.setpoint.mbar;     // for rebreathers
-			int i;
-			for (i = 0; i < MAX_O2_SENSORS; i++)
-				entry.o2sensor[i].mbar = sample.o2sensor[i].mbar;
+			pressure_t *o2sensor = &pi.o2sensors[(pi.entry.size() - 1) * MAX_O2_SENSORS];
+			for (int i = 0; i < MAX_O2_SENSORS; i++)
+				o2sensor[i].mbar = sample.o2sensor[i].mbar;
 		} else {
 			entry.pressures.o2 = sample.setpoint.mbar / 1000.0;
 		}
@@ -612,10 +630,10 @@ static void calculate_sac(const struct dive *dive, const struct divecomputer *dc
 	std::vector<char> gases_scratch(pi.nr_cylinders);
 
 	struct gasmix gasmix = gasmix_invalid;
-	gasmix_loop loop(*dive, *dc);
+	auto timeline = dive->get_timeline(*dc);
 	for (int i = 0; i < pi.nr; i++) {
 		const struct plot_data &entry = pi.entry[i];
-		struct gasmix newmix = loop.at(entry.sec).first;
+		struct gasmix newmix = timeline->gasmix_at(entry.sec).first;
 		if (!same_gasmix(newmix, gasmix)) {
 			gasmix = newmix;
 			matching_gases(dive, newmix, gases.data());
@@ -676,9 +694,7 @@ static void setup_gas_sensor_pressure(const struct dive *dive, const struct dive
 	std::vector<int> last(num_cyl, INT_MAX);
 
 	int prev = -1;
-	gasmix_loop loop(*dive, *dc);
-	while (loop.has_next()) {
-		auto [cylinder_index, time] = loop.next_cylinder_index();
+	for (auto [time, cylinder_index]: dive->get_timeline(*dc)->gas_changes()) {
 
 		if (cylinder_index < 0)
 			continue; // unknown cylinder
@@ -852,8 +868,12 @@ static void calculate_deco_information(struct deco_state *ds, const struct deco_
 		ds->deco_time = planner_ds->deco_time;
 		ds->first_ceiling_pressure = planner_ds->first_ceiling_pressure;
 	}
+	bool tissues = pi.channels & PLOT_TISSUES;
+	if (tissues) {
+		pi.ceilings.assign(pi.nr * NUM_PLOT_TISSUES, 0);
+		pi.percentages.assign(pi.nr * NUM_PLOT_TISSUES, 0);
+	}
 	deco_state_cache cache_data_initial;
-	lock_planner();
 	/* For VPM-B outside the planner, cache the initial deco state for CVA iterations */
 	if (decoMode(in_planner) == VPMB) {
 		cache_data_initial.cache(ds);
@@ -861,36 +881,34 @@ static void calculate_deco_information(struct deco_state *ds, const struct deco_
 	/* For VPM-B outside the planner, iterate until deco time converges (usually one or two iterations after the initial)
 	 * Set maximum number of iterations to 10 just in case */
 
+	auto timeline = dive->get_timeline(*dc);
 	while ((abs(prev_deco_time - ds->deco_time) >= 30) && (count_iteration < 10)) {
 		int last_ndl_tts_calc_time = 0, first_ceiling = 0, current_ceiling, last_ceiling = 0, final_tts = 0 , time_clear_ceiling = 0;
 		if (decoMode(in_planner) == VPMB)
 			ds->first_ceiling_pressure.mbar = dive->depth_to_mbar(first_ceiling);
 
-		gasmix_loop loop(*dive, *dc);
-		divemode_loop loop_d(*dc);
 		for (i = 1; i < pi.nr; i++) {
 			struct plot_data &entry = pi.entry[i];
 			struct plot_data &prev = pi.entry[i - 1];
+			int *ceilings = tissues ? &pi.ceilings[i * NUM_PLOT_TISSUES] : nullptr;
+			int *percentages = tissues ? &pi.percentages[i * NUM_PLOT_TISSUES] : nullptr;
 			int j, t0 = prev.sec, t1 = entry.sec;
-			int time_stepsize = 20, max_ceiling = -1;
+			int max_ceiling = -1;
 
-			divemode_t current_divemode = loop_d.at(entry.sec);
-			struct gasmix gasmix = loop.at(t1).first;
+			divemode_t current_divemode = timeline->divemode_at(entry.sec);
+			struct gasmix gasmix = timeline->gasmix_at(t1).first;
 			entry.ambpressure = dive->depth_to_bar(entry.depth);
-			entry.gfline = get_gf(ds, entry.ambpressure, dive) * (100.0 - AMB_PERCENTAGE) + AMB_PERCENTAGE;
+			if (tissues)
+				entry.gfline = get_gf(ds, entry.ambpressure, dive) * (100.0 - AMB_PERCENTAGE) + AMB_PERCENTAGE;
 			if (t0 > t1) {
 				report_info("non-monotonous dive stamps %d %d", t0, t1);
 				std::swap(t0, t1);
 			}
-			if (t0 != t1 && t1 - t0 < time_stepsize)
-				time_stepsize = t1 - t0;
-			for (j = t0 + time_stepsize; j <= t1; j += time_stepsize) {
-				int depth = interpolate(prev.depth, entry.depth, j - t0, t1 - t0);
-				add_segment(ds, dive->depth_to_bar(depth),
-					    gasmix, time_stepsize, entry.o2pressure.mbar, current_divemode, entry.sac, in_planner);
+			/* The depth changes linearly between the entries: one step for the whole interval */
+			if (t0 != t1) {
+				add_linear_segment(ds, dive->depth_to_bar(prev.depth), dive->depth_to_bar(entry.depth),
+						   gasmix, t1 - t0, entry.o2pressure.mbar, current_divemode, entry.sac, in_planner);
 				entry.icd_warning = ds->icd_warning;
-				if ((t1 - j < time_stepsize) && (j < t1))
-					time_stepsize = t1 - j;
 			}
 			if (t0 == t1) {
 				entry.ceiling = prev.ceiling;
@@ -936,14 +954,14 @@ static void calculate_deco_information(struct deco_state *ds, const struct deco_
 			}
 			entry.surface_gf = 0.0;
 			entry.current_gf = 0.0;
-			for (j = 0; j < 16; j++) {
+			for (j = 0; tissues && j < NUM_PLOT_TISSUES; j++) {
 				double m_value = ds->buehlmann_inertgas_a[j] + entry.ambpressure / ds->buehlmann_inertgas_b[j];
 				double surface_m_value = ds->buehlmann_inertgas_a[j] + surface_pressure / ds->buehlmann_inertgas_b[j];
-				entry.ceilings[j] = deco_allowed_depth(ds->tolerated_by_tissue[j], surface_pressure, dive, 1);
-				if (entry.ceilings[j] > max_ceiling)
-					max_ceiling = entry.ceilings[j];
+				ceilings[j] = deco_allowed_depth(ds->tolerated_by_tissue[j], surface_pressure, dive, 1);
+				if (ceilings[j] > max_ceiling)
+					max_ceiling = ceilings[j];
 				double current_gf = (ds->tissue_inertgas_saturation[j] - entry.ambpressure) / (m_value - entry.ambpressure);
-				entry.percentages[j] = ds->tissue_inertgas_saturation[j] < entry.ambpressure ?
+				percentages[j] = ds->tissue_inertgas_saturation[j] < entry.ambpressure ?
 					lrint(ds->tissue_inertgas_saturation[j] / entry.ambpressure * AMB_PERCENTAGE) :
 					lrint(AMB_PERCENTAGE + current_gf * (100.0 - AMB_PERCENTAGE));
 				if (current_gf > entry.current_gf)
@@ -1024,74 +1042,71 @@ static void calculate_deco_information(struct deco_state *ds, const struct deco_
 #if DECO_CALC_DEBUG & 1
 	dump_tissues(ds);
 #endif
-	unlock_planner();
-}
-
-/* Sort the o2 pressure values. There are so few that a simple bubble sort
- * will do */
-
-void sort_o2_pressures(int *sensorn, int np, const struct plot_data &entry)
-{
-	int smallest, position, old;
-
-	for (int i = 0; i < np - 1; i++) {
-		position = i;
-		smallest = entry.o2sensor[sensorn[i]].mbar;
-		for (int j = i+1; j < np; j++)
-			if (entry.o2sensor[sensorn[j]].mbar < smallest) {
-				position = j;
-				smallest = entry.o2sensor[sensorn[j]].mbar;
-			}
-		old = sensorn[i];
-		sensorn[i] = position;
-		sensorn[position] = old;
-	}
 }
 
-/* Function calculate_ccr_po2: This function takes information from one plot_data structure (i.e. one point on
- * the dive profile), containing the oxygen sensor values of a CCR system and, for that plot_data structure,
- * calculates the po2 value from the sensor data. If there are at least 3 sensors, sensors are voted out until
- * their span is within diff_limit.
+/* The pO2 is calculated from the valid (non-zero) sensor readings. If there are at
+ * least 3 of them, sensors are voted out until their span is within the limit.
+ *
+ * The sensor values are copied into columns of a block of entries, which are sorted
+ * by a sorting network. Its compare-and-exchange steps run over whole columns without
+ * branches, which the compiler vectorizes. Invalid readings sort to the front.
  */
-static int calculate_ccr_po2(struct plot_data &entry, const struct divecomputer *dc)
+void ccr_po2_consensus(const pressure_t *o2sensors, int nsensors, int nr, int *po2)
 {
-	int sump = 0, minp = 0, maxp = 0;
-	int sensorn[MAX_O2_SENSORS];
-	int i, np = 0;
-
-	for (i = 0; i < dc->no_o2sensors && i < MAX_O2_SENSORS; i++)
-		if (entry.o2sensor[i].mbar) { // Valid reading
-			sensorn[np++] = i;
-			sump += entry.o2sensor[i].mbar;
+	const int block = 256;
+	int col[MAX_O2_SENSORS][block];
+	nsensors = std::clamp(nsensors, 0, MAX_O2_SENSORS);
+
+	for (int first = 0; first < nr; first += block) {
+		int n = std::min(block, nr - first);
+		const pressure_t *o2sensor = o2sensors + (size_t)first * MAX_O2_SENSORS;
+		for (int i = 0; i < n; i++) {
+			for (int s = 0; s < nsensors; s++)
+				col[s][i] = o2sensor[i * MAX_O2_SENSORS + s].mbar;
 		}
-	if (np == 0)
-		return entry.o2pressure.mbar;
-	else if (np == 1)
-		return entry.o2sensor[sensorn[0]].mbar;
-
-	maxp = np - 1;
-	sort_o2_pressures(sensorn, np, entry);
-
-	// This is the Shearwater voting logic: If there are still at least three sensors and one
-	// differs by more than 20% from the closest it is voted out.
-	while (maxp - minp > 1) {
-		if (entry.o2sensor[sensorn[minp + 1]].mbar - entry.o2sensor[sensorn[minp]].mbar >
-		    sump / (maxp - minp + 1) / 5) {
-			sump -= entry.o2sensor[sensorn[minp]].mbar;
-			++minp;
-			continue;
+
+		// Odd-even transposition sort: nsensors rounds sort nsensors values.
+		for (int round = 0; round < nsensors; round++) {
+			for (int s = round % 2; s + 1 < nsensors; s += 2) {
+				int *a = col[s], *b = col[s + 1];
+				for (int i = 0; i < n; i++) {
+					int lo = std::min(a[i], b[i]);
+					int hi = std::max(a[i], b[i]);
+					a[i] = lo;
+					b[i] = hi;
+				}
+			}
 		}
-		if (entry.o2sensor[sensorn[maxp]].mbar - entry.o2sensor[sensorn[maxp - 1]].mbar >
-		    sump / (maxp - minp +1) / 5) {
-			sump -= entry.o2sensor[sensorn[maxp]].mbar;
-			--maxp;
-			continue;
+
+		for (int i = 0; i < n; i++) {
+			int minp = 0, maxp = nsensors - 1, sump = 0;
+			while (minp <= maxp && col[minp][i] == 0)
+				++minp;
+			if (minp > maxp) {
+				po2[first + i] = 0;
+				continue;
+			}
+			for (int s = minp; s <= maxp; s++)
+				sump += col[s][i];
+
+			// This is the Shearwater voting logic: If there are still at least three sensors and one
+			// differs by more than 20% from the closest it is voted out.
+			while (maxp - minp > 1) {
+				if (col[minp + 1][i] - col[minp][i] > sump / (maxp - minp + 1) / 5) {
+					sump -= col[minp][i];
+					++minp;
+					continue;
+				}
+				if (col[maxp][i] - col[maxp - 1][i] > sump / (maxp - minp + 1) / 5) {
+					sump -= col[maxp][i];
+					--maxp;
+					continue;
+				}
+				break;
+			}
+			po2[first + i] = sump / (maxp - minp + 1);
 		}
-		break;
 	}
-
-	return sump / (maxp - minp + 1);
-
 }
 
 static double gas_density(const struct gas_pressures &pressures)
@@ -1104,21 +1119,19 @@ static void calculate_gas_information_new(const struct dive *dive, const struct
 	int i;
 	double amb_pressure;
 
-	gasmix_loop loop(*dive, *dc);
-	divemode_loop loop_d(*dc);
+	auto timeline = dive->get_timeline(*dc);
 	for (i = 1; i < pi.nr; i++) {
 		double fn2, fhe;
 		struct plot_data &entry = pi.entry[i];
 
-		auto gasmix = loop.at(entry.sec).first;
+		auto gasmix = timeline->gasmix_at(entry.sec).first;
 		amb_pressure = dive->depth_to_bar(entry.depth);
-		divemode_t current_divemode = loop_d.at(entry.sec);
+		divemode_t current_divemode = timeline->divemode_at(entry.sec);
 		entry.pressures = fill_pressures(amb_pressure, gasmix, (current_divemode == OC) ? 0.0 : entry.o2pressure.mbar / 1000.0, current_divemode);
 		fn2 = 1000.0 * entry.pressures.n2 / amb_pressure;
 		fhe = 1000.0 * entry.pressures.he / amb_pressure;
 		if (dc->divemode == PSCR) { // OC pO2 is calulated for PSCR with or without external PO2 monitoring.
-			struct gasmix gasmix2 = loop.at(entry.sec).first;
-			entry.scr_OC_pO2.mbar = (int) dive->depth_to_mbar(entry.depth) * get_o2(gasmix2) / 1000;
+			entry.scr_OC_pO2.mbar = (int) dive->depth_to_mbar(entry.depth) * get_o2(gasmix) / 1000;
 		}
 
 		/* Calculate MOD, EAD, END and EADD based on partial pressures calculated before
@@ -1156,31 +1169,39 @@ static void fill_o2_values(const struct dive *dive, const struct divecomputer *d
  * last known values so that the oxygen sensor data are complete and ready
  * for plotting. This function called by: create_plot_info_new() */
 {
-	int i, j;
-	pressure_t last_sensor[3], o2pressure;
-	pressure_t amb_pressure;
-
-	for (i = 0; i < pi.nr; i++) {
-		struct plot_data &entry = pi.entry[i];
-
-		if (dc->divemode == CCR || (dc->divemode == PSCR && dc->no_o2sensors)) {
-			if (i == 0) { // For 1st iteration, initialise the last_sensor values
-				for (j = 0; j < dc->no_o2sensors; j++)
-					last_sensor[j] = entry.o2sensor[j];
-			} else { // Now re-insert the missing oxygen pressure values
-				for (j = 0; j < dc->no_o2sensors; j++)
-					if (entry.o2sensor[j].mbar)
-						last_sensor[j] = entry.o2sensor[j];
-					else
-						entry.o2sensor[j] = last_sensor[j];
-			} // having initialised the empty o2 sensor values for this point on the profile,
-			amb_pressure.mbar = dive->depth_to_mbar(entry.depth);
-			o2pressure.mbar = calculate_ccr_po2(entry, dc); // ...calculate the po2 based on the sensor data
-			entry.o2pressure.mbar = std::min(o2pressure.mbar, amb_pressure.mbar);
-		} else {
+	if (pi.o2sensors.empty()) {
+		for (struct plot_data &entry: pi.entry)
 			entry.o2pressure = 0_bar; // initialise po2 to zero for dctype = OC
+		return;
+	}
+
+	// Re-insert the missing oxygen pressure values, one sensor after the other.
+	int nsensors = std::clamp(dc->no_o2sensors, 0, MAX_O2_SENSORS);
+	for (int j = 0; j < nsensors; j++) {
+		pressure_t last_sensor = pi.o2sensors[j];
+		for (int i = 1; i < pi.nr; i++) {
+			pressure_t &sensor = pi.o2sensors[i * MAX_O2_SENSORS + j];
+			if (sensor.mbar)
+				last_sensor = sensor;
+			else
+				sensor = last_sensor;
 		}
 	}
+
+	// Having initialised the empty o2 sensor values, calculate the po2 based on the sensor data.
+	// With a single sensor, there is nothing to vote on.
+	std::vector<int> po2(pi.nr);
+	if (nsensors == 1) {
+		for (int i = 0; i < pi.nr; i++)
+			po2[i] = pi.o2sensors[i * MAX_O2_SENSORS].mbar;
+	} else if (nsensors > 1) {
+		ccr_po2_consensus(pi.o2sensors.data(), nsensors, pi.nr, po2.data());
+	}
+	for (int i = 0; i < pi.nr; i++) {
+		struct plot_data &entry = pi.entry[i];
+		int o2pressure = po2[i] ? po2[i] : entry.o2pressure.mbar;
+		entry.o2pressure.mbar = std::min(o2pressure, dive->depth_to_mbar(entry.depth));
+	}
 }
 
 #ifdef DEBUG_GAS
@@ -1200,7 +1221,8 @@ static void debug_print_profiledata(struct plot_info &pi)
 			struct plot_data &entry = pi.entry[i];
 			fprintf(f1, "%d gas=%8d %8d ; dil=%8d %8d ; o2_sp= %d %d %d %d PO2= %f\n", i, get_plot_sensor_pressure(pi, i),
 				get_plot_interpolated_pressure(pi, i), O2CYLINDER_PRESSURE(entry), INTERPOLATED_O2CYLINDER_PRESSURE(entry),
-				entry.o2pressure.mbar, entry.o2sensor[0].mbar, entry.o2sensor[1].mbar, entry.o2sensor[2].mbar, entry.pressures.o2);
+				entry.o2pressure.mbar, get_plot_o2sensor(pi, i, 0).mbar, get_plot_o2sensor(pi, i, 1).mbar,
+				get_plot_o2sensor(pi, i, 2).mbar, entry.pressures.o2);
 		}
 		fclose(f1);
 	}
@@ -1216,12 +1238,23 @@ static void debug_print_profiledata(struct plot_info &pi)
  *
  * The old data will be freed.
  */
-struct plot_info create_plot_info_new(const struct dive *dive, const struct divecomputer *dc, const struct deco_state *planner_ds)
+struct plot_info create_plot_info_new(const struct dive *dive, const struct divecomputer *dc, const struct deco_state *planner_ds,
+				      int channels)
 {
+	TRACE_ZONE("create_plot_info_new");
 	struct deco_state plot_deco_state;
 	bool in_planner = planner_ds != NULL;
-	divelog.dives.init_decompression(&plot_deco_state, dive, in_planner);
 	plot_info pi;
+	/* The planner relies on the ceiling to flag waypoints above it. Tissues need the deco. */
+	if (in_planner)
+		channels = PLOT_ALL_CHANNELS;
+	else if (channels & PLOT_TISSUES)
+		channels |= PLOT_DECO;
+	pi.channels = channels;
+	if (in_planner)
+		plot_deco_state.config = planner_ds->config;
+	if (channels & PLOT_DECO)
+		divelog.dives.init_decompression(&plot_deco_state, dive, in_planner);
 	calculate_max_limits_new(dive, dc, pi, in_planner);
 	auto [o2, he, o2max ] = dive->get_maximal_gas();
 	if (dc->divemode == FREEDIVE) {
@@ -1244,7 +1277,8 @@ struct plot_info create_plot_info_new(const struct dive *dive, const struct dive
 	fill_o2_values(dive, dc, pi);			 /* .. and insert the O2 sensor data having 0 values. */
 	calculate_sac(dive, dc, pi);			 /* Calculate sac */
 
-	calculate_deco_information(&plot_deco_state, planner_ds, dive, dc, pi); /* and ceiling information, using gradient factor values in Preferences) */
+	if (channels & PLOT_DECO)
+		calculate_deco_information(&plot_deco_state, planner_ds, dive, dc, pi); /* and ceiling information, using gradient factor values in Preferences) */
 
 	calculate_gas_information_new(dive, dc, pi);	 /* Calculate gas partial pressures */
 
@@ -1257,6 +1291,108 @@ struct plot_info create_plot_info_new(const struct dive *dive, const struct dive
 	return pi;
 }
 
+/* The preferences that create_plot_info_new() depends on */
+static auto plot_info_settings()
+{
+	struct deco_config config = get_deco_config();
+	return std::make_tuple(prefs.zoomed_plot, prefs.calcceiling3m, prefs.calcndltts, prefs.bottomsac, prefs.decosac,
+			       prefs.pscr_ratio, prefs.modpO2, decoMode(false), config.gf_low, config.gf_high, config.vpmb_conservatism);
+}
+
+struct plot_info_cache_entry {
+	const struct dive *dive;
+	int dive_id;
+	timestamp_t when;
+	size_t dcnr;
+	decltype(plot_info_settings()) settings;
+	struct plot_info pi;
+};
+
+static constexpr size_t plot_info_cache_size = 10;
+static std::list<plot_info_cache_entry> plot_info_cache; // most recently used first
+static std::mutex plot_info_cache_lock;
+static perf_counter plot_info_cache_hits("plot_info cache hits");
+static perf_counter plot_info_cache_misses("plot_info cache misses");
+
+struct plot_info create_plot_info_cached(const struct dive *dive, const struct divecomputer *dc, const struct deco_state *planner_ds,
+					 int channels)
+{
+	size_t dcnr = dc - dive->dcs.data();
+	if (planner_ds || dcnr >= dive->dcs.size() || divelog.dives.get_idx(dive) == std::string::npos)
+		return create_plot_info_new(dive, dc, planner_ds, channels);
+
+	auto settings = plot_info_settings();
+	{
+		std::lock_guard<std::mutex> lock(plot_info_cache_lock);
+		auto it = std::find_if(plot_info_cache.begin(), plot_info_cache.end(), [&](const plot_info_cache_entry &entry)
+				       { return entry.dive == dive && entry.dive_id == dive->id && entry.dcnr == dcnr && entry.settings == settings &&
+						(entry.pi.channels & channels) == channels; });
+		if (it != plot_info_cache.end()) {
+			plot_info_cache.splice(plot_info_cache.begin(), plot_info_cache, it);
+			plot_info_cache_hits.add();
+			return it->pi;
+		}
+	}
+	plot_info_cache_misses.add();
+
+	struct plot_info pi = create_plot_info_new(dive, dc, planner_ds, channels);
+	std::lock_guard<std::mutex> lock(plot_info_cache_lock);
+	plot_info_cache.remove_if([&](const plot_info_cache_entry &entry)
+				  { return entry.dive == dive && entry.dcnr == dcnr && (entry.pi.channels & channels) == entry.pi.channels; });
+	plot_info_cache.push_front({ dive, dive->id, dive->when, dcnr, settings, pi });
+	if (plot_info_cache.size() > plot_info_cache_size)
+		plot_info_cache.pop_back();
+	return pi;
+}
+
+void invalidate_plot_info_cache(const struct dive *dive)
+{
+	std::lock_guard<std::mutex> lock(plot_info_cache_lock);
+	if (!dive) {
+		plot_info_cache.clear();
+		return;
+	}
+	plot_info_cache.remove_if([dive](const plot_info_cache_entry &entry)
+				  { return entry.dive == dive || entry.dive_id == dive->id || entry.when >= dive->when; });
+}
+
+size_t plot_info_cache_memory_usage()
+{
+	std::lock_guard<std::mutex> lock(plot_info_cache_lock);
+	size_t res = 0;
+	for (const plot_info_cache_entry &entry: plot_info_cache) {
+		const struct plot_info &pi = entry.pi;
+		res += sizeof(entry) +
+		       pi.entry.capacity() * sizeof(pi.entry[0]) +
+		       pi.pressures.capacity() * sizeof(pi.pressures[0]) +
+		       pi.ceilings.capacity() * sizeof(pi.ceilings[0]) +
+		       pi.percentages.capacity() * sizeof(pi.percentages[0]) +
+		       pi.o2sensors.capacity() * sizeof(pi.o2sensors[0]);
+	}
+	return res;
+}
+
+std::vector<struct plot_info> create_plot_infos(const std::vector<const struct dive *> &dives, int channels)
+{
+	std::vector<struct plot_info> res(dives.size());
+	auto fn = [&dives, &res, channels](size_t i)
+		{ res[i] = create_plot_info_new(dives[i], dives[i]->get_dc(0), nullptr, channels); };
+
+	if (dives.size() < 2 || QThread::idealThreadCount() <= 1) {
+		for (size_t i = 0; i < dives.size(); i++)
+			fn(i);
+		return res;
+	}
+
+	/* The tissue loading reads the samples of earlier dives, so load them up front */
+	for (auto &d: divelog.dives)
+		d->load_samples();
+	std::vector<size_t> idx(dives.size());
+	std::iota(idx.begin(), idx.end(), 0);
+	QtConcurrent::blockingMap(idx, [&fn](size_t i) { fn(i); });
+	return res;
+}
+
 static std::vector<std::string> plot_string(const struct dive *d, const struct plot_info &pi, int idx)
 {
 	int pressurevalue, mod, ead, end, eadd;
@@ -1393,9 +1529,10 @@ static std::vector<std::string> plot_string(const struct dive *d, const struct p
 			res.push_back(casprintf_loc(translate("gettextFromC", "Calculated ceiling %.1f%s"), depthvalue, depth_unit));
 			if (prefs.calcalltissues) {
 				int k;
-				for (k = 0; k < 16; k++) {
-					if (entry.ceilings[k]) {
-						depthvalue = get_depth_units(entry.ceilings[k], NULL, &depth_unit);
+				for (k = 0; k < NUM_PLOT_TISSUES; k++) {
+					int ceiling = get_plot_tissue_ceiling(pi, idx, k);
+					if (ceiling) {
+						depthvalue = get_depth_units(ceiling, NULL, &depth_unit);
 						res.push_back(casprintf_loc(translate("gettextFromC", "Tissue %.0fmin: %.1f%s"), buehlmann_N2_t_halflife[k], depthvalue, depth_unit));
 					}
 				}
@@ -1416,11 +1553,13 @@ static std::vector<std::string> plot_string(const struct dive *d, const struct p
 	return res;
 }
 
-std::pair<int, std::vector<std::string>> get_plot_details_new(const struct dive *d, const struct plot_info &pi, int time)
+std::pair<int, const std::vector<std::string> &> get_plot_details_new(const struct dive *d, const struct plot_info &pi, int time)
 {
+	static const std::vector<std::string> no_details;
+
 	/* The two first and the two last plot entries do not have useful data */
 	if (pi.entry.size() <= 4)
-		return { 0, {} };
+		return { 0, no_details };
 
 	// binary search for sample index
 	auto it = std::lower_bound(pi.entry.begin() + 2, pi.entry.end() - 3, time,
@@ -1428,19 +1567,118 @@ std::pair<int, std::vector<std::string>> get_plot_details_new(const struct dive
 				   { return d.sec < time; });
 	int idx = it - pi.entry.begin();
 
-	auto strings = plot_string(d, pi, idx);
-	return std::make_pair(idx, strings);
+	// The mouse moves over the same entry many times
+	if (pi.details.size() != pi.entry.size())
+		pi.details.assign(pi.entry.size(), std::vector<std::string>());
+	std::vector<std::string> &strings = pi.details[idx];
+	if (strings.empty())
+		strings = plot_string(d, pi, idx);
+	return { idx, strings };
 }
 
 /* Compare two plot_data entries and writes the results into a set of strings */
-std::vector<std::string> compare_samples(const struct dive *d, const struct plot_info &pi, int idx1, int idx2, bool sum)
+range_extrema::range_extrema(const std::vector<int> &values)
+{
+	if (values.empty())
+		return;
+	min_levels.push_back(values);
+	max_levels.push_back(values);
+	for (size_t width = 1; 2 * width <= values.size(); width *= 2) {
+		const std::vector<int> &prev_min = min_levels.back();
+		const std::vector<int> &prev_max = max_levels.back();
+		size_t size = prev_min.size() - width;
+		std::vector<int> next_min(size), next_max(size);
+		for (size_t i = 0; i < size; ++i) {
+			next_min[i] = std::min(prev_min[i], prev_min[i + width]);
+			next_max[i] = std::max(prev_max[i], prev_max[i + width]);
+		}
+		min_levels.push_back(std::move(next_min));
+		max_levels.push_back(std::move(next_max));
+	}
+}
+
+// The largest level whose ranges fit into [first, last].
+static int range_level(int first, int last)
+{
+	int level = 0;
+	while ((2 << level) <= last - first + 1)
+		++level;
+	return level;
+}
+
+int range_extrema::min(int first, int last) const
+{
+	int level = range_level(first, last);
+	const std::vector<int> &values = min_levels[level];
+	return std::min(values[first], values[last - (1 << level) + 1]);
+}
+
+int range_extrema::max(int first, int last) const
+{
+	int level = range_level(first, last);
+	const std::vector<int> &values = max_levels[level];
+	return std::max(values[first], values[last - (1 << level) + 1]);
+}
+
+plot_range_index::plot_range_index(const struct dive *d, const struct plot_info &pi) :
+	nr(pi.nr),
+	depth_time(pi.nr, 0),
+	speed_time(pi.nr, 0),
+	abs_speed_time(pi.nr, 0),
+	cylinders(pi.nr_cylinders)
+{
+	std::vector<int> values(pi.nr);
+	for (int i = 0; i < pi.nr; ++i)
+		values[i] = pi.entry[i].depth;
+	depth = range_extrema(values);
+	for (int i = 0; i < pi.nr; ++i)
+		values[i] = pi.entry[i].speed;
+	speed = range_extrema(values);
+
+	for (int i = 1; i < pi.nr; ++i) {
+		const struct plot_data &data = pi.entry[i];
+		int64_t time = data.sec - pi.entry[i - 1].sec;
+		depth_time[i] = depth_time[i - 1] + data.depth * time;
+		speed_time[i] = speed_time[i - 1] + data.speed * time;
+		abs_speed_time[i] = abs_speed_time[i - 1] + abs(data.speed) * time;
+	}
+
+	for (int c = 0; c < pi.nr_cylinders; ++c) {
+		struct cylinder &cyl = cylinders[c];
+		const cylinder_t *cylinder = d->get_cylinder(c);
+		gas_compressibility z(cylinder->gasmix);
+		cyl.bar_used.assign(pi.nr, 0);
+		cyl.volume_used.assign(pi.nr, 0);
+		cyl.next_pressure.assign(pi.nr, pi.nr);
+		for (int i = 0; i < pi.nr; ++i)
+			values[i] = get_plot_pressure(pi, i, c);
+		for (int i = pi.nr - 1; i >= 0; --i)
+			cyl.next_pressure[i] = values[i] ? i : (i + 1 < pi.nr ? cyl.next_pressure[i + 1] : pi.nr);
+		for (int i = 1; i < pi.nr; ++i) {
+			int last = values[i - 1], next = values[i];
+			cyl.bar_used[i] = cyl.bar_used[i - 1];
+			cyl.volume_used[i] = cyl.volume_used[i - 1];
+			if (last) {
+				cyl.bar_used[i] += last - next;
+				// TODO: Implement addition/subtraction on units.h types
+				cyl.volume_used[i] += (cylinder->gas_volume((pressure_t){ .mbar = last }, z) -
+						       cylinder->gas_volume((pressure_t){ .mbar = next }, z)).mliter;
+			}
+		}
+		if (cyl.next_pressure[0] < pi.nr)
+			cyl.pressure = range_extrema(values);
+	}
+}
+
+std::vector<std::string> compare_samples(const struct dive *d, const struct plot_info &pi, const struct plot_range_index &index,
+					 int idx1, int idx2, bool sum)
 {
 	std::string space(" ");
 	const char *depth_unit, *pressure_unit, *vertical_speed_unit;
 	double depthvalue, speedvalue;
 
 	std::vector<std::string> res;
-	if (idx1 < 0 || idx2 < 0)
+	if (idx1 < 0 || idx2 < 0 || index.nr != pi.nr || idx1 >= pi.nr || idx2 >= pi.nr)
 		return res;
 
 	if (pi.entry[idx1].sec > pi.entry[idx2].sec) {
@@ -1453,74 +1691,36 @@ std::vector<std::string> compare_samples(const struct dive *d, const struct plot
 	const struct plot_data &start = pi.entry[idx1];
 	const struct plot_data &stop = pi.entry[idx2];
 
-	int avg_speed = 0;
-	int max_asc_speed = 0;
-	int max_desc_speed = 0;
-
+	/* The statistics are over the entries idx1..idx2-1 */
+	int last = idx2 - 1;
 	int delta_depth = abs(start.depth - stop.depth);
 	int delta_time = abs(start.sec - stop.sec);
-	int avg_depth = 0;
-	int max_depth = 0;
-	int min_depth = INT_MAX;
-
-	int last_sec = start.sec;
+	int min_depth = index.depth.min(idx1, last);
+	int max_depth = index.depth.max(idx1, last);
+	int max_asc_speed = std::min(0, index.speed.min(idx1, last));
+	int max_desc_speed = std::max(0, index.speed.max(idx1, last));
+	const std::vector<int64_t> &speed_time = sum ? index.abs_speed_time : index.speed_time;
+	int avg_depth = (int)((index.depth_time[last] - index.depth_time[idx1]) / (stop.sec - start.sec));
+	int avg_speed = (int)((speed_time[last] - speed_time[idx1]) / (stop.sec - start.sec));
 
 	volume_t cylinder_volume;
-	std::vector<int> start_pressures(pi.nr_cylinders, 0);
-	std::vector<int> last_pressures(pi.nr_cylinders, 0);
 	std::vector<int> bar_used(pi.nr_cylinders, 0);
 	std::vector<int> volumes_used(pi.nr_cylinders, 0);
 	std::vector<char> cylinder_is_used(pi.nr_cylinders, false);
 
-	for (int i = idx1; i < idx2; ++i) {
-		const struct plot_data &data = pi.entry[i];
-		if (sum)
-			avg_speed += abs(data.speed) * (data.sec - last_sec);
-		else
-			avg_speed += data.speed * (data.sec - last_sec);
-		avg_depth += data.depth * (data.sec - last_sec);
-
-		if (data.speed > max_desc_speed)
-			max_desc_speed = data.speed;
-		if (data.speed < max_asc_speed)
-			max_asc_speed = data.speed;
-
-		if (data.depth < min_depth)
-			min_depth = data.depth;
-		if (data.depth > max_depth)
-			max_depth = data.depth;
-
-		for (int cylinder_index = 0; cylinder_index < pi.nr_cylinders; cylinder_index++) {
-			int next_pressure = get_plot_pressure(pi, i, cylinder_index);
-			if (next_pressure && !start_pressures[cylinder_index])
-				start_pressures[cylinder_index] = next_pressure;
-
-			if (start_pressures[cylinder_index]) {
-				if (last_pressures[cylinder_index]) {
-					bar_used[cylinder_index] += last_pressures[cylinder_index] - next_pressure;
-
-					const cylinder_t *cyl = d->get_cylinder(cylinder_index);
-
-					// TODO: Implement addition/subtraction on units.h types
-					volumes_used[cylinder_index] += (cyl->gas_volume((pressure_t){ .mbar = last_pressures[cylinder_index] }) -
-									 cyl->gas_volume((pressure_t){ .mbar = next_pressure })).mliter;
-				}
-
-				// check if the gas in this cylinder is being used
-				if (next_pressure < start_pressures[cylinder_index] - 1000 && !cylinder_is_used[cylinder_index]) {
-					cylinder_is_used[cylinder_index] = true;
-				}
-			}
-
-			last_pressures[cylinder_index] = next_pressure;
-		}
+	for (int cylinder_index = 0; cylinder_index < pi.nr_cylinders; cylinder_index++) {
+		const plot_range_index::cylinder &cyl = index.cylinders[cylinder_index];
+		int first = cyl.next_pressure[idx1];
+		if (first > last)
+			continue;
+		bar_used[cylinder_index] = (int)(cyl.bar_used[last] - cyl.bar_used[idx1]);
+		volumes_used[cylinder_index] = (int)(cyl.volume_used[last] - cyl.volume_used[idx1]);
 
-		last_sec = data.sec;
+		// check if the gas in this cylinder is being used
+		int start_pressure = get_plot_pressure(pi, first, cylinder_index);
+		cylinder_is_used[cylinder_index] = cyl.pressure.min(first, last) < start_pressure - 1000;
 	}
 
-	avg_depth /= stop.sec - start.sec;
-	avg_speed /= stop.sec - start.sec;
-
 	std::string l = casprintf_loc(translate("gettextFromC", "ΔT:%d:%02dmin"), delta_time / 60, delta_time % 60);
 
 	depthvalue = get_depth_units(delta_depth, NULL, &depth_unit);
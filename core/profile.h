@@ -9,6 +9,7 @@
 #include <string>
 #include <array>
 #include <vector>
+#include <stdint.h>
 
 enum velocity_t {
 	STABLE,
@@ -43,8 +44,6 @@ struct plot_data {
 	/* Depth info */
 	int depth = 0;
 	int ceiling = 0;
-	std::array<int, 16> ceilings;
-	std::array<int, 16> percentages;
 	int ndl = 0;
 	int tts = 0;
 	int rbt = 0;
@@ -57,7 +56,6 @@ struct plot_data {
 	struct gas_pressures pressures;
 	// TODO: make pressure_t default to 0
 	pressure_t o2pressure;  // for rebreathers, this is consensus measured po2, or setpoint otherwise. 0 for OC.
-	std::array<pressure_t, MAX_O2_SENSORS> o2sensor; //for rebreathers with several sensors
 	pressure_t o2setpoint;
 	pressure_t scr_OC_pO2;
 	int mod = 0, ead = 0, end = 0, eadd = 0;
@@ -80,11 +78,33 @@ struct plot_data {
 	bool icd_warning = false;
 };
 
+#define NUM_PLOT_TISSUES 16
+
+/*
+ * The parts of the plot info that are expensive to calculate and that
+ * are only needed for some of the graphs. Without PLOT_DECO, the
+ * calculated ceiling, NDL and TTS are not calculated. Without
+ * PLOT_TISSUES, the per-tissue ceilings and percentages and the
+ * gradient factors are not calculated.
+ */
+enum plot_channel {
+	PLOT_DECO = 1 << 0,
+	PLOT_TISSUES = 1 << 1,
+	PLOT_ALL_CHANNELS = PLOT_DECO | PLOT_TISSUES
+};
+
 /* Plot info with smoothing, velocity indication
- * and one-, two- and three-minute minimums and maximums */
+ * and one-, two- and three-minute minimums and maximums.
+ *
+ * The wide per-tissue and per-sensor channels are not part of plot_data,
+ * but are kept in separate arrays, so that the render passes that only
+ * read a few scalar fields don't have to walk over them. They are accessed
+ * via the get_plot_*() functions below. The sensor channel is only
+ * allocated for rebreather dives. */
 struct plot_info {
 	int nr = 0; // TODO: remove - redundant with entry.size()
 	int nr_cylinders = 0;
+	int channels = PLOT_ALL_CHANNELS; // the plot_channel bits that were calculated
 	int maxtime = 0;
 	int meandepth = 0, maxdepth = 0;
 	int minpressure = 0, maxpressure = 0;
@@ -96,6 +116,11 @@ struct plot_info {
 	bool waypoint_above_ceiling = false;
 	std::vector<plot_data> entry;
 	std::vector<plot_pressure_data> pressures; /* cylinders.size() blocks of nr entries. */
+	std::vector<int> ceilings; /* NUM_PLOT_TISSUES blocks of nr entries, in mm, or empty. */
+	std::vector<int> percentages; /* NUM_PLOT_TISSUES blocks of nr entries or empty. */
+	std::vector<pressure_t> o2sensors; /* MAX_O2_SENSORS blocks of nr entries or empty. */
+	/* The lines of get_plot_details_new(), formatted on first use. Empty or nr entries. */
+	mutable std::vector<std::vector<std::string>> details;
 
 	plot_info();
 	~plot_info();
@@ -107,8 +132,30 @@ struct plot_info {
 
 #define AMB_PERCENTAGE 50.0
 
-/* when planner_dc is non-null, this is called in planner mode. */
-extern struct plot_info create_plot_info_new(const struct dive *dive, const struct divecomputer *dc, const struct deco_state *planner_ds);
+/* when planner_dc is non-null, this is called in planner mode, which always calculates all channels. */
+extern struct plot_info create_plot_info_new(const struct dive *dive, const struct divecomputer *dc, const struct deco_state *planner_ds,
+					     int channels = PLOT_ALL_CHANNELS);
+
+/*
+ * The same, but the plot infos of the last few dives of the dive log
+ * are kept, so that switching between dives or replotting the same
+ * dive doesn't calculate the profile again. Dives in the planner and
+ * dives that are not in the dive log are not cached.
+ * invalidate_plot_info_cache() drops the plot info of the given dive
+ * and of all later dives, whose deco depends on it. A null dive drops
+ * everything.
+ */
+extern struct plot_info create_plot_info_cached(const struct dive *dive, const struct divecomputer *dc, const struct deco_state *planner_ds,
+						int channels = PLOT_ALL_CHANNELS);
+extern void invalidate_plot_info_cache(const struct dive *dive);
+extern size_t plot_info_cache_memory_usage(); // approximate, in bytes
+
+/*
+ * The plot infos of the first dive computer of a number of dives of the
+ * dive log, calculated on the thread pool. Used for printing and for
+ * exporting many dives.
+ */
+extern std::vector<struct plot_info> create_plot_infos(const std::vector<const struct dive *> &dives, int channels = PLOT_ALL_CHANNELS);
 
 /*
  * When showing dive profiles, we scale things to the
@@ -149,8 +196,61 @@ static inline int get_plot_pressure(const struct plot_info &pi, int idx, int cyl
 	return res ? res : get_plot_interpolated_pressure(pi, idx, cylinder);
 }
 
-// Returns index of sample and array of strings describing the dive details at given time
-std::pair<int, std::vector<std::string>> get_plot_details_new(const struct dive *d, const struct plot_info &pi, int time);
-std::vector<std::string> compare_samples(const struct dive *d, const struct plot_info &pi, int idx1, int idx2, bool sum);
+static inline int get_plot_tissue_ceiling(const struct plot_info &pi, int idx, int tissue)
+{
+	return pi.ceilings.empty() ? 0 : pi.ceilings[tissue + idx * NUM_PLOT_TISSUES];
+}
+
+static inline int get_plot_tissue_percentage(const struct plot_info &pi, int idx, int tissue)
+{
+	return pi.percentages.empty() ? 0 : pi.percentages[tissue + idx * NUM_PLOT_TISSUES];
+}
+
+static inline pressure_t get_plot_o2sensor(const struct plot_info &pi, int idx, int sensor)
+{
+	return pi.o2sensors.empty() ? pressure_t() : pi.o2sensors[sensor + idx * MAX_O2_SENSORS];
+}
+
+// The pO2 of a rebreather voted from the oxygen sensors, for nr entries of MAX_O2_SENSORS
+// sensor values each, of which the first nsensors are used. Zero if no sensor has a reading.
+void ccr_po2_consensus(const pressure_t *o2sensors, int nsensors, int nr, int *po2);
+
+// Returns index of sample and array of strings describing the dive details at given time.
+// The strings are kept in the plot info, which therefore must not be shared between threads.
+std::pair<int, const std::vector<std::string> &> get_plot_details_new(const struct dive *d, const struct plot_info &pi, int time);
+/* Minimum and maximum of any range of values in O(1) (a "sparse table"). */
+class range_extrema {
+	std::vector<std::vector<int>> min_levels, max_levels; // level k: extrema of 2^k values
+public:
+	range_extrema() = default;
+	range_extrema(const std::vector<int> &values);
+	int min(int first, int last) const; // of values[first..last], first <= last
+	int max(int first, int last) const;
+};
+
+/*
+ * Prefix sums and extrema of the entries of a plot_info, so that the
+ * statistics of a range of entries (see compare_samples()) are calculated
+ * in constant time. The sums at index i are over the entries 1..i, weighted
+ * with the time since the previous entry.
+ */
+struct plot_range_index {
+	struct cylinder {
+		std::vector<int64_t> bar_used;	  // in mbar, summed over the steps between entries with pressure
+		std::vector<int64_t> volume_used; // in ml, likewise
+		std::vector<int> next_pressure;	  // first entry at or after i with pressure, or nr
+		range_extrema pressure;
+	};
+	int nr = 0;
+	std::vector<int64_t> depth_time, speed_time, abs_speed_time;
+	range_extrema depth, speed;
+	std::vector<cylinder> cylinders;
+
+	plot_range_index() = default;
+	plot_range_index(const struct dive *d, const struct plot_info &pi);
+};
+
+std::vector<std::string> compare_samples(const struct dive *d, const struct plot_info &pi, const struct plot_range_index &index,
+					 int idx1, int idx2, bool sum);
 
 #endif // PROFILE_H
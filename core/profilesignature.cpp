@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "profilesignature.h"
+#include "dive.h"
+#include "divecomputer.h"
+#include "sample.h"
+#include "subsurface-string.h"
+
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <math.h>
+#include <map>
+#include <numeric>
+#include <string.h>
+#include <unordered_map>
+
+// The profile is cut into bands of that many points. Each band is quantized
+// on two grids of that size, the second one shifted by half a cell.
+static const int band_points = 4;
+static const int grid = 300;	// cm
+
+static uint64_t hash_add(uint64_t h, uint64_t v)
+{
+	// FNV-1a, on whole values rather than bytes
+	return (h ^ v) * 1099511628211ULL;
+}
+
+static const uint64_t hash_init = 14695981039346656037ULL;
+
+profile_signature::profile_signature(const struct divecomputer &dc)
+{
+	const std::vector<sample> &samples = dc.samples;
+	auto below_surface = [](const sample &s) { return s.depth.mm > SURFACE_THRESHOLD; };
+	auto first_it = std::find_if(samples.begin(), samples.end(), below_surface);
+	if (first_it == samples.end())
+		return;
+	size_t first = first_it - samples.begin();
+	size_t last = samples.rend() - std::find_if(samples.rbegin(), samples.rend(), below_surface) - 1;
+	int start = samples[first].time.seconds;
+	int end = samples[last].time.seconds;
+	if (end <= start)
+		return;
+	duration.seconds = end - start;
+
+	// Interpolate in the middle of every interval
+	size_t i = first;
+	for (int p = 0; p < points; ++p) {
+		double t = start + (p + 0.5) * duration.seconds / points;
+		while (i < last && samples[i + 1].time.seconds <= t)
+			++i;
+		double mm = samples[i].depth.mm;
+		if (i < last) {
+			const sample &next = samples[i + 1];
+			mm += (t - samples[i].time.seconds) / (next.time.seconds - samples[i].time.seconds) *
+			      (next.depth.mm - samples[i].depth.mm);
+		}
+		depth[p] = (uint16_t)std::clamp(lrint(mm / 10.0), 0L, 65535L);
+	}
+
+	hash = hash_init;
+	for (uint16_t cm: depth)
+		hash = hash_add(hash, (cm + 50) / 100);
+	hash = hash_add(hash, (duration.seconds + 30) / 60);
+}
+
+int profile_signature::distance(const profile_signature &s) const
+{
+	int sum = 0;
+	for (int p = 0; p < points; ++p)
+		sum += abs((int)depth[p] - (int)s.depth[p]);
+	return sum * 10 / points;
+}
+
+// The bucket keys of a signature: the whole hash and every band on both grids.
+template <typename F>
+static void for_each_key(const profile_signature &s, F fn)
+{
+	fn(hash_add(hash_add(hash_init, 0), s.hash));
+	for (int band = 0; band < profile_signature::points / band_points; ++band) {
+		for (int shift = 0; shift < 2; ++shift) {
+			uint64_t h = hash_add(hash_init, band * 2 + shift + 1);
+			for (int p = band * band_points; p < (band + 1) * band_points; ++p)
+				h = hash_add(h, (s.depth[p] + shift * grid / 2) / grid);
+			fn(h);
+		}
+	}
+}
+
+static bool indexed_dc(const struct divecomputer &dc)
+{
+	return !is_dc_manually_added_dive(&dc) && !is_dc_planner(&dc);
+}
+
+profile_signature_index::profile_signature_index(const std::vector<dive *> &dives)
+{
+	// Loading the samples and resampling them is the expensive part
+	std::vector<std::vector<entry>> per_dive(dives.size());
+	auto fn = [&dives, &per_dive](size_t i) {
+		struct dive *d = dives[i];
+		d->load_samples();
+		for (const divecomputer &dc: d->dcs) {
+			if (!indexed_dc(dc))
+				continue;
+			profile_signature s(dc);
+			if (s.valid())
+				per_dive[i].push_back({ d, i, &dc, s });
+		}
+	};
+	if (dives.size() < 100 || QThread::idealThreadCount() <= 1) {
+		for (size_t i = 0; i < dives.size(); i++)
+			fn(i);
+	} else {
+		std::vector<size_t> idx(dives.size());
+		std::iota(idx.begin(), idx.end(), 0);
+		QtConcurrent::blockingMap(idx, [&fn](size_t i) { fn(i); });
+	}
+
+	for (auto &v: per_dive) {
+		for (entry &e: v) {
+			size_t idx = entries.size();
+			for_each_key(e.signature, [this, idx](uint64_t key) { buckets[key].push_back(idx); });
+			entries.push_back(e);
+		}
+	}
+}
+
+// The entries that share a bucket with s, sorted and without duplicates.
+void profile_signature_index::candidates(const profile_signature &s, std::vector<size_t> &res) const
+{
+	res.clear();
+	for_each_key(s, [this, &res](uint64_t key) {
+		auto it = buckets.find(key);
+		if (it != buckets.end())
+			res.insert(res.end(), it->second.begin(), it->second.end());
+	});
+	std::sort(res.begin(), res.end());
+	res.erase(std::unique(res.begin(), res.end()), res.end());
+}
+
+int profile_signature_index::duplicate_distance_to(const struct dive &d, const struct divecomputer &dc,
+						   const profile_signature &s, const entry &e)
+{
+	if (e.dive == &d)
+		return -1;
+	if (llabs(e.dive->when - d.when) > max_clock_offset)
+		return -1;
+	int duration_fuzz = std::max(std::max(s.duration.seconds, e.signature.duration.seconds) / 10, 3 * 60);
+	if (abs(s.duration.seconds - e.signature.duration.seconds) > duration_fuzz)
+		return -1;
+	// A dive computer doesn't record the same dive under two different numbers
+	if (!dc.model.empty() && !strcasecmp(dc.model.c_str(), e.dc->model.c_str()) &&
+	    dc.deviceid == e.dc->deviceid && dc.diveid && e.dc->diveid && dc.diveid != e.dc->diveid)
+		return -1;
+	int distance = s.distance(e.signature);
+	return distance <= duplicate_distance ? distance : -1;
+}
+
+std::vector<profile_signature_index::match> profile_signature_index::find_similar(const struct dive &d, int max_distance) const
+{
+	std::unordered_map<struct dive *, int> best;
+	std::vector<size_t> found;
+	d.load_samples();
+	for (const divecomputer &dc: d.dcs) {
+		profile_signature s(dc);
+		if (!s.valid())
+			continue;
+		candidates(s, found);
+		for (size_t idx: found) {
+			const entry &e = entries[idx];
+			if (e.dive == &d)
+				continue;
+			int distance = s.distance(e.signature);
+			if (distance > max_distance)
+				continue;
+			auto [it, inserted] = best.emplace(e.dive, distance);
+			if (!inserted)
+				it->second = std::min(it->second, distance);
+		}
+	}
+
+	std::vector<match> res;
+	res.reserve(best.size());
+	for (auto [dive, distance]: best)
+		res.push_back({ dive, distance });
+	std::sort(res.begin(), res.end(), [](const match &m1, const match &m2)
+		  { return std::tie(m1.distance, m1.dive->when, m1.dive->id) < std::tie(m2.distance, m2.dive->when, m2.dive->id); });
+	return res;
+}
+
+struct dive *profile_signature_index::find_duplicate(const struct dive &d) const
+{
+	const entry *res = nullptr;
+	int res_distance = 0;
+	std::vector<size_t> found;
+	d.load_samples();
+	for (const divecomputer &dc: d.dcs) {
+		if (!indexed_dc(dc))
+			continue;
+		profile_signature s(dc);
+		if (!s.valid())
+			continue;
+		candidates(s, found);
+		for (size_t idx: found) {
+			int distance = duplicate_distance_to(d, dc, s, entries[idx]);
+			if (distance >= 0 && (!res || distance < res_distance ||
+					      (distance == res_distance && entries[idx].dive_idx < res->dive_idx))) {
+				res = &entries[idx];
+				res_distance = distance;
+			}
+		}
+	}
+	return res ? res->dive : nullptr;
+}
+
+std::vector<std::pair<dive *, dive *>> profile_signature_index::find_duplicates() const
+{
+	// Keyed by the indexes of the dives, to return the pairs in order
+	std::map<std::pair<size_t, size_t>, std::pair<dive *, dive *>> pairs;
+	std::vector<size_t> found;
+	for (const entry &e1: entries) {
+		candidates(e1.signature, found);
+		for (size_t idx: found) {
+			const entry &e2 = entries[idx];
+			if (e2.dive_idx <= e1.dive_idx)
+				continue;
+			if (duplicate_distance_to(*e1.dive, *e1.dc, e1.signature, e2) >= 0)
+				pairs.emplace(std::make_pair(e1.dive_idx, e2.dive_idx), std::make_pair(e1.dive, e2.dive));
+		}
+	}
+
+	std::vector<std::pair<dive *, dive *>> res;
+	res.reserve(pairs.size());
+	for (auto &[key, dives]: pairs)
+		res.push_back(dives);
+	return res;
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0
+// Compact signatures of the depth profiles, to find duplicate and similar dives.
+//
+// Merging on import only considers dives that overlap in time. The same dive
+// downloaded by two buddies or imported twice from different formats is
+// missed if the clocks of the dive computers disagree. The signature of a
+// dive computer is its depth profile resampled at a fixed number of points
+// over the time spent below the surface, plus a hash of the coarsely
+// quantized profile.
+//
+// The index finds the candidates by locality sensitive hashing: the profile
+// is cut into bands and each band, quantized on two staggered grids, is a
+// bucket key. Profiles that are close share at least one bucket with high
+// probability, so only few signatures have to be compared.
+//
+// Like the dive site index, the index is a snapshot: it must not be used
+// after dives were added, removed or edited.
+#ifndef PROFILESIGNATURE_H
+#define PROFILESIGNATURE_H
+
+#include "units.h"
+
+#include <array>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct dive;
+struct divecomputer;
+
+struct profile_signature {
+	static constexpr int points = 32;
+	std::array<uint16_t, points> depth = {};	// in cm, at equidistant times
+	duration_t duration;				// from first to last sample below the surface
+	uint64_t hash = 0;				// of the depths in m and the duration in min
+
+	profile_signature() = default;
+	profile_signature(const struct divecomputer &dc);
+	bool valid() const { return duration.seconds > 0; }
+	int distance(const profile_signature &s) const;	// mean depth difference in mm
+};
+
+class profile_signature_index {
+public:
+	// Dives whose profiles differ by at most that are duplicates
+	static constexpr int duplicate_distance = 1000;	// mm
+	// Nor will clocks be off by more than a day
+	static constexpr int max_clock_offset = 24 * 60 * 60;
+
+	struct match {
+		struct dive *dive;
+		int distance;
+	};
+
+	profile_signature_index(const std::vector<dive *> &dives);
+
+	// Dives with a dive computer whose profile differs from the profile of a
+	// dive computer of d by at most max_distance, closest first. d itself is
+	// not returned.
+	std::vector<match> find_similar(const struct dive &d, int max_distance) const;
+	// The closest dive that is most likely the same dive as d, or null.
+	struct dive *find_duplicate(const struct dive &d) const;
+	// All pairs of likely duplicates in the index.
+	std::vector<std::pair<dive *, dive *>> find_duplicates() const;
+private:
+	struct entry {
+		struct dive *dive;
+		size_t dive_idx;	// index in the dives the index was built from
+		const struct divecomputer *dc;
+		profile_signature signature;
+	};
+	void candidates(const profile_signature &s, std::vector<size_t> &res) const;
+	// Returns the distance of the profiles, or -1 if e is not a duplicate of the dive computer dc of d.
+	static int duplicate_distance_to(const struct dive &d, const struct divecomputer &dc,
+					 const profile_signature &s, const entry &e);
+
+	std::vector<entry> entries;
+	std::unordered_map<uint64_t, std::vector<size_t>> buckets;
+};
+
+#endif
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "progressreporter.h"
+
+#include <algorithm>
+#include <chrono>
+
+static int64_t now_ms()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+progress_reporter::progress_reporter(int max_per_second) : interval(1000 / std::max(max_per_second, 1))
+{
+}
+
+bool progress_reporter::update(uint64_t current, uint64_t total)
+{
+	uint64_t previous = current_value.exchange(current, std::memory_order_relaxed);
+	total_value.store(total, std::memory_order_relaxed);
+
+	int64_t now = now_ms();
+	// Going backwards means that a new operation started
+	if (current < previous || (total && current >= total)) {
+		next_due.store(now + interval, std::memory_order_relaxed);
+		return true;
+	}
+	// If several threads report, only one of them passes the update on
+	int64_t due = next_due.load(std::memory_order_relaxed);
+	return now >= due && next_due.compare_exchange_strong(due, now + interval, std::memory_order_relaxed);
+}
+
+void progress_reporter::reset()
+{
+	current_value.store(0, std::memory_order_relaxed);
+	total_value.store(0, std::memory_order_relaxed);
+	next_due.store(0, std::memory_order_relaxed);
+}
+
+double progress_reporter::fraction() const
+{
+	uint64_t t = total();
+	return t ? std::min((double)current() / (double)t, 1.0) : 0.0;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0
+// Progress of long running transfers, which is reported by worker threads.
+//
+// The transports report progress far more often than anybody can read it:
+// a fast download gives an update for every few bytes. The reporter keeps
+// the latest values in atomics, which the UI can poll at its own pace,
+// and tells the caller when an update is due to be passed on, which is at
+// most max_per_second times a second. Thus, the caller only formats the
+// text and calls into the UI for the updates that are due.
+#ifndef PROGRESSREPORTER_H
+#define PROGRESSREPORTER_H
+
+#include <atomic>
+#include <stdint.h>
+
+class progress_reporter {
+public:
+	progress_reporter(int max_per_second = 10);
+
+	// Record the progress. Returns true if the update is due: the first
+	// update of an operation, the last one and otherwise at most
+	// max_per_second a second. May be called from any thread.
+	bool update(uint64_t current, uint64_t total);
+	void reset();
+
+	uint64_t current() const { return current_value.load(std::memory_order_relaxed); }
+	uint64_t total() const { return total_value.load(std::memory_order_relaxed); }
+	double fraction() const;	// 0.0 if the total is unknown
+private:
+	int64_t interval;		// in ms
+	std::atomic<uint64_t> current_value = 0;
+	std::atomic<uint64_t> total_value = 0;
+	std::atomic<int64_t> next_due = 0;
+};
+
+#endif
@@ -1,8 +1,10 @@
 // SPDX-License-Identifier: GPL-2.0
 #include <errno.h>
+#include <algorithm>
 
 #include <QtBluetooth/QBluetoothAddress>
 #include <QLowEnergyController>
+#include <QLowEnergyConnectionParameters>
 #include <QLowEnergyService>
 #include <QCoreApplication>
 #include <QElapsedTimer>
@@ -28,21 +30,26 @@ static int debugCounter;
 #define MAXIMAL_HW_CREDIT	254
 #define MINIMAL_HW_CREDIT	32
 
+// Sleep until an event arrives (in particular a BLE signal) instead
+// of polling. The single-shot timer wakes us up when the time is over.
 #define WAITFOR(expression, ms) do {					\
 	Q_ASSERT(QCoreApplication::instance());				\
 	Q_ASSERT(QThread::currentThread());				\
 									\
 	if (expression)							\
 		break;							\
-	QElapsedTimer timer;						\
-	timer.start();							\
+	bool expired = false;						\
+	QTimer wakeup;							\
+	wakeup.setSingleShot(true);					\
+	wakeup.setTimerType(Qt::PreciseTimer);				\
+	QObject::connect(&wakeup, &QTimer::timeout, [&expired]() { expired = true; }); \
+	wakeup.start(ms);						\
 									\
 	do {								\
-		QCoreApplication::processEvents(QEventLoop::AllEvents, ms); \
+		QCoreApplication::processEvents(QEventLoop::AllEvents | QEventLoop::WaitForMoreEvents); \
 		if (expression)						\
 			break;						\
-		QThread::msleep(10);					\
-	} while (timer.elapsed() < (ms));				\
+	} while (!expired);						\
 } while (0)
 
 static std::string current_time()
@@ -81,10 +88,18 @@ static bool is_garmin(const device_data_t &d)
 	return d.vendor == "Garmin";
 }
 
+// Keep track of the received bytes, so that the user can see how fast
+// the download is.
+void BLEObject::countReceived(int size)
+{
+	meter.received(size);
+}
+
 void BLEObject::characteristcStateChanged(const QLowEnergyCharacteristic &c, const QByteArray &value)
 {
 	if (verbose > 2 || debugCounter < DEBUG_THRESHOLD)
 		report_info("%s packet RECV %s", current_time().c_str(), qPrintable(value.toHex()));
+	countReceived(value.size());
 	if (is_hw(device)) {
 		if (c.uuid() == telit[TELIT_DATA_TX] || c.uuid() == ublox[UBLOX_DATA_TX]) {
 			hw_credit--;
@@ -322,30 +337,33 @@ dc_status_t BLEObject::write(const void *data, size_t size, size_t *actual)
 
 	if (!receivedPackets.isEmpty()) {
 		report_info(".. write HIT with still incoming packets in queue");
-		do {
-			receivedPackets.takeFirst();
-		} while (!receivedPackets.isEmpty());
+		receivedPackets.clear();
+		receivedOffset = 0;
 	}
 
-	for (const QLowEnergyCharacteristic &c: preferredService()->characteristics()) {
-		if (!is_write_characteristic(c))
-			continue;
-
-		QByteArray bytes((const char *)data, (int) size);
-		if (verbose > 2 || debugCounter < DEBUG_THRESHOLD)
-			report_info("%s packet SEND %s", current_time().c_str(), qPrintable(bytes.toHex()));
-
-		QLowEnergyService::WriteMode mode;
-		mode = (c.properties() & QLowEnergyCharacteristic::WriteNoResponse) ?
-				QLowEnergyService::WriteWithoutResponse :
-				QLowEnergyService::WriteWithResponse;
-
-		preferredService()->writeCharacteristic(c, bytes, mode);
-		if (actual) *actual = size;
-		return DC_STATUS_SUCCESS;
+	// Look for the write characteristic only once. The writes are not
+	// waited for, so that consecutive packets are pipelined by the stack.
+	if (!writeCharacteristic.isValid()) {
+		for (const QLowEnergyCharacteristic &c: preferredService()->characteristics()) {
+			if (!is_write_characteristic(c))
+				continue;
+			writeCharacteristic = c;
+			writeMode = (c.properties() & QLowEnergyCharacteristic::WriteNoResponse) ?
+					QLowEnergyService::WriteWithoutResponse :
+					QLowEnergyService::WriteWithResponse;
+			break;
+		}
+		if (!writeCharacteristic.isValid())
+			return DC_STATUS_IO;
 	}
 
-	return DC_STATUS_IO;
+	QByteArray bytes((const char *)data, (int) size);
+	if (verbose > 2 || debugCounter < DEBUG_THRESHOLD)
+		report_info("%s packet SEND %s", current_time().c_str(), qPrintable(bytes.toHex()));
+
+	preferredService()->writeCharacteristic(writeCharacteristic, bytes, writeMode);
+	if (actual) *actual = size;
+	return DC_STATUS_SUCCESS;
 }
 
 dc_status_t BLEObject::poll(int timeout)
@@ -378,24 +396,23 @@ dc_status_t BLEObject::read(void *data, size_t size, size_t *actual)
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	QByteArray packet = receivedPackets.takeFirst();
-
-	// Did we get more than asked for?
-	//
-	// Put back the left-over at the beginning of the
-	// received packet list, and truncate the packet
-	// we got to just the part asked for.
-	if ((size_t)packet.size() > size) {
-		receivedPackets.prepend(packet.mid(size));
-		packet.truncate(size);
-	}
-
-	memcpy((char *)data, packet.data(), packet.size());
+	// Return the rest of the first packet, but not more than asked for.
+	// If we got more, remember how far we got instead of copying the
+	// left-over into a new packet.
+	const QByteArray &packet = receivedPackets.head();
+	size_t len = std::min(size, (size_t)(packet.size() - receivedOffset));
+	memcpy((char *)data, packet.constData() + receivedOffset, len);
 	if (actual)
-		*actual += packet.size();
+		*actual += len;
 
 	if (verbose > 2 || debugCounter < DEBUG_THRESHOLD)
-		report_info("%s packet READ %s", current_time().c_str(), qPrintable(packet.toHex()));
+		report_info("%s packet READ %s", current_time().c_str(), qPrintable(packet.mid(receivedOffset, len).toHex()));
+
+	receivedOffset += len;
+	if (receivedOffset >= packet.size()) {
+		receivedPackets.dequeue();
+		receivedOffset = 0;
+	}
 
 	return DC_STATUS_SUCCESS;
 }
@@ -609,6 +626,9 @@ dc_status_t qt_ble_open(void **io, dc_context_t *, const char *devaddr, device_d
 	switch (controller->state()) {
 	case QLowEnergyController::ConnectedState:
 		report_info("connected to the controller for device %s", devaddr);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+		report_info("MTU is %d", controller->mtu());
+#endif
 		break;
 	case QLowEnergyController::ConnectingState:
 		report_info("timeout while trying to connect to the controller %s", devaddr);
@@ -622,6 +642,15 @@ dc_status_t qt_ble_open(void **io, dc_context_t *, const char *devaddr, device_d
 		return DC_STATUS_IO;
 	}
 
+	// Ask for a short connection interval, since we want to transfer a lot
+	// of data. This is only a request, which is honored by BlueZ and Android
+	// (if the device agrees) and ignored by the other platforms.
+	QLowEnergyConnectionParameters parameters;
+	parameters.setIntervalRange(7.5, 15.0);
+	parameters.setLatency(0);
+	parameters.setSupervisionTimeout(4000);
+	controller->requestConnectionUpdate(parameters);
+
 	// We need to discover services etc here!
 	// Note that ble takes ownership of controller and henceforth deleting ble will
 	// take care of deleting controller.
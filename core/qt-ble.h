@@ -7,6 +7,7 @@
 #include <QVector>
 #include <QLowEnergyController>
 #include <QEventLoop>
+#include <QQueue>
 
 #define TELIT_DATA_RX    0
 #define TELIT_DATA_TX    1
@@ -43,11 +44,17 @@ public slots:
 	dc_status_t setupHwTerminalIo(const QList<QLowEnergyCharacteristic> &allC);
 	dc_status_t setHwCredit(unsigned int c);
 private:
+	void countReceived(int size);
+
 	QVector<QLowEnergyService *> services;
 
 	QLowEnergyController *controller;
 	QLowEnergyService *preferred = nullptr;
-	QList<QByteArray> receivedPackets;
+	QQueue<QByteArray> receivedPackets;
+	int receivedOffset = 0;		// Already read part of the first packet
+	QLowEnergyCharacteristic writeCharacteristic;
+	QLowEnergyService::WriteMode writeMode = QLowEnergyService::WriteWithResponse;
+	transfer_meter meter { "BLE" };
 	bool isCharacteristicWritten;
 	device_data_t &device;
 	unsigned int hw_credit = 0;
@@ -35,7 +35,10 @@
 #include <QFont>
 #include <QApplication>
 #include <QTextDocument>
+#include <charconv>
+#include <cmath>
 #include <cstdarg>
+#include <map>
 #include <cstdint>
 #ifdef Q_OS_UNIX
 #include <sys/utsname.h>
@@ -51,19 +54,124 @@ static inline QString degreeSigns()
 	return QStringLiteral("dD\u00b0");
 }
 
+/*
+ * The unit strings are formatted for every dive of the dive list and every
+ * tooltip of the profile. Instead of parsing a "%L1" format string with
+ * QString::arg(), the numbers are rounded by hand, written with std::to_chars()
+ * and the separators of the locale are put in between. The result is the same:
+ * rounded half away from zero and grouped by thousands. Locales that QLocale
+ * formats in any other way (other digits, other grouping) are detected on first
+ * use and go through QString::arg().
+ */
+namespace {
+	struct number_locale {
+		QLocale locale;
+		bool valid = false;
+		bool fast = false;
+		bool grouping = false;
+		QString decimal_point, group_separator, minus_sign;
+	};
+}
+
+static const number_locale &get_number_locale()
+{
+	// The default locale is set once at startup. Every thread has its
+	// own copy, so that no locking is needed.
+	thread_local number_locale res;
+	QLocale current;
+	if (res.valid && res.locale == current)
+		return res;
+	res.locale = current;
+	res.valid = true;
+	res.decimal_point = QString(current.decimalPoint());
+	res.group_separator = QString(current.groupSeparator());
+	res.minus_sign = QString(current.negativeSign());
+
+	const QString &dp = res.decimal_point, &gs = res.group_separator;
+	QString big = QStringLiteral("%L1").arg(-1234567.5, 0, 'f', 1);
+	QString small = QStringLiteral("%L1").arg(1234.5, 0, 'f', 1);
+	res.grouping = big == res.minus_sign + "1" + gs + "234" + gs + "567" + dp + "5" &&
+		       small == "1" + gs + "234" + dp + "5";
+	res.fast = res.grouping || (big == res.minus_sign + "1234567" + dp + "5" && small == "1234" + dp + "5");
+	return res;
+}
+
+static char16_t *append_utf16(char16_t *p, const QString &s)
+{
+	memcpy(p, s.utf16(), s.size() * sizeof(char16_t));
+	return p + s.size();
+}
+
+// Like res += QString("%L1").arg(value, 0, 'f', decimals)
+static void append_number(QString &res, double value, int decimals)
+{
+	static const double scale[] = { 1.0, 10.0, 100.0, 1000.0 };
+	const number_locale &l = get_number_locale();
+	double a = fabs(value);
+	double p = decimals >= 0 && decimals <= 3 ? a * scale[decimals] : NAN;
+	// Above that, the fractional part of the product is lost (and NaN fails, too)
+	if (!l.fast || !(p < 1099511627776.0)) {
+		res += QStringLiteral("%L1").arg(value, 0, 'f', decimals);
+		return;
+	}
+
+	// Round half up, as decided by the exact value of a * scale, which is p + e
+	double e = std::fma(a, scale[decimals], -p);
+	double f = floor(p);
+	uint64_t n = (uint64_t)f + ((p - f) - 0.5 >= -e ? 1 : 0);
+
+	char digits[24];
+	int len = std::to_chars(digits, digits + sizeof(digits), n).ptr - digits;
+	int int_len = std::max(len - decimals, 1);
+	int zeros = int_len + decimals - len;	// numbers below 1 have a leading zero
+
+	// Plenty for 13 digits, with separators of up to two UTF-16 code units
+	char16_t buf[64];
+	char16_t *out = buf;
+	if (value < 0)
+		out = append_utf16(out, l.minus_sign);
+	for (int i = 0; i < int_len; i++) {
+		if (l.grouping && i > 0 && (int_len - i) % 3 == 0)
+			out = append_utf16(out, l.group_separator);
+		*out++ = i < zeros ? '0' : digits[i - zeros];
+	}
+	if (decimals > 0) {
+		out = append_utf16(out, l.decimal_point);
+		for (int i = int_len; i < int_len + decimals; i++)
+			*out++ = i < zeros ? '0' : digits[i - zeros];
+	}
+	res.append(reinterpret_cast<const QChar *>(buf), out - buf);
+}
+
+// Like res += QString("%1").arg(value, width, 10, QChar('0')), for non-negative values
+static void append_int(QString &res, int value, int width = 0)
+{
+	char buf[16];
+	int len = std::to_chars(buf, buf + sizeof(buf), value).ptr - buf;
+	for (int i = len; i < width; i++)
+		res += QLatin1Char('0');
+	res += QLatin1String(buf, len);
+}
+
+template <units::WEIGHT unit>
 static QString weight_string(weight_t weight)
 {
 	QString str;
-	if (get_units()->weight == units::KG) {
+	if constexpr (unit == units::KG) {
 		double kg = (double) weight.grams / 1000.0;
-		str = QString("%L1").arg(kg, 0, 'f', kg >= 20.0 ? 0 : 1);
+		append_number(str, kg, kg >= 20.0 ? 0 : 1);
 	} else {
 		double lbs = grams_to_lbs(weight.grams);
-		str = QString("%L1").arg(lbs, 0, 'f', lbs >= 40.0 ? 0 : 1);
+		append_number(str, lbs, lbs >= 40.0 ? 0 : 1);
 	}
 	return str;
 }
 
+static QString weight_string(weight_t weight)
+{
+	return get_units()->weight == units::KG ? weight_string<units::KG>(weight) : weight_string<units::LBS>(weight);
+}
+
 QString distance_string(int distanceInMeters)
 {
 	QString str;
@@ -286,8 +394,22 @@ static xmlDocPtr get_stylesheet_doc(const xmlChar *uri, xmlDictPtr, int, void *,
 	return doc;
 }
 
+/*
+ * The stylesheets are compiled into the resources and never change.
+ * Therefore, they are compiled only once and kept for the lifetime of
+ * the program. A compiled stylesheet can be applied from different
+ * threads at the same time, only the cache itself has to be protected.
+ */
+static QMutex stylesheetMutex;
+static std::map<std::string, xsltStylesheetPtr> stylesheets;
+
 xsltStylesheetPtr get_stylesheet(const char *name)
 {
+	QMutexLocker locker(&stylesheetMutex);
+	auto it = stylesheets.find(name);
+	if (it != stylesheets.end())
+		return it->second;
+
 	// this needs to be done only once, but doesn't hurt to run every time
 	xsltSetLoaderFunc(get_stylesheet_doc);
 
@@ -303,6 +425,7 @@ xsltStylesheetPtr get_stylesheet(const char *name)
 		return NULL;
 	}
 
+	stylesheets[name] = xslt;
 	return xslt;
 }
 
@@ -490,15 +613,29 @@ QLocale getLocale()
 	return loc;
 }
 
-QString get_depth_string(int mm, bool showunit, bool showdecimal)
+template <units::LENGTH unit>
+static QString depth_string(int mm, bool showunit, bool showdecimal)
 {
-	if (prefs.units.length == units::METERS) {
+	QString str;
+	if constexpr (unit == units::METERS) {
 		double meters = mm / 1000.0;
-		return QString("%L1%2").arg(meters, 0, 'f', (showdecimal && meters < 20.0) ? 1 : 0).arg(showunit ? gettextFromC::tr("m") : QString());
+		append_number(str, meters, (showdecimal && meters < 20.0) ? 1 : 0);
+		if (showunit)
+			str += gettextFromC::tr("m");
 	} else {
-		double feet = mm_to_feet(mm);
-		return QString("%L1%2").arg(feet, 0, 'f', 0).arg(showunit ? gettextFromC::tr("ft") : QString());
+		append_number(str, mm_to_feet(mm), 0);
+		if (showunit)
+			str += gettextFromC::tr("ft");
 	}
+	return str;
+}
+
+QString get_depth_string(int mm, bool showunit, bool showdecimal)
+{
+	if (prefs.units.length == units::METERS)
+		return depth_string<units::METERS>(mm, showunit, showdecimal);
+	else
+		return depth_string<units::FEET>(mm, showunit, showdecimal);
 }
 
 QString get_depth_string(depth_t depth, bool showunit, bool showdecimal)
@@ -538,17 +675,30 @@ QString get_weight_unit()
 	return get_weight_unit(prefs.units.weight == units::KG);
 }
 
-QString get_temperature_string(temperature_t temp, bool showunit)
+template <units::TEMPERATURE unit>
+static QString temperature_string(temperature_t temp, bool showunit)
 {
-	if (temp.mkelvin == 0) {
-		return ""; //temperature not defined
-	} else if (prefs.units.temperature == units::CELSIUS) {
-		double celsius = mkelvin_to_C(temp.mkelvin);
-		return QString("%L1%2%3").arg(celsius, 0, 'f', 1).arg(showunit ? "°" : "").arg(showunit ? gettextFromC::tr("C") : QString());
+	QString str;
+	if constexpr (unit == units::CELSIUS) {
+		append_number(str, mkelvin_to_C(temp.mkelvin), 1);
+		if (showunit)
+			str += QStringLiteral("°") + gettextFromC::tr("C");
 	} else {
-		double fahrenheit = mkelvin_to_F(temp.mkelvin);
-		return QString("%L1%2%3").arg(fahrenheit, 0, 'f', 1).arg(showunit ? "°" : "").arg(showunit ? gettextFromC::tr("F") : QString());
+		append_number(str, mkelvin_to_F(temp.mkelvin), 1);
+		if (showunit)
+			str += QStringLiteral("°") + gettextFromC::tr("F");
 	}
+	return str;
+}
+
+QString get_temperature_string(temperature_t temp, bool showunit)
+{
+	if (temp.mkelvin == 0)
+		return ""; //temperature not defined
+	else if (prefs.units.temperature == units::CELSIUS)
+		return temperature_string<units::CELSIUS>(temp, showunit);
+	else
+		return temperature_string<units::FAHRENHEIT>(temp, showunit);
 }
 
 QString get_temp_unit(bool metric)
@@ -564,12 +714,29 @@ QString get_temp_unit()
 	return get_temp_unit(prefs.units.temperature == units::CELSIUS);
 }
 
+// Same units and decimals as get_volume_units()
+template <units::VOLUME unit>
+static QString volume_string(unsigned int ml, bool showunit)
+{
+	QString str;
+	if constexpr (unit == units::LITER) {
+		append_number(str, ml / 1000.0, 1);
+		if (showunit)
+			str += QString::fromUtf8(translate("gettextFromC", "ℓ"));
+	} else {
+		append_number(str, ml_to_cuft(ml), 2);
+		if (showunit)
+			str += QString::fromUtf8(translate("gettextFromC", "cuft"));
+	}
+	return str;
+}
+
 QString get_volume_string(int mliter, bool showunit)
 {
-	const char *unit;
-	int decimals;
-	double value = get_volume_units(mliter, &decimals, &unit);
-	return QString("%L1%2").arg(value, 0, 'f', decimals).arg(showunit ? unit : "");
+	if (get_units()->volume == units::CUFT)
+		return volume_string<units::CUFT>(mliter, showunit);
+	else
+		return volume_string<units::LITER>(mliter, showunit);
 }
 
 QString get_volume_string(volume_t volume, bool showunit)
@@ -590,15 +757,28 @@ QString get_volume_unit()
 	return get_volume_unit(prefs.units.volume == units::LITER);
 }
 
-QString get_pressure_string(pressure_t pressure, bool showunit)
+template <units::PRESSURE unit>
+static QString pressure_string(pressure_t pressure, bool showunit)
 {
-	if (prefs.units.pressure == units::BAR) {
-		double bar = pressure.mbar / 1000.0;
-		return QString("%L1%2").arg(bar, 0, 'f', 0).arg(showunit ? gettextFromC::tr("bar") : QString());
+	QString str;
+	if constexpr (unit == units::BAR) {
+		append_number(str, pressure.mbar / 1000.0, 0);
+		if (showunit)
+			str += gettextFromC::tr("bar");
 	} else {
-		double psi = mbar_to_PSI(pressure.mbar);
-		return QString("%L1%2").arg(psi, 0, 'f', 0).arg(showunit ? gettextFromC::tr("psi") : QString());
+		append_number(str, mbar_to_PSI(pressure.mbar), 0);
+		if (showunit)
+			str += gettextFromC::tr("psi");
 	}
+	return str;
+}
+
+QString get_pressure_string(pressure_t pressure, bool showunit)
+{
+	if (prefs.units.pressure == units::BAR)
+		return pressure_string<units::BAR>(pressure, showunit);
+	else
+		return pressure_string<units::PSI>(pressure, showunit);
 }
 
 QString get_salinity_string(int salinity)
@@ -862,32 +1042,53 @@ QString get_dive_duration_string(timestamp_t when, QString hoursText, QString mi
 	secs = when - 60 * fullmins;
 	hrs = mins / 60;
 
+	// The pieces are appended one after the other, rather than going through QString::arg()
 	QString displayTime;
+	bool colon = separator == ":";
 	if (prefs.units.duration_units == units::ALWAYS_HOURS || (prefs.units.duration_units == units::MIXED && hrs)) {
 		mins -= hrs * 60;
-		displayTime = QString("%1%2%3%4%5").arg(hrs).arg(separator == ":" ? "" : hoursText).arg(separator)
-			.arg(mins, 2, 10, QChar('0')).arg(separator == ":" ? hoursText : minutesText);
+		append_int(displayTime, hrs);
+		if (!colon)
+			displayTime += hoursText;
+		displayTime += separator;
+		append_int(displayTime, mins, 2);
+		displayTime += colon ? hoursText : minutesText;
 	} else if (isFreeDive && ( prefs.units.duration_units == units::MINUTES_ONLY || minutesText != "" )) {
 		// Freedive <1h and we display no hours but only minutes for other dives
 		// --> display a short (5min 35sec) freedives e.g. as "5:35"
 		// Freedive <1h and we display a unit for minutes
 		// --> display a short (5min 35sec) freedives e.g. as "5:35min"
-		if (separator == ":") displayTime = QString("%1%2%3%4").arg(fullmins).arg(separator)
-			.arg(secs, 2, 10, QChar('0')).arg(minutesText);
-		else displayTime = QString("%1%2%3%4%5").arg(fullmins).arg(minutesText).arg(separator)
-			.arg(secs).arg(secondsText);
+		append_int(displayTime, fullmins);
+		if (colon) {
+			displayTime += separator;
+			append_int(displayTime, secs, 2);
+			displayTime += minutesText;
+		} else {
+			displayTime += minutesText + separator;
+			append_int(displayTime, secs);
+			displayTime += secondsText;
+		}
 	} else if (isFreeDive) {
 		// Mixed display (hh:mm / mm only) and freedive < 1h and we have no unit for minutes
 		// --> Prefix duration with "0:" --> "0:05:35"
-		if (separator == ":") displayTime = QString("%1%2%3%4%5%6").arg(hrs).arg(separator)
-			.arg(fullmins, 2, 10, QChar('0')).arg(separator)
-			.arg(secs, 2, 10, QChar('0')).arg(hoursText);
-		// Separator != ":" and no units for minutes --> unlikely case - remove?
-		else displayTime = QString("%1%2%3%4%5%6%7%8").arg(hrs).arg(hoursText).arg(separator)
-			.arg(fullmins).arg(minutesText).arg(separator)
-			.arg(secs).arg(secondsText);
+		append_int(displayTime, hrs);
+		if (colon) {
+			displayTime += separator;
+			append_int(displayTime, fullmins, 2);
+			displayTime += separator;
+			append_int(displayTime, secs, 2);
+			displayTime += hoursText;
+		} else {
+			// Separator != ":" and no units for minutes --> unlikely case - remove?
+			displayTime += hoursText + separator;
+			append_int(displayTime, fullmins);
+			displayTime += minutesText + separator;
+			append_int(displayTime, secs);
+			displayTime += secondsText;
+		}
 	} else {
-		displayTime = QString("%1%2").arg(mins).arg(minutesText);
+		append_int(displayTime, mins);
+		displayTime += minutesText;
 	}
 	return displayTime;
 }
@@ -966,24 +1167,26 @@ std::string get_current_date()
 static QMutex hashOfMutex;
 static QHash<QString, QString> localFilenameOf;
 
-std::string hashfile_name()
+// Changes of localFilenameOf that were not yet written. Instead of rewriting the
+// whole hashfile, these are appended to a log, which is replayed when reading
+// the hashfile. An empty local filename means that the entry was removed.
+// Once the log gets longer than the table itself, the hashfile is rewritten.
+static QVector<std::pair<QString, QString>> unsavedFilenames;
+static int loggedFilenames = 0;
+
+static QString hashlogName()
 {
-	return std::string(system_default_directory()) + "/hashes";
+	return QString::fromStdString(hashfile_name()) + ".log";
 }
 
-static QString thumbnailDir()
+std::string hashfile_name()
 {
-	return QString::fromStdString(system_default_directory() + "/thumbnails/");
+	return std::string(system_default_directory()) + "/hashes";
 }
 
-// Calculate thumbnail filename by hashing name of file.
-QString thumbnailFileName(const QString &filename)
+QString thumbnailDir()
 {
-	if (filename.isEmpty())
-		return QString();
-	QCryptographicHash hash(QCryptographicHash::Sha1);
-	hash.addData(filename.toUtf8());
-	return thumbnailDir() + hash.result().toHex();
+	return QString::fromStdString(system_default_directory() + "/thumbnails/");
 }
 
 // TODO: This is a temporary helper struct. Remove in due course with convertLocalFilename().
@@ -1044,6 +1247,24 @@ void read_hashes()
 		convertLocalFilename(hashOf, localFilenameByHash);
 	}
 	QMutexLocker locker(&hashOfMutex);
+
+	// Replay the log of changes since the hashfile was written.
+	loggedFilenames = 0;
+	QFile hashlog(hashlogName());
+	if (hashlog.open(QIODevice::ReadOnly)) {
+		QDataStream stream(&hashlog);
+		while (!stream.atEnd()) {
+			QString originalName, localName;
+			stream >> originalName >> localName;
+			if (stream.status() != QDataStream::Ok)
+				break;	// Truncated entry, e.g. after a crash
+			if (localName.isEmpty())
+				localFilenameOf.remove(originalName);
+			else
+				localFilenameOf[originalName] = localName;
+			++loggedFilenames;
+		}
+	}
 	localFilenameOf.remove("");
 
 	// Make sure that the thumbnail directory exists
@@ -1052,16 +1273,38 @@ void read_hashes()
 
 void write_hashes()
 {
-	QSaveFile hashfile(QString::fromStdString(hashfile_name()));
 	QMutexLocker locker(&hashOfMutex);
+	if (unsavedFilenames.isEmpty())
+		return;
+
+	// As long as the log is shorter than the table, append the changes to the log.
+	if (loggedFilenames + unsavedFilenames.size() <= localFilenameOf.size()) {
+		QFile hashlog(hashlogName());
+		if (hashlog.open(QIODevice::WriteOnly | QIODevice::Append)) {
+			QDataStream stream(&hashlog);
+			for (const auto &[originalName, localName]: unsavedFilenames)
+				stream << originalName << localName;
+			if (stream.status() == QDataStream::Ok && hashlog.flush()) {
+				loggedFilenames += unsavedFilenames.size();
+				unsavedFilenames.clear();
+				return;
+			}
+		}
+		// If appending failed, try to rewrite the hashfile.
+	}
 
+	QSaveFile hashfile(QString::fromStdString(hashfile_name()));
 	if (hashfile.open(QIODevice::WriteOnly)) {
 		QDataStream stream(&hashfile);
 		stream << QHash<QByteArray, QString>();	// Empty hash to filename - for backwards compatibility
 		stream << QHash<QString, QByteArray>(); // Empty hashes - for backwards compatibility
 		stream << QHash<QString,QImage>();	// Empty thumbnailCache - for backwards compatibility
 		stream << localFilenameOf;
-		hashfile.commit();
+		if (hashfile.commit()) {
+			QFile::remove(hashlogName());
+			loggedFilenames = 0;
+			unsavedFilenames.clear();
+		}
 	} else {
 		qWarning() << "Cannot open hashfile for writing: " << hashfile.fileName();
 	}
@@ -1073,10 +1316,16 @@ void learnPictureFilename(const QString &originalName, const QString &localName)
 		return;
 	QMutexLocker locker(&hashOfMutex);
 	// Only keep track of images where original and local names differ
-	if (originalName == localName)
-		localFilenameOf.remove(originalName);
-	else
-		localFilenameOf[originalName] = localName;
+	if (originalName == localName) {
+		if (localFilenameOf.remove(originalName))
+			unsavedFilenames.push_back({ originalName, QString() });
+	} else {
+		auto it = localFilenameOf.find(originalName);
+		if (it != localFilenameOf.end() && *it == localName)
+			return;
+		localFilenameOf.insert(originalName, localName);
+		unsavedFilenames.push_back({ originalName, localName });
+	}
 }
 
 QString localFilePath(const QString &originalFilename)
@@ -1511,18 +1760,6 @@ void print_qt_versions()
 	printf("%s\n", qPrintable(QStringLiteral("built with Qt Version %1, runtime from Qt Version %2").arg(QT_VERSION_STR).arg(qVersion())));
 }
 
-QMutex planLock;
-
-void lock_planner()
-{
-	planLock.lock();
-}
-
-void unlock_planner()
-{
-	planLock.unlock();
-}
-
 // function to call to allow the UI to show updates for longer running activities
 void (*uiNotificationCallback)(QString msg) = nullptr;
 
@@ -33,7 +33,7 @@ std::vector<std::pair<int, QString>> get_dive_gas_list(const struct dive *d, int
 QStringList stringToList(const QString &s);
 void read_hashes();
 void write_hashes();
-QString thumbnailFileName(const QString &filename);
+QString thumbnailDir();
 void learnPictureFilename(const QString &originalName, const QString &localName);
 QString localFilePath(const QString &originalFilename);
 std::optional<std::string> getCloudURL(); // move to prefs.h, probably.
@@ -113,9 +113,7 @@ enum deco_mode decoMode(bool in_planner);
 void parse_seabear_header(const char *filename, struct xml_params *params);
 time_t get_dive_datetime_from_isostring(const char *when);
 void print_qt_versions();
-void lock_planner();
-void unlock_planner();
-xsltStylesheetPtr get_stylesheet(const char *name);
+xsltStylesheetPtr get_stylesheet(const char *name);	// owned by a cache, don't free
 weight_t string_to_weight(const char *str);
 depth_t string_to_depth(const char *str);
 pressure_t string_to_pressure(const char *str);
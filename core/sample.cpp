@@ -1,9 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #include "sample.h"
+#include "perfcounters.h"
 
 sample::sample() = default;
 
+perf_counter samples_parsed("samples parsed");
+
 /*
  * Adding a cylinder pressure sample field is not quite as trivial as it
  * perhaps should be.
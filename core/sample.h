@@ -32,6 +32,44 @@ struct sample                         // BASE TYPE BYTES  UNITS    RANGE
 	sample();			  // Default constructor
 };	                                  // Total size of structure: 63 bytes, excluding padding at end
 
+/*
+ * The channels of a sample, in the order of the columns of the sample
+ * encoding (see samplecodec.cpp). A dive computer records a channel if
+ * any of its samples differ from a default constructed sample there.
+ * See get_sample_channels().
+ */
+enum sample_channel {
+	SAMPLE_TIME		= 1 << 0,
+	SAMPLE_STOPTIME		= 1 << 1,
+	SAMPLE_NDL		= 1 << 2,
+	SAMPLE_TTS		= 1 << 3,
+	SAMPLE_RBT		= 1 << 4,
+	SAMPLE_DEPTH		= 1 << 5,
+	SAMPLE_STOPDEPTH	= 1 << 6,
+	SAMPLE_TEMPERATURE	= 1 << 7,
+	SAMPLE_PRESSURE0	= 1 << 8,
+	SAMPLE_PRESSURE1	= 1 << 9,
+	SAMPLE_SETPOINT		= 1 << 10,
+	SAMPLE_O2SENSOR0	= 1 << 11,
+	SAMPLE_O2SENSOR1	= 1 << 12,
+	SAMPLE_O2SENSOR2	= 1 << 13,
+	SAMPLE_O2SENSOR3	= 1 << 14,
+	SAMPLE_O2SENSOR4	= 1 << 15,
+	SAMPLE_O2SENSOR5	= 1 << 16,
+	SAMPLE_BEARING		= 1 << 17,
+	SAMPLE_SENSOR0		= 1 << 18,
+	SAMPLE_SENSOR1		= 1 << 19,
+	SAMPLE_CNS		= 1 << 20,
+	SAMPLE_HEARTBEAT	= 1 << 21,
+	SAMPLE_SAC		= 1 << 22,
+	SAMPLE_IN_DECO		= 1 << 23,
+	SAMPLE_MANUALLY_ENTERED	= 1 << 24
+};
+#define SAMPLE_CHANNELS 25
+
 extern void add_sample_pressure(struct sample *sample, int sensor, int mbar);
 
+class perf_counter;
+extern perf_counter samples_parsed;	// Counted by the file parsers
+
 #endif
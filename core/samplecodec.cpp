@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "samplecodec.h"
+#include "membuffer.h"
+#include "sample.h"
+
+#include <algorithm>
+#include <array>
+#include <stdint.h>
+
+/*
+ * The columns, in the order they are stored. Adding, removing or
+ * reordering columns requires a new SAMPLECODEC_VERSION.
+ */
+struct sample_column {
+	int64_t (*get)(const struct sample &);
+	void (*set)(struct sample &, int64_t);
+};
+
+#define COLUMN(field, type) sample_column { \
+	[](const struct sample &s) -> int64_t { return s.field; }, \
+	[](struct sample &s, int64_t v) { s.field = (type)v; } }
+
+static const std::array sample_columns {
+	COLUMN(time.seconds, int32_t),
+	COLUMN(stoptime.seconds, int32_t),
+	COLUMN(ndl.seconds, int32_t),
+	COLUMN(tts.seconds, int32_t),
+	COLUMN(rbt.seconds, int32_t),
+	COLUMN(depth.mm, int32_t),
+	COLUMN(stopdepth.mm, int32_t),
+	COLUMN(temperature.mkelvin, uint32_t),
+	COLUMN(pressure[0].mbar, int32_t),
+	COLUMN(pressure[1].mbar, int32_t),
+	COLUMN(setpoint.mbar, uint16_t),
+	COLUMN(o2sensor[0].mbar, uint16_t),
+	COLUMN(o2sensor[1].mbar, uint16_t),
+	COLUMN(o2sensor[2].mbar, uint16_t),
+	COLUMN(o2sensor[3].mbar, uint16_t),
+	COLUMN(o2sensor[4].mbar, uint16_t),
+	COLUMN(o2sensor[5].mbar, uint16_t),
+	COLUMN(bearing.degrees, int16_t),
+	COLUMN(sensor[0], int16_t),
+	COLUMN(sensor[1], int16_t),
+	COLUMN(cns, uint16_t),
+	COLUMN(heartbeat, uint8_t),
+	COLUMN(sac.mliter, int),
+	COLUMN(in_deco, bool),
+	COLUMN(manually_entered, bool)
+};
+
+#undef COLUMN
+
+static_assert(sample_columns.size() == SAMPLE_CHANNELS, "columns and channels out of sync");
+
+enum column_kind {
+	COLUMN_CONSTANT = 0,
+	COLUMN_DELTA = 1
+};
+
+static void put_varint(struct membuffer *b, int64_t value)
+{
+	uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	char buf[10];
+	int len = 0;
+
+	while (v >= 0x80) {
+		buf[len++] = (char)(v | 0x80);
+		v >>= 7;
+	}
+	buf[len++] = (char)v;
+	put_bytes(b, buf, len);
+}
+
+static bool get_varint(const unsigned char *&p, const unsigned char *end, int64_t &value)
+{
+	uint64_t v = 0;
+
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (p == end)
+			return false;
+		unsigned char c = *p++;
+		v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+void encode_samples(struct membuffer *b, const std::vector<sample> &samples)
+{
+	for (const sample_column &column: sample_columns) {
+		bool constant = true;
+		int64_t first = samples.empty() ? 0 : column.get(samples[0]);
+
+		for (const sample &s: samples) {
+			if (column.get(s) != first) {
+				constant = false;
+				break;
+			}
+		}
+		if (constant) {
+			put_bytes(b, "\0", 1);
+			put_varint(b, first);
+			continue;
+		}
+
+		int64_t old = 0;
+		put_bytes(b, "\1", 1);
+		for (const sample &s: samples) {
+			int64_t v = column.get(s);
+			put_varint(b, v - old);
+			old = v;
+		}
+	}
+}
+
+uint32_t sample_channels(const std::vector<sample> &samples)
+{
+	static const sample empty;
+	uint32_t res = 0;
+
+	for (size_t i = 0; i < sample_columns.size(); i++) {
+		const sample_column &column = sample_columns[i];
+		int64_t v = column.get(empty);
+		if (std::any_of(samples.begin(), samples.end(),
+				[&column, v](const sample &s) { return column.get(s) != v; }))
+			res |= 1u << i;
+	}
+	return res;
+}
+
+static bool decode_columns(const unsigned char *p, const unsigned char *end, sample *samples, size_t count)
+{
+	for (const sample_column &column: sample_columns) {
+		int64_t v;
+
+		if (p == end)
+			return false;
+		switch (*p++) {
+		case COLUMN_CONSTANT:
+			if (!get_varint(p, end, v))
+				return false;
+			for (size_t i = 0; i < count; i++)
+				column.set(samples[i], v);
+			break;
+		case COLUMN_DELTA:
+			v = 0;
+			for (size_t i = 0; i < count; i++) {
+				int64_t delta;
+				if (!get_varint(p, end, delta))
+					return false;
+				v += delta;
+				column.set(samples[i], v);
+			}
+			break;
+		default:
+			return false;
+		}
+	}
+	return p == end;
+}
+
+bool decode_samples(const char *data, size_t size, size_t count, std::vector<sample> &samples)
+{
+	size_t start = samples.size();
+
+	samples.resize(start + count);
+	if (decode_columns((const unsigned char *)data, (const unsigned char *)data + size, samples.data() + start, count))
+		return true;
+	samples.resize(start);
+	return false;
+}
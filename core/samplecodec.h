@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compact binary encoding of the samples of a dive computer.
+ *
+ * The samples are stored column by column, one column per field of
+ * struct sample. Each column is either a constant (a single value) or
+ * a list of deltas against the previous sample. All numbers are zigzag
+ * encoded varints, so that small positive and negative deltas take a
+ * single byte.
+ *
+ * The git backend stores this after a "samples <version> <count> <size>"
+ * line in the divecomputer file (see save-git.cpp and load-git.cpp).
+ */
+#ifndef SAMPLECODEC_H
+#define SAMPLECODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct membuffer;
+struct sample;
+
+#define SAMPLECODEC_VERSION 1
+
+extern void encode_samples(struct membuffer *b, const std::vector<sample> &samples);
+
+/* Bitmask of the recorded channels, see enum sample_channel. */
+extern uint32_t sample_channels(const std::vector<sample> &samples);
+
+/* Appends count samples. Returns false if the data is corrupt. */
+extern bool decode_samples(const char *data, size_t size, size_t count, std::vector<sample> &samples);
+
+#endif
@@ -14,7 +14,15 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <git2.h>
+#include <algorithm>
+#include <deque>
+#include <map>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <QThread>
+#include <QtConcurrent>
 
 #include "dive.h"
 #include "divelog.h"
@@ -22,6 +30,7 @@
 #include "filterconstraint.h"
 #include "filterpreset.h"
 #include "sample.h"
+#include "samplecodec.h"
 #include "subsurface-string.h"
 #include "trip.h"
 #include "device.h"
@@ -30,12 +39,15 @@
 #include "extradata.h"
 #include "membuffer.h"
 #include "git-access.h"
+#include "cloudsync.h"
 #include "version.h"
+#include "perfcounters.h"
 #include "picture.h"
 #include "qthelper.h"
 #include "range.h"
 #include "gettext.h"
 #include "tag.h"
+#include "trace.h"
 #include "subsurface-time.h"
 
 #define VA_BUF(b, fmt) do { va_list args; va_start(args, fmt); put_vformat(b, fmt, args); va_end(args); } while (0)
@@ -56,6 +68,7 @@ static void quote(struct membuffer *b, const char *text)
 	for (;;) {
 		const char *escape;
 
+		p = skip_plain_text(p, "\\\"");
 		switch (*p++) {
 		default:
 			continue;
@@ -357,11 +370,31 @@ static void save_sample(struct membuffer *b, const struct sample &sample, struct
 	put_format(b, "\n");
 }
 
+/*
+ * Optionally, the samples are stored in binary form (see samplecodec.h).
+ * Older versions of Subsurface can't read that, so it is off by default.
+ */
+bool git_binary_samples = false;
+
+static void save_binary_samples(struct membuffer *b, const struct divecomputer &dc)
+{
+	membuffer data;
+
+	encode_samples(&data, dc.samples);
+	put_format(b, "samples %d %u %u\n", SAMPLECODEC_VERSION, (unsigned)dc.samples.size(), data.len);
+	put_bytes(b, data.buffer, data.len);
+}
+
 static void save_samples(struct membuffer *b, const struct dive &dive, const struct divecomputer &dc)
 {
 	int o2sensor;
 	struct sample dummy;
 
+	if (git_binary_samples && !dc.samples.empty()) {
+		save_binary_samples(b, dc);
+		return;
+	}
+
 	/* Is this a CCR dive with the old-style "o2pressure" sensor? */
 	o2sensor = legacy_format_o2pressures(&dive, &dc);
 	if (o2sensor >= 0) {
@@ -477,9 +510,11 @@ struct dir {
 	git_treebuilder *files;
 	std::vector<std::unique_ptr<dir>> subdirs;
 	bool unique;
+	bool shard;		/* already written and linked as a shard, see write_shards() */
 	std::string name;
+	git_oid id;		/* filled in by write_git_tree() */
 
-	dir() : files(nullptr), unique(false)
+	dir() : files(nullptr), unique(false), shard(false), id()
 	{
 	}
 
@@ -586,6 +621,9 @@ static void create_dive_name(struct dive &dive, struct membuffer *name, struct t
 /*
  * Write a membuffer to the git repo, and free it
  */
+static perf_counter git_objects_written("git objects written");
+static perf_counter git_saves("git saves");
+
 static int blob_insert(git_repository *repo, struct dir *tree, struct membuffer *b, const char *fmt, ...)
 {
 	int ret;
@@ -595,34 +633,93 @@ static int blob_insert(git_repository *repo, struct dir *tree, struct membuffer
 	ret = git_blob_create_frombuffer(&blob_id, repo, b->buffer, b->len);
 	if (ret)
 		return ret;
+	git_objects_written.add();
 
 	VA_BUF(&name, fmt);
 	ret = tree_insert(tree->files, mb_cstring(&name), 1, &blob_id, GIT_FILEMODE_BLOB);
 	return ret;
 }
 
-static int save_one_divecomputer(git_repository *repo, struct dir *tree, const struct dive &dive, const struct divecomputer &dc, int idx)
+/*
+ * The files of a dive directory don't depend on the rest of the tree,
+ * so they can be rendered and hashed ahead of time on a thread pool.
+ * Writing the blobs and building the tree then happens in the usual
+ * order on the calling thread. This is a deque, because membuffers
+ * must not be moved.
+ */
+struct dive_blob {
+	membuffer buf;
+	git_oid id;
+};
+
+struct rendered_dive {
+	const struct dive *dive;
+	std::deque<dive_blob> blobs; // the dive, the divecomputers, then the pictures
+};
+
+static void save_picture_info(struct membuffer *b, const struct picture &pic)
+{
+	show_utf8(b, "filename ", pic.filename.c_str(), "\n");
+	put_location(b, &pic.location, "gps ", "\n");
+}
+
+static void render_dive(struct rendered_dive &rendered)
+{
+	const struct dive &dive = *rendered.dive;
+
+	create_dive_buffer(dive, &rendered.blobs.emplace_back().buf);
+	for (auto &dc: dive.dcs)
+		save_dc(&rendered.blobs.emplace_back().buf, dive, dc);
+	for (auto &picture: dive.pictures)
+		save_picture_info(&rendered.blobs.emplace_back().buf, picture);
+	for (auto &blob: rendered.blobs)
+		git_odb_hash(&blob.id, blob.buf.buffer, blob.buf.len, GIT_OBJ_BLOB);
+}
+
+/*
+ * Like blob_insert(), but for a blob that was hashed already. If the
+ * object database has it (the dive didn't change since the last save),
+ * there's nothing to write.
+ */
+static int rendered_blob_insert(git_repository *repo, struct dir *tree, struct dive_blob &blob, const char *fmt, ...)
 {
 	int ret;
-	membuffer buf;
+	git_odb *odb;
+	membuffer name;
+
+	if (git_repository_odb(&odb, repo))
+		return -1;
+	bool exists = git_odb_exists(odb, &blob.id);
+	git_odb_free(odb);
+	if (!exists) {
+		git_oid blob_id;
+		ret = git_blob_create_frombuffer(&blob_id, repo, blob.buf.buffer, blob.buf.len);
+		if (ret)
+			return ret;
+		git_objects_written.add();
+	}
+
+	VA_BUF(&name, fmt);
+	ret = tree_insert(tree->files, mb_cstring(&name), 1, &blob.id, GIT_FILEMODE_BLOB);
+	return ret;
+}
 
-	save_dc(&buf, dive, dc);
-	ret = blob_insert(repo, tree, &buf, "Divecomputer%c%03u", idx ? '-' : 0, idx);
+static int save_one_divecomputer(git_repository *repo, struct dir *tree, struct dive_blob &blob, int idx)
+{
+	int ret;
+
+	ret = rendered_blob_insert(repo, tree, blob, "Divecomputer%c%03u", idx ? '-' : 0, idx);
 	if (ret)
 		report_error("divecomputer tree insert failed");
 	return ret;
 }
 
-static int save_one_picture(git_repository *repo, struct dir *dir, const struct picture &pic)
+static int save_one_picture(git_repository *repo, struct dir *dir, const struct picture &pic, struct dive_blob &blob)
 {
 	int offset = pic.offset.seconds;
-	membuffer buf;
 	char sign = '+';
 	unsigned h;
 
-	show_utf8(&buf, "filename ", pic.filename.c_str(), "\n");
-	put_location(&buf, &pic.location, "gps ", "\n");
-
 	/* Picture loading will load even negative offsets.. */
 	if (offset < 0) {
 		offset = -offset;
@@ -632,23 +729,26 @@ static int save_one_picture(git_repository *repo, struct dir *dir, const struct
 	/* Use full hh:mm:ss format to make it all sort nicely */
 	h = offset / 3600;
 	offset -= h *3600;
-	return blob_insert(repo, dir, &buf, "%c%02u=%02u=%02u",
+	return rendered_blob_insert(repo, dir, blob, "%c%02u=%02u=%02u",
 		sign, h, FRACTION_TUPLE(offset, 60));
 }
 
-static int save_pictures(git_repository *repo, struct dir *dir, const struct dive &dive)
+static int save_pictures(git_repository *repo, struct dir *dir, const struct dive &dive, std::deque<dive_blob>::iterator blob)
 {
 	if (!dive.pictures.empty()) {
 		dir = mktree(repo, dir, "Pictures");
 		for (auto &picture: dive.pictures)
-			save_one_picture(repo, dir, picture);
+			save_one_picture(repo, dir, picture, *blob++);
 	}
 	return 0;
 }
 
-static int save_one_dive(git_repository *repo, struct dir *tree, struct dive &dive, struct tm *tm, bool cached_ok)
+using rendered_dives = std::unordered_map<const struct dive *, struct rendered_dive *>;
+
+static int save_one_dive(git_repository *repo, struct dir *tree, struct dive &dive, struct tm *tm, bool cached_ok,
+			 const rendered_dives &rendered)
 {
-	membuffer buf, name;
+	membuffer name;
 	struct dir *subdir;
 	int ret, nr;
 
@@ -669,12 +769,21 @@ static int save_one_dive(git_repository *repo, struct dir *tree, struct dive &di
 		return 0;
 	}
 
+	/* Normally the dive was rendered by render_dives() */
+	struct rendered_dive local { &dive, {} };
+	auto it = rendered.find(&dive);
+	struct rendered_dive *r = it != rendered.end() ? it->second : &local;
+	if (r == &local) {
+		dive.load_samples();
+		render_dive(local);
+	}
+
 	subdir = new_directory(repo, tree, &name);
 	subdir->unique = true;
 
-	create_dive_buffer(dive, &buf);
+	auto blob = r->blobs.begin();
 	nr = dive.number;
-	ret = blob_insert(repo, subdir, &buf,
+	ret = rendered_blob_insert(repo, subdir, *blob++,
 		"Dive%c%d", nr ? '-' : 0, nr);
 	if (ret)
 		return report_error("dive save-file tree insert failed");
@@ -685,11 +794,11 @@ static int save_one_dive(git_repository *repo, struct dir *tree, struct dive &di
 	 * generation when naming it).
 	 */
 	nr = dive.dcs.size() > 1 ? 1 : 0;
-	for (auto &dc: dive.dcs)
-		save_one_divecomputer(repo, subdir, dive, dc, nr++);
+	for (size_t i = 0; i < dive.dcs.size(); i++)
+		save_one_divecomputer(repo, subdir, *blob++, nr++);
 
 	/* Save the picture data, if any */
-	save_pictures(repo, subdir, dive);
+	save_pictures(repo, subdir, dive, blob);
 	return 0;
 }
 
@@ -759,6 +868,7 @@ static int save_trip_description(git_repository *repo, struct dir *dir, dive_tri
 	ret = git_blob_create_frombuffer(&blob_id, repo, desc.buffer, desc.len);
 	if (ret)
 		return report_error("trip blob creation failed");
+	git_objects_written.add();
 	ret = tree_insert(dir->files, "00-Trip", 0, &blob_id, GIT_FILEMODE_BLOB);
 	if (ret)
 		return report_error("trip description tree insert failed");
@@ -781,7 +891,8 @@ static void verify_shared_date(timestamp_t when, struct tm *tm)
 #define MIN_TIMESTAMP (0)
 #define MAX_TIMESTAMP (0x7fffffffffffffff)
 
-static int save_one_trip(git_repository *repo, struct dir *tree, dive_trip *trip, struct tm *tm, bool cached_ok)
+static int save_one_trip(git_repository *repo, struct dir *tree, dive_trip *trip, struct tm *tm, bool cached_ok,
+			 const rendered_dives &rendered)
 {
 	struct dir *subdir;
 	membuffer name;
@@ -812,7 +923,7 @@ static int save_one_trip(git_repository *repo, struct dir *tree, dive_trip *trip
 	/* Save each dive in the directory */
 	for (auto &dive: divelog.dives) {
 		if (dive->divetrip == trip)
-			save_one_dive(repo, subdir, *dive, tm, cached_ok);
+			save_one_dive(repo, subdir, *dive, tm, cached_ok, rendered);
 	}
 
 	return 0;
@@ -976,8 +1087,142 @@ static void save_filter_presets(git_repository *repo, struct dir *tree)
 	}
 }
 
-static int create_git_tree(git_repository *repo, struct dir *root, bool select_only, bool cached_ok)
+/*
+ * Render the files of all dives that will be written (i.e. that are not
+ * cached) on a thread pool. The samples have to be loaded first, because
+ * that may need the repository.
+ */
+static void render_dives(std::vector<rendered_dive> &dives, rendered_dives &map, bool select_only, bool cached_ok)
+{
+	for (auto &dive: divelog.dives) {
+		if (select_only && !dive->selected)
+			continue;
+		if (cached_ok && dive->cache_is_valid())
+			continue;
+		dive->load_samples();
+		dives.push_back({ dive.get(), {} });
+	}
+
+	/* Not worth spinning up the thread pool for a few dives */
+	if (dives.size() < 64 || QThread::idealThreadCount() <= 1) {
+		for (auto &rendered: dives)
+			render_dive(rendered);
+	} else {
+		QtConcurrent::blockingMap(dives, [](rendered_dive &rendered) { render_dive(rendered); });
+	}
+
+	for (auto &rendered: dives)
+		map[rendered.dive] = &rendered;
+}
+
+/*
+ * A year/month directory only contains the trips and dives that are
+ * filed under that month. If all of those are unchanged since the last
+ * save, we can reuse the tree that was written then instead of
+ * rebuilding the directory level by level.
+ *
+ * The signature of a month describes everything that goes into its
+ * tree: the names and git ids of the dives and the trip descriptions.
+ * It is only meaningful if all dives of the month have a valid cache.
+ */
+struct month_signature {
+	std::string signature;
+	bool cached = true;
+	bool reused = false;
+	git_oid id;
+};
+using month_signatures = std::map<std::pair<int, int>, month_signature>;
+
+/* The month trees written by the last saves, keyed by year and month */
+static month_signatures saved_months;
+
+static void add_signature(month_signature &month, const struct dive &dive)
+{
+	month.signature.append((const char *)&dive.when, sizeof(dive.when));
+	month.signature.append((const char *)dive.git_id.data(), dive.git_id.size());
+	if (!dive.cache_is_valid())
+		month.cached = false;
+}
+
+static void create_month_signatures(month_signatures &months)
+{
+	std::unordered_set<const dive_trip *> trips;
+
+	for (auto &dive: divelog.dives) {
+		struct tm tm;
+		dive_trip *trip = dive->divetrip;
+
+		utc_mkdate(trip ? trip->date() : dive->when, &tm);
+		month_signature &month = months[{ tm.tm_year, tm.tm_mon }];
+		if (!trip) {
+			month.signature += 'D';
+			add_signature(month, *dive);
+			continue;
+		}
+		if (!trips.insert(trip).second)
+			continue;
+
+		timestamp_t when = trip->date();
+		month.signature += 'T';
+		month.signature.append((const char *)&when, sizeof(when));
+		month.signature.append(trip->location.c_str(), trip->location.size() + 1);
+		month.signature.append(trip->notes.c_str(), trip->notes.size() + 1);
+		for (auto &trip_dive: divelog.dives) {
+			if (trip_dive->divetrip == trip)
+				add_signature(month, *trip_dive);
+		}
+		month.signature += 't';
+	}
+}
+
+static void find_reusable_months(git_repository *repo, month_signatures &months)
 {
+	git_odb *odb;
+
+	if (git_repository_odb(&odb, repo))
+		return;
+	for (auto &[key, month]: months) {
+		auto it = saved_months.find(key);
+		if (!month.cached || it == saved_months.end() || it->second.signature != month.signature)
+			continue;
+		if (!git_odb_exists(odb, &it->second.id))
+			continue;
+		month.reused = true;
+		month.id = it->second.id;
+	}
+	git_odb_free(odb);
+}
+
+/*
+ * Remember the month trees that were just written, so that the next
+ * save can reuse them.
+ */
+static void record_saved_months(const struct dir &root, const month_signatures &months)
+{
+	for (auto &[key, month]: months) {
+		if (!month.cached || month.reused)
+			continue;
+		membuffer year_name, month_name;
+		put_format(&year_name, "%04d", key.first);
+		put_format(&month_name, "%02d", key.second + 1);
+		for (auto &year: root.subdirs) {
+			if (year->unique || year->name != mb_cstring(&year_name))
+				continue;
+			for (auto &subdir: year->subdirs) {
+				if (subdir->unique || subdir->name != mb_cstring(&month_name))
+					continue;
+				saved_months[key] = { month.signature, true, false, subdir->id };
+			}
+		}
+	}
+}
+
+static int create_git_tree(git_repository *repo, struct dir *root, bool select_only, bool cached_ok,
+			   month_signatures &months)
+{
+	std::vector<rendered_dive> dives;
+	rendered_dives rendered;
+
 	git_storage_update_progress(translate("gettextFromC", "Start saving data"));
 	save_settings(repo, root);
 
@@ -987,8 +1232,18 @@ static int create_git_tree(git_repository *repo, struct dir *root, bool select_o
 	for (auto &trip: divelog.trips)
 		trip->saved = false;
 
+	/*
+	 * With cached writes, months without changes since the
+	 * last save just get their old tree
+	 */
+	if (cached_ok && !select_only) {
+		create_month_signatures(months);
+		find_reusable_months(repo, months);
+	}
+
 	/* save the dives */
 	git_storage_update_progress(translate("gettextFromC", "Start saving dives"));
+	render_dives(dives, rendered, select_only, cached_ok);
 	for (auto &dive: divelog.dives) {
 		struct tm tm;
 		struct dir *tree;
@@ -1005,6 +1260,16 @@ static int create_git_tree(git_repository *repo, struct dir *root, bool select_o
 		/* Create the date-based hierarchy */
 		utc_mkdate(trip ? trip->date() : dive->when, &tm);
 		tree = mktree(repo, root, "%04d", tm.tm_year);
+
+		auto month = months.find({ tm.tm_year, tm.tm_mon });
+		if (month != months.end() && month->second.reused) {
+			membuffer name;
+			put_format(&name, "%02d", tm.tm_mon + 1);
+			if (!git_treebuilder_get(tree->files, mb_cstring(&name)) &&
+			    tree_insert(tree->files, mb_cstring(&name), 0, &month->second.id, GIT_FILEMODE_TREE))
+				return report_error("cached month tree insert failed");
+			continue;
+		}
 		tree = mktree(repo, tree, "%02d", tm.tm_mon + 1);
 
 		if (trip) {
@@ -1014,11 +1279,11 @@ static int create_git_tree(git_repository *repo, struct dir *root, bool select_o
 			trip->saved = 1;
 
 			/* Pass that new subdirectory in for save-trip */
-			save_one_trip(repo, tree, trip, &tm, cached_ok);
+			save_one_trip(repo, tree, trip, &tm, cached_ok, rendered);
 			continue;
 		}
 
-		save_one_dive(repo, tree, *dive, &tm, cached_ok);
+		save_one_dive(repo, tree, *dive, &tm, cached_ok, rendered);
 	}
 	git_storage_update_progress(translate("gettextFromC", "Done creating local cache"));
 	return 0;
@@ -1185,6 +1450,7 @@ static int create_new_commit(struct git_info *info, git_oid *tree_id, bool creat
 			git_signature_free(author);
 			return report_error("Git commit create failed (%s)", strerror(errno));
 		}
+		git_objects_written.add();
 
 		if (git_commit_lookup(&commit, info->repo, &commit_id)) {
 			git_signature_free(author);
@@ -1228,20 +1494,22 @@ static int create_new_commit(struct git_info *info, git_oid *tree_id, bool creat
 	return 0;
 }
 
-static int write_git_tree(git_repository *repo, const struct dir *tree, git_oid *result)
+static int write_git_tree(git_repository *repo, struct dir *tree, git_oid *result)
 {
 	int ret;
 
 	/* Write out our subdirectories, add them to the treebuilder, and free them */
 	for (auto &subdir: tree->subdirs) {
-		git_oid id;
-
-		if (!write_git_tree(repo, subdir.get(), &id))
-			tree_insert(tree->files, subdir->name.c_str(), subdir->unique, &id, GIT_FILEMODE_TREE);
+		if (subdir->shard)
+			continue;
+		if (!write_git_tree(repo, subdir.get(), &subdir->id))
+			tree_insert(tree->files, subdir->name.c_str(), subdir->unique, &subdir->id, GIT_FILEMODE_TREE);
 	};
 
 	/* .. write out the resulting treebuilder */
 	ret = git_treebuilder_write(result, tree->files);
+	if (!ret)
+		git_objects_written.add();
 	if (ret && verbose) {
 		const git_error *gerr = giterr_last();
 		if (gerr)
@@ -1251,11 +1519,88 @@ static int write_git_tree(git_repository *repo, const struct dir *tree, git_oid
 	return ret;
 }
 
+/*
+ * Optionally, every year is stored as a shard: a commit of its own, which
+ * continues the history of that year kept by the ref git_shard_ref(). The
+ * main tree links to that commit (as a gitlink, like a submodule) instead
+ * of containing the year directory. Thus, the history of a year only grows
+ * when its dives change, syncing only transfers the changed years and
+ * loading can walk the years in parallel. Older versions of Subsurface
+ * can't read that. Once a branch is sharded, it stays that way.
+ */
+bool git_sharded_layout = false;
+
+static int commit_shard(struct git_info *info, const std::string &year, const git_oid *tree_id, git_oid *commit_id)
+{
+	std::string refname = git_shard_ref(info->branch, year);
+	git_commit *parent = NULL;
+	git_reference *ref;
+	git_signature *author;
+	git_tree *tree;
+	git_oid parent_id;
+	membuffer msg;
+
+	/* Unchanged years keep their commit */
+	if (!git_reference_name_to_id(&parent_id, info->repo, refname.c_str()) &&
+	    !git_commit_lookup(&parent, info->repo, &parent_id) &&
+	    git_oid_equal(git_commit_tree_id(parent), tree_id)) {
+		*commit_id = parent_id;
+		git_commit_free(parent);
+		return 0;
+	}
+
+	if (git_tree_lookup(&tree, info->repo, tree_id))
+		return report_error("Could not look up tree of shard %s", year.c_str());
+	if (get_authorship(info->repo, &author))
+		return report_error("No user name configuration in git repo");
+	put_format(&msg, "Dives of %s\n\nCreated by %s\n", year.c_str(), subsurface_user_agent().c_str());
+	if (git_commit_create_v(commit_id, info->repo, NULL, author, author, NULL, mb_cstring(&msg), tree, parent != NULL, parent)) {
+		git_signature_free(author);
+		return report_error("Git commit create failed (%s)", strerror(errno));
+	}
+	git_objects_written.add();
+	git_signature_free(author);
+	git_commit_free(parent);
+	git_tree_free(tree);
+
+	if (git_reference_create(&ref, info->repo, refname.c_str(), commit_id, 1, "Subsurface save event"))
+		return report_error("Failed to update shard '%s'", refname.c_str());
+	git_reference_free(ref);
+	return 0;
+}
+
+static bool is_year_dir(const struct dir &dir)
+{
+	return !dir.unique && dir.name.size() == 4 &&
+	       std::all_of(dir.name.begin(), dir.name.end(), [](char c) { return isdigit(c); });
+}
+
+/* Write the year directories as shards and link them from the root */
+static int write_shards(struct git_info *info, struct dir *root)
+{
+	for (auto &year: root->subdirs) {
+		if (!is_year_dir(*year))
+			continue;
+		git_oid commit_id;
+		if (write_git_tree(info->repo, year.get(), &year->id))
+			return report_error("git tree write failed");
+		if (commit_shard(info, year->name, &year->id, &commit_id))
+			return -1;
+		if (tree_insert(root->files, year->name.c_str(), 0, &commit_id, GIT_FILEMODE_COMMIT))
+			return report_error("shard insert failed");
+		year->shard = true;
+	}
+	return 0;
+}
+
 int do_git_save(struct git_info *info, bool select_only, bool create_empty)
 {
+	TRACE_ZONE("do_git_save");
+	git_saves.add();
 	struct dir tree;
 	git_oid id;
 	bool cached_ok;
+	month_signatures months;
 
 	if (!info->repo)
 		return report_error("Unable to open git repository '%s[%s]'", info->url.c_str(), info->branch.c_str());
@@ -1266,6 +1611,9 @@ int do_git_save(struct git_info *info, bool select_only, bool create_empty)
 	if (!create_empty) // so we are actually saving the dives
 		git_storage_update_progress(translate("gettextFromC", "Preparing to save data"));
 
+	// Don't change the branch while a background sync is merging into it
+	std::unique_lock<std::mutex> guard(git_storage_lock);
+
 	/*
 	 * Check if we can do the cached writes - we need to
 	 * have the original git commit we loaded in the repo
@@ -1278,22 +1626,33 @@ int do_git_save(struct git_info *info, bool select_only, bool create_empty)
 
 	if (!create_empty)
 		/* Populate our tree data structure */
-		if (create_git_tree(info->repo, &tree, select_only, cached_ok))
+		if (create_git_tree(info->repo, &tree, select_only, cached_ok, months))
 			return -1;
 
+	if (!create_empty && (git_sharded_layout || git_branch_is_sharded(info->repo, info->branch)) &&
+	    write_shards(info, &tree))
+		return -1;
+
 	if (verbose)
 		report_info("git storage, write git tree\n");
 
 	if (write_git_tree(info->repo, &tree, &id))
 		return report_error("git tree write failed");
+	record_saved_months(tree, months);
 
 	/* And save the tree! */
 	if (create_new_commit(info, &id, create_empty))
 		return report_error("creating commit failed");
 
 	/* now sync the tree with the remote server */
-	if (!info->url.empty() && !git_local_only)
+	guard.unlock();
+	if (!info->url.empty() && !git_local_only) {
+		if (git_background_sync) {
+			CloudSync::instance()->schedule(*info);
+			return 0;
+		}
 		return sync_with_remote(info);
+	}
 	return 0;
 }
 
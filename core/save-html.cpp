@@ -13,6 +13,7 @@
 #include "errorhelper.h"
 #include "event.h"
 #include "file.h"
+#include "mappedfile.h"
 #include "picture.h"
 #include "sample.h"
 #include "tag.h"
@@ -22,6 +23,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <QFile>
+#include <QFileInfo>
 
 static void write_attribute(struct membuffer *b, const char *att_name, const char *value, const char *separator)
 {
@@ -32,11 +34,43 @@ static void write_attribute(struct membuffer *b, const char *att_name, const cha
 	put_format(b, "\"%s", separator);
 }
 
+/*
+ * Exports are typically published by syncing the export directory to a
+ * web server. Therefore, files that didn't change are left alone: they
+ * are neither rewritten nor copied again and keep their modification
+ * time. A copied photo is considered unchanged if it has the same size
+ * as the original and was written after the original was modified.
+ */
+static bool copy_is_current(const QString &fileName, const QString &newName)
+{
+	QFileInfo source(fileName), copy(newName);
+	return copy.exists() && copy.size() == source.size() && copy.lastModified() >= source.lastModified();
+}
+
+static void write_if_changed(const char *file_name, struct membuffer *b)
+{
+	{
+		mapped_file old(file_name);
+		if (old.status() >= 0 && old.data() == std::string_view(b->buffer, b->len))
+			return;
+	}
+
+	FILE *f = subsurface_fopen(file_name, "w+");
+	if (!f) {
+		report_error(translate("gettextFromC", "Can't open file %s"), file_name);
+	} else {
+		flush_buffer(b, f); /*check for writing errors? */
+		fclose(f);
+	}
+}
+
 static void copy_image_and_overwrite(const std::string &cfileName, const std::string &path, const std::string &cnewName)
 {
 	QString fileName = QString::fromStdString(cfileName);
 	std::string newName = path + cnewName;
 	QFile file(QString::fromStdString(newName));
+	if (copy_is_current(fileName, file.fileName()))
+		return;
 	if (file.exists())
 		file.remove();
 	if (!QFile::copy(fileName, QString::fromStdString(newName)))
@@ -464,24 +498,13 @@ void export_list(struct membuffer *b, const char *photos_dir, bool selected_only
 
 void export_HTML(const char *file_name, const char *photos_dir, const bool selected_only, const bool list_only)
 {
-	FILE *f;
-
 	membuffer buf;
 	export_list(&buf, photos_dir, selected_only, list_only);
-
-	f = subsurface_fopen(file_name, "w+");
-	if (!f) {
-		report_error(translate("gettextFromC", "Can't open file %s"), file_name);
-	} else {
-		flush_buffer(&buf, f); /*check for writing errors? */
-		fclose(f);
-	}
+	write_if_changed(file_name, &buf);
 }
 
 void export_translation(const char *file_name)
 {
-	FILE *f;
-
 	membuffer buf;
 
 	//export translated words here
@@ -557,11 +580,5 @@ void export_translation(const char *file_name)
 
 	put_format(&buf, "}");
 
-	f = subsurface_fopen(file_name, "w+");
-	if (!f) {
-		report_error(translate("gettextFromC", "Can't open file %s"), file_name);
-	} else {
-		flush_buffer(&buf, f); /*check for writing errors? */
-		fclose(f);
-	}
+	write_if_changed(file_name, &buf);
 }
@@ -12,25 +12,48 @@
 #include "core/subsurface-string.h"
 #include "core/version.h"
 #include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <charconv>
+#include <QtConcurrent>
+
+/*
+ * The rows are made mostly of integers. Format them directly instead
+ * of going through printf.
+ */
+static void put_quoted_int(struct membuffer *b, int val, const char *sep, int seplen)
+{
+	char buf[32];
+
+	buf[0] = '"';
+	char *end = std::to_chars(buf + 1, buf + 16, val).ptr;
+	*end++ = '"';
+	memcpy(end, sep, seplen);
+	put_bytes(b, buf, end + seplen - buf);
+}
 
 static void put_int(struct membuffer *b, int val)
 {
-	put_format(b, "\"%d\", ", val);
+	put_quoted_int(b, val, ", ", 2);
 }
 
 static void put_int_with_nl(struct membuffer *b, int val)
 {
-	put_format(b, "\"%d\"\n", val);
+	put_quoted_int(b, val, "\n", 1);
 }
 
 static void put_csv_string(struct membuffer *b, const char *val)
 {
-	put_format(b, "\"%s\", ", val);
+	put_bytes(b, "\"", 1);
+	put_string(b, val);
+	put_bytes(b, "\", ", 3);
 }
 
 static void put_csv_string_with_nl(struct membuffer *b, const char *val)
 {
-	put_format(b, "\"%s\"\n", val);
+	put_bytes(b, "\"", 1);
+	put_string(b, val);
+	put_bytes(b, "\"\n", 2);
 }
 
 static void put_double(struct membuffer *b, double val)
@@ -70,10 +93,10 @@ static void put_pd(struct membuffer *b, const struct plot_info &pi, int idx)
 	put_int(b, entry.temperature);
 	put_int(b, entry.depth);
 	put_int(b, entry.ceiling);
-	for (int i = 0; i < 16; i++)
-		put_int(b, entry.ceilings[i]);
-	for (int i = 0; i < 16; i++)
-		put_int(b, entry.percentages[i]);
+	for (int i = 0; i < NUM_PLOT_TISSUES; i++)
+		put_int(b, get_plot_tissue_ceiling(pi, idx, i));
+	for (int i = 0; i < NUM_PLOT_TISSUES; i++)
+		put_int(b, get_plot_tissue_percentage(pi, idx, i));
 	put_int(b, entry.ndl);
 	put_int(b, entry.tts);
 	put_int(b, entry.rbt);
@@ -88,7 +111,7 @@ static void put_pd(struct membuffer *b, const struct plot_info &pi, int idx)
 	put_double(b, entry.pressures.he);
 	put_int(b, entry.o2pressure.mbar);
 	for (int i = 0; i < MAX_O2_SENSORS; i++)
-		put_int(b, entry.o2sensor[i].mbar);
+		put_int(b, get_plot_o2sensor(pi, idx, i).mbar);
 	put_int(b, entry.o2setpoint.mbar);
 	put_int(b, entry.scr_OC_pO2.mbar);
 	put_int(b, entry.mod);
@@ -399,20 +422,52 @@ static std::string format_st_event(const plot_data &entry, const plot_data &next
 	return res;
 }
 
-static void save_profiles_buffer(struct membuffer *b, bool select_only)
-{
-	struct deco_state *planner_deco_state = NULL;
+/* The number of dives whose plot infos are calculated at once */
+static constexpr size_t profile_batch_size = 64;
 
-	for(auto &dive: divelog.dives) {
-		if (select_only && !dive->selected)
-			continue;
-		plot_info pi = create_plot_info_new(dive.get(), &dive->dcs[0], planner_deco_state);
-		put_headers(b, pi.nr_cylinders);
+/* Write out the rows when the buffer gets larger than that */
+static constexpr unsigned int profile_write_size = 64 * 1024;
 
-		for (int i = 0; i < pi.nr; i++)
-			put_pd(b, pi, i);
-		put_format(b, "\n");
+/*
+ * The plot infos are calculated in batches. The next batch is calculated
+ * in the background while the current one is written, so that at most two
+ * batches are in memory.
+ */
+static void save_profiles(FILE *f, bool select_only)
+{
+	std::vector<const struct dive *> dives;
+	membuffer buf;
+
+	for (auto &dive: divelog.dives) {
+		if (!select_only || dive->selected)
+			dives.push_back(dive.get());
+	}
+
+	auto calculate = [&dives](size_t start) {
+		size_t end = std::min(start + profile_batch_size, dives.size());
+		return create_plot_infos(std::vector<const struct dive *>(dives.begin() + start, dives.begin() + end));
+	};
+
+	QFuture<std::vector<plot_info>> next;
+	if (!dives.empty())
+		next = QtConcurrent::run(calculate, (size_t)0);
+	for (size_t start = 0; start < dives.size(); start += profile_batch_size) {
+		std::vector<plot_info> batch = next.result();
+		if (start + profile_batch_size < dives.size())
+			next = QtConcurrent::run(calculate, start + profile_batch_size);
+
+		for (const plot_info &pi: batch) {
+			put_headers(&buf, pi.nr_cylinders);
+
+			for (int i = 0; i < pi.nr; i++) {
+				put_pd(&buf, pi, i);
+				if (buf.len > profile_write_size)
+					flush_buffer(&buf, f);
+			}
+			put_bytes(&buf, "\n", 1);
+		}
 	}
+	flush_buffer(&buf, f);
 }
 
 std::string save_subtitles_buffer(struct dive *dive, int offset, int length)
@@ -437,12 +492,9 @@ std::string save_subtitles_buffer(struct dive *dive, int offset, int length)
 
 int save_profiledata(const char *filename, bool select_only)
 {
-	membuffer buf;
 	FILE *f;
 	int error = 0;
 
-	save_profiles_buffer(&buf, select_only);
-
 	if (same_string(filename, "-")) {
 		f = stdout;
 	} else {
@@ -450,7 +502,7 @@ int save_profiledata(const char *filename, bool select_only)
 		f = subsurface_fopen(filename, "w");
 	}
 	if (f) {
-		flush_buffer(&buf, f);
+		save_profiles(f, select_only);
 		error = fclose(f);
 	}
 	if (error)
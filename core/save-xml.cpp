@@ -11,7 +11,15 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
-
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <zlib.h>
+#include <QThread>
+#include <QtConcurrent>
+
+#include "binarylog.h"
 #include "device.h"
 #include "dive.h"
 #include "divelog.h"
@@ -35,6 +43,10 @@
 #include "version.h"
 #include "xmlparams.h"
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 /*
  * We're outputting utf8 in xml.
  * We need to quote the characters <, >, &.
@@ -477,6 +489,7 @@ static void save_picture(struct membuffer *b, const struct picture &pic)
 
 void save_one_dive_to_mb(struct membuffer *b, const struct dive &dive, bool anonymize)
 {
+	dive.load_samples();
 	pressure_t surface_pressure = dive.un_fixup_surface_pressure();
 
 	put_string(b, "<dive");
@@ -543,13 +556,134 @@ int save_dive(FILE *f, const struct dive &dive, bool anonymize)
 	return 0;
 }
 
-static void save_trip(struct membuffer *b, dive_trip &trip, bool anonymize)
+/*
+ * When saving to a file or feeding the XML parser for an export, the
+ * buffer is passed on whenever it grows beyond this size. Thus saving
+ * a big log doesn't need memory for the whole file.
+ */
+#define SAVE_FLUSH_SIZE (256 * 1024)
+
+struct xml_output {
+	FILE *f = nullptr;
+	gzFile gz = nullptr;
+	xmlParserCtxtPtr parser = nullptr;
+};
+
+static void write_output(struct membuffer *b, struct xml_output *out)
+{
+	if (out->f)
+		fwrite(b->buffer, 1, b->len, out->f);
+	else if (out->gz)
+		gzwrite(out->gz, b->buffer, (unsigned int)b->len);
+	else
+		xmlParseChunk(out->parser, b->buffer, b->len, 0);
+	b->len = 0;
+}
+
+static void partial_flush(struct membuffer *b, struct xml_output *out)
+{
+	if (!out || b->len < SAVE_FLUSH_SIZE)
+		return;
+	write_output(b, out);
+}
+
+/*
+ * The XML of a dive only depends on the dive itself. Therefore, for
+ * big logs the dives are rendered in batches on a thread pool and the
+ * results are copied to the output in the order the dives are saved.
+ * Rendering in batches keeps the memory use bounded when writing
+ * directly to a file.
+ */
+#define RENDER_BATCH_SIZE 256
+
+struct rendered_xml {
+	const struct dive *dive = nullptr;
+	membuffer buf;
+};
+
+struct dive_renderer {
+	std::vector<const struct dive *> dives;		/* in the order they are saved */
+	std::vector<rendered_xml> batch;
+	size_t next = 0, batch_start = 0, batch_end = 0;
+	bool anonymize;
+
+	dive_renderer(bool select_only, bool anonymize);
+	void render_batch();
+	void put(struct membuffer *b, const struct dive &dive);
+};
+
+dive_renderer::dive_renderer(bool select_only, bool anonymize) : anonymize(anonymize)
+{
+	/* Not worth spinning up the thread pool for a few dives */
+	if (divelog.dives.size() < 64 || QThread::idealThreadCount() <= 1)
+		return;
+
+	if (select_only) {
+		for (auto &dive: divelog.dives) {
+			if (dive->selected)
+				dives.push_back(dive.get());
+		}
+		return;
+	}
+
+	/* Dives of a trip are saved together, when the first one is encountered */
+	std::unordered_map<const dive_trip *, std::vector<const struct dive *>> trip_dives;
+	std::unordered_set<const dive_trip *> trips;
+	for (auto &dive: divelog.dives) {
+		if (dive->divetrip)
+			trip_dives[dive->divetrip].push_back(dive.get());
+	}
+	for (auto &dive: divelog.dives) {
+		if (!dive->divetrip)
+			dives.push_back(dive.get());
+		else if (trips.insert(dive->divetrip).second)
+			dives.insert(dives.end(), trip_dives[dive->divetrip].begin(), trip_dives[dive->divetrip].end());
+	}
+}
+
+void dive_renderer::render_batch()
+{
+	batch_start = next;
+	batch_end = std::min(next + RENDER_BATCH_SIZE, dives.size());
+	if (batch.size() < batch_end - batch_start)
+		batch = std::vector<rendered_xml>(RENDER_BATCH_SIZE);
+
+	/* Loading lazy samples may need the repository - do that first */
+	for (size_t i = batch_start; i < batch_end; i++) {
+		dives[i]->load_samples();
+		batch[i - batch_start].dive = dives[i];
+	}
+	bool anon = anonymize;
+	QtConcurrent::blockingMap(batch.begin(), batch.begin() + (batch_end - batch_start),
+				  [anon](rendered_xml &r) { save_one_dive_to_mb(&r.buf, *r.dive, anon); });
+}
+
+void dive_renderer::put(struct membuffer *b, const struct dive &dive)
+{
+	if (next >= dives.size() || dives[next] != &dive) {
+		save_one_dive_to_mb(b, dive, anonymize);
+		return;
+	}
+	if (next == batch_end)
+		render_batch();
+	rendered_xml &r = batch[next - batch_start];
+	put_bytes(b, r.buf.buffer, r.buf.len);
+	r.buf.len = 0;
+	next++;
+}
+
+static void save_trip_header(struct membuffer *b, const dive_trip &trip)
 {
 	put_format(b, "<trip");
 	show_date(b, trip.date());
 	show_utf8(b, trip.location.c_str(), " location=\'", "\'", 1);
 	put_format(b, ">\n");
 	show_utf8(b, trip.notes.c_str(), "<notes>", "</notes>\n", 0);
+}
+
+static void save_trip(struct membuffer *b, dive_trip &trip, dive_renderer &renderer, struct xml_output *out)
+{
+	save_trip_header(b, trip);
 
 	/*
 	 * Incredibly cheesy: we want to save the dives sorted, and they
@@ -558,13 +692,59 @@ static void save_trip(struct membuffer *b, dive_trip &trip, bool anonymize)
 	 * check the divetrip pointer..
 	 */
 	for (auto &dive: divelog.dives) {
-		if (dive->divetrip == &trip)
-			save_one_dive_to_mb(b, *dive, anonymize);
+		if (dive->divetrip == &trip) {
+			renderer.put(b, *dive);
+			partial_flush(b, out);
+		}
 	}
 
 	put_format(b, "</trip>\n");
 }
 
+static void save_one_site(struct membuffer *b, const struct dive_site &ds, bool anonymize)
+{
+	put_format(b, "<site uuid='%8x'", ds.uuid);
+	show_utf8_blanked(b, ds.name.c_str(), " name='", "'", 1, anonymize);
+	put_location(b, &ds.location, " gps='", "'");
+	show_utf8_blanked(b, ds.description.c_str(), " description='", "'", 1, anonymize);
+	put_format(b, ">\n");
+	show_utf8_blanked(b, ds.notes.c_str(), "  <notes>", " </notes>\n", 0, anonymize);
+	for (auto const &t: ds.taxonomy) {
+		if (t.category != TC_NONE && !t.value.empty()) {
+			put_format(b, "  <geo cat='%d'", t.category);
+			put_format(b, " origin='%d'", t.origin);
+			show_utf8_blanked(b, t.value.c_str(), " value='", "'", 1, anonymize);
+			put_format(b, "/>\n");
+		}
+	}
+	put_format(b, "</site>\n");
+}
+
+/*
+ * A complete log with only this dive, its dive site and its trip, which
+ * can be read back with parse_xml_buffer(). The trip only contains this
+ * dive. Used for the change journal.
+ */
+void save_one_dive_as_log_to_mb(struct membuffer *b, const struct dive &dive)
+{
+	put_format(b, "<divelog program='subsurface' version='%d'>\n", dataformat_version);
+	if (dive.dive_site) {
+		put_format(b, "<divesites>\n");
+		save_one_site(b, *dive.dive_site, false);
+		put_format(b, "</divesites>\n");
+	}
+	put_format(b, "<dives>\n");
+	dive.load_samples();
+	if (dive.divetrip) {
+		save_trip_header(b, *dive.divetrip);
+		save_one_dive_to_mb(b, dive, false);
+		put_format(b, "</trip>\n");
+	} else {
+		save_one_dive_to_mb(b, dive, false);
+	}
+	put_format(b, "</dives>\n</divelog>\n");
+}
+
 static void save_one_device(struct membuffer *b, const struct device &d)
 {
 	/* Nicknames that are empty or the same as the device model are not interesting */
@@ -631,7 +811,8 @@ static void save_filter_presets(struct membuffer *b)
 	put_format(b, "</filterpresets>\n");
 }
 
-static void save_dives_buffer(struct membuffer *b, bool select_only, bool anonymize)
+/* If out is given, the buffer is passed on to it as it fills up */
+static void save_dives_buffer(struct membuffer *b, bool select_only, bool anonymize, struct xml_output *out)
 {
 	put_format(b, "<divelog program='subsurface' version='%d'>\n<settings>\n", dataformat_version);
 
@@ -658,21 +839,7 @@ static void save_dives_buffer(struct membuffer *b, bool select_only, bool anonym
 		if (select_only && !ds->is_selected())
 			continue;
 
-		put_format(b, "<site uuid='%8x'", ds->uuid);
-		show_utf8_blanked(b, ds->name.c_str(), " name='", "'", 1, anonymize);
-		put_location(b, &ds->location, " gps='", "'");
-		show_utf8_blanked(b, ds->description.c_str(), " description='", "'", 1, anonymize);
-		put_format(b, ">\n");
-		show_utf8_blanked(b, ds->notes.c_str(), "  <notes>", " </notes>\n", 0, anonymize);
-		for (auto const &t: ds->taxonomy) {
-			if (t.category != TC_NONE && !t.value.empty()) {
-				put_format(b, "  <geo cat='%d'", t.category);
-				put_format(b, " origin='%d'", t.origin);
-				show_utf8_blanked(b, t.value.c_str(), " value='", "'", 1, anonymize);
-				put_format(b, "/>\n");
-			}
-		}
-		put_format(b, "</site>\n");
+		save_one_site(b, *ds, anonymize);
 	}
 	put_format(b, "</divesites>\n<dives>\n");
 	for (auto &trip: divelog.trips)
@@ -682,17 +849,19 @@ static void save_dives_buffer(struct membuffer *b, bool select_only, bool anonym
 	save_filter_presets(b);
 
 	/* save the dives */
+	dive_renderer renderer(select_only, anonymize);
 	for (auto &dive: divelog.dives) {
 		if (select_only) {
 			if (!dive->selected)
 				continue;
-			save_one_dive_to_mb(b, *dive, anonymize);
+			renderer.put(b, *dive);
 		} else {
 			dive_trip *trip = dive->divetrip;
 
 			/* Bare dive without a trip? */
 			if (!trip) {
-				save_one_dive_to_mb(b, *dive, anonymize);
+				renderer.put(b, *dive);
+				partial_flush(b, out);
 				continue;
 			}
 
@@ -702,8 +871,9 @@ static void save_dives_buffer(struct membuffer *b, bool select_only, bool anonym
 
 			/* We haven't seen this trip before - save it and all dives */
 			trip->saved = 1;
-			save_trip(b, *trip, anonymize);
+			save_trip(b, *trip, renderer, out);
 		}
+		partial_flush(b, out);
 	}
 	put_format(b, "</dives>\n</divelog>\n");
 }
@@ -756,6 +926,36 @@ static void try_to_backup(const char *filename)
 	}
 }
 
+/* Files ending in ".gz" are saved gzip compressed */
+static bool is_compressed_filename(const char *filename)
+{
+	size_t len = strlen(filename);
+
+	return len > 3 && !strcasecmp(filename + len - 3, ".gz");
+}
+
+static int save_dives_compressed(const char *filename, bool select_only, bool anonymize)
+{
+	membuffer buf;
+	struct xml_output out;
+	int fd, error;
+
+	fd = subsurface_open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (fd < 0)
+		return -1;
+	out.gz = gzdopen(fd, "wb");
+	if (!out.gz) {
+		close(fd);
+		return -1;
+	}
+	save_dives_buffer(&buf, select_only, anonymize, &out);
+	write_output(&buf, &out);
+	gzerror(out.gz, &error);
+	if (gzclose(out.gz) != Z_OK)
+		error = -1;
+	return error != Z_OK ? -1 : 0;
+}
+
 int save_dives_logic(const char *filename, const bool select_only, bool anonymize)
 {
 	membuffer buf;
@@ -768,18 +968,31 @@ int save_dives_logic(const char *filename, const bool select_only, bool anonymiz
 		return error;
 	}
 
-	save_dives_buffer(&buf, select_only, anonymize);
-
 	if (same_string(filename, "-")) {
 		f = stdout;
 	} else {
 		try_to_backup(filename);
+		if (is_compressed_filename(filename)) {
+			error = save_dives_compressed(filename, select_only, anonymize);
+			if (error)
+				report_error(translate("gettextFromC", "Failed to save dives to %s (%s)"), filename, strerror(errno));
+			return error;
+		}
+		/* The binary log doesn't know how to anonymize: such exports are written as XML */
+		if (is_binary_log_filename(filename) && !anonymize)
+			return save_binary_log(filename, divelog, select_only);
 		error = -1;
 		f = subsurface_fopen(filename, "w");
 	}
 	if (f) {
+		/* Write the file while it is generated */
+		struct xml_output out;
+		out.f = f;
+		save_dives_buffer(&buf, select_only, anonymize, &out);
 		flush_buffer(&buf, f);
-		error = fclose(f);
+		error = ferror(f) ? -1 : 0;
+		if (fclose(f))
+			error = -1;
 	}
 	if (error)
 		report_error(translate("gettextFromC", "Failed to save dives to %s (%s)"), filename, strerror(errno));
@@ -812,15 +1025,24 @@ static int export_dives_xslt_doit(const char *filename, struct xml_params *param
 	if (!filename)
 		return report_error("No filename for export");
 
-	/* Save XML to file and convert it into a memory buffer */
-	save_dives_buffer(&buf, selected, anonymize);
-
 	/*
-	 * Parse the memory buffer into XML document and
-	 * transform it to selected export format, finally dumping
-	 * the XML into a character buffer.
+	 * Feed the XML to the parser while it is generated, then
+	 * transform the document to the selected export format,
+	 * finally dumping the XML into a character buffer.
 	 */
-	doc = xmlReadMemory(buf.buffer, buf.len, "divelog", NULL, XML_PARSE_HUGE);
+	struct xml_output out;
+	out.parser = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, "divelog");
+	if (!out.parser)
+		return report_error("Failed to read XML memory");
+	xmlCtxtUseOptions(out.parser, XML_PARSE_HUGE);
+	save_dives_buffer(&buf, selected, anonymize, &out);
+	xmlParseChunk(out.parser, buf.buffer, buf.len, 1);
+	doc = out.parser->myDoc;
+	if (doc && !out.parser->wellFormed) {
+		xmlFreeDoc(doc);
+		doc = NULL;
+	}
+	xmlFreeParserCtxt(out.parser);
 	if (!doc)
 		return report_error("Failed to read XML memory");
 
@@ -843,7 +1065,6 @@ static int export_dives_xslt_doit(const char *filename, struct xml_params *param
 	} else {
 		res = report_error("Failed to open %s for writing (%s)", filename, strerror(errno));
 	}
-	xsltFreeStylesheet(xslt);
 	xmlFreeDoc(transformed);
 
 	return res;
@@ -858,21 +1079,7 @@ static void save_dive_sites_buffer(struct membuffer *b, const struct dive_site *
 	for (i = 0; i < nr_sites; i++) {
 		const struct dive_site *ds = sites[i];
 
-		put_format(b, "<site uuid='%8x'", ds->uuid);
-		show_utf8_blanked(b, ds->name.c_str(), " name='", "'", 1, anonymize);
-		put_location(b, &ds->location, " gps='", "'");
-		show_utf8_blanked(b, ds->description.c_str(), " description='", "'", 1, anonymize);
-		put_format(b, ">\n");
-		show_utf8_blanked(b, ds->notes.c_str(), "  <notes>", " </notes>\n", 0, anonymize);
-		for (const auto &t: ds->taxonomy) {
-			if (t.category != TC_NONE && !t.value.empty()) {
-				put_format(b, "  <geo cat='%d'", t.category);
-				put_format(b, " origin='%d'", t.origin);
-				show_utf8_blanked(b, t.value.c_str(), " value='", "'", 1, anonymize);
-				put_format(b, "/>\n");
-			}
-		}
-		put_format(b, "</site>\n");
+		save_one_site(b, *ds, anonymize);
 	}
 	put_format(b, "</divesites>\n");
 }
@@ -9,6 +9,8 @@
 #include "subsurface-qt/divelistnotifier.h"
 
 #include <QVector>
+#include <algorithm>
+#include <iterator>
 
 struct dive *current_dive = NULL;
 int amount_selected;
@@ -121,6 +123,11 @@ QVector<dive *> setSelectionCore(const std::vector<dive *> &selection, dive *cur
 	QVector<dive *> divesToSelect;
 	divesToSelect.reserve(selection.size());
 
+	// The selection is not necessarily sorted. Sort a copy by address
+	// for binary search, so that selecting many dives is not quadratic.
+	std::vector<dive *> sorted = selection;
+	std::sort(sorted.begin(), sorted.end());
+
 	// TODO: We might want to keep track of selected dives in a more efficient way!
 	amount_selected = 0; // We recalculate amount_selected
 	for (auto &d: divelog.dives) {
@@ -132,8 +139,7 @@ QVector<dive *> setSelectionCore(const std::vector<dive *> &selection, dive *cur
 		}
 
 		// Search the dive in the list of selected dives.
-		// TODO: By sorting the list in the same way as the backend, this could be made more efficient.
-		bool newState = std::find(selection.begin(), selection.end(), d.get()) != selection.end();
+		bool newState = std::binary_search(sorted.begin(), sorted.end(), d.get());
 
 		if (newState) {
 			++amount_selected;
@@ -240,22 +246,32 @@ bool diveInSelection(const std::vector<dive *> &selection, const dive *d)
 	return it != selection.end() && *it == d;
 }
 
+// The selection is sorted according to the dive list. Sort the dives to
+// add and remove likewise and merge, since the filter may remove thousands
+// of dives from the selection at once.
 void updateSelection(std::vector<dive *> &selection, const std::vector<dive *> &add, const std::vector<dive *> &remove)
 {
-	// We could sort the array and merge the vectors as we do in the undo code. But is it necessary?
-	for (dive *d: add) {
-		auto it = std::lower_bound(selection.begin(), selection.end(), d, dive_less_than_ptr);
-		if (it != selection.end() && *it == d)
-			continue; // Ooops. Already there?
-		selection.insert(it, d);
+	if (!add.empty()) {
+		std::vector<dive *> sorted = add;
+		std::sort(sorted.begin(), sorted.end(), dive_less_than_ptr);
+		sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+		std::vector<dive *> res;
+		res.reserve(selection.size() + sorted.size());
+		// Dives that are already there are not added twice
+		std::set_union(selection.begin(), selection.end(), sorted.begin(), sorted.end(),
+			       std::back_inserter(res), dive_less_than_ptr);
+		selection = std::move(res);
 	}
 
-	// Likewise, we could sort the array and be smarter here. Again, is it necessary?
-	for (dive *d: remove) {
-		auto it = std::lower_bound(selection.begin(), selection.end(), d, dive_less_than_ptr);
-		if (it == selection.end() || *it != d)
-			continue; // Ooops. Not there?
-		selection.erase(it);
+	if (!remove.empty()) {
+		std::vector<dive *> sorted = remove;
+		std::sort(sorted.begin(), sorted.end(), dive_less_than_ptr);
+		// Dives that are not there are ignored
+		std::vector<dive *> res;
+		res.reserve(selection.size());
+		std::set_difference(selection.begin(), selection.end(), sorted.begin(), sorted.end(),
+				    std::back_inserter(res), dive_less_than_ptr);
+		selection = std::move(res);
 	}
 }
 
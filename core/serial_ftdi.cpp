@@ -22,6 +22,7 @@
  * MA 02110-1301 USA
  */
 
+#include <algorithm>
 #include <memory>
 #include <string.h>     // strerror
 #include <errno.h>      // errno
@@ -49,6 +50,12 @@
 
 #define VID 0x0403 // Vendor ID of FTDI
 
+// The chip sends what it received when its buffer is full or when the
+// latency timer expires. The default of 16 ms adds up for protocols that
+// exchange many small packets.
+int ftdi_latency_timer = 2;
+int ftdi_chunk_size = 0;
+
 struct ftdi_serial_t {
 	/* Library context. */
 	dc_context_t *context = nullptr;
@@ -72,6 +79,7 @@ struct ftdi_serial_t {
 	unsigned int databits = 0;
 	unsigned int stopbits = 0;
 	unsigned int parity = 0;
+	transfer_meter meter { "FTDI" };
 	~ftdi_serial_t() {
 		if (ftdi_ctx)
 			ftdi_free(ftdi_ctx);
@@ -215,6 +223,14 @@ static dc_status_t serial_ftdi_open (void **io, dc_context_t *context)
 		return DC_STATUS_IO;
 	}
 
+	// Not fatal, the defaults work, if slowly
+	INFO("latency timer %d ms, chunk size %d", ftdi_latency_timer, ftdi_chunk_size);
+	if (ftdi_set_latency_timer(ftdi_ctx, (unsigned char)std::clamp(ftdi_latency_timer, 1, 255)))
+		ERROR ("%s", ftdi_get_error_string(ftdi_ctx));
+	if (ftdi_chunk_size > 0 &&
+	    (ftdi_read_data_set_chunksize(ftdi_ctx, ftdi_chunk_size) || ftdi_write_data_set_chunksize(ftdi_ctx, ftdi_chunk_size)))
+		ERROR ("%s", ftdi_get_error_string(ftdi_ctx));
+
 	device->ftdi_ctx = ftdi_ctx;
 
 	*io = device.release();
@@ -397,6 +413,8 @@ static dc_status_t serial_ftdi_read (void *io, void *data, size_t size, size_t *
 				return DC_STATUS_TIMEOUT;
 			}
 			serial_ftdi_sleep (device, 1);
+		} else {
+			device->meter.received(n);
 		}
 
 		nbytes += n;
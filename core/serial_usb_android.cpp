@@ -9,7 +9,10 @@
 #include <QtAndroid>
 #include <QRegularExpression>
 
+#include <algorithm>
+#include <chrono>
 #include <thread>
+#include <vector>
 
 #include <android/log.h>
 
@@ -18,11 +21,74 @@
 #define INFO(fmt, ...) __android_log_print(ANDROID_LOG_DEBUG, __FILE__, "INFO: " fmt "\n", ##__VA_ARGS__)
 #define TRACE INFO
 
+/*
+ * Every call into the Java USB layer goes through JNI, which costs more
+ * than the transfer of a few bytes. Therefore, read what the adapter has
+ * in bulk transfers and keep the rest in a ring buffer for the next reads.
+ */
+static const size_t bulk_size = 4096;
+
+class read_ahead_buffer {
+public:
+	read_ahead_buffer() : data(4 * bulk_size)
+	{
+	}
+	size_t size() const
+	{
+		return tail - head;
+	}
+	void clear()
+	{
+		head = tail = 0;
+	}
+	size_t read(unsigned char *dst, size_t n)
+	{
+		n = std::min(n, size());
+		for (size_t i = 0; i < n; ++i)
+			dst[i] = data[(head + i) % data.size()];
+		head += n;
+		return n;
+	}
+	// The buffer is only filled when it doesn't have what was asked for,
+	// thus a bulk transfer always fits.
+	void write(const jbyte *src, size_t n)
+	{
+		for (size_t i = 0; i < n; ++i)
+			data[(tail + i) % data.size()] = (unsigned char)src[i];
+		tail += n;
+	}
+private:
+	std::vector<unsigned char> data;
+	size_t head = 0, tail = 0;
+};
+
+struct usb_android_serial {
+	QAndroidJniObject java;
+	jbyteArray bulk = nullptr;	// global reference, reused for all transfers
+	std::vector<jbyte> staging;
+	read_ahead_buffer buffer;
+	int timeout = -1;
+	transfer_meter meter { "USB serial" };
+
+	usb_android_serial(const QAndroidJniObject &java) : java(java), staging(bulk_size)
+	{
+		QAndroidJniEnvironment env;
+		jbyteArray array = env->NewByteArray(bulk_size);
+		bulk = static_cast<jbyteArray>(env->NewGlobalRef(array));
+		env->DeleteLocalRef(array);
+	}
+	~usb_android_serial()
+	{
+		QAndroidJniEnvironment env;
+		env->DeleteGlobalRef(bulk);
+	}
+};
+
 static dc_status_t serial_usb_android_sleep(void *io, unsigned int timeout)
 {
 	TRACE ("%s: %i", __FUNCTION__, timeout);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == nullptr)
 		return DC_STATUS_INVALIDARGS;
 
@@ -34,44 +100,45 @@ static dc_status_t serial_usb_android_set_timeout(void *io, int timeout)
 {
 	TRACE ("%s: %i", __FUNCTION__, timeout);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == nullptr)
 		return DC_STATUS_INVALIDARGS;
 
-	return static_cast<dc_status_t>(device->callMethod<jint>("set_timeout", "(I)I", timeout));
+	device->timeout = timeout;
+	return static_cast<dc_status_t>(device->java.callMethod<jint>("set_timeout", "(I)I", timeout));
 }
 
 static dc_status_t serial_usb_android_set_dtr(void *io, unsigned int value)
 {
 	TRACE ("%s: %i", __FUNCTION__, value);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == nullptr)
 		return DC_STATUS_INVALIDARGS;
 
-	return static_cast<dc_status_t>(device->callMethod<jint>("set_dtr", "(Z)I", value));
+	return static_cast<dc_status_t>(device->java.callMethod<jint>("set_dtr", "(Z)I", value));
 }
 
 static dc_status_t serial_usb_android_set_rts(void *io, unsigned int value)
 {
 	TRACE ("%s: %i", __FUNCTION__, value);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == nullptr)
 		return DC_STATUS_INVALIDARGS;
 
-	return static_cast<dc_status_t>(device->callMethod<jint>("set_rts", "(Z)I", value));
+	return static_cast<dc_status_t>(device->java.callMethod<jint>("set_rts", "(Z)I", value));
 }
 
 static dc_status_t serial_usb_android_close(void *io)
 {
 	TRACE ("%s", __FUNCTION__);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == nullptr)
 		return DC_STATUS_SUCCESS;
 
-	auto retval = static_cast<dc_status_t>(device->callMethod<jint>("close", "()I"));
+	auto retval = static_cast<dc_status_t>(device->java.callMethod<jint>("close", "()I"));
 	delete device;
 	return retval;
 }
@@ -80,11 +147,13 @@ static dc_status_t serial_usb_android_purge(void *io, dc_direction_t direction)
 {
 	TRACE ("%s: %i", __FUNCTION__, direction);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == nullptr)
 		return DC_STATUS_INVALIDARGS;
 
-	return static_cast<dc_status_t>(device->callMethod<jint>("purge", "(I)I", direction));
+	if (direction & DC_DIRECTION_INPUT)
+		device->buffer.clear();
+	return static_cast<dc_status_t>(device->java.callMethod<jint>("purge", "(I)I", direction));
 }
 
 static dc_status_t serial_usb_android_configure(void *io, unsigned int baudrate, unsigned int databits, dc_parity_t parity,
@@ -93,37 +162,52 @@ static dc_status_t serial_usb_android_configure(void *io, unsigned int baudrate,
 	TRACE ("%s: baudrate=%i, databits=%i, parity=%i, stopbits=%i, flowcontrol=%i", __FUNCTION__,
 	       baudrate, databits, parity, stopbits, flowcontrol);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == NULL)
 		return DC_STATUS_INVALIDARGS;
 
-	return static_cast<dc_status_t>(device->callMethod<jint>("configure", "(IIII)I", baudrate, databits, parity, stopbits));
+	return static_cast<dc_status_t>(device->java.callMethod<jint>("configure", "(IIII)I", baudrate, databits, parity, stopbits));
 }
 
 static dc_status_t serial_usb_android_read(void *io, void *data, size_t size, size_t *actual)
 {
 	TRACE ("%s: size: %zu", __FUNCTION__, size);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	unsigned char *dst = static_cast<unsigned char *>(data);
+	size_t nbytes = device->buffer.read(dst, size);
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(device->timeout, 0));
 	QAndroidJniEnvironment env;
-	jbyteArray array = env->NewByteArray(size);
-	env->SetByteArrayRegion(array, 0, size, (const jbyte *) data);
-
-	auto retval = device->callMethod<jint>("read", "([B)I", array);
-	if (retval < 0) {
-		env->DeleteLocalRef(array);
-		INFO ("Error in %s, retval %i", __FUNCTION__, retval);
-		return static_cast<dc_status_t>(retval);
+	while (nbytes < size) {
+		// A blocking read waits in slices, a non-blocking read polls once
+		int wait = 100;
+		if (device->timeout >= 0) {
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (left <= 0 && (device->timeout > 0 || nbytes > 0))
+				break;
+			wait = std::max((int)left, 1);
+		}
+		auto retval = device->java.callMethod<jint>("read", "([BI)I", device->bulk, wait);
+		if (retval < 0) {
+			INFO ("Error in %s, retval %i", __FUNCTION__, retval);
+			return static_cast<dc_status_t>(retval);
+		}
+		if (retval > 0) {
+			env->GetByteArrayRegion(device->bulk, 0, retval, device->staging.data());
+			device->buffer.write(device->staging.data(), retval);
+			device->meter.received(retval);
+			nbytes += device->buffer.read(dst + nbytes, size - nbytes);
+		} else if (device->timeout == 0) {
+			break;
+		}
 	}
-	*actual = retval;
-	env->GetByteArrayRegion(array, 0, retval, (jbyte *) data);
-	env->DeleteLocalRef(array);
-	TRACE ("%s: actual read size: %i", __FUNCTION__, retval);
+	*actual = nbytes;
+	TRACE ("%s: actual read size: %zu", __FUNCTION__, nbytes);
 
-	if (retval < size)
+	if (nbytes < size)
 		return DC_STATUS_TIMEOUT;
 	else
 		return DC_STATUS_SUCCESS;
@@ -133,7 +217,7 @@ static dc_status_t serial_usb_android_write(void *io, const void *data, size_t s
 {
 	TRACE ("%s: size: %zu", __FUNCTION__, size);
 
-	QAndroidJniObject *device = static_cast<QAndroidJniObject *>(io);
+	usb_android_serial *device = static_cast<usb_android_serial *>(io);
 	if (device == NULL)
 		return DC_STATUS_INVALIDARGS;
 
@@ -141,7 +225,7 @@ static dc_status_t serial_usb_android_write(void *io, const void *data, size_t s
 	jbyteArray array = env->NewByteArray(size);
 	env->SetByteArrayRegion(array, 0, size, (const jbyte *) data);
 
-	auto retval = device->callMethod<jint>("write", "([B)I", array);
+	auto retval = device->java.callMethod<jint>("write", "([B)I", array);
 	env->DeleteLocalRef(array);
 	if (retval < 0) {
 		INFO ("Error in %s, retval %i", __FUNCTION__, retval);
@@ -177,7 +261,7 @@ dc_status_t serial_usb_android_open(dc_iostream_t **iostream, dc_context_t *cont
 	if (localdevice == nullptr)
 		return DC_STATUS_IO;
 
-	QAndroidJniObject *device = new QAndroidJniObject(localdevice);
+	usb_android_serial *device = new usb_android_serial(localdevice);
 	TRACE("%s", "calling dc_custom_open())");
 	return dc_custom_open(iostream, context, DC_TRANSPORT_SERIAL, &callbacks, device);
 }
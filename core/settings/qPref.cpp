@@ -22,6 +22,8 @@
 
 void qPref::loadSync(bool doSync)
 {
+	qPrefTransaction transaction(false);
+
 	// the following calls, ensures qPref* is instanciated, registred and
 	// that properties are loaded
 	qPrefCloudStorage::loadSync(doSync);
@@ -18,4 +18,20 @@ public:
 private:
 	static void loadSync(bool doSync);
 };
+
+// Batches accesses to the preferences. While a transaction exists, all
+// preferences are read and written through one QSettings object, which is
+// written to disk when the outermost transaction ends. If a preference was
+// changed, the outermost transaction then emits the settingsChanged() signal
+// of the DiveListNotifier, once. Listeners of the individual ...Changed()
+// signals can check active() to wait for that signal.
+class qPrefTransaction {
+public:
+	qPrefTransaction(bool notify = true);
+	~qPrefTransaction();
+	// Emit settingsChanged() at the end, even if no preference was changed
+	// through the qPref classes.
+	static void markChanged();
+	static bool active();
+};
 #endif
@@ -123,3 +123,13 @@ void qPrefCloudStorage::set_divelogde_pass(const QString &value)
 	qPrefPrivate::propSetValue(keyFromGroupAndName("", "divelogde_pass"), value, QString());
 	emit instance()->divelogde_passChanged(value);
 }
+
+qint64 qPrefCloudStorage::cloud_server_checked()
+{
+	return qPrefPrivate::propValue(keyFromGroupAndName(group, "cloud_server_checked"), QVariant((qint64)0)).toLongLong();
+}
+void qPrefCloudStorage::set_cloud_server_checked(qint64 value)
+{
+	qPrefPrivate::propSetValue(keyFromGroupAndName(group, "cloud_server_checked"), QVariant(value), QVariant((qint64)0));
+	emit instance()->cloud_server_checkedChanged(value);
+}
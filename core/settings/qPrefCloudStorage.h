@@ -20,6 +20,7 @@ class qPrefCloudStorage : public QObject {
 	Q_PROPERTY(bool diveshare_private READ diveshare_private WRITE set_diveshare_private NOTIFY diveshare_privateChanged);
 	Q_PROPERTY(QString divelogde_user READ divelogde_user WRITE set_divelogde_user NOTIFY divelogde_userChanged);
 	Q_PROPERTY(QString divelogde_pass READ divelogde_pass WRITE set_divelogde_pass NOTIFY divelogde_passChanged);
+	Q_PROPERTY(qint64 cloud_server_checked READ cloud_server_checked WRITE set_cloud_server_checked NOTIFY cloud_server_checkedChanged);
 
 public:
 	static qPrefCloudStorage *instance();
@@ -53,6 +54,7 @@ public:
 	static bool diveshare_private();
 	static QString divelogde_user();
 	static QString divelogde_pass();
+	static qint64 cloud_server_checked();	// when cloud_base_url was picked, secs since epoch
 
 public slots:
 	static void set_cloud_auto_sync(bool value);
@@ -69,6 +71,7 @@ public slots:
 	static void set_diveshare_private(bool value);
 	static void set_divelogde_user(const QString &value);
 	static void set_divelogde_pass(const QString &value);
+	static void set_cloud_server_checked(qint64 value);
 
 signals:
 	void cloud_auto_syncChanged(bool value);
@@ -84,6 +87,7 @@ signals:
 	void diveshare_privateChanged(bool value);
 	void divelogde_userChanged(const QString &value);
 	void divelogde_passChanged(const QString &value);
+	void cloud_server_checkedChanged(qint64 value);
 
 private:
 	qPrefCloudStorage() {}
@@ -31,6 +31,7 @@ void qPrefDiveComputer::loadSync(bool doSync)
 	DISK_DC(4)
 
 	disk_sync_dc_time(doSync);
+	disk_keep_raw_dives(doSync);
 }
 
 // these are the 'active' settings
@@ -58,3 +59,5 @@ HANDLE_PREFERENCE_TXT_EXT_ALT(DiveComputer, "dive_computer_vendor3", vendor, div
 HANDLE_PREFERENCE_TXT_EXT_ALT(DiveComputer, "dive_computer_vendor4", vendor, dive_computer, 4)
 
 HANDLE_PREFERENCE_BOOL(DiveComputer, "sync_dive_computer_time", sync_dc_time);
+
+HANDLE_PREFERENCE_BOOL(DiveComputer, "keep_raw_dives", keep_raw_dives);
@@ -36,6 +36,7 @@ class qPrefDiveComputer : public QObject {
 	Q_PROPERTY(QString vendor4 READ vendor4 WRITE set_vendor4 NOTIFY vendor4Changed)
 
 	Q_PROPERTY(bool sync_dc_time READ sync_dc_time WRITE set_sync_dc_time NOTIFY sync_dc_timeChanged)
+	Q_PROPERTY(bool keep_raw_dives READ keep_raw_dives WRITE set_keep_raw_dives NOTIFY keep_raw_divesChanged)
 
 public:
 	static qPrefDiveComputer *instance();
@@ -52,6 +53,7 @@ public:
 	IMPLEMENT5GETTERS(vendor)
 
 	static bool sync_dc_time() { return prefs.sync_dc_time; }
+	static bool keep_raw_dives() { return prefs.keep_raw_dives; }
 
 public slots:
 	static void set_device(const QString &device);
@@ -79,6 +81,7 @@ public slots:
 	static void set_vendor4(const QString &vendor);
 
 	static void set_sync_dc_time(bool value);
+	static void set_keep_raw_dives(bool value);
 
 signals:
 	void deviceChanged(const QString &device);
@@ -106,6 +109,7 @@ signals:
 	void vendor4Changed(const QString &vendor);
 
 	void sync_dc_timeChanged(bool value);
+	void keep_raw_divesChanged(bool value);
 
 private:
 	qPrefDiveComputer() {}
@@ -137,6 +141,7 @@ private:
 	static void disk_vendor4(bool doSync);
 
 	static void disk_sync_dc_time(bool doSync);
+	static void disk_keep_raw_dives(bool doSync);
 };
 
 #endif
@@ -16,6 +16,7 @@ void qPrefMedia::loadSync(bool doSync)
 	disk_extract_video_thumbnails_position(doSync);
 	disk_ffmpeg_executable(doSync);
 	disk_subtitles_format_string(doSync);
+	disk_thumbnail_cache_size(doSync);
 	disk_auto_recalculate_thumbnails(doSync);
 	disk_auto_recalculate_thumbnails(doSync);
 }
@@ -25,3 +26,4 @@ HANDLE_PREFERENCE_BOOL(Media, "extract_video_thumbnails", extract_video_thumbnai
 HANDLE_PREFERENCE_INT(Media, "extract_video_thumbnails_position", extract_video_thumbnails_position);
 HANDLE_PREFERENCE_TXT(Media, "ffmpeg_executable", ffmpeg_executable);
 HANDLE_PREFERENCE_TXT(Media, "subtitles_format_string", subtitles_format_string);
+HANDLE_PREFERENCE_INT(Media, "thumbnail_cache_size", thumbnail_cache_size);
@@ -11,6 +11,7 @@ class qPrefMedia : public QObject {
 	Q_PROPERTY(bool extract_video_thumbnails READ extract_video_thumbnails WRITE set_extract_video_thumbnails NOTIFY extract_video_thumbnailsChanged)
 	Q_PROPERTY(int extract_video_thumbnails_position READ extract_video_thumbnails_position WRITE set_extract_video_thumbnails_position NOTIFY extract_video_thumbnails_positionChanged)
 	Q_PROPERTY(QString ffmpeg_executable READ ffmpeg_executable WRITE set_ffmpeg_executable  NOTIFY ffmpeg_executableChanged)
+	Q_PROPERTY(int thumbnail_cache_size READ thumbnail_cache_size WRITE set_thumbnail_cache_size NOTIFY thumbnail_cache_sizeChanged)
 	Q_PROPERTY(QString subtitles_format_string READ subtitles_format_string WRITE set_subtitles_format_string  NOTIFY subtitles_format_stringChanged)
 
 public:
@@ -26,6 +27,7 @@ public:
 	static bool extract_video_thumbnails() { return prefs.extract_video_thumbnails; }
 	static int extract_video_thumbnails_position() { return prefs.extract_video_thumbnails_position; }
 	static QString ffmpeg_executable() { return QString::fromStdString(prefs.ffmpeg_executable); }
+	static int thumbnail_cache_size() { return prefs.thumbnail_cache_size; }
 	static QString subtitles_format_string() { return QString::fromStdString(prefs.subtitles_format_string); }
 
 public slots:
@@ -34,6 +36,7 @@ public slots:
 	static void set_extract_video_thumbnails_position(int value);
 	static void set_ffmpeg_executable(const QString& value);
 	static void set_subtitles_format_string(const QString& value);
+	static void set_thumbnail_cache_size(int value);
 
 signals:
 	void auto_recalculate_thumbnailsChanged(bool value);
@@ -41,6 +44,7 @@ signals:
 	void extract_video_thumbnails_positionChanged(int value);
 	void ffmpeg_executableChanged(const QString& value);
 	void subtitles_format_stringChanged(const QString& value);
+	void thumbnail_cache_sizeChanged(int value);
 
 private:
 	qPrefMedia() {}
@@ -50,6 +54,7 @@ private:
 	static void disk_extract_video_thumbnails_position(bool doSync);
 	static void disk_ffmpeg_executable(bool doSync);
 	static void disk_subtitles_format_string(bool doSync);
+	static void disk_thumbnail_cache_size(bool doSync);
 
 };
 
@@ -1,8 +1,46 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "qPrefPrivate.h"
 #include "core/subsurface-float.h"
+#include "core/subsurface-qt/divelistnotifier.h"
 
 #include <QSettings>
+#include <memory>
+#include <optional>
+
+// The state of the transactions. Preferences are accessed by the UI thread only.
+static std::unique_ptr<QSettings> transactionSettings;
+static int transactionDepth = 0;
+static bool transactionChanged = false;
+static bool transactionNotify = false;
+
+qPrefTransaction::qPrefTransaction(bool notify)
+{
+	if (transactionDepth++ == 0) {
+		transactionSettings = std::make_unique<QSettings>();
+		transactionChanged = false;
+		transactionNotify = false;
+	}
+	transactionNotify |= notify;
+}
+
+qPrefTransaction::~qPrefTransaction()
+{
+	if (--transactionDepth > 0)
+		return;
+	transactionSettings.reset();	// Writes the changes to disk
+	if (transactionChanged && transactionNotify)
+		emit diveListNotifier.settingsChanged();
+}
+
+void qPrefTransaction::markChanged()
+{
+	transactionChanged = true;
+}
+
+bool qPrefTransaction::active()
+{
+	return transactionDepth > 0 && transactionNotify;
+}
 
 QString keyFromGroupAndName(QString group, QString name)
 {
@@ -12,7 +50,8 @@ QString keyFromGroupAndName(QString group, QString name)
 
 void qPrefPrivate::propSetValue(const QString &key, const QVariant &value, const QVariant &defaultValue)
 {
-	QSettings s;
+	std::optional<QSettings> local;
+	QSettings &s = transactionSettings ? *transactionSettings : local.emplace();
 	bool isDefault = false;
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 	if (value.isValid() && value.typeId() == QMetaType::Double)
@@ -27,6 +66,7 @@ void qPrefPrivate::propSetValue(const QString &key, const QVariant &value, const
 		s.setValue(key, value);
 	else
 		s.remove(key);
+	transactionChanged = true;
 }
 
 void qPrefPrivate::propSetValue(const QString &key, const std::string &value, const std::string &defaultValue)
@@ -36,12 +76,13 @@ void qPrefPrivate::propSetValue(const QString &key, const std::string &value, co
 
 QVariant qPrefPrivate::propValue(const QString &key, const QVariant &defaultValue)
 {
+	if (transactionSettings)
+		return transactionSettings->value(key, defaultValue);
 	QSettings s;
 	return  s.value(key, defaultValue);
 }
 
 QVariant qPrefPrivate::propValue(const QString &key, const std::string &defaultValue)
 {
-	QSettings s;
-	return  s.value(key, QString::fromStdString(defaultValue));
+	return propValue(key, QVariant(QString::fromStdString(defaultValue)));
 }
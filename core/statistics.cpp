@@ -42,12 +42,18 @@ static void process_temperatures(const struct dive &dp, stats_t &stats)
 	}
 }
 
+static void update_averages(stats_t &stats)
+{
+	if (stats.total_average_depth_time.seconds)
+		stats.avg_depth.mm = lrint((double)stats.depth_time_sum / stats.total_average_depth_time.seconds);
+	if (stats.total_sac_time.seconds)
+		stats.avg_sac.mliter = lrint((double)stats.sac_time_sum / stats.total_sac_time.seconds);
+}
+
 static void process_dive(const struct dive &dive, stats_t &stats)
 {
-	int old_tadt, sac_time = 0;
 	int32_t duration = dive.duration.seconds;
 
-	old_tadt = stats.total_average_depth_time.seconds;
 	stats.total_time.seconds += duration;
 	if (duration > stats.longest_time.seconds)
 		stats.longest_time.seconds = duration;
@@ -66,21 +72,55 @@ static void process_dive(const struct dive &dive, stats_t &stats)
 		return;
 	if (dive.meandepth.mm) {
 		stats.total_average_depth_time.seconds += duration;
-		stats.avg_depth.mm = lrint((1.0 * old_tadt * stats.avg_depth.mm +
-					duration * dive.meandepth.mm) /
-					stats.total_average_depth_time.seconds);
+		stats.depth_time_sum += (int64_t)duration * dive.meandepth.mm;
 	}
 	if (dive.sac > 100) { /* less than .1 l/min is bogus, even with a pSCR */
-		sac_time = stats.total_sac_time.seconds + duration;
-		stats.avg_sac.mliter = lrint((1.0 * stats.total_sac_time.seconds * stats.avg_sac.mliter +
-					 duration * dive.sac) /
-					 sac_time);
+		stats.total_sac_time.seconds += duration;
+		stats.sac_time_sum += (int64_t)duration * dive.sac;
 		if (dive.sac > stats.max_sac.mliter)
 			stats.max_sac.mliter = dive.sac;
 		if (stats.min_sac.mliter == 0 || dive.sac < stats.min_sac.mliter)
 			stats.min_sac.mliter = dive.sac;
-		stats.total_sac_time.seconds = sac_time;
 	}
+	update_averages(stats);
+}
+
+/* For the minima and maxima, zero means "not set" */
+template <typename T>
+static void merge_min(T &to, T from)
+{
+	if (from && (!to || from < to))
+		to = from;
+}
+
+template <typename T>
+static void merge_max(T &to, T from)
+{
+	if (from > to)
+		to = from;
+}
+
+/* Add the dives accumulated in "from" to "to", as if they had been processed one by one */
+static void merge_stats(stats_t &to, const stats_t &from)
+{
+	to.total_time.seconds += from.total_time.seconds;
+	to.total_average_depth_time.seconds += from.total_average_depth_time.seconds;
+	merge_min(to.shortest_time.seconds, from.shortest_time.seconds);
+	merge_max(to.longest_time.seconds, from.longest_time.seconds);
+	merge_min(to.min_depth.mm, from.min_depth.mm);
+	merge_max(to.max_depth.mm, from.max_depth.mm);
+	to.combined_max_depth.mm += from.combined_max_depth.mm;
+	merge_min(to.min_sac.mliter, from.min_sac.mliter);
+	merge_max(to.max_sac.mliter, from.max_sac.mliter);
+	merge_min(to.min_temp.mkelvin, from.min_temp.mkelvin);
+	merge_max(to.max_temp.mkelvin, from.max_temp.mkelvin);
+	to.combined_temp.mkelvin += from.combined_temp.mkelvin;
+	to.combined_count += from.combined_count;
+	to.selection_size += from.selection_size;
+	to.total_sac_time.seconds += from.total_sac_time.seconds;
+	to.depth_time_sum += from.depth_time_sum;
+	to.sac_time_sum += from.sac_time_sum;
+	update_averages(to);
 }
 
 /*
@@ -146,26 +186,14 @@ stats_summary calculate_stats_summary(bool selected_only)
 		out.stats_yearly.back().selection_size++;
 		out.stats_yearly.back().period = current_year;
 
-		/* stats_by_type[0] is all the dives combined */
-		out.stats_by_type[0].selection_size++;
-		process_dive(*dp, out.stats_by_type[0]);
-
 		process_dive(*dp, out.stats_by_type[dp->dcs[0].divemode + 1]);
 		out.stats_by_type[dp->dcs[0].divemode + 1].selection_size++;
 
-		/* stats_by_depth[0] is all the dives combined */
-		out.stats_by_depth[0].selection_size++;
-		process_dive(*dp, out.stats_by_depth[0]);
-
 		int d_idx = dp->maxdepth.mm / (STATS_DEPTH_BUCKET * 1000);
 		d_idx = std::clamp(d_idx, 0, STATS_MAX_DEPTH / STATS_DEPTH_BUCKET);
 		process_dive(*dp, out.stats_by_depth[d_idx + 1]);
 		out.stats_by_depth[d_idx + 1].selection_size++;
 
-		/* stats_by_temp[0] is all the dives combined */
-		out.stats_by_temp[0].selection_size++;
-		process_dive(*dp, out.stats_by_temp[0]);
-
 		int t_idx = ((int)mkelvin_to_C(dp->mintemp.mkelvin)) / STATS_TEMP_BUCKET;
 		t_idx = std::clamp(t_idx, 0, STATS_MAX_TEMP / STATS_TEMP_BUCKET);
 		process_dive(*dp, out.stats_by_temp[t_idx + 1]);
@@ -177,13 +205,6 @@ stats_summary calculate_stats_summary(bool selected_only)
 				out.stats_by_trip.emplace_back();
 			}
 
-			/* stats_by_trip[0] is all the dives combined */
-			/* TODO: yet, this doesn't seem to consider dives outside of trips !? */
-			out.stats_by_trip[0].selection_size++;
-			process_dive(*dp, out.stats_by_trip[0]);
-			out.stats_by_trip[0].is_trip = true;
-			out.stats_by_trip[0].location = translate("gettextFromC", "All (by trip stats)");
-
 			process_dive(*dp, out.stats_by_trip.back());
 			out.stats_by_trip.back().selection_size++;
 			out.stats_by_trip.back().is_trip = true;
@@ -207,6 +228,22 @@ stats_summary calculate_stats_summary(bool selected_only)
 		prev_year = current_year;
 	}
 
+	/* The first entries are all the dives combined. Instead of processing each dive
+	 * once more for these, merge the other entries. */
+	for (auto it = std::next(out.stats_by_type.begin()); it != out.stats_by_type.end(); ++it)
+		merge_stats(out.stats_by_type[0], *it);
+	for (auto it = std::next(out.stats_by_depth.begin()); it != out.stats_by_depth.end(); ++it)
+		merge_stats(out.stats_by_depth[0], *it);
+	for (auto it = std::next(out.stats_by_temp.begin()); it != out.stats_by_temp.end(); ++it)
+		merge_stats(out.stats_by_temp[0], *it);
+	/* TODO: yet, this doesn't seem to consider dives outside of trips !? */
+	if (out.stats_by_trip.size() > 1) {
+		for (auto it = std::next(out.stats_by_trip.begin()); it != out.stats_by_trip.end(); ++it)
+			merge_stats(out.stats_by_trip[0], *it);
+		out.stats_by_trip[0].is_trip = true;
+		out.stats_by_trip[0].location = translate("gettextFromC", "All (by trip stats)");
+	}
+
 	/* add labels for depth ranges up to maximum depth seen */
 	if (out.stats_by_depth[0].selection_size) {
 		int d_idx = out.stats_by_depth[0].max_depth.mm;
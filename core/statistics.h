@@ -43,6 +43,9 @@ struct stats_t
 	unsigned int combined_count = 0;
 	unsigned int selection_size = 0;
 	duration_t total_sac_time;
+	/* sums of depth * time and SAC * time, the averages are calculated from these */
+	int64_t depth_time_sum = 0;
+	int64_t sac_time_sum = 0;
 	bool is_year = false;
 	bool is_trip = false;
 	std::string location;
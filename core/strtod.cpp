@@ -14,6 +14,7 @@
  * with commas", use general_strtod() instead.
  */
 #include <ctype.h>
+#include <stdint.h>
 #include "subsurface-string.h"
 
 static double strtod_flags(const char *str, const char **ptr, bool no_comma)
@@ -114,7 +115,54 @@ double permissive_strtod(const char *str, const char **ptr)
 	return strtod_flags(str, ptr, false);
 }
 
+/*
+ * Fast path for the plain fixed-point numbers that make up nearly
+ * all of our input, like "12.345" or "200.0": the mantissa is collected
+ * as an integer and divided by the power of ten once at the end. With
+ * at most 15 digits the mantissa is exact in a double, so the result
+ * is the same as what strtod_flags() computes one digit at a time.
+ *
+ * Anything else (leading whitespace, more digits, an exponent) is left
+ * to the generic code.
+ */
+static bool strtod_fixed_point(const char *str, double &res, const char **ptr)
+{
+	static const double power_of_ten[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+		1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+	};
+	const char *p = str;
+	bool sign = false;
+	uint64_t mantissa = 0;
+	int digits, decimals = 0;
+
+	if (*p == '-' || *p == '+')
+		sign = *p++ == '-';
+	const char *start = p;
+	while ((unsigned char)(*p - '0') < 10)
+		mantissa = mantissa * 10 + (*p++ - '0');
+	digits = p - start;
+	if (*p == '.') {
+		start = ++p;
+		while ((unsigned char)(*p - '0') < 10)
+			mantissa = mantissa * 10 + (*p++ - '0');
+		decimals = p - start;
+		digits += decimals;
+	}
+	if (!digits || digits > 15 || *p == 'e' || *p == 'E')
+		return false;
+
+	if (ptr)
+		*ptr = p;
+	res = (sign ? -(double)mantissa : (double)mantissa) / power_of_ten[decimals];
+	return true;
+}
+
 double ascii_strtod(const char *str, const char **ptr)
 {
+	double val;
+
+	if (strtod_fixed_point(str, val, ptr))
+		return val;
 	return strtod_flags(str, ptr, true);
 }
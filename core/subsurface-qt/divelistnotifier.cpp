@@ -1,4 +1,155 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "divelistnotifier.h"
+#include "core/divelog.h"
+#include "core/divesite.h"
+#include "core/profile.h"
+#include "core/trip.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 DiveListNotifier diveListNotifier;
+
+// These connections are made first, so that the cached plot infos
+// are dropped before any profile is replotted because of a change.
+DiveListNotifier::DiveListNotifier()
+{
+	// Pending changes go out before dives are added, removed or moved, so that the
+	// receivers still find the changed dives where they were. The changes of removed
+	// dives and the changes before a reset are of no interest anymore.
+	connect(this, &DiveListNotifier::dataReset, this, [this] { pendingChanges.clear(); });
+	connect(this, &DiveListNotifier::divesAdded, this, &DiveListNotifier::flushDivesChanged);
+	connect(this, &DiveListNotifier::divesDeleted, this, [this](dive_trip *, bool, const QVector<dive *> &dives) {
+		if (pendingChanges.empty())
+			return;
+		std::unordered_set<const dive *> deleted(dives.begin(), dives.end());
+		pendingChanges.erase(std::remove_if(pendingChanges.begin(), pendingChanges.end(),
+						    [&deleted](const std::pair<dive *, int> &change)
+						    { return deleted.count(change.first) > 0; }),
+				     pendingChanges.end());
+		flushDivesChanged();
+	});
+	connect(this, &DiveListNotifier::divesMovedBetweenTrips, this, &DiveListNotifier::flushDivesChanged);
+	connect(this, &DiveListNotifier::divesTimeChanged, this, &DiveListNotifier::flushDivesChanged);
+
+	auto invalidate_all = [] { invalidate_plot_info_cache(nullptr); };
+	auto invalidate_dive = [](dive *d) { invalidate_plot_info_cache(d); };
+	auto invalidate_dives = [](const QVector<dive *> &dives) {
+		for (dive *d: dives)
+			invalidate_plot_info_cache(d);
+	};
+
+	connect(this, &DiveListNotifier::dataReset, this, invalidate_all);
+	connect(this, &DiveListNotifier::divesImported, this, invalidate_all);
+	connect(this, &DiveListNotifier::divesTimeChanged, this, invalidate_all);
+	connect(this, &DiveListNotifier::diveComputerEdited, this, invalidate_all);
+	connect(this, &DiveListNotifier::divesAdded, this,
+		[invalidate_dives](dive_trip *, bool, const QVector<dive *> &dives) { invalidate_dives(dives); });
+	connect(this, &DiveListNotifier::divesDeleted, this,
+		[invalidate_dives](dive_trip *, bool, const QVector<dive *> &dives) { invalidate_dives(dives); });
+	connect(this, &DiveListNotifier::divesChanged, this,
+		[invalidate_dives](const QVector<dive *> &dives, DiveField field) {
+			if (field.datetime)
+				invalidate_plot_info_cache(nullptr);
+			else if (field.depth || field.duration || field.atm_press || field.divesite ||
+				 field.mode || field.salinity || field.invalid)
+				invalidate_dives(dives);
+		});
+	connect(this, &DiveListNotifier::cylindersReset, this, invalidate_dives);
+	connect(this, &DiveListNotifier::cylinderAdded, this, [invalidate_dive](dive *d, int) { invalidate_dive(d); });
+	connect(this, &DiveListNotifier::cylinderRemoved, this, [invalidate_dive](dive *d, int) { invalidate_dive(d); });
+	connect(this, &DiveListNotifier::cylinderEdited, this, [invalidate_dive](dive *d, int) { invalidate_dive(d); });
+	connect(this, &DiveListNotifier::eventsChanged, this, invalidate_dive);
+}
+
+void DiveListNotifier::notifyDivesChanged(const QVector<dive *> &dives, DiveField field)
+{
+	if (batchLevel == 0) {
+		emit divesChanged(dives, field);
+		return;
+	}
+	int flags = field.flags();
+	for (dive *d: dives)
+		pendingChanges.emplace_back(d, flags);
+}
+
+void DiveListNotifier::beginBatch()
+{
+	++batchLevel;
+}
+
+void DiveListNotifier::endBatch()
+{
+	if (--batchLevel == 0)
+		flushDivesChanged();
+}
+
+void DiveListNotifier::connectDiveChanges(QObject *context, std::function<void(const dive *)> fn)
+{
+	auto touchDives = [fn](const QVector<dive *> &dives) { for (const dive *d: dives) fn(d); };
+	connect(this, &DiveListNotifier::divesAdded, context,
+		[touchDives](dive_trip *, bool, const QVector<dive *> &d) { touchDives(d); });
+	connect(this, &DiveListNotifier::divesDeleted, context,
+		[touchDives](dive_trip *, bool, const QVector<dive *> &d) { touchDives(d); });
+	connect(this, &DiveListNotifier::divesMovedBetweenTrips, context,
+		[touchDives](dive_trip *, dive_trip *, bool, bool, const QVector<dive *> &d) { touchDives(d); });
+	connect(this, &DiveListNotifier::divesChanged, context,
+		[touchDives](const QVector<dive *> &d, DiveField) { touchDives(d); });
+	connect(this, &DiveListNotifier::divesTimeChanged, context,
+		[touchDives](timestamp_t, const QVector<dive *> &d) { touchDives(d); });
+	connect(this, &DiveListNotifier::cylindersReset, context, touchDives);
+	connect(this, &DiveListNotifier::weightsystemsReset, context, touchDives);
+
+	auto touchDive = [fn](dive *d) { fn(d); };
+	connect(this, &DiveListNotifier::cylinderAdded, context, touchDive);
+	connect(this, &DiveListNotifier::cylinderRemoved, context, touchDive);
+	connect(this, &DiveListNotifier::cylinderEdited, context, touchDive);
+	connect(this, &DiveListNotifier::weightAdded, context, touchDive);
+	connect(this, &DiveListNotifier::weightRemoved, context, touchDive);
+	connect(this, &DiveListNotifier::weightEdited, context, touchDive);
+	connect(this, &DiveListNotifier::eventsChanged, context, touchDive);
+	connect(this, &DiveListNotifier::pictureOffsetChanged, context, touchDive);
+	connect(this, &DiveListNotifier::picturesRemoved, context, touchDive);
+	connect(this, &DiveListNotifier::picturesAdded, context, touchDive);
+
+	connect(this, &DiveListNotifier::diveComputerEdited, context, [fn](divecomputer *dc) {
+		for (auto &d: divelog.dives) {
+			if (dc >= d->dcs.data() && dc < d->dcs.data() + d->dcs.size())
+				fn(d.get());
+		}
+	});
+	connect(this, &DiveListNotifier::tripChanged, context, [fn](dive_trip *trip, TripField) {
+		if (trip) {
+			for (const dive *d: trip->dives)
+				fn(d);
+		}
+	});
+	connect(this, &DiveListNotifier::diveSiteChanged, context, [fn](dive_site *ds, int) {
+		if (ds) {
+			for (const dive *d: ds->dives)
+				fn(d);
+		}
+	});
+}
+
+// One signal for each set of changed fields, with the dives sorted as in the core.
+void DiveListNotifier::flushDivesChanged()
+{
+	if (pendingChanges.empty())
+		return;
+	std::vector<std::pair<dive *, int>> changes;
+	changes.swap(pendingChanges);
+
+	std::unordered_map<dive *, int> fieldsOfDive;
+	for (auto [d, flags]: changes)
+		fieldsOfDive[d] |= flags;
+	std::map<int, QVector<dive *>> divesOfFields;
+	for (auto [d, flags]: fieldsOfDive)
+		divesOfFields[flags].push_back(d);
+	for (auto &[flags, dives]: divesOfFields) {
+		std::sort(dives.begin(), dives.end(), dive_less_than_ptr);
+		emit divesChanged(dives, DiveField(flags));
+	}
+}
@@ -8,6 +8,8 @@
 #include "core/dive.h"
 
 #include <QObject>
+#include <functional>
+#include <vector>
 
 struct device;
 
@@ -64,6 +66,7 @@ struct DiveField {
 		INVALID = 1 << 21
 	};
 	DiveField(int flags);
+	int flags() const;
 };
 struct TripField {
 	unsigned int location : 1;
@@ -78,6 +81,21 @@ struct TripField {
 
 class DiveListNotifier : public QObject {
 	Q_OBJECT
+public:
+	DiveListNotifier();
+
+	// Send divesChanged(). Within a batch (see Command::execute()), the changes
+	// are collected and sent when the batch ends: the dives changed multiple times
+	// are sent once, and there is one signal per set of changed fields. Pending
+	// changes are sent before any signal that adds, removes or moves dives.
+	void notifyDivesChanged(const QVector<dive *> &dives, DiveField field);
+	void beginBatch();
+	void endBatch();
+
+	// Calls fn for every dive that is added, deleted, moved or changed in any
+	// way, including the dives of edited trips and dive sites. For receivers
+	// that keep track of the changed dives instead of updating a model.
+	void connectDiveChanges(QObject *context, std::function<void(const dive *)> fn);
 signals:
 	// The core structures were completely reset. Repopulate all models.
 	void dataReset();
@@ -147,9 +165,14 @@ signals:
 	// This is necessary, so that the user can't click on the "undo" button and undo
 	// an unrelated command.
 	void commandExecuted();
+
+private:
+	void flushDivesChanged();
+	int batchLevel = 0;
+	std::vector<std::pair<dive *, int>> pendingChanges;	// dive and DiveField flags
 };
 
-// The DiveListNotifier class has only trivial state.
+// The DiveListNotifier class has only simple state.
 // We can simply define it as a global object.
 extern DiveListNotifier diveListNotifier;
 
@@ -179,6 +202,16 @@ inline DiveField::DiveField(int flags) :
 {
 }
 
+inline int DiveField::flags() const
+{
+	return (nr ? NR : 0) | (datetime ? DATETIME : 0) | (depth ? DEPTH : 0) | (duration ? DURATION : 0) |
+	       (air_temp ? AIR_TEMP : 0) | (water_temp ? WATER_TEMP : 0) | (atm_press ? ATM_PRESS : 0) |
+	       (divesite ? DIVESITE : 0) | (diveguide ? DIVEGUIDE : 0) | (buddy ? BUDDY : 0) | (rating ? RATING : 0) |
+	       (visibility ? VISIBILITY : 0) | (wavesize ? WAVESIZE : 0) | (current ? CURRENT : 0) | (surge ? SURGE : 0) |
+	       (chill ? CHILL : 0) | (suit ? SUIT : 0) | (tags ? TAGS : 0) | (mode ? MODE : 0) | (notes ? NOTES : 0) |
+	       (salinity ? SALINITY : 0) | (invalid ? INVALID : 0);
+}
+
 inline TripField::TripField(int flags) :
 	location((flags & LOCATION) != 0),
 	notes((flags & NOTES) != 0)
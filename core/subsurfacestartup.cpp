@@ -7,8 +7,11 @@
 #include "qthelper.h"
 #include "git-access.h"
 #include "pref.h"
+#include "trace.h"
+#include "libdivecomputer.h"
 #include "libdivecomputer/version.h"
 
+#include <chrono>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
@@ -16,9 +19,13 @@
 extern void show_computer_list();
 
 int quit, force_root, ignore_bt;
+bool startup_trace;
 #ifdef SUBSURFACE_MOBILE_DESKTOP
 std::string testqml;
 #endif
+#ifdef SUBSURFACE_DOWNLOADER
+std::string dc_batch_file;
+#endif
 
 /*
  * track whether we switched to importing dives
@@ -66,13 +73,41 @@ void print_files()
 	printf("Image filename table: %s\n", hashfile_name().c_str());
 }
 
+/*
+ * With --startup-trace, print the time since the previous phase
+ * and since the start of the program when a phase is finished.
+ */
+static const std::chrono::steady_clock::time_point startup_start = std::chrono::steady_clock::now();
+
+void startup_phase(const char *phase)
+{
+	using namespace std::chrono;
+	static steady_clock::time_point last = startup_start;
+
+	if (!startup_trace)
+		return;
+	steady_clock::time_point now = steady_clock::now();
+	report_info("startup: %-24s %6ld ms (total %6ld ms)", phase,
+		    (long)duration_cast<milliseconds>(now - last).count(),
+		    (long)duration_cast<milliseconds>(now - startup_start).count());
+	last = now;
+}
+
 static void print_help()
 {
 	print_version();
 	printf("\nUsage: subsurface [options] [logfile ...] [--import logfile ...]");
 	printf("\n\noptions include:");
 	printf("\n --help|-h             This help text");
+	printf("\n --git-binary-samples  Store samples in binary form when saving to git (not readable by older versions)");
+	printf("\n --git-sharded         Store every year as a commit of its own when saving to git (not readable by older versions)");
 	printf("\n --ignore-bt           Don't enable Bluetooth support");
+#if defined(SERIAL_FTDI)
+	printf("\n --ftdi-latency=<ms>   Latency timer of FTDI serial adapters (default %d ms)", ftdi_latency_timer);
+	printf("\n --ftdi-chunksize=<n>  Size of the USB transfers of FTDI serial adapters in bytes");
+#endif
+	printf("\n --startup-trace       Print the time taken by the phases of the startup");
+	printf("\n --trace=<file>        Record where the time is spent and write it to <file> at exit");
 	printf("\n --import logfile ...  Logs before this option is treated as base, everything after is imported");
 	printf("\n --verbose|-v          Verbose debug (repeat to increase verbosity)");
 	printf("\n --version             Prints current version");
@@ -83,6 +118,8 @@ static void print_help()
 	printf("\n --dc-vendor=vendor    Set the dive computer to download from");
 	printf("\n --dc-product=product  Set the dive computer to download from");
 	printf("\n --device=device       Set the device to download from");
+	printf("\n --dc-batch=file       Download from all dive computers listed in file at the same time,");
+	printf("\n                       one \"vendor;product;device\" per line");
 #endif
 	printf("\n --cloud-timeout=<nr>  Set timeout for cloud connection (0 < timeout < 60)\n\n");
 }
@@ -121,10 +158,36 @@ void parse_argument(const char *arg)
 				print_help();
 				exit(0);
 			}
+			if (strcmp(arg, "--git-binary-samples") == 0) {
+				git_binary_samples = true;
+				return;
+			}
+			if (strcmp(arg, "--git-sharded") == 0) {
+				git_sharded_layout = true;
+				return;
+			}
 			if (strcmp(arg, "--ignore-bt") == 0) {
 				ignore_bt = true;
 				return;
 			}
+#if defined(SERIAL_FTDI)
+			if (strncmp(arg, "--ftdi-latency=", sizeof("--ftdi-latency=") - 1) == 0) {
+				ftdi_latency_timer = atoi(arg + sizeof("--ftdi-latency=") - 1);
+				return;
+			}
+			if (strncmp(arg, "--ftdi-chunksize=", sizeof("--ftdi-chunksize=") - 1) == 0) {
+				ftdi_chunk_size = atoi(arg + sizeof("--ftdi-chunksize=") - 1);
+				return;
+			}
+#endif
+			if (strncmp(arg, "--trace=", sizeof("--trace=") - 1) == 0) {
+				trace_start(arg + sizeof("--trace=") - 1);
+				return;
+			}
+			if (strcmp(arg, "--startup-trace") == 0) {
+				startup_trace = true;
+				return;
+			}
 			if (strcmp(arg, "--import") == 0) {
 				imported = true; /* mark the dives so far as the base, * everything after is imported */
 				return;
@@ -155,6 +218,10 @@ void parse_argument(const char *arg)
 				prefs.dive_computer.device = arg + sizeof("--device=") - 1;
 				return;
 			}
+			if (strncmp(arg, "--dc-batch=", sizeof("--dc-batch=") - 1) == 0) {
+				dc_batch_file = arg + sizeof("--dc-batch=") - 1;
+				return;
+			}
 			if (strncmp(arg, "--list-dc", sizeof("--list-dc") - 1) == 0) {
 				show_computer_list();
 				exit(0);
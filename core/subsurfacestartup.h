@@ -6,11 +6,13 @@
 
 extern bool imported;
 extern int quit, force_root, ignore_bt;
+extern bool startup_trace;
 
 void setup_system_prefs();
 void parse_argument(const char *arg);
 void print_files();
 void print_version();
+void startup_phase(const char *phase);
 
 void subsurface_console_init();
 void subsurface_console_exit();
@@ -21,5 +23,8 @@ extern std::string settings_suffix;
 #ifdef SUBSURFACE_MOBILE_DESKTOP
 extern std::string testqml;
 #endif
+#ifdef SUBSURFACE_DOWNLOADER
+extern std::string dc_batch_file;
+#endif
 
 #endif // SUBSURFACESTARTUP_H
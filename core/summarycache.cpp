@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "summarycache.h"
+#include "dive.h"
+#include "divelist.h"
+#include "errorhelper.h"
+#include "file.h"
+
+#include <array>
+#include <string.h>
+
+/*
+ * The cache is a flat binary file in the .git directory of the
+ * repository. It is only ever read by the machine that wrote it,
+ * therefore we simply dump the values in native byte order.
+ *
+ *	header:		magic, version, number of dives, commit sha
+ *	per dive:	git_id, sac, otu, maxcns, mintemp, maxtemp,
+ *			number of cylinders, per cylinder sample_start and sample_end
+ *
+ * The commit sha guarantees that the dives are the same as when
+ * the cache was written. The per-dive git ids are only used as a
+ * sanity check.
+ */
+static const char summary_cache_magic[8] = { 'S', 'S', 'R', 'F', 'S', 'U', 'M', 0 };
+static const uint32_t summary_cache_version = 1;
+static const char summary_cache_filename[] = "subsurface-summary";
+
+struct summary_cache_entry {
+	std::array<unsigned char, 20> git_id;
+	int32_t sac, otu, maxcns;
+	uint32_t mintemp, maxtemp;
+	std::vector<std::pair<int32_t, int32_t>> sample_pressures;
+};
+
+summary_cache::summary_cache()
+{
+}
+
+summary_cache::~summary_cache()
+{
+}
+
+static std::string cache_filename(const std::string &repo_path)
+{
+	std::string res = repo_path;
+	if (!res.empty() && res.back() != '/')
+		res += '/';
+	return res + summary_cache_filename;
+}
+
+template <typename T>
+static void put_value(std::string &buf, const T &v)
+{
+	buf.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template <typename T>
+static bool get_value(const std::string &buf, size_t &pos, T &v)
+{
+	if (pos + sizeof(v) > buf.size())
+		return false;
+	memcpy(&v, buf.data() + pos, sizeof(v));
+	pos += sizeof(v);
+	return true;
+}
+
+bool summary_cache::read(const std::string &repo_path, const std::string &sha)
+{
+	auto [buf, err] = readfile(cache_filename(repo_path).c_str());
+	size_t pos = 0;
+	char magic[8];
+	uint32_t version, count;
+
+	entries.clear();
+	if (err <= 0 || sha.empty())
+		return false;
+	if (!get_value(buf, pos, magic) || memcmp(magic, summary_cache_magic, sizeof(magic)) ||
+	    !get_value(buf, pos, version) || version != summary_cache_version ||
+	    !get_value(buf, pos, count) ||
+	    buf.size() < pos + sha.size() || buf.compare(pos, sha.size(), sha))
+		return false;
+	pos += sha.size();
+
+	entries.resize(count);
+	for (summary_cache_entry &entry: entries) {
+		uint32_t num_cylinders;
+		if (!get_value(buf, pos, entry.git_id) ||
+		    !get_value(buf, pos, entry.sac) ||
+		    !get_value(buf, pos, entry.otu) ||
+		    !get_value(buf, pos, entry.maxcns) ||
+		    !get_value(buf, pos, entry.mintemp) ||
+		    !get_value(buf, pos, entry.maxtemp) ||
+		    !get_value(buf, pos, num_cylinders) ||
+		    buf.size() < pos + num_cylinders * 2 * sizeof(int32_t))
+			goto corrupt;
+		entry.sample_pressures.resize(num_cylinders);
+		for (auto &p: entry.sample_pressures) {
+			get_value(buf, pos, p.first);
+			get_value(buf, pos, p.second);
+		}
+	}
+	if (pos == buf.size())
+		return true;
+
+corrupt:
+	report_info("git storage: ignoring corrupt summary cache");
+	entries.clear();
+	return false;
+}
+
+bool summary_cache::apply(dive_table &dives) const
+{
+	if (entries.size() != dives.size())
+		return false;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (entries[i].git_id != dives[i]->git_id ||
+		    entries[i].sample_pressures.size() != dives[i]->cylinders.size())
+			return false;
+	}
+
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const summary_cache_entry &entry = entries[i];
+		struct dive &d = *dives[i];
+		d.sac = entry.sac;
+		d.otu = entry.otu;
+		d.maxcns = entry.maxcns;
+		d.mintemp.mkelvin = entry.mintemp;
+		d.maxtemp.mkelvin = entry.maxtemp;
+		for (size_t j = 0; j < entry.sample_pressures.size(); ++j) {
+			d.cylinders[j].sample_start.mbar = entry.sample_pressures[j].first;
+			d.cylinders[j].sample_end.mbar = entry.sample_pressures[j].second;
+		}
+	}
+	return true;
+}
+
+void summary_cache::write(const std::string &repo_path, const std::string &sha, const dive_table &dives)
+{
+	std::string buf;
+	std::string filename = cache_filename(repo_path);
+	std::string tmp = filename + ".tmp";
+
+	buf.append(summary_cache_magic, sizeof(summary_cache_magic));
+	put_value(buf, summary_cache_version);
+	put_value(buf, static_cast<uint32_t>(dives.size()));
+	buf += sha;
+	for (auto &d: dives) {
+		put_value(buf, d->git_id);
+		put_value(buf, static_cast<int32_t>(d->sac));
+		put_value(buf, static_cast<int32_t>(d->otu));
+		put_value(buf, static_cast<int32_t>(d->maxcns));
+		put_value(buf, static_cast<uint32_t>(d->mintemp.mkelvin));
+		put_value(buf, static_cast<uint32_t>(d->maxtemp.mkelvin));
+		put_value(buf, static_cast<uint32_t>(d->cylinders.size()));
+		for (auto &cyl: d->cylinders) {
+			put_value(buf, static_cast<int32_t>(cyl.sample_start.mbar));
+			put_value(buf, static_cast<int32_t>(cyl.sample_end.mbar));
+		}
+	}
+
+	FILE *f = subsurface_fopen(tmp.c_str(), "wb");
+	if (!f)
+		return;
+	bool ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+	ok = fclose(f) == 0 && ok;
+	if (!ok || subsurface_rename(tmp.c_str(), filename.c_str()))
+		report_info("git storage: couldn't write summary cache %s", filename.c_str());
+}
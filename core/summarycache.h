@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-2.0
+// Cache for the values that are calculated from the samples of the dives of a
+// git logbook. Together with lazy sample loading (see git_info::lazy_samples),
+// this allows opening an unchanged logbook without parsing any sample.
+#ifndef SUMMARYCACHE_H
+#define SUMMARYCACHE_H
+
+#include <string>
+#include <vector>
+
+struct dive_table;
+
+struct summary_cache_entry;
+
+struct summary_cache {
+	std::vector<summary_cache_entry> entries;
+
+	summary_cache();
+	~summary_cache();
+
+	// Reads the cache of the given repository. Fails if it doesn't exist,
+	// is corrupt or was written for a different commit.
+	bool read(const std::string &repo_path, const std::string &sha);
+	// Transfers the cached values to the dives. Fails if the dives don't
+	// correspond exactly to the cache entries.
+	bool apply(dive_table &dives) const;
+	static void write(const std::string &repo_path, const std::string &sha, const dive_table &dives);
+};
+
+#endif
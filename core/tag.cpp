@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <algorithm>
+#include <mutex>
 #include <QtGlobal> // for QT_TRANSLATE_NOOP
 
 std::vector<std::unique_ptr<divetag>> g_tag_list;
@@ -21,25 +22,89 @@ static const char *default_tags[] = {
 	QT_TRANSLATE_NOOP("gettextFromC", "deco")
 };
 
-divetag::divetag(std::string name, std::string source) :
-	name(std::move(name)), source(std::move(source))
+divetag::divetag(std::string name, std::string source, int index) :
+	name(std::move(name)), source(std::move(source)), index(index)
 {
 }
 
+void tag_set::set(int index)
+{
+	if (index < 64) {
+		bits |= (uint64_t)1 << index;
+		return;
+	}
+	size_t word = index / 64 - 1;
+	if (word >= overflow.size())
+		overflow.resize(word + 1, 0);
+	overflow[word] |= (uint64_t)1 << (index % 64);
+}
+
+bool tag_set::test(int index) const
+{
+	if (index < 64)
+		return (bits >> index) & 1;
+	size_t word = index / 64 - 1;
+	return word < overflow.size() && ((overflow[word] >> (index % 64)) & 1);
+}
+
+bool tag_set::intersects(const tag_set &s) const
+{
+	if (bits & s.bits)
+		return true;
+	size_t n = std::min(overflow.size(), s.overflow.size());
+	for (size_t i = 0; i < n; ++i) {
+		if (overflow[i] & s.overflow[i])
+			return true;
+	}
+	return false;
+}
+
+bool tag_set::empty() const
+{
+	return !bits && std::all_of(overflow.begin(), overflow.end(), [](uint64_t w) { return !w; });
+}
+
+tag_set &tag_set::operator|=(const tag_set &s)
+{
+	bits |= s.bits;
+	if (overflow.size() < s.overflow.size())
+		overflow.resize(s.overflow.size(), 0);
+	for (size_t i = 0; i < s.overflow.size(); ++i)
+		overflow[i] |= s.overflow[i];
+	return *this;
+}
+
+void tag_list::clear()
+{
+	tags.clear();
+	set = tag_set();
+}
+
+static bool tag_less(const divetag *tag1, const divetag *tag2)
+{
+	return tag1->name < tag2->name;
+}
+
 /* remove duplicates and empty tags */
 void taglist_cleanup(tag_list &list)
 {
+	std::vector<const divetag *> &tags = list.tags;
+
 	// Remove empty tags
-	list.erase(std::remove_if(list.begin(), list.end(), [](const divetag *tag) { return tag->name.empty(); }),
-		   list.end());
+	tags.erase(std::remove_if(tags.begin(), tags.end(), [](const divetag *tag) { return tag->name.empty(); }),
+		   tags.end());
 
 	// Sort (should be a NOP, because we add in a sorted way, but let's make sure)
-	std::sort(list.begin(), list.end());
+	std::sort(tags.begin(), tags.end(), tag_less);
 
 	// Remove duplicates
-	list.erase(std::unique(list.begin(), list.end(),
+	tags.erase(std::unique(tags.begin(), tags.end(),
 			       [](const divetag *tag1, const divetag *tag2) { return tag1->name == tag2->name; }),
-		   list.end());
+		   tags.end());
+
+	list.set = tag_set();
+	for (const divetag *tag: tags)
+		list.set.set(tag->index);
 }
 
 std::string taglist_get_tagstring(const tag_list &list)
@@ -56,25 +121,29 @@ std::string taglist_get_tagstring(const tag_list &list)
 }
 
 /* Add a tag to the tag_list, keep the list sorted */
-static void taglist_add_divetag(tag_list &list, const struct divetag *tag)
+void taglist_add_divetag(tag_list &list, const struct divetag *tag)
 {
-	// Use binary search to enter at sorted position
-	auto it = std::lower_bound(list.begin(), list.end(), tag,
-				   [](const struct divetag *tag1, const struct divetag *tag2)
-				   { return tag1->name < tag2->name; });
 	// Don't add if it already exists
-	if (it == list.end() || (*it)->name != tag->name)
-		list.insert(it, tag);
+	if (list.contains(tag))
+		return;
+	// Use binary search to enter at sorted position
+	auto it = std::lower_bound(list.tags.begin(), list.tags.end(), tag, tag_less);
+	list.tags.insert(it, tag);
+	list.set.set(tag->index);
 }
 
 static const divetag *register_tag(std::string s, std::string source)
 {
+	// The entries of zip archives are parsed concurrently
+	static std::mutex lock;
+	std::lock_guard<std::mutex> guard(lock);
 	// binary search
 	auto it = std::lower_bound(g_tag_list.begin(), g_tag_list.end(), s,
 				   [](const std::unique_ptr<divetag> &tag, const std::string &s)
 				   { return tag->name < s; });
+	// Tags are never removed, only all at once. Thus, the next index is the size of the list.
 	if (it == g_tag_list.end() || (*it)->name != s)
-		it = g_tag_list.insert(it, std::make_unique<divetag>(std::move(s), std::move(source)));
+		it = g_tag_list.insert(it, std::make_unique<divetag>(std::move(s), std::move(source), (int)g_tag_list.size()));
 	return it->get();
 }
 
@@ -95,10 +164,8 @@ void taglist_add_tag(tag_list &list, const std::string &tag)
 /* Merge src1 and src2, write to *dst */
 tag_list taglist_merge(const tag_list &src1, const tag_list &src2)
 {
-	tag_list dst;
+	tag_list dst = src1;
 
-	for (const divetag *t: src1)
-		taglist_add_divetag(dst, t);
 	for (const divetag *t: src2)
 		taglist_add_divetag(dst, t);
 	return dst;
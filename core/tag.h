@@ -3,10 +3,10 @@
 #ifndef TAG_H
 #define TAG_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
-#include <string>
 
 struct divetag {
 	/*
@@ -19,12 +19,53 @@ struct divetag {
 	 * This enables us to write a non-localized tag to the xml file.
 	 */
 	std::string source;
-	divetag(std::string name, std::string source);
+	/*
+	 * Dense index of the tag in order of registration, used for the
+	 * tag sets. Two tags with the same name have the same index.
+	 */
+	int index;
+	divetag(std::string name, std::string source, int index);
 };
 
-using tag_list = std::vector<const divetag *>;
+/*
+ * A set of tags, as bits of the tag indices. Most logs have less than
+ * 64 different tags, the others need some more words.
+ */
+struct tag_set {
+	uint64_t bits = 0;
+	std::vector<uint64_t> overflow;
+
+	void set(int index);
+	bool test(int index) const;
+	bool intersects(const tag_set &s) const;
+	bool empty() const;
+	tag_set &operator|=(const tag_set &s);
+};
+
+/*
+ * The tags of a dive, sorted by name. The indices of the tags are
+ * also kept as a tag_set, so that membership tests and comparisons
+ * with a set of tags (e.g. of a filter) are bit operations.
+ */
+class tag_list {
+public:
+	using const_iterator = std::vector<const divetag *>::const_iterator;
+	const_iterator begin() const { return tags.begin(); }
+	const_iterator end() const { return tags.end(); }
+	bool empty() const { return tags.empty(); }
+	size_t size() const { return tags.size(); }
+	void clear();
+	bool contains(const divetag *tag) const { return set.test(tag->index); }
+	const tag_set &bits() const { return set; }
+private:
+	std::vector<const divetag *> tags;
+	tag_set set;
+	friend void taglist_add_divetag(tag_list &list, const divetag *tag);
+	friend void taglist_cleanup(tag_list &list);
+};
 
 void taglist_add_tag(tag_list &list, const std::string &tag);
+void taglist_add_divetag(tag_list &list, const divetag *tag);
 
 /* cleans up a list: removes empty tags and duplicates */
 void taglist_cleanup(tag_list &list);
@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "thumbnailstore.h"
+#include "errorhelper.h"
+#include "qthelper.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+// The pack is a cache that never leaves this machine, therefore
+// the numbers are stored in native byte order.
+static const char pack_magic[8] = { 'S', 'S', 'R', 'F', 'T', 'H', 'M', 'B' };
+static const quint32 pack_version = 1;
+static const char record_magic[4] = { 'T', 'H', 'M', 'B' };
+
+struct pack_header {
+	char magic[8];
+	quint32 version;
+	quint32 reserved;
+};
+
+struct record_header {
+	char magic[4];
+	quint32 size;
+	qint64 written;
+	unsigned char hash[20];
+	quint32 reserved;
+};
+
+// Don't bother compacting a pack with less garbage than that.
+static const qint64 min_garbage_for_compaction = 4 * 1024 * 1024;
+
+static QByteArray pictureHash(const QString &filename)
+{
+	return QCryptographicHash::hash(filename.toUtf8(), QCryptographicHash::Sha1);
+}
+
+ThumbnailStore &ThumbnailStore::instance()
+{
+	static ThumbnailStore self(thumbnailDir() + "thumbnails.pack", thumbnailDir());
+	return self;
+}
+
+ThumbnailStore::ThumbnailStore(const QString &packFilename, const QString &legacyDirIn) :
+	legacyDir(legacyDirIn), file(packFilename)
+{
+	QMutexLocker l(&lock);
+	open();
+	if (deadBytes > liveBytes && deadBytes > min_garbage_for_compaction)
+		compactLocked();
+}
+
+ThumbnailStore::~ThumbnailStore()
+{
+	close();
+}
+
+void ThumbnailStore::open()
+{
+	QDir().mkpath(QFileInfo(file.fileName()).absolutePath());
+	if (!file.open(QIODevice::ReadWrite)) {
+		report_info("Cannot open thumbnail pack %s", qPrintable(file.fileName()));
+		return;
+	}
+	scan();
+}
+
+void ThumbnailStore::close()
+{
+	if (map)
+		file.unmap(map);
+	map = nullptr;
+	mapSize = 0;
+	file.close();
+	index.clear();
+	liveBytes = deadBytes = 0;
+}
+
+// Reads the record headers of the whole pack and builds the index.
+// A truncated record at the end (say, after a crash) is cut off.
+void ThumbnailStore::scan()
+{
+	qint64 size = file.size();
+	pack_header header;
+
+	if (size < (qint64)sizeof(header) || file.read((char *)&header, sizeof(header)) != sizeof(header) ||
+	    memcmp(header.magic, pack_magic, sizeof(pack_magic)) != 0 || header.version != pack_version) {
+		// Empty, broken or from an unknown version: start from scratch.
+		memcpy(header.magic, pack_magic, sizeof(pack_magic));
+		header.version = pack_version;
+		header.reserved = 0;
+		file.resize(0);
+		file.seek(0);
+		file.write((const char *)&header, sizeof(header));
+		file.flush();
+		return;
+	}
+
+	map = file.map(0, size);
+	if (map)
+		mapSize = size;
+
+	qint64 pos = sizeof(header);
+	while (pos + (qint64)sizeof(record_header) <= size) {
+		record_header rec;
+		if (map) {
+			memcpy(&rec, map + pos, sizeof(rec));
+		} else if (!file.seek(pos) || file.read((char *)&rec, sizeof(rec)) != sizeof(rec)) {
+			break;
+		}
+		qint64 payload = pos + sizeof(rec);
+		if (memcmp(rec.magic, record_magic, sizeof(record_magic)) != 0 || payload + rec.size > size)
+			break;
+
+		QByteArray hash((const char *)rec.hash, sizeof(rec.hash));
+		auto it = index.find(hash);
+		if (it != index.end()) {
+			deadBytes += it->size + sizeof(rec);
+			liveBytes -= it->size + sizeof(rec);
+		}
+		index.insert(hash, Entry { payload, rec.size, rec.written });
+		liveBytes += rec.size + sizeof(rec);
+		pos = payload + rec.size;
+	}
+
+	if (pos < size) {
+		report_info("Truncating corrupt thumbnail pack %s at %lld", qPrintable(file.fileName()), (long long)pos);
+		if (map) {
+			file.unmap(map);
+			map = nullptr;
+			mapSize = 0;
+		}
+		file.resize(pos);
+		map = file.map(0, pos);
+		if (map)
+			mapSize = pos;
+	}
+}
+
+bool ThumbnailStore::append(const QByteArray &hash, const QByteArray &data, qint64 written)
+{
+	if (!file.isOpen())
+		return false;
+
+	record_header rec;
+	memcpy(rec.magic, record_magic, sizeof(record_magic));
+	rec.size = (quint32)data.size();
+	rec.written = written;
+	memcpy(rec.hash, hash.constData(), sizeof(rec.hash));
+	rec.reserved = 0;
+
+	// Write header and payload in one go, so that a crash leaves
+	// at most one partial record at the end of the pack.
+	QByteArray buf;
+	buf.reserve(sizeof(rec) + data.size());
+	buf.append((const char *)&rec, sizeof(rec));
+	buf.append(data);
+
+	qint64 pos = file.size();
+	if (!file.seek(pos) || file.write(buf) != buf.size() || !file.flush()) {
+		report_info("Cannot write to thumbnail pack %s", qPrintable(file.fileName()));
+		return false;
+	}
+
+	auto it = index.find(hash);
+	if (it != index.end()) {
+		deadBytes += it->size + sizeof(rec);
+		liveBytes -= it->size + sizeof(rec);
+	}
+	index.insert(hash, Entry { pos + (qint64)sizeof(rec), rec.size, written });
+	liveBytes += buf.size();
+	return true;
+}
+
+bool ThumbnailStore::readPayload(const Entry &entry, QByteArray &data)
+{
+	if (entry.offset + entry.size <= mapSize) {
+		data = QByteArray((const char *)map + entry.offset, entry.size);
+		return true;
+	}
+	// Appended after opening the pack: one read from the file.
+	if (!file.seek(entry.offset))
+		return false;
+	data = file.read(entry.size);
+	return data.size() == (int)entry.size;
+}
+
+// Import a thumbnail of the old per-picture cache into the pack.
+bool ThumbnailStore::getLegacy(const QString &picture_filename, const QByteArray &hash, QByteArray &data, QDateTime &written)
+{
+	if (legacyDir.isEmpty() || picture_filename.isEmpty())
+		return false;
+	QFile legacy(legacyDir + hash.toHex());
+	if (!legacy.open(QIODevice::ReadOnly))
+		return false;
+	data = legacy.readAll();
+	written = QFileInfo(legacy).lastModified();
+	legacy.close();
+	if (append(hash, data, written.toMSecsSinceEpoch()))
+		legacy.remove();
+	return true;
+}
+
+bool ThumbnailStore::get(const QString &picture_filename, QByteArray &data, QDateTime &written)
+{
+	QByteArray hash = pictureHash(picture_filename);
+	QMutexLocker l(&lock);
+	auto it = index.constFind(hash);
+	if (it == index.cend())
+		return getLegacy(picture_filename, hash, data, written);
+	if (!readPayload(*it, data))
+		return false;
+	written = QDateTime::fromMSecsSinceEpoch(it->written);
+	return true;
+}
+
+void ThumbnailStore::put(const QString &picture_filename, const QByteArray &data)
+{
+	if (picture_filename.isEmpty())
+		return;
+	QByteArray hash = pictureHash(picture_filename);
+	QMutexLocker l(&lock);
+	append(hash, data, QDateTime::currentMSecsSinceEpoch());
+	if (deadBytes > liveBytes && deadBytes > min_garbage_for_compaction)
+		compactLocked();
+}
+
+int ThumbnailStore::count() const
+{
+	QMutexLocker l(&lock);
+	return index.size();
+}
+
+void ThumbnailStore::compact()
+{
+	QMutexLocker l(&lock);
+	compactLocked();
+}
+
+// Rewrite the pack with only the live records, in the order of the old pack.
+void ThumbnailStore::compactLocked()
+{
+	if (!file.isOpen())
+		return;
+
+	std::vector<std::pair<QByteArray, Entry>> entries;
+	entries.reserve(index.size());
+	for (auto it = index.cbegin(); it != index.cend(); ++it)
+		entries.emplace_back(it.key(), it.value());
+	std::sort(entries.begin(), entries.end(),
+		  [](const auto &e1, const auto &e2) { return e1.second.offset < e2.second.offset; });
+
+	QSaveFile out(file.fileName());
+	if (!out.open(QIODevice::WriteOnly))
+		return;
+	pack_header header;
+	memcpy(header.magic, pack_magic, sizeof(pack_magic));
+	header.version = pack_version;
+	header.reserved = 0;
+	out.write((const char *)&header, sizeof(header));
+
+	QByteArray data;
+	for (const auto &[hash, entry]: entries) {
+		if (!readPayload(entry, data))
+			continue;
+		record_header rec;
+		memcpy(rec.magic, record_magic, sizeof(record_magic));
+		rec.size = entry.size;
+		rec.written = entry.written;
+		memcpy(rec.hash, hash.constData(), sizeof(rec.hash));
+		rec.reserved = 0;
+		out.write((const char *)&rec, sizeof(rec));
+		out.write(data);
+	}
+
+	// Release the old pack before it is replaced (required on Windows).
+	close();
+	if (!out.commit())
+		report_info("Cannot compact thumbnail pack %s", qPrintable(file.fileName()));
+	open();
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0
+// Persistent storage of the thumbnails in a single pack file.
+//
+// The thumbnails are appended to the pack file as records, each made of
+// a fixed-size header (SHA1 of the picture filename, time of writing and
+// payload size) and the serialized thumbnail. Rewriting a thumbnail simply
+// appends a new record, which supersedes the old one. The index, which
+// maps the hash to the last record, is built when opening the pack by
+// walking the memory-mapped file. Once the superseded records take more
+// space than the live ones, the pack is compacted.
+//
+// Thumbnails from the old one-file-per-picture cache are moved into the
+// pack when they are first accessed.
+#ifndef THUMBNAILSTORE_H
+#define THUMBNAILSTORE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+
+class ThumbnailStore {
+public:
+	static ThumbnailStore &instance();
+	ThumbnailStore(const QString &packFilename, const QString &legacyDir = QString());
+	~ThumbnailStore();
+
+	// Returns false if there is no thumbnail for this picture. On success,
+	// data is the serialized thumbnail and written the time it was stored.
+	bool get(const QString &picture_filename, QByteArray &data, QDateTime &written);
+	void put(const QString &picture_filename, const QByteArray &data);
+	int count() const;
+	void compact();
+private:
+	struct Entry {
+		qint64 offset;		// Offset of the payload in the pack file
+		quint32 size;
+		qint64 written;		// msecs since epoch
+	};
+	void open();
+	void close();
+	void scan();
+	bool append(const QByteArray &hash, const QByteArray &data, qint64 written);
+	bool readPayload(const Entry &entry, QByteArray &data);
+	bool getLegacy(const QString &picture_filename, const QByteArray &hash, QByteArray &data, QDateTime &written);
+	void compactLocked();
+
+	mutable QMutex lock;
+	QString legacyDir;
+	QFile file;
+	uchar *map = nullptr;	// The part of the pack that existed when opening it
+	qint64 mapSize = 0;
+	qint64 liveBytes = 0;
+	qint64 deadBytes = 0;
+	QHash<QByteArray, Entry> index;
+};
+
+#endif
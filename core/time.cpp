@@ -25,6 +25,52 @@
 #define SEC_PER_DAY  ((timestamp_t) 24*60*60)
 #define EPOCH_OFFSET (25567 * SEC_PER_DAY)
 
+/*
+ * Days before the first of each month, for common and leap years.
+ * Indexed by [leap][month], with the length of the year at [leap][12].
+ */
+static const unsigned int month_start[2][13] = {
+	{ 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 },
+	{ 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366 },
+};
+
+/*
+ * Split "days since Jan 1, 1900" into the year and the day in the year.
+ * Returns 1 for leap years, 0 otherwise.
+ *
+ * To make things easier, let's count from Jan 1, 1904, since that's a
+ * leap-year. 1900 itself was not. This will get 1900-1903 wrong. If you
+ * were diving back then, you're kind of screwed.
+ */
+static int split_days(unsigned long val, int *year, unsigned int *yday)
+{
+	unsigned int leapyears;
+
+	val -= 365*4;
+
+	/* This only works up until 2099 (2100 isn't a leap-year) */
+	leapyears = val / (365 * 4 + 1);
+	val %= (365 * 4 + 1);
+	*year = 1904 + leapyears * 4;
+
+	/* Handle the leap-year itself */
+	if (val > 365) {
+		val -= 366;
+		*year += 1 + val / 365;
+		*yday = val % 365;
+		return 0;
+	}
+	*yday = val;
+	return 1;
+}
+
+/* Days since Jan 1, 1900 of a non-zero timestamp */
+static unsigned long days_since_1900(timestamp_t timestamp)
+{
+	unsigned long val = (timestamp + EPOCH_OFFSET) / 60;
+	return val / 60 / 24;
+}
+
 /*
  * Convert 64-bit timestamp to 'struct tm' in UTC.
  *
@@ -35,16 +81,9 @@
  */
 void utc_mkdate(timestamp_t timestamp, struct tm *tm)
 {
-	static const unsigned int mdays[] = {
-		31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31,
-	};
-	static const unsigned int mdays_leap[] = {
-		31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31,
-	};
 	unsigned long val;
-	unsigned int leapyears;
-	int m;
-	const unsigned int *mp;
+	unsigned int yday;
+	int m, leap;
 
 	memset(tm, 0, sizeof(*tm));
 
@@ -68,35 +107,16 @@ void utc_mkdate(timestamp_t timestamp, struct tm *tm)
 	/* Jan 1, 1900 was a Monday (tm_wday=1) */
 	tm->tm_wday = (val + 1) % 7;
 
+	leap = split_days(val, &tm->tm_year, &yday);
+
 	/*
-	 * Now we're in "days since Jan 1, 1900". To make things easier,
-	 * let's make it "days since Jan 1, 1904", since that's a leap-year.
-	 * 1900 itself was not. The following logic will get 1900-1903
-	 * wrong. If you were diving back then, you're kind of screwed.
+	 * No month is longer than 32 days, so this is at most two
+	 * months early. Step forward from there.
 	 */
-	val -= 365*4;
-
-	/* This only works up until 2099 (2100 isn't a leap-year) */
-	leapyears = val / (365 * 4 + 1);
-	val %= (365 * 4 + 1);
-	tm->tm_year = 1904 + leapyears * 4;
-
-	/* Handle the leap-year itself */
-	mp = mdays_leap;
-	if (val > 365) {
-		tm->tm_year++;
-		val -= 366;
-		tm->tm_year += val / 365;
-		val %= 365;
-		mp = mdays;
-	}
-
-	for (m = 0; m < 12; m++) {
-		if (val < *mp)
-			break;
-		val -= *mp++;
-	}
-	tm->tm_mday = val + 1;
+	m = yday / 32;
+	while (yday >= month_start[leap][m + 1])
+		m++;
+	tm->tm_mday = yday - month_start[leap][m] + 1;
 	tm->tm_mon = m;
 }
 
@@ -141,32 +161,30 @@ timestamp_t utc_mktime(const struct tm *tm)
 
 /*
  * Extract year from 64-bit timestamp.
- *
- * This looks inefficient, since it breaks down into a full
- * struct tm. However, modern compilers are effective at throwing
- * out unused calculations. If it turns out to be a bottle neck
- * we will have to cache a struct tm per dive.
+ * These are called per dive when grouping and filtering,
+ * therefore they skip the parts of utc_mkdate() they don't need.
  */
 int utc_year(timestamp_t timestamp)
 {
-	struct tm tm;
-	utc_mkdate(timestamp, &tm);
-	return tm.tm_year;
+	int year;
+	unsigned int yday;
+
+	if (!timestamp)
+		return 0;
+	split_days(days_since_1900(timestamp), &year, &yday);
+	return year;
 }
 
 /*
  * Extract day of week from 64-bit timestamp.
  * Returns 0-6, whereby 0 is Sunday and 6 is Saturday.
- *
- * Same comment as for utc_year(): Modern compilers are good
- * at throwing out unused calculations, so this is more efficient
- * than it looks.
  */
 int utc_weekday(timestamp_t timestamp)
 {
-	struct tm tm;
-	utc_mkdate(timestamp, &tm);
-	return tm.tm_wday;
+	if (!timestamp)
+		return 0;
+	/* Jan 1, 1900 was a Monday (tm_wday=1) */
+	return (days_since_1900(timestamp) + 1) % 7;
 }
 
 /*
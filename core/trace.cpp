@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "trace.h"
+#include "errorhelper.h"
+#include "file.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+bool trace_enabled = false;
+
+struct trace_event {
+	const char *name;
+	int thread;
+	uint64_t start, duration;
+};
+
+static std::string trace_filename;
+static std::mutex trace_lock;
+static std::vector<trace_event> trace_events;
+static const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+void trace_start(const std::string &filename)
+{
+	trace_filename = filename;
+	trace_events.reserve(4096);
+	trace_enabled = true;
+}
+
+uint64_t trace_now()
+{
+	using namespace std::chrono;
+	return (uint64_t)duration_cast<microseconds>(steady_clock::now() - trace_epoch).count();
+}
+
+// Small numbers are easier to read in the viewer than the native thread ids.
+static int trace_thread()
+{
+	static std::atomic<int> next_thread { 1 };
+	thread_local int thread = next_thread++;
+	return thread;
+}
+
+void trace_record(const char *name, uint64_t start)
+{
+	uint64_t end = trace_now();
+	int thread = trace_thread();
+	std::lock_guard<std::mutex> guard(trace_lock);
+	trace_events.push_back({ name, thread, start, end - start });
+}
+
+void trace_finish()
+{
+	if (!trace_enabled)
+		return;
+	trace_enabled = false;
+
+	std::lock_guard<std::mutex> guard(trace_lock);
+	FILE *f = subsurface_fopen(trace_filename.c_str(), "w");
+	if (!f) {
+		report_error("Cannot write trace file %s", trace_filename.c_str());
+		return;
+	}
+	fputs("{\"traceEvents\":[\n", f);
+	for (size_t i = 0; i < trace_events.size(); ++i) {
+		const trace_event &ev = trace_events[i];
+		fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu}%s\n",
+			ev.name, ev.thread, (unsigned long long)ev.start, (unsigned long long)ev.duration,
+			i + 1 < trace_events.size() ? "," : "");
+	}
+	fputs("],\"displayTimeUnit\":\"ms\"}\n", f);
+	fclose(f);
+	report_info("Wrote %d trace events to %s", (int)trace_events.size(), trace_filename.c_str());
+	trace_events.clear();
+}
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0
+// Tracing of the time spent in selected functions.
+//
+// A function is traced by putting TRACE_ZONE("name") at its top. The zone
+// ends when the enclosing scope is left. Tracing is disabled by default,
+// in which case a zone costs a test of a global flag. It is enabled with
+// the --trace=<file> command line option. The zones are collected in memory
+// and written at exit in the JSON trace event format, which can be opened
+// with chrome://tracing or https://ui.perfetto.dev.
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <string>
+
+extern bool trace_enabled;
+
+void trace_start(const std::string &filename);
+void trace_finish();		// Write the trace file, if tracing is enabled
+uint64_t trace_now();		// Microseconds since the start of the program
+void trace_record(const char *name, uint64_t start);
+
+class trace_zone {
+public:
+	// The name must be a string literal (it is not copied)
+	trace_zone(const char *zone) : name(trace_enabled ? zone : nullptr), start(name ? trace_now() : 0)
+	{
+	}
+	~trace_zone()
+	{
+		if (name)
+			trace_record(name, start);
+	}
+	trace_zone(const trace_zone &) = delete;
+	trace_zone &operator=(const trace_zone &) = delete;
+private:
+	const char *name;
+	uint64_t start;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_ZONE(name) trace_zone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+
+#endif
@@ -9,6 +9,8 @@
 #include "subsurface-string.h"
 #include "selection.h"
 
+#include <algorithm>
+
 dive_trip::dive_trip() : id(dive_getUniqID())
 {
 }
@@ -77,13 +79,18 @@ std::unique_ptr<dive_trip> create_trip_from_dive(const struct dive *dive)
  */
 std::pair<dive_trip *, std::unique_ptr<dive_trip>> get_trip_for_new_dive(const struct divelog &log, const struct dive *new_dive)
 {
-	/* Find dive that is within TRIP_THRESHOLD of current dive */
-	for (auto &d: log.dives) {
+	/* Find dive that is within TRIP_THRESHOLD of current dive.
+	 * The dives are sorted by start time, so skip the earlier ones. */
+	timestamp_t start = new_dive->when - TRIP_THRESHOLD;
+	auto it = std::lower_bound(log.dives.begin(), log.dives.end(), start,
+				   [](const std::unique_ptr<dive> &d, timestamp_t when) { return d->when < when; });
+	for (; it != log.dives.end(); ++it) {
+		const dive *d = it->get();
 		/* Check if we're past the range of possible dives */
 		if (d->when >= new_dive->when + TRIP_THRESHOLD)
 			break;
 
-		if (d->when + TRIP_THRESHOLD >= new_dive->when && d->divetrip)
+		if (d->divetrip)
 			return { d->divetrip, nullptr }; /* Found a dive with trip in the range */
 	}
 
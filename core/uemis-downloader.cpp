@@ -21,6 +21,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <array>
 #include <string>
 #include <charconv>
@@ -73,10 +74,14 @@ static int debug_round = 0;
 static constexpr int uemis_timeout = 50;		/* 50ns */
 static constexpr int uemis_long_timeout = 500;		/* 500ns */
 static constexpr int uemis_max_timeout = 2000;		/* 2ms */
+static constexpr int uemis_poll_interval = 5;		/* 5ns */
+static constexpr int uemis_max_poll_interval = 40;	/* 40ns */
 #else
 static constexpr int uemis_timeout = 50000;		/* 50ms */
 static constexpr int uemis_long_timeout = 500000;	/* 500ms */
 static constexpr int uemis_max_timeout = 2000000;	/* 2s */
+static constexpr int uemis_poll_interval = 5000;	/* 5ms */
+static constexpr int uemis_max_poll_interval = 40000;	/* 40ms */
 #endif
 
 static uemis uemis_obj;
@@ -449,13 +454,6 @@ static void show_progress(const std::string &buf, const char *what)
 	}
 }
 
-static void uemis_increased_timeout(int *timeout)
-{
-	if (*timeout < uemis_max_timeout)
-		*timeout += uemis_long_timeout;
-	usleep(*timeout);
-}
-
 static std::string build_ans_path(const std::string &path, int filenumber)
 {
 	using namespace std::string_literals;
@@ -470,6 +468,42 @@ static std::string build_ans_path(const std::string &path, int filenumber)
 	return build_filename(intermediate, fl);
 }
 
+/* The dive computer takes anything from a few to several hundred ms to
+ * answer. Instead of always sleeping for the worst case, give it a short
+ * head start and then poll the answer file with increasing intervals until
+ * it is marked as complete or the timeout has passed. (File change
+ * notifications are of no use: the device writes to its filesystem behind
+ * the back of the host.) */
+static void uemis_wait_for_answer(const std::string &path, int filenumber, int timeout)
+{
+	std::string ans_path = build_ans_path(path, filenumber);
+	int waited = std::min(uemis_timeout, timeout);
+	int interval = uemis_poll_interval;
+
+	usleep(waited);
+	while (waited < timeout && !import_thread_cancelled) {
+		int ans_file = subsurface_open(ans_path.c_str(), O_RDONLY, 0666);
+		if (ans_file >= 0) {
+			char status;
+			bool ready = read(ans_file, &status, 1) == 1 && status == '1';
+			close(ans_file);
+			if (ready)
+				return;
+		}
+		int step = std::min(interval, timeout - waited);
+		usleep(step);
+		waited += step;
+		interval = std::min(2 * interval, uemis_max_poll_interval);
+	}
+}
+
+static void uemis_increased_timeout(const std::string &path, int *timeout)
+{
+	if (*timeout < uemis_max_timeout)
+		*timeout += uemis_long_timeout;
+	uemis_wait_for_answer(path, filenr - 1, *timeout);
+}
+
 /* send a request to the dive computer and collect the answer */
 static std::string uemis_get_answer(const std::string &path, const std::string &request, int n_param_in,
 				   int n_param_out, std::string &error_text)
@@ -527,7 +561,7 @@ static std::string uemis_get_answer(const std::string &path, const std::string &
 		more_files = false;
 	}
 	trigger_response(reqtxt_file, "n", filenr, file_length);
-	usleep(timeout);
+	uemis_wait_for_answer(path, filenr - 1, timeout);
 	std::string mbuf;
 	while (searching || assembling_mbuf) {
 		if (import_thread_cancelled)
@@ -594,7 +628,7 @@ static std::string uemis_get_answer(const std::string &path, const std::string &
 				return std::string();
 			}
 			trigger_response(reqtxt_file, "r", filenr, file_length);
-			uemis_increased_timeout(&timeout);
+			uemis_increased_timeout(path, &timeout);
 		}
 		if (ismulti && more_files && tmp[0] == '1') {
 			int size;
@@ -2,8 +2,6 @@
 #include "uploadDiveLogsDE.h"
 #include <QDir>
 #include <QTemporaryFile>
-#include <zip.h>
-#include <errno.h>
 #include "core/errorhelper.h"
 #include "core/qthelper.h"
 #include "core/dive.h"
@@ -14,6 +12,7 @@
 #include "core/range.h"
 #include "core/cloudstorage.h"
 #include "core/xmlparams.h"
+#include "core/zipwriter.h"
 #ifndef SUBSURFACE_MOBILE
 #include "core/selection.h"
 #endif // SUBSURFACE_MOBILE
@@ -68,7 +67,6 @@ bool uploadDiveLogsDE::prepareDives(const QString &tempfile, bool selected)
 	static const char errPrefix[] = "divelog.de-upload:";
 
 	xsltStylesheetPtr xslt = NULL;
-	struct zip *zip;
 
 	emit uploadStatus(tr("building zip file to upload"));
 
@@ -79,15 +77,14 @@ bool uploadDiveLogsDE::prepareDives(const QString &tempfile, bool selected)
 		return false;
 	}
 
-	// Prepare zip file
-	int error_code;
-	zip = zip_open(QFile::encodeName(QDir::toNativeSeparators(tempfile)), ZIP_CREATE, &error_code);
-	if (!zip) {
-		char buffer[1024];
-		zip_error_to_str(buffer, sizeof buffer, error_code, errno);
-		report_error(qPrintable(tr("Failed to create zip file for upload: %s")), buffer);
+	// Prepare zip file. The dives are added to the file one by one, so that
+	// only the dive that is being converted has to be kept in memory.
+	QFile zipFile(tempfile);
+	if (!zipFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		report_error(qPrintable(tr("Failed to create zip file for upload: %s")), qPrintable(zipFile.errorString()));
 		return false;
 	}
+	ZipWriter zip(zipFile);
 
 	/* walk the dive list in chronological order */
 	for (auto [i, dive]: enumerated_range(divelog.dives)) {
@@ -95,7 +92,6 @@ bool uploadDiveLogsDE::prepareDives(const QString &tempfile, bool selected)
 		int streamsize;
 		char *membuf;
 		xmlDoc *transformed;
-		struct zip_source *s;
 		membuffer mb;
 		struct xml_params *params = alloc_xml_params();
 
@@ -146,9 +142,8 @@ bool uploadDiveLogsDE::prepareDives(const QString &tempfile, bool selected)
 		if (!doc) {
 			report_info("%s could not parse back into memory the XML file we've just created!", errPrefix);
 			report_error("%s", qPrintable(tr("internal error")));
-			zip_close(zip);
+			zipFile.close();
 			QFile::remove(tempfile);
-			xsltFreeStylesheet(xslt);
 			free_xml_params(params);
 			return false;
 		}
@@ -166,28 +161,19 @@ bool uploadDiveLogsDE::prepareDives(const QString &tempfile, bool selected)
 		xmlFreeDoc(transformed);
 
 		/*
-		 * Save the XML document into a zip file.
+		 * Save the XML document into the zip file.
 		 */
 		snprintf(filename, PATH_MAX, "%d.xml", i + 1);
-		s = zip_source_buffer(zip, membuf, streamsize, 1); // frees membuffer!
-		if (s) {
-			int64_t ret = zip_add(zip, filename, s);
-			if (ret == -1)
-				report_info("%s failed to include dive: %d", errPrefix, i);
-		}
+		bool added = zip.add(filename, membuf, streamsize);
+		xmlFree(membuf);
+		if (!added)
+			break;
 	}
-	xsltFreeStylesheet(xslt);
-	if (zip_close(zip)) {
-		int ze, se;
-#if LIBZIP_VERSION_MAJOR >= 1
-		zip_error_t *error = zip_get_error(zip);
-		ze = zip_error_code_zip(error);
-		se = zip_error_code_system(error);
-#else
-		zip_error_get(zip, &ze, &se);
-#endif
-		report_error(qPrintable(tr("error writing zip file: %s zip error %d system error %d - %s")),
-			     qPrintable(QDir::toNativeSeparators(tempfile)), ze, se, zip_strerror(zip));
+	if (!zip.finish() || !zipFile.flush()) {
+		report_error(qPrintable(tr("error writing zip file: %s - %s")),
+			     qPrintable(QDir::toNativeSeparators(tempfile)), qPrintable(zipFile.errorString()));
+		zipFile.close();
+		QFile::remove(tempfile);
 		return false;
 	}
 	return true;
@@ -24,12 +24,25 @@ uploadDiveShare::uploadDiveShare():
 }
 
 
+uploadDiveShare::~uploadDiveShare()
+{
+}
+
+
 void uploadDiveShare::doUpload(bool selected, const QString &uid, bool noPublic)
 {
+	// An earlier upload still reads from the old payload
+	if (reply != NULL) {
+		reply->disconnect(this);
+		reply->abort();
+		delete reply;
+		reply = NULL;
+	}
+
 	//generate json
-	membuffer buf;
-	export_list(&buf, NULL, selected, false);
-	QByteArray json_data(buf.buffer, buf.len);
+	payload = std::make_unique<membuffer>();
+	export_list(payload.get(), NULL, selected, false);
+	QByteArray json_data = QByteArray::fromRawData(payload->buffer, (int)payload->len);
 
 	//Request to server
 	QNetworkRequest request;
@@ -81,11 +94,16 @@ void uploadDiveShare::updateProgressSlot(qint64 current, qint64 total)
 
 void uploadDiveShare::uploadFinishedSlot()
 {
+	if (!reply)
+		return;
 	QByteArray html = reply->readAll();
 	reply->deleteLater();
 	timeout.stop();
-	if (reply->error() != 0)  {
-		emit uploadFinish(false, reply->errorString(), html);
+	QNetworkReply::NetworkError error = reply->error();
+	QString errorString = reply->errorString();
+	reply = NULL;
+	if (error != 0)  {
+		emit uploadFinish(false, errorString, html);
 	} else {
 		emit uploadFinish(true, tr("Upload successful"), html);
 	}
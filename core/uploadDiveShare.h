@@ -3,6 +3,9 @@
 #define UPLOADDIVESHARE_H
 #include <QNetworkReply>
 #include <QTimer>
+#include <memory>
+
+struct membuffer;
 
 class uploadDiveShare : public QObject {
 	Q_OBJECT
@@ -24,9 +27,13 @@ signals:
 	
 private:
 	uploadDiveShare();
+	~uploadDiveShare();
 
 	QNetworkReply *reply;
 	QTimer timeout;
+	// The JSON that is being uploaded. It is sent from this buffer
+	// without copying, so it must live until the upload is done.
+	std::unique_ptr<membuffer> payload;
 };
 
 #endif // UPLOADDIVESHARE_H
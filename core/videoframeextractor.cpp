@@ -6,6 +6,7 @@
 
 #include <QtConcurrent>
 #include <QProcess>
+#include <QTemporaryDir>
 
 // Note: this is a global instead of a function-local variable on purpose.
 // We don't want this to be generated in a different thread context if
@@ -23,31 +24,43 @@ VideoFrameExtractor::VideoFrameExtractor()
 	pool.setMaxThreadCount(1);
 }
 
+// Spawning ffmpeg is expensive. Therefore, the thumbnails of up to that
+// many queued videos are extracted by a single ffmpeg process.
+static const int max_batch_size = 16;
+
 void VideoFrameExtractor::extract(QString originalFilename, QString filename, duration_t duration)
 {
 	QMutexLocker l(&lock);
 	if (!workingOn.contains(originalFilename)) {
 		// We are not currently extracting this video - add it to the list.
-		workingOn.insert(originalFilename, QtConcurrent::run(&pool, [this, originalFilename, filename, duration]()
-				 { processItem(originalFilename, filename, duration); }));
+		// A job is started for every video, but it will process all videos queued
+		// at that time. The other jobs will then find an empty queue.
+		workingOn.insert(originalFilename);
+		queue.enqueue({ originalFilename, filename, duration });
+		QtConcurrent::run(&pool, [this]() { processBatch(); });
 	}
 }
 
+void VideoFrameExtractor::done(const QString &originalFilename)
+{
+	QMutexLocker l(&lock);
+	workingOn.remove(originalFilename);
+}
+
 void VideoFrameExtractor::fail(const QString &originalFilename, duration_t duration, bool isInvalid)
 {
 	if (isInvalid)
 		emit invalid(originalFilename, duration);
 	else
 		emit failed(originalFilename, duration);
-	QMutexLocker l(&lock);
-	workingOn.remove(originalFilename);
+	done(originalFilename);
 }
 
 void VideoFrameExtractor::clearWorkQueue()
 {
 	QMutexLocker l(&lock);
-	for (auto it = workingOn.begin(); it != workingOn.end(); ++it)
-		it->cancel();
+	pool.clear();
+	queue.clear();
 	workingOn.clear();
 }
 
@@ -58,18 +71,10 @@ T clamp(T v, T lo, T hi)
 	return v < lo ? lo : v > hi ? hi : v;
 }
 
-void VideoFrameExtractor::processItem(QString originalFilename, QString filename, duration_t duration)
+// Determine the time where we want to extract the image.
+// If the duration is < 10 sec, just snap the first frame
+static duration_t thumbnailPosition(duration_t &duration)
 {
-	// If video frame extraction is turned off (e.g. because we failed to start ffmpeg),
-	// abort immediately.
-	if (!prefs.extract_video_thumbnails) {
-		QMutexLocker l(&lock);
-		workingOn.remove(originalFilename);
-		return;
-	}
-
-	// Determine the time where we want to extract the image.
-	// If the duration is < 10 sec, just snap the first frame
 	duration_t position;
 	if (duration.seconds > 10) {
 		// We round to second-precision. To be sure that we don't attempt reading past the
@@ -78,13 +83,95 @@ void VideoFrameExtractor::processItem(QString originalFilename, QString filename
 		position.seconds = clamp(duration.seconds * prefs.extract_video_thumbnails_position / 100,
 					 0, duration.seconds);
 	}
+	return position;
+}
+
+// The input options to extract a frame at the given position. Putting -ss before
+// the input makes ffmpeg seek in the container. With -noaccurate_seek, it takes
+// the keyframe at that position instead of decoding up to the exact timestamp.
+static QStringList inputArguments(const QString &filename, duration_t position)
+{
 	QString posString = QString("%1:%2:%3").arg(position.seconds / 3600, 2, 10, QChar('0'))
 					       .arg((position.seconds % 3600) / 60, 2, 10, QChar('0'))
 					       .arg(position.seconds % 60, 2, 10, QChar('0'));
+	return { "-noaccurate_seek", "-ss", posString, "-i", filename };
+}
+
+void VideoFrameExtractor::processBatch()
+{
+	std::vector<Item> items;
+	QMutexLocker l(&lock);
+	while (!queue.isEmpty() && (int)items.size() < max_batch_size)
+		items.push_back(queue.dequeue());
+	l.unlock();
+
+	if (items.empty())
+		return;
+	if (items.size() == 1 || !extractBatch(items)) {
+		// Single video or one of the videos made ffmpeg give up: extract one by one,
+		// so that we can tell the broken videos from the good ones.
+		for (const Item &item: items)
+			processItem(item.originalFilename, item.filename, item.duration);
+	}
+}
+
+// Extract the frames of multiple videos with a single ffmpeg process. Each video is
+// an input of its own and each frame is written to a file in a temporary directory.
+// Returns false if ffmpeg failed, in which case no signal was emitted.
+bool VideoFrameExtractor::extractBatch(const std::vector<Item> &items)
+{
+	if (!prefs.extract_video_thumbnails)
+		return false;
+
+	QTemporaryDir dir;
+	if (!dir.isValid())
+		return false;
+
+	QStringList arguments { "-y" };
+	std::vector<duration_t> durations, positions;
+	durations.reserve(items.size());
+	positions.reserve(items.size());
+	for (const Item &item: items) {
+		durations.push_back(item.duration);
+		positions.push_back(thumbnailPosition(durations.back()));
+		arguments << inputArguments(item.filename, positions.back());
+	}
+	for (size_t i = 0; i < items.size(); ++i) {
+		arguments << "-map" << QString("%1:v:0").arg(i) << "-vframes" << "1" << "-q:v" << "2"
+			  << dir.filePath(QString("%1.jpg").arg(i));
+	}
+
+	QProcess ffmpeg;
+	ffmpeg.start(prefs.ffmpeg_executable.c_str(), arguments);
+	// Give ffmpeg the default 30 seconds per video
+	if (!ffmpeg.waitForStarted() || !ffmpeg.waitForFinished(30000 * (int)items.size()) ||
+	    ffmpeg.exitStatus() != QProcess::NormalExit || ffmpeg.exitCode() != 0)
+		return false;
+
+	for (size_t i = 0; i < items.size(); ++i) {
+		QImage img(dir.filePath(QString("%1.jpg").arg(i)));
+		if (img.isNull()) {
+			fail(items[i].originalFilename, durations[i], true);
+			continue;
+		}
+		emit extracted(items[i].originalFilename, std::move(img), durations[i], positions[i]);
+		done(items[i].originalFilename);
+	}
+	return true;
+}
+
+void VideoFrameExtractor::processItem(QString originalFilename, QString filename, duration_t duration)
+{
+	// If video frame extraction is turned off (e.g. because we failed to start ffmpeg),
+	// abort immediately.
+	if (!prefs.extract_video_thumbnails)
+		return done(originalFilename);
+
+	duration_t position = thumbnailPosition(duration);
 
 	QProcess ffmpeg;
-	ffmpeg.start(prefs.ffmpeg_executable.c_str(), QStringList {
-		"-ss", posString, "-i", filename, "-vframes", "1", "-q:v", "2", "-f", "image2", "-"
+	ffmpeg.start(prefs.ffmpeg_executable.c_str(), inputArguments(filename, position) + QStringList {
+		"-vframes", "1", "-q:v", "2", "-f", "image2", "-"
 	});
 	if (!ffmpeg.waitForStarted()) {
 		// Since we couldn't sart ffmpeg, turn off thumbnailing
@@ -113,6 +200,5 @@ void VideoFrameExtractor::processItem(QString originalFilename, QString filename
 	}
 
 	emit extracted(originalFilename, std::move(img), duration, position);
-	QMutexLocker l(&lock);
-	workingOn.remove(originalFilename);
+	done(originalFilename);
 }
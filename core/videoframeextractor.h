@@ -5,11 +5,11 @@
 #include "core/units.h"
 
 #include <QMutex>
-#include <QFuture>
 #include <QThreadPool>
 #include <QQueue>
+#include <QSet>
 #include <QString>
-#include <QPair>
+#include <vector>
 
 class VideoFrameExtractor : public QObject {
 	Q_OBJECT
@@ -27,11 +27,20 @@ public slots:
 	void extract(QString originalFilename, QString filename, duration_t duration);
 	void clearWorkQueue();
 private:
+	struct Item {
+		QString originalFilename;
+		QString filename;
+		duration_t duration;
+	};
+	void processBatch();
+	bool extractBatch(const std::vector<Item> &items);
 	void processItem(QString originalFilename, QString filename, duration_t duration);
 	void fail(const QString &originalFilename, duration_t duration, bool isInvalid);
+	void done(const QString &originalFilename);
 	mutable QMutex lock;
 	QThreadPool pool;
-	QMap<QString, QFuture<void>> workingOn;
+	QQueue<Item> queue;
+	QSet<QString> workingOn;	// Queued or being extracted
 };
 
 #endif
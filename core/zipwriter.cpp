@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "zipwriter.h"
+#include "errorhelper.h"
+
+#include <QDateTime>
+#include <algorithm>
+#include <zlib.h>
+
+static const uint32_t local_header_signature = 0x04034b50;
+static const uint32_t central_header_signature = 0x02014b50;
+static const uint32_t end_of_central_directory_signature = 0x06054b50;
+static const uint16_t version_needed = 20;	// deflate
+static const uint16_t method_stored = 0;
+static const uint16_t method_deflated = 8;
+
+// All numbers in zip files are little endian
+static void put16(std::string &s, uint16_t v)
+{
+	s += (char)(v & 0xff);
+	s += (char)(v >> 8);
+}
+
+static void put32(std::string &s, uint32_t v)
+{
+	put16(s, (uint16_t)(v & 0xffff));
+	put16(s, (uint16_t)(v >> 16));
+}
+
+ZipWriter::ZipWriter(QIODevice &out) : out(out), pos(0), ok(true)
+{
+	// All entries get the time the archive was created
+	QDateTime now = QDateTime::currentDateTime();
+	QDate date = now.date();
+	QTime time = now.time();
+	dosTime = (uint16_t)((time.hour() << 11) | (time.minute() << 5) | (time.second() / 2));
+	dosDate = (uint16_t)(((std::max(date.year(), 1980) - 1980) << 9) | (date.month() << 5) | date.day());
+}
+
+bool ZipWriter::write(const char *data, size_t size)
+{
+	if (!ok)
+		return false;
+	if (out.write(data, (qint64)size) != (qint64)size) {
+		report_info("zip writer: write error: %s", qPrintable(out.errorString()));
+		ok = false;
+		return false;
+	}
+	pos += size;
+	if (pos > UINT32_MAX) {
+		report_info("zip writer: archive exceeds 4 GB");
+		ok = false;
+		return false;
+	}
+	return true;
+}
+
+bool ZipWriter::add(const std::string &name, const char *data, size_t size)
+{
+	if (!ok || size > UINT32_MAX)
+		return ok = false;
+
+	// Raw deflate stream (negative window bits: no zlib header)
+	std::string compressed;
+	z_stream zs = {};
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return ok = false;
+	compressed.resize(deflateBound(&zs, (uLong)size));
+	zs.next_in = (Bytef *)data;
+	zs.avail_in = (uInt)size;
+	zs.next_out = (Bytef *)compressed.data();
+	zs.avail_out = (uInt)compressed.size();
+	int res = deflate(&zs, Z_FINISH);
+	compressed.resize(zs.total_out);
+	deflateEnd(&zs);
+	if (res != Z_STREAM_END)
+		return ok = false;
+
+	Entry entry;
+	entry.name = name;
+	entry.crc = (uint32_t)crc32(crc32(0, Z_NULL, 0), (const Bytef *)data, (uInt)size);
+	entry.size = (uint32_t)size;
+	entry.offset = (uint32_t)pos;
+	// Incompressible data is stored as is
+	bool store = compressed.size() >= size;
+	entry.method = store ? method_stored : method_deflated;
+	entry.compressedSize = store ? (uint32_t)size : (uint32_t)compressed.size();
+
+	std::string header;
+	put32(header, local_header_signature);
+	put16(header, version_needed);
+	put16(header, 0);			// flags
+	put16(header, entry.method);
+	put16(header, dosTime);
+	put16(header, dosDate);
+	put32(header, entry.crc);
+	put32(header, entry.compressedSize);
+	put32(header, entry.size);
+	put16(header, (uint16_t)name.size());
+	put16(header, 0);			// extra field length
+	header += name;
+	if (!write(header.data(), header.size()) ||
+	    !write(store ? data : compressed.data(), entry.compressedSize))
+		return false;
+	entries.push_back(std::move(entry));
+	return true;
+}
+
+bool ZipWriter::finish()
+{
+	if (!ok || entries.size() > UINT16_MAX)
+		return false;
+
+	std::string directory;
+	for (const Entry &entry: entries) {
+		put32(directory, central_header_signature);
+		put16(directory, version_needed);	// version made by
+		put16(directory, version_needed);
+		put16(directory, 0);			// flags
+		put16(directory, entry.method);
+		put16(directory, dosTime);
+		put16(directory, dosDate);
+		put32(directory, entry.crc);
+		put32(directory, entry.compressedSize);
+		put32(directory, entry.size);
+		put16(directory, (uint16_t)entry.name.size());
+		put16(directory, 0);			// extra field length
+		put16(directory, 0);			// comment length
+		put16(directory, 0);			// disk number
+		put16(directory, 0);			// internal attributes
+		put32(directory, 0);			// external attributes
+		put32(directory, entry.offset);
+		directory += entry.name;
+	}
+	uint32_t directoryOffset = (uint32_t)pos;
+	uint32_t directorySize = (uint32_t)directory.size();
+	put32(directory, end_of_central_directory_signature);
+	put16(directory, 0);				// disk number
+	put16(directory, 0);				// disk with the central directory
+	put16(directory, (uint16_t)entries.size());	// entries on this disk
+	put16(directory, (uint16_t)entries.size());
+	put32(directory, directorySize);
+	put32(directory, directoryOffset);
+	put16(directory, 0);				// comment length
+	return write(directory.data(), directory.size());
+}
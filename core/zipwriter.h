@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0
+// Writing of zip archives, one entry at a time.
+//
+// libzip keeps the data of all added entries until the archive is closed.
+// For exports of many dives, that is the whole export in memory. Here, each
+// entry is compressed and written when it is added, so only one entry has
+// to be kept in memory. Since the output is written strictly sequentially,
+// it can be a file as well as any sequential device. Only the data needed
+// for the central directory is kept until the archive is finished.
+// There is no support for zip64, i.e. the archive is limited to 4 GB.
+#ifndef ZIPWRITER_H
+#define ZIPWRITER_H
+
+#include <QIODevice>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ZipWriter {
+public:
+	ZipWriter(QIODevice &out);
+
+	// Returns false if the entry couldn't be written. Then,
+	// the archive can't be used and finish() will fail.
+	bool add(const std::string &name, const char *data, size_t size);
+	// Writes the central directory. Returns false on error.
+	bool finish();
+private:
+	struct Entry {
+		std::string name;
+		uint16_t method;
+		uint32_t crc;
+		uint32_t compressedSize;
+		uint32_t size;
+		uint32_t offset;
+	};
+	bool write(const char *data, size_t size);
+
+	QIODevice &out;
+	std::vector<Entry> entries;
+	uint16_t dosTime, dosDate;
+	qint64 pos;
+	bool ok;
+};
+
+#endif
@@ -1,9 +1,17 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "desktop-widgets/about.h"
+#include "core/perfcounters.h"
 #include "core/version.h"
+#include <QApplication>
+#include <QClipboard>
 #include <QDesktopServices>
+#include <QDialogButtonBox>
+#include <QFontDatabase>
+#include <QPlainTextEdit>
+#include <QPushButton>
 #include <QUrl>
 #include <QShortcut>
+#include <QVBoxLayout>
 
 SubsurfaceAbout::SubsurfaceAbout(QWidget *parent) : QDialog(parent, QFlag(0))
 {
@@ -44,3 +52,27 @@ void SubsurfaceAbout::on_creditButton_clicked()
 {
 	QDesktopServices::openUrl(QUrl("http://subsurface-divelog.org/credits/"));
 }
+
+// Show the performance counters, so that users can send them with bug reports.
+void SubsurfaceAbout::on_performanceButton_clicked()
+{
+	QDialog dialog(this);
+	dialog.setWindowTitle(tr("Performance counters"));
+	QVBoxLayout *layout = new QVBoxLayout(&dialog);
+	QPlainTextEdit *text = new QPlainTextEdit(&dialog);
+	text->setReadOnly(true);
+	text->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+	text->setPlainText(QString::fromStdString(perf_counters_text()));
+	layout->addWidget(text);
+
+	QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+	QPushButton *refresh = buttons->addButton(tr("Refresh"), QDialogButtonBox::ActionRole);
+	QPushButton *copy = buttons->addButton(tr("Copy as JSON"), QDialogButtonBox::ActionRole);
+	connect(refresh, &QPushButton::clicked, [text]() { text->setPlainText(QString::fromStdString(perf_counters_text())); });
+	connect(copy, &QPushButton::clicked, []() { QApplication::clipboard()->setText(QString::fromStdString(perf_counters_json())); });
+	connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+	layout->addWidget(buttons);
+
+	dialog.resize(400, 400);
+	dialog.exec();
+}
@@ -16,6 +16,7 @@ slots:
 	void on_contributeButton_clicked();
 	void on_websiteButton_clicked();
 	void on_creditButton_clicked();
+	void on_performanceButton_clicked();
 
 private:
 	Ui::SubsurfaceAbout ui;
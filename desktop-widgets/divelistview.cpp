@@ -18,9 +18,14 @@
 #include <QMessageBox>
 #include <QNetworkReply>
 #include <QHeaderView>
+#include <QApplication>
+#include <algorithm>
+#include <unordered_map>
 #include "commands/command.h"
 #include "commands/command_base.h"
 #include "core/errorhelper.h"
+#include "core/libdivecomputer.h"
+#include "core/picture.h"
 #include "core/qthelper.h"
 #include "core/range.h"
 #include "core/trip.h"
@@ -615,6 +620,13 @@ void DiveListView::renumberDives()
 	dialog.exec();
 }
 
+void DiveListView::reparseDives()
+{
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	Command::reparseDives(stdToQt<dive *>(getDiveSelection()));
+	QApplication::restoreOverrideCursor();
+}
+
 void DiveListView::merge_trip(const QModelIndex &a, int offset)
 {
 	int i = a.row() + offset;
@@ -778,6 +790,10 @@ void DiveListView::contextMenuEvent(QContextMenuEvent *event)
 	if (amount_selected >= 1) {
 		popup.addAction(tr("Add dive(s) to arbitrary trip","",amount_selected), this, &DiveListView::addDivesToTrip);
 		popup.addAction(tr("Renumber dive(s)","",amount_selected), this, &DiveListView::renumberDives);
+		std::vector<dive *> selection = getDiveSelection();
+		if (std::any_of(selection.begin(), selection.end(), [](const dive *d)
+				{ return std::any_of(d->dcs.begin(), d->dcs.end(), libdc_has_raw_dive); }))
+			popup.addAction(tr("Re-parse dive(s) from raw data","",amount_selected), this, &DiveListView::reparseDives);
 		popup.addAction(tr("Shift dive times"), this, &DiveListView::shiftTimes);
 		popup.addAction(tr("Split selected dives"), this, &DiveListView::splitDives);
 		popup.addAction(tr("Load media from file(s)"), this, &DiveListView::loadImages);
@@ -834,16 +850,18 @@ void DiveListView::matchImagesToDives(const QStringList &fileNames)
 
 	// Create the data structure of pictures to be added: a list of pictures per dive.
 	std::vector<Command::PictureListForAddition> pics;
+	std::unordered_map<const dive *, size_t> diveIdx; // index in pics
+	picture_matcher matcher;
 	for (const QString &fileName: fileNames) {
-		auto [pic, d] = create_picture(fileName.toStdString(), shiftDialog.amount(), shiftDialog.matchAll());
+		auto [pic, d] = create_picture(matcher, fileName.toStdString(), shiftDialog.amount(), shiftDialog.matchAll());
 		if (!pic)
 			continue;
 
-		auto it = std::find_if(pics.begin(), pics.end(), [dive=d](const Command::PictureListForAddition &l) { return l.d == dive; });
-		if (it == pics.end())
+		auto [it, inserted] = diveIdx.emplace(d, pics.size());
+		if (inserted)
 			pics.push_back(Command::PictureListForAddition { d, { std::move(*pic) } });
 		else
-			it->pics.push_back(std::move(*pic));
+			pics[it->second].pics.push_back(std::move(*pic));
 	}
 
 	if (pics.empty())
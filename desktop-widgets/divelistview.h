@@ -50,6 +50,7 @@ slots:
 	void mergeDives();
 	void splitDives();
 	void renumberDives();
+	void reparseDives();
 	void addDivesToTrip();
 	void shiftTimes();
 	void divesSelectedSlot(const QVector<QModelIndex> &indices, QModelIndex currentDive, int currentDC);
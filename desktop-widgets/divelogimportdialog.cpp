@@ -11,6 +11,13 @@
 #include <QUndoStack>
 #include <QPainter>
 #include <QFile>
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QProgressDialog>
+#include <QTimer>
+#include <QtConcurrent>
+#include <atomic>
+#include <functional>
 #include "core/filterpreset.h"
 #include "core/qthelper.h"
 #include "core/divesite.h"
@@ -423,6 +430,57 @@ static QPair<QString, QString> poseidonFileNames(const QString &fn)
 	}
 }
 
+// The preview only needs the start of the file, which is read once. Logger
+// CSV files may be hundreds of MB, so this never reads more than that.
+static const int previewMaxLines = 1000;
+static const qint64 previewMaxBytes = 4 * 1024 * 1024;
+
+void DiveLogImportDialog::readPreview(const QString &fileName)
+{
+	if (fileName == previewFileName)
+		return;
+	previewFileName = fileName;
+	previewLines.clear();
+	previewRows.clear();
+	previewStart = -1;
+
+	QFile f(fileName);
+	if (!f.open(QFile::ReadOnly))
+		return;
+	qint64 size = 0;
+	while (previewLines.size() < previewMaxLines && size < previewMaxBytes && !f.atEnd()) {
+		previewLines.append(f.readLine());
+		size += previewLines.last().size();
+	}
+}
+
+// Goes through the preview lines like through the file.
+class PreviewReader {
+public:
+	PreviewReader(const QList<QByteArray> &lines) : lines(lines), pos(0)
+	{
+	}
+	QByteArray readLine()
+	{
+		return pos < lines.size() ? lines[pos++] : QByteArray();
+	}
+	bool atEnd() const
+	{
+		return pos >= lines.size();
+	}
+	void reset()
+	{
+		pos = 0;
+	}
+	int line() const
+	{
+		return pos;
+	}
+private:
+	const QList<QByteArray> &lines;
+	int pos;
+};
+
 void DiveLogImportDialog::loadFileContents(int value, whatChanged triggeredBy)
 {
 	QList<QStringList> fileColumns;
@@ -461,8 +519,8 @@ void DiveLogImportDialog::loadFileContents(int value, whatChanged triggeredBy)
 		}
 	}
 
-	QFile f(fileName);
-	f.open(QFile::ReadOnly);
+	readPreview(fileName);
+	PreviewReader f(previewLines);
 	QString firstLine = f.readLine();
 	if (firstLine.contains("SEABEAR")) {
 		seabear = true;
@@ -786,18 +844,26 @@ void DiveLogImportDialog::loadFileContents(int value, whatChanged triggeredBy)
 		}
 	}
 
-	while (rows < 10 && !f.atEnd()) {
-		QString currLine = f.readLine().trimmed();
-		currColumns = currLine.split(separator);
-		// For Poseidon, read only columns where the second value is 8 (=depth)
-		if (poseidon) {
-			if (currColumns.size() < 3 || currColumns[1] != "8")
-				continue;
-			currColumns.removeAt(1);
+	// Only split the lines again if the separator or the first data line changed.
+	if (separator != previewSeparator || f.line() != previewStart || poseidon != previewPoseidon) {
+		previewSeparator = separator;
+		previewStart = f.line();
+		previewPoseidon = poseidon;
+		previewRows.clear();
+		while (previewRows.size() < 10 && !f.atEnd()) {
+			QString currLine = f.readLine().trimmed();
+			currColumns = currLine.split(separator);
+			// For Poseidon, read only columns where the second value is 8 (=depth)
+			if (poseidon) {
+				if (currColumns.size() < 3 || currColumns[1] != "8")
+					continue;
+				currColumns.removeAt(1);
+			}
+			previewRows.append(currColumns);
 		}
-		fileColumns.append(currColumns);
-		rows += 1;
 	}
+	fileColumns = previewRows;
+	rows = previewRows.size();
 
 	if (rows > 0)
 		resultModel->setColumnValues(std::move(fileColumns));
@@ -880,17 +946,53 @@ void DiveLogImportDialog::parseTxtHeader(QString fileName, xml_params &params)
 	xml_params_add(&params, "time", qPrintable(time));
 }
 
+// Parse the files on a worker thread, with a progress dialog. Returns false if canceled.
+static bool runImportJobs(const std::vector<std::function<void(struct divelog *)>> &jobs, struct divelog &log, QWidget *parent)
+{
+	QProgressDialog progress(DiveLogImportDialog::tr("Importing dives..."), DiveLogImportDialog::tr("Cancel"), 0, (int)jobs.size(), parent);
+	progress.setWindowModality(Qt::WindowModal);
+	progress.setMinimumDuration(500);
+
+	// A file can't be canceled halfway, but the remaining files are skipped.
+	std::atomic<int> done { 0 };
+	std::atomic<bool> canceled { false };
+	QFutureWatcher<void> watcher;
+	QEventLoop loop;
+	QTimer timer;
+	QObject::connect(&watcher, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+	QObject::connect(&timer, &QTimer::timeout, [&]() {
+		if (progress.wasCanceled())
+			canceled = true;
+		else
+			progress.setValue(done);
+	});
+	watcher.setFuture(QtConcurrent::run([&]() {
+		for (const auto &job: jobs) {
+			if (canceled)
+				return;
+			job(&log);
+			++done;
+		}
+	}));
+	timer.start(100);
+	loop.exec();
+	return !canceled;
+}
+
 void DiveLogImportDialog::on_buttonBox_accepted()
 {
-	struct divelog log;
+	// The parameters are collected here, the files are parsed in the background.
+	std::vector<std::function<void(struct divelog *)>> jobs;
 	QStringList r = resultModel->result();
 	if (ui->knownImports->currentText() != "Manual import") {
 		for (int i = 0; i < fileNames.size(); ++i) {
+			std::string filename = fileNames[i].toStdString();
 			if (ui->knownImports->currentText() == "Seabear CSV") {
-				parse_seabear_log(qPrintable(fileNames[i]), &log);
+				jobs.push_back([filename](struct divelog *log) { parse_seabear_log(filename.c_str(), log); });
 			} else if (ui->knownImports->currentText() == "Poseidon MkVI") {
 				QPair<QString, QString> pair = poseidonFileNames(fileNames[i]);
-				parse_txt_file(qPrintable(pair.second), qPrintable(pair.first), &log);
+				jobs.push_back([txt = pair.second.toStdString(), csv = pair.first.toStdString()](struct divelog *log)
+					       { parse_txt_file(txt.c_str(), csv.c_str(), log); });
 			} else {
 				xml_params params;
 
@@ -905,13 +1007,15 @@ void DiveLogImportDialog::on_buttonBox_accepted()
 					}
 				}
 				setup_csv_params(r, params);
-				parse_csv_file(qPrintable(fileNames[i]), &params,
-						specialCSV.contains(ui->knownImports->currentIndex()) ? qPrintable(CSVApps[ui->knownImports->currentIndex()].name) : "csv",
-						&log);
+				std::string csvtemplate = specialCSV.contains(ui->knownImports->currentIndex()) ?
+					CSVApps[ui->knownImports->currentIndex()].name.toStdString() : "csv";
+				jobs.push_back([filename, params, csvtemplate](struct divelog *log) mutable
+					       { parse_csv_file(filename.c_str(), &params, csvtemplate.c_str(), log); });
 			}
 		}
 	} else {
 		for (int i = 0; i < fileNames.size(); ++i) {
+			std::string filename = fileNames[i].toStdString();
 			if (r.indexOf(tr("Sample time")) < 0) {
 				xml_params params;
 				xml_params_add_int(&params, "numberField", r.indexOf(tr("Dive #")));
@@ -943,7 +1047,8 @@ void DiveLogImportDialog::on_buttonBox_accepted()
 				xml_params_add_int(&params, "visibilityField", r.indexOf(tr("Visibility")));
 				xml_params_add_int(&params, "ratingField", r.indexOf(tr("Rating")));
 
-				parse_manual_file(qPrintable(fileNames[i]), &params, &log);
+				jobs.push_back([filename, params](struct divelog *log) mutable
+					       { parse_manual_file(filename.c_str(), &params, log); });
 			} else {
 				xml_params params;
 
@@ -959,13 +1064,17 @@ void DiveLogImportDialog::on_buttonBox_accepted()
 
 				}
 				setup_csv_params(r, params);
-				parse_csv_file(qPrintable(fileNames[i]), &params,
-						specialCSV.contains(ui->knownImports->currentIndex()) ? qPrintable(CSVApps[ui->knownImports->currentIndex()].name) : "csv",
-						&log);
+				std::string csvtemplate = specialCSV.contains(ui->knownImports->currentIndex()) ?
+					CSVApps[ui->knownImports->currentIndex()].name.toStdString() : "csv";
+				jobs.push_back([filename, params, csvtemplate](struct divelog *log) mutable
+					       { parse_csv_file(filename.c_str(), &params, csvtemplate.c_str(), log); });
 			}
 		}
 	}
 
+	struct divelog log;
+	if (!runImportJobs(jobs, log, parentWidget()))
+		return;
 	QString source = fileNames.size() == 1 ? fileNames[0] : tr("multiple files");
 	Command::importDives(&log, import_flags::merge_all_trips, source);
 }
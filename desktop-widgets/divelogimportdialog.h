@@ -90,6 +90,7 @@ slots:
 	void loadFileContents(int value, enum whatChanged triggeredBy);
 	void setup_csv_params(QStringList r, xml_params &params);
 	void parseTxtHeader(QString fileName, xml_params &params);
+	void readPreview(const QString &fileName);
 
 private:
 	bool selector;
@@ -102,6 +103,14 @@ private:
 	QString hw;
 	bool txtLog;
 
+	// The start of the previewed file and its first rows, as split for the table
+	QString previewFileName;
+	QList<QByteArray> previewLines;
+	QList<QStringList> previewRows;
+	QString previewSeparator;
+	int previewStart = -1;
+	bool previewPoseidon = false;
+
 };
 
 class TagDragDelegate : public QStyledItemDelegate {
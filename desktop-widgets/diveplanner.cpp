@@ -21,6 +21,8 @@
 #include <QPrintDialog>
 #include <QPrinter>
 #include <QBuffer>
+#include <QTextCursor>
+#include <QTextDocument>
 #endif
 
 DivePlannerWidget::DivePlannerWidget(const dive &planned_dive, int &dcNr, PlannerWidgets *parent)
@@ -546,7 +548,27 @@ PlannerDetails::PlannerDetails(QWidget *parent) : QWidget(parent)
 
 void PlannerDetails::setPlanNotes(QString plan)
 {
+	// Laying out the notes again is what makes replanning slow, so only do it if they changed.
+	if (plan == shownPlan)
+		return;
+
+	// The notes are first shown with a placeholder for the variations, which
+	// are filled in when they were calculated. Replace only this text.
+	static const QString placeholder = QStringLiteral("VARIATIONS");
+	int pos = shownPlan.indexOf(placeholder);
+	int variationsSize = plan.size() - shownPlan.size() + placeholder.size();
+	if (pos >= 0 && variationsSize >= 0 && plan.left(pos) == shownPlan.left(pos) &&
+	    plan.endsWith(shownPlan.mid(pos + placeholder.size()))) {
+		QTextCursor cursor = ui.divePlanOutput->document()->find(placeholder);
+		if (!cursor.isNull()) {
+			cursor.insertText(plan.mid(pos, variationsSize));
+			shownPlan = plan;
+			return;
+		}
+	}
+
 	ui.divePlanOutput->setHtml(plan);
+	shownPlan = plan;
 }
 
 PlannerWidgets::PlannerWidgets() :
@@ -73,6 +73,7 @@ slots:
 
 private:
 	Ui::plannerDetails ui;
+	QString shownPlan;
 };
 
 // The planner widgets make up three quadrants
@@ -53,6 +53,8 @@ void DivesiteImportDialog::on_cancel_clicked()
 
 void DivesiteImportDialog::on_ok_clicked()
 {
+	divesiteImportedModel->stopGeoLookup();
+
 	// delete non-selected dive sites
 	dive_site_table selectedSites;
 	for (size_t i = 0; i < importedSites.size(); i++)  {
@@ -37,6 +37,8 @@ DownloadFromDCWidget::DownloadFromDCWidget(const QString &filename, QWidget *par
 #endif
 	currentState(INITIAL)
 {
+	// Normally filled after startup, but the user may have been quicker.
+	fill_computer_list();
 	diveImportedModel = new DiveImportedModel(this);
 	vendorModel.setStringList(vendorList);
 	QShortcut *close = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_W), this);
@@ -62,6 +64,7 @@ DownloadFromDCWidget::DownloadFromDCWidget(const QString &filename, QWidget *par
 	ui.search->setEnabled(is_vendor_searchable(ui.vendor->currentText()));
 	ui.product->setModel(&productModel);
 	ui.syncDiveComputerTime->setChecked(prefs.sync_dc_time);
+	ui.keepRawDives->setChecked(prefs.keep_raw_dives);
 
 	progress_bar_text.clear();
 
@@ -75,6 +78,7 @@ DownloadFromDCWidget::DownloadFromDCWidget(const QString &filename, QWidget *par
 	connect(ui.selectAllButton, SIGNAL(clicked()), diveImportedModel, SLOT(selectAll()));
 	connect(ui.unselectAllButton, SIGNAL(clicked()), diveImportedModel, SLOT(selectNone()));
 	connect(ui.syncDiveComputerTime, &QAbstractButton::toggled, qPrefDiveComputer::instance(), &qPrefDiveComputer::set_sync_dc_time);
+	connect(ui.keepRawDives, &QAbstractButton::toggled, qPrefDiveComputer::instance(), &qPrefDiveComputer::set_keep_raw_dives);
 	connect(timer, SIGNAL(timeout()), this, SLOT(updateProgressBar()));
 	connect(close, SIGNAL(activated()), this, SLOT(close()));
 	connect(quit, SIGNAL(activated()), parent, SLOT(close()));
@@ -218,13 +222,17 @@ void DownloadFromDCWidget::updateProgressBar()
 		if (!progress_bar_text.empty() && nearly_equal(progress_bar_fraction, 1.0))
 			progress_bar_text.clear();
 	}
+	// show the speed of the transfer, if the transport measures it
+	auto withRate = [this](const QString &text) {
+		return transfer_rate > 0.0 ? tr("%1 (%2 kB/s)").arg(text).arg(transfer_rate / 1000.0, 0, 'f', 1) : text;
+	};
 	if (!progress_bar_text.empty()) {
 		// once the progress bar text is set, setup the maximum so the user sees actual progress
-		ui.progressBar->setFormat(QString::fromStdString(progress_bar_text));
+		ui.progressBar->setFormat(withRate(QString::fromStdString(progress_bar_text)));
 		ui.progressBar->setMaximum(100);
 #if defined(Q_OS_MAC)
 		// on mac the progress bar doesn't show its text
-		ui.progressText->setText(QString::fromStdString(progress_bar_text));
+		ui.progressText->setText(withRate(QString::fromStdString(progress_bar_text)));
 #endif
 	} else {
 		if (nearly_0(progress_bar_fraction)) {
@@ -238,10 +246,10 @@ void DownloadFromDCWidget::updateProgressBar()
 		} else {
 			// we have some progress - reset the maximum so the user sees actual progress
 			ui.progressBar->setMaximum(100);
-			ui.progressBar->setFormat("%p%");
+			ui.progressBar->setFormat(withRate("%p%"));
 #if defined(Q_OS_MAC)
 			// on mac the progress bar doesn't show its text
-			ui.progressText->setText(QString("%1%").arg(lrint(progress_bar_fraction * 100)));
+			ui.progressText->setText(withRate(QString("%1%").arg(lrint(progress_bar_fraction * 100))));
 #endif
 		}
 	}
@@ -455,6 +463,7 @@ void DownloadFromDCWidget::on_downloadCancelRetryButton_clicked()
 	data->setSaveLog(ui.logToFile->isChecked());
 	data->setSaveDump(ui.dumpToFile->isChecked());
 	data->setSyncTime(ui.syncDiveComputerTime->isChecked());
+	data->setKeepRaw(ui.keepRawDives->isChecked());
 
 	qPrefDiveComputer::set_vendor(data->vendor());
 	qPrefDiveComputer::set_product(data->product());
@@ -613,6 +622,7 @@ void DownloadFromDCWidget::markChildrenAsDisabled()
 	ui.bluetoothMode->setEnabled(false);
 	ui.chooseBluetoothDevice->setEnabled(false);
 	ui.syncDiveComputerTime->setEnabled(false);
+	ui.keepRawDives->setEnabled(false);
 }
 
 void DownloadFromDCWidget::markChildrenAsEnabled()
@@ -637,6 +647,7 @@ void DownloadFromDCWidget::markChildrenAsEnabled()
 	ui.chooseBluetoothDevice->setEnabled(true);
 #endif
 	ui.syncDiveComputerTime->setEnabled(true);
+	ui.keepRawDives->setEnabled(true);
 }
 
 #if defined(BT_SUPPORT)
@@ -8,6 +8,8 @@
 #include "core/settings/qPrefUnit.h"
 #include "qt-models/filterpresetmodel.h"
 
+static const int fullTextDelay = 200; // in ms
+
 FilterWidget::FilterWidget(QWidget* parent) :
 	QWidget(parent),
 	ignoreSignal(false),
@@ -37,7 +39,11 @@ FilterWidget::FilterWidget(QWidget* parent) :
 
 	connect(ui.clear, &QToolButton::clicked, this, &FilterWidget::clearFilter);
 	connect(ui.close, &QToolButton::clicked, this, &FilterWidget::closeFilter);
-	connect(ui.fullText, &QLineEdit::textChanged, this, &FilterWidget::filterChanged);
+	// Don't refilter on every keystroke while the user is typing.
+	fullTextTimer.setSingleShot(true);
+	fullTextTimer.setInterval(fullTextDelay);
+	connect(ui.fullText, &QLineEdit::textChanged, &fullTextTimer, QOverload<>::of(&QTimer::start));
+	connect(&fullTextTimer, &QTimer::timeout, this, &FilterWidget::filterChanged);
 	connect(ui.fulltextStringMode, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &FilterWidget::filterChanged);
 	connect(ui.presetTable, &QTableView::clicked, this, &FilterWidget::presetClicked);
 	connect(ui.presetTable->selectionModel(), &QItemSelectionModel::selectionChanged, this, &FilterWidget::presetSelected);
@@ -211,6 +217,8 @@ void FilterWidget::updateFilter()
 	if (ignoreSignal)
 		return;
 
+	fullTextTimer.stop(); // The filter is up to date with the text
+
 	FilterData filterData = createFilterData();
 	DiveFilter::instance()->setFilter(filterData);
 	updatePresetLabel();
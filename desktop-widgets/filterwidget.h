@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <memory>
+#include <QTimer>
 
 #include "ui_filterwidget.h"
 #include "core/divefilter.h"
@@ -42,6 +43,7 @@ private:
 	bool presetModified;
 	Ui::FilterWidget ui;
 	FilterConstraintModel constraintModel;
+	QTimer fullTextTimer; // Delays the filtering while typing into the fulltext field
 	void addConstraint(filter_constraint_type type);
 	std::vector<std::unique_ptr<FilterConstraintWidget>> constraintWidgets;
 	FilterData createFilterData() const;
@@ -9,6 +9,7 @@
 
 #include <QFileDialog>
 #include <QtConcurrent>
+#include <numeric>
 
 FindMovedImagesDialog::FindMovedImagesDialog(QWidget *parent) : QDialog(parent)
 {
@@ -87,10 +88,10 @@ void FindMovedImagesDialog::learnImage(const QString &filename, QMap<QString, Im
 	}
 }
 
-// We use a stack to recurse into directories. Each level of the stack is made up of
-// a list of subdirectories to process. For each directory we keep track of the progress
-// that is done when processing this directory. In principle the from value is redundant
-// (it could be extracted from previous stack entries, but it makes code simpler.
+// The directories are scanned level by level. The directories of a level are
+// processed in parallel, since listing directories is mostly waiting for the
+// disk or the network. For each directory we keep track of the progress that
+// is done when processing this directory.
 struct Dir {
 	QString path;
 	double progressFrom, progressTo;
@@ -114,40 +115,64 @@ QVector<FindMovedImagesDialog::Match> FindMovedImagesDialog::learnImages(const Q
 	// Free memory of original path vector - we don't need it any more
 	imagePathsIn.clear();
 
-	QVector<QVector<Dir>> stack; // Use a stack to recurse into directories
-	stack.reserve(maxRecursions + 1);
-	stack.append({ { rootdir, 0.0, 1.0 } });
-	while (!stack.isEmpty()) {
-		if (stack.last().isEmpty()) {
-			stack.removeLast();
-			continue;
-		}
-		Dir entry = stack.last().takeLast();
-		QDir dir(entry.path);
-
-		// Since we're running in a different thread, use invokeMethod to set progress.
-		QMetaObject::invokeMethod(this, "setProgress", Q_ARG(double, entry.progressFrom), Q_ARG(QString, dir.absolutePath()));
+	// What was found in a directory: its subdirectories and the matches of its files.
+	struct ScannedDir {
+		QStringList subdirs;
+		QMap<QString, ImageMatch> matches;
+	};
 
-		for (const QString &file: dir.entryList(QDir::Files)) {
+	std::vector<Dir> level { { rootdir, 0.0, 1.0 } };
+	double progress = 0.0; // Sum of the progress of the directories without subdirectories
+	for (int depth = 0; !level.empty() && stopScanning == 0; ++depth) {
+		std::vector<ScannedDir> scanned(level.size());
+		std::vector<size_t> idx(level.size());
+		std::iota(idx.begin(), idx.end(), 0);
+		bool recurse = depth < maxRecursions;
+		QtConcurrent::blockingMap(idx, [&](size_t i) {
 			if (stopScanning != 0)
-				goto out;
-			learnImage(dir.absoluteFilePath(file), matches, imagePaths);
-		}
-		if (stack.size() <= maxRecursions) {
-			stack.append(QVector<Dir>());
-			QVector<Dir> &newItem = stack.last();
-			for (const QString &dirname: dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs))
-				stack.last().append({ dir.filePath(dirname), 0.0, 0.0 });
-			int num = newItem.size();
+				return;
+			QDir dir(level[i].path);
+
+			// Since we're running in a different thread, use invokeMethod to set progress.
+			QMetaObject::invokeMethod(this, "setProgress", Q_ARG(double, progress), Q_ARG(QString, dir.absolutePath()));
+
+			for (const QString &file: dir.entryList(QDir::Files)) {
+				if (stopScanning != 0)
+					return;
+				learnImage(dir.absoluteFilePath(file), scanned[i].matches, imagePaths);
+			}
+			if (recurse) {
+				for (const QString &dirname: dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs))
+					scanned[i].subdirs.append(dir.filePath(dirname));
+			}
+		});
+
+		// Merge the matches in the order of the directories, so that the result
+		// doesn't depend on the scheduling of the threads. Then, collect the next level.
+		std::vector<Dir> nextLevel;
+		for (size_t i = 0; i < level.size(); ++i) {
+			for (auto it = scanned[i].matches.begin(); it != scanned[i].matches.end(); ++it) {
+				auto it2 = matches.find(it.key());
+				if (it2 == matches.end())
+					matches.insert(it.key(), *it);
+				else if (it2->score < it->score)
+					*it2 = *it;
+			}
+
+			const Dir &entry = level[i];
+			int num = scanned[i].subdirs.size();
+			if (num == 0)
+				progress += entry.progressTo - entry.progressFrom;
 			double diff = entry.progressTo - entry.progressFrom;
-			// We pop from back therefore we fill the progress in reverse
-			for (int i = 0; i < num; ++i) {
-				newItem[num - i - 1].progressFrom = (i / (double)num) * diff + entry.progressFrom;
-				newItem[num - i - 1].progressTo = ((i + 1) / (double)num) * diff + entry.progressFrom;
+			for (int j = 0; j < num; ++j) {
+				nextLevel.push_back({ scanned[i].subdirs[j],
+						      (j / (double)num) * diff + entry.progressFrom,
+						      ((j + 1) / (double)num) * diff + entry.progressFrom });
 			}
 		}
+		level = std::move(nextLevel);
 	}
-out:
+
 	QMetaObject::invokeMethod(this, "setProgress", Q_ARG(double, 1.0), Q_ARG(QString, QString()));
 	QVector<FindMovedImagesDialog::Match> ret;
 	for (auto it = matches.begin(); it != matches.end(); ++it)
@@ -29,6 +29,15 @@ ImportGPS::ImportGPS(QWidget *parent, QString fileName, class Ui::LocationInform
 	pixmapSize = (int) (ui.diveDateLabel->height() / 2);
 }
 
+// Read the track once, the time controls only change how it is matched to the dive
+int ImportGPS::readFile()
+{
+	if (readGPXFile(track, fileName))
+		return 1;
+	getCoordsFromGPXTrack(&coords, track);
+	return 0;
+}
+
 void ImportGPS::buttonClicked(QAbstractButton *button)
 {
 	if (ui.GPSbuttonBox->buttonRole(button) == QDialogButtonBox::AcceptRole) {
@@ -109,7 +118,7 @@ void  ImportGPS::updateUI()
 void ImportGPS::changeZoneForward()
 {
 	coords.timeZone_offset = abs(coords.timeZone_offset);
-	getCoordsFromGPXFile(&coords, fileName); // If any of the time controls are changed
+	getCoordsFromGPXTrack(&coords, track); // If any of the time controls are changed
 	updateUI();          // .. then recalculate the synchronisation
 }
 
@@ -117,14 +126,14 @@ void ImportGPS::changeZoneBackwards()
 {
 	if (coords.timeZone_offset > 0)
 		coords.timeZone_offset = 0 - coords.timeZone_offset;
-	getCoordsFromGPXFile(&coords, fileName);
+	getCoordsFromGPXTrack(&coords, track);
 	updateUI();
 }
 
 void ImportGPS::changeDiffForward()
 {
 	coords.settingsDiff_offset = abs(coords.settingsDiff_offset);
-	getCoordsFromGPXFile(&coords, fileName);
+	getCoordsFromGPXTrack(&coords, track);
 	updateUI();
 }
 
@@ -132,7 +141,7 @@ void ImportGPS::changeDiffBackwards()
 {
 	if (coords.settingsDiff_offset > 0)
 		coords.settingsDiff_offset = 0 - coords.settingsDiff_offset;
-	getCoordsFromGPXFile(&coords, fileName);
+	getCoordsFromGPXTrack(&coords, track);
 	updateUI();
 }
 
@@ -141,7 +150,7 @@ void  ImportGPS::timeDiffEditChanged()
 	coords.settingsDiff_offset = ui.timeDiffEdit->time().hour() * 3600 + ui.timeDiffEdit->time().minute() * 60;
 	if (ui.diff_backwards->isChecked())
 		coords.settingsDiff_offset = 0 - coords.settingsDiff_offset;
-	getCoordsFromGPXFile(&coords, fileName);
+	getCoordsFromGPXTrack(&coords, track);
 	updateUI();
 }
 
@@ -150,6 +159,6 @@ void  ImportGPS::timeZoneEditChanged()
 	coords.timeZone_offset = ui.timeZoneEdit->time().hour() * 3600;
 	if (ui.timezone_backwards->isChecked())
 		coords.timeZone_offset = 0 - coords.timeZone_offset;
-	getCoordsFromGPXFile(&coords, fileName);
+	getCoordsFromGPXTrack(&coords, track);
 	updateUI();
 }
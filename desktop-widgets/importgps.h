@@ -14,6 +14,7 @@ public:
 	Ui::ImportGPS ui;
 	explicit ImportGPS(QWidget *parent, QString fileName, class Ui::LocationInformation *LocationUI);
 	struct dive_coords coords;
+	int readFile();
 	void updateUI();
 
 private
@@ -28,6 +29,7 @@ slots:
 
 private:
 	QString fileName;
+	gpx_track track;
 	class Ui::LocationInformation *LocationUI;
 	int pixmapSize;
 };
@@ -6,7 +6,10 @@
  */
 #include "mainwindow.h"
 
+#include <atomic>
+#include <QEventLoop>
 #include <QFileDialog>
+#include <QFutureWatcher>
 #include <QMessageBox>
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
 #include <QDesktopWidget>
@@ -14,11 +17,15 @@
 #include <QSettings>
 #include <QShortcut>
 #include <QStatusBar>
+#include <QThread>
+#include <QTimer>
 #include <QNetworkProxy>
 #include <QUndoStack>
 
+#include "core/changejournal.h"
 #include "core/color.h"
 #include "core/device.h"
+#include "core/cloudsync.h"
 #include "core/divelog.h"
 #include "core/divesitehelpers.h"
 #include "core/errorhelper.h"
@@ -30,6 +37,7 @@
 #include "core/qthelper.h"
 #include "core/selection.h"
 #include "core/subsurface-string.h"
+#include "core/subsurfacestartup.h"
 #include "core/trip.h"
 #include "core/version.h"
 #include "core/windowtitleupdate.h"
@@ -79,12 +87,17 @@
 
 namespace {
 	QProgressDialog *progressDialog = nullptr;
-	bool progressDialogCanceled = false;
+	std::atomic<bool> progressDialogCanceled = false;
 	int progressCounter = 0;
 }
 
 int updateProgress(const char *text)
 {
+	// Files are parsed on a worker thread, let the GUI thread update the dialog
+	if (QThread::currentThread() != qApp->thread()) {
+		QTimer::singleShot(0, qApp, [label = std::string(text)]() { updateProgress(label.c_str()); });
+		return progressDialogCanceled;
+	}
 	if (verbose)
 		report_info("git storage: %s", text);
 	if (progressDialog) {
@@ -113,6 +126,12 @@ static void showError(std::string err)
 	emit MainWindow::instance()->showError(QString::fromStdString(err));
 }
 
+// Called on the thread that reported the first error of a batch.
+static void errorsQueued()
+{
+	QMetaObject::invokeMethod(MainWindow::instance(), [] { flush_errors(); }, Qt::QueuedConnection);
+}
+
 MainWindow::MainWindow() :
 	appState((ApplicationState)-1), // Invalid state
 	actionNextDive(nullptr),
@@ -139,25 +158,16 @@ MainWindow::MainWindow() :
 #ifdef MAP_SUPPORT
 	mapWidget.reset(MapWidget::instance()); // Yes, this is ominous see comment in mapwidget.cpp.
 #endif
-	plannerWidgets.reset(new PlannerWidgets);
-	statistics.reset(new StatsWidget);
-	diveSites.reset(new DiveSiteListView);
 	profile.reset(new ProfileWidget);
 
 	diveSiteEdit.reset(new LocationInformationWidget);
 
 	registerApplicationState(ApplicationState::Default, { true, { mainTab.get(), FLAG_NONE },  { profile.get(), FLAG_NONE },
 								    { diveList.get(), FLAG_NONE }, { mapWidget.get(), FLAG_NONE } });
-	registerApplicationState(ApplicationState::PlanDive, { false, { &plannerWidgets->plannerWidget, FLAG_NONE },         { profile.get(), FLAG_NONE },
-								      { &plannerWidgets->plannerSettingsWidget, FLAG_NONE }, { &plannerWidgets->plannerDetails, FLAG_NONE } });
 	registerApplicationState(ApplicationState::EditDiveSite, { false, { diveSiteEdit.get(), FLAG_NONE }, { profile.get(), FLAG_DISABLED },
 									  { diveList.get(), FLAG_DISABLED }, { mapWidget.get(), FLAG_NONE } });
 	registerApplicationState(ApplicationState::FilterDive, { true, { mainTab.get(), FLAG_NONE },  { profile.get(), FLAG_NONE },
 								       { diveList.get(), FLAG_NONE }, { &filterWidget, FLAG_NONE } });
-	registerApplicationState(ApplicationState::Statistics, { true, { statistics.get(), FLAG_NONE }, { nullptr, FLAG_NONE },
-								       { diveList.get(), FLAG_DISABLED },   { &filterWidget, FLAG_NONE } });
-	registerApplicationState(ApplicationState::DiveSites, { false, { diveSites.get(), FLAG_NONE },  { profile.get(), FLAG_NONE },
-								       { diveList.get(), FLAG_NONE }, { mapWidget.get(), FLAG_NONE } });
 	registerApplicationState(ApplicationState::MapMaximized, { true, { nullptr, FLAG_NONE }, { nullptr, FLAG_NONE },
 									 { nullptr, FLAG_NONE }, { mapWidget.get(), FLAG_NONE } });
 	registerApplicationState(ApplicationState::ProfileMaximized, { true, { nullptr, FLAG_NONE }, { profile.get(), FLAG_NONE },
@@ -217,6 +227,32 @@ MainWindow::MainWindow() :
 	ui.menu_Edit->addActions({ undoAction, redoAction });
 
 #ifndef NO_PRINTING
+	// Not needed before the user prints: do it once the window is shown.
+	QTimer::singleShot(0, this, &MainWindow::setupPrintTemplates);
+#endif
+
+	setupSocialNetworkMenu();
+	set_git_update_cb(&updateProgress);
+	set_error_cb(&::showError);
+	set_error_notify_cb(&errorsQueued);
+
+	// Don't make the user wait for the cloud when saving
+	git_background_sync = true;
+	connect(CloudSync::instance(), &CloudSync::remoteChanges, this, &MainWindow::importRemoteChanges);
+	connect(CloudSync::instance(), &CloudSync::syncFinished, this, &MainWindow::updateCloudOnlineStatus);
+
+// full screen support is buggy on Windows and Ubuntu.
+// require the FULLSCREEN_SUPPORT macro to enable it!
+#ifndef FULLSCREEN_SUPPORT
+	ui.actionFullScreen->setEnabled(false);
+	ui.actionFullScreen->setVisible(false);
+	setWindowState(windowState() & ~Qt::WindowFullScreen);
+#endif
+}
+
+#ifndef NO_PRINTING
+void MainWindow::setupPrintTemplates()
+{
 	// copy the bundled print templates to the user path
 	QStringList templateBackupList;
 	QString templatePathUser(getPrintingTemplatePathUser());
@@ -236,20 +272,9 @@ MainWindow::MainWindow() :
 	}
 	set_bundled_templates_as_read_only();
 	find_all_templates();
-#endif
-
-	setupSocialNetworkMenu();
-	set_git_update_cb(&updateProgress);
-	set_error_cb(&::showError);
-
-// full screen support is buggy on Windows and Ubuntu.
-// require the FULLSCREEN_SUPPORT macro to enable it!
-#ifndef FULLSCREEN_SUPPORT
-	ui.actionFullScreen->setEnabled(false);
-	ui.actionFullScreen->setVisible(false);
-	setWindowState(windowState() & ~Qt::WindowFullScreen);
-#endif
+	startup_phase("print templates");
 }
+#endif
 
 static void clearSplitter(QSplitter &splitter)
 {
@@ -267,6 +292,7 @@ MainWindow::~MainWindow()
 	clearSplitter(*bottomSplitter);
 	clearSplitter(*ui.mainSplitter);
 	write_hashes();
+	set_error_notify_cb(nullptr);
 	m_Instance = nullptr;
 }
 
@@ -423,6 +449,7 @@ void MainWindow::on_actionCloudstorageopen_triggered()
 	hideProgressBar();
 	refreshDisplay();
 	updateAutogroup();
+	recoverChanges();
 }
 
 // Return whether saving to cloud is OK. If it isn't, show an error return false.
@@ -455,6 +482,7 @@ void MainWindow::on_actionCloudstoragesave_triggered()
 
 	setCurrentFile(*filename);
 	Command::setClean();
+	ChangeJournal::instance()->reset(existing_filename);
 }
 
 void MainWindow::on_actionCloudOnline_triggered()
@@ -511,6 +539,7 @@ void MainWindow::closeCurrentFile()
 {
 	/* free the dives and trips */
 	clear_git_id();
+	ChangeJournal::instance()->close(); // the user saved or dropped the changes
 	clear_dive_file_data(); // this clears all the core data structures and resets the models
 	setCurrentFile(std::string());
 	diveList->setSortOrder(DiveTripModelBase::NR, Qt::DescendingOrder);
@@ -1072,6 +1101,13 @@ void MainWindow::closeEvent(QCloseEvent *event)
 		event->ignore();
 		return;
 	}
+	// Let a background sync push the last save before quitting
+	if (CloudSync::instance()->busy()) {
+		QApplication::setOverrideCursor(Qt::WaitCursor);
+		CloudSync::instance()->waitForFinished();
+		QApplication::restoreOverrideCursor();
+	}
+	ChangeJournal::instance()->close();
 	event->accept();
 	writeSettings();
 	QApplication::closeAllWindows();
@@ -1214,6 +1250,7 @@ int MainWindow::file_save_as()
 
 	setCurrentFile(filename.toStdString());
 	Command::setClean();
+	ChangeJournal::instance()->reset(existing_filename);
 	addRecentFile(filename, true);
 	return 0;
 }
@@ -1247,6 +1284,7 @@ int MainWindow::file_save()
 	if (is_cloud)
 		hideProgressBar();
 	Command::setClean();
+	ChangeJournal::instance()->reset(existing_filename);
 	addRecentFile(QString::fromStdString(existing_filename), true);
 	return 0;
 }
@@ -1305,28 +1343,88 @@ void MainWindow::importFiles(const std::vector<std::string> &fileNames)
 	Command::importDives(&log, import_flags::merge_all_trips, source);
 }
 
+// The background sync merged changes from the cloud. Apply them to our dive
+// list (as undoable commands), so that the next save doesn't revert them.
+void MainWindow::importRemoteChanges()
+{
+	struct divelog log;
+	std::vector<dive *> removed;
+	CloudSync::instance()->takeRemoteChanges(existing_filename, log, removed);
+	if (log.dives.empty() && removed.empty())
+		return;
+	bool wasClean = Command::isClean();
+	applyChanges(log, removed, tr("cloud storage"));
+	// The imported state is what's in the local cache
+	if (wasClean) {
+		Command::setClean();
+		ChangeJournal::instance()->reset(existing_filename);
+	}
+}
+
+// Replace the removed dives by the dives of log, as undoable commands.
+void MainWindow::applyChanges(struct divelog &log, const std::vector<dive *> &removed, const QString &source)
+{
+	if (!removed.empty()) {
+		QVector<dive *> toDelete;
+		for (dive *d: removed)
+			toDelete.push_back(d);
+		Command::deleteDive(toDelete);
+	}
+	if (!log.dives.empty())
+		Command::importDives(&log, import_flags::prefer_imported | import_flags::merge_all_trips, source);
+}
+
+// Start the change journal of the loaded log. If the previous session
+// didn't end cleanly, offer to restore the changes that weren't saved.
+void MainWindow::recoverChanges()
+{
+	if (ChangeJournal::instance()->open(existing_filename) <= 0)
+		return;
+	struct divelog log;
+	std::vector<dive *> removed;
+	ChangeJournal::instance()->takeRecovered(log, removed);
+	if (QMessageBox::question(this, tr("Recover changes?"),
+				  tr("Subsurface was not closed properly and there are unsaved changes of %1.\n"
+				     "Do you want to restore them?").arg(displayedFilename(existing_filename)),
+				  QMessageBox::Yes | QMessageBox::No) != QMessageBox::Yes)
+		return;
+	applyChanges(log, removed, tr("recovered changes"));
+}
+
 void MainWindow::loadFiles(const std::vector<std::string> &fileNames)
 {
 	if (fileNames.empty()) {
 		refreshDisplay();
 		return;
 	}
-	QByteArray fileNamePtr;
+	std::vector<std::string> encoded;
+	for (const std::string &fn: fileNames)
+		encoded.push_back(encodeFileName(fn));
 
+	// Parse in the background and keep the event loop running meanwhile.
+	// The progress dialog is window-modal, so the dive list can't be
+	// changed under our feet.
+	struct divelog log;
+	QEventLoop loop;
+	QFutureWatcher<std::vector<std::string>> watcher;
+	connect(&watcher, &QFutureWatcher<std::vector<std::string>>::finished, &loop, &QEventLoop::quit);
 	showProgressBar();
-	for (const std::string &fn: fileNames) {
-		fileNamePtr = QFile::encodeName(QString::fromStdString(fn));
-		if (!parse_file(fileNamePtr.data(), &divelog)) {
-			setCurrentFile(fileNamePtr.toStdString());
-			addRecentFile(fileNamePtr, false);
-		}
-	}
+	watcher.setFuture(parse_files_async(std::move(encoded), &log));
+	if (!watcher.isFinished())
+		loop.exec();
 	hideProgressBar();
+
+	for (const std::string &fn: watcher.result()) {
+		setCurrentFile(fn);
+		addRecentFile(QString::fromStdString(fn), false);
+	}
 	updateRecentFiles();
-	divelog.process_loaded_dives();
+	divelog.process_loaded_log(log);
 
 	refreshDisplay();
 	updateAutogroup();
+	if (fileNames.size() == 1)
+		recoverChanges();
 
 	int min_datafile_version = get_min_datafile_version();
 	if (min_datafile_version >0 && min_datafile_version < dataformat_version) {
@@ -1453,6 +1551,37 @@ void MainWindow::registerApplicationState(ApplicationState state, Quadrants q)
 	applicationState[(int)state] = q;
 }
 
+// The widgets of the planner, the statistics and the dive site list are
+// only built when their state is entered for the first time.
+void MainWindow::createStateWidgets(ApplicationState state)
+{
+	switch (state) {
+	case ApplicationState::PlanDive:
+		if (plannerWidgets)
+			return;
+		plannerWidgets.reset(new PlannerWidgets);
+		registerApplicationState(ApplicationState::PlanDive, { false, { &plannerWidgets->plannerWidget, FLAG_NONE },         { profile.get(), FLAG_NONE },
+									      { &plannerWidgets->plannerSettingsWidget, FLAG_NONE }, { &plannerWidgets->plannerDetails, FLAG_NONE } });
+		break;
+	case ApplicationState::Statistics:
+		if (statistics)
+			return;
+		statistics.reset(new StatsWidget);
+		registerApplicationState(ApplicationState::Statistics, { true, { statistics.get(), FLAG_NONE }, { nullptr, FLAG_NONE },
+									       { diveList.get(), FLAG_DISABLED },   { &filterWidget, FLAG_NONE } });
+		break;
+	case ApplicationState::DiveSites:
+		if (diveSites)
+			return;
+		diveSites.reset(new DiveSiteListView);
+		registerApplicationState(ApplicationState::DiveSites, { false, { diveSites.get(), FLAG_NONE },  { profile.get(), FLAG_NONE },
+									       { diveList.get(), FLAG_NONE }, { mapWidget.get(), FLAG_NONE } });
+		break;
+	default:
+		break;
+	}
+}
+
 void MainWindow::setQuadrantWidget(QSplitter &splitter, const Quadrant &q, int pos)
 {
 	if (!q.widget)
@@ -1497,6 +1626,7 @@ void MainWindow::setApplicationState(ApplicationState state)
 	if (appState == state)
 		return;
 
+	createStateWidgets(state);
 	saveSplitterSizes();
 
 	appState = state;
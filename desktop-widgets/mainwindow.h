@@ -39,6 +39,7 @@ class PlannerWidgets;
 class ProfileWidget;
 class StatsWidget;
 class LocationInformationWidget;
+struct divelog;
 
 class MainWindow : public QMainWindow {
 	Q_OBJECT
@@ -184,6 +185,9 @@ private:
 	void closeCurrentFile();
 	void setCurrentFile(const std::string &f);
 	void updateCloudOnlineStatus();
+	void importRemoteChanges();
+	void applyChanges(struct divelog &log, const std::vector<dive *> &removed, const QString &source);
+	void recoverChanges();
 	void showProgressBar();
 	void hideProgressBar();
 	void writeSettings();
@@ -231,6 +235,8 @@ private:
 	void setQuadrantWidget(QSplitter &splitter, const Quadrant &q, int pos);
 	void setQuadrantWidgets(QSplitter &splitter, const Quadrant &left, const Quadrant &right);
 	void registerApplicationState(ApplicationState state, Quadrants q);
+	void createStateWidgets(ApplicationState state);
+	void setupPrintTemplates();
 	void disableShortcuts(bool disablePaste = true);
 	void enableShortcuts();
 
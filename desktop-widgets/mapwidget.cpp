@@ -2,11 +2,13 @@
 #include <QQmlContext>
 #include <QQuickItem>
 #include <QModelIndex>
+#include <QTimer>
 
 #include "mapwidget.h"
 #include "core/divesite.h"
 #include "core/errorhelper.h"
 #include "core/selection.h"
+#include "core/subsurfacestartup.h"
 #include "map-widget/qmlmapwidgethelper.h"
 #include "qt-models/maplocationmodel.h"
 #include "qt-models/divelocationmodel.h"
@@ -30,7 +32,15 @@ MapWidget::MapWidget(QWidget *parent) : QQuickWidget(parent)
 	connect(&diveListNotifier, &DiveListNotifier::divesChanged, this, &MapWidget::divesChanged);
 	connect(&diveListNotifier, &DiveListNotifier::dataReset, this, &MapWidget::reload);
 	connect(&diveListNotifier, &DiveListNotifier::settingsChanged, this, &MapWidget::reload);
-	setSource(urlMapWidget);
+}
+
+// Loading the QML (and creating the QML engine) is expensive.
+// Do it only when the map is shown, and after that frame was painted.
+void MapWidget::showEvent(QShowEvent *event)
+{
+	QQuickWidget::showEvent(event);
+	if (source().isEmpty())
+		QTimer::singleShot(0, this, [this] { if (source().isEmpty()) setSource(urlMapWidget); });
 }
 
 void MapWidget::doneLoading(QQuickWidget::Status status)
@@ -49,6 +59,13 @@ void MapWidget::doneLoading(QQuickWidget::Status status)
 	m_mapHelper = rootObject()->findChild<MapWidgetHelper *>();
 	connect(m_mapHelper, &MapWidgetHelper::selectedDivesChanged, this, &MapWidget::selectedDivesChanged);
 	connect(m_mapHelper, &MapWidgetHelper::coordinatesChanged, this, &MapWidget::coordinatesChanged);
+	startup_phase("map");
+
+	// The dives may have been loaded and selected before the map.
+	reload();
+	if (!pendingSelection.empty())
+		setSelected(std::move(pendingSelection));
+	pendingSelection.clear();
 }
 
 void MapWidget::centerOnDiveSite(struct dive_site *ds)
@@ -81,7 +98,10 @@ bool MapWidget::editMode() const
 
 void MapWidget::setSelected(std::vector<dive_site *> divesites)
 {
-	CHECK_IS_READY_RETURN_VOID();
+	if (!isReady) {
+		pendingSelection = std::move(divesites);
+		return;
+	}
 	m_mapHelper->setSelected(std::move(divesites));
 	m_mapHelper->centerOnSelectedDiveSite();
 }
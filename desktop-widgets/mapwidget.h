@@ -11,6 +11,7 @@
 #undef IGNORE
 
 class QResizeEvent;
+class QShowEvent;
 class QQuickItem;
 class MapWidgetHelper;
 
@@ -35,10 +36,14 @@ public slots:
 	void doneLoading(QQuickWidget::Status status);
 	void divesChanged(const QVector<dive *> &, DiveField field);
 
+protected:
+	void showEvent(QShowEvent *event) override;
+
 private:
 	static MapWidget *m_instance;
 	QQuickItem *m_rootItem;
 	MapWidgetHelper *m_mapHelper;
+	std::vector<dive_site *> pendingSelection; // selected before the QML was loaded
 };
 
 #endif // MAPWIDGET_H
@@ -15,6 +15,7 @@
 #include "preferences_reset.h"
 
 #include "core/qthelper.h"
+#include "core/settings/qPref.h"
 #include "core/subsurface-qt/divelistnotifier.h"
 
 #include <QVBoxLayout>
@@ -109,9 +110,14 @@ void PreferencesDialog::refreshPages()
 
 void PreferencesDialog::applyRequested(bool closeIt)
 {
-	for (AbstractPreferencesWidget *page: pages)
-		page->syncSettings();
-	emit diveListNotifier.settingsChanged();
+	{
+		// Write the settings of all pages at once and
+		// emit a single settingsChanged() at the end.
+		qPrefTransaction transaction;
+		qPrefTransaction::markChanged();
+		for (AbstractPreferencesWidget *page: pages)
+			page->syncSettings();
+	}
 	if (closeIt)
 		accept();
 }
@@ -117,7 +117,7 @@ PrintDialog::PrintDialog(dive *singleDive, const QString &filename, QWidget *par
 	QPushButton *exportHtmlButton = new QPushButton(tr("Export Html"));
 	connect(exportHtmlButton, SIGNAL(clicked(bool)), this, SLOT(exportHtmlClicked()));
 
-	QDialogButtonBox *buttonBox = new QDialogButtonBox;
+	buttonBox = new QDialogButtonBox;
 	buttonBox->addButton(QDialogButtonBox::Cancel);
 	buttonBox->addButton(printButton, QDialogButtonBox::AcceptRole);
 	buttonBox->addButton(previewButton, QDialogButtonBox::ActionRole);
@@ -184,6 +184,25 @@ void PrintDialog::createPrinterObj()
 	}
 }
 
+// While printing, only the cancel button is active. It stops the print job.
+void PrintDialog::setPrinting(bool printing)
+{
+	optionsWidget->setEnabled(!printing);
+	for (QAbstractButton *button: buttonBox->buttons()) {
+		if (buttonBox->buttonRole(button) != QDialogButtonBox::RejectRole)
+			button->setEnabled(!printing);
+	}
+}
+
+void PrintDialog::reject()
+{
+	if (printer && printer->isPrinting()) {
+		printer->cancel();
+		return;
+	}
+	QDialog::reject();
+}
+
 void PrintDialog::previewClicked()
 {
 	createPrinterObj();
@@ -218,7 +237,9 @@ void PrintDialog::printClicked()
 	QPrintDialog printDialog(qprinter, this);
 	if (printDialog.exec() == QDialog::Accepted) {
 		connect(printer, SIGNAL(progessUpdated(int)), progressBar, SLOT(setValue(int)));
+		setPrinting(true);
 		printer->print();
+		setPrinting(false);
 		close();
 	}
 }
@@ -10,6 +10,7 @@
 struct dive;
 class Printer;
 class QPrinter;
+class QDialogButtonBox;
 class QProgressBar;
 class PrintOptions;
 class PrintLayout;
@@ -23,11 +24,16 @@ public:
 	explicit PrintDialog(dive *singleDive, const QString &filename, QWidget *parent = 0);
 	~PrintDialog();
 
+public
+slots:
+	void reject() override;
+
 private:
 	dive *singleDive;
 	QString filename;
 	PrintOptions *optionsWidget;
 	QProgressBar *progressBar;
+	QDialogButtonBox *buttonBox;
 	Printer *printer;
 	QPrinter *qprinter;
 	struct print_options printOptions;
@@ -41,6 +47,7 @@ slots:
 	void printClicked();
 	void onPaintRequested(QPrinter *);
 	void createPrinterObj();
+	void setPrinting(bool printing);
 };
 #endif
 #endif // PRINTDIALOG_H
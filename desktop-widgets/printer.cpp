@@ -6,12 +6,16 @@
 #include "core/selection.h"
 #include "core/statistics.h"
 #include "core/qthelper.h"
+#include "core/profile.h"
 #include "profile-widget/profilescene.h"
 
 #include <algorithm>
+#include <map>
 #include <memory>
+#include <QCoreApplication>
 #include <QPainter>
 #include <QPrinter>
+#include <QtConcurrent>
 #include <QtWebKitWidgets>
 #include <QWebElementCollection>
 #include <QWebElement>
@@ -23,7 +27,9 @@ Printer::Printer(QPaintDevice *paintDevice, const print_options &printOptions, c
 	templateOptions(templateOptions),
 	printMode(printMode),
 	singleDive(singleDive),
-	done(0)
+	done(0),
+	printing(false),
+	cancelled(false)
 {
 }
 
@@ -33,14 +39,36 @@ Printer::~Printer()
 }
 
 void Printer::putProfileImage(const QRect &profilePlaceholder, const QRect &viewPort, QPainter *painter,
-			      struct dive *dive, ProfileScene *profile)
+			      struct dive *dive, const struct plot_info *pi, ProfileScene *profile)
 {
 	int x = profilePlaceholder.x() - viewPort.x();
 	int y = profilePlaceholder.y() - viewPort.y();
 	// use the placeHolder and the viewPort position to calculate the relative position of the dive profile.
 	QRect pos(x, y, profilePlaceholder.width(), profilePlaceholder.height());
 
-	profile->draw(painter, pos, dive, 0, nullptr, false);
+	profile->draw(painter, pos, dive, 0, nullptr, false, pi);
+}
+
+void Printer::cancel()
+{
+	cancelled = true;
+}
+
+bool Printer::isPrinting() const
+{
+	return printing;
+}
+
+// Called after each page: keeps the UI (progress bar, cancel button) alive.
+// If the user cancelled, the print job is aborted and true is returned.
+bool Printer::pageFinished()
+{
+	QCoreApplication::processEvents();
+	if (!cancelled)
+		return false;
+	if (printMode == Printer::PRINT)
+		static_cast<QPrinter*>(paintDevice)->abort();
+	return true;
 }
 
 void Printer::flowRender()
@@ -83,12 +111,11 @@ void Printer::flowRender()
 			emit(progessUpdated(lrint((end * 80.0 / fullPageResolution) + done)));
 
 			// add new pages only in print mode, while previewing we don't add new pages
-			if (printMode == Printer::PRINT) {
-				static_cast<QPrinter*>(paintDevice)->newPage();
-			} else {
+			if (printMode != Printer::PRINT || pageFinished()) {
 				painter.end();
 				return;
 			}
+			static_cast<QPrinter*>(paintDevice)->newPage();
 			start = dontbreakElement.geometry().y();
 		}
 	}
@@ -102,10 +129,41 @@ void Printer::flowRender()
 	painter.end();
 }
 
+// The number of profiles that are calculated at once
+static constexpr int profileBatchSize = 64;
+
 void Printer::render(int pages)
 {
 	// get all refereces to diveprofile class in the Html template
 	QWebElementCollection collection = webView->page()->mainFrame()->findAllElements(".diveprofile");
+	std::vector<dive *> profileDives;
+	for (QWebElement profileElement: collection) {
+		// dive id field should be dive_{{dive_no}} se we remove the first 5 characters
+		QString diveIdString = profileElement.attribute("id");
+		int diveId = diveIdString.remove(0, 5).toInt(0, 10);
+		profileDives.push_back(divelog.dives.get_by_uniq_id(diveId));
+	}
+
+	// The profiles are calculated in batches on the thread pool.
+	// While the pages of one batch are painted, the next one is calculated.
+	auto calculate = [&profileDives](int start) {
+		int end = std::min(start + profileBatchSize, (int)profileDives.size());
+		std::vector<const dive *> batch;
+		for (int i = start; i < end; i++) {
+			if (profileDives[i])
+				batch.push_back(profileDives[i]);
+		}
+		std::vector<plot_info> res = create_plot_infos(batch);
+		std::map<const dive *, plot_info> plotInfos;
+		for (size_t i = 0; i < batch.size(); i++)
+			plotInfos[batch[i]] = std::move(res[i]);
+		return plotInfos;
+	};
+	std::map<const dive *, plot_info> plotInfos;
+	QFuture<std::map<const dive *, plot_info>> next;
+	if (!profileDives.empty())
+		next = QtConcurrent::run(calculate, 0);
+	int batchEnd = 0;
 
 	// A "standard" profile has about 600 pixels in height.
 	// Scale the items in the printed profile accordingly.
@@ -127,10 +185,16 @@ void Printer::render(int pages)
 
 		// render all the dive profiles in the current page
 		while (elemNo < collection.count() && collection.at(elemNo).geometry().y() < viewPort.y() + viewPort.height()) {
-			// dive id field should be dive_{{dive_no}} se we remove the first 5 characters
-			QString diveIdString = collection.at(elemNo).attribute("id");
-			int diveId = diveIdString.remove(0, 5).toInt(0, 10);
-			putProfileImage(collection.at(elemNo).geometry(), viewPort, &painter, divelog.dives.get_by_uniq_id(diveId), profile.get());
+			if (elemNo >= batchEnd) {
+				plotInfos = next.result();
+				batchEnd = std::min(elemNo + profileBatchSize, collection.count());
+				if (batchEnd < collection.count())
+					next = QtConcurrent::run(calculate, batchEnd);
+			}
+			dive *d = profileDives[elemNo];
+			auto it = plotInfos.find(d);
+			putProfileImage(collection.at(elemNo).geometry(), viewPort, &painter, d,
+					it != plotInfos.end() ? &it->second : nullptr, profile.get());
 			elemNo++;
 		}
 
@@ -139,11 +203,17 @@ void Printer::render(int pages)
 		viewPort.adjust(0, pageSize.height(), 0, pageSize.height());
 
 		// rendering progress is 4/5 of total work
-		emit(progessUpdated(lrint((i * 80.0 / pages) + done)));
-		if (i < pages - 1 && printMode == Printer::PRINT)
+		emit(progessUpdated(lrint(((i + 1) * 80.0 / pages) + done)));
+		if (i < pages - 1 && printMode == Printer::PRINT) {
+			if (pageFinished())
+				break;
 			static_cast<QPrinter*>(paintDevice)->newPage();
+		}
 	}
 	painter.end();
+
+	// don't leave a calculation behind that refers to the dives
+	next.waitForFinished();
 }
 
 //value: ranges from 0 : 100 and shows the progress of the templating engine
@@ -185,7 +255,7 @@ QString Printer::exportHtml()
 void Printer::print()
 {
 	// we can only print if "PRINT" mode is selected
-	if (printMode != Printer::PRINT) {
+	if (printMode != Printer::PRINT || printing) {
 		return;
 	}
 
@@ -221,10 +291,13 @@ void Printer::print()
 		divesPerPage = 1; // print each dive in a single page if the attribute is missing or malformed
 		//TODO: show warning
 	}
+	printing = true;
+	cancelled = false;
 	if (divesPerPage == 0)
 		flowRender();
 	else
 		render((t.numDives - 1) / divesPerPage + 1);
+	printing = false;
 }
 
 void Printer::previewOnePage()
@@ -30,11 +30,14 @@ private:
 	PrintMode printMode;
 	struct dive *singleDive;
 	int done;
+	bool printing;
+	bool cancelled;
 	void render(int Pages);
+	bool pageFinished();
 	void flowRender();
 	std::vector<dive *> getDives() const;
 	void putProfileImage(const QRect &box, const QRect &viewPort, QPainter *painter,
-			     struct dive *dive, ProfileScene *profile);
+			     struct dive *dive, const struct plot_info *pi, ProfileScene *profile);
 
 private slots:
 	void templateProgessUpdated(int value);
@@ -47,6 +50,11 @@ public:
 	void print();
 	void previewOnePage();
 	QString exportHtml();
+	bool isPrinting() const;
+
+public slots:
+	// Stops printing after the current page.
+	void cancel();
 
 signals:
 	void progessUpdated(int value);
@@ -10,6 +10,8 @@
 #include <QDesktopServices>
 #include <QToolTip>
 #include <QCompleter>
+#include <QtConcurrent>
+#include <numeric>
 
 #include "core/file.h"
 #include "core/filterpreset.h"
@@ -180,10 +182,15 @@ ShiftImageTimesDialog::ShiftImageTimesDialog(QWidget *parent, QStringList fileNa
 	dcImageEpoch = (time_t)0;
 
 	// Get times of all files. 0 means that the time couldn't be determined.
+	// The files might be on a slow network share, so read them in parallel.
+	// The metadata is cached, therefore matching the pictures to the dives
+	// later on doesn't read the files again.
 	int numFiles = fileNames.size();
 	timestamps.resize(numFiles);
-	for (int i = 0; i < numFiles; ++i)
-		timestamps[i] = picture_get_timestamp(qPrintable(fileNames[i]));
+	timestamp_t *ts = timestamps.data();
+	std::vector<int> idx(numFiles);
+	std::iota(idx.begin(), idx.end(), 0);
+	QtConcurrent::blockingMap(idx, [ts, &fileNames](int i) { ts[i] = picture_get_timestamp(qPrintable(fileNames[i])); });
 	updateInvalid();
 }
 
@@ -219,8 +226,9 @@ void ShiftImageTimesDialog::updateInvalid()
 	ui.invalidFilesText->append(tr("\nFiles with inappropriate date/time") + ":");
 
 	int numFiles = fileNames.size();
+	picture_matcher matcher;
 	for (int i = 0; i < numFiles; ++i) {
-		if (picture_check_valid_time(timestamps[i], m_amount))
+		if (matcher.check_time(timestamps[i] + m_amount))
 			continue;
 
 		// We've found an invalid image
@@ -2,6 +2,8 @@
 #include <QDir>
 #include <QFile>
 #include <QFileDevice>
+#include <QFileInfo>
+#include <QHash>
 #include <QRegularExpression>
 #include <QTextStream>
 
@@ -96,6 +98,21 @@ TemplateLayout::TemplateLayout(const print_options &printOptions, const template
 {
 }
 
+// A node of a compiled template
+struct TemplateLayout::Node {
+	enum Type { TEXT, VARIABLE, FOR, IF };
+	enum List { YEARS, DIVES, CYLINDERS, CYLINDER_OBJECTS, UNKNOWN_LIST };
+	Type type;
+	QString text;		// TEXT: the text, FOR: name of the list
+	Accessor value;		// VARIABLE
+	List list;		// FOR
+	int divisor;		// IF: body is shown if the loop counter is divisible by this
+	Nodes body;		// FOR, IF
+	Node(Type type) : type(type), list(UNKNOWN_LIST), divisor(1)
+	{
+	}
+};
+
 QString TemplateLayout::generate(const std::vector<dive *> &dives)
 {
 	QString htmlContent;
@@ -105,13 +122,12 @@ QString TemplateLayout::generate(const std::vector<dive *> &dives)
 	for (dive *d: dives)
 		state.dives.append(d);
 
-	QString templateContents = readTemplate(printOptions.p_template);
+	std::shared_ptr<const Nodes> nodes = compiledTemplate(printOptions.p_template);
 	numDives = state.dives.size();
 
-	QList<token> tokens = lexer(templateContents);
 	QString buffer;
 	QTextStream out(&buffer);
-	parser(tokens, 0, tokens.size(), out, state);
+	run(*nodes, out, state);
 	htmlContent = out.readAll();
 	return htmlContent;
 }
@@ -130,16 +146,49 @@ QString TemplateLayout::generateStatistics()
 	}
 
 	QString templateFile = QString("statistics") + QDir::separator() + printOptions.p_template;
-	QString templateContents = readTemplate(templateFile);
+	std::shared_ptr<const Nodes> nodes = compiledTemplate(templateFile);
 
-	QList<token> tokens = lexer(templateContents);
 	QString buffer;
 	QTextStream out(&buffer);
-	parser(tokens, 0, tokens.size(), out, state);
+	run(*nodes, out, state);
 	htmlContent = out.readAll();
 	return htmlContent;
 }
 
+static QList<token> lexer(QString input);
+
+// Incremented when a template is written, in case the modification
+// time of the file doesn't change (coarse file system timestamps).
+static int templateWrites = 0;
+
+// Compiling the template means lexing it with regular expressions, resolving
+// the variables to accessors and matching the loops and conditions. That is
+// only done when the template file changed since it was last compiled.
+std::shared_ptr<const TemplateLayout::Nodes> TemplateLayout::compiledTemplate(const QString &template_name)
+{
+	struct Compiled {
+		QDateTime modified;
+		qint64 size;
+		int writes;
+		std::shared_ptr<const Nodes> nodes;
+	};
+	static QHash<QString, Compiled> cache;
+
+	QFileInfo info(getPrintingTemplatePathUser() + QDir::separator() + template_name);
+	QDateTime modified = info.lastModified();
+	qint64 size = info.size();
+	auto it = cache.find(template_name);
+	if (it != cache.end() && it->modified == modified && it->size == size && it->writes == templateWrites)
+		return it->nodes;
+
+	QList<token> tokens = lexer(readTemplate(template_name));
+	auto nodes = std::make_shared<Nodes>();
+	QMap<QString, QString> types;
+	compile(tokens, 0, tokens.size(), *nodes, types);
+	cache.insert(template_name, Compiled { modified, size, templateWrites, nodes });
+	return nodes;
+}
+
 QString TemplateLayout::readTemplate(QString template_name)
 {
 	QFile qfile(getPrintingTemplatePathUser() + QDir::separator() + template_name);
@@ -158,6 +207,7 @@ void TemplateLayout::writeTemplate(QString template_name, QString grantlee_templ
 		qfile.resize(qfile.pos());
 		qfile.close();
 	}
+	++templateWrites;
 }
 
 struct token stringToken(QString s)
@@ -223,7 +273,7 @@ struct token operatorToken(QString s)
 
 static QRegularExpression op(R"(\{%([\w\s\.\|\:]+)%\})");	// Look for {% stuff %}
 
-QList<token> TemplateLayout::lexer(QString input)
+static QList<token> lexer(QString input)
 {
 	QList<token> tokenList;
 
@@ -241,31 +291,40 @@ QList<token> TemplateLayout::lexer(QString input)
 
 static QRegularExpression var(R"(\{\{\s*(\w+)\.(\w+)\s*(\|\s*(\w+))?\s*\}\})");	// Look for {{ stuff.stuff|stuff }}
 
-QString TemplateLayout::translate(QString s, State &state)
+void TemplateLayout::addText(Nodes &nodes, const QString &text)
+{
+	nodes.emplace_back(Node::TEXT);
+	nodes.back().text = text;
+}
+
+void TemplateLayout::compileText(const QString &s, Nodes &nodes, const QMap<QString, QString> &types)
 {
-	QString out;
 	int last = 0;
 	QRegularExpressionMatch match = var.match(s);
 	while (match.hasMatch()) {
 		QString obname = match.captured(1);
 		QString memname = match.captured(2);
-		out +=  s.mid(last, match.capturedStart() - last);
-		QString listname = state.types.value(obname, obname);
-		QVariant value = getValue(listname, memname, state);
-		out += value.toString();
+		if (match.capturedStart() > last)
+			addText(nodes, s.mid(last, match.capturedStart() - last));
+		QString listname = types.value(obname, obname);
+		// Unknown variables are replaced by nothing
+		if (Accessor value = accessor(listname, memname)) {
+			nodes.emplace_back(Node::VARIABLE);
+			nodes.back().value = std::move(value);
+		}
 		last = match.capturedEnd();
 		match = var.match(s, last);
 	}
-	out += s.mid(last);
-	return out;
+	if (last < s.size())
+		addText(nodes, s.mid(last));
 }
 
 static QRegularExpression forloop(R"(\s*(\w+)\s+in\s+(\w+))");	// Look for "VAR in LISTNAME"
 static QRegularExpression ifstatement(R"(forloop\.counter\|\s*divisibleby\:\s*(\d+))");	// Look for forloop.counter|divisibleby: NUMBER
 
 template<typename V, typename T>
-void TemplateLayout::parser_for(QList<token> tokenList, int from, int to, QTextStream &out, State &state,
-				const V &data, const T *&act, bool emitProgress)
+void TemplateLayout::run_for(const Nodes &body, QTextStream &out, State &state,
+			     const V &data, const T *&act, bool emitProgress)
 {
 	const T *old = act;
 	int i = 1; // Loop iterators start at one
@@ -273,7 +332,7 @@ void TemplateLayout::parser_for(QList<token> tokenList, int from, int to, QTextS
 	for (auto &item: data) {
 		act = &item;
 		state.forloopiterator = i++;
-		parser(tokenList, from, to, out, state);
+		run(body, out, state);
 		if (emitProgress)
 			emit progressUpdated(state.forloopiterator * 100 / data.size());
 	}
@@ -309,12 +368,14 @@ static std::vector<const cylinder_t *> cylinderList(const dive *d)
 	return res;
 }
 
-void TemplateLayout::parser(QList<token> tokenList, int from, int to, QTextStream &out, State &state)
+// The variables in the text are resolved to the lists of the loops they are in.
+// Thus, the types map the loop variable to the name of the list.
+void TemplateLayout::compile(const QList<token> &tokenList, int from, int to, Nodes &nodes, QMap<QString, QString> &types)
 {
 	for (int pos = from; pos < to; ++pos) {
 		switch (tokenList[pos].type) {
 		case LITERAL:
-			out << translate(tokenList[pos].contents, state);
+			compileText(tokenList[pos].contents, nodes, types);
 			break;
 		case BLOCKSTART:
 		case BLOCKSTOP:
@@ -327,36 +388,25 @@ void TemplateLayout::parser(QList<token> tokenList, int from, int to, QTextStrea
 			if (match.hasMatch()) {
 				QString itemname = match.captured(1);
 				QString listname = match.captured(2);
-				state.types[itemname] = listname;
-				QString buffer;
-				QTextStream capture(&buffer);
+				types[itemname] = listname;
 				int loop_end = findEnd(tokenList, pos, to, FORSTART, FORSTOP);
 				if (loop_end < 0) {
-					out << "UNMATCHED FOR: '" << argument << "'";
+					addText(nodes, "UNMATCHED FOR: '" + argument + "'");
 					break;
 				}
-				if (listname == "years") {
-					parser_for(tokenList, pos, loop_end, capture, state, state.years, state.currentYear, true);
-				} else if (listname == "dives") {
-					parser_for(tokenList, pos, loop_end, capture, state, state.dives, state.currentDive, true);
-				} else if (listname == "cylinders") {
-					if (state.currentDive)
-						parser_for(tokenList, pos, loop_end, capture, state, formatCylinders(*state.currentDive), state.currentCylinder, false);
-					else
-						qWarning("cylinders loop outside of dive");
-				} else if (listname == "cylinderObjects") {
-					if (state.currentDive)
-						parser_for(tokenList, pos, loop_end, capture, state, cylinderList(*state.currentDive), state.currentCylinderObject, false);
-					else
-						qWarning("cylinderObjects loop outside of dive");
-				} else {
-					qWarning("unknown loop: %s", qPrintable(listname));
-				}
-				state.types.remove(itemname);
-				out << capture.readAll();
+				Node loop(Node::FOR);
+				loop.text = listname;
+				loop.list = listname == "years" ? Node::YEARS :
+					    listname == "dives" ? Node::DIVES :
+					    listname == "cylinders" ? Node::CYLINDERS :
+					    listname == "cylinderObjects" ? Node::CYLINDER_OBJECTS :
+									    Node::UNKNOWN_LIST;
+				compile(tokenList, pos, loop_end, loop.body, types);
+				types.remove(itemname);
+				nodes.push_back(std::move(loop));
 				pos = loop_end;
 			} else {
-				out << "PARSING ERROR: '" << argument << "'";
+				addText(nodes, "PARSING ERROR: '" + argument + "'");
 			}
 		}
 			break;
@@ -368,38 +418,102 @@ void TemplateLayout::parser(QList<token> tokenList, int from, int to, QTextStrea
 			if (match.hasMatch()) {
 				int if_end = findEnd(tokenList, pos, to, IFSTART, IFSTOP);
 				if (if_end < 0) {
-					out << "UNMATCHED IF: '" << argument << "'";
+					addText(nodes, "UNMATCHED IF: '" + argument + "'");
 					break;
 				}
-				int divisor = match.captured(1).toInt();
-				int counter = std::max(0, state.forloopiterator);
-				if (!(counter % divisor)) {
-					QString buffer;
-					QTextStream capture(&buffer);
-					parser(tokenList, pos, if_end, capture, state);
-					out << capture.readAll();
-				}
+				Node condition(Node::IF);
+				condition.divisor = match.captured(1).toInt();
+				compile(tokenList, pos, if_end, condition.body, types);
+				nodes.push_back(std::move(condition));
 				pos = if_end;
 			} else {
-				out << "PARSING ERROR: '" << argument << "'";
+				addText(nodes, "PARSING ERROR: '" + argument + "'");
 			}
 		}
 			break;
 		case FORSTOP:
 		case IFSTOP:
-			out << "UNEXPECTED END: " << tokenList[pos].contents;
+			addText(nodes, "UNEXPECTED END: " + tokenList[pos].contents);
 			return;
 		case PARSERERROR:
-			out << "PARSING ERROR";
+			addText(nodes, "PARSING ERROR");
+		}
+	}
+}
+
+void TemplateLayout::run(const Nodes &nodes, QTextStream &out, State &state)
+{
+	for (const Node &node: nodes) {
+		switch (node.type) {
+		case Node::TEXT:
+			out << node.text;
+			break;
+		case Node::VARIABLE:
+			out << node.value(*this, state).toString();
+			break;
+		case Node::FOR:
+			switch (node.list) {
+			case Node::YEARS:
+				run_for(node.body, out, state, state.years, state.currentYear, true);
+				break;
+			case Node::DIVES:
+				run_for(node.body, out, state, state.dives, state.currentDive, true);
+				break;
+			case Node::CYLINDERS:
+				if (state.currentDive)
+					run_for(node.body, out, state, formatCylinders(*state.currentDive), state.currentCylinder, false);
+				else
+					qWarning("cylinders loop outside of dive");
+				break;
+			case Node::CYLINDER_OBJECTS:
+				if (state.currentDive)
+					run_for(node.body, out, state, cylinderList(*state.currentDive), state.currentCylinderObject, false);
+				else
+					qWarning("cylinderObjects loop outside of dive");
+				break;
+			case Node::UNKNOWN_LIST:
+				qWarning("unknown loop: %s", qPrintable(node.text));
+				break;
+			}
+			break;
+		case Node::IF:
+		{
+			int counter = std::max(0, state.forloopiterator);
+			if (node.divisor > 0 && !(counter % node.divisor))
+				run(node.body, out, state);
+		}
+			break;
 		}
 	}
 }
 
-QVariant TemplateLayout::getValue(QString list, QString property, const State &state)
+// Accessors of the variables of the templates. The lookup by name
+// is done when compiling the template, not for every dive.
+TemplateLayout::Accessor TemplateLayout::accessor(const QString &list, const QString &property)
 {
-	if (list == "template_options") {
-		if (property == "font") {
-			switch (templateOptions.font_index) {
+	using DiveAccessor = QVariant (*)(const dive *);
+	using YearAccessor = QVariant (*)(const stats_t *);
+	using CylinderAccessor = QVariant (*)(const cylinder_t *);
+	using OptionsAccessor = QVariant (*)(const TemplateLayout &);
+	auto forDive = [](DiveAccessor f) -> Accessor {
+		return [f](const TemplateLayout &, const State &state)
+		       { return state.currentDive ? f(*state.currentDive) : QVariant(); };
+	};
+	auto forYear = [](YearAccessor f) -> Accessor {
+		return [f](const TemplateLayout &, const State &state)
+		       { return state.currentYear ? f(*state.currentYear) : QVariant(); };
+	};
+	auto forCylinder = [](CylinderAccessor f) -> Accessor {
+		return [f](const TemplateLayout &, const State &state)
+		       { return state.currentCylinderObject ? f(*state.currentCylinderObject) : QVariant(); };
+	};
+	auto forOptions = [](OptionsAccessor f) -> Accessor {
+		return [f](const TemplateLayout &t, const State &) { return f(t); };
+	};
+
+	static const QHash<QString, Accessor> accessors = {
+		{ "template_options.font", forOptions([](const TemplateLayout &t) -> QVariant {
+			switch (t.templateOptions.font_index) {
 			case 0:
 				return "Arial, Helvetica, sans-serif";
 			case 1:
@@ -411,179 +525,97 @@ QVariant TemplateLayout::getValue(QString list, QString property, const State &s
 			case 4:
 				return "Verdana, Geneva, sans-serif";
 			}
-		} else if (property == "borderwidth") {
-			return templateOptions.border_width;
-		} else if (property == "font_size") {
-			return templateOptions.font_size / 9.0;
-		} else if (property == "line_spacing") {
-			return templateOptions.line_spacing;
-		} else if (property == "color1") {
-			return templateOptions.color_palette.color1.name();
-		} else if (property == "color2") {
-			return templateOptions.color_palette.color2.name();
-		} else if (property == "color3") {
-			return templateOptions.color_palette.color3.name();
-		} else if (property == "color4") {
-			return templateOptions.color_palette.color4.name();
-		} else if (property == "color5") {
-			return templateOptions.color_palette.color5.name();
-		} else if (property == "color6") {
-			return templateOptions.color_palette.color6.name();
-		}
-	} else if (list ==  "print_options") {
-		if (property == "grayscale") {
-			if (printOptions.color_selected) {
-				return "";
-			} else {
-				return "-webkit-filter: grayscale(100%)";
-			}
-		}
-	} else if (list =="years") {
-		if (!state.currentYear)
 			return QVariant();
-		const stats_t *object = *state.currentYear;
-		if (property == "year") {
-			return object->period;
-		} else if (property == "dives") {
-			return object->selection_size;
-		} else if (property == "min_temp") {
+		}) },
+		{ "template_options.borderwidth", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.border_width; }) },
+		{ "template_options.font_size", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.font_size / 9.0; }) },
+		{ "template_options.line_spacing", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.line_spacing; }) },
+		{ "template_options.color1", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.color_palette.color1.name(); }) },
+		{ "template_options.color2", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.color_palette.color2.name(); }) },
+		{ "template_options.color3", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.color_palette.color3.name(); }) },
+		{ "template_options.color4", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.color_palette.color4.name(); }) },
+		{ "template_options.color5", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.color_palette.color5.name(); }) },
+		{ "template_options.color6", forOptions([](const TemplateLayout &t) -> QVariant { return t.templateOptions.color_palette.color6.name(); }) },
+		{ "print_options.grayscale", forOptions([](const TemplateLayout &t) -> QVariant {
+			return t.printOptions.color_selected ? "" : "-webkit-filter: grayscale(100%)";
+		}) },
+
+		{ "years.year", forYear([](const stats_t *object) -> QVariant { return object->period; }) },
+		{ "years.dives", forYear([](const stats_t *object) -> QVariant { return object->selection_size; }) },
+		{ "years.min_temp", forYear([](const stats_t *object) -> QVariant {
 			return object->min_temp.mkelvin == 0 ? "0" : get_temperature_string(object->min_temp, true);
-		} else if (property == "max_temp") {
+		}) },
+		{ "years.max_temp", forYear([](const stats_t *object) -> QVariant {
 			return object->max_temp.mkelvin == 0 ? "0" : get_temperature_string(object->max_temp, true);
-		} else if (property == "total_time") {
+		}) },
+		{ "years.total_time", forYear([](const stats_t *object) -> QVariant {
 			return get_dive_duration_string(object->total_time.seconds, gettextFromC::tr("h"),
 							gettextFromC::tr("min"), gettextFromC::tr("sec"), " ");
-		} else if (property == "avg_time") {
-			return formatMinutes(object->total_time.seconds / object->selection_size);
-		} else if (property == "shortest_time") {
-			return formatMinutes(object->shortest_time.seconds);
-		} else if (property == "longest_time") {
-			return formatMinutes(object->longest_time.seconds);
-		} else if (property == "avg_depth") {
-			return get_depth_string(object->avg_depth);
-		} else if (property == "min_depth") {
-			return get_depth_string(object->min_depth);
-		} else if (property == "max_depth") {
-			return get_depth_string(object->max_depth);
-		} else if (property == "avg_sac") {
-			return get_volume_string(object->avg_sac);
-		} else if (property == "min_sac") {
-			return get_volume_string(object->min_sac);
-		} else if (property == "max_sac") {
-			return get_volume_string(object->max_sac);
-		}
-	} else if (list == "cylinders") {
-		if (state.currentCylinder && property == "description") {
-			return *state.currentCylinder;
-		}
-	} else if (list == "cylinderObjects") {
-		if (!state.currentCylinderObject)
-			return QVariant();
-		const cylinder_t *cylinder = *state.currentCylinderObject;
-		if (property == "description") {
-			return QString::fromStdString(cylinder->type.description);
-		} else if (property == "size") {
-			return get_volume_string(cylinder->type.size, true);
-		} else if (property == "workingPressure") {
-			return get_pressure_string(cylinder->type.workingpressure, true);
-		} else if (property == "startPressure") {
-			return get_pressure_string(cylinder->start, true);
-		} else if (property == "endPressure") {
-			return get_pressure_string(cylinder->end, true);
-		} else if (property == "gasMix") {
-			return get_gas_string(cylinder->gasmix);
-                } else if (property == "gasO2") {
-                        return (get_o2(cylinder->gasmix) + 5) / 10;
-                } else if (property == "gasN2") {
-                        return (get_n2(cylinder->gasmix) + 5) / 10;
-                } else if (property == "gasHe") {
-                        return (get_he(cylinder->gasmix) + 5) / 10;
-		}
-	} else if (list == "dives") {
-		if (!state.currentDive)
-			return QVariant();
-		const dive *d = *state.currentDive;
-		if (property == "number") {
-			return d->number;
-		} else if (property == "id") {
-			return d->id;
-		} else if (property == "rating") {
-			return d->rating;
-		} else if (property == "visibility") {
-			return d->visibility;
-		} else if (property == "wavesize") {
-			return d->wavesize;
-		} else if (property == "current") {
-			return d->current;
-		} else if (property == "surge") {
-			return d->surge;
-		} else if (property == "chill") {
-			return d->chill;
-		} else if (property == "date") {
-			return formatDiveDate(d);
-		} else if (property == "time") {
-			return formatDiveTime(d);
-		} else if (property == "timestamp") {
-			return QVariant::fromValue(d->when);
-		} else if (property == "location") {
-			return QString::fromStdString(d->get_location());
-		} else if (property == "gps") {
-			return formatDiveGPS(d);
-		} else if (property == "gps_decimal") {
-			return format_gps_decimal(d);
-		} else if (property == "duration") {
-			return formatDiveDuration(d);
-		} else if (property == "noDive") {
-			return d->duration.seconds == 0 && d->dcs[0].duration.seconds == 0;
-		} else if (property == "depth") {
-			return get_depth_string(d->dcs[0].maxdepth.mm, true, true);
-		} else if (property == "meandepth") {
-			return get_depth_string(d->dcs[0].meandepth.mm, true, true);
-		} else if (property == "divemaster") {
-			return QString::fromStdString(d->diveguide);
-		} else if (property == "diveguide") {
-			return QString::fromStdString(d->diveguide);
-		} else if (property == "buddy") {
-			return QString::fromStdString(d->buddy);
-		} else if (property == "airTemp") {
-			return get_temperature_string(d->airtemp, true);
-		} else if (property == "waterTemp") {
-			return get_temperature_string(d->watertemp, true);
-		} else if (property == "notes") {
-			return formatNotes(d);
-		} else if (property == "tags") {
-			return QString::fromStdString(taglist_get_tagstring(d->tags));
-		} else if (property == "gas") {
-			return formatGas(d);
-		} else if (property == "sac") {
-			return formatSac(d);
-		} else if (property == "weightList") {
-			return formatWeightList(d);
-		} else if (property == "weights") {
-			return formatWeights(d);
-		} else if (property == "singleWeight") {
-			return d->weightsystems.size() <= 1;
-		} else if (property == "suit") {
-			return QString::fromStdString(d->suit);
-		} else if (property == "cylinderList") {
-			return formatFullCylinderList();
-		} else if (property == "cylinders") {
-			return formatCylinders(d);
-		} else if (property == "maxcns") {
-			return d->maxcns;
-		} else if (property == "otu") {
-			return d->otu;
-		} else if (property == "sumWeight") {
-			return formatSumWeight(d);
-		} else if (property == "getCylinder") {
-			return formatGetCylinder(d);
-		} else if (property == "startPressure") {
-			return formatStartPressure(d);
-		} else if (property == "endPressure") {
-			return formatEndPressure(d);
-		} else if (property == "firstGas") {
-			return formatFirstGas(d);
-		}
-	}
-	return QVariant();
+		}) },
+		{ "years.avg_time", forYear([](const stats_t *object) -> QVariant { return formatMinutes(object->total_time.seconds / object->selection_size); }) },
+		{ "years.shortest_time", forYear([](const stats_t *object) -> QVariant { return formatMinutes(object->shortest_time.seconds); }) },
+		{ "years.longest_time", forYear([](const stats_t *object) -> QVariant { return formatMinutes(object->longest_time.seconds); }) },
+		{ "years.avg_depth", forYear([](const stats_t *object) -> QVariant { return get_depth_string(object->avg_depth); }) },
+		{ "years.min_depth", forYear([](const stats_t *object) -> QVariant { return get_depth_string(object->min_depth); }) },
+		{ "years.max_depth", forYear([](const stats_t *object) -> QVariant { return get_depth_string(object->max_depth); }) },
+		{ "years.avg_sac", forYear([](const stats_t *object) -> QVariant { return get_volume_string(object->avg_sac); }) },
+		{ "years.min_sac", forYear([](const stats_t *object) -> QVariant { return get_volume_string(object->min_sac); }) },
+		{ "years.max_sac", forYear([](const stats_t *object) -> QVariant { return get_volume_string(object->max_sac); }) },
+
+		{ "cylinders.description", [](const TemplateLayout &, const State &state) -> QVariant {
+			return state.currentCylinder ? QVariant(*state.currentCylinder) : QVariant();
+		} },
+
+		{ "cylinderObjects.description", forCylinder([](const cylinder_t *cylinder) -> QVariant { return QString::fromStdString(cylinder->type.description); }) },
+		{ "cylinderObjects.size", forCylinder([](const cylinder_t *cylinder) -> QVariant { return get_volume_string(cylinder->type.size, true); }) },
+		{ "cylinderObjects.workingPressure", forCylinder([](const cylinder_t *cylinder) -> QVariant { return get_pressure_string(cylinder->type.workingpressure, true); }) },
+		{ "cylinderObjects.startPressure", forCylinder([](const cylinder_t *cylinder) -> QVariant { return get_pressure_string(cylinder->start, true); }) },
+		{ "cylinderObjects.endPressure", forCylinder([](const cylinder_t *cylinder) -> QVariant { return get_pressure_string(cylinder->end, true); }) },
+		{ "cylinderObjects.gasMix", forCylinder([](const cylinder_t *cylinder) -> QVariant { return get_gas_string(cylinder->gasmix); }) },
+		{ "cylinderObjects.gasO2", forCylinder([](const cylinder_t *cylinder) -> QVariant { return (get_o2(cylinder->gasmix) + 5) / 10; }) },
+		{ "cylinderObjects.gasN2", forCylinder([](const cylinder_t *cylinder) -> QVariant { return (get_n2(cylinder->gasmix) + 5) / 10; }) },
+		{ "cylinderObjects.gasHe", forCylinder([](const cylinder_t *cylinder) -> QVariant { return (get_he(cylinder->gasmix) + 5) / 10; }) },
+
+		{ "dives.number", forDive([](const dive *d) -> QVariant { return d->number; }) },
+		{ "dives.id", forDive([](const dive *d) -> QVariant { return d->id; }) },
+		{ "dives.rating", forDive([](const dive *d) -> QVariant { return d->rating; }) },
+		{ "dives.visibility", forDive([](const dive *d) -> QVariant { return d->visibility; }) },
+		{ "dives.wavesize", forDive([](const dive *d) -> QVariant { return d->wavesize; }) },
+		{ "dives.current", forDive([](const dive *d) -> QVariant { return d->current; }) },
+		{ "dives.surge", forDive([](const dive *d) -> QVariant { return d->surge; }) },
+		{ "dives.chill", forDive([](const dive *d) -> QVariant { return d->chill; }) },
+		{ "dives.date", forDive([](const dive *d) -> QVariant { return formatDiveDate(d); }) },
+		{ "dives.time", forDive([](const dive *d) -> QVariant { return formatDiveTime(d); }) },
+		{ "dives.timestamp", forDive([](const dive *d) -> QVariant { return QVariant::fromValue(d->when); }) },
+		{ "dives.location", forDive([](const dive *d) -> QVariant { return QString::fromStdString(d->get_location()); }) },
+		{ "dives.gps", forDive([](const dive *d) -> QVariant { return formatDiveGPS(d); }) },
+		{ "dives.gps_decimal", forDive([](const dive *d) -> QVariant { return format_gps_decimal(d); }) },
+		{ "dives.duration", forDive([](const dive *d) -> QVariant { return formatDiveDuration(d); }) },
+		{ "dives.noDive", forDive([](const dive *d) -> QVariant { return d->duration.seconds == 0 && d->dcs[0].duration.seconds == 0; }) },
+		{ "dives.depth", forDive([](const dive *d) -> QVariant { return get_depth_string(d->dcs[0].maxdepth.mm, true, true); }) },
+		{ "dives.meandepth", forDive([](const dive *d) -> QVariant { return get_depth_string(d->dcs[0].meandepth.mm, true, true); }) },
+		{ "dives.divemaster", forDive([](const dive *d) -> QVariant { return QString::fromStdString(d->diveguide); }) },
+		{ "dives.diveguide", forDive([](const dive *d) -> QVariant { return QString::fromStdString(d->diveguide); }) },
+		{ "dives.buddy", forDive([](const dive *d) -> QVariant { return QString::fromStdString(d->buddy); }) },
+		{ "dives.airTemp", forDive([](const dive *d) -> QVariant { return get_temperature_string(d->airtemp, true); }) },
+		{ "dives.waterTemp", forDive([](const dive *d) -> QVariant { return get_temperature_string(d->watertemp, true); }) },
+		{ "dives.notes", forDive([](const dive *d) -> QVariant { return formatNotes(d); }) },
+		{ "dives.tags", forDive([](const dive *d) -> QVariant { return QString::fromStdString(taglist_get_tagstring(d->tags)); }) },
+		{ "dives.gas", forDive([](const dive *d) -> QVariant { return formatGas(d); }) },
+		{ "dives.sac", forDive([](const dive *d) -> QVariant { return formatSac(d); }) },
+		{ "dives.weightList", forDive([](const dive *d) -> QVariant { return formatWeightList(d); }) },
+		{ "dives.weights", forDive([](const dive *d) -> QVariant { return formatWeights(d); }) },
+		{ "dives.singleWeight", forDive([](const dive *d) -> QVariant { return d->weightsystems.size() <= 1; }) },
+		{ "dives.suit", forDive([](const dive *d) -> QVariant { return QString::fromStdString(d->suit); }) },
+		{ "dives.cylinderList", forDive([](const dive *) -> QVariant { return formatFullCylinderList(); }) },
+		{ "dives.cylinders", forDive([](const dive *d) -> QVariant { return formatCylinders(d); }) },
+		{ "dives.maxcns", forDive([](const dive *d) -> QVariant { return d->maxcns; }) },
+		{ "dives.otu", forDive([](const dive *d) -> QVariant { return d->otu; }) },
+		{ "dives.sumWeight", forDive([](const dive *d) -> QVariant { return formatSumWeight(d); }) },
+		{ "dives.getCylinder", forDive([](const dive *d) -> QVariant { return formatGetCylinder(d); }) },
+		{ "dives.startPressure", forDive([](const dive *d) -> QVariant { return formatStartPressure(d); }) },
+		{ "dives.endPressure", forDive([](const dive *d) -> QVariant { return formatEndPressure(d); }) },
+		{ "dives.firstGas", forDive([](const dive *d) -> QVariant { return formatFirstGas(d); }) },
+	};
+	return accessors.value(list + '.' + property);
 }
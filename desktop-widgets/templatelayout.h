@@ -5,6 +5,9 @@
 #include "core/statistics.h"
 #include "core/equipment.h"
 #include <QStringList>
+#include <functional>
+#include <memory>
+#include <vector>
 
 struct print_options;
 struct template_options;
@@ -37,21 +40,26 @@ private:
 	struct State {
 		QList<const dive *> dives;
 		QList<stats_t *> years;
-		QMap<QString, QString> types;
 		int forloopiterator = -1;
 		const dive * const *currentDive = nullptr;
 		const stats_t * const *currentYear = nullptr;
 		const QString *currentCylinder = nullptr;
 		const cylinder_t * const *currentCylinderObject = nullptr;
 	};
+	// Templates are compiled into a tree of nodes, which is cached.
+	using Accessor = std::function<QVariant(const TemplateLayout &, const State &)>;
+	struct Node;
+	using Nodes = std::vector<Node>;
 	const print_options &printOptions;
 	const template_options &templateOptions;
-	QList<token> lexer(QString input);
-	void parser(QList<token> tokenList, int from, int to, QTextStream &out, State &state);
+	static std::shared_ptr<const Nodes> compiledTemplate(const QString &template_name);
+	static void compile(const QList<token> &tokenList, int from, int to, Nodes &nodes, QMap<QString, QString> &types);
+	static void compileText(const QString &s, Nodes &nodes, const QMap<QString, QString> &types);
+	static void addText(Nodes &nodes, const QString &text);
+	static Accessor accessor(const QString &list, const QString &property);
+	void run(const Nodes &nodes, QTextStream &out, State &state);
 	template<typename V, typename T>
-	void parser_for(QList<token> tokenList, int from, int to, QTextStream &out, State &state, const V &data, const T *&act, bool emitProgress);
-	QVariant getValue(QString list, QString property, const State &state);
-	QString translate(QString s, State &state);
+	void run_for(const Nodes &body, QTextStream &out, State &state, const V &data, const T *&act, bool emitProgress);
 
 signals:
 	void progressUpdated(int value);
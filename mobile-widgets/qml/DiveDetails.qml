@@ -392,6 +392,9 @@ Kirigami.Page {
 			clip: true
 			snapMode: ListView.SnapOneItem
 			highlightRangeMode: ListView.StrictlyEnforceRange
+			// keep the neighbors of the current dive instantiated, so
+			// that their profiles are rendered before they are swiped in
+			cacheBuffer: width
 			onMovementEnded: {
 				currentIndex = indexAt(contentX+1, 1);
 				manager.selectSwipeRow(currentIndex)
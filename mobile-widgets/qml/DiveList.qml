@@ -60,6 +60,8 @@ Kirigami.ScrollablePage {
 
 			// When clicked, a trip expands / unexpands, a dive is opened in DiveDetails
 			onClicked: {
+				if (diveListModel !== diveModel)
+					return // still showing the snapshot
 				view.currentIndex = index
 				if (isTrip) {
 					manager.appendTextToLog("clicked on trip " + tripTitle)
@@ -75,6 +77,8 @@ Kirigami.ScrollablePage {
 			}
 			// use this to select a dive without switching to dive details; instead open context drawer
 			onPressAndHold: {
+				if (diveListModel !== diveModel)
+					return
 				view.currentIndex = index
 				manager.appendTextToLog("press and hold on trip or dive; open context drawer")
 				manager.selectRow(model.row)
@@ -504,6 +508,13 @@ Kirigami.ScrollablePage {
 		}
 	}
 
+	function setDiveListModel(model) {
+		// the snapshot has the same rows as the collapsed list: keep the position
+		var y = diveListView.contentY
+		diveListModel = model
+		diveListView.contentY = y
+	}
+
 	function setCurrentDiveListIndex(idx, noScroll) {
 		// pick the dive in the dive list and make sure its trip is expanded
 		diveListView.currentIndex = idx
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0
+import QtQuick 2.6
+import QtQuick.Layouts 1.2
+import QtQuick.Controls 2.2
+import org.subsurfacedivelog.mobile 1.0
+import org.kde.kirigami 2.4 as Kirigami
+
+Kirigami.ScrollablePage {
+	id: perfCountersWindow
+	objectName: "PerfCounters"
+	title: qsTr("Performance counters")
+	background: Rectangle { color: subsurfaceTheme.backgroundColor }
+
+	// the counters keep changing - read them whenever the page is shown
+	onVisibleChanged: {
+		if (visible)
+			countersText.text = manager.perfCounters()
+	}
+
+	ColumnLayout {
+		width: perfCountersWindow.width - Kirigami.Units.gridUnit
+		Text {
+			id: countersText
+			Layout.fillWidth: true
+			wrapMode: Text.WrapAtWordBoundaryOrAnywhere
+			color: subsurfaceTheme.textColor
+			font.family: "monospace"
+			font.pointSize: subsurfaceTheme.smallPointSize
+			leftPadding: Kirigami.Units.gridUnit / 2
+		}
+		RowLayout {
+			TemplateButton {
+				text: qsTr("Refresh")
+				onClicked: countersText.text = manager.perfCounters()
+			}
+			TemplateButton {
+				text: qsTr("Copy as JSON")
+				onClicked: {
+					manager.copyPerfCountersToClipboard()
+					showPassiveNotification(qsTr("Counters copied to clipboard"), 3000)
+				}
+			}
+		}
+	}
+}
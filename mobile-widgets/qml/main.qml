@@ -530,6 +530,13 @@ if you have network connectivity and want to sync your data to cloud storage."),
 						showPage(logWindow)
 					}
 				}
+				Kirigami.Action {
+					text: qsTr("Performance counters")
+					onTriggered: {
+						globalDrawer.close()
+						showPage(perfCountersWindow)
+					}
+				}
 				Kirigami.Action {
 					text: qsTr("Test busy indicator (toggle)")
 					onTriggered: {
@@ -747,7 +754,7 @@ if you have network connectivity and want to sync your data to cloud storage."),
 			hideBusy()
 			manager.appendTextToLog("initialization completed - showing the dive list")
 			showPage(diveList) // we want to make sure that gets on the stack
-			diveList.diveListModel = diveModel
+			diveList.setDiveListModel(diveModel)
 
 			if (Qt.platform.os === "android") {
 				manager.appendTextToLog("if we got started by a plugged in device, switch to download page -- pluggedInDeviceName = " + pluggedInDeviceName)
@@ -759,9 +766,18 @@ if you have network connectivity and want to sync your data to cloud storage."),
 		}
 	}
 
+	// until the dives are loaded, show the snapshot of the last session
+	Component.onCompleted: {
+		if (snapshotModel.count > 0) {
+			manager.appendTextToLog("showing the dive list snapshot with " + snapshotModel.count + " entries")
+			diveList.diveListModel = snapshotModel
+			showPage(diveList)
+		}
+	}
+
 	Label {
 		id: textBlock
-		visible: !initialized
+		visible: !initialized && snapshotModel.count === 0
 		color: subsurfaceTheme.textColor
 		text: qsTr("Subsurface-mobile starting up")
 		font.pointSize: subsurfaceTheme.headingPointSize
@@ -842,6 +858,11 @@ if you have network connectivity and want to sync your data to cloud storage."),
 		visible: false
 	}
 
+	PerfCounters {
+		id: perfCountersWindow
+		visible: false
+	}
+
 	DownloadFromDiveComputer {
 		id: downloadFromDc
 		visible: false
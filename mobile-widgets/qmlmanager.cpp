@@ -16,6 +16,7 @@
 #include <QtConcurrent>
 #include <QFuture>
 #include <QUndoStack>
+#include <QQuickWindow>
 
 #include <QBluetoothLocalDevice>
 
@@ -37,6 +38,7 @@
 #include "core/subsurfacestartup.h" // for ignore_bt flag
 #include "core/subsurface-string.h"
 #include "core/string-format.h"
+#include "core/perfcounters.h"
 #include "core/pref.h"
 #include "core/sample.h"
 #include "core/selection.h"
@@ -74,6 +76,12 @@ static void showError(std::string s)
 	QMetaObject::invokeMethod(QMLManager::instance(), "registerError", Qt::AutoConnection, Q_ARG(QString, error));
 }
 
+// Called on the thread that reported the first error of a batch.
+static void errorsQueued()
+{
+	QMetaObject::invokeMethod(QMLManager::instance(), [] { flush_errors(); }, Qt::QueuedConnection);
+}
+
 // this gets called from libdivecomputer
 static void progressCallback(const std::string &text)
 {
@@ -271,6 +279,7 @@ QMLManager::QMLManager() :
 	}
 #endif
 	set_error_cb(&showError);
+	set_error_notify_cb(&errorsQueued);
 	uiNotificationCallback = showProgress;
 	appendTextToLog("Starting " + getUserAgent());
 	appendTextToLog(QStringLiteral("built with libdivecomputer v%1").arg(dc_version(NULL)));
@@ -329,6 +338,8 @@ QMLManager::QMLManager() :
 
 	// setup Command infrastructure
 	Command::init();
+	// Phones don't have memory to spare for long editing sessions
+	Command::setUndoMemoryLimit(64 * 1024 * 1024);
 	undoAction = Command::undoAction(this);
 
 	// get updates to the undo/redo texts
@@ -355,8 +366,24 @@ void QMLManager::applicationStateChanged(Qt::ApplicationState state)
 	if (state == Qt::ApplicationActive && !m_initialized && !initializeOnce) {
 		// once the app UI is displayed, finish our setup and mark the app as initialized
 		initializeOnce = true;
-		finishSetup();
-		appInitialized();
+		QQuickWindow *window = qobject_cast<QQuickWindow *>(qmlWindow);
+		if (window && MobileModels::instance()->snapshotModel()->count() > 0) {
+			// Loading the dives blocks the UI thread. Let the snapshot
+			// of the dive list be drawn first.
+			appendTextToLog("show dive list snapshot while loading");
+			auto conn = std::make_shared<QMetaObject::Connection>();
+			*conn = connect(window, &QQuickWindow::frameSwapped, this, [this, conn]() {
+				if (!disconnect(*conn))
+					return;
+				finishSetup();
+				appInitialized();
+				MobileModels::instance()->snapshotModel()->clear();
+			}, Qt::QueuedConnection);
+			window->update();
+		} else {
+			finishSetup();
+			appInitialized();
+		}
 	}
 	if (state == Qt::ApplicationInactive && unsavedChanges()) {
 		// saveChangesCloud ensures that we don't have two conflicting saves going on
@@ -416,6 +443,7 @@ void QMLManager::openLocalThenRemote(QString url)
 		// the following steps can take a long time, so provide updates
 		setNotificationText(tr("Processing %1 dives").arg(divelog.dives.size()));
 		divelog.process_loaded_dives();
+		saveListSnapshot();
 		setNotificationText(tr("%1 dives loaded from local dive data file").arg(divelog.dives.size()));
 	}
 	if (qPrefCloudStorage::cloud_verification_status() == qPrefCloudStorage::CS_NEED_TO_VERIFY) {
@@ -489,6 +517,16 @@ void QMLManager::copyAppLogToClipboard()
 	QApplication::clipboard()->setText(getCombinedLogs(), QClipboard::Clipboard);
 }
 
+QString QMLManager::perfCounters()
+{
+	return QString::fromStdString(perf_counters_text());
+}
+
+void QMLManager::copyPerfCountersToClipboard()
+{
+	QApplication::clipboard()->setText(QString::fromStdString(perf_counters_json()), QClipboard::Clipboard);
+}
+
 bool QMLManager::createSupportEmail()
 {
 	QString messageBody = "Please describe your issue here and keep the logs below:\n\n\n\n";
@@ -544,6 +582,9 @@ QString QMLManager::getCombinedLogs()
 		copyString += in.readAll();
 	}
 
+	copyString += "\n\n\n---------- performance counters ----------\n";
+	copyString += QString::fromStdString(perf_counters_json());
+
 	copyString += "---------- finish ----------\n";
 
 #if defined(Q_OS_ANDROID)
@@ -618,6 +659,7 @@ QMLManager::~QMLManager()
 	if (appLogFileOpen)
 		appLogFile.close();
 #endif
+	set_error_notify_cb(nullptr);
 	m_instance = NULL;
 }
 
@@ -805,10 +847,17 @@ void QMLManager::loadDivesWithValidCredentials()
 		}
 		if (info.repo) {
 			appendTextToLog(QString("have repository and branch %1").arg(info.branch.c_str()));
+			// on mobile only few profiles are ever looked at - parse the samples on demand
+			info.lazy_samples = true;
 			error = git_load_dives(&info, &divelog);
 		} else {
 			appendTextToLog(QString("didn't receive valid git repo, try again"));
 			error = parse_file(fileNamePrt.data(), &divelog);
+			// likewise, keep the samples packed until a profile is shown
+			if (!error) {
+				for (auto &d: divelog.dives)
+					d->compact_samples();
+			}
 		}
 		setDiveListProcessing(false);
 		if (!error) {
@@ -893,11 +942,23 @@ void QMLManager::consumeFinishedLoad()
 	prefs.show_ccr_sensors = git_prefs.show_ccr_sensors;
 	prefs.pp_graphs.po2 = git_prefs.pp_graphs.po2;
 	divelog.process_loaded_dives();
+	saveListSnapshot();
 	appendTextToLog(QStringLiteral("%1 dives loaded").arg(divelog.dives.size()));
 	if (divelog.dives.empty())
 		setStartPageText(tr("Cloud storage open successfully. No dives in dive list."));
 }
 
+// The snapshot belongs to the account it was made of.
+QString QMLManager::snapshotKey()
+{
+	return qPrefCloudStorage::cloud_storage_email();
+}
+
+void QMLManager::saveListSnapshot()
+{
+	MobileModels::instance()->saveSnapshot(snapshotKey());
+}
+
 void QMLManager::refreshDiveList()
 {
 	MobileModels::instance()->invalidate();
@@ -1553,6 +1614,7 @@ void QMLManager::saveChangesLocal()
 		mark_divelist_changed(false);
 		Command::setClean();
 		updateHaveLocalChanges(true);
+		saveListSnapshot();
 	} else {
 		appendTextToLog("local save requested with no unsaved changes");
 	}
@@ -1585,13 +1647,13 @@ void QMLManager::saveChangesCloud(bool forceRemoteSync)
 
 void QMLManager::undo()
 {
-	Command::getUndoStack()->undo();
+	Command::undo();
 	changesNeedSaving(true);
 }
 
 void QMLManager::redo()
 {
-	Command::getUndoStack()->redo();
+	Command::redo();
 	changesNeedSaving();
 }
 
@@ -128,6 +128,7 @@ public:
 	Q_INVOKABLE void importCacheRepo(QString repo);
 
 	static QMLManager *instance();
+	static QString snapshotKey();
 	Q_INVOKABLE void registerError(QString error);
 	QString consumeError();
 
@@ -204,6 +205,8 @@ public slots:
 	void cancelDownloadDC();
 	QString getCombinedLogs();
 	void copyAppLogToClipboard();
+	QString perfCounters();
+	void copyPerfCountersToClipboard();
 	bool createSupportEmail();
 	void finishSetup();
 	QString getNumber(const QString& diveId);
@@ -272,6 +275,7 @@ private:
 	void loadDivesWithValidCredentials();
 	void revertToNoCloudIfNeeded();
 	void consumeFinishedLoad();
+	void saveListSnapshot();
 	void mergeLocalRepo();
 	void openLocalThenRemote(QString url);
 	void saveChangesLocal();
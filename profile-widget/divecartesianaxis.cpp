@@ -249,8 +249,11 @@ void DiveCartesianAxis::updateLabel(Label &label, double opacityEnd, double pos)
 		// For the time-axis, the format might change from "mm" to "mm:ss",
 		// or vice versa. Currently, we don't animate that, i.e. it will
 		// switch instantaneously.
-		if (position == Position::Bottom)
-			label.label->set(textForValue(label.value), textColor);
+		if (position == Position::Bottom) {
+			QString text = textForValue(label.value);
+			if (label.label->text() != text)
+				label.label->set(text, textColor);
+		}
 	}
 	if (label.line) {
 		label.lineStart = label.line->line();
@@ -265,10 +268,7 @@ DiveCartesianAxis::Label DiveCartesianAxis::createLabel(double value, double pos
 	if (textVisibility && !noLabel) {
 		label.labelPosStart = labelPos(posStart);
 		label.labelPosEnd = labelPos(pos);
-		int alignFlags = position == Position::Bottom ? Qt::AlignTop | Qt::AlignHCenter :
-				 position == Position::Left   ? Qt::AlignVCenter | Qt::AlignLeft:
-								Qt::AlignVCenter | Qt::AlignRight;
-		label.label = std::make_unique<DiveTextItem>(dpr, labelScale, alignFlags, this);
+		label.label = std::make_unique<DiveTextItem>(dpr, labelScale, labelAlignFlags(), this);
 		label.label->set(textForValue(value), textColor);
 		label.label->setZValue(1);
 		label.label->setPos(animSpeed <= 0 ? label.labelPosEnd : label.labelPosStart);
@@ -286,11 +286,97 @@ DiveCartesianAxis::Label DiveCartesianAxis::createLabel(double value, double pos
 	return label;
 }
 
+int DiveCartesianAxis::labelAlignFlags() const
+{
+	return position == Position::Bottom ? Qt::AlignTop | Qt::AlignHCenter :
+	       position == Position::Left   ? Qt::AlignVCenter | Qt::AlignLeft:
+					      Qt::AlignVCenter | Qt::AlignRight;
+}
+
+// Put a label, possibly with items of a label that is not needed anymore,
+// at its final position. Only what changed is touched.
+void DiveCartesianAxis::placeLabel(Label &label, double value, double pos, bool noLabel)
+{
+	label.value = value;
+	label.opacityStart = label.opacityEnd = 1.0;
+	if (textVisibility && !noLabel) {
+		if (!label.label) {
+			label.label = std::make_unique<DiveTextItem>(dpr, labelScale, labelAlignFlags(), this);
+			label.label->setZValue(1);
+		}
+		QString text = textForValue(value);
+		if (label.label->text() != text)
+			label.label->set(text, textColor);
+		label.labelPosStart = label.labelPosEnd = labelPos(pos);
+		label.label->setPos(label.labelPosEnd);
+		label.label->setOpacity(1.0);
+	} else {
+		label.label.reset();
+	}
+	if (lineVisibility) {
+		if (!label.line) {
+			label.line = std::make_unique<DiveLineItem>(this);
+			label.line->setPen(gridPen);
+			label.line->setZValue(0);
+		}
+		label.lineStart = label.lineEnd = linePos(pos);
+		label.line->setLine(label.lineEnd);
+		label.line->setOpacity(1.0);
+	} else {
+		label.line.reset();
+	}
+}
+
+// Without animation, the labels and lines are reused: the ones that keep
+// their value are only moved, the items of the others get the new values.
+// Thus, zooming and switching dives doesn't recreate the items.
+void DiveCartesianAxis::updateLabelsInstant(int numTicks, double firstPosScreen, double firstValue, double stepScreen, double stepValue)
+{
+	std::vector<Label> newLabels(numTicks);
+	std::vector<Label> unused;
+	std::vector<int> missing;
+	auto actOld = labels.begin();
+	double value = firstValue;
+
+	for (int i = 0; i < numTicks; i++, value += stepValue) {
+		for ( ; actOld != labels.end() && actOld->value < value; ++actOld)
+			unused.push_back(std::move(*actOld));
+		if (actOld != labels.end() && actOld->value == value) {
+			newLabels[i] = std::move(*actOld);
+			++actOld;
+		} else {
+			missing.push_back(i);
+		}
+	}
+	for ( ; actOld != labels.end(); ++actOld)
+		unused.push_back(std::move(*actOld));
+
+	for (int i: missing) {
+		if (!unused.empty()) {
+			newLabels[i] = std::move(unused.back());
+			unused.pop_back();
+		}
+	}
+
+	value = firstValue;
+	for (int i = 0; i < numTicks; i++, value += stepValue) {
+		double pos = ((position == Position::Bottom) != inverted) ?
+					 firstPosScreen + i * stepScreen :
+					 firstPosScreen - i * stepScreen;
+		// For the depth axis, we don't want to show the first label (0). See updateLabels().
+		placeLabel(newLabels[i], value, pos, inverted && i == 0);
+	}
+
+	labels = std::move(newLabels);
+}
+
 void DiveCartesianAxis::updateLabels(int numTicks, double firstPosScreen, double firstValue, double stepScreen, double stepValue,
 				     int animSpeed, double dataMinOld, double dataMaxOld)
 {
-	if (animSpeed <= 0)
-		labels.clear(); // No animation? Simply redo the labels.
+	if (animSpeed <= 0) {
+		updateLabelsInstant(numTicks, firstPosScreen, firstValue, stepScreen, stepValue);
+		return;
+	}
 
 	std::vector<Label> newLabels;
 	newLabels.reserve(numTicks);
@@ -71,6 +71,8 @@ private:
 	QLineF linePos(double pos) const;
 	void updateLabel(Label &label, double opacityEnd, double pos) const;
 	Label createLabel(double value, double pos, double dataMinOld, double dataMaxOld, int animSpeed, bool noLabel);
+	void placeLabel(Label &label, double value, double pos, bool noLabel);
+	int labelAlignFlags() const;
 	QString textForValue(double value) const;
 	std::vector<Label> labels;
 	double dataMin, dataMax;
@@ -94,6 +96,7 @@ private:
 
 	void updateLabels(int numTicks, double firstPosScreen, double firstValue, double stepScreen, double stepValue,
 			  int animSpeed, double dataMinOld, double dataMaxOld);
+	void updateLabelsInstant(int numTicks, double firstPosScreen, double firstValue, double stepScreen, double stepValue);
 };
 
 #endif // DIVECARTESIANAXIS_H
@@ -20,26 +20,54 @@ DiveEventItem::DiveEventItem(const struct dive *d, int idx, const struct event &
 			     const plot_info &pi, DiveCartesianAxis *hAxis, DiveCartesianAxis *vAxis,
 			     int speed, const DivePixmaps &pixmaps, QGraphicsItem *parent) : DivePixmapItem(parent),
 	vAxis(vAxis),
-	hAxis(hAxis),
-	idx(idx),
-	ev(ev),
-	dive(d),
-	depth(depthAtTime(pi, ev.time))
+	hAxis(hAxis)
 {
 	setFlag(ItemIgnoresTransformations);
+	setAcceptHoverEvents(true);
 
-	setupPixmap(lastgasmix, pixmaps);
-	setupToolTipString(lastgasmix);
-	recalculatePos();
+	set(d, idx, ev, lastgasmix, pi, pixmaps);
 }
 
 DiveEventItem::~DiveEventItem()
 {
 }
 
-void DiveEventItem::setupPixmap(struct gasmix lastgasmix, const DivePixmaps &pixmaps)
+void DiveEventItem::set(const struct dive *d, int idxIn, const struct event &evIn, struct gasmix lastgasmixIn,
+			const plot_info &pi, const DivePixmaps &pixmaps)
+{
+	dive = d;
+	idx = idxIn;
+	ev = evIn;
+	lastgasmix = lastgasmixIn;
+	mix = ev.is_gaschange() ? d->get_gasmix_from_event(ev) : gasmix_invalid;
+	typeId = event_type_id(&ev);
+	depth = depthAtTime(pi, ev.time);
+	culled = false;
+
+	setupPixmap(pixmaps);
+	setToolTip(QString());
+	toolTipPending = true;
+	recalculatePos();
+}
+
+void DiveEventItem::prepareToolTip()
+{
+	if (!toolTipPending)
+		return;
+	setupToolTipString();
+	toolTipPending = false;
+}
+
+void DiveEventItem::hoverEnterEvent(QGraphicsSceneHoverEvent *event)
+{
+	prepareToolTip();
+	DivePixmapItem::hoverEnterEvent(event);
+}
+
+void DiveEventItem::setupPixmap(const DivePixmaps &pixmaps)
 {
 	event_severity severity = ev.get_severity();
+	setOffset(QPointF());
 	if (ev.name.empty()) {
 		setPixmap(pixmaps.warning);
 	} else if (same_string_caseinsensitive(ev.name.c_str(), "modechange")) {
@@ -51,7 +79,6 @@ void DiveEventItem::setupPixmap(struct gasmix lastgasmix, const DivePixmaps &pix
 		setPixmap(pixmaps.bookmark);
 		setOffset(QPointF(0.0, -pixmap().height()));
 	} else if (ev.is_gaschange()) {
-		struct gasmix mix = dive->get_gasmix_from_event(ev);
 		struct icd_data icd_data;
 		bool icd = isobaric_counterdiffusion(lastgasmix, mix, &icd_data);
 		if (mix.he.permille) {
@@ -114,7 +141,7 @@ void DiveEventItem::setupPixmap(struct gasmix lastgasmix, const DivePixmaps &pix
 	}
 }
 
-void DiveEventItem::setupToolTipString(struct gasmix lastgasmix)
+void DiveEventItem::setupToolTipString()
 {
 	// we display the event on screen - so translate
 	QString name = gettextFromC::tr(ev.name.c_str());
@@ -123,7 +150,6 @@ void DiveEventItem::setupToolTipString(struct gasmix lastgasmix)
 
 	if (ev.is_gaschange()) {
 		struct icd_data icd_data;
-		struct gasmix mix = dive->get_gasmix_from_event(ev);
 		name += ": ";
 		name += QString::fromStdString(mix.name());
 
@@ -210,13 +236,47 @@ bool DiveEventItem::isInteresting(const struct dive *d, const struct divecompute
 	return true;
 }
 
+bool DiveEventItem::matches(const struct dive *d, int idxIn, const struct event &evIn, struct gasmix lastgasmixIn) const
+{
+	return d == dive && idxIn == idx && evIn == ev && same_gasmix(lastgasmixIn, lastgasmix) &&
+	       (!ev.is_gaschange() || same_gasmix(d->get_gasmix_from_event(ev), mix));
+}
+
+void DiveEventItem::refresh(const struct event &evIn, const struct plot_info &pi)
+{
+	ev.hidden = evIn.hidden;
+	typeId = event_type_id(&ev);
+	depth = depthAtTime(pi, ev.time);
+	culled = false;
+	recalculatePos();
+}
+
+void DiveEventItem::setCulled(bool culledIn)
+{
+	if (culled == culledIn)
+		return;
+	culled = culledIn;
+	updateVisibility();
+}
+
+void DiveEventItem::unhide()
+{
+	ev.hidden = false;
+	updateVisibility();
+}
+
+void DiveEventItem::updateVisibility()
+{
+	setVisible(depth != DEPTH_NOT_FOUND && !culled && !ev.hidden && !is_event_type_hidden(typeId));
+}
+
 void DiveEventItem::recalculatePos()
 {
 	if (depth == DEPTH_NOT_FOUND) {
 		hide();
 		return;
 	}
-	setVisible(!ev.hidden && !is_event_type_hidden(&ev));
+	updateVisibility();
 	double x = hAxis->posAtValue(ev.time.seconds);
 	double y = vAxis->posAtValue(depth);
 	setPos(x, y);
@@ -17,19 +17,38 @@ public:
 		      const struct plot_info &pi, DiveCartesianAxis *hAxis, DiveCartesianAxis *vAxis,
 		      int speed, const DivePixmaps &pixmaps, QGraphicsItem *parent = nullptr);
 	~DiveEventItem();
+	// Show a different event, reusing the item.
+	void set(const struct dive *d, int idx, const struct event &ev, struct gasmix lastgasmix,
+		 const struct plot_info &pi, const DivePixmaps &pixmaps);
 	void eventVisibilityChanged(const QString &eventName, bool visible);
 	void setVerticalAxis(DiveCartesianAxis *axis, int speed);
 	void setHorizontalAxis(DiveCartesianAxis *axis);
 	static bool isInteresting(const struct dive *d, const struct divecomputer *dc,
 				  const struct event &ev, const struct plot_info &pi,
 				  int firstSecond, int lastSecond);
+	// True if the item shows the same as a new item for these arguments would.
+	bool matches(const struct dive *d, int idx, const struct event &ev, struct gasmix lastgasmix) const;
+	// Take over the hidden flag of the event and move the item to the depth of the new plot info.
+	void refresh(const struct event &ev, const struct plot_info &pi);
+	// The tooltip is only built when it is needed, i.e. on hover.
+	void prepareToolTip();
+	// Items that would be painted on top of an identical icon are culled.
+	void setCulled(bool culled);
+	void unhide();
 
 private:
-	void setupToolTipString(struct gasmix lastgasmix);
-	void setupPixmap(struct gasmix lastgasmix, const DivePixmaps &pixmaps);
+	void hoverEnterEvent(QGraphicsSceneHoverEvent *event) override;
+	void setupToolTipString();
+	void setupPixmap(const DivePixmaps &pixmaps);
 	void recalculatePos();
+	void updateVisibility();
 	DiveCartesianAxis *vAxis;
 	DiveCartesianAxis *hAxis;
+	struct gasmix lastgasmix;
+	struct gasmix mix; // for gas changes
+	int typeId; // see event_type_id()
+	bool culled;
+	bool toolTipPending;
 public:
 	int idx;
 	struct event ev;
@@ -5,7 +5,8 @@
 #include "core/event.h"
 #include "core/profile.h"
 
-#include <array>
+#include <algorithm>
+#include <vector>
 
 DivePercentageItem::DivePercentageItem(const DiveCartesianAxis &hAxis, const DiveCartesianAxis &vAxis) :
 	hAxis(hAxis), vAxis(vAxis)
@@ -14,45 +15,6 @@ DivePercentageItem::DivePercentageItem(const DiveCartesianAxis &hAxis, const Div
 
 static constexpr int num_tissues = 16;
 
-// Calculate the number of scanlines for every drawn tissue.
-static std::array<int, num_tissues> calcLinesPerTissue(int size)
-{
-	std::array<int, num_tissues> res;
-
-	// A Bresenham-inspired algorithm without the weird half steps at the beginning and the end.
-	if (size <= 0) {
-		std::fill(res.begin(), res.end(), 0);
-	} else if (size >= num_tissues) {
-		int step = size / num_tissues;
-		int err_inc = size % num_tissues;
-		int err = 0;
-		for (int i = 0; i < num_tissues; ++i) {
-			res[i] = step;
-			err += err_inc;
-			if (err >= num_tissues) {
-				err -= num_tissues;
-				++res[i];
-			}
-		}
-	} else { // size < num_tissues
-		int step = num_tissues / size;
-		int err_inc = num_tissues % size;
-		int err = 0;
-		int act = 0;
-		std::fill(res.begin(), res.end(), 0);
-		for (int i = 0; i < size; ++i) {
-			res[act] = 1;
-			act += step;
-			err += err_inc;
-			if (err >= size) {
-				err -= size;
-				++act;
-			}
-		}
-	}
-	return res;
-}
-
 static inline QRgb hsv2rgb(double h, double s, double v)
 {
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)  // they are just trolling us with these changes
@@ -84,6 +46,57 @@ static QRgb colorScale(double value, int inert)
 		return hsv2rgb(0.0, 0.0, 1.0);
 }
 
+// The colors only depend on the integer percentage and, below the ambient
+// pressure, on the permille of inert gas. Look them up in a table.
+static constexpr int lut_inert_size = 1001;
+static constexpr int lut_low_size = (int)AMB_PERCENTAGE;
+static constexpr int lut_high_size = 120;
+
+static QRgb lookupColor(int value, int inert)
+{
+	static const std::vector<QRgb> lut = [] {
+		std::vector<QRgb> res(lut_low_size * lut_inert_size + lut_high_size - lut_low_size);
+		for (int value = 0; value < lut_low_size; ++value) {
+			for (int inert = 0; inert < lut_inert_size; ++inert)
+				res[value * lut_inert_size + inert] = colorScale(value, inert);
+		}
+		for (int value = lut_low_size; value < lut_high_size; ++value)
+			res[lut_low_size * lut_inert_size + value - lut_low_size] = colorScale(value, 0);
+		return res;
+	}();
+
+	if (value >= lut_high_size)
+		return colorScale(value, inert); // white
+	if (value >= lut_low_size)
+		return lut[lut_low_size * lut_inert_size + value - lut_low_size];
+	if (value >= 0 && inert >= 0 && inert < lut_inert_size)
+		return lut[value * lut_inert_size + inert];
+	return colorScale(value, inert);
+}
+
+void DivePercentageItem::invalidate()
+{
+	colors = QImage();
+}
+
+// One pixel per tissue and plot entry. Only recalculated if the plot info changed.
+void DivePercentageItem::calculateColors(const dive *d, const struct divecomputer *dc, const plot_info &pi)
+{
+	colors = QImage(std::max(pi.nr, 1), num_tissues, QImage::Format_ARGB32);
+	colors.fill(0);
+	auto timeline = d->get_timeline(*dc);
+	std::vector<int> inert(pi.nr);
+	for (int i = 0; i < pi.nr; i++) {
+		struct gasmix gasmix = timeline->gasmix_at(pi.entry[i].sec).first;
+		inert[i] = get_n2(gasmix) + get_he(gasmix);
+	}
+	for (int tissue = 0; tissue < num_tissues; ++tissue) {
+		QRgb *scanline = (QRgb *)colors.scanLine(tissue);
+		for (int i = 0; i < pi.nr; i++)
+			scanline[i] = lookupColor(get_plot_tissue_percentage(pi, i, tissue), inert[i]);
+	}
+}
+
 void DivePercentageItem::replot(const dive *d, const struct divecomputer *dc, const plot_info &pi)
 {
 	auto [minX, maxX] = hAxis.screenMinMax();
@@ -95,29 +108,27 @@ void DivePercentageItem::replot(const dive *d, const struct divecomputer *dc, co
 		return;
 	}
 
-	std::array<int, num_tissues> linesPerTissue = calcLinesPerTissue(height);
+	if (colors.isNull())
+		calculateColors(d, dc, pi);
 
-	QImage img(width, height, QImage::QImage::Format_ARGB32);
+	// The horizontal position of the entries depends on the zoom, so the entries
+	// are distributed over the pixels here. Vertically, the tissues are scaled.
+	std::vector<int> xs(pi.nr);
+	for (int i = 0; i < pi.nr; i++)
+		xs[i] = lrint(hAxis.posAtValue(pi.entry[i].sec)) - lrint(minX);
 
-	int line = 0;
+	QImage img(width, num_tissues, QImage::QImage::Format_ARGB32);
 	for (int tissue = 0; tissue < num_tissues; ++tissue) {
-		if (linesPerTissue[tissue] <= 0)
-			continue;
 		int x = 0;
-		QRgb *scanline = (QRgb *)img.scanLine(line);
+		QRgb *scanline = (QRgb *)img.scanLine(tissue);
+		const QRgb *entryColors = (const QRgb *)colors.constScanLine(tissue);
 		QRgb color = 0;
-		gasmix_loop loop(*d, *dc);
 		for (int i = 0; i < pi.nr; i++) {
-			const plot_data &item = pi.entry[i];
-			int sec = item.sec;
-			int nextX = lrint(hAxis.posAtValue(sec)) - lrint(minX);
+			int nextX = xs[i];
 			if (nextX == x)
 				continue;
 
-			double value = item.percentages[tissue];
-			struct gasmix gasmix = loop.at(sec).first;
-			int inert = get_n2(gasmix) + get_he(gasmix);
-			color = colorScale(value, inert);
+			color = entryColors[i];
 			if (nextX >= width)
 				nextX = width - 1;
 			for (; x <= nextX; ++x)
@@ -127,15 +138,8 @@ void DivePercentageItem::replot(const dive *d, const struct divecomputer *dc, co
 		}
 		for (; x < width; ++x)
 			scanline[x] = color;
-		++line;
-
-		// Clone line if needed
-		for (int i = 0; i < linesPerTissue[tissue] - 1; ++i) {
-			QRgb *scanline2 = (QRgb *)img.scanLine(line);
-			std::copy(scanline, scanline + width, scanline2);
-			++line;
-		}
 	}
 	setPixmap(QPixmap::fromImage(img));
+	setTransform(QTransform::fromScale(1.0, height / (double)num_tissues));
 	setPos(minX, minY);
 }
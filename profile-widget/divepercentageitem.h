@@ -2,6 +2,7 @@
 #define DIVEPERCENTAGEITEM_H
 
 #include <QGraphicsPixmapItem>
+#include <QImage>
 
 struct dive;
 struct divecomputer;
@@ -12,9 +13,12 @@ class DivePercentageItem : public QGraphicsPixmapItem {
 public:
 	DivePercentageItem(const DiveCartesianAxis &hAxis, const DiveCartesianAxis &vAxis);
 	void replot(const dive *d, const divecomputer *dc, const plot_info &pi);
+	void invalidate(); // to be called when the plot info changed
 private:
+	void calculateColors(const dive *d, const divecomputer *dc, const plot_info &pi);
 	const DiveCartesianAxis &hAxis;
 	const DiveCartesianAxis &vAxis;
+	QImage colors; // the tissues of the plot entries, see calculateColors()
 };
 
 #endif
@@ -11,10 +11,14 @@
 #include "libdivecomputer/parser.h"
 #include "profile-widget/profilewidget2.h"
 
+#include <algorithm>
+#include <cmath>
+
 AbstractProfilePolygonItem::AbstractProfilePolygonItem(const plot_info &pInfo, const DiveCartesianAxis &horizontal,
 						       const DiveCartesianAxis &vertical, DataAccessor accessor,
 						       double dpr) :
-	hAxis(horizontal), vAxis(vertical), pInfo(pInfo), accessor(accessor), dpr(dpr), from(0), to(0)
+	hAxis(horizontal), vAxis(vertical), pInfo(pInfo), accessor(accessor), dpr(dpr), from(0), to(0),
+	decimationScale(0.0)
 {
 	setCacheMode(DeviceCoordinateCache);
 }
@@ -27,6 +31,33 @@ void AbstractProfilePolygonItem::clear()
 {
 	setPolygon(QPolygonF());
 	texts.clear();
+	oldTexts.clear();
+}
+
+// Starts a new set of labels. The current labels are hidden and kept
+// until the next call, so that unchanged labels don't have to be rendered
+// again when the profile is replotted, notably while editing in the planner.
+void AbstractProfilePolygonItem::clearTexts()
+{
+	oldTexts = std::move(texts);
+	texts.clear();
+	for (auto &text: oldTexts)
+		text->setVisible(false);
+}
+
+DiveTextItem *AbstractProfilePolygonItem::addText(double scale, int alignFlags, const QString &label, const QColor &color)
+{
+	QBrush brush(color);
+	auto it = std::find_if(oldTexts.begin(), oldTexts.end(), [&](const std::unique_ptr<DiveTextItem> &text)
+			       { return text && text->matches(scale, alignFlags, label, brush); }); // reused items are null
+	if (it != oldTexts.end()) {
+		texts.push_back(std::move(*it));
+		texts.back()->setVisible(true);
+	} else {
+		texts.push_back(std::make_unique<DiveTextItem>(dpr, scale, alignFlags, this));
+		texts.back()->set(label, brush);
+	}
+	return texts.back().get();
 }
 
 static std::pair<double,double> clip(double x1, double y1, double x2, double y2, double x)
@@ -51,23 +82,79 @@ std::pair<double, double> AbstractProfilePolygonItem::getPoint(int i) const
 {
 	const auto &data = pInfo.entry;
 	double x = data[i].sec;
-	double y = accessor(data[i]);
+	double y = accessor(pInfo, i);
 
 	// Do clipping of first and last value
 	if (i == from && i < to) {
 		double next_x = data[i+1].sec;
-		double next_y = accessor(data[i+1]);
+		double next_y = accessor(pInfo, i+1);
 		clipStart(x, y, next_x, next_y);
 	}
 	if (i == to - 1 && i > 0) {
 		double prev_x = data[i-1].sec;
-		double prev_y = accessor(data[i-1]);
+		double prev_y = accessor(pInfo, i-1);
 		clipStop(x, y, prev_x, prev_y);
 	}
 
 	return { x, y };
 }
 
+void AbstractProfilePolygonItem::invalidateDecimation()
+{
+	decimation.clear();
+	decimationScale = 0.0;
+}
+
+// Long dives have many more points than pixels. Of the points that fall
+// into the same pixel column, only the first, the last, the lowest and the
+// highest are painted, which gives the same picture (M4 decimation).
+// The columns are aligned to the dive time, not to the visible range, so
+// that the decimation of the whole dive can be reused when panning.
+std::vector<int> AbstractProfilePolygonItem::decimatedIndexes(int from, int to)
+{
+	double scale = fabs(hAxis.deltaToValue(1.0)); // seconds per pixel
+	if (!std::isfinite(scale) || scale <= 0.0)
+		scale = 1.0;
+	if (scale != decimationScale || decimation.empty()) {
+		decimation.clear();
+		decimationScale = scale;
+		int i = 0;
+		while (i < pInfo.nr) {
+			double column = floor(pInfo.entry[i].sec / scale);
+			int first = i, low = i, high = i;
+			double lowValue = accessor(pInfo, i), highValue = lowValue;
+			for (++i; i < pInfo.nr && floor(pInfo.entry[i].sec / scale) == column; ++i) {
+				double value = accessor(pInfo, i);
+				if (value < lowValue) {
+					low = i;
+					lowValue = value;
+				}
+				if (value > highValue) {
+					high = i;
+					highValue = value;
+				}
+			}
+			int column_points[] = { first, std::min(low, high), std::max(low, high), i - 1 };
+			for (int idx: column_points) {
+				if (decimation.empty() || decimation.back() != idx)
+					decimation.push_back(idx);
+			}
+		}
+	}
+
+	// The first and the last point are always needed for clipping.
+	std::vector<int> res;
+	if (from >= to)
+		return res;
+	res.push_back(from);
+	auto it = std::upper_bound(decimation.begin(), decimation.end(), from);
+	for (; it != decimation.end() && *it < to - 1; ++it)
+		res.push_back(*it);
+	if (to - 1 > from)
+		res.push_back(to - 1);
+	return res;
+}
+
 void AbstractProfilePolygonItem::makePolygon(int fromIn, int toIn)
 {
 	from = fromIn;
@@ -79,7 +166,8 @@ void AbstractProfilePolygonItem::makePolygon(int fromIn, int toIn)
 	// is an array of QPointF's, so we basically get the point from the model, convert
 	// to our coordinates, store. no painting is done here.
 	QPolygonF poly;
-	for (int i = from; i < to; i++) {
+	polygonIndexes = decimatedIndexes(from, to);
+	for (int i: polygonIndexes) {
 		auto [horizontalValue, verticalValue] = getPoint(i);
 
 		if (i == from) {
@@ -95,7 +183,7 @@ void AbstractProfilePolygonItem::makePolygon(int fromIn, int toIn)
 	}
 	setPolygon(poly);
 
-	texts.clear();
+	clearTexts();
 }
 
 DiveProfileItem::DiveProfileItem(const plot_info &pInfo, const DiveCartesianAxis &hAxis,
@@ -122,13 +210,13 @@ void DiveProfileItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *o
 	pen.setWidth(2);
 	QPolygonF poly = polygon();
 	const auto &data = pInfo.entry;
-	// This paints the colors of the velocities.
-	for (int i = from + 1; i < to; i++) {
-		QColor color = getColor((color_index_t)(VELOCITY_COLORS_START_IDX + data[i].velocity));
+	// This paints the colors of the velocities. The first point of the polygon is on the surface.
+	for (size_t i = 1; i < polygonIndexes.size(); i++) {
+		QColor color = getColor((color_index_t)(VELOCITY_COLORS_START_IDX + data[polygonIndexes[i]].velocity));
 		pen.setBrush(QBrush(color));
 		painter->setPen(pen);
-		if (i - from < poly.count() - 1)
-			painter->drawLine(poly[i - from], poly[i - from + 1]);
+		if ((int)i < poly.count() - 1)
+			painter->drawLine(poly[i], poly[i + 1]);
 	}
 	painter->restore();
 }
@@ -253,10 +341,8 @@ void DiveProfileItem::replot(const dive *d, int from, int to, bool in_planner)
 
 void DiveProfileItem::plot_depth_sample(const struct plot_data &entry, QFlags<Qt::AlignmentFlag> flags, const QColor &color)
 {
-	auto item = std::make_unique<DiveTextItem>(dpr, 1.0, flags, this);
-	item->set(get_depth_string(entry.depth, true), color);
+	DiveTextItem *item = addText(1.0, flags, get_depth_string(entry.depth, true), color);
 	item->setPos(hAxis.posAtValue(entry.sec), vAxis.posAtValue(entry.depth));
-	texts.push_back(std::move(item));
 }
 
 DiveHeartrateItem::DiveHeartrateItem(const plot_info &pInfo, const DiveCartesianAxis &hAxis,
@@ -282,7 +368,7 @@ void DiveHeartrateItem::replot(const dive *, int fromIn, int toIn, bool)
 	} hist[3] = {};
 	std::vector<sec_hr> textItems;
 
-	texts.clear();
+	clearTexts();
 	// Ignore empty values. a heart rate of 0 would be a bad sign.
 	QPolygonF poly;
 	int interval = vAxis.getMinLabelDistance(hAxis);
@@ -332,10 +418,8 @@ void DiveHeartrateItem::createTextItem(int sec, int hr, bool last)
 {
 	int flags = last ? Qt::AlignLeft | Qt::AlignBottom :
 			   Qt::AlignRight | Qt::AlignBottom;
-	auto text = std::make_unique<DiveTextItem>(dpr, 0.7, flags, this);
-	text->set(QStringLiteral("%1").arg(hr), getColor(HR_TEXT));
+	DiveTextItem *text = addText(0.7, flags, QStringLiteral("%1").arg(hr), getColor(HR_TEXT));
 	text->setPos(QPointF(hAxis.posAtValue(sec), vAxis.posAtValue(hr)));
-	texts.push_back(std::move(text));
 }
 
 void DiveHeartrateItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
@@ -367,7 +451,7 @@ void DiveTemperatureItem::replot(const dive *, int fromIn, int toIn, bool)
 	double last = -300.0, last_printed_temp = 0.0, last_valid_temp = 0.0, sec = 0.0;
 	std::vector<std::pair<int, int>> textItems;
 
-	texts.clear();
+	clearTexts();
 	// Ignore empty values. things do not look good with '0' as temperature in kelvin...
 	QPolygonF poly;
 	int interval = vAxis.getMinLabelDistance(hAxis);
@@ -415,10 +499,8 @@ void DiveTemperatureItem::createTextItem(int sec, int mkelvin, bool last)
 
 	int flags = last ? Qt::AlignLeft | Qt::AlignBottom :
 			   Qt::AlignRight | Qt::AlignBottom;
-	auto text = std::make_unique<DiveTextItem>(dpr, 0.8, flags, this);
-	text->set(get_temperature_string(temp, true), getColor(TEMP_TEXT));
+	DiveTextItem *text = addText(0.8, flags, get_temperature_string(temp, true), getColor(TEMP_TEXT));
 	text->setPos(QPointF(hAxis.posAtValue(sec), vAxis.posAtValue(mkelvin)));
-	texts.push_back(std::move(text));
 }
 
 void DiveTemperatureItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
@@ -476,6 +558,7 @@ void DiveMeanDepthItem::replot(const dive *, int fromIn, int toIn, bool)
 
 	double prevSec = 0.0, prevMeanDepth = 0.0;
 
+	clearTexts();
 	QPolygonF poly;
 	for (int i = from; i < to; i++) {
 		auto [sec, meanDepth] = getMeanDepth(i);
@@ -514,11 +597,9 @@ void DiveMeanDepthItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*
 
 void DiveMeanDepthItem::createTextItem(double lastSec, double lastMeanDepth)
 {
-	texts.clear();
-	auto text = std::make_unique<DiveTextItem>(dpr, diveMeanDepthItemLabelScale, Qt::AlignRight | Qt::AlignVCenter, this);
-	text->set(get_depth_string(lrint(lastMeanDepth), true), getColor(TEMP_TEXT));
+	DiveTextItem *text = addText(diveMeanDepthItemLabelScale, Qt::AlignRight | Qt::AlignVCenter,
+				     get_depth_string(lrint(lastMeanDepth), true), getColor(TEMP_TEXT));
 	text->setPos(QPointF(hAxis.posAtValue(lastSec) + dpr, vAxis.posAtValue(lastMeanDepth)));
-	texts.push_back(std::move(text));
 }
 
 void DiveGasPressureItem::replot(const dive *d, int fromIn, int toIn, bool in_planner)
@@ -611,7 +692,7 @@ void DiveGasPressureItem::replot(const dive *d, int fromIn, int toIn, bool in_pl
 	}
 
 	setPolygon(boundingPoly);
-	texts.clear();
+	clearTexts();
 
 	// These are offset values used to print the gas labels and pressures on a
 	// dive profile at appropriate Y-coordinates. We alternate aligning the
@@ -643,10 +724,8 @@ double DiveGasPressureItem::plotPressureValue(double mbar, double sec, QFlags<Qt
 {
 	const char *unit;
 	auto label = QStringLiteral("%1%2").arg(get_pressure_units(lrint(mbar), &unit)).arg(unit);
-	auto text = std::make_unique<DiveTextItem>(dpr, 1.0, align, this);
-	text->set(label, getColor(PRESSURE_TEXT));
+	DiveTextItem *text = addText(1.0, align, label, getColor(PRESSURE_TEXT));
 	text->setPos(hAxis.posAtValue(sec), vAxis.posAtValue(mbar) + y_offset);
-	texts.push_back(std::move(text));
 
 	return DiveTextItem::getLabelSize(dpr, 1.0, label).first;
 }
@@ -659,10 +738,8 @@ void DiveGasPressureItem::plotGasValue(double mbar, double sec, const cylinder_t
 		label = QStringLiteral("(%1) %2").arg(QString::fromStdString(cylinder->type.description), std::move(gas));
 	else
 		label = gas;
-	auto text = std::make_unique<DiveTextItem>(dpr, 1.0, align, this);
-	text->set(label, getColor(PRESSURE_TEXT));
+	DiveTextItem *text = addText(1.0, align, label, getColor(PRESSURE_TEXT));
 	text->setPos(hAxis.posAtValue(sec) - x_offset, vAxis.posAtValue(mbar) + y_offset);
-	texts.push_back(std::move(text));
 }
 
 void DiveGasPressureItem::paint(QPainter *painter, const QStyleOptionGraphicsItem*, QWidget*)
@@ -790,7 +867,7 @@ void PartialPressureGasItem::replot(const dive *, int fromIn, int toIn, bool)
 	if (thresholdPtrMin)
 		threshold_min = *thresholdPtrMin;
 	bool inAlertFragment = false;
-	for (int i = from; i < to; i++) {
+	for (int i: decimatedIndexes(from, to)) {
 		auto [time, value] = getPoint(i);
 		QPointF point(hAxis.posAtValue(time), vAxis.posAtValue(value));
 		poly.push_back(point);
@@ -26,7 +26,7 @@ struct dive;
 
 class AbstractProfilePolygonItem : public QGraphicsPolygonItem {
 public:
-	using DataAccessor = double (*)(const plot_data &data); // The pointer-to-function syntax is hilarious.
+	using DataAccessor = double (*)(const plot_info &pi, int idx); // The pointer-to-function syntax is hilarious.
 	AbstractProfilePolygonItem(const plot_info &pInfo, const DiveCartesianAxis &hAxis, const DiveCartesianAxis &vAxis,
 				   DataAccessor accessor, double dpr);
 	~AbstractProfilePolygonItem();
@@ -37,18 +37,32 @@ public:
 	// only the first and the last segment will have to be clipped.
 	virtual void replot(const dive *d, int from, int to, bool in_planner) = 0;
 
+	// To be called when the plot info changed.
+	void invalidateDecimation();
+
 protected:
 	void makePolygon(int from, int to);
 	void clipStart(double &x, double &y, double next_x, double next_y) const;
 	void clipStop(double &x, double &y, double prev_x, double prev_y) const;
 	std::pair<double, double> getPoint(int i) const;
+	std::vector<int> decimatedIndexes(int from, int to);
+	void clearTexts();
+	DiveTextItem *addText(double scale, int alignFlags, const QString &text, const QColor &color);
 	const DiveCartesianAxis &hAxis;
 	const DiveCartesianAxis &vAxis;
 	const plot_info &pInfo;
 	DataAccessor accessor;
 	double dpr;
 	int from, to;
+	std::vector<int> polygonIndexes; // the plot info index of each point set by makePolygon()
 	std::vector<std::unique_ptr<DiveTextItem>> texts;
+private:
+	// For each pixel column, the first, last, lowest and highest point.
+	// Only recalculated when the zoom level or the plot info changes.
+	std::vector<int> decimation;
+	double decimationScale;
+	// The text items of the previous replot, hidden and waiting to be reused by addText().
+	std::vector<std::unique_ptr<DiveTextItem>> oldTexts;
 };
 
 class DiveProfileItem : public AbstractProfilePolygonItem {
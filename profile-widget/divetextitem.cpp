@@ -6,6 +6,9 @@
 
 #include <QBrush>
 #include <QApplication>
+#include <QCache>
+
+#include <algorithm>
 
 static const double outlineSize = 3.0;
 
@@ -33,18 +36,28 @@ static QFont getFont(double dpr, double scale)
 	return fnt;
 }
 
-void DiveTextItem::set(const QString &t, const QBrush &b)
-{
-	internalText = t;
-	if (internalText.isEmpty()) {
-		setPixmap(QPixmap());
-		return;
-	}
+// Rendered labels, shared by all scenes. Profiles show the same labels
+// (depths, temperatures, pressures) over and over again, notably when
+// replotting or printing many dives, and rendering the outlined text is
+// comparatively slow. The cost of an entry is its size in pixels.
+// Note: like the pixmap cache, this must only be used from the UI thread.
+struct RenderedLabel {
+	QPixmap pixmap;
+	QSizeF size; // size of the outline, which is not rounded
+};
+static const int labelCacheSize = 4 * 1024 * 1024;
+static QCache<QString, RenderedLabel> labelCache(labelCacheSize);
 
-	QFont fnt = getFont(dpr, scale);
+// The dpr enters via the font size and the width of the outline.
+static QString labelKey(const QFont &fnt, double dpr, const QString &t, const QBrush &b)
+{
+	return QStringLiteral("%1|%2|%3|%4").arg(fnt.key()).arg(dpr).arg(b.color().rgba()).arg(t);
+}
 
+static RenderedLabel renderLabel(const QFont &fnt, double dpr, const QString &t, const QBrush &b)
+{
 	QPainterPath textPath;
-	textPath.addText(0.0, 0.0, fnt, internalText);
+	textPath.addText(0.0, 0.0, fnt, t);
 	QPainterPathStroker stroker;
 	stroker.setWidth(outlineSize * dpr);
 	QPainterPath outlinePath = stroker.createStroke(textPath);
@@ -65,7 +78,34 @@ void DiveTextItem::set(const QString &t, const QBrush &b)
 		painter.setPen(Qt::NoPen);
 		painter.drawPath(textPath);
 	}
-	setPixmap(pixmap);
+	return { pixmap, outlineRect.size() };
+}
+
+void DiveTextItem::set(const QString &t, const QBrush &b)
+{
+	internalText = t;
+	internalBrush = b;
+	if (internalText.isEmpty()) {
+		setPixmap(QPixmap());
+		return;
+	}
+
+	QFont fnt = getFont(dpr, scale);
+	RenderedLabel label;
+	if (b.style() != Qt::SolidPattern) {
+		// Only plain colours can be identified by the key.
+		label = renderLabel(fnt, dpr, internalText, b);
+	} else {
+		QString key = labelKey(fnt, dpr, internalText, b);
+		if (const RenderedLabel *cached = labelCache.object(key)) {
+			label = *cached;
+		} else {
+			label = renderLabel(fnt, dpr, internalText, b);
+			labelCache.insert(key, new RenderedLabel(label), std::max(label.pixmap.width() * label.pixmap.height(), 1));
+		}
+	}
+	setPixmap(label.pixmap);
+	QRectF outlineRect(QPointF(), label.size);
 
 	double yOffset = (internalAlignFlags & Qt::AlignTop) ? 0.0 :
 		(internalAlignFlags & Qt::AlignBottom) ? -outlineRect.height() :
@@ -77,6 +117,12 @@ void DiveTextItem::set(const QString &t, const QBrush &b)
 	setOffset(xOffset, yOffset);
 }
 
+// Used to recycle text items, since rendering the text is not cheap.
+bool DiveTextItem::matches(double scaleIn, int alignFlags, const QString &t, const QBrush &b) const
+{
+	return scale == scaleIn && internalAlignFlags == alignFlags && internalText == t && internalBrush == b;
+}
+
 const QString &DiveTextItem::text()
 {
 	return internalText;
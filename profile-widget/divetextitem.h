@@ -3,10 +3,10 @@
 #define DIVETEXTITEM_H
 
 #include <QObject>
+#include <QBrush>
 #include <QFont>
 #include <QGraphicsPixmapItem>
 
-class QBrush;
 
 /* A Line Item that has animated-properties. */
 class DiveTextItem : public QObject, public QGraphicsPixmapItem {
@@ -19,6 +19,7 @@ public:
 	// placing text items next to each other. This may have to be fixed.
 	DiveTextItem(double dpr, double scale, int alignFlags, QGraphicsItem *parent);
 	void set(const QString &text, const QBrush &brush);
+	bool matches(double scale, int alignFlags, const QString &text, const QBrush &brush) const;
 	const QString &text();
 	static double fontHeight(double dpr, double scale);
 	static std::pair<double, double> getLabelSize(double dpr, double scale, const QString &label);
@@ -27,6 +28,7 @@ public:
 private:
 	int internalAlignFlags;
 	QString internalText;
+	QBrush internalBrush;
 	double dpr;
 	double scale;
 };
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "profile-widget/divetooltipitem.h"
 #include "profile-widget/divecartesianaxis.h"
+#include "profile-widget/diveeventitem.h"
 #include "core/membuffer.h"
 #include "core/metrics.h"
 #include "core/settings/qPrefDisplay.h"
@@ -133,7 +134,8 @@ ToolTipItem::ToolTipItem(QGraphicsItem *parent) : RoundRectItem(8.0, parent),
 	tissues(16,60),
 	painter(&tissues),
 	timeAxis(0),
-	lastTime(-1)
+	lastTime(-1),
+	lastIdx(-1)
 {
 	clearPlotInfo();
 	entryToolTip.first = NULL;
@@ -208,11 +210,13 @@ void ToolTipItem::readPos()
 void ToolTipItem::setPlotInfo(const plot_info &plot)
 {
 	pInfo = plot;
+	lastIdx = -1;
 }
 
 void ToolTipItem::clearPlotInfo()
 {
 	pInfo = plot_info();
+	lastIdx = -1;
 }
 
 void ToolTipItem::setTimeAxis(DiveCartesianAxis *axis)
@@ -229,10 +233,27 @@ void ToolTipItem::refresh(const dive *d, const QPointF &pos, bool inPlanner)
 	int time = lrint(timeAxis->valueAt(pos));
 
 	lastTime = time;
-	clear();
 
 	auto [idx, lines] = get_plot_details_new(d, pInfo, time);
 
+	QStringList itemToolTips;
+	const auto l = scene()->items(pos, Qt::IntersectsItemBoundingRect, Qt::DescendingOrder,
+			scene()->views().first()->transform());
+	for (QGraphicsItem *item: l) {
+		// The tooltips of the events are built on demand
+		if (DiveEventItem *eventItem = dynamic_cast<DiveEventItem *>(item))
+			eventItem->prepareToolTip();
+		if (!item->toolTip().isEmpty())
+			itemToolTips.push_back(item->toolTip());
+	}
+
+	// Still on the same plot entry: keep the text items and their layouts
+	if (isExpanded() && idx == lastIdx && itemToolTips == lastItemToolTips)
+		return;
+	lastIdx = idx;
+	lastItemToolTips = itemToolTips;
+	clear();
+
 	tissues.fill();
 	painter.setPen(QColor(0, 0, 0, 0));
 	painter.setBrush(QColor(LIMENADE1));
@@ -241,7 +262,8 @@ void ToolTipItem::refresh(const dive *d, const QPointF &pos, bool inPlanner)
 	painter.drawRect(0, 10, 16, (100 - AMB_PERCENTAGE) / 2);
 	painter.setBrush(QColor(Qt::red));
 	painter.drawRect(0,0,16,10);
-	if (idx) {
+	// The tissue saturations are only calculated when deco info is shown
+	if (idx && !pInfo.percentages.empty()) {
 		const struct plot_data *entry = &pInfo.entry[idx];
 		painter.setPen(QColor(0, 0, 0, 255));
 		if (decoMode(inPlanner) == BUEHLMANN)
@@ -249,8 +271,10 @@ void ToolTipItem::refresh(const dive *d, const QPointF &pos, bool inPlanner)
 		painter.drawLine(0, lrint(60 - AMB_PERCENTAGE * (entry->pressures.n2 + entry->pressures.he) / entry->ambpressure / 2),
 				16, lrint(60 - AMB_PERCENTAGE * (entry->pressures.n2 + entry->pressures.he) / entry->ambpressure /2));
 		painter.setPen(QColor(0, 0, 0, 127));
-		for (int i = 0; i < 16; i++)
-			painter.drawLine(i, 60, i, 60 - entry->percentages[i] / 2);
+		for (int i = 0; i < NUM_PLOT_TISSUES; i++)
+			painter.drawLine(i, 60, i, 60 - get_plot_tissue_percentage(pInfo, idx, i) / 2);
+	}
+	if (idx) {
 		QString text;
 		for (const std::string &s: lines) {
 			if (!text.isEmpty())
@@ -261,12 +285,8 @@ void ToolTipItem::refresh(const dive *d, const QPointF &pos, bool inPlanner)
 	}
 	entryToolTip.first->setPixmap(tissues);
 
-	const auto l = scene()->items(pos, Qt::IntersectsItemBoundingRect, Qt::DescendingOrder,
-			scene()->views().first()->transform());
-	for (QGraphicsItem *item: l) {
-		if (!item->toolTip().isEmpty())
-			addToolTip(item->toolTip(), QPixmap());
-	}
+	for (const QString &toolTip: itemToolTips)
+		addToolTip(toolTip, QPixmap());
 	expand();
 }
 
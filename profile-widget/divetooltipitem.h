@@ -7,6 +7,7 @@
 #include <QRectF>
 #include <QIcon>
 #include <QElapsedTimer>
+#include <QStringList>
 #include <QPainter>
 #include "backend-shared/roundrectitem.h"
 #include "core/profile.h"
@@ -58,6 +59,8 @@ private:
 	DiveCartesianAxis *timeAxis;
 	plot_info pInfo;
 	int lastTime;
+	int lastIdx;			// of the plot entry shown, -1 if none
+	QStringList lastItemToolTips;	// of the items under the mouse
 	QElapsedTimer refreshTime;
 	QList<QGraphicsItem*> oldSelection;
 
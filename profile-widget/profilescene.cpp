@@ -11,6 +11,7 @@
 #include "core/device.h"
 #include "core/divecomputer.h"
 #include "core/event.h"
+#include "core/perfcounters.h"
 #include "core/pref.h"
 #include "core/profile.h"
 #include "core/qthelper.h"	// for decoMode()
@@ -20,15 +21,39 @@
 #include "core/settings/qPrefDisplay.h"
 #include "qt-models/diveplannermodel.h"
 #include <QAbstractAnimation>
+#include <QElapsedTimer>
+#include <cmath>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 
 static const double diveComputerTextBorder = 1.0;
 
+// A frame that takes longer than that, including painting, is slow.
+static const qint64 frameBudget = 40; // ms
+// After that many slow frames in a row, the animation jumps to the end.
+static const int maxSlowFramesInARow = 3;
+// When the animations were turned off, try again after that many plots.
+static const int retryAnimationAfter = 20;
+
+static perf_counter animation_frames("profile animation frames");
+static perf_counter animation_slow_frames("profile animation slow frames");
+static perf_counter animations_aborted("profile animations aborted");
+static perf_counter animations_degraded("profile animations degraded");
+// Of the interactive profile: 0 = all axes, 1 = main axes, 2 = none
+static int interactiveAnimationStrategy = 0;
+static perf_gauge animation_strategy("profile animation strategy", [] { return (int64_t)interactiveAnimationStrategy; });
+
 // Class for animations (if any). Might want to do our own.
 class ProfileAnimation : public QAbstractAnimation {
 	ProfileScene &scene;
 	// For historical reasons, speed is actually the duration
 	// (i.e. the reciprocal of speed). Ouch, that hurts.
 	int speed;
+	QElapsedTimer frameTimer;
+	int frames;
+	int slowFrames;
+	int slowFramesInARow;
 
 	int duration() const override
 	{
@@ -36,15 +61,42 @@ class ProfileAnimation : public QAbstractAnimation {
 	}
 	void updateCurrentTime(int time) override
 	{
+		// The time between two updates includes painting the previous frame.
+		// The first one also includes the rest of plotting the dive, so ignore it.
+		if (frameTimer.isValid()) {
+			++frames;
+			if (frameTimer.restart() > frameBudget) {
+				++slowFrames;
+				++slowFramesInARow;
+			} else {
+				slowFramesInARow = 0;
+			}
+		} else {
+			frameTimer.start();
+		}
+
+		if (time != speed && slowFramesInARow >= maxSlowFramesInARow) {
+			// Rather than stuttering on, show the final state.
+			scene.anim(1.0);
+			stop();
+			scene.animationFinished(frames, slowFrames, true);
+			return;
+		}
+
 		// Note: we explicitly pass 1.0 at the end, so that
 		// the callee can do a simple float comparison for "end".
 		scene.anim(time == speed ? 1.0
 					 : static_cast<double>(time) / speed);
+		if (time == speed)
+			scene.animationFinished(frames, slowFrames, false);
 	}
 public:
 	ProfileAnimation(ProfileScene &scene, int animSpeed) :
 		scene(scene),
-		speed(animSpeed)
+		speed(animSpeed),
+		frames(0),
+		slowFrames(0),
+		slowFramesInARow(0)
 	{
 		start();
 	}
@@ -69,9 +121,9 @@ PartialPressureGasItem *ProfileScene::createPPGas(DataAccessor accessor, color_i
 }
 
 template <int IDX>
-double accessTissue(const plot_data &item)
+double accessTissue(const plot_info &pi, int idx)
 {
-	return item.ceilings[IDX];
+	return get_plot_tissue_ceiling(pi, idx, IDX);
 }
 
 // For now, the accessor functions for the profile data do not possess a payload.
@@ -94,8 +146,11 @@ ProfileScene::ProfileScene(double dpr, bool printMode, bool isGrayscale) :
 	printMode(printMode),
 	isGrayscale(isGrayscale),
 	empty(true),
+	plotInfoChanged(false),
 	maxtime(-1),
 	maxdepth(-1),
+	animationStrategy(AnimationStrategy::Full),
+	instantPlots(0),
 	profileYAxis(new DiveCartesianAxis(DiveCartesianAxis::Position::Left, true, 3, 0, TIME_GRID, Qt::red, true, true,
 				   dpr, 1.0, printMode, isGrayscale, *this)),
 	gasYAxis(new DiveCartesianAxis(DiveCartesianAxis::Position::Right, false, 1, 2, TIME_GRID, Qt::black, true, true,
@@ -111,43 +166,43 @@ ProfileScene::ProfileScene(double dpr, bool printMode, bool isGrayscale) :
 	percentageAxis(new DiveCartesianAxis(DiveCartesianAxis::Position::Right, false, 2, 0, TIME_GRID, Qt::black, false, false,
 					     dpr, 0.7, printMode, isGrayscale, *this)),
 	diveProfileItem(createItem<DiveProfileItem>(*profileYAxis,
-						    [](const plot_data &item) { return (double)item.depth; },
+						    [](const plot_info &pi, int i) { return (double)pi.entry[i].depth; },
 						    0, dpr)),
 	temperatureItem(createItem<DiveTemperatureItem>(*temperatureAxis,
-							[](const plot_data &item) { return (double)item.temperature; },
+							[](const plot_info &pi, int i) { return (double)pi.entry[i].temperature; },
 							1, dpr)),
 	meanDepthItem(createItem<DiveMeanDepthItem>(*profileYAxis,
-						    [](const plot_data &item) { return (double)item.running_sum; },
+						    [](const plot_info &pi, int i) { return (double)pi.entry[i].running_sum; },
 						    1, dpr)),
 	gasPressureItem(createItem<DiveGasPressureItem>(*cylinderPressureAxis,
-							[](const plot_data &item) { return 0.0; }, // unused
+							[](const plot_info &, int) { return 0.0; }, // unused
 							1, dpr)),
 	diveComputerText(new DiveTextItem(dpr, 1.0, Qt::AlignRight | Qt::AlignTop, nullptr)),
 	reportedCeiling(createItem<DiveReportedCeiling>(*profileYAxis,
-							[](const plot_data &item) { return (double)item.ceiling; },
+							[](const plot_info &pi, int i) { return (double)pi.entry[i].ceiling; },
 							1, dpr)),
-	pn2GasItem(createPPGas([](const plot_data &item) { return (double)item.pressures.n2; },
+	pn2GasItem(createPPGas([](const plot_info &pi, int i) { return (double)pi.entry[i].pressures.n2; },
 			       PN2, PN2_ALERT, NULL, &prefs.pp_graphs.pn2_threshold)),
-	pheGasItem(createPPGas([](const plot_data &item) { return (double)item.pressures.he; },
+	pheGasItem(createPPGas([](const plot_info &pi, int i) { return (double)pi.entry[i].pressures.he; },
 			       PHE, PHE_ALERT, NULL, &prefs.pp_graphs.phe_threshold)),
-	po2GasItem(createPPGas([](const plot_data &item) { return (double)item.pressures.o2; },
+	po2GasItem(createPPGas([](const plot_info &pi, int i) { return (double)pi.entry[i].pressures.o2; },
 			       PO2, PO2_ALERT, &prefs.pp_graphs.po2_threshold_min, &prefs.pp_graphs.po2_threshold_max)),
-	o2SetpointGasItem(createPPGas([](const plot_data &item) { return item.o2setpoint.mbar / 1000.0; },
+	o2SetpointGasItem(createPPGas([](const plot_info &pi, int i) { return pi.entry[i].o2setpoint.mbar / 1000.0; },
 				      O2SETPOINT, PO2_ALERT, &prefs.pp_graphs.po2_threshold_min, &prefs.pp_graphs.po2_threshold_max)),
-	ccrsensor1GasItem(createPPGas([](const plot_data &item) { return item.o2sensor[0].mbar / 1000.0; },
+	ccrsensor1GasItem(createPPGas([](const plot_info &pi, int i) { return get_plot_o2sensor(pi, i, 0).mbar / 1000.0; },
 				      CCRSENSOR1, PO2_ALERT, &prefs.pp_graphs.po2_threshold_min, &prefs.pp_graphs.po2_threshold_max)),
-	ccrsensor2GasItem(createPPGas([](const plot_data &item) { return item.o2sensor[1].mbar / 1000.0; },
+	ccrsensor2GasItem(createPPGas([](const plot_info &pi, int i) { return get_plot_o2sensor(pi, i, 1).mbar / 1000.0; },
 				      CCRSENSOR2, PO2_ALERT, &prefs.pp_graphs.po2_threshold_min, &prefs.pp_graphs.po2_threshold_max)),
-	ccrsensor3GasItem(createPPGas([](const plot_data &item) { return item.o2sensor[2].mbar / 1000.0; },
+	ccrsensor3GasItem(createPPGas([](const plot_info &pi, int i) { return get_plot_o2sensor(pi, i, 2).mbar / 1000.0; },
 				      CCRSENSOR3, PO2_ALERT, &prefs.pp_graphs.po2_threshold_min, &prefs.pp_graphs.po2_threshold_max)),
-	ocpo2GasItem(createPPGas([](const plot_data &item) { return item.scr_OC_pO2.mbar / 1000.0; },
+	ocpo2GasItem(createPPGas([](const plot_info &pi, int i) { return pi.entry[i].scr_OC_pO2.mbar / 1000.0; },
 				 SCR_OCPO2, PO2_ALERT, &prefs.pp_graphs.po2_threshold_min, &prefs.pp_graphs.po2_threshold_max)),
 	diveCeiling(createItem<DiveCalculatedCeiling>(*profileYAxis,
-						      [](const plot_data &item) { return (double)item.ceiling; },
+						      [](const plot_info &pi, int i) { return (double)pi.entry[i].ceiling; },
 						      1, dpr)),
 	decoModelParameters(new DiveTextItem(dpr, 1.0, Qt::AlignHCenter | Qt::AlignTop, nullptr)),
 	heartBeatItem(createItem<DiveHeartrateItem>(*heartBeatAxis,
-						    [](const plot_data &item) { return (double)item.heartbeat; },
+						    [](const plot_info &pi, int i) { return (double)pi.entry[i].heartbeat; },
 						    1, dpr)),
 	percentageItem(new DivePercentageItem(*timeAxis, *percentageAxis)),
 	tankItem(new TankItem(*timeAxis, dpr)),
@@ -404,6 +459,18 @@ static double max_gas(const plot_info &pi, double gas_pressures::*gas)
 	return ret;
 }
 
+// The expensive parts of the plot info that the current preferences show.
+static int requestedChannels()
+{
+	int channels = 0;
+	if (prefs.calcceiling || prefs.calcndltts)
+		channels |= PLOT_DECO;
+	// The info box shows the gradient factors and the tooltip shows the tissue saturation.
+	if ((prefs.calcceiling && prefs.calcalltissues) || prefs.percentagegraph || prefs.decoinfo)
+		channels |= PLOT_TISSUES;
+	return channels;
+}
+
 void ProfileScene::plotDive(const struct dive *dIn, int dcIn, DivePlannerPointsModel *plannerModel,
 			   bool inPlanner, bool instant, bool keepPlotInfo, bool calcMax, double zoom, double zoomedPosition)
 {
@@ -434,12 +501,23 @@ void ProfileScene::plotDive(const struct dive *dIn, int dcIn, DivePlannerPointsM
 		return;
 	}
 
-	// If we come from the empty state, the plot info has to be recalculated.
-	if (empty)
+	// If we come from the empty state or need more of the plot info, it has to be recalculated.
+	int channels = requestedChannels();
+	if (empty || (plotInfo.channels & channels) != channels)
 		keepPlotInfo = false;
 	empty = false;
 
 	int animSpeed = instant || printMode ? 0 : qPrefDisplay::animation_speed();
+	if (animSpeed > 0 && animationStrategy == AnimationStrategy::None) {
+		if (++instantPlots < retryAnimationAfter) {
+			animSpeed = 0;
+		} else {
+			animationStrategy = AnimationStrategy::MainAxes;
+			interactiveAnimationStrategy = (int)animationStrategy;
+		}
+	}
+	// The axes other than depth and time
+	int secondaryAnimSpeed = animationStrategy == AnimationStrategy::Full ? animSpeed : 0;
 
 	// A non-null planner_ds signals to create_plot_info_new that the dive is currently planned.
 	struct deco_state *planner_ds = inPlanner && plannerModel ? &plannerModel->final_deco_state : nullptr;
@@ -453,7 +531,13 @@ void ProfileScene::plotDive(const struct dive *dIn, int dcIn, DivePlannerPointsM
 	 * create_plot_info_new() automatically frees old plot data.
 	 */
 	if (!keepPlotInfo)
-		plotInfo = create_plot_info_new(d, currentdc, planner_ds);
+		plotInfo = create_plot_info_cached(d, currentdc, planner_ds, channels);
+	if (!keepPlotInfo || plotInfoChanged) {
+		for (AbstractProfilePolygonItem *item: profileItems)
+			item->invalidateDecimation();
+		percentageItem->invalidate();
+		plotInfoChanged = false;
+	}
 
 	bool hasHeartBeat = plotInfo.maxhr;
 	// For mobile we might want to turn of some features that are normally shown.
@@ -492,14 +576,16 @@ void ProfileScene::plotDive(const struct dive *dIn, int dcIn, DivePlannerPointsM
 
 	if (hasHeartBeat) {
 		heartBeatAxis->setBounds(plotInfo.minhr, plotInfo.maxhr);
-		heartBeatAxis->updateTicks(animSpeed);
-		animatedAxes.push_back(heartBeatAxis);
+		heartBeatAxis->updateTicks(secondaryAnimSpeed);
+		if (secondaryAnimSpeed > 0)
+			animatedAxes.push_back(heartBeatAxis);
 	}
 
 	percentageAxis->setBounds(0, 100);
 	percentageAxis->setVisible(false);
-	percentageAxis->updateTicks(animSpeed);
-	animatedAxes.push_back(percentageAxis);
+	percentageAxis->updateTicks(secondaryAnimSpeed);
+	if (secondaryAnimSpeed > 0)
+		animatedAxes.push_back(percentageAxis);
 
 	double relStart = (1.0 - 1.0/zoom) * zoomedPosition;
 	double relEnd = relStart + 1.0/zoom;
@@ -535,8 +621,9 @@ void ProfileScene::plotDive(const struct dive *dIn, int dcIn, DivePlannerPointsM
 			max = std::max(max_gas(plotInfo, &gas_pressures::o2), max);
 
 		gasYAxis->setBounds(0.0, max);
-		gasYAxis->updateTicks(animSpeed);
-		animatedAxes.push_back(gasYAxis);
+		gasYAxis->updateTicks(secondaryAnimSpeed);
+		if (secondaryAnimSpeed > 0)
+			animatedAxes.push_back(gasYAxis);
 	}
 
 	// Replot dive items
@@ -549,8 +636,21 @@ void ProfileScene::plotDive(const struct dive *dIn, int dcIn, DivePlannerPointsM
 	// The event items are a bit special since we don't know how many events are going to
 	// exist on a dive, so I cant create cache items for that. that's why they are here
 	// while all other items are up there on the constructor.
-	qDeleteAll(eventItems);
-	eventItems.clear();
+	// Items of unchanged events are kept, which matters when dragging planner handles.
+	// The other items are reused for other events, which matters for dives with thousands
+	// of events.
+	QList<DiveEventItem *> oldEventItems;
+	oldEventItems.swap(eventItems);
+	std::unordered_map<int, DiveEventItem *> oldEventItemsByIdx;
+	for (DiveEventItem *item: oldEventItems)
+		oldEventItemsByIdx.emplace(item->idx, item);
+	struct shown_event {
+		int idx;
+		const struct event &ev;
+		struct gasmix lastgasmix;
+		DiveEventItem *item;
+	};
+	std::vector<shown_event> shownEvents;
 	struct gasmix lastgasmix = d->get_gasmix_at_time(*currentdc, 1_sec);
 
 	for (auto [idx, event]: enumerated_range(currentdc->events)) {
@@ -564,16 +664,38 @@ void ProfileScene::plotDive(const struct dive *dIn, int dcIn, DivePlannerPointsM
 				continue;
 		}
 		if (DiveEventItem::isInteresting(d, currentdc, event, plotInfo, firstSecond, lastSecond)) {
-			auto item = new DiveEventItem(d, idx, event, lastgasmix, plotInfo,
-						      timeAxis, profileYAxis, animSpeed, *pixmaps);
-			item->setZValue(2);
-			addItem(item);
-			eventItems.push_back(item);
+			DiveEventItem *item = nullptr;
+			auto it = oldEventItemsByIdx.find((int)idx);
+			if (it != oldEventItemsByIdx.end() && it->second->matches(d, idx, event, lastgasmix)) {
+				item = it->second;
+				oldEventItemsByIdx.erase(it);
+			}
+			shownEvents.push_back({ (int)idx, event, lastgasmix, item });
 		}
 		if (event.is_gaschange())
 			lastgasmix = d->get_gasmix_from_event(event);
 	}
 
+	auto freeItem = oldEventItemsByIdx.begin();
+	for (shown_event &e: shownEvents) {
+		if (e.item) {
+			e.item->refresh(e.ev, plotInfo);
+		} else if (freeItem != oldEventItemsByIdx.end()) {
+			e.item = freeItem->second;
+			++freeItem;
+			e.item->set(d, e.idx, e.ev, e.lastgasmix, plotInfo, *pixmaps);
+		} else {
+			e.item = new DiveEventItem(d, e.idx, e.ev, e.lastgasmix, plotInfo,
+						   timeAxis, profileYAxis, animSpeed, *pixmaps);
+			e.item->setZValue(2);
+			addItem(e.item);
+		}
+		eventItems.push_back(e.item);
+	}
+	for (; freeItem != oldEventItemsByIdx.end(); ++freeItem)
+		delete freeItem->second;
+	cullEventItems();
+
 	QString dcText = QString::fromStdString(get_dc_nickname(currentdc));
 	if (is_dc_planner(currentdc))
 		dcText = tr("Planned dive");
@@ -593,19 +715,78 @@ void ProfileScene::plotDive(const struct dive *dIn, int dcIn, DivePlannerPointsM
 		animation = std::make_unique<ProfileAnimation>(*this, animSpeed);
 }
 
+// Rebreathers and some dive computers record thousands of setpoint changes,
+// alarms and the like. Many of their icons would be painted exactly on top of
+// each other. Only the first icon of a kind in every bucket of a few pixels is
+// shown, the others are culled.
+void ProfileScene::cullEventItems()
+{
+	const double bucketSize = 4.0 * dpr;
+	std::set<std::tuple<qint64, int, int>> buckets;
+	for (DiveEventItem *item: eventItems) {
+		item->setCulled(false);
+		if (!item->isVisible())
+			continue;
+		QPointF pos = item->pos() + item->offset();
+		auto key = std::make_tuple(item->pixmap().cacheKey(),
+					   (int)floor(pos.x() / bucketSize), (int)floor(pos.y() / bucketSize));
+		if (!buckets.insert(key).second)
+			item->setCulled(true);
+	}
+}
+
 void ProfileScene::anim(double fraction)
 {
 	for (DiveCartesianAxis *axis: animatedAxes)
 		axis->anim(fraction);
 }
 
+// Degrade the animations if they were aborted or if more than a quarter
+// of the frames were too slow. An animation of the main axes only that
+// went smoothly enables all the axes again.
+void ProfileScene::animationFinished(int frames, int slowFrames, bool aborted)
+{
+	animation_frames.add(frames);
+	animation_slow_frames.add(slowFrames);
+	if (aborted)
+		animations_aborted.add();
+
+	if (aborted || slowFrames * 4 > frames) {
+		if (animationStrategy == AnimationStrategy::Full) {
+			animationStrategy = AnimationStrategy::MainAxes;
+		} else {
+			animationStrategy = AnimationStrategy::None;
+			instantPlots = 0;
+		}
+		animations_degraded.add();
+	} else if (slowFrames == 0 && animationStrategy == AnimationStrategy::MainAxes) {
+		animationStrategy = AnimationStrategy::Full;
+	}
+	interactiveAnimationStrategy = (int)animationStrategy;
+}
+
 void ProfileScene::draw(QPainter *painter, const QRect &pos,
 			const struct dive *d, int dc,
-			DivePlannerPointsModel *plannerModel, bool inPlanner)
+			DivePlannerPointsModel *plannerModel, bool inPlanner,
+			const struct plot_info *pi)
 {
 	QSize size = pos.size();
 	resize(QSizeF(size));
-	plotDive(d, dc, plannerModel, inPlanner, true, false, true);
+	if (pi) {
+		plotInfo = *pi;
+		plotInfoChanged = true;
+		empty = false;
+	}
+	plotDive(d, dc, plannerModel, inPlanner, true, pi != nullptr, true);
+
+	// On screen, render directly with the given painter. If that is backed by
+	// the GPU (e.g. a framebuffer object on mobile), so is the rendering.
+	// Printing goes through an image, which is converted to grayscale if needed.
+	if (!printMode && !isGrayscale) {
+		painter->fillRect(pos, getColor(::BACKGROUND, isGrayscale));
+		render(painter, pos, sceneRect(), Qt::IgnoreAspectRatio);
+		return;
+	}
 
 	QImage image(pos.size(), QImage::Format_ARGB32);
 	image.fill(getColor(::BACKGROUND, isGrayscale));
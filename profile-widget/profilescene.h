@@ -40,32 +40,47 @@ public:
 	bool pointOnProfile(const QPointF &point) const;
 	void anim(double fraction); // Called by the animation with 0.0-1.0 (start to stop).
 				    // Can be compared with literal 1.0 to determine "end" state.
+	void animationFinished(int frames, int slowFrames, bool aborted); // Called by the animation when done.
 
 	// If a plannerModel is passed, the deco-information is taken from there.
 	void plotDive(const struct dive *d, int dc, DivePlannerPointsModel *plannerModel = nullptr, bool inPlanner = false,
 		      bool instant = false, bool keepPlotInfo = false, bool calcMax = true, double zoom = 1.0, double zoomedPosition = 0.0);
 
+	// If a plot info is passed, it is used instead of calculating the plot info of the dive.
 	void draw(QPainter *painter, const QRect &pos,
 		  const struct dive *d, int dc,
-		  DivePlannerPointsModel *plannerModel = nullptr, bool inPlanner = false);
+		  DivePlannerPointsModel *plannerModel = nullptr, bool inPlanner = false,
+		  const struct plot_info *pi = nullptr);
 	double calcZoomPosition(double zoom, double originalPos, double delta);
 
 	const struct dive *d;
 	int dc;
 private:
-	using DataAccessor = double (*)(const plot_data &data);
+	using DataAccessor = double (*)(const plot_info &pi, int idx);
 	template<typename T, class... Args> T *createItem(const DiveCartesianAxis &vAxis, DataAccessor accessor, int z, Args&&... args);
 	PartialPressureGasItem *createPPGas(DataAccessor accessor, color_index_t color, color_index_t colorAlert,
 					    const double *thresholdSettingsMin, const double *thresholdSettingsMax);
 	template <int ACT, int MAX> void addTissueItems(double dpr);
 	void updateVisibility(bool diveHasHeartBeat, bool simplified); // Update visibility of non-interactive chart features according to preferences
 	void updateAxes(bool diveHasHeartBeat, bool simplified); // Update axes according to preferences
+	void cullEventItems(); // Hide event icons that would be painted on top of an identical icon
+
+	// What is animated. If the animations don't keep up with the frame rate,
+	// this is degraded step by step, see animationFinished().
+	enum class AnimationStrategy {
+		Full,		// All axes
+		MainAxes,	// Only the depth and the time axes
+		None
+	};
+	AnimationStrategy animationStrategy;
+	int instantPlots; // Number of plots without animation since the strategy was degraded to None.
 
 	friend class ProfileWidget2; // For now, give the ProfileWidget full access to the objects on the scene
 	double dpr; // Device Pixel Ratio. A DPR of one corresponds to a "standard" PC screen.
 	bool printMode;
 	bool isGrayscale;
 	bool empty; // The profile currently shows nothing.
+	bool plotInfoChanged; // The plot info was set from outside, see draw().
 	int maxtime;
 	int maxdepth;
 
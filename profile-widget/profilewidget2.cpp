@@ -7,6 +7,7 @@
 #include "core/subsurface-string.h"
 #include "core/qthelper.h"
 #include "core/range.h"
+#include "core/settings/qPref.h"
 #include "core/settings/qPrefTechnicalDetails.h"
 #include "core/settings/qPrefPartialPressureGas.h"
 #include "profile-widget/diveeventitem.h"
@@ -65,6 +66,7 @@ ProfileWidget2::ProfileWidget2(DivePlannerPointsModel *plannerModelIn, double dp
 	mouseFollowerVertical(new DiveLineItem()),
 	mouseFollowerHorizontal(new DiveLineItem()),
 	rulerItem(new RulerItem2()),
+	pictureLayoutWidth(-1.0),
 #endif
 	shouldCalculateMax(true)
 {
@@ -255,6 +257,9 @@ void ProfileWidget2::divesChanged(const QVector<dive *> &dives, DiveField field)
 
 void ProfileWidget2::actionRequestedReplot(bool)
 {
+	// Replot once, when the transaction emits DiveListNotifier::settingsChanged().
+	if (qPrefTransaction::active())
+		return;
 	settingsChanged();
 }
 
@@ -687,6 +692,7 @@ void ProfileWidget2::hideOneEvent(DiveEventItem *item)
 	if (!currentdc || idx < 0 || static_cast<size_t>(idx) >= currentdc->events.size())
 		return;
 	currentdc->events[idx].hidden = true;
+	item->ev.hidden = true;
 	item->hide();
 }
 
@@ -709,7 +715,7 @@ void ProfileWidget2::unhideEvents()
 	for (auto &ev: currentdc->events)
 		ev.hidden = false;
 	for (DiveEventItem *item: profileScene->eventItems)
-		item->show();
+		item->unhide();
 }
 
 void ProfileWidget2::unhideEventTypes()
@@ -798,6 +804,7 @@ void ProfileWidget2::connectPlannerModel()
 {
 	connect(plannerModel, &DivePlannerPointsModel::dataChanged, this, &ProfileWidget2::replot);
 	connect(plannerModel, &DivePlannerPointsModel::cylinderModelEdited, this, &ProfileWidget2::replot);
+	connect(plannerModel, &DivePlannerPointsModel::planUpdated, this, &ProfileWidget2::replot);
 	connect(plannerModel, &DivePlannerPointsModel::modelReset, this, &ProfileWidget2::pointsReset);
 	connect(plannerModel, &DivePlannerPointsModel::rowsInserted, this, &ProfileWidget2::pointInserted);
 	connect(plannerModel, &DivePlannerPointsModel::rowsRemoved, this, &ProfileWidget2::pointsRemoved);
@@ -811,6 +818,7 @@ void ProfileWidget2::disconnectPlannerModel()
 	if (plannerModel) {
 		disconnect(plannerModel, &DivePlannerPointsModel::dataChanged, this, &ProfileWidget2::replot);
 		disconnect(plannerModel, &DivePlannerPointsModel::cylinderModelEdited, this, &ProfileWidget2::replot);
+		disconnect(plannerModel, &DivePlannerPointsModel::planUpdated, this, &ProfileWidget2::replot);
 
 		disconnect(plannerModel, &DivePlannerPointsModel::modelReset, this, &ProfileWidget2::pointsReset);
 		disconnect(plannerModel, &DivePlannerPointsModel::rowsInserted, this, &ProfileWidget2::pointInserted);
@@ -1044,6 +1052,7 @@ void ProfileWidget2::keyDeleteAction()
 void ProfileWidget2::clearPictures()
 {
 	pictures.clear();
+	pictureLayouts.clear();
 }
 
 static const double unscaledDurationLineWidth = 2.5;
@@ -1088,8 +1097,7 @@ void ProfileWidget2::updateThumbnail(QString filenameIn, QImage thumbnail, durat
 	// or its timestamp is outside of the profile.
 	if (it != pictures.end()) {
 		// Replace the pixmap of the thumbnail with the newly calculated one.
-		int size = Thumbnailer::defaultThumbnailSize();
-		it->thumbnail->setPixmap(QPixmap::fromImage(thumbnail.scaled(size, size, Qt::KeepAspectRatio)));
+		it->setThumbnail(thumbnail);
 
 		// If the duration changed, update the line
 		if (duration.seconds != it->duration.seconds) {
@@ -1102,20 +1110,34 @@ void ProfileWidget2::updateThumbnail(QString filenameIn, QImage thumbnail, durat
 }
 
 // Create a PictureEntry object and add its thumbnail to the scene if profile pictures are shown.
-ProfileWidget2::PictureEntry::PictureEntry(offset_t offsetIn, const std::string &filenameIn, ProfileWidget2 *profile, bool synchronous) : offset(offsetIn),
+// The thumbnail itself is fetched when the picture is shown, see updateThumbnailXPos().
+ProfileWidget2::PictureEntry::PictureEntry(offset_t offsetIn, const std::string &filenameIn, ProfileWidget2 *profile) : offset(offsetIn),
 	filename(filenameIn),
-	thumbnail(new DivePictureItem)
+	thumbnail(new DivePictureItem),
+	thumbnailFetched(false)
 {
 	QGraphicsScene *scene = profile->scene();
-	int size = Thumbnailer::defaultThumbnailSize();
 	scene->addItem(thumbnail.get());
 	thumbnail->setVisible(prefs.show_pictures_in_profile);
-	QImage img = Thumbnailer::instance()->fetchThumbnail(QString::fromStdString(filename), synchronous).scaled(size, size, Qt::KeepAspectRatio);
-	thumbnail->setPixmap(QPixmap::fromImage(img));
 	thumbnail->setFileUrl(QString::fromStdString(filename));
 	connect(thumbnail.get(), &DivePictureItem::removePicture, profile, &ProfileWidget2::removePicture);
 }
 
+void ProfileWidget2::PictureEntry::fetchThumbnail(bool synchronous)
+{
+	thumbnailFetched = true;
+	setThumbnail(Thumbnailer::instance()->fetchThumbnail(QString::fromStdString(filename), synchronous, Thumbnailer::PriorityVisible));
+}
+
+// The thumbnailer caches the thumbnails at the maximum size. On the profile, they
+// are shown at the default size when hovered and scaled down otherwise.
+void ProfileWidget2::PictureEntry::setThumbnail(const QImage &img)
+{
+	int size = Thumbnailer::defaultThumbnailSize();
+	thumbnailFetched = true;
+	thumbnail->setPixmap(QPixmap::fromImage(img.scaled(size, size, Qt::KeepAspectRatio)));
+}
+
 // Define a default sort order for picture-entries: sort lexicographically by timestamp and filename.
 bool ProfileWidget2::PictureEntry::operator< (const PictureEntry &e) const
 {
@@ -1143,27 +1165,31 @@ void ProfileWidget2::updateThumbnailPaintOrder()
 	}
 }
 
-// Calculate the y-coordinates of the thumbnails, which are supposed to be sorted by x-coordinate.
-// This will also change the order in which the thumbnails are painted, to avoid weird effects,
-// when items are added later to the scene. This is done using the QGraphicsItem::packBefore() function.
-// We can't use the z-value, because that will be modified on hoverEnter and hoverExit events.
-void ProfileWidget2::calculatePictureYPositions()
+// Stack the thumbnails that would overlap. The stacking only depends on the distance of the
+// thumbnails on the screen, therefore it is calculated for all pictures once per zoom level,
+// not for every pan. The pictures are supposed to be sorted by offset.
+const std::vector<double> &ProfileWidget2::pictureLayout()
 {
+	if (pictureLayoutWidth != profileScene->width()) {
+		pictureLayouts.clear();
+		pictureLayoutWidth = profileScene->width();
+	}
+	auto [it, inserted] = pictureLayouts.try_emplace(zoomLevel);
+	std::vector<double> &layout = it->second;
+	if (!inserted)
+		return layout;
+
 	double lastX = -1.0, lastY = 0.0;
 	const double yStart = 0.05; // At which depth the thumbnails start (in fraction of total depth).
 	const double yStep = 0.01; // Increase of depth for overlapping thumbnails (in fraction of total depth).
 	const double xSpace = 18.0 * profileScene->dpr; // Horizontal range in which thumbnails are supposed to be overlapping (in pixels).
 	const int maxDepth = 14; // Maximal depth of thumbnail stack (in thumbnails).
-	for (PictureEntry &e: pictures) {
-		// Invisible items are outside of the shown range - ignore.
-		if (!e.thumbnail->isVisible())
-			continue;
-
+	double x0 = profileScene->timeAxis->posAtValue(0.0);
+	layout.reserve(pictures.size());
+	for (const PictureEntry &e: pictures) {
 		// Let's put the picture at the correct time, but at a fixed "depth" on the profile
 		// not sure this is ideal, but it seems to look right.
-		double x = e.thumbnail->x();
-		if (x < 0.0)
-			continue;
+		double x = profileScene->timeAxis->posAtValue(e.offset.seconds) - x0;
 		double y;
 		if (lastX >= 0.0 && fabs(x - lastX) < xSpace * profileScene->dpr && lastY <= (yStart + maxDepth * yStep) - 1e-10)
 			y = lastY + yStep;
@@ -1171,14 +1197,31 @@ void ProfileWidget2::calculatePictureYPositions()
 			y = yStart;
 		lastX = x;
 		lastY = y;
-		double yScreen = profileScene->timeAxis->screenPosition(y);
+		layout.push_back(y);
+	}
+	return layout;
+}
+
+// Set the y-coordinates of the thumbnails, which are supposed to be sorted by x-coordinate.
+// This will also change the order in which the thumbnails are painted, to avoid weird effects,
+// when items are added later to the scene. This is done using the QGraphicsItem::packBefore() function.
+// We can't use the z-value, because that will be modified on hoverEnter and hoverExit events.
+void ProfileWidget2::calculatePictureYPositions()
+{
+	const std::vector<double> &layout = pictureLayout();
+	for (size_t i = 0; i < pictures.size(); ++i) {
+		PictureEntry &e = pictures[i];
+		// Invisible items are outside of the shown range - ignore.
+		if (!e.thumbnail->isVisible())
+			continue;
+		double yScreen = profileScene->timeAxis->screenPosition(layout[i]);
 		e.thumbnail->setY(yScreen);
 		updateDurationLine(e); // If we changed the y-position, we also have to change the duration-line.
 	}
 	updateThumbnailPaintOrder();
 }
 
-void ProfileWidget2::updateThumbnailXPos(PictureEntry &e)
+void ProfileWidget2::updateThumbnailXPos(PictureEntry &e, bool synchronous)
 {
 	// Here, we only set the x-coordinate of the picture. The y-coordinate
 	// will be set later in calculatePictureYPositions().
@@ -1188,6 +1231,8 @@ void ProfileWidget2::updateThumbnailXPos(PictureEntry &e)
 		double x = profileScene->timeAxis->posAtValue(time);
 		e.thumbnail->setX(x);
 		e.thumbnail->setVisible(true);
+		if (!e.thumbnailFetched)
+			e.fetchThumbnail(synchronous);
 	} else {
 		e.thumbnail->setVisible(false);
 	}
@@ -1201,7 +1246,7 @@ void ProfileWidget2::plotPictures()
 
 void ProfileWidget2::plotPicturesInternal(const struct dive *d, bool synchronous)
 {
-	pictures.clear();
+	clearPictures();
 	if (currentState == EDIT || currentState == PLAN)
 		return;
 
@@ -1213,21 +1258,21 @@ void ProfileWidget2::plotPicturesInternal(const struct dive *d, bool synchronous
 	// emplace_back() constructs an object at the end of the vector. The parameters are passed directly to the constructor.
 	for (auto &picture: d->pictures) {
 		if (picture.offset.seconds > 0 && picture.offset.seconds <= d->duration.seconds)
-			pictures.emplace_back(picture.offset, picture.filename, this, synchronous);
+			pictures.emplace_back(picture.offset, picture.filename, this);
 	}
 	if (pictures.empty())
 		return;
 	// Sort pictures by timestamp (and filename if equal timestamps).
 	// This will allow for proper location of the pictures on the profile plot.
 	std::sort(pictures.begin(), pictures.end());
-	updateThumbnails();
+	updateThumbnails(synchronous);
 }
 
-void ProfileWidget2::updateThumbnails()
+void ProfileWidget2::updateThumbnails(bool synchronous)
 {
 	// Calculate thumbnail positions. First the x-coordinates and and then the y-coordinates.
 	for (PictureEntry &e: pictures)
-		updateThumbnailXPos(e);
+		updateThumbnailXPos(e, synchronous);
 	calculatePictureYPositions();
 }
 
@@ -1244,6 +1289,7 @@ void ProfileWidget2::picturesRemoved(dive *d, QVector<QString> fileUrls)
 			// Check whether filename of entry is in list of provided filenames
 			{ return std::find(fileUrls.begin(), fileUrls.end(), QString::fromStdString(e.filename)) != fileUrls.end(); });
 	pictures.erase(it, pictures.end());
+	pictureLayouts.clear();
 	calculatePictureYPositions();
 }
 
@@ -1251,7 +1297,7 @@ void ProfileWidget2::picturesAdded(dive *d, QVector<picture> pics)
 {
 	for (const picture &pic: pics) {
 		if (pic.offset.seconds > 0 && pic.offset.seconds <= d->duration.seconds) {
-			pictures.emplace_back(pic.offset, pic.filename, this, false);
+			pictures.emplace_back(pic.offset, pic.filename, this);
 			updateThumbnailXPos(pictures.back());
 		}
 	}
@@ -1260,6 +1306,7 @@ void ProfileWidget2::picturesAdded(dive *d, QVector<picture> pics)
 	// This will allow for proper location of the pictures on the profile plot.
 	std::sort(pictures.begin(), pictures.end());
 
+	pictureLayouts.clear();
 	calculatePictureYPositions();
 }
 
@@ -1347,6 +1394,7 @@ void ProfileWidget2::pictureOffsetChanged(dive *dIn, QString filenameIn, offset_
 		}
 
 		// In both cases the picture list changed, therefore we must recalculate the y-coordinatesA.
+		pictureLayouts.clear();
 		calculatePictureYPositions();
 	} else {
 		// Cases 2a) and 2b): picture not on profile. We only have to take action for
@@ -1362,8 +1410,9 @@ void ProfileWidget2::pictureOffsetChanged(dive *dIn, QString filenameIn, offset_
 			// The parameters are passed directly to the contructor.
 			// The call returns an iterator to the new element (which might differ from
 			// the old iterator, since the buffer might have been reallocated).
-			newPos = pictures.emplace(newPos, offset, filename, this, false);
+			newPos = pictures.emplace(newPos, offset, filename, this);
 			updateThumbnailXPos(*newPos);
+			pictureLayouts.clear();
 			calculatePictureYPositions();
 		}
 	}
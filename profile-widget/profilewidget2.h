@@ -3,6 +3,7 @@
 #define PROFILEWIDGET2_H
 
 #include <QGraphicsView>
+#include <map>
 #include <vector>
 #include <memory>
 
@@ -120,7 +121,7 @@ private:
 	struct plot_data *getEntryFromPos(QPointF pos);
 	void clearPictures();
 	void plotPicturesInternal(const struct dive *d, bool synchronous);
-	void updateThumbnails();
+	void updateThumbnails(bool synchronous = false);
 	void addDivemodeSwitch(int seconds, int divemode);
 	void addBookmark(int seconds);
 	void splitDive(int seconds);
@@ -160,18 +161,27 @@ private:
 	// The list of pictures in this plot. The pictures are sorted by offset in seconds.
 	// For the same offset, sort by filename.
 	// Pictures that are outside of the dive time are not shown.
+	// The thumbnail is only fetched once the picture is in the shown time range.
 	struct PictureEntry {
 		offset_t offset;
 		duration_t duration;
 		std::string filename;
 		std::unique_ptr<DivePictureItem> thumbnail;
+		bool thumbnailFetched;
 		// For videos with known duration, we represent the duration of the video by a line
 		std::unique_ptr<QGraphicsRectItem> durationLine;
-		PictureEntry (offset_t offsetIn, const std::string &filenameIn, ProfileWidget2 *profile, bool synchronous);
+		PictureEntry (offset_t offsetIn, const std::string &filenameIn, ProfileWidget2 *profile);
 		bool operator< (const PictureEntry &e) const;
+		void fetchThumbnail(bool synchronous);
+		void setThumbnail(const QImage &img);
 	};
-	void updateThumbnailXPos(PictureEntry &e);
+	void updateThumbnailXPos(PictureEntry &e, bool synchronous = false);
 	std::vector<PictureEntry> pictures;
+	// The y-positions of the thumbnails (in fraction of total depth) for each zoom level,
+	// in the order of the pictures. Must be cleared when the list of pictures changes.
+	std::map<int, std::vector<double>> pictureLayouts;
+	double pictureLayoutWidth; // The width of the scene the layouts were calculated for.
+	const std::vector<double> &pictureLayout();
 	void calculatePictureYPositions();
 	void updateDurationLine(PictureEntry &e);
 	void updateThumbnailPaintOrder();
@@ -7,9 +7,64 @@
 #include "core/subsurface-float.h"
 #include "core/metrics.h"
 #include "core/subsurface-string.h"
+#include "core/settings/qPrefDisplay.h"
+#include "core/settings/qPrefPartialPressureGas.h"
+#include "core/settings/qPrefTechnicalDetails.h"
+#include "core/settings/qPrefUnit.h"
 #include <QTransform>
 #include <QScreen>
 #include <QElapsedTimer>
+#include <QMetaMethod>
+#include <QPainter>
+#include <QQuickWindow>
+#include <QSGRendererInterface>
+#include <algorithm>
+#include <deque>
+
+// Rendering a profile is expensive, but the picture only depends on the dive,
+// the dive computer, the size and the preferences. Therefore, keep the pictures
+// of the last few dives. This is shared by all profile items, so that swiping
+// back to a dive, whose item has been destroyed in the meantime, rotating the
+// phone back and forth and zooming (which repaints on every step) don't render
+// the profile again.
+struct CachedProfile {
+	int diveId;
+	int dc;
+	QSize size;
+	qreal dpr;
+	QImage image;
+};
+static const size_t profileCacheSize = 5;
+static std::deque<CachedProfile> profileCache; // most recently used first
+
+static const QImage *findCachedProfile(int diveId, int dc, QSize size, qreal dpr)
+{
+	auto it = std::find_if(profileCache.begin(), profileCache.end(), [&](const CachedProfile &p)
+			       { return p.diveId == diveId && p.dc == dc && p.size == size && p.dpr == dpr; });
+	if (it == profileCache.end())
+		return nullptr;
+	if (it != profileCache.begin()) {
+		CachedProfile p = std::move(*it);
+		profileCache.erase(it);
+		profileCache.push_front(std::move(p));
+	}
+	return &profileCache.front().image;
+}
+
+static const QImage *cacheProfile(int diveId, int dc, QSize size, qreal dpr, QImage image)
+{
+	if (profileCache.size() >= profileCacheSize)
+		profileCache.pop_back();
+	profileCache.push_front(CachedProfile { diveId, dc, size, dpr, std::move(image) });
+	return &profileCache.front().image;
+}
+
+static void dropCachedProfiles(int diveId)
+{
+	profileCache.erase(std::remove_if(profileCache.begin(), profileCache.end(),
+					  [diveId](const CachedProfile &p) { return p.diveId == diveId; }),
+			   profileCache.end());
+}
 
 QMLProfile::QMLProfile(QQuickItem *parent) :
 	QQuickPaintedItem(parent),
@@ -22,10 +77,34 @@ QMLProfile::QMLProfile(QQuickItem *parent) :
 {
 	createProfileView();
 	setAntialiasing(true);
+	// With an OpenGL scene graph, paint into a framebuffer object, i.e. on the GPU,
+	// instead of painting into an image that is uploaded as texture on every update.
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+	if (QQuickWindow::graphicsApi() == QSGRendererInterface::OpenGL)
+#else
+	if (QQuickWindow::sceneGraphBackend().isEmpty())
+#endif
+		setRenderTarget(QQuickPaintedItem::FramebufferObject);
 	setFlags(QQuickItem::ItemClipsChildrenToShape | QQuickItem::ItemHasContents );
 	connect(QMLManager::instance(), &QMLManager::sendScreenChanged, this, &QMLProfile::screenChanged);
 	connect(this, &QMLProfile::scaleChanged, this, &QMLProfile::triggerUpdate);
 	connect(&diveListNotifier, &DiveListNotifier::divesChanged, this, &QMLProfile::divesChanged);
+	connect(&diveListNotifier, &DiveListNotifier::dataReset, this, &QMLProfile::dataReset);
+
+	// Any of the preferences that go into the profile outdates the cached pictures.
+	QMetaMethod slot = metaObject()->method(metaObject()->indexOfSlot("settingsChanged()"));
+	std::initializer_list<const QObject *> prefs = {
+		qPrefDisplay::instance(), qPrefPartialPressureGas::instance(),
+		qPrefTechnicalDetails::instance(), qPrefUnits::instance()
+	};
+	for (const QObject *pref: prefs) {
+		const QMetaObject *meta = pref->metaObject();
+		for (int i = meta->methodOffset(); i < meta->methodCount(); ++i) {
+			QMetaMethod method = meta->method(i);
+			if (method.methodType() == QMetaMethod::Signal)
+				connect(pref, method, this, slot);
+		}
+	}
 	setDevicePixelRatio(QMLManager::instance()->lastDevicePixelRatio());
 }
 
@@ -59,12 +138,24 @@ void QMLProfile::paint(QPainter *painter)
 	// in applying that dpr scaling twice. So we hard-code it here to be the identity matrix
 	QRect painterRect = painter->viewport();
 	painter->resetTransform();
-	if (m_diveId < 0)
+	if (m_diveId < 0 || painterRect.isEmpty())
 		return;
-	struct dive *d = divelog.dives.get_by_uniq_id(m_diveId);
-	if (!d)
-		return;
-	m_profileWidget->draw(painter, painterRect, d, m_dc, nullptr, false);
+	const QImage *image = findCachedProfile(m_diveId, m_dc, painterRect.size(), m_devicePixelRatio);
+	if (!image) {
+		struct dive *d = divelog.dives.get_by_uniq_id(m_diveId);
+		if (!d)
+			return;
+		QImage rendered(painterRect.size(), QImage::Format_ARGB32_Premultiplied);
+		QPainter imgPainter(&rendered);
+		imgPainter.setRenderHint(QPainter::Antialiasing);
+		imgPainter.setRenderHint(QPainter::TextAntialiasing);
+		m_profileWidget->draw(&imgPainter, rendered.rect(), d, m_dc, nullptr, false);
+		imgPainter.end();
+		image = cacheProfile(m_diveId, m_dc, painterRect.size(), m_devicePixelRatio, std::move(rendered));
+	}
+	painter->drawImage(painterRect, *image);
+	if (verbose)
+		report_info("profile of dive %d painted in %lld ms", m_diveId, (long long)timer.elapsed());
 }
 
 void QMLProfile::setMargin(int margin)
@@ -123,6 +214,10 @@ void QMLProfile::screenChanged(QScreen *screen)
 
 void QMLProfile::divesChanged(const QVector<dive *> &dives, DiveField)
 {
+	// Every profile item gets this signal, but removing the stale
+	// pictures from the cache a second time doesn't hurt.
+	for (struct dive *d: dives)
+		dropCachedProfiles(d->id);
 	for (struct dive *d: dives) {
 		if (d->id == m_diveId) {
 			report_info("dive #%d changed, trigger profile update", d->number);
@@ -132,6 +227,18 @@ void QMLProfile::divesChanged(const QVector<dive *> &dives, DiveField)
 	}
 }
 
+void QMLProfile::dataReset()
+{
+	profileCache.clear();
+	triggerUpdate();
+}
+
+void QMLProfile::settingsChanged()
+{
+	profileCache.clear();
+	triggerUpdate();
+}
+
 void QMLProfile::nextDC()
 {
 	rotateDC(1);
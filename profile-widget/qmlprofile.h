@@ -36,6 +36,7 @@ public slots:
 	void setMargin(int margin);
 	void screenChanged(QScreen *screen);
 	void triggerUpdate();
+	void settingsChanged();
 
 private:
 	int m_diveId;
@@ -50,6 +51,7 @@ private:
 
 private slots:
 	void divesChanged(const QVector<dive *> &dives, DiveField);
+	void dataReset();
 
 signals:
 	void rightAlignedChanged();
@@ -4,8 +4,7 @@
 #include "core/settings/qPrefTechnicalDetails.h"
 
 #include <qgraphicssceneevent.h>
-
-#include "core/profile.h"
+#include <algorithm>
 
 RulerNodeItem2::RulerNodeItem2() :
 	pInfo(NULL),
@@ -44,9 +43,10 @@ void RulerNodeItem2::recalculate()
 	} else if (x() > timeAxis->posAtValue(last.sec)) {
 		setPos(timeAxis->posAtValue(last.sec), depthAxis->posAtValue(last.depth));
 	} else {
-		idx = 0;
-		while (idx < pInfo->nr && timeAxis->posAtValue(pInfo->entry[idx].sec) < x())
-			++idx;
+		// The entries are sorted by time: find the first one at or after the node.
+		auto it = std::partition_point(pInfo->entry.begin(), pInfo->entry.begin() + pInfo->nr,
+					       [this](const plot_data &entry) { return timeAxis->posAtValue(entry.sec) < x(); });
+		idx = std::min((int)(it - pInfo->entry.begin()), pInfo->nr - 1);
 		const struct plot_data &data = pInfo->entry[idx];
 		setPos(timeAxis->posAtValue(data.sec), depthAxis->posAtValue(data.depth));
 	}
@@ -63,6 +63,7 @@ void RulerNodeItem2::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 }
 
 RulerItem2::RulerItem2() : pInfo(NULL),
+	rangeIndexValid(false),
 	source(new RulerNodeItem2()),
 	dest(new RulerNodeItem2()),
 	timeAxis(NULL),
@@ -112,8 +113,15 @@ void RulerItem2::recalculate()
 	QLineF line(startPoint, endPoint);
 	setLine(line);
 
+	// Only build the index if there is a ruler to show: setVisible() recalculates.
+	if (!isVisible())
+		return;
+	if (!rangeIndexValid) {
+		rangeIndex = plot_range_index(dive, *pInfo);
+		rangeIndexValid = true;
+	}
 	QString text;
-	for (const std::string &s: compare_samples(dive, *pInfo, source->idx, dest->idx, 1)) {
+	for (const std::string &s: compare_samples(dive, *pInfo, rangeIndex, source->idx, dest->idx, 1)) {
 		if (!text.isEmpty())
 			text += '\n';
 		text += QString::fromStdString(s);
@@ -155,6 +163,7 @@ void RulerItem2::setPlotInfo(const struct dive *d, const plot_info &info)
 {
 	dive = d;
 	pInfo = &info;
+	rangeIndexValid = false;
 	dest->setPlotInfo(info);
 	source->setPlotInfo(info);
 	dest->recalculate();
@@ -178,4 +187,6 @@ void RulerItem2::setVisible(bool visible)
 	QGraphicsLineItem::setVisible(visible);
 	source->setVisible(visible);
 	dest->setVisible(visible);
+	if (visible)
+		recalculate();
 }
@@ -6,9 +6,8 @@
 #include <QGraphicsEllipseItem>
 #include <QGraphicsObject>
 #include "profile-widget/divecartesianaxis.h"
+#include "core/profile.h"
 
-struct plot_data;
-struct plot_info;
 class RulerItem2;
 
 class RulerNodeItem2 : public QObject, public QGraphicsEllipseItem {
@@ -49,6 +48,8 @@ slots:
 private:
 	const struct dive *dive;
 	const struct plot_info *pInfo;
+	plot_range_index rangeIndex;	// built on first use after setPlotInfo()
+	bool rangeIndexValid;
 	QPointF startPoint, endPoint;
 	RulerNodeItem2 *source, *dest;
 	QString text;
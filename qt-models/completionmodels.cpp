@@ -4,7 +4,6 @@
 #include "core/divelist.h"
 #include "core/divelog.h"
 #include "core/tag.h"
-#include <QSet>
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
 #define SKIP_EMPTY Qt::SkipEmptyParts
@@ -16,36 +15,94 @@ CompletionModelBase::CompletionModelBase()
 {
 	connect(&diveListNotifier, &DiveListNotifier::dataReset, this, &CompletionModelBase::updateModel);
 	connect(&diveListNotifier, &DiveListNotifier::divesImported, this, &CompletionModelBase::updateModel);
+	connect(&diveListNotifier, &DiveListNotifier::divesAdded, this, &CompletionModelBase::divesAdded);
+	connect(&diveListNotifier, &DiveListNotifier::divesDeleted, this, &CompletionModelBase::divesDeleted);
 	connect(&diveListNotifier, &DiveListNotifier::divesChanged, this, &CompletionModelBase::divesChanged);
 }
 
+void CompletionModelBase::addDive(const dive *d)
+{
+	if (strings.contains(d))
+		return;
+	QStringList list = getStrings(*d);
+	for (const QString &s: list) {
+		if (counts[s]++ == 0)
+			stringsChanged = true;
+	}
+	strings.insert(d, std::move(list));
+}
+
+void CompletionModelBase::removeDive(const dive *d)
+{
+	auto it = strings.find(d);
+	if (it == strings.end())
+		return;
+	for (const QString &s: *it) {
+		auto count = counts.find(s);
+		if (count != counts.end() && --*count <= 0) {
+			counts.erase(count);
+			stringsChanged = true;
+		}
+	}
+	strings.erase(it);
+}
+
+void CompletionModelBase::updateStringList()
+{
+	if (!stringsChanged)
+		return;
+	QStringList list = counts.keys();
+	std::sort(list.begin(), list.end());
+	setStringList(list);
+	stringsChanged = false;
+}
+
 void CompletionModelBase::updateModel()
 {
-	setStringList(getStrings());
+	counts.clear();
+	strings.clear();
+	for (auto &d: divelog.dives)
+		addDive(d.get());
+	stringsChanged = true;
+	updateStringList();
 }
 
-void CompletionModelBase::divesChanged(const QVector<dive *> &, DiveField field)
+void CompletionModelBase::divesAdded(dive_trip *, bool, const QVector<dive *> &dives)
 {
-	if (relevantDiveField(field))
-		updateModel();
+	for (const dive *d: dives)
+		addDive(d);
+	updateStringList();
 }
 
-static QStringList getCSVList(const std::string dive::*item)
+void CompletionModelBase::divesDeleted(dive_trip *, bool, const QVector<dive *> &dives)
 {
-	QSet<QString> set;
-	for (auto &dive: divelog.dives) {
-		QString str = QString::fromStdString(dive.get()->*item);
-		for (const QString &value: str.split(",", SKIP_EMPTY))
-			set.insert(value.trimmed());
+	for (const dive *d: dives)
+		removeDive(d);
+	updateStringList();
+}
+
+void CompletionModelBase::divesChanged(const QVector<dive *> &dives, DiveField field)
+{
+	if (!relevantDiveField(field))
+		return;
+	for (const dive *d: dives) {
+		removeDive(d);
+		addDive(d);
 	}
-	QStringList setList = set.values();
-	std::sort(setList.begin(), setList.end());
-	return setList;
+	updateStringList();
 }
 
-QStringList BuddyCompletionModel::getStrings()
+static QStringList getCSVList(const std::string &item)
 {
-	return getCSVList(&dive::buddy);
+	QStringList res;
+	for (const QString &value: QString::fromStdString(item).split(",", SKIP_EMPTY))
+		res.push_back(value.trimmed());
+	return res;
+}
+
+QStringList BuddyCompletionModel::getStrings(const dive &d)
+{
+	return getCSVList(d.buddy);
 }
 
 bool BuddyCompletionModel::relevantDiveField(const DiveField &f)
@@ -53,9 +110,9 @@ bool BuddyCompletionModel::relevantDiveField(const DiveField &f)
 	return f.buddy;
 }
 
-QStringList DiveGuideCompletionModel::getStrings()
+QStringList DiveGuideCompletionModel::getStrings(const dive &d)
 {
-	return getCSVList(&dive::diveguide);
+	return getCSVList(d.diveguide);
 }
 
 bool DiveGuideCompletionModel::relevantDiveField(const DiveField &f)
@@ -63,16 +120,9 @@ bool DiveGuideCompletionModel::relevantDiveField(const DiveField &f)
 	return f.diveguide;
 }
 
-QStringList SuitCompletionModel::getStrings()
+QStringList SuitCompletionModel::getStrings(const dive &d)
 {
-	QStringList list;
-	for (auto &dive: divelog.dives) {
-		QString suit = QString::fromStdString(dive->suit);
-		if (!list.contains(suit))
-			list.append(suit);
-	}
-	std::sort(list.begin(), list.end());
-	return list;
+	return { QString::fromStdString(d.suit) };
 }
 
 bool SuitCompletionModel::relevantDiveField(const DiveField &f)
@@ -80,16 +130,24 @@ bool SuitCompletionModel::relevantDiveField(const DiveField &f)
 	return f.suit;
 }
 
-QStringList TagCompletionModel::getStrings()
+TagCompletionModel::TagCompletionModel()
+{
+	connect(&diveListNotifier, &DiveListNotifier::dataReset, this, &TagCompletionModel::updateModel);
+	connect(&diveListNotifier, &DiveListNotifier::divesImported, this, &TagCompletionModel::updateModel);
+	connect(&diveListNotifier, &DiveListNotifier::divesChanged, this, &TagCompletionModel::divesChanged);
+}
+
+void TagCompletionModel::updateModel()
 {
 	QStringList list;
 	for (const std::unique_ptr<divetag> &tag: g_tag_list)
 		list.append(QString::fromStdString(tag->name));
 	std::sort(list.begin(), list.end());
-	return list;
+	setStringList(list);
 }
 
-bool TagCompletionModel::relevantDiveField(const DiveField &f)
+void TagCompletionModel::divesChanged(const QVector<dive *> &, DiveField field)
 {
-	return f.tags;
+	if (field.tags)
+		updateModel();
 }
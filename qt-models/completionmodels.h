@@ -3,48 +3,64 @@
 #define COMPLETIONMODELS_H
 
 #include "core/subsurface-qt/divelistnotifier.h"
+#include <QHash>
 #include <QStringListModel>
 
 struct dive;
 
+// The completions are collected from the dives. To avoid rescanning all dives
+// when a single dive changes, every string is counted and the strings a dive
+// contributed are remembered, so that they can be removed again.
 class CompletionModelBase : public QStringListModel {
 	Q_OBJECT
 public:
 	CompletionModelBase();
 private slots:
 	void updateModel();
+	void divesAdded(dive_trip *trip, bool addTrip, const QVector<dive *> &dives);
+	void divesDeleted(dive_trip *trip, bool deleteTrip, const QVector<dive *> &dives);
 	void divesChanged(const QVector<dive *> &dives, DiveField field);
 protected:
-	virtual QStringList getStrings() = 0;
+	virtual QStringList getStrings(const dive &d) = 0;
 	virtual bool relevantDiveField(const DiveField &f) = 0;
+private:
+	void addDive(const dive *d);
+	void removeDive(const dive *d);
+	void updateStringList();
+	QHash<QString, int> counts;
+	QHash<const dive *, QStringList> strings; // the strings of every dive
+	bool stringsChanged = false; // set if a string was added or removed
 };
 
 class BuddyCompletionModel final : public CompletionModelBase {
 	Q_OBJECT
 private:
-	QStringList getStrings() override;
+	QStringList getStrings(const dive &d) override;
 	bool relevantDiveField(const DiveField &f) override;
 };
 
 class DiveGuideCompletionModel final : public CompletionModelBase {
 	Q_OBJECT
 private:
-	QStringList getStrings() override;
+	QStringList getStrings(const dive &d) override;
 	bool relevantDiveField(const DiveField &f) override;
 };
 
 class SuitCompletionModel final : public CompletionModelBase {
 	Q_OBJECT
 private:
-	QStringList getStrings() override;
+	QStringList getStrings(const dive &d) override;
 	bool relevantDiveField(const DiveField &f) override;
 };
 
-class TagCompletionModel final : public CompletionModelBase {
+// The tags are taken from the global tag list, not from the dives.
+class TagCompletionModel final : public QStringListModel {
 	Q_OBJECT
-private:
-	QStringList getStrings() override;
-	bool relevantDiveField(const DiveField &f) override;
+public:
+	TagCompletionModel();
+private slots:
+	void updateModel();
+	void divesChanged(const QVector<dive *> &dives, DiveField field);
 };
 
 #endif // COMPLETIONMODELS_H
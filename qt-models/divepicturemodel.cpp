@@ -12,6 +12,7 @@
 
 #include <QFileInfo>
 #include <QPainter>
+#include <algorithm>
 
 PictureEntry::PictureEntry(dive *dIn, const picture &p) : d(dIn),
 	filename(p.filename),
@@ -101,6 +102,22 @@ int DivePictureModel::columnCount(const QModelIndex&) const
 	return 2;
 }
 
+// The view asks only for the decoration of the pictures it shows. Move
+// these and their neighbours to the front of the thumbnailing queue, so
+// that the pictures on screen don't wait for the ones scrolled out of view.
+void DivePictureModel::prioritizeThumbnails(int row) const
+{
+	const int neighbours = 4;
+	int from = std::max(row - neighbours, 0);
+	int to = std::min(row + neighbours + 1, (int)pictures.size());
+	Thumbnailer *thumbnailer = Thumbnailer::instance();
+	for (int i = from; i < to; ++i) {
+		if (i != row)
+			thumbnailer->prioritize(QString::fromStdString(pictures[i].filename), Thumbnailer::PriorityNeighbour);
+	}
+	thumbnailer->prioritize(QString::fromStdString(pictures[row].filename), Thumbnailer::PriorityVisible);
+}
+
 QVariant DivePictureModel::data(const QModelIndex &index, int role) const
 {
 	if (!index.isValid())
@@ -112,6 +129,7 @@ QVariant DivePictureModel::data(const QModelIndex &index, int role) const
 		case Qt::ToolTipRole:
 			return QString::fromStdString(entry.filename);
 		case Qt::DecorationRole:
+			prioritizeThumbnails(index.row());
 			return entry.image.scaled(size, size, Qt::KeepAspectRatio);
 		case Qt::DisplayRole:
 			return QFileInfo(QString::fromStdString(entry.filename)).fileName();
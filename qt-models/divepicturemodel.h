@@ -42,6 +42,7 @@ private:
 	double zoomLevel;	// -1.0: minimum, 0.0: standard, 1.0: maximum
 	int size;
 	void updateThumbnails();
+	void prioritizeThumbnails(int row) const;
 	void updateZoom();
 };
 
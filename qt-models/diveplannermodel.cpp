@@ -36,6 +36,7 @@ static double unit_factor()
 }
 
 static constexpr int decotimestep = 60; // seconds
+static constexpr int recalculationDelay = 50; // ms
 
 CylindersModel *DivePlannerPointsModel::cylindersModel()
 {
@@ -243,6 +244,11 @@ void DivePlannerPointsModel::addCylinder_clicked()
 void DivePlannerPointsModel::setPlanMode(Mode m)
 {
 	mode = m;
+	if (m == NOTHING) {
+		recalculationTimer.stop();
+		recalculationPending = false;
+		++instanceCounter;
+	}
 	// the planner may reset our GF settings that are used to show deco
 	// reset them to what's in the preferences
 	if (m != PLAN) {
@@ -500,6 +506,13 @@ DivePlannerPointsModel::DivePlannerPointsModel(QObject *parent) : QAbstractTable
 	mode(NOTHING)
 {
 	startTime.setTimeSpec(Qt::UTC);
+
+	// The temporary plan is recalculated by a single worker thread.
+	recalculationPool.setMaxThreadCount(1);
+	recalculationTimer.setSingleShot(true);
+	recalculationTimer.setInterval(recalculationDelay);
+	connect(&recalculationTimer, &QTimer::timeout, this, &DivePlannerPointsModel::startRecalculation);
+
 	// use a Qt-connection to send the variations text across thread boundary (in case we
 	// are calculating the variations in a background thread).
 	connect(this, &DivePlannerPointsModel::variationsComputed, this, &DivePlannerPointsModel::computeVariationsDone);
@@ -1110,29 +1123,126 @@ static bool shouldComputeVariations()
 	return prefs.display_variations && decoMode(true) != RECREATIONAL;
 }
 
+// Everything a recalculation of the temporary plan needs, so that it can be
+// done on the worker thread without touching the model or the planned dive.
+struct DivePlannerPointsModel::PlanJob {
+	std::unique_ptr<struct dive> dive;
+	struct diveplan plan;
+	struct plan_checkpoints checkpoints;
+	struct deco_state ds;
+	int dcNr;
+	bool isPlanner;
+	int instance;
+};
+
+static void runPlanJob(DivePlannerPointsModel::PlanJob &job)
+{
+	deco_state_cache cache;
+
+	// Only the segments after a moved waypoint have to be recalculated
+	plan(&job.ds, job.plan, job.dive.get(), job.dcNr, decotimestep, cache, job.isPlanner, false, &job.checkpoints);
+}
+
 void DivePlannerPointsModel::updateDiveProfile()
 {
 	if (!d)
 		return;
+
+	// The plan changed: the plans and variations that are still being computed are stale.
+	++instanceCounter;
+
+	// When editing a profile, the caller creates an undo command
+	// from the dive right away. Therefore, only plan in the background
+	// in the planner.
+	if (!isPlanner()) {
+		std::unique_ptr<PlanJob> job = createPlanJob();
+		if (!job)
+			return;
+		runPlanJob(*job);
+		publishPlanJob(std::move(job));
+		return;
+	}
+
+	// Coalesce the changes of the next few milliseconds, e.g. when the
+	// user drags a waypoint or keeps a spinbox button pressed.
+	if (!recalculationTimer.isActive())
+		recalculationTimer.start();
+}
+
+std::unique_ptr<DivePlannerPointsModel::PlanJob> DivePlannerPointsModel::createPlanJob()
+{
 	createTemporaryPlan();
 	if (diveplan.is_empty())
+		return {};
+
+	auto job = std::make_unique<PlanJob>();
+	job->dive = std::make_unique<struct dive>();
+	copy_dive(d, job->dive.get());
+	job->plan = diveplan;
+	job->checkpoints = checkpoints;
+	job->dcNr = dcNr;
+	job->isPlanner = isPlanner();
+	job->instance = instanceCounter;
+	return job;
+}
+
+void DivePlannerPointsModel::startRecalculation()
+{
+	if (!d || mode == NOTHING)
 		return;
 
-	deco_state_cache cache;
-	struct deco_state plan_deco_state;
+	// Only one plan at a time: the plan that is running is
+	// most likely stale by now, so don't queue behind it.
+	if (recalculationRunning) {
+		recalculationPending = true;
+		return;
+	}
+
+	std::unique_ptr<PlanJob> job = createPlanJob();
+	if (!job)
+		return;
+
+	// As for the variations below, QtConcurrent::run() copies the lambda, so
+	// pass the job as a raw pointer (see the comment in publishPlanJob()).
+	recalculationRunning = true;
+	QtConcurrent::run(&recalculationPool, [this, job = job.release()] () {
+		runPlanJob(*job);
+		QMetaObject::invokeMethod(this, [this, job] () { recalculationFinished(std::unique_ptr<PlanJob>(job)); },
+					  Qt::QueuedConnection);
+	});
+}
+
+void DivePlannerPointsModel::recalculationFinished(std::unique_ptr<PlanJob> job)
+{
+	recalculationRunning = false;
+	if (job->instance == instanceCounter && d && mode != NOTHING)
+		publishPlanJob(std::move(job));
 
-	plan(&plan_deco_state, diveplan, d, dcNr, decotimestep, cache, isPlanner(), false);
+	if (recalculationPending) {
+		recalculationPending = false;
+		startRecalculation();
+	}
+}
+
+// Apply the result of a recalculation to the planned dive. Only the result
+// of the latest change is applied: the inputs of the plan are taken from
+// the planned dive, which might have changed in the meantime.
+void DivePlannerPointsModel::publishPlanJob(std::unique_ptr<PlanJob> job)
+{
+	*d = *job->dive;
+	diveplan = job->plan;
+	checkpoints = std::move(job->checkpoints);
 	updateMaxDepth();
 
-	if (isPlanner() && shouldComputeVariations()) {
+	if (job->isPlanner && shouldComputeVariations()) {
 		auto plan_copy = std::make_unique<struct diveplan>();
-		lock_planner();
-		*plan_copy = diveplan;
-		unlock_planner();
+		*plan_copy = job->plan;
+		int instance = job->instance;
 #ifdef VARIATIONS_IN_BACKGROUND
-		// Since we're calling computeVariations asynchronously and plan_deco_state is allocated
-		// on the stack, it must be copied and freed by the worker-thread.
-		auto deco_copy = std::make_unique<deco_state>(plan_deco_state);
+		// Since we're calling computeVariations asynchronously and the job is owned
+		// by this function, the deco state and the dive must be copied and freed
+		// by the worker-thread.
+		auto deco_copy = std::make_unique<deco_state>(job->ds);
 
 		// Ideally, we would pass the unique_ptrs to the lambda for QtConcurrent::run().
 		// This, in principle, can be done as such:
@@ -1145,15 +1255,17 @@ void DivePlannerPointsModel::updateDiveProfile()
 		//	exceptions anyway.
 		// Note 2: We also can't use the function / argument syntax of QtConcurrent::run(),
 		//	because it likewise uses copy-semantics. How annoying.
-		QtConcurrent::run([this, plan = plan_copy.release(), deco = deco_copy.release()] ()
+		QtConcurrent::run([this, plan = plan_copy.release(), deco = deco_copy.release(), dive = job->dive.release(), instance] ()
 				  { this->computeVariationsFreeDeco(std::unique_ptr<struct diveplan>(plan),
-								    std::unique_ptr<deco_state>(deco)); });
+								    std::unique_ptr<deco_state>(deco),
+								    std::unique_ptr<struct dive>(dive), instance); });
 #else
-		computeVariations(std::move(plan_copy), &plan_deco_state);
+		computeVariations(std::move(plan_copy), &job->ds, job->dive.get(), instance);
 #endif
-		final_deco_state = plan_deco_state;
+		final_deco_state = job->ds;
 	}
 	emit calculatedPlanNotes(QString::fromStdString(d->notes));
+	emit planUpdated();
 
 #if DEBUG_PLAN
 	save_dive(stderr, *d);
@@ -1194,10 +1306,11 @@ int DivePlannerPointsModel::analyzeVariations(const std::vector<decostop> &min,
 	return (leftsum + rightsum) / 2;
 }
 
-void DivePlannerPointsModel::computeVariationsFreeDeco(std::unique_ptr<struct diveplan> original_plan, std::unique_ptr<struct deco_state> previous_ds)
+void DivePlannerPointsModel::computeVariationsFreeDeco(std::unique_ptr<struct diveplan> original_plan, std::unique_ptr<struct deco_state> previous_ds,
+							std::unique_ptr<struct dive> dive, int instance)
 {
-	computeVariations(std::move(original_plan), previous_ds.get());
-	// Note: previous ds automatically free()d by virtue of being a unique_ptr.
+	computeVariations(std::move(original_plan), previous_ds.get(), dive.get(), instance);
+	// Note: previous ds and dive automatically free()d by virtue of being unique_ptrs.
 }
 
 // Return reference to second to last element.
@@ -1208,21 +1321,13 @@ auto &second_to_last(T &v)
 	return *std::prev(std::prev(v.end()));
 }
 
-void DivePlannerPointsModel::computeVariations(std::unique_ptr<struct diveplan> original_plan, const struct deco_state *previous_ds)
+void DivePlannerPointsModel::computeVariations(std::unique_ptr<struct diveplan> original_plan, const struct deco_state *previous_ds, const struct dive *dive,
+						int instance)
 {
 	// nothing to do unless there's an original plan
-	if (!original_plan)
+	if (!original_plan || original_plan->dp.size() < 2)
 		return;
 
-	auto dive = std::make_unique<struct dive>();
-	copy_dive(d, dive.get());
-	deco_state_cache cache, save;
-	struct diveplan plan_copy;
-	struct deco_state ds = *previous_ds;
-
-	int my_instance = ++instanceCounter;
-	save.cache(&ds);
-
 	duration_t delta_time = 1_min;
 	QString time_units = tr("min");
 	depth_t delta_depth;
@@ -1236,55 +1341,46 @@ void DivePlannerPointsModel::computeVariations(std::unique_ptr<struct diveplan>
 		depth_units = tr("ft");
 	}
 
-	plan_copy = *original_plan;
-	if (plan_copy.dp.size() < 2)
-		return;
-	if (my_instance != instanceCounter)
-		return;
-	auto original = plan(&ds, plan_copy, dive.get(), dcNr, 1, cache, true, false);
-	save.restore(&ds, false);
-
-	plan_copy = *original_plan;
-	second_to_last(plan_copy.dp).depth.mm += delta_depth.mm;
-	plan_copy.dp.back().depth.mm += delta_depth.mm;
-	if (my_instance != instanceCounter)
-		return;
-	auto deeper = plan(&ds, plan_copy, dive.get(), dcNr, 1, cache, true, false);
-	save.restore(&ds, false);
-
-	second_to_last(plan_copy.dp).depth.mm -= delta_depth.mm;
-	plan_copy.dp.back().depth.mm -= delta_depth.mm;
-	if (my_instance != instanceCounter)
+	// The five variations are independent: plan them concurrently, each
+	// on its own copy of the dive and the deco state.
+	enum { ORIGINAL, DEEPER, SHALLOWER, LONGER, SHORTER };
+	std::vector<struct diveplan> variants(5, *original_plan);
+	second_to_last(variants[DEEPER].dp).depth.mm += delta_depth.mm;
+	variants[DEEPER].dp.back().depth.mm += delta_depth.mm;
+	second_to_last(variants[SHALLOWER].dp).depth.mm -= delta_depth.mm;
+	variants[SHALLOWER].dp.back().depth.mm -= delta_depth.mm;
+	variants[LONGER].dp.back().time += delta_time.seconds;
+	variants[SHORTER].dp.back().time -= delta_time.seconds;
+
+	// A plan that is already running can't be interrupted, but the
+	// ones that haven't started are skipped once the plan was edited.
+	auto cancelled = [this, instance]() { return instance != instanceCounter; };
+	auto res = plan_variants(previous_ds, variants, dive, dcNr, 1, cancelled);
+	if (cancelled())
 		return;
-	auto shallower = plan(&ds, plan_copy, dive.get(), dcNr, 1, cache, true, false);
-	save.restore(&ds, false);
-
-	plan_copy = *original_plan;
-	plan_copy.dp.back().time += delta_time.seconds;
-	if (my_instance != instanceCounter)
-		return;
-	auto longer = plan(&ds, plan_copy, dive.get(), dcNr, 1, cache, true, false);
-	save.restore(&ds, false);
-
-	plan_copy.dp.back().time -= delta_time.seconds;
-	if (my_instance != instanceCounter)
-		return;
-	auto shorter = plan(&ds, plan_copy, dive.get(), dcNr, 1, cache, true, false);
-	save.restore(&ds, false);
+	const auto &original = res[ORIGINAL].stops;
+	const auto &deeper = res[DEEPER].stops;
+	const auto &shallower = res[SHALLOWER].stops;
+	const auto &longer = res[LONGER].stops;
+	const auto &shorter = res[SHORTER].stops;
 
 	std::string buf = format_string_std(", %s: %c %d:%02d /%s %c %d:%02d /min", qPrintable(tr("Stop times")),
 		SIGNED_FRAC_TRIPLET(analyzeVariations(shallower, original, deeper, qPrintable(depth_units)), 60), qPrintable(depth_units),
 		SIGNED_FRAC_TRIPLET(analyzeVariations(shorter, original, longer, qPrintable(time_units)), 60));
 
 	// By using a signal, we can transport the variations to the main thread.
-	emit variationsComputed(QString::fromStdString(buf));
+	emit variationsComputed(QString::fromStdString(buf), instance);
 #ifdef DEBUG_STOPVAR
 	printf("\n\n");
 #endif
 }
 
-void DivePlannerPointsModel::computeVariationsDone(QString variations)
+void DivePlannerPointsModel::computeVariationsDone(QString variations, int instance)
 {
+	// The plan changed while the variations were in the event queue.
+	if (instance != instanceCounter)
+		return;
+
 	QString notes = QString::fromStdString(d->notes);
 	notes = notes.replace("VARIATIONS", variations);
 	d->notes = notes.toStdString();
@@ -1303,7 +1399,11 @@ static void addDive(dive *d, bool autogroup, bool newNumber)
 
 void DivePlannerPointsModel::createPlan(bool saveAsNew)
 {
-	// Ok, so, here the diveplan creates a dive
+	// Ok, so, here the diveplan creates a dive. Drop the
+	// results of the recalculations that are still running.
+	recalculationTimer.stop();
+	recalculationPending = false;
+	++instanceCounter;
 	deco_state_cache cache;
 	removeDeco();
 	createTemporaryPlan();
@@ -1312,10 +1412,8 @@ void DivePlannerPointsModel::createPlan(bool saveAsNew)
 
 	if (shouldComputeVariations()) {
 		auto plan_copy = std::make_unique<struct diveplan>();
-		lock_planner();
 		*plan_copy = diveplan;
-		unlock_planner();
-		computeVariations(std::move(plan_copy), &ds_after_previous_dives);
+		computeVariations(std::move(plan_copy), &ds_after_previous_dives, d, instanceCounter);
 	}
 
 	// Fixup planner notes.
@@ -4,6 +4,9 @@
 
 #include <QAbstractTableModel>
 #include <QDateTime>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -46,6 +49,7 @@ public:
 	Mode currentMode() const;
 	bool tankInUse(int cylinderid) const;
 	CylindersModel *cylindersModel();
+	struct PlanJob;
 
 	int ascrate75Display() const;
 	int ascrate50Display() const;
@@ -115,7 +119,8 @@ signals:
 	void cylinderModelEdited();
 	void recreationChanged(bool);
 	void calculatedPlanNotes(QString);
-	void variationsComputed(QString);
+	void planUpdated();		// The planned dive was recalculated
+	void variationsComputed(QString, int instance);
 
 private:
 	explicit DivePlannerPointsModel(QObject *parent = 0);
@@ -130,9 +135,15 @@ private:
 	void updateDiveProfile(); // Creates a temporary plan and updates the dive profile with it.
 	void createTemporaryPlan();
 	struct diveplan diveplan;
-	void computeVariationsDone(QString text);
-	void computeVariations(std::unique_ptr<struct diveplan> plan, const struct deco_state *ds);
-	void computeVariationsFreeDeco(std::unique_ptr<struct diveplan> plan, std::unique_ptr<struct deco_state> ds);
+	struct plan_checkpoints checkpoints; // tissues of the last temporary plan, see updateDiveProfile()
+	void computeVariationsDone(QString text, int instance);
+	void computeVariations(std::unique_ptr<struct diveplan> plan, const struct deco_state *ds, const struct dive *dive, int instance);
+	void computeVariationsFreeDeco(std::unique_ptr<struct diveplan> plan, std::unique_ptr<struct deco_state> ds,
+				       std::unique_ptr<struct dive> dive, int instance);
+	std::unique_ptr<PlanJob> createPlanJob();
+	void startRecalculation();
+	void recalculationFinished(std::unique_ptr<PlanJob> job);
+	void publishPlanJob(std::unique_ptr<PlanJob> job);
 	int analyzeVariations(const std::vector<decostop> &min, const std::vector<decostop> &mid, const std::vector<decostop> &max, const char *unit);
 	struct dive *d;
 	int dcNr;
@@ -140,9 +151,13 @@ private:
 	Mode mode;
 	QVector<divedatapoint> divepoints;
 	QDateTime startTime;
-	int instanceCounter = 0;
+	std::atomic<int> instanceCounter { 0 };	// bumped whenever the plan changes, cancels running plans and variations
 	struct deco_state ds_after_previous_dives;
 	duration_t preserved_until;
+	QTimer recalculationTimer;
+	bool recalculationRunning = false;
+	bool recalculationPending = false;	// the plan changed while recalculating
+	QThreadPool recalculationPool;		// last member: waits for the worker on destruction
 };
 
 #endif
@@ -1,17 +1,108 @@
 #include "divesiteimportmodel.h"
 #include "core/divelog.h"
+#include "core/divesiteindex.h"
 #include "core/qthelper.h"
 #include "core/range.h"
 #include "core/taxonomy.h"
+#include "core/subsurface-qt/divelistnotifier.h"
+
+#include <QtConcurrent>
 
 DivesiteImportedModel::DivesiteImportedModel(dive_site_table &table, QObject *o) : QAbstractTableModel(o),
 	firstIndex(0),
 	lastIndex(-1),
 	importedSitesTable(table)
 {
+	dive_site_index index(divelog.sites);
 	checkStates.resize(importedSitesTable.size());
 	for (const auto &[row, item]: enumerated_range(importedSitesTable))
-		checkStates[row] = !divelog.sites.get_by_gps(&item->location);
+		checkStates[row] = !index.get_by_gps(item->location);
+
+	connect(&nearestWatcher, &QFutureWatcher<std::vector<NearestSite>>::finished, this, &DivesiteImportedModel::nearestSearchFinished);
+	connect(&diveListNotifier, &DiveListNotifier::diveSiteAdded, this, &DivesiteImportedModel::startNearestSearch);
+	connect(&diveListNotifier, &DiveListNotifier::diveSiteDeleted, this, &DivesiteImportedModel::startNearestSearch);
+	startNearestSearch();
+
+	// Fill in the taxonomy of the imported sites that have none
+	std::vector<location_t> locations;
+	for (const auto &[row, item]: enumerated_range(importedSitesTable)) {
+		if (has_location(&item->location) && item->taxonomy.empty()) {
+			geoLookupRows.push_back(row);
+			locations.push_back(item->location);
+		}
+	}
+	connect(&geoLookup, &ReverseGeoLookup::found, this, &DivesiteImportedModel::geoLookupFound);
+	if (!locations.empty())
+		geoLookup.lookup(locations);
+}
+
+DivesiteImportedModel::~DivesiteImportedModel()
+{
+	cancelNearestSearch();
+}
+
+void DivesiteImportedModel::cancelNearestSearch()
+{
+	nearestCancelled = true;
+	nearestWatcher.waitForFinished();
+	nearestCancelled = false;
+}
+
+// The index takes copies of the locations of the existing sites, thus the
+// search doesn't access the dive sites. It is restarted when sites are added or removed.
+void DivesiteImportedModel::startNearestSearch()
+{
+	cancelNearestSearch();
+	if (!nearest.empty()) {
+		nearest.clear();
+		if (rowCount() > 0)
+			dataChanged(index(0, NEAREST), index(rowCount() - 1, DISTANCE));
+	}
+
+	auto siteIndex = std::make_shared<dive_site_index>(divelog.sites);
+	std::vector<location_t> locations;
+	locations.reserve(importedSitesTable.size());
+	for (const auto &ds: importedSitesTable)
+		locations.push_back(ds->location);
+	nearestWatcher.setFuture(QtConcurrent::run([this, siteIndex, locations = std::move(locations)] () {
+		std::vector<NearestSite> res;
+		res.reserve(locations.size());
+		for (const location_t &loc: locations) {
+			if (nearestCancelled)
+				return std::vector<NearestSite>();
+			NearestSite site { nullptr, 0 };
+			// 40075000 is circumference of the earth in meters
+			site.ds = siteIndex->get_by_gps_proximity(loc, 40075000, &site.distance);
+			res.push_back(site);
+		}
+		return res;
+	}));
+}
+
+void DivesiteImportedModel::nearestSearchFinished()
+{
+	nearest = nearestWatcher.result();
+	if (nearest.size() != importedSitesTable.size()) {
+		nearest.clear();	// canceled
+		return;
+	}
+	if (rowCount() > 0)
+		dataChanged(index(0, NEAREST), index(rowCount() - 1, DISTANCE));
+}
+
+void DivesiteImportedModel::geoLookupFound(int index, const taxonomy_data &taxonomy)
+{
+	int row = geoLookupRows[index];
+	if (row >= (int)importedSitesTable.size() || !importedSitesTable[row])
+		return;
+	importedSitesTable[row]->taxonomy = taxonomy;
+	dataChanged(this->index(row, COUNTRY), this->index(row, COUNTRY));
+}
+
+// To be called before the imported sites are taken out of the table.
+void DivesiteImportedModel::stopGeoLookup()
+{
+	geoLookup.cancel();
 }
 
 int DivesiteImportedModel::columnCount(const QModelIndex &) const
@@ -66,23 +157,17 @@ QVariant DivesiteImportedModel::data(const QModelIndex &index, int role) const
 			return printGPSCoords(&ds->location);
 		case COUNTRY:
 			return QString::fromStdString(taxonomy_get_country(ds->taxonomy));
-		case NEAREST: {
-			// 40075000 is circumference of the earth in meters
-			struct dive_site *nearest_ds =
-				divelog.sites.get_by_gps_proximity(ds->location, 40075000);
-			if (nearest_ds)
-				return QString::fromStdString(nearest_ds->name);
+		case NEAREST:
+			if (index.row() < (int)nearest.size() && nearest[index.row()].ds)
+				return QString::fromStdString(nearest[index.row()].ds->name);
+			else
+				return QString();
+		case DISTANCE:
+			// Until the search finished, don't show a distance of 0
+			if (index.row() < (int)nearest.size())
+				return distance_string(nearest[index.row()].ds ? nearest[index.row()].distance : 0);
 			else
 				return QString();
-		}
-		case DISTANCE: {
-			unsigned int distance = 0;
-			struct dive_site *nearest_ds =
-				divelog.sites.get_by_gps_proximity(ds->location, 40075000);
-			if (nearest_ds)
-				distance = get_distance(ds->location, nearest_ds->location);
-			return distance_string(distance);
-		}
 		case SELECTED:
 			return checkStates[index.row()];
 		}
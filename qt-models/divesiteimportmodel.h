@@ -2,8 +2,11 @@
 #define DIVESITEIMPORTEDMODEL_H
 
 #include <QAbstractTableModel>
+#include <QFutureWatcher>
+#include <atomic>
 #include <vector>
 #include "core/divesite.h"
+#include "core/divesitehelpers.h"
 
 class DivesiteImportedModel : public QAbstractTableModel
 {
@@ -12,6 +15,7 @@ public:
 	enum columnNames { NAME, LOCATION, COUNTRY, NEAREST, DISTANCE, SELECTED };
 
 	DivesiteImportedModel(dive_site_table &, QObject *parent = 0);
+	~DivesiteImportedModel();
 	int columnCount(const QModelIndex& index = QModelIndex()) const override;
 	int rowCount(const QModelIndex& index = QModelIndex()) const override;
 	QVariant data(const QModelIndex& index, int role) const override;
@@ -23,12 +27,28 @@ slots:
 	void selectRow(int row);
 	void selectAll();
 	void selectNone();
+	void stopGeoLookup();
 
 private:
 	int firstIndex;
 	int lastIndex;
 	std::vector<char> checkStates; // char instead of bool to avoid silly pessimization of std::vector.
 	dive_site_table &importedSitesTable;
+	ReverseGeoLookup geoLookup;
+	std::vector<int> geoLookupRows; // the imported sites that are looked up
+	void geoLookupFound(int index, const taxonomy_data &taxonomy);
+
+	// The nearest existing site of each imported site, searched in the background.
+	struct NearestSite {
+		dive_site *ds;
+		unsigned int distance;
+	};
+	std::vector<NearestSite> nearest;	// empty until the search finished
+	QFutureWatcher<std::vector<NearestSite>> nearestWatcher;
+	std::atomic<bool> nearestCancelled { false };
+	void startNearestSearch();
+	void cancelNearestSearch();
+	void nearestSearchFinished();
 };
 
 #endif
@@ -267,6 +267,65 @@ QString DiveTripModelBase::getDescription(int column)
 	}
 }
 
+// The number, OTU and CNS are not formatted, and the latter two also change when
+// other dives are edited without a notification for this dive. Don't cache them.
+static bool isCachedColumn(int column)
+{
+	return column >= 0 && column < DiveTripModelBase::COLUMNS &&
+	       column != DiveTripModelBase::NR && column != DiveTripModelBase::OTU &&
+	       column != DiveTripModelBase::MAXCNS && column != DiveTripModelBase::PHOTOS;
+}
+
+QVariant DiveTripModelBase::diveDisplayData(const struct dive *d, int column)
+{
+	switch (column) {
+	case NR:
+		return d->number;
+	case DATE:
+		return get_dive_date_string(d->when);
+	case DEPTH:
+		return get_depth_string(d->maxdepth, prefs.units.show_units_table);
+	case DURATION:
+		return displayDuration(d);
+	case TEMPERATURE:
+		return displayTemperature(d, prefs.units.show_units_table);
+	case TOTALWEIGHT:
+		return displayWeight(d, prefs.units.show_units_table);
+	case SUIT:
+		return QString::fromStdString(d->suit);
+	case CYLINDER:
+		return !d->cylinders.empty() ? QString::fromStdString(d->cylinders[0].type.description) : QString();
+	case SAC:
+		return displaySac(d, prefs.units.show_units_table);
+	case OTU:
+		return d->otu;
+	case MAXCNS:
+		if (prefs.units.show_units_table)
+			return QString("%1%").arg(d->maxcns);
+		else
+			return d->maxcns;
+	case TAGS:
+		return QString::fromStdString(taglist_get_tagstring(d->tags));
+	case PHOTOS:
+		break;
+	case COUNTRY:
+		return QString::fromStdString(d->get_country());
+	case BUDDIES:
+		return QString::fromStdString(d->buddy);
+	case DIVEGUIDE:
+		return QString::fromStdString(d->diveguide);
+	case LOCATION:
+		return QString::fromStdString(d->get_location());
+	case GAS:
+		return formatDiveGasString(d);
+	case NOTES:
+		return QString::fromStdString(d->notes);
+	case DIVEMODE:
+		return QString(divemode_text_ui[(int)d->dcs[0].divemode]);
+	}
+	return QVariant();
+}
+
 QVariant DiveTripModelBase::diveData(const struct dive *d, int column, int role) const
 {
 #ifdef SUBSURFACE_MOBILE
@@ -318,53 +377,17 @@ QVariant DiveTripModelBase::diveData(const struct dive *d, int column, int role)
 		return d->invalid ? invalidForeground : QVariant();
 	case Qt::TextAlignmentRole:
 		return dive_table_alignment(column);
-	case Qt::DisplayRole:
-		switch (column) {
-		case NR:
-			return d->number;
-		case DATE:
-			return get_dive_date_string(d->when);
-		case DEPTH:
-			return get_depth_string(d->maxdepth, prefs.units.show_units_table);
-		case DURATION:
-			return displayDuration(d);
-		case TEMPERATURE:
-			return displayTemperature(d, prefs.units.show_units_table);
-		case TOTALWEIGHT:
-			return displayWeight(d, prefs.units.show_units_table);
-		case SUIT:
-			return QString::fromStdString(d->suit);
-		case CYLINDER:
-			return !d->cylinders.empty() ? QString::fromStdString(d->cylinders[0].type.description) : QString();
-		case SAC:
-			return displaySac(d, prefs.units.show_units_table);
-		case OTU:
-			return d->otu;
-		case MAXCNS:
-			if (prefs.units.show_units_table)
-				return QString("%1%").arg(d->maxcns);
-			else
-				return d->maxcns;
-		case TAGS:
-			return QString::fromStdString(taglist_get_tagstring(d->tags));
-		case PHOTOS:
-			break;
-		case COUNTRY:
-			return QString::fromStdString(d->get_country());
-		case BUDDIES:
-			return QString::fromStdString(d->buddy);
-		case DIVEGUIDE:
-			return QString::fromStdString(d->diveguide);
-		case LOCATION:
-			return QString::fromStdString(d->get_location());
-		case GAS:
-			return formatDiveGasString(d);
-		case NOTES:
-			return QString::fromStdString(d->notes);
-		case DIVEMODE:
-			return QString(divemode_text_ui[(int)d->dcs[0].divemode]);
-		}
-		break;
+	case Qt::DisplayRole: {
+		if (!isCachedColumn(column))
+			return diveDisplayData(d, column);
+		auto it = displayCache.find(d);
+		if (it == displayCache.end())
+			it = displayCache.emplace(d, std::array<QVariant, COLUMNS>()).first;
+		QVariant &res = it->second[column];
+		if (!res.isValid())
+			res = diveDisplayData(d, column);
+		return res;
+	}
 	case Qt::DecorationRole:
 		switch (column) {
 		//TODO: ADD A FLAG
@@ -478,6 +501,7 @@ void DiveTripModelBase::reset()
 {
 	beginResetModel();
 	oldCurrent = nullptr;
+	clearDisplayCache();
 	clearData();
 	populate();
 	uiNotification(tr("finish populating data store"));
@@ -491,6 +515,82 @@ DiveTripModelBase::DiveTripModelBase(QObject *parent) : QAbstractItemModel(paren
 	invalidForeground(Qt::gray)
 {
 	invalidFont.setStrikeOut(true);
+
+	// These are connected before the signals of the derived classes, so that the
+	// cache is updated before the views are told to redraw the changed dives.
+	auto diveChanged = [this](dive *d) { dropCachedDive(d); };
+	connect(&diveListNotifier, &DiveListNotifier::dataReset, this, &DiveTripModelBase::clearDisplayCache);
+	connect(&diveListNotifier, &DiveListNotifier::settingsChanged, this, &DiveTripModelBase::clearDisplayCache);
+	connect(&diveListNotifier, &DiveListNotifier::divesChanged, this, &DiveTripModelBase::invalidateDisplayCache);
+	connect(&diveListNotifier, &DiveListNotifier::divesTimeChanged, this,
+		[this](timestamp_t, const QVector<dive *> &dives) { invalidateDisplayCache(dives); });
+	connect(&diveListNotifier, &DiveListNotifier::divesDeleted, this,
+		[this](dive_trip *, bool, const QVector<dive *> &dives) { invalidateDisplayCache(dives); });
+	connect(&diveListNotifier, &DiveListNotifier::diveSiteChanged, this, &DiveTripModelBase::clearDisplayCache);
+	connect(&diveListNotifier, &DiveListNotifier::cylindersReset, this, &DiveTripModelBase::invalidateDisplayCache);
+	connect(&diveListNotifier, &DiveListNotifier::cylinderAdded, this, diveChanged);
+	connect(&diveListNotifier, &DiveListNotifier::cylinderEdited, this, diveChanged);
+	connect(&diveListNotifier, &DiveListNotifier::cylinderRemoved, this, diveChanged);
+	connect(&diveListNotifier, &DiveListNotifier::weightsystemsReset, this, &DiveTripModelBase::invalidateDisplayCache);
+	connect(&diveListNotifier, &DiveListNotifier::weightAdded, this, diveChanged);
+	connect(&diveListNotifier, &DiveListNotifier::weightEdited, this, diveChanged);
+	connect(&diveListNotifier, &DiveListNotifier::weightRemoved, this, diveChanged);
+	connect(&diveListNotifier, &DiveListNotifier::eventsChanged, this, diveChanged);
+	connect(&diveListNotifier, &DiveListNotifier::diveComputerEdited, this, &DiveTripModelBase::clearDisplayCache);
+}
+
+void DiveTripModelBase::invalidateDisplayCache(const QVector<dive *> &dives)
+{
+	for (const dive *d: dives)
+		dropCachedDive(d);
+}
+
+void DiveTripModelBase::dropCachedDive(const dive *d)
+{
+	displayCache.erase(d);
+	for (auto &keys: sortKeyCache)
+		keys.erase(d);
+}
+
+void DiveTripModelBase::clearDisplayCache()
+{
+	displayCache.clear();
+	for (auto &keys: sortKeyCache)
+		keys.clear();
+}
+
+// The string a text column is sorted by.
+static std::string sortString(const dive *d, int column)
+{
+	switch (column) {
+	case DiveTripModelBase::SUIT:
+		return d->suit;
+	case DiveTripModelBase::CYLINDER:
+		return d->cylinders.empty() ? std::string() : d->cylinders[0].type.description;
+	case DiveTripModelBase::TAGS:
+		return taglist_get_tagstring(d->tags);
+	case DiveTripModelBase::BUDDIES:
+		return d->buddy;
+	case DiveTripModelBase::DIVEGUIDE:
+		return d->diveguide;
+	case DiveTripModelBase::COUNTRY:
+		return d->get_country();
+	case DiveTripModelBase::LOCATION:
+		return d->get_location();
+	case DiveTripModelBase::NOTES:
+		return d->notes;
+	default:
+		return std::string();
+	}
+}
+
+const QCollatorSortKey &DiveTripModelBase::sortKey(const dive *d, int column) const
+{
+	auto &keys = sortKeyCache[column];
+	auto it = keys.find(d);
+	if (it == keys.end())
+		it = keys.emplace(d, collator.sortKey(QString::fromStdString(sortString(d, column)))).first;
+	return it->second;
 }
 
 int DiveTripModelBase::columnCount(const QModelIndex&) const
@@ -706,8 +806,8 @@ void DiveTripModelTree::populate()
 	// we want this to be two calls as the second text is overwritten below by the lines starting with "\r"
 	uiNotification(QObject::tr("populate data model"));
 	uiNotification(QObject::tr("start processing"));
+	divelog.dives.update_all_cylinder_related_info();
 	for (auto &d: divelog.dives) {
-		divelog.dives.update_cylinder_related_info(*d);
 		if (d->hidden_by_filter)
 			continue;
 		dive_trip *trip = d->divetrip;
@@ -867,8 +967,11 @@ void processByTrip(QVector<dive *> dives, Function action)
 void DiveTripModelTree::filterReset()
 {
 	ShownChange change = updateShownAll();
+	if (!change.newHidden.empty())
+		removeHiddenTopLevel();
+	// The hidden top-level dives and trips are gone. What remains are hidden dives of shown trips.
 	processByTrip(change.newHidden, [this] (dive_trip *trip, const QVector<dive *> &divesInTrip)
-		      { divesHidden(trip, divesInTrip); });
+		      { if (trip && findTripIdx(trip) >= 0) divesHidden(trip, divesInTrip); });
 	processByTrip(change.newShown, [this] (dive_trip *trip, const QVector<dive *> &divesInTrip)
 		      { divesShown(trip, divesInTrip); });
 
@@ -897,6 +1000,27 @@ void DiveTripModelTree::divesShown(dive_trip *trip, const QVector<dive *> &dives
 	}
 }
 
+// Remove the top-level dives that are hidden by the filter and the trips
+// whose dives are all hidden. This is done in one pass, so that neighbouring
+// items are removed with a single signal, even if some of them are trips and
+// others are dives. A filter change may hide thousands of items at once.
+void DiveTripModelTree::removeHiddenTopLevel()
+{
+	processRanges(items,
+		      [](const Item &item) -> int { // Condition
+			if (dive *d = item.getDive())
+				return d->hidden_by_filter;
+			return std::all_of(item.dives.begin(), item.dives.end(),
+					   [](const dive *d) { return d->hidden_by_filter; });
+		      },
+		      [&](std::vector<Item> &items, int from, int to) -> int { // Action
+			beginRemoveRows(QModelIndex(), from, to - 1);
+			items.erase(items.begin() + from, items.begin() + to);
+			endRemoveRows();
+			return from - to; // Delta: negate the number of items deleted
+		      });
+}
+
 void DiveTripModelTree::divesHidden(dive_trip *trip, const QVector<dive *> &dives)
 {
 	if (dives.empty())
@@ -1002,21 +1126,37 @@ void DiveTripModelTree::addDivesToTrip(int trip, const QVector<dive *> &dives)
 	topLevelChanged(trip);
 }
 
+// The items are sorted, therefore we first try a binary search. However, while
+// processing changes, the order may be broken temporarily (e.g. if the time of
+// a trip changed). Therefore, fall back to a linear search if that fails.
+int DiveTripModelTree::findTopLevelIdx(dive_or_trip d_or_t) const
+{
+	auto it = std::lower_bound(items.begin(), items.end(), d_or_t,
+				   [] (const Item &item, dive_or_trip d_or_t)
+				   { return dive_or_trip_less_than(item.d_or_t, d_or_t); });
+	if (it != items.end() && it->d_or_t.dive == d_or_t.dive && it->d_or_t.trip == d_or_t.trip)
+		return it - items.begin();
+	return index_of_if(items, [d_or_t] (const Item &item)
+				  { return item.d_or_t.dive == d_or_t.dive && item.d_or_t.trip == d_or_t.trip; });
+}
+
 int DiveTripModelTree::findTripIdx(const dive_trip *trip) const
 {
-	return index_of_if(items, [trip] (const Item &item)
-				  { return item.d_or_t.trip == trip; });
+	return findTopLevelIdx(dive_or_trip { nullptr, (dive_trip *)trip });
 }
 
 int DiveTripModelTree::findDiveIdx(const dive *d) const
 {
-	return index_of_if(items, [d] (const Item &item)
-				  { return item.isDive(d); });
+	return findTopLevelIdx(dive_or_trip { (dive *)d, nullptr });
 }
 
 int DiveTripModelTree::findDiveInTrip(int tripIdx, const dive *d) const
 {
-	return index_of(items[tripIdx].dives, d);
+	const std::vector<dive *> &dives = items[tripIdx].dives;
+	auto it = std::lower_bound(dives.begin(), dives.end(), d, &dive_less_than_ptr);
+	if (it != dives.end() && *it == d)
+		return it - dives.begin();
+	return index_of(dives, d);
 }
 
 int DiveTripModelTree::findInsertionIndex(const dive_trip *trip) const
@@ -1391,9 +1531,8 @@ void DiveTripModelTree::divesSelectedTrip(dive_trip *trip, const QVector<dive *>
 {
 	if (!trip) {
 		// This is at the top level.
-		// Since both lists are sorted, we can do this linearly. Perhaps a binary search
-		// would be better?
-		int j = 0; // Index in items array
+		// Since both lists are sorted, we can do this linearly, starting at the first dive.
+		int j = dives.empty() ? 0 : std::max(findDiveIdx(dives.front()), 0); // Index in items array
 		for (struct dive *dive: dives) {
 			while (j < (int)items.size() && !items[j].isDive(dive))
 				++j;
@@ -1411,9 +1550,8 @@ void DiveTripModelTree::divesSelectedTrip(dive_trip *trip, const QVector<dive *>
 			return;
 		}
 		// Locate the indices inside the trip.
-		// Since both lists are sorted, we can do this linearly. Perhaps a binary search
-		// would be better?
-		int j = 0; // Index in items array
+		// Since both lists are sorted, we can do this linearly, starting at the first dive.
+		int j = dives.empty() ? 0 : std::max(findDiveInTrip(idx, dives.front()), 0); // Index in items array
 		const Item &entry = items[idx];
 		for (struct dive *dive: dives) {
 			while (j < (int)entry.dives.size() && entry.dives[j] != dive)
@@ -1707,10 +1845,6 @@ static bool lessThanHelper(int diff1, int diff2)
 	return diff1 < 0 || (diff1 == 0 && diff2 < 0);
 }
 
-static int strCmp(const std::string &s1, const std::string &s2)
-{
-	return QString::localeAwareCompare(QString::fromStdString(s1), QString::fromStdString(s2)); // TODO: avoid copy
-}
 
 bool DiveTripModelList::lessThan(const QModelIndex &i1, const QModelIndex &i2) const
 {
@@ -1723,6 +1857,7 @@ bool DiveTripModelList::lessThan(const QModelIndex &i1, const QModelIndex &i2) c
 	const dive *d2 = items[row2];
 	// This is used as a second sort criterion: For equal values, sorting is chronologically *descending*.
 	int row_diff = row2 - row1;
+	auto strCmp = [this, d1, d2](int column) { return sortKey(d1, column).compare(sortKey(d2, column)); };
 	switch (i1.column()) {
 	case NR:
 	case DATE:
@@ -1739,10 +1874,10 @@ bool DiveTripModelList::lessThan(const QModelIndex &i1, const QModelIndex &i2) c
 	case TOTALWEIGHT:
 		return lessThanHelper(d1->total_weight().grams - d2->total_weight().grams, row_diff);
 	case SUIT:
-		return lessThanHelper(strCmp(d1->suit, d2->suit), row_diff);
+		return lessThanHelper(strCmp(SUIT), row_diff);
 	case CYLINDER:
 		if (!d1->cylinders.empty() && !d2->cylinders.empty())
-			return lessThanHelper(strCmp(d1->cylinders[0].type.description, d2->cylinders[0].type.description), row_diff);
+			return lessThanHelper(strCmp(CYLINDER), row_diff);
 		return d1->cylinders.size() < d2->cylinders.size();
 	case GAS:
 		return lessThanHelper(nitrox_sort_value(d1) - nitrox_sort_value(d2), row_diff);
@@ -1752,24 +1887,20 @@ bool DiveTripModelList::lessThan(const QModelIndex &i1, const QModelIndex &i2) c
 		return lessThanHelper(d1->otu - d2->otu, row_diff);
 	case MAXCNS:
 		return lessThanHelper(d1->maxcns - d2->maxcns, row_diff);
-	case TAGS: {
-		std::string s1 = taglist_get_tagstring(d1->tags);
-		std::string s2 = taglist_get_tagstring(d2->tags);
-		int diff = strCmp(s1, s2);
-		return lessThanHelper(diff, row_diff);
-	}
+	case TAGS:
+		return lessThanHelper(strCmp(TAGS), row_diff);
 	case PHOTOS:
 		return lessThanHelper(countPhotos(d1) - countPhotos(d2), row_diff);
 	case COUNTRY:
-		return lessThanHelper(strCmp(d1->get_country(), d2->get_country()), row_diff);
+		return lessThanHelper(strCmp(COUNTRY), row_diff);
 	case BUDDIES:
-		return lessThanHelper(strCmp(d1->buddy, d2->buddy), row_diff);
+		return lessThanHelper(strCmp(BUDDIES), row_diff);
 	case DIVEGUIDE:
-		return lessThanHelper(strCmp(d1->diveguide, d2->diveguide), row_diff);
+		return lessThanHelper(strCmp(DIVEGUIDE), row_diff);
 	case LOCATION:
-		return lessThanHelper(strCmp(d1->get_location(), d2->get_location()), row_diff);
+		return lessThanHelper(strCmp(LOCATION), row_diff);
 	case NOTES:
-		return lessThanHelper(strCmp(d1->notes, d2->notes), row_diff);
+		return lessThanHelper(strCmp(NOTES), row_diff);
 	case DIVEMODE:
 		return lessThanHelper((int)d1->dcs[0].divemode - (int)d2->dcs[0].divemode, row_diff);
 	}
@@ -6,7 +6,10 @@
 #include "core/subsurface-qt/divelistnotifier.h"
 #include <QAbstractItemModel>
 #include <QBrush>
+#include <QCollator>
 #include <QFont>
+#include <array>
+#include <unordered_map>
 
 class DiveFilter;
 
@@ -94,12 +97,28 @@ protected:
 
 	// Access trip and dive data
 	QVariant diveData(const struct dive *d, int column, int role) const;	// Not static because we have to access invalidFont
+	static QVariant diveDisplayData(const struct dive *d, int column);
 	static QVariant tripData(const dive_trip *trip, int column, int role);
 	static QString tripTitle(const dive_trip *trip);
 	static QString tripShortDate(const dive_trip *trip);
 	static QString getDescription(int column);
 	void currentChanged(dive *currentDive);
 
+	// The formatted strings of the dives that were displayed. Formatting is
+	// comparatively slow and the views request them on every repaint.
+	// Entries are dropped when the dives change.
+	mutable std::unordered_map<const dive *, std::array<QVariant, COLUMNS>> displayCache;
+	void invalidateDisplayCache(const QVector<dive *> &dives);
+	void dropCachedDive(const dive *d);
+	void clearDisplayCache();
+
+	// The collation keys of the text columns, computed when sorting by that
+	// column. Comparing keys is much faster than comparing the strings with
+	// the locale's rules. They are dropped together with the display cache.
+	QCollator collator;
+	mutable std::array<std::unordered_map<const dive *, QCollatorSortKey>, COLUMNS> sortKeyCache;
+	const QCollatorSortKey &sortKey(const dive *d, int column) const;
+
 	virtual dive *diveOrNull(const QModelIndex &index) const = 0;	// Returns a dive if this index represents a dive, null otherwise
 	virtual void clearData() = 0;
 	virtual void populate() = 0;
@@ -138,6 +157,7 @@ private:
 	void divesChangedTrip(dive_trip *trip, const QVector<dive *> &dives);
 	void divesShown(dive_trip *trip, const QVector<dive *> &dives);
 	void divesHidden(dive_trip *trip, const QVector<dive *> &dives);
+	void removeHiddenTopLevel();
 	void divesTimeChangedTrip(dive_trip *trip, timestamp_t delta, const QVector<dive *> &dives);
 	void divesDeletedInternal(dive_trip *trip, bool deleteTrip, const QVector<dive *> &dives);
 
@@ -174,6 +194,7 @@ private:
 	void topLevelChanged(int idx);
 
 	// Access trips and dives
+	int findTopLevelIdx(dive_or_trip d_or_t) const;
 	int findTripIdx(const dive_trip *trip) const;
 	int findDiveIdx(const dive *d) const;			// Find _top_level_ dive
 	QModelIndex diveToIdx(const dive *d) const;		// Find _any_ dive
@@ -10,7 +10,11 @@
 #include "qt-models/filtermodels.h"
 #include "desktop-widgets/mapwidget.h"
 #endif
+#include <algorithm>
+#include <iterator>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 #define MIN_DISTANCE_BETWEEN_DIVE_SITES_M 50.0
 
@@ -137,16 +141,33 @@ void MapLocationModel::selectionChanged()
 {
 	if (m_mapLocations.empty())
 		return;
-	for(MapLocation &m: m_mapLocations)
-		m.selected = range_contains(m_selectedDs, m.divesite);
-	emit dataChanged(createIndex(0, 0), createIndex((int)m_mapLocations.size() - 1, 0));
+
+	// Sorted by pointer for quick lookup
+	std::vector<dive_site *> selected = m_selectedDs;
+	std::sort(selected.begin(), selected.end());
+
+	// Only send the changed rows, so that the map doesn't update all markers.
+	// Collect contiguous ranges of changed rows to reduce the number of signals.
+	static const QVector<int> roles { MapLocation::RolePixmap, MapLocation::RoleZ, MapLocation::RoleIsSelected };
+	int first = -1;
+	for (auto [row, m]: enumerated_range(m_mapLocations)) {
+		bool isSelected = std::binary_search(selected.begin(), selected.end(), m.divesite);
+		if (isSelected != m.selected) {
+			m.selected = isSelected;
+			if (first < 0)
+				first = row;
+		} else if (first >= 0) {
+			emit dataChanged(createIndex(first, 0), createIndex(row - 1, 0), roles);
+			first = -1;
+		}
+	}
+	if (first >= 0)
+		emit dataChanged(createIndex(first, 0), createIndex((int)m_mapLocations.size() - 1, 0), roles);
 }
 
 void MapLocationModel::reload(QObject *map)
 {
-	beginResetModel();
-
-	m_mapLocations.clear();
+	std::vector<MapLocation> locations;
 	m_selectedDs.clear();
 
 	std::map<QString, size_t> locationNameMap;
@@ -162,6 +183,7 @@ void MapLocationModel::reload(QObject *map)
 	if (diveSiteMode)
 		m_selectedDs = DiveFilter::instance()->filteredDiveSites();
 #endif
+	std::unordered_set<const dive_site *> selectedSet(m_selectedDs.begin(), m_selectedDs.end());
 	for (const auto &ds: divelog.sites) {
 		QGeoCoordinate dsCoord;
 
@@ -172,7 +194,7 @@ void MapLocationModel::reload(QObject *map)
 			// Dive sites that do not have a gps location are not shown in normal mode.
 			// In dive-edit mode, selected sites are placed at the center of the map,
 			// so that the user can drag them somewhere without having to enter coordinates.
-			if (!diveSiteMode || !range_contains(m_selectedDs, ds.get()) || !map)
+			if (!diveSiteMode || !selectedSet.count(ds.get()) || !map)
 				continue;
 			dsCoord = map->property("center").value<QGeoCoordinate>();
 		} else {
@@ -180,7 +202,7 @@ void MapLocationModel::reload(QObject *map)
 			qreal longitude = ds->location.lon.udeg * 0.000001;
 			dsCoord = QGeoCoordinate(latitude, longitude);
 		}
-		if (!diveSiteMode && hasSelectedDive(*ds) && !range_contains(m_selectedDs, ds.get()))
+		if (!diveSiteMode && hasSelectedDive(*ds) && selectedSet.insert(ds.get()).second)
 			m_selectedDs.push_back(ds.get());
 		QString name = siteMapDisplayName(ds->name);
 		if (!diveSiteMode) {
@@ -188,19 +210,82 @@ void MapLocationModel::reload(QObject *map)
 			// at least MIN_DISTANCE_BETWEEN_DIVE_SITES_M apart
 			auto it = locationNameMap.find(name);
 			if (it != locationNameMap.end()) {
-				const MapLocation &existingLocation = m_mapLocations[it->second];
+				const MapLocation &existingLocation = locations[it->second];
 				QGeoCoordinate coord = existingLocation.coordinate;
 				if (dsCoord.distanceTo(coord) < MIN_DISTANCE_BETWEEN_DIVE_SITES_M)
 					continue;
 			}
 		}
-		bool selected = range_contains(m_selectedDs, ds.get());
-		m_mapLocations.emplace_back(ds.get(), dsCoord, name, selected);
+		bool selected = selectedSet.count(ds.get()) > 0;
+		locations.emplace_back(ds.get(), dsCoord, name, selected);
 		if (!diveSiteMode)
-			locationNameMap[name] = m_mapLocations.size() - 1;
+			locationNameMap[name] = locations.size() - 1;
+	}
+
+	update(std::move(locations));
+}
+
+// Replace the locations by the new ones. A model reset makes the map
+// recreate all markers, which stalls the map for a moment with many
+// dive sites. Instead, only signal the locations that were removed,
+// added or changed. Both lists are in the order of the dive sites in
+// the log, so the common locations mostly come in the same order.
+void MapLocationModel::update(std::vector<MapLocation> locations)
+{
+	std::unordered_map<const dive_site *, size_t> newRow;
+	for (auto [row, l]: enumerated_range(locations))
+		newRow.emplace(l.divesite, row);
+
+	// The location is not in the new list or was already placed further up.
+	auto isStale = [&newRow](const MapLocation &l, size_t j) {
+		auto it = newRow.find(l.divesite);
+		return it == newRow.end() || it->second < j;
+	};
+
+	// The old locations that were not processed yet start at row,
+	// the new locations that were not processed yet start at j.
+	size_t row = 0, j = 0;
+	while (row < m_mapLocations.size() || j < locations.size()) {
+		size_t insertTo = locations.size();
+		if (row < m_mapLocations.size()) {
+			MapLocation &old = m_mapLocations[row];
+			if (isStale(old, j)) {
+				size_t end = row + 1;
+				while (end < m_mapLocations.size() && isStale(m_mapLocations[end], j))
+					++end;
+				beginRemoveRows(QModelIndex(), (int)row, (int)end - 1);
+				m_mapLocations.erase(m_mapLocations.begin() + row, m_mapLocations.begin() + end);
+				endRemoveRows();
+				continue;
+			}
+			size_t pos = newRow[old.divesite];
+			if (pos == j) {
+				MapLocation &l = locations[j];
+				if (l.coordinate != old.coordinate || l.name != old.name || l.selected != old.selected) {
+					old = std::move(l);
+					emit dataChanged(createIndex((int)row, 0), createIndex((int)row, 0));
+				}
+				++row;
+				++j;
+				continue;
+			}
+			insertTo = pos;
+		}
+		// Insert the new locations up to the next old one that stays.
+		beginInsertRows(QModelIndex(), (int)row, (int)(row + insertTo - j) - 1);
+		m_mapLocations.insert(m_mapLocations.begin() + row,
+				      std::make_move_iterator(locations.begin() + j),
+				      std::make_move_iterator(locations.begin() + insertTo));
+		endInsertRows();
+		row += insertTo - j;
+		j = insertTo;
 	}
 
-	endResetModel();
+	// The markers of all dive sites depend on the edit mode.
+	bool editMode = inEditMode();
+	if (editMode != m_editMode && !m_mapLocations.empty())
+		emit dataChanged(createIndex(0, 0), createIndex((int)m_mapLocations.size() - 1, 0), { MapLocation::RolePixmap });
+	m_editMode = editMode;
 }
 
 void MapLocationModel::setSelected(struct dive_site *ds)
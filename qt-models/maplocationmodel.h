@@ -58,8 +58,10 @@ private slots:
 	void diveSiteChanged(struct dive_site *ds, int field);
 
 private:
+	void update(std::vector<MapLocation> locations);
 	std::vector<MapLocation> m_mapLocations;
 	std::vector<dive_site *> m_selectedDs;
+	bool m_editMode = false;	// edit mode of the last update
 };
 
 #endif
@@ -2,6 +2,7 @@
 #include "messagehandlermodel.h"
 #include "core/errorhelper.h"
 #include "QRegularExpression"
+#include <QThread>
 
 #if defined(Q_OS_ANDROID) || defined(Q_OS_IOS)
 extern void writeToAppLogFile(QString logText);
@@ -18,7 +19,7 @@ MessageHandlerModel * MessageHandlerModel::self()
 	return self;
 }
 
-MessageHandlerModel::MessageHandlerModel(QObject*)
+MessageHandlerModel::MessageHandlerModel(QObject*) : m_queue(1024)
 {
 	// no more than one message handler.
 	qInstallMessageHandler(logMessageHandler);
@@ -33,24 +34,47 @@ int MessageHandlerModel::rowCount(const QModelIndex&) const
 
 void MessageHandlerModel::addLog(QtMsgType type, const QString& message)
 {
-	if (!m_data.isEmpty()) {
-		struct MessageData *lm = &m_data.last();
-		QString lastMessage = lm->message.mid(lm->message.indexOf(':'));
+	bool first = m_queue.push((int)type, message.toStdString());
+	if (QThread::currentThread() == thread())
+		drainLog();
+	else if (first)
+		QMetaObject::invokeMethod(this, &MessageHandlerModel::drainLog, Qt::QueuedConnection);
+}
+
+void MessageHandlerModel::drainLog()
+{
+	int dropped;
+	std::vector<MessageRing::Message> messages = m_queue.drain(dropped);
+
+	QVector<MessageData> batch;
+	QString lastMessage = m_data.isEmpty() ? QString() : m_data.last().message.mid(m_data.last().message.indexOf(':'));
+	for (const MessageRing::Message &m: messages) {
+		QString message = QString::fromStdString(m.text);
 		QString newMessage = message.mid(message.indexOf(':'));
-		if (lastMessage == newMessage)
-			return;
+		if (!lastMessage.isNull() && lastMessage == newMessage)
+			continue;
+		// filter extremely noisy and unhelpful messages
+		if (message.contains("Updating RSSI for") || (message.contains(QRegularExpression(".*kirigami.*onFoo properties in Connections"))))
+			continue;
+		lastMessage = newMessage;
+		if (m.count > 1)
+			message += QStringLiteral(" (%1x)").arg(m.count);
+		batch.append({message, (QtMsgType)m.level});
 	}
-	// filter extremely noisy and unhelpful messages
-	if (message.contains("Updating RSSI for") || (message.contains(QRegularExpression(".*kirigami.*onFoo properties in Connections"))))
+	if (dropped > 0)
+		batch.append({QStringLiteral("%1 messages dropped").arg(dropped), QtWarningMsg});
+	if (batch.isEmpty())
 		return;
 
-	beginInsertRows(QModelIndex(), rowCount(), rowCount());
-	m_data.append({message, type});
+	beginInsertRows(QModelIndex(), rowCount(), rowCount() + batch.size() - 1);
+	m_data.append(batch);
 	endInsertRows();
-	report_info("%s", qPrintable(message));
+	for (const MessageData &data: batch) {
+		report_info("%s", qPrintable(data.message));
 #if defined(Q_OS_ANDROID) || defined(Q_OS_IOS)
-	writeToAppLogFile(message);
+		writeToAppLogFile(data.message);
 #endif
+	}
 }
 
 const QString MessageHandlerModel::logAsString()
@@ -2,9 +2,9 @@
 #ifndef MESSAGEHANDLERMODEL_H
 #define MESSAGEHANDLERMODEL_H
 
+#include "core/messagering.h"
 #include <QAbstractListModel>
 
-
 class MessageHandlerModel : public QAbstractListModel {
 	Q_OBJECT
 public:
@@ -13,6 +13,7 @@ public:
 	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
 	QVariant data(const QModelIndex& idx, int role) const override;
 	QHash<int, QByteArray> roleNames() const override;
+	// Can be called from any thread. Messages of other threads are added in batches.
 	void addLog(QtMsgType type, const QString& message);
 	const QString logAsString();
 
@@ -21,11 +22,13 @@ public:
 
 private:
 	MessageHandlerModel(QObject *parent = 0);
+	void drainLog();
 	struct MessageData {
 		QString message;
 		QtMsgType type;
 	};
 	QVector<MessageData> m_data;
+	MessageRing m_queue;
 };
 
 #endif
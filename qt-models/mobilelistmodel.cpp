@@ -1,6 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "mobilelistmodel.h"
 #include "core/divefilter.h" // for shown_dives
+#include "core/errorhelper.h"
+#include "core/pref.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
 
 MobileListModelBase::MobileListModelBase(DiveTripModelBase *sourceIn) : source(sourceIn)
 {
@@ -962,9 +968,160 @@ MobileSwipeModel *MobileModels::swipeModel()
 	return &sm;
 }
 
+MobileListSnapshot *MobileModels::snapshotModel()
+{
+	return &snapshot;
+}
+
+void MobileModels::saveSnapshot(const QString &key)
+{
+	snapshot.save(key, lm);
+}
+
 // This is called when the settings changed. Instead of rebuilding the model, send a changed signal on all entries.
 void MobileModels::invalidate()
 {
 	sm.invalidate();
 	sm.invalidate();
 }
+
+// The snapshot is only a cache for the startup. If anything is off
+// (version, dive log, a truncated file), it is simply not shown.
+static const quint32 snapshot_version = 1;
+
+static QString snapshotName()
+{
+	return QString::fromStdString(system_default_directory() + "/listsnapshot");
+}
+
+bool MobileListSnapshot::load(const QString &key)
+{
+	QFile f(snapshotName());
+	if (!f.open(QIODevice::ReadOnly))
+		return false;
+	QDataStream stream(&f);
+	quint32 version, count;
+	QString snapshotKey;
+	stream >> version;
+	if (version != snapshot_version)
+		return false;
+	stream >> snapshotKey >> count;
+	if (stream.status() != QDataStream::Ok || snapshotKey != key)
+		return false;
+
+	std::vector<Row> newRows;
+	newRows.reserve(count);
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+		Row row;
+		qint32 nrDives;
+		stream >> row.isTrip >> row.invalid >> nrDives >> row.shortDate >> row.title
+		       >> row.dateTime >> row.depthDuration >> row.number;
+		row.nrDives = nrDives;
+		newRows.push_back(std::move(row));
+	}
+	if (stream.status() != QDataStream::Ok)
+		return false;
+
+	beginResetModel();
+	rows = std::move(newRows);
+	endResetModel();
+	emit countChanged();
+	return !rows.empty();
+}
+
+// Only the top level items are saved, i.e. the list as it is shown
+// when no trip is expanded.
+void MobileListSnapshot::save(const QString &key, const QAbstractItemModel &model)
+{
+	using R = MobileListModelBase;
+	QSaveFile f(snapshotName());
+	if (!f.open(QIODevice::WriteOnly))
+		return;
+	QDataStream stream(&f);
+	int count = model.rowCount(QModelIndex());
+	int topLevel = 0;
+	for (int i = 0; i < count; ++i) {
+		if (model.index(i, 0).data(R::IsTopLevelRole).toBool())
+			++topLevel;
+	}
+	stream << snapshot_version << key << (quint32)topLevel;
+	for (int i = 0; i < count; ++i) {
+		QModelIndex idx = model.index(i, 0);
+		if (!idx.data(R::IsTopLevelRole).toBool())
+			continue;
+		bool isTrip = idx.data(DiveTripModelBase::IS_TRIP_ROLE).toBool();
+		stream << isTrip
+		       << idx.data(R::IsInvalidRole).toBool()
+		       << (qint32)idx.data(R::TripNrDivesRole).toInt()
+		       << idx.data(R::TripShortDateRole).toString()
+		       << idx.data(isTrip ? R::TripTitleRole : R::LocationRole).toString()
+		       << idx.data(R::DateTimeRole).toString()
+		       << idx.data(R::DepthDurationRole).toString()
+		       << idx.data(R::NumberRole).toString();
+	}
+	if (!f.commit())
+		report_info("Cannot write dive list snapshot %s", qPrintable(snapshotName()));
+}
+
+void MobileListSnapshot::clear()
+{
+	if (rows.empty())
+		return;
+	beginResetModel();
+	rows.clear();
+	rows.shrink_to_fit();
+	endResetModel();
+	emit countChanged();
+}
+
+int MobileListSnapshot::count() const
+{
+	return (int)rows.size();
+}
+
+int MobileListSnapshot::rowCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : (int)rows.size();
+}
+
+// The role names the dive list delegate uses, with the same values
+// as in the real model.
+QHash<int, QByteArray> MobileListSnapshot::roleNames() const
+{
+	using R = MobileListModelBase;
+	QHash<int, QByteArray> roles;
+	roles[DiveTripModelBase::IS_TRIP_ROLE] = "isTrip";
+	roles[DiveTripModelBase::CURRENT_ROLE] = "current";
+	roles[R::IsTopLevelRole] = "isTopLevel";
+	roles[R::TripNrDivesRole] = "tripNrDives";
+	roles[R::TripShortDateRole] = "tripShortDate";
+	roles[R::TripTitleRole] = "tripTitle";
+	roles[R::DateTimeRole] = "dateTime";
+	roles[R::NumberRole] = "number";
+	roles[R::LocationRole] = "location";
+	roles[R::DepthDurationRole] = "depthDuration";
+	roles[R::IsInvalidRole] = "isInvalid";
+	return roles;
+}
+
+QVariant MobileListSnapshot::data(const QModelIndex &index, int role) const
+{
+	using R = MobileListModelBase;
+	if (!index.isValid() || index.row() >= (int)rows.size())
+		return QVariant();
+	const Row &row = rows[index.row()];
+	switch (role) {
+	case DiveTripModelBase::IS_TRIP_ROLE: return row.isTrip;
+	case DiveTripModelBase::CURRENT_ROLE: return false;
+	case R::IsTopLevelRole: return true;
+	case R::TripNrDivesRole: return row.nrDives;
+	case R::TripShortDateRole: return row.shortDate;
+	case R::TripTitleRole: return row.isTrip ? row.title : QString();
+	case R::DateTimeRole: return row.dateTime;
+	case R::NumberRole: return row.number;
+	case R::LocationRole: return row.isTrip ? QString() : row.title;
+	case R::DepthDurationRole: return row.depthDuration;
+	case R::IsInvalidRole: return row.invalid;
+	}
+	return QVariant();
+}
@@ -8,10 +8,15 @@
 // trip. Even if there is temporal overlap of trips, all dives of
 // a trip are listed in a contiguous block. This model is used for
 // swiping through dives.
+//
+// MobileListSnapshot is a copy of the top level of the MobileListModel
+// with the already formatted strings, which is saved to disk. It is shown
+// at startup while the real dive data are loaded.
 #ifndef MOBILELISTMODEL_H
 #define MOBILELISTMODEL_H
 
 #include "divetripmodel.h"
+#include <QAbstractListModel>
 
 // This is the base class of the mobile-list model. All it does
 // is exporting the various dive fields as roles.
@@ -171,6 +176,34 @@ private slots:
 	void changed(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
 };
 
+class MobileListSnapshot : public QAbstractListModel {
+	Q_OBJECT
+public:
+	// The key identifies the dive log the snapshot was made of.
+	bool load(const QString &key);
+	void save(const QString &key, const QAbstractItemModel &model);
+	void clear();
+	Q_PROPERTY(int count READ count NOTIFY countChanged);
+	int count() const;
+	QHash<int, QByteArray> roleNames() const override;
+signals:
+	void countChanged();
+private:
+	struct Row {
+		bool isTrip;
+		bool invalid;
+		int nrDives;
+		QString shortDate;	// trip: date box
+		QString title;		// trip: title, dive: location
+		QString dateTime;
+		QString depthDuration;
+		QString number;
+	};
+	std::vector<Row> rows;
+	QVariant data(const QModelIndex &index, int role) const override;
+	int rowCount(const QModelIndex &parent) const override;
+};
+
 // This convenience class provides access to the two mobile models.
 // Moreover, it provides an interface to the source trip-model.
 class MobileModels {
@@ -178,12 +211,15 @@ public:
 	static MobileModels *instance();
 	MobileListModel *listModel();
 	MobileSwipeModel *swipeModel();
+	MobileListSnapshot *snapshotModel();
+	void saveSnapshot(const QString &key);
 	void invalidate(); // Invalidate all entries to force a re-render.
 private:
 	MobileModels();
 	DiveTripModelTree source;
 	MobileListModel lm;
 	MobileSwipeModel sm;
+	MobileListSnapshot snapshot;
 };
 
 #endif
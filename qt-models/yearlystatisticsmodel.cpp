@@ -6,6 +6,9 @@
 #include "core/string-format.h"
 #include "core/dive.h" // For NUM_DIVEMODE
 
+#include <array>
+#include <bitset>
+
 class YearStatisticsItem : public TreeItem {
 	Q_DECLARE_TR_FUNCTIONS(YearStatisticsItem)
 public:
@@ -32,12 +35,50 @@ public:
 	QVariant data(int column, int role) const;
 	YearStatisticsItem(const stats_t &interval);
 
+	// The rows below this one are only created when it is expanded, see
+	// YearlyStatisticsModel::fetchMore(). The depth and temperature buckets
+	// get their label then. Each entry is the index of the bucket and its statistics.
+	enum class Buckets { None, Depth, Temperature };
+	Buckets buckets;
+	std::vector<std::pair<int, stats_t>> pending;
+	void addPending(const stats_t &s, int bucket = 0);
+	void createChildren();
+
 private:
+	QVariant format(int column) const;
 	stats_t stats_interval;
+	// The views ask for the cells on every repaint: format them only once.
+	mutable std::array<QVariant, COLUMNS> cells;
+	mutable std::bitset<COLUMNS> formatted;
 };
 
-YearStatisticsItem::YearStatisticsItem(const stats_t &interval) : stats_interval(interval)
+YearStatisticsItem::YearStatisticsItem(const stats_t &interval) : buckets(Buckets::None), stats_interval(interval)
+{
+}
+
+void YearStatisticsItem::addPending(const stats_t &s, int bucket)
+{
+	pending.emplace_back(bucket, s);
+}
+
+void YearStatisticsItem::createChildren()
 {
+	for (auto &[i, s]: pending) {
+		if (buckets == Buckets::Depth) {
+			s.location = YearlyStatisticsModel::tr("%1 - %2").arg(get_depth_string(i * (STATS_DEPTH_BUCKET * 1000), true, false),
+					get_depth_string((i + 1) * (STATS_DEPTH_BUCKET * 1000), true, false)).toStdString();
+		} else if (buckets == Buckets::Temperature) {
+			temperature_t t_range_min, t_range_max;
+			t_range_min.mkelvin = C_to_mkelvin(i * STATS_TEMP_BUCKET);
+			t_range_max.mkelvin = C_to_mkelvin((i + 1) * STATS_TEMP_BUCKET);
+			s.location = YearlyStatisticsModel::tr("%1 - %2").arg(get_temperature_string(t_range_min, true),
+					get_temperature_string(t_range_max, true)).toStdString();
+		}
+		YearStatisticsItem *iChild = new YearStatisticsItem(s);
+		children.append(iChild);
+		iChild->parent = this;
+	}
+	pending.clear();
 }
 
 QVariant YearStatisticsItem::data(int column, int role) const
@@ -46,9 +87,18 @@ QVariant YearStatisticsItem::data(int column, int role) const
 		QFont font = defaultModelFont();
 		font.setBold(stats_interval.is_year);
 		return font;
-	} else if (role != Qt::DisplayRole) {
+	} else if (role != Qt::DisplayRole || column < 0 || column >= COLUMNS) {
 		return QVariant();
 	}
+	if (!formatted[column]) {
+		cells[column] = format(column);
+		formatted.set(column);
+	}
+	return cells[column];
+}
+
+QVariant YearStatisticsItem::format(int column) const
+{
 	switch (column) {
 	case YEAR:
 		if (stats_interval.is_trip) {
@@ -168,21 +218,19 @@ QVariant YearlyStatisticsModel::headerData(int section, Qt::Orientation orientat
 	return val;
 }
 
+// Only the top level rows are created here. The rows below them are kept
+// as statistics and are turned into items when a row is expanded.
 void YearlyStatisticsModel::update_yearly_stats()
 {
-	QString label;
-	temperature_t t_range_min,t_range_max;
 	stats_summary stats = calculate_stats_summary(false);
 
-	int month = 0;
+	size_t month = 0;
 	for (const auto &s: stats.stats_yearly) {
 		YearStatisticsItem *item = new YearStatisticsItem(s);
 		size_t combined_months = 0;
-		while (combined_months < s.selection_size) {
+		while (combined_months < s.selection_size && month < stats.stats_monthly.size()) {
 			combined_months += stats.stats_monthly[month].selection_size;
-			YearStatisticsItem *iChild = new YearStatisticsItem(stats.stats_monthly[month]);
-			item->children.append(iChild);
-			iChild->parent = item;
+			item->addPending(stats.stats_monthly[month]);
 			month++;
 		}
 		rootItem->children.append(item);
@@ -191,11 +239,8 @@ void YearlyStatisticsModel::update_yearly_stats()
 
 	if (stats.stats_by_trip[0].is_trip == true) {
 		YearStatisticsItem *item = new YearStatisticsItem(stats.stats_by_trip[0]);
-		for (auto it = std::next(stats.stats_by_trip.begin()); it != stats.stats_by_trip.end(); ++it) {
-			YearStatisticsItem *iChild = new YearStatisticsItem(*it);
-			item->children.append(iChild);
-			iChild->parent = item;
-		}
+		for (auto it = std::next(stats.stats_by_trip.begin()); it != stats.stats_by_trip.end(); ++it)
+			item->addPending(*it);
 		rootItem->children.append(item);
 		item->parent = rootItem.get();
 	}
@@ -206,9 +251,7 @@ void YearlyStatisticsModel::update_yearly_stats()
 		for (auto it = std::next(stats.stats_by_type.begin()); it != stats.stats_by_type.end(); ++it) {
 			if (it->selection_size == 0)
 				continue;
-			YearStatisticsItem *iChild = new YearStatisticsItem(*it);
-			item->children.append(iChild);
-			iChild->parent = item;
+			item->addPending(*it);
 		}
 		rootItem->children.append(item);
 		item->parent = rootItem.get();
@@ -217,16 +260,11 @@ void YearlyStatisticsModel::update_yearly_stats()
 	/* Show the statistic sorted by dive depth */
 	if (stats.stats_by_depth[0].selection_size) {
 		YearStatisticsItem *item = new YearStatisticsItem(stats.stats_by_depth[0]);
+		item->buckets = YearStatisticsItem::Buckets::Depth;
 		int i = 0;
 		for (auto it = std::next(stats.stats_by_depth.begin()); it != stats.stats_by_depth.end(); ++it) {
-			if (it->selection_size) {
-				QString label = QString(tr("%1 - %2")).arg(get_depth_string(i * (STATS_DEPTH_BUCKET * 1000), true, false),
-						get_depth_string((i + 1) * (STATS_DEPTH_BUCKET * 1000), true, false));
-				it->location = label.toStdString();
-				YearStatisticsItem *iChild = new YearStatisticsItem(*it);
-				item->children.append(iChild);
-				iChild->parent = item;
-			}
+			if (it->selection_size)
+				item->addPending(*it, i);
 			i++;
 		}
 		rootItem->children.append(item);
@@ -236,21 +274,37 @@ void YearlyStatisticsModel::update_yearly_stats()
 	/* Show the statistic sorted by dive temperature */
 	if (stats.stats_by_temp[0].selection_size) {
 		YearStatisticsItem *item = new YearStatisticsItem(stats.stats_by_temp[0]);
+		item->buckets = YearStatisticsItem::Buckets::Temperature;
 		int i = 0;
 		for (auto it = std::next(stats.stats_by_temp.begin()); it != stats.stats_by_temp.end(); ++it) {
-			if (it->selection_size) {
-				t_range_min.mkelvin = C_to_mkelvin(i * STATS_TEMP_BUCKET);
-				t_range_max.mkelvin = C_to_mkelvin((i + 1) * STATS_TEMP_BUCKET);
-				label = QString(tr("%1 - %2")).arg(get_temperature_string(t_range_min, true),
-					get_temperature_string(t_range_max, true));
-				it->location = label.toStdString();
-				YearStatisticsItem *iChild = new YearStatisticsItem(*it);
-				item->children.append(iChild);
-				iChild->parent = item;
-			}
+			if (it->selection_size)
+				item->addPending(*it, i);
 			i++;
 		}
 		rootItem->children.append(item);
 		item->parent = rootItem.get();
 	}
 }
+
+bool YearlyStatisticsModel::hasChildren(const QModelIndex &parent) const
+{
+	return rowCount(parent) > 0 || canFetchMore(parent);
+}
+
+bool YearlyStatisticsModel::canFetchMore(const QModelIndex &parent) const
+{
+	if (!parent.isValid())
+		return false;
+	const YearStatisticsItem *item = static_cast<const YearStatisticsItem *>(parent.internalPointer());
+	return !item->pending.empty();
+}
+
+void YearlyStatisticsModel::fetchMore(const QModelIndex &parent)
+{
+	if (!canFetchMore(parent))
+		return;
+	YearStatisticsItem *item = static_cast<YearStatisticsItem *>(parent.internalPointer());
+	beginInsertRows(parent, 0, (int)item->pending.size() - 1);
+	item->createChildren();
+	endInsertRows();
+}
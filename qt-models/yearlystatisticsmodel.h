@@ -28,6 +28,9 @@ public:
 	};
 
 	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+	bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+	bool canFetchMore(const QModelIndex &parent) const override;
+	void fetchMore(const QModelIndex &parent) override;
 	YearlyStatisticsModel(QObject *parent = 0);
 	void update_yearly_stats();
 };
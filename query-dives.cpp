@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0
+// Command line queries over a dive log, see stats/statsquery.h.
+// Writes one CSV line per bin to stdout, e.g.
+//   query-dives -s <log> --where sac:greater:15000 --bin "Date" --binner "Yearly" --value "SAC"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+
+#include "core/qt-gui.h"
+#include "core/qthelper.h"
+#include "core/errorhelper.h"
+#include "core/file.h"
+#include "core/divelog.h"
+#include "core/filterpreset.h"
+#include "core/fulltext.h"
+#include "core/pref.h"
+#include "stats/statsquery.h"
+#include "git2.h"
+
+static void list_variables(QTextStream &out)
+{
+	for (const StatsVariable *var: stats_variables) {
+		out << var->name();
+		if (var->type() == StatsVariable::Type::Numeric)
+			out << " (numeric)";
+		out << "\n";
+		std::vector<const StatsBinner *> binners = var->binners();
+		if (binners.size() > 1) {
+			for (const StatsBinner *binner: binners)
+				out << "\t" << binner->name() << "\n";
+		}
+	}
+}
+
+static QString format_value(double v, int decimals)
+{
+	return std::isnan(v) ? QString() : QString::number(v, 'f', decimals);
+}
+
+int main(int argc, char **argv)
+{
+	QApplication *application = new QApplication(argc, argv);
+	git_libgit2_init();
+	prefs = default_prefs;
+	init_qt_late();
+
+	QCommandLineParser parser;
+	QCommandLineOption sourceOption(QStringList() << "s" << "source",
+					"Read the dive log from <file> or git repository",
+					"file");
+	parser.addOption(sourceOption);
+	QCommandLineOption filterOption(QStringList() << "f" << "filter",
+					"Use the filter preset <name> of the log",
+					"name");
+	parser.addOption(filterOption);
+	QCommandLineOption whereOption(QStringList() << "w" << "where",
+				       "Only dives matching <constraint>, given as [!]type[:mode]:data as in the filter presets",
+				       "constraint");
+	parser.addOption(whereOption);
+	QCommandLineOption binOption(QStringList() << "b" << "bin",
+				     "Group the dives by <variable>",
+				     "variable");
+	parser.addOption(binOption);
+	QCommandLineOption binnerOption(QStringList() << "binner",
+					"Group the dives by <binner> of the variable",
+					"binner");
+	parser.addOption(binnerOption);
+	QCommandLineOption valueOption(QStringList() << "v" << "value",
+				       "Calculate the statistics of the numeric <variable>",
+				       "variable");
+	parser.addOption(valueOption);
+	QCommandLineOption invalidOption(QStringList() << "include-invalid",
+					 "Include the dives marked as invalid");
+	parser.addOption(invalidOption);
+	QCommandLineOption listOption(QStringList() << "l" << "list",
+				      "List the variables and their binners");
+	parser.addOption(listOption);
+
+	parser.process(*application);
+
+	QTextStream out(stdout);
+	if (parser.isSet(listOption)) {
+		list_variables(out);
+		exit(0);
+	}
+
+	QString source = parser.value(sourceOption);
+	if (source.isEmpty()) {
+		report_info("need --source");
+		exit(1);
+	}
+	int ret = parse_file(qPrintable(source), &divelog);
+	if (ret) {
+		report_info("parse_file returned %d", ret);
+		exit(1);
+	}
+	divelog.dives.sort();
+	divelog.trips.sort();
+	fulltext_populate();
+
+	// format the values in the units of the log
+	prefs.unit_system = git_prefs.unit_system;
+	prefs.units = git_prefs.units;
+
+	StatsQuery query;
+	query.includeInvalid = parser.isSet(invalidOption);
+	if (parser.isSet(filterOption)) {
+		std::string name = parser.value(filterOption).toStdString();
+		auto it = std::find_if(divelog.filter_presets.begin(), divelog.filter_presets.end(),
+				       [&name](const filter_preset &p) { return p.name == name; });
+		if (it == divelog.filter_presets.end()) {
+			report_info("unknown filter preset %s", name.c_str());
+			exit(1);
+		}
+		query.filter = it->data;
+	}
+	for (const QString &constraint: parser.values(whereOption)) {
+		if (!stats_query_add_constraint(query, constraint)) {
+			report_info("invalid constraint %s", qPrintable(constraint));
+			exit(1);
+		}
+	}
+	if (parser.isSet(binOption)) {
+		query.binVariable = stats_query_variable(parser.value(binOption));
+		if (!query.binVariable) {
+			report_info("unknown variable %s", qPrintable(parser.value(binOption)));
+			exit(1);
+		}
+		if (parser.isSet(binnerOption)) {
+			query.binner = stats_query_binner(*query.binVariable, parser.value(binnerOption));
+			if (!query.binner) {
+				report_info("unknown binner %s", qPrintable(parser.value(binnerOption)));
+				exit(1);
+			}
+		}
+	}
+	std::vector<StatsOperation> operations;
+	if (parser.isSet(valueOption)) {
+		query.valueVariable = stats_query_variable(parser.value(valueOption));
+		if (!query.valueVariable || query.valueVariable->type() != StatsVariable::Type::Numeric) {
+			report_info("unknown or non-numeric variable %s", qPrintable(parser.value(valueOption)));
+			exit(1);
+		}
+		operations = query.valueVariable->supportedOperations();
+	}
+
+	std::vector<dive *> dives;
+	dives.reserve(divelog.dives.size());
+	for (auto &d: divelog.dives)
+		dives.push_back(d.get());
+	std::vector<StatsQueryRow> rows = stats_query_run(query, dives);
+
+	out << "\"bin\",\"dives\"";
+	for (StatsOperation op: operations)
+		out << ",\"" << StatsVariable::operationName(op) << "\"";
+	out << "\n";
+	for (const StatsQueryRow &row: rows) {
+		QString bin = row.bin;
+		out << "\"" << bin.replace("\"", "\"\"") << "\"," << row.dives.size();
+		for (StatsOperation op: operations) {
+			out << ",";
+			if (row.results.isValid())
+				out << format_value(row.results.get(op), query.valueVariable->decimals());
+		}
+		out << "\n";
+	}
+	exit(0);
+}
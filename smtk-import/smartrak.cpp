@@ -33,8 +33,11 @@
 #include <stdarg.h>
 #include <locale.h>
 #include <array>
+#include <memory>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
+#include <QtConcurrent>
 
 #if defined(WIN32) || defined(_WIN32)
 #include <windows.h>
@@ -109,7 +112,7 @@ static int coln(enum field_pos pos_in)
  * Fills the date part of a tm structure with the string data obtained
  * from smartrak in format "DD/MM/YY HH:MM:SS" where time is irrelevant.
  */
-static void smtk_date_to_tm(char *d_buffer, struct tm *tm_date)
+static void smtk_date_to_tm(const char *d_buffer, struct tm *tm_date)
 {
 	int n, d, m, y;
 
@@ -251,6 +254,41 @@ SmtkTable::~SmtkTable()
 		mdb_free_tabledef(table);
 }
 
+/*
+ * The linked tables are read once for the whole file, instead of scanning
+ * them for every dive. Rows are indexed by the text of one of their columns.
+ */
+using smtk_row = std::vector<std::string>;
+using smtk_rows = std::unordered_map<std::string, smtk_row>;
+
+/*
+ * Reads a table into a map from the key column to the row.
+ * If several rows have the same key, the first one is kept.
+ */
+static smtk_rows smtk_read_rows(MdbHandle *mdb, const char *table_name, size_t key_col)
+{
+	SmtkTable table(mdb, table_name);
+	if (!table)
+		return {};
+
+	smtk_rows res;
+	while (table.fetch_row()) {
+		smtk_row row;
+		row.reserve(table.size());
+		for (size_t i = 0; i < table.size(); i++)
+			row.emplace_back(table.get_data(i));
+		std::string key = row[key_col];
+		res.emplace(std::move(key), std::move(row));
+	}
+	return res;
+}
+
+static const smtk_row *smtk_find_row(const smtk_rows &rows, const char *key)
+{
+	auto it = rows.find(key);
+	return it != rows.end() ? &it->second : nullptr;
+}
+
 /*
  * Utility function which joins three strings, being the second a separator string,
  * usually a "\n". The third is a format string with an argument list.
@@ -271,7 +309,7 @@ static void concat(std::string &orig, const char *sep, std::string_view s)
  * Wreck format:
  * | Idx | SiteIdx | Text | Built | Sank | SankTime | Reason | ... | Notes | TrakId |
  */
-static void smtk_wreck_site(MdbHandle *mdb, char *site_idx, struct dive_site *ds)
+static void smtk_wreck_site(const smtk_rows &wrecks, const char *site_idx, struct dive_site *ds)
 {
 	std::string notes;
 	int i;
@@ -282,57 +320,61 @@ static void smtk_wreck_site(MdbHandle *mdb, char *site_idx, struct dive_site *ds
 				      QT_TRANSLATE_NOOP("gettextFromC", "Draught"), QT_TRANSLATE_NOOP("gettextFromC", "Displacement"), QT_TRANSLATE_NOOP("gettextFromC", "Cargo"),
 				      QT_TRANSLATE_NOOP("gettextFromC", "Notes")};
 
-	SmtkTable table(mdb, "Wreck");
-
-	/* Sanity check for table, unlikely but ... */
-	if (!table)
+	/* Write strings to notes only if available.*/
+	const smtk_row *row = smtk_find_row(wrecks, site_idx);
+	if (!row)
 		return;
-
-	/* Begin parsing. Write strings to notes only if available.*/
-	while (table.fetch_row()) {
-		if (!strcmp(table.get_data(1), site_idx)) {
-			concat(notes, "\n", translate("gettextFromC", "Wreck Data"));
-			for (i = 3; i < 16; i++) {
-				switch (i) {
-				case 3:
-				case 4: {
-					std::string_view tmp = table.get_string_view(i);
-					if (!tmp.empty()) {
-						tmp = tmp.substr(0, tmp.find(' '));
-						concat(notes, "\n", format_string_std("%s: %s", wreck_fields[i - 3], std::string(tmp).c_str()));
-					}
-					break;
-				}
-				case 5: {
-					std::string_view tmp = table.get_string_view(i);
-					if (!tmp.empty()) {
-						size_t pos = tmp.rfind(' ');
-						tmp.remove_prefix(pos + 1);
-						concat(notes, "\n", format_string_std("%s: %s", wreck_fields[i - 3], std::string(tmp).c_str()));
-					}
-					break;
-				}
-				case 6 ... 9:
-				case 14:
-				case 15: {
-					const char *tmp = table.get_data(i);
-					if (!empty_string(tmp))
-						concat(notes, "\n", format_string_std("%s: %s", wreck_fields[i - 3], tmp));
-					break;
-				}
-				default:
-					d = lrintl(strtold(table.get_data(1), NULL));
-					if (d)
-						concat(notes, "\n", format_string_std("%s: %d", wreck_fields[i - 3], d));
-					break;
-				}
+	const smtk_row &table = *row;
+	concat(notes, "\n", translate("gettextFromC", "Wreck Data"));
+	for (i = 3; i < 16; i++) {
+		switch (i) {
+		case 3:
+		case 4: {
+			std::string_view tmp = table[i];
+			if (!tmp.empty()) {
+				tmp = tmp.substr(0, tmp.find(' '));
+				concat(notes, "\n", format_string_std("%s: %s", wreck_fields[i - 3], std::string(tmp).c_str()));
 			}
-			concat(ds->notes, "\n", notes);
+			break;
+		}
+		case 5: {
+			std::string_view tmp = table[i];
+			if (!tmp.empty()) {
+				size_t pos = tmp.rfind(' ');
+				tmp.remove_prefix(pos + 1);
+				concat(notes, "\n", format_string_std("%s: %s", wreck_fields[i - 3], std::string(tmp).c_str()));
+			}
+			break;
+		}
+		case 6 ... 9:
+		case 14:
+		case 15: {
+			const char *tmp = table[i].c_str();
+			if (!empty_string(tmp))
+				concat(notes, "\n", format_string_std("%s: %s", wreck_fields[i - 3], tmp));
+			break;
+		}
+		default:
+			d = lrintl(strtold(table[1].c_str(), NULL));
+			if (d)
+				concat(notes, "\n", format_string_std("%s: %d", wreck_fields[i - 3], d));
 			break;
 		}
 	}
+	concat(ds->notes, "\n", notes);
 }
 
+/* The Site, Location and Wreck tables, indexed by site, location and site index */
+struct smtk_site_tables {
+	smtk_rows sites, locations, wrecks;
+	smtk_site_tables(MdbHandle *mdb) :
+		sites(smtk_read_rows(mdb, "Site", 0)),
+		locations(smtk_read_rows(mdb, "Location", 0)),
+		wrecks(smtk_read_rows(mdb, "Wreck", 1))
+	{
+	}
+};
+
 /*
  * Smartrak locations db is quite extensive. This builds a string joining some of
  * the data in the style:   "Country, State, Locality, Site"  if this data are
@@ -343,9 +385,9 @@ static void smtk_wreck_site(MdbHandle *mdb, char *site_idx, struct dive_site *ds
  * Location format:
  * | Idx | Text | Province | Country | Depth |
  */
-static void smtk_build_location(MdbHandle *mdb, char *idx, struct dive_site **location, struct divelog *log)
+static void smtk_build_location(const smtk_site_tables &tables, const char *idx, struct dive_site **location, struct divelog *log)
 {
-	int i, rc;
+	int i;
 	uint32_t d;
 	struct dive_site *ds;
 	location_t loc;
@@ -354,53 +396,44 @@ static void smtk_build_location(MdbHandle *mdb, char *idx, struct dive_site **lo
 				     QT_TRANSLATE_NOOP("gettextFromC", "Notes")};
 
 	/* Read data from Site table. Format notes for the dive site if any.*/
-	{
-		SmtkTable table(mdb, "Site");
-		if (!table)
-			return;
-		do {
-			rc = table.fetch_row();
-		} while (strcasecmp(table.get_data(0), idx) && rc != 0);
-		if (rc == 0)
-			return;
-		loc_idx = table.get_data(2);
-		site = table.get_data(1);
-		loc = create_location(strtod(table.get_data(6), NULL), strtod(table.get_data(7), NULL));
-
-		for (i = 8; i < 11; i++) {
-			switch (i) {
-			case 8:
-			case 9:
-				d = lrintl(strtold(table.get_data(i), NULL));
-				if (d)
-					concat(notes, "\n", format_string_std("%s: %d m", site_fields[i - 8], d));
-				break;
-			case 10:
-				if (!empty_string(table.get_data(i)))
-					concat(notes, "\n", format_string_std("%s: %s", site_fields[i - 8], table.get_data(i)));
-				break;
-			}
+	const smtk_row *site_row = smtk_find_row(tables.sites, idx);
+	if (!site_row)
+		return;
+	loc_idx = (*site_row)[2];
+	site = (*site_row)[1];
+	loc = create_location(strtod((*site_row)[6].c_str(), NULL), strtod((*site_row)[7].c_str(), NULL));
+
+	for (i = 8; i < 11; i++) {
+		const char *field = (*site_row)[i].c_str();
+		switch (i) {
+		case 8:
+		case 9:
+			d = lrintl(strtold(field, NULL));
+			if (d)
+				concat(notes, "\n", format_string_std("%s: %d m", site_fields[i - 8], d));
+			break;
+		case 10:
+			if (!empty_string(field))
+				concat(notes, "\n", format_string_std("%s: %s", site_fields[i - 8], field));
+			break;
 		}
 	}
 
 	/* Read data from Location table, linked to Site by loc_idx */
-	SmtkTable table(mdb, "Location");
-	do {
-		rc = table.fetch_row();
-	} while (strcasecmp(table.get_data(0), loc_idx.c_str()) && rc != 0);
-	if (rc == 0)
+	const smtk_row *loc_row = smtk_find_row(tables.locations, loc_idx.c_str());
+	if (!loc_row)
 		return;
 
 	/*
 	 * Create a string for Subsurface's dive site structure with coordinates
 	 * if available, if the site's name doesn't previously exists.
 	 */
-	if (!empty_string(table.get_data(3)))
-		concat(str, ", ", table.get_string_view(3)); // Country
-	if (!empty_string(table.get_data(2)))
-		concat(str, ", ", table.get_string_view(2)); // State - Province
-	if (!empty_string(table.get_data(1)))
-		concat(str, ", ", table.get_string_view(1)); // Locality
+	if (!(*loc_row)[3].empty())
+		concat(str, ", ", (*loc_row)[3]); // Country
+	if (!(*loc_row)[2].empty())
+		concat(str, ", ", (*loc_row)[2]); // State - Province
+	if (!(*loc_row)[1].empty())
+		concat(str, ", ", (*loc_row)[1]); // Locality
 	concat(str, ", ", site);
 
 	ds = log->sites.get_by_name(str);
@@ -416,22 +449,38 @@ static void smtk_build_location(MdbHandle *mdb, char *idx, struct dive_site **lo
 	ds->notes = notes.c_str();
 
 	/* Check if we have a wreck */
-	smtk_wreck_site(mdb, idx, ds);
+	smtk_wreck_site(tables.wrecks, idx, ds);
 }
 
-static void smtk_build_tank_info(MdbHandle *mdb, cylinder_t *tank, char *idx)
+/*
+ * The Tank table, in the order of the rows. Dives refer to the tanks by
+ * their position, starting at 1.
+ */
+static std::vector<cylinder_type_t> smtk_build_tanks(MdbHandle *mdb)
 {
-	int i;
-
 	SmtkTable table(mdb, "Tank");
 	if (!table)
+		return {};
+
+	std::vector<cylinder_type_t> res;
+	while (table.fetch_row()) {
+		cylinder_type_t type;
+		type.description = table.get_data(1);
+		type.size.mliter = lrint(strtod(table.get_data(2), NULL) * 1000);
+		type.workingpressure.mbar = lrint(strtod(table.get_data(4), NULL) * 1000);
+		res.push_back(std::move(type));
+	}
+	return res;
+}
+
+static void smtk_build_tank_info(const std::vector<cylinder_type_t> &tank_list, cylinder_t *tank, const char *idx)
+{
+	if (tank_list.empty())
 		return;
 
-	for (i = 1; i <= atoi(idx); i++)
-		table.fetch_row();
-	tank->type.description = table.get_data(1);
-	tank->type.size.mliter = lrint(strtod(table.get_data(2), NULL) * 1000);
-	tank->type.workingpressure.mbar = lrint(strtod(table.get_data(4), NULL) * 1000);
+	/* Past the end of the table, the last row is used */
+	int i = std::min(atoi(idx), (int)tank_list.size());
+	tank->type = i > 0 ? tank_list[i - 1] : cylinder_type_t();
 }
 
 /*
@@ -570,13 +619,14 @@ static std::vector<std::string> smtk_build_list(MdbHandle *mdb, const char *tabl
 }
 
 /*
- * Parses a relation table and returns a list with the relations for a dive idx.
- * Use types_list items with text set to NULL.
- * Returns a pointer to the list head.
+ * Parses a relation table and returns the relations of every dive idx,
+ * in the order of the table.
  * Table relation format:
  * | Diveidx | Idx |
  */
-static std::vector<int> smtk_index_list(MdbHandle *mdb, const char *table_name, char *dive_idx)
+using smtk_relations = std::unordered_map<std::string, std::vector<int>>;
+
+static smtk_relations smtk_read_relations(MdbHandle *mdb, const char *table_name)
 {
 	SmtkTable table(mdb, table_name);
 
@@ -584,16 +634,20 @@ static std::vector<int> smtk_index_list(MdbHandle *mdb, const char *table_name,
 	if (!table)
 		return {};
 
-	/* Parse the table searching for dive_idx */
-	std::vector<int> res;
-	while (table.fetch_row()) {
-		if (!strcmp(dive_idx, table.get_data(0)))
-			res.push_back(atoi(table.get_data(1)));
-	}
+	smtk_relations res;
+	while (table.fetch_row())
+		res[table.get_data(0)].push_back(atoi(table.get_data(1)));
 
 	return res;
 }
 
+static const std::vector<int> &smtk_index_list(const smtk_relations &relations, const char *dive_idx)
+{
+	static const std::vector<int> empty;
+	auto it = relations.find(dive_idx);
+	return it != relations.end() ? it->second : empty;
+}
+
 /*
  * "Buddy" is a bit special table that needs some extra work, so we can't just use smtk_build_list.
  * "Buddy" table is a buddies relation with lots and lots and lots of data (even buddy mother's
@@ -643,12 +697,11 @@ T get(const std::vector<T> &v, int idx)
 /*
  * Returns string with buddies names as registered in smartrak (may be a nickname).
  */
-static std::string smtk_locate_buddy(MdbHandle *mdb, char *dive_idx, const std::vector<std::string> &buddies_list)
+static std::string smtk_locate_buddy(const smtk_relations &relations, const char *dive_idx, const std::vector<std::string> &buddies_list)
 {
 	std::string str;
 
-	std::vector<int> rel_list = smtk_index_list(mdb, "BuddyRelation", dive_idx);
-	for (int idx: rel_list)
+	for (int idx: smtk_index_list(relations, dive_idx))
 		concat(str, ", ", std::string(get(buddies_list, idx - 1)));
 
 	return str;
@@ -660,13 +713,12 @@ static std::string smtk_locate_buddy(MdbHandle *mdb, char *dive_idx, const std::
  * The "tag" parameter is used to mark if we want this table to be imported
  * into tags or into notes.
  */
-static void smtk_parse_relations(MdbHandle *mdb, struct dive *dive, char *dive_idx, const char *table_name, const char *rel_table_name, const std::vector<std::string> &list, bool tag)
+static void smtk_parse_relations(const smtk_relations &relations, struct dive *dive, const char *dive_idx, const char *table_name, const std::vector<std::string> &list, bool tag)
 {
 	std::string tmp;
 
 	/* Get the text associated with the relations */
-	std::vector<int> diverel_list = smtk_index_list(mdb, rel_table_name, dive_idx);
-	for (int idx: diverel_list) {
+	for (int idx: smtk_index_list(relations, dive_idx)) {
 		const std::string str = get(list, idx - 1);
 		if (str.empty())
 			continue;
@@ -688,7 +740,7 @@ static void smtk_parse_relations(MdbHandle *mdb, struct dive *dive, char *dive_i
  * in Subsurface. Write them as tags or dive notes by setting true or false the
  * boolean parameter "tag".
  */
-static void smtk_parse_other(struct dive *dive, const std::vector<std::string> &list, const char *data_name, char *idx, bool tag)
+static void smtk_parse_other(struct dive *dive, const std::vector<std::string> &list, const char *data_name, const char *idx, bool tag)
 {
        int i = atoi(idx) - 1;
        if (i < 0 || i >= (int)list.size())
@@ -724,28 +776,42 @@ static struct event *find_bookmark(struct divecomputer &dc, int t)
  * XConnect irelevant
  * YConnect irelevant
  */
-static void smtk_parse_bookmarks(MdbHandle *mdb, struct dive *d, char *dive_idx)
-{
+struct smtk_marker {
 	int time;
-	struct event *ev;
+	std::string text;
+};
+using smtk_markers = std::unordered_map<std::string, std::vector<smtk_marker>>;
 
+static smtk_markers smtk_read_markers(MdbHandle *mdb)
+{
 	SmtkTable table(mdb, "Marker");
 	if (!table) {
-		report_error("[smtk-import] Error - Couldn't open table 'Marker', dive %d", d->number);
-		return;
+		report_error("[smtk-import] Error - Couldn't open table 'Marker'");
+		return {};
 	}
-	while (table.fetch_row()) {
-		if (same_string(table.get_data(0), dive_idx)) {
-			time = lrint(strtod(table.get_data(4), NULL) * 60);
-			const char *tmp = table.get_data(2);
-			ev = find_bookmark(d->dcs[0], time);
-			if (ev)
-				ev->name = tmp;
-			else
-				if (!add_event(&d->dcs[0], time, SAMPLE_EVENT_BOOKMARK, 0, 0, tmp))
-					report_error("[smtk-import] Error - Couldn't add bookmark, dive %d, Name = %s",
-						     d->number, tmp);
-		}
+
+	smtk_markers res;
+	while (table.fetch_row())
+		res[table.get_data(0)].push_back({ (int)lrint(strtod(table.get_data(4), NULL) * 60), table.get_data(2) });
+	return res;
+}
+
+static void smtk_parse_bookmarks(const smtk_markers &markers, struct dive *d, const char *dive_idx)
+{
+	struct event *ev;
+
+	auto it = markers.find(dive_idx);
+	if (it == markers.end())
+		return;
+	for (const smtk_marker &marker: it->second) {
+		const char *tmp = marker.text.c_str();
+		ev = find_bookmark(d->dcs[0], marker.time);
+		if (ev)
+			ev->name = tmp;
+		else
+			if (!add_event(&d->dcs[0], marker.time, SAMPLE_EVENT_BOOKMARK, 0, 0, tmp))
+				report_error("[smtk-import] Error - Couldn't add bookmark, dive %d, Name = %s",
+					     d->number, tmp);
 	}
 }
 
@@ -757,32 +823,20 @@ static void smtk_parse_bookmarks(MdbHandle *mdb, struct dive *d, char *dive_idx)
  */
 static dc_descriptor_t *get_data_descriptor(int data_model, dc_family_t data_fam)
 {
-	dc_descriptor_t *descriptor = NULL, *current = NULL;
-	dc_iterator_t *iterator = NULL;
-	dc_status_t rc;
-
-	rc = dc_descriptor_iterator(&iterator);
-	if (rc != DC_STATUS_SUCCESS) {
-		report_error("[Error][libdc]\t\t\tCreating the device descriptor iterator.\n");
-		return current;
-	}
-	while ((dc_iterator_next(iterator, &descriptor)) == DC_STATUS_SUCCESS) {
+	if (data_fam == DC_FAMILY_UWATEC_ALADIN)
+		return get_descriptor(data_fam, data_model);
+
+	dc_descriptor_t *current = NULL;
+	for (dc_descriptor_t *descriptor: all_descriptors()) {
 		int desc_model = dc_descriptor_get_model(descriptor);
 		dc_family_t desc_fam = dc_descriptor_get_type(descriptor);
 
-		if (data_fam == DC_FAMILY_UWATEC_ALADIN) {
-			if (data_model == desc_model && data_fam == desc_fam) {
-				current = descriptor;
-				break;
-			}
-		} else if (data_model == desc_model && (desc_fam == DC_FAMILY_UWATEC_SMART ||
-							desc_fam == DC_FAMILY_UWATEC_MERIDIAN)) {
+		if (data_model == desc_model && (desc_fam == DC_FAMILY_UWATEC_SMART ||
+						 desc_fam == DC_FAMILY_UWATEC_MERIDIAN)) {
 			current = descriptor;
 			break;
 		}
-		dc_descriptor_free(descriptor);
 	}
-	dc_iterator_free(iterator);
 	return current;
 }
 
@@ -842,18 +896,92 @@ static dc_status_t libdc_buffer_complete(device_data_t *dev_data, unsigned char
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * A row of the Dives table. The profiles are parsed by libdivecomputer in
+ * parallel, once all rows are read, then the dives are completed with the
+ * data of the linked tables.
+ */
+struct smtk_dive {
+	std::unique_ptr<dive> d;
+	std::vector<std::string> cols;
+	device_data_t devdata;
+	std::vector<unsigned char> buffer;	// Header and profile, for libdivecomputer
+};
+
+/*
+ * Reads a row of the Dives table, including the blobs of the header and
+ * the profile, which can only be read through the mdb handle.
+ */
+static std::unique_ptr<smtk_dive> smtk_read_dive(MdbHandle *mdb, const SmtkTable &mdb_table)
+{
+	MdbColumn *col[MDB_MAX_COLS];
+	dc_family_t dc_fam = DC_FAMILY_NULL;
+	unsigned char *prf_buffer = NULL, *hdr_buffer = NULL;
+	size_t hdr_length = 0, prf_length = 0;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	int dc_model;
+
+	auto res = std::make_unique<smtk_dive>();
+	res->d = std::make_unique<dive>();
+	struct dive *smtkdive = res->d.get();
+
+	for (size_t j = 0; j < mdb_table.table->num_cols; j++) {
+		col[j] = static_cast<MdbColumn *>(g_ptr_array_index(mdb_table.table->columns, j));
+		res->cols.emplace_back(mdb_table.get_data(j));
+	}
+	const std::vector<std::string> &cols = res->cols;
+	smtkdive->number = lrint(strtod(cols[1].c_str(), NULL));
+	/*
+	 * If there is a DC model (no zero) try to create a buffer for the
+	 * dive and parse it with libdivecomputer
+	 */
+	dc_model = lrint(strtod(cols[coln(DCMODEL)].c_str(), NULL)) & 0xFF;
+	if (mdb_table.get_len(coln(LOG))) {
+		hdr_buffer = static_cast<unsigned char *>(mdb_ole_read_full(mdb, col[coln(LOG)], &hdr_length));
+		if (hdr_length > 0 && hdr_length < 20)	// We have a profile but it's imported from datatrak
+			dc_fam = DC_FAMILY_UWATEC_ALADIN;
+	}
+	rc = prepare_data(dc_model, cols[coln(DCNUMBER)].c_str(), dc_fam, res->devdata);
+	smtkdive->dcs[0].model = res->devdata.model;
+	if (rc == DC_STATUS_SUCCESS && mdb_table.get_len(coln(PROFILE))) {
+		prf_buffer = static_cast<unsigned char *>(mdb_ole_read_full(mdb, col[coln(PROFILE)], &prf_length));
+		if (prf_length > 0) {
+			if (dc_descriptor_get_type(res->devdata.descriptor) == DC_FAMILY_UWATEC_ALADIN || dc_descriptor_get_type(res->devdata.descriptor) == DC_FAMILY_UWATEC_MEMOMOUSE)
+				hdr_length = 18;
+			res->buffer.resize(hdr_length + prf_length);
+			rc = libdc_buffer_complete(&res->devdata, hdr_buffer, hdr_length, prf_buffer, prf_length, res->buffer.data());
+			if (rc != DC_STATUS_SUCCESS) {
+				report_error("[Error][smartrak_import]\t- %s - for dive %d", errmsg(rc), smtkdive->number);
+				res->buffer.clear();
+			}
+		} else {
+			/* Dives without profile samples (usual in older aladin series) */
+			report_error("[Warning][smartrak_import]\t No profile for dive %d", smtkdive->number);
+			smtkdive->dcs[0].duration.seconds = smtkdive->duration.seconds = smtk_time_to_secs(cols[coln(DURATION)].c_str());
+			smtkdive->dcs[0].maxdepth.mm = smtkdive->maxdepth.mm = lrint(strtod(cols[coln(MAXDEPTH)].c_str(), NULL) * 1000);
+		}
+	} else {
+		/* Manual dives or unknown DCs */
+		report_error("[Warning][smartrak_import]\t Manual or unknown dive computer for dive %d", smtkdive->number);
+		smtkdive->dcs[0].duration.seconds = smtkdive->duration.seconds = smtk_time_to_secs(cols[coln(DURATION)].c_str());
+		smtkdive->dcs[0].maxdepth.mm = smtkdive->maxdepth.mm = lrint(strtod(cols[coln(MAXDEPTH)].c_str(), NULL) * 1000);
+	}
+	free(hdr_buffer);
+	free(prf_buffer);
+	return res;
+}
+
 /*
  * Main function.
- * Two looping levels using a database for the first level ("Dives" table)
- * and a clone of the first DB for the second level (each dive items). Using
- * a DB clone is necessary as calling mdb_fetch_row() over different tables in
- * a single DB breaks binded row data, and so would break the top loop.
+ * The linked tables are read into memory first, then the rows of the
+ * "Dives" table. Reading all tables of a DB through one handle is fine as
+ * long as only one table is iterated at a time: calling mdb_fetch_row()
+ * over different tables in a single DB breaks binded row data.
  */
 void smartrak_import(const char *file, struct divelog *log)
 {
-	MdbHandle *mdb, *mdb_clon;
-	MdbColumn *col[MDB_MAX_COLS];
-	int i, dc_model;
+	MdbHandle *mdb;
+	int i;
 
 	// Set an european style locale to work date/time conversion
 	setlocale(LC_TIME, "POSIX");
@@ -864,22 +992,21 @@ void smartrak_import(const char *file, struct divelog *log)
 	}
 	if (!mdb_read_catalog(mdb, MDB_TABLE)) {
 		report_error("[Error][smartrak_import]\tFile %s does not seem to be an Access database.", file);
+		mdb_close(mdb);
 		return;
 	}
-	mdb_clon = mdb_clone_handle(mdb);
-	mdb_read_catalog(mdb_clon, MDB_TABLE);
 
 	/* Load auxiliary tables */
-	std::vector<std::string> type_list = smtk_build_list(mdb_clon, "Type");
-	std::vector<std::string> activity_list = smtk_build_list(mdb_clon, "Activity");
-	std::vector<std::string> gear_list = smtk_build_list(mdb_clon, "Gear");
-	std::vector<std::string> fish_list = smtk_build_list(mdb_clon, "Fish");
-	std::vector<std::string> smtk_ver = smtk_build_list(mdb_clon, "SmartTrak");
-	std::vector<std::string> suit_list = smtk_build_list(mdb_clon, "Suit");
-	std::vector<std::string> weather_list = smtk_build_list(mdb_clon, "Weather");
-	std::vector<std::string> underwater_list = smtk_build_list(mdb_clon, "Underwater");
-	std::vector<std::string> surface_list = smtk_build_list(mdb_clon, "Surface");
-	std::vector<std::string> buddy_list = smtk_build_buddies(mdb_clon);
+	std::vector<std::string> type_list = smtk_build_list(mdb, "Type");
+	std::vector<std::string> activity_list = smtk_build_list(mdb, "Activity");
+	std::vector<std::string> gear_list = smtk_build_list(mdb, "Gear");
+	std::vector<std::string> fish_list = smtk_build_list(mdb, "Fish");
+	std::vector<std::string> smtk_ver = smtk_build_list(mdb, "SmartTrak");
+	std::vector<std::string> suit_list = smtk_build_list(mdb, "Suit");
+	std::vector<std::string> weather_list = smtk_build_list(mdb, "Weather");
+	std::vector<std::string> underwater_list = smtk_build_list(mdb, "Underwater");
+	std::vector<std::string> surface_list = smtk_build_list(mdb, "Surface");
+	std::vector<std::string> buddy_list = smtk_build_buddies(mdb);
 
 	/* Check Smarttrak version (different number of supported tanks, mixes and so).
 	 * File format 10000 is quite different from other formats, just drop it and give
@@ -888,67 +1015,48 @@ void smartrak_import(const char *file, struct divelog *log)
 	smtk_version = atoi(get(smtk_ver, 0).c_str());
 	if (smtk_version == 10000) {
 		report_error("[Error]\t File %s is SmartTrak file format %d which is not supported. Please load the file in a newer SmartTrak software version and upgrade it.", file, smtk_version);
+		mdb_close(mdb);
 		return;
 	}
 	tanks = (smtk_version < 10213) ? 3 : 10;
 
-	SmtkTable mdb_table(mdb, "Dives");
-	if (!mdb_table) {
-		report_error("[Error][smartrak_import]\tFile %s does not seem to be an SmartTrak file.", file);
-		return;
+	/* Load the tables linked to the dives */
+	smtk_relations buddy_rel = smtk_read_relations(mdb, "BuddyRelation");
+	smtk_relations type_rel = smtk_read_relations(mdb, "TypeRelation");
+	smtk_relations activity_rel = smtk_read_relations(mdb, "ActivityRelation");
+	smtk_relations gear_rel = smtk_read_relations(mdb, "GearRelation");
+	smtk_relations fish_rel = smtk_read_relations(mdb, "FishRelation");
+	smtk_markers markers = smtk_read_markers(mdb);
+	smtk_site_tables site_tables(mdb);
+	std::vector<cylinder_type_t> tank_list = smtk_build_tanks(mdb);
+
+	std::vector<std::unique_ptr<smtk_dive>> dives;
+	{
+		SmtkTable mdb_table(mdb, "Dives");
+		if (!mdb_table) {
+			report_error("[Error][smartrak_import]\tFile %s does not seem to be an SmartTrak file.", file);
+			mdb_close(mdb);
+			return;
+		}
+		while (mdb_table.fetch_row())
+			dives.push_back(smtk_read_dive(mdb, mdb_table));
 	}
-	while (mdb_table.fetch_row()) {
-		device_data_t devdata;
-		dc_family_t dc_fam = DC_FAMILY_NULL;
-		unsigned char *prf_buffer, *hdr_buffer;
-		auto smtkdive = std::make_unique<dive>();
+
+	/* Parsing the profiles is the expensive part, and independent for every dive */
+	QtConcurrent::blockingMap(dives, [](std::unique_ptr<smtk_dive> &sd) {
+		if (sd->buffer.empty())
+			return;
+		dc_status_t rc = libdc_buffer_parser(sd->d.get(), &sd->devdata, sd->buffer.data(), sd->buffer.size());
+		if (rc != DC_STATUS_SUCCESS)
+			report_error("[Error][libdc]\t\t- %s - for dive %d", errmsg(rc), sd->d->number);
+		sd->buffer = std::vector<unsigned char>();
+	});
+
+	for (auto &sd: dives) {
+		struct dive *smtkdive = sd->d.get();
+		const std::vector<std::string> &cols = sd->cols;
 		struct tm tm_date;
-		size_t hdr_length, prf_length;
-		dc_status_t rc = DC_STATUS_SUCCESS;
 
-		for (size_t j = 0; j < mdb_table.table->num_cols; j++)
-			col[j] = static_cast<MdbColumn *>(g_ptr_array_index(mdb_table.table->columns, j));
-		smtkdive->number = lrint(strtod(mdb_table.get_data(1), NULL));
-		/*
-		 * If there is a DC model (no zero) try to create a buffer for the
-		 * dive and parse it with libdivecomputer
-		 */
-		dc_model = lrint(strtod(mdb_table.get_data(coln(DCMODEL)), NULL)) & 0xFF;
-		if (mdb_table.get_len(coln(LOG))) {
-			hdr_buffer = static_cast<unsigned char *>(mdb_ole_read_full(mdb, col[coln(LOG)], &hdr_length));
-			if (hdr_length > 0 && hdr_length < 20)	// We have a profile but it's imported from datatrak
-				dc_fam = DC_FAMILY_UWATEC_ALADIN;
-		}
-		rc = prepare_data(dc_model, (char *)col[coln(DCNUMBER)]->bind_ptr, dc_fam, devdata);
-		smtkdive->dcs[0].model = devdata.model;
-		if (rc == DC_STATUS_SUCCESS && mdb_table.get_len(coln(PROFILE))) {
-			prf_buffer = static_cast<unsigned char *>(mdb_ole_read_full(mdb, col[coln(PROFILE)], &prf_length));
-			if (prf_length > 0) {
-				if (dc_descriptor_get_type(devdata.descriptor) == DC_FAMILY_UWATEC_ALADIN || dc_descriptor_get_type(devdata.descriptor) == DC_FAMILY_UWATEC_MEMOMOUSE)
-					hdr_length = 18;
-				std::vector<unsigned char> compl_buffer(hdr_length+prf_length);
-				rc = libdc_buffer_complete(&devdata, hdr_buffer, hdr_length, prf_buffer, prf_length, compl_buffer.data());
-				if (rc != DC_STATUS_SUCCESS) {
-					report_error("[Error][smartrak_import]\t- %s - for dive %d", errmsg(rc), smtkdive->number);
-				} else {
-					rc = libdc_buffer_parser(smtkdive.get(), &devdata, compl_buffer.data(), hdr_length + prf_length);
-					if (rc != DC_STATUS_SUCCESS)
-						report_error("[Error][libdc]\t\t- %s - for dive %d", errmsg(rc), smtkdive->number);
-				}
-			} else {
-				/* Dives without profile samples (usual in older aladin series) */
-				report_error("[Warning][smartrak_import]\t No profile for dive %d", smtkdive->number);
-				smtkdive->dcs[0].duration.seconds = smtkdive->duration.seconds = smtk_time_to_secs((char *)col[coln(DURATION)]->bind_ptr);
-				smtkdive->dcs[0].maxdepth.mm = smtkdive->maxdepth.mm = lrint(strtod((char *)col[coln(MAXDEPTH)]->bind_ptr, NULL) * 1000);
-			}
-			free(hdr_buffer);
-			free(prf_buffer);
-		} else {
-			/* Manual dives or unknown DCs */
-			report_error("[Warning][smartrak_import]\t Manual or unknown dive computer for dive %d", smtkdive->number);
-			smtkdive->dcs[0].duration.seconds = smtkdive->duration.seconds = smtk_time_to_secs((char *)col[coln(DURATION)]->bind_ptr);
-			smtkdive->dcs[0].maxdepth.mm = smtkdive->maxdepth.mm = lrint(strtod((char *)col[coln(MAXDEPTH)]->bind_ptr, NULL) * 1000);
-		}
 		/*
 		 * Cylinder and gasmixes completion.
 		 * Revisit data under some circunstances, e.g. a start pressure = 0 may mean
@@ -964,63 +1072,60 @@ void smartrak_import(const char *file, struct divelog *log)
 			if (!tmptank)
 				break;
 			if (tmptank->start.mbar == 0)
-				tmptank->start.mbar = lrint(strtod((char *)col[(i * 2) + pstartcol]->bind_ptr, NULL) * 1000);
+				tmptank->start.mbar = lrint(strtod(cols[(i * 2) + pstartcol].c_str(), NULL) * 1000);
 			/*
 			 * If there is a start pressure ensure that end pressure is not zero as
 			 * will be registered in DCs which only keep track of differential pressures,
 			 * and collect the data registered  by the user in mdb
 			 */
 			if (tmptank->end.mbar == 0 && tmptank->start.mbar != 0)
-				tmptank->end.mbar = lrint(strtod((char *)col[(i * 2) + 1 + pstartcol]->bind_ptr, NULL) * 1000 ? : 1000);
+				tmptank->end.mbar = lrint(strtod(cols[(i * 2) + 1 + pstartcol].c_str(), NULL) * 1000 ? : 1000);
 			if (tmptank->gasmix.o2.permille == 0)
-				tmptank->gasmix.o2.permille = lrint(strtod((char *)col[i + o2fraccol]->bind_ptr, NULL) * 10);
+				tmptank->gasmix.o2.permille = lrint(strtod(cols[i + o2fraccol].c_str(), NULL) * 10);
 			if (smtk_version == 10213) {
 				if (tmptank->gasmix.he.permille == 0)
-					tmptank->gasmix.he.permille = lrint(strtod((char *)col[i + hefraccol]->bind_ptr, NULL) * 10);
+					tmptank->gasmix.he.permille = lrint(strtod(cols[i + hefraccol].c_str(), NULL) * 10);
 			} else {
 				tmptank->gasmix.he = 0_percent;
 			}
-			smtk_build_tank_info(mdb_clon, tmptank, (char *)col[i + tankidxcol]->bind_ptr);
+			smtk_build_tank_info(tank_list, tmptank, cols[i + tankidxcol].c_str());
 		}
 		/* Check for duplicated cylinders and clean them */
-		smtk_clean_cylinders(smtkdive.get());
+		smtk_clean_cylinders(smtkdive);
 
 		/* Date issues with libdc parser - Take date time from mdb */
-		smtk_date_to_tm((char *)col[coln(_DATE)]->bind_ptr, &tm_date);
-		smtk_time_to_tm((char *)col[coln(INTIME)]->bind_ptr, &tm_date);
+		smtk_date_to_tm(cols[coln(_DATE)].c_str(), &tm_date);
+		smtk_time_to_tm(cols[coln(INTIME)].c_str(), &tm_date);
 		smtkdive->dcs[0].when = smtkdive->when = smtk_timegm(&tm_date);
-		smtkdive->dcs[0].surfacetime.seconds = smtk_time_to_secs((char *)col[coln(INTVAL)]->bind_ptr);
+		smtkdive->dcs[0].surfacetime.seconds = smtk_time_to_secs(cols[coln(INTVAL)].c_str());
 
 		/* Data that user may have registered manually if not supported by DC, or not parsed */
 		if (!smtkdive->airtemp.mkelvin)
-			smtkdive->airtemp.mkelvin = C_to_mkelvin(lrint(strtod((char *)col[coln(AIRTEMP)]->bind_ptr, NULL)));
+			smtkdive->airtemp.mkelvin = C_to_mkelvin(lrint(strtod(cols[coln(AIRTEMP)].c_str(), NULL)));
 		if (!smtkdive->watertemp.mkelvin)
-			smtkdive->watertemp.mkelvin = smtkdive->mintemp.mkelvin = C_to_mkelvin(lrint(strtod((char *)col[coln(MINWATERTEMP)]->bind_ptr, NULL)));
+			smtkdive->watertemp.mkelvin = smtkdive->mintemp.mkelvin = C_to_mkelvin(lrint(strtod(cols[coln(MINWATERTEMP)].c_str(), NULL)));
 		if (!smtkdive->maxtemp.mkelvin)
-			smtkdive->maxtemp.mkelvin = C_to_mkelvin(lrint(strtod((char *)col[coln(MAXWATERTEMP)]->bind_ptr, NULL)));
+			smtkdive->maxtemp.mkelvin = C_to_mkelvin(lrint(strtod(cols[coln(MAXWATERTEMP)].c_str(), NULL)));
 
 		/* No DC related data */
-		smtkdive->visibility = strtod((char *)col[coln(VISIBILITY)]->bind_ptr, NULL) > 25 ? 5 : lrint(strtod((char *)col[13]->bind_ptr, NULL) / 5);
-		weightsystem_t ws = { { .grams = int_cast<int>(strtod((char *)col[coln(WEIGHT)]->bind_ptr, NULL) * 1000)}, std::string(), false };
+		smtkdive->visibility = strtod(cols[coln(VISIBILITY)].c_str(), NULL) > 25 ? 5 : lrint(strtod(cols[13].c_str(), NULL) / 5);
+		weightsystem_t ws = { { .grams = int_cast<int>(strtod(cols[coln(WEIGHT)].c_str(), NULL) * 1000)}, std::string(), false };
 		smtkdive->weightsystems.push_back(std::move(ws));
-		smtkdive->suit = get(suit_list, atoi((char *)col[coln(SUITIDX)]->bind_ptr) - 1);
-		smtk_build_location(mdb_clon, (char *)col[coln(SITEIDX)]->bind_ptr, &smtkdive->dive_site, log);
-		smtkdive->buddy = smtk_locate_buddy(mdb_clon, (char *)col[0]->bind_ptr, buddy_list);
-		smtk_parse_relations(mdb_clon, smtkdive.get(), (char *)col[0]->bind_ptr, "Type", "TypeRelation", type_list, true);
-		smtk_parse_relations(mdb_clon, smtkdive.get(), (char *)col[0]->bind_ptr, "Activity", "ActivityRelation", activity_list, false);
-		smtk_parse_relations(mdb_clon, smtkdive.get(), (char *)col[0]->bind_ptr, "Gear", "GearRelation", gear_list, false);
-		smtk_parse_relations(mdb_clon, smtkdive.get(), (char *)col[0]->bind_ptr, "Fish", "FishRelation", fish_list, false);
-		smtk_parse_other(smtkdive.get(), weather_list, "Weather", (char *)col[coln(WEATHERIDX)]->bind_ptr, false);
-		smtk_parse_other(smtkdive.get(), underwater_list, "Underwater", (char *)col[coln(UNDERWATERIDX)]->bind_ptr, false);
-		smtk_parse_other(smtkdive.get(), surface_list, "Surface", (char *)col[coln(SURFACEIDX)]->bind_ptr, false);
-		smtk_parse_bookmarks(mdb_clon, smtkdive.get(), (char *)col[0]->bind_ptr);
-		concat(smtkdive->notes, "\n", std::string((char *)col[coln(REMARKS)]->bind_ptr));
-
-		log->dives.record_dive(std::move(smtkdive));
+		smtkdive->suit = get(suit_list, atoi(cols[coln(SUITIDX)].c_str()) - 1);
+		smtk_build_location(site_tables, cols[coln(SITEIDX)].c_str(), &smtkdive->dive_site, log);
+		smtkdive->buddy = smtk_locate_buddy(buddy_rel, cols[0].c_str(), buddy_list);
+		smtk_parse_relations(type_rel, smtkdive, cols[0].c_str(), "Type", type_list, true);
+		smtk_parse_relations(activity_rel, smtkdive, cols[0].c_str(), "Activity", activity_list, false);
+		smtk_parse_relations(gear_rel, smtkdive, cols[0].c_str(), "Gear", gear_list, false);
+		smtk_parse_relations(fish_rel, smtkdive, cols[0].c_str(), "Fish", fish_list, false);
+		smtk_parse_other(smtkdive, weather_list, "Weather", cols[coln(WEATHERIDX)].c_str(), false);
+		smtk_parse_other(smtkdive, underwater_list, "Underwater", cols[coln(UNDERWATERIDX)].c_str(), false);
+		smtk_parse_other(smtkdive, surface_list, "Surface", cols[coln(SURFACEIDX)].c_str(), false);
+		smtk_parse_bookmarks(markers, smtkdive, cols[0].c_str());
+		concat(smtkdive->notes, "\n", cols[coln(REMARKS)]);
+
+		log->dives.record_dive(std::move(sd->d));
 	}
-	mdb_free_catalog(mdb_clon);
-	mdb->catalog = NULL;
-	mdb_close(mdb_clon);
 	mdb_close(mdb);
 	log->dives.sort();
 }
@@ -13,9 +13,13 @@
 #include "core/qthelper.h"
 #include "core/selection.h"
 
+#include <algorithm>
+#include <cmath>
+
 ScatterSeries::ScatterSeries(StatsView &view, StatsAxis *xAxis, StatsAxis *yAxis,
 			     const StatsVariable &varX, const StatsVariable &varY) :
 	StatsSeries(view, xAxis, yAxis),
+	gridDirty(true),
 	varX(varX), varY(varY)
 {
 }
@@ -51,51 +55,105 @@ void ScatterSeries::Item::highlight(bool highlight)
 void ScatterSeries::append(dive *d, double pos, double value)
 {
 	items.emplace_back(view, this, d, pos, value);
+	gridDirty = true;
 }
 
 void ScatterSeries::updatePositions()
 {
 	for (Item &item: items)
 		item.updatePosition(this);
+	gridDirty = true;
 }
 
-std::vector<int> ScatterSeries::getItemsUnderMouse(const QPointF &point) const
+static int gridCell(double v, double origin, double cellSize, int num)
 {
-	std::vector<int> res;
-	double x = point.x();
-
-	auto low = std::lower_bound(items.begin(), items.end(), x,
-				    [] (const Item &item, double x) { return item.item->getRect().right() < x; });
-	auto high = std::upper_bound(low, items.end(), x,
-				    [] (double x, const Item &item) { return x < item.item->getRect().left(); });
-	// Hopefully that narrows it down enough. For discrete scatter plots, we could also partition
-	// by equal x and do a binary search in these partitions. But that's probably not worth it.
-	res.reserve(high - low);
-	for (auto it = low; it < high; ++it) {
-		if (it->item->contains(point))
-			res.push_back(it - items.begin());
+	return std::clamp((int)floor((v - origin) / cellSize), 0, num - 1);
+}
+
+void ScatterSeries::buildGrid() const
+{
+	gridDirty = false;
+	grid.cells.clear();
+	if (items.empty())
+		return;
+
+	QRectF itemRect = items[0].item->getRect();
+	QRectF bounds = itemRect;
+	for (const Item &item: items)
+		bounds |= item.item->getRect();
+
+	// A cell is at least as large as an item, so that an item covers at most four cells.
+	// Don't use more cells than needed for a sparsely populated grid.
+	size_t maxCells = 4 * items.size() + 1024;
+	double cellSize = std::max(itemRect.width(), itemRect.height());
+	cellSize = std::max(cellSize, sqrt(bounds.width() * bounds.height() / maxCells));
+	cellSize = std::max(cellSize, 1.0);
+
+	grid.bounds = bounds;
+	grid.cellSize = cellSize;
+	grid.cols = (int)floor(bounds.width() / cellSize) + 1;
+	grid.rows = (int)floor(bounds.height() / cellSize) + 1;
+	grid.cells.resize(grid.cols * grid.rows);
+	for (size_t i = 0; i < items.size(); ++i) {
+		QRectF r = items[i].item->getRect();
+		int left = gridCell(r.left(), bounds.left(), cellSize, grid.cols);
+		int right = gridCell(r.right(), bounds.left(), cellSize, grid.cols);
+		int top = gridCell(r.top(), bounds.top(), cellSize, grid.rows);
+		int bottom = gridCell(r.bottom(), bounds.top(), cellSize, grid.rows);
+		for (int row = top; row <= bottom; ++row) {
+			for (int col = left; col <= right; ++col)
+				grid.cells[row * grid.cols + col].push_back((int)i);
+		}
 	}
-	return res;
 }
 
-std::vector<int> ScatterSeries::getItemsInRect(const QRectF &rect) const
+std::vector<int> ScatterSeries::gridCandidates(const QRectF &rect) const
 {
+	if (gridDirty)
+		buildGrid();
+
 	std::vector<int> res;
+	const QRectF &bounds = grid.bounds;
+	if (grid.cells.empty() || rect.right() < bounds.left() || rect.left() > bounds.right() ||
+	    rect.bottom() < bounds.top() || rect.top() > bounds.bottom())
+		return res;
 
-	auto low = std::lower_bound(items.begin(), items.end(), rect.left(),
-				    [] (const Item &item, double x) { return item.item->getRect().right() < x; });
-	auto high = std::upper_bound(low, items.end(), rect.right(),
-				    [] (double x, const Item &item) { return x < item.item->getRect().left(); });
-	// Hopefully that narrows it down enough. For discrete scatter plots, we could also partition
-	// by equal x and do a binary search in these partitions. But that's probably not worth it.
-	res.reserve(high - low);
-	for (auto it = low; it < high; ++it) {
-		if (it->item->inRect(rect))
-			res.push_back(it - items.begin());
+	int left = gridCell(rect.left(), bounds.left(), grid.cellSize, grid.cols);
+	int right = gridCell(rect.right(), bounds.left(), grid.cellSize, grid.cols);
+	int top = gridCell(rect.top(), bounds.top(), grid.cellSize, grid.rows);
+	int bottom = gridCell(rect.bottom(), bounds.top(), grid.cellSize, grid.rows);
+	for (int row = top; row <= bottom; ++row) {
+		for (int col = left; col <= right; ++col) {
+			const std::vector<int> &cell = grid.cells[row * grid.cols + col];
+			res.insert(res.end(), cell.begin(), cell.end());
+		}
+	}
+	// Items that span multiple cells were added more than once
+	if (left != right || top != bottom) {
+		std::sort(res.begin(), res.end());
+		res.erase(std::unique(res.begin(), res.end()), res.end());
 	}
 	return res;
 }
 
+std::vector<int> ScatterSeries::getItemsUnderMouse(const QPointF &point) const
+{
+	std::vector<int> res = gridCandidates(QRectF(point, point));
+	res.erase(std::remove_if(res.begin(), res.end(),
+				 [this, &point](int idx) { return !items[idx].item->contains(point); }),
+		  res.end());
+	return res;
+}
+
+std::vector<int> ScatterSeries::getItemsInRect(const QRectF &rect) const
+{
+	std::vector<int> res = gridCandidates(rect.normalized());
+	res.erase(std::remove_if(res.begin(), res.end(),
+				 [this, &rect](int idx) { return !items[idx].item->inRect(rect); }),
+		  res.end());
+	return res;
+}
+
 bool ScatterSeries::selectItemsUnderMouse(const QPointF &point, SelectionModifier modifier)
 {
 	std::vector<int> indices = getItemsUnderMouse(point);
@@ -122,9 +180,11 @@ void ScatterSeries::selectItemsInRect(const QRectF &rect, SelectionModifier modi
 
 	if (modifier.ctrl) {
 		selected = oldSelection;
-		// Ouch - this primitive merging of the selections grows with O(n^2). Fix this.
+		// Sorted by pointer for quick lookup
+		std::vector<dive *> sortedOld = oldSelection;
+		std::sort(sortedOld.begin(), sortedOld.end());
 		for (int idx: indices) {
-			if (std::find(selected.begin(), selected.end(), items[idx].d) == selected.end())
+			if (!std::binary_search(sortedOld.begin(), sortedOld.end(), items[idx].d))
 				selected.push_back(items[idx].d);
 		}
 	} else {
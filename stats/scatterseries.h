@@ -9,6 +9,7 @@
 
 #include <memory>
 #include <vector>
+#include <QRectF>
 
 class ChartScatterItem;
 struct InformationBox;
@@ -36,6 +37,20 @@ private:
 	std::vector<int> getItemsUnderMouse(const QPointF &f) const;
 	std::vector<int> getItemsInRect(const QRectF &f) const;
 
+	// A uniform grid over the screen rects of the items, so that hovering
+	// and selecting don't have to test every item. Regenerated on demand
+	// when items are added or moved.
+	struct Grid {
+		QRectF bounds;
+		double cellSize;
+		int cols, rows;
+		std::vector<std::vector<int>> cells; // item indices, ascending
+	};
+	mutable Grid grid;
+	mutable bool gridDirty;
+	void buildGrid() const;
+	std::vector<int> gridCandidates(const QRectF &rect) const; // ascending, may contain items outside of rect
+
 	struct Item {
 		ChartItemPtr<ChartScatterItem> item;
 		dive *d;
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "statsquery.h"
+#include "core/dive.h"
+#include "core/filterconstraint.h"
+#include "core/fulltext.h"
+#include "core/pref.h"
+
+#include <numeric>
+#include <QThread>
+#include <QtConcurrent>
+
+// Below this number of dives, the overhead of the thread pool isn't worth it.
+static const size_t parallelQueryThreshold = 1000;
+
+// Runs fn(i) for 0 <= i < n, on the thread pool if there is enough work.
+template <typename Func>
+static void for_each_index(size_t n, size_t work, Func fn)
+{
+	if (work >= parallelQueryThreshold && n > 1 && QThread::idealThreadCount() > 1) {
+		std::vector<size_t> idx(n);
+		std::iota(idx.begin(), idx.end(), 0);
+		QtConcurrent::blockingMap(idx, [&fn](size_t i) { fn(i); });
+	} else {
+		for (size_t i = 0; i < n; ++i)
+			fn(i);
+	}
+}
+
+bool stats_query_add_constraint(StatsQuery &query, const QString &s)
+{
+	bool negate = s.startsWith('!');
+	QStringList parts = s.mid(negate ? 1 : 0).split(':');
+	if (parts.size() < 2 || parts.size() > 3)
+		return false;
+	std::string type = parts[0].trimmed().toStdString();
+	std::string mode = parts.size() == 3 ? parts[1].trimmed().toStdString() : std::string();
+	std::string data = parts.back().toStdString();
+
+	// The constructor falls back to the first type for unknown names.
+	filter_constraint c(type, mode, mode, negate, data);
+	if (type != filter_constraint_type_to_string(c.type))
+		return false;
+	if (!mode.empty() && mode != (filter_constraint_has_string_mode(c.type) ?
+				      filter_constraint_string_mode_to_string(c.string_mode) :
+				      filter_constraint_range_mode_to_string(c.range_mode)))
+		return false;
+	query.filter.constraints.push_back(std::move(c));
+	return true;
+}
+
+const StatsVariable *stats_query_variable(const QString &name)
+{
+	for (const StatsVariable *var: stats_variables) {
+		if (var->name().compare(name, Qt::CaseInsensitive) == 0)
+			return var;
+	}
+	return nullptr;
+}
+
+const StatsBinner *stats_query_binner(const StatsVariable &variable, const QString &name)
+{
+	for (const StatsBinner *binner: variable.binners()) {
+		if (binner->name().compare(name, Qt::CaseInsensitive) == 0)
+			return binner;
+	}
+	return nullptr;
+}
+
+// Same logic as DiveFilter::updateAll(), but without touching the dives.
+std::vector<dive *> stats_query_dives(const StatsQuery &query, const std::vector<dive *> &dives)
+{
+	const FilterData &filter = query.filter;
+	for (const filter_constraint &c: filter.constraints)
+		filter_constraint_prepare(c);
+	bool doFullText = filter.fullText.doit();
+	FullTextResult ft;
+	if (doFullText)
+		ft = fulltext_find_dives(filter.fullText, filter.fulltextStringMode);
+	bool includeInvalid = query.includeInvalid;
+
+	std::vector<char> matches(dives.size());
+	for_each_index(dives.size(), dives.size(), [&](size_t i) {
+		const dive *d = dives[i];
+		matches[i] = (includeInvalid || !d->invalid) &&
+			     (!doFullText || ft.dive_matches(d)) &&
+			     std::all_of(filter.constraints.begin(), filter.constraints.end(),
+					 [d](const filter_constraint &c) { return filter_constraint_match_dive(c, d); });
+	});
+
+	std::vector<dive *> res;
+	for (size_t i = 0; i < dives.size(); ++i) {
+		if (matches[i])
+			res.push_back(dives[i]);
+	}
+	return res;
+}
+
+std::vector<StatsQueryRow> stats_query_run(const StatsQuery &query, const std::vector<dive *> &dives_in)
+{
+	std::vector<dive *> dives = stats_query_dives(query, dives_in);
+	std::vector<StatsQueryRow> res;
+	if (!query.binVariable) {
+		res.push_back({ QString(), std::move(dives), StatsOperationResults() });
+	} else {
+		const StatsBinner *binner = query.binner ? query.binner : query.binVariable->getBinner(0);
+		if (!binner)
+			return res;
+		std::vector<StatsBinDives> bins = binner->bin_dives(dives, false);
+		res.reserve(bins.size());
+		for (auto &[bin, binDives]: bins)
+			res.push_back({ binner->formatWithUnit(*bin), std::move(binDives), StatsOperationResults() });
+	}
+
+	// The operations only read the dives, the bins can be done in parallel.
+	if (query.valueVariable) {
+		const StatsVariable *var = query.valueVariable;
+		for_each_index(res.size(), dives.size(), [&res, var](size_t i) {
+			res[i].results = var->operations(res[i].dives);
+		});
+	}
+	return res;
+}
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0
+// Queries over the dive log without the statistics widgets, for example
+// for batch analytics from the command line. A query selects the dives
+// matching a filter, as defined by the filter presets, sorts them into the
+// bins of a statistics variable and applies the operations of a numeric
+// variable (median, mean, sum, ...) to the dives of every bin.
+#ifndef STATS_QUERY_H
+#define STATS_QUERY_H
+
+#include "statsvariables.h"
+#include "core/divefilter.h"
+
+struct StatsQuery {
+	FilterData filter;
+	bool includeInvalid = false;
+	const StatsVariable *binVariable = nullptr;	// If null, all dives are in one bin
+	const StatsBinner *binner = nullptr;		// If null, the first binner of binVariable
+	const StatsVariable *valueVariable = nullptr;	// If null, the dives are only counted. Must be numeric.
+};
+
+struct StatsQueryRow {
+	QString bin;			// Empty if the dives are not binned
+	std::vector<dive *> dives;
+	StatsOperationResults results;	// Invalid if there is no value variable
+};
+
+// Adds a constraint given as "[!]type[:mode]:data", with the names and the data
+// in the same format as in the filter presets of the log. Returns false on error.
+bool stats_query_add_constraint(StatsQuery &query, const QString &s);
+// Variables and binners by their (case insensitive) name. Null if not found.
+const StatsVariable *stats_query_variable(const QString &name);
+const StatsBinner *stats_query_binner(const StatsVariable &variable, const QString &name);
+
+std::vector<dive *> stats_query_dives(const StatsQuery &query, const std::vector<dive *> &dives);
+std::vector<StatsQueryRow> stats_query_run(const StatsQuery &query, const std::vector<dive *> &dives);
+
+#endif
@@ -16,21 +16,17 @@ void processSelection(std::vector<dive *> dives, SelectionModifier modifier)
 		bool allSelected = std::all_of(dives.begin(), dives.end(),
 					       [] (const dive *d) { return d->selected; });
 		if (allSelected) {
-			// Remove items under cursor from selection. This could be made more efficient.
-			for (const dive *d: dives) {
-				auto it = std::find(selected.begin(), selected.end(), d);
-				if (it != selected.end()) {
-					// Move last element to deselected element. If this already was
-					// the last element, this is a no-op. Then, chop off last element.
-					*it = selected.back();
-					selected.pop_back();
-				}
-			}
+			// Remove items under cursor from selection. Sort them by pointer for quick lookup.
+			std::sort(dives.begin(), dives.end());
+			selected.erase(std::remove_if(selected.begin(), selected.end(),
+						      [&dives](dive *d) { return std::binary_search(dives.begin(), dives.end(), d); }),
+				       selected.end());
 		} else {
-			// Add items under cursor to selection
+			// Add items under cursor to selection. The selected dives are exactly those with the
+			// selected flag set, so no need to search the selection.
 			selected.reserve(dives.size() + selected.size());
 			for (dive *d: dives) {
-				if (std::find(selected.begin(), selected.end(), d) == selected.end())
+				if (!d->selected)
 					selected.push_back(d);
 			}
 		}
@@ -14,6 +14,7 @@
 #include "core/subsurface-time.h"
 #include <cmath>
 #include <limits>
+#include <type_traits>
 #include <QLocale>
 
 static constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
@@ -395,14 +396,27 @@ double StatsVariable::mean(const std::vector<dive *> &dives) const
 	return res.isValid() ? res.mean : invalid_value<double>();
 }
 
+StatsOperationResults StatsVariable::operations(const std::vector<dive *> &dives) const
+{
+	return applyOperations(dives);
+}
+
+std::vector<double> StatsVariable::toFloats(const std::vector<dive *> &dives) const
+{
+	std::vector<double> res(dives.size());
+	for (size_t i = 0; i < dives.size(); ++i)
+		res[i] = toFloat(dives[i]);
+	return res;
+}
+
 std::vector<StatsValue> StatsVariable::values(const std::vector<dive *> &dives) const
 {
+	std::vector<double> floats = toFloats(dives);
 	std::vector<StatsValue> vec;
 	vec.reserve(dives.size());
-	for (dive *d: dives) {
-		double v = toFloat(d);
-		if (!is_invalid_value(v))
-			vec.push_back({ v, d });
+	for (size_t i = 0; i < dives.size(); ++i) {
+		if (!is_invalid_value(floats[i]))
+			vec.push_back({ floats[i], dives[i] });
 	}
 	std::sort(vec.begin(), vec.end(),
 		  [](const StatsValue &v1, const StatsValue &v2)
@@ -468,33 +482,56 @@ StatsQuartiles StatsVariable::quartiles(const std::vector<StatsValue> &vec)
 	}
 }
 
+// Median of an unsorted list. Reorders the list.
+static double median(std::vector<double> &v)
+{
+	size_t s = v.size();
+	auto mid = v.begin() + s / 2;
+	std::nth_element(v.begin(), mid, v.end());
+	if (s % 2)
+		return *mid;
+	// For even lists, the other central element is the largest one before the middle
+	return (*std::max_element(v.begin(), mid) + *mid) / 2.0;
+}
+
 StatsOperationResults StatsVariable::applyOperations(const std::vector<dive *> &dives) const
+{
+	std::vector<double> scratch;
+	return applyOperations(dives, scratch);
+}
+
+// All results are calculated in one pass over the dives, only the median
+// needs a partial sort of the values. The scratch buffer can be reused by
+// the caller to avoid allocations.
+StatsOperationResults StatsVariable::applyOperations(const std::vector<dive *> &dives, std::vector<double> &scratch) const
 {
 	StatsOperationResults res;
-	std::vector<StatsValue> val = values(dives);
+	scratch.clear();
+	res.dives.reserve(dives.size());
 
 	double sumTime = 0.0;
-	res.dives.reserve(val.size());
-	res.median = quartiles(val).q2;
-
-	if (val.empty())
-		return res;
-
-	res.min = std::numeric_limits<double>::max();
-	res.max = std::numeric_limits<double>::lowest();
-	for (auto [v, d]: val) {
+	for (dive *d: dives) {
+		double v = toFloat(d);
+		if (is_invalid_value(v))
+			continue;
+		if (scratch.empty())
+			res.min = res.max = v;
+		scratch.push_back(v);
 		res.dives.push_back(d);
 		res.sum += v;
-		res.mean += v;
 		sumTime += d->duration.seconds;
 		res.timeWeightedMean += v * d->duration.seconds;
-		if (v < res.min)
-			res.min = v;
-		if (v > res.max)
-			res.max = v;
+		res.min = std::min(res.min, v);
+		res.max = std::max(res.max, v);
 	}
 
-	res.mean /= val.size();
+	if (scratch.empty()) {
+		res.median = invalid_value<double>();
+		return res;
+	}
+
+	res.median = median(scratch);
+	res.mean = res.sum / scratch.size();
 	res.timeWeightedMean /= sumTime;
 	return res;
 }
@@ -525,14 +562,14 @@ double StatsOperationResults::get(StatsOperation op) const
 
 std::vector<StatsScatterItem> StatsVariable::scatter(const StatsVariable &t2, const std::vector<dive *> &dives) const
 {
+	std::vector<double> v1 = toFloats(dives);
+	std::vector<double> v2 = t2.toFloats(dives);
 	std::vector<StatsScatterItem> res;
 	res.reserve(dives.size());
-	for (dive *d: dives) {
-		double v1 = toFloat(d);
-		double v2 = t2.toFloat(d);
-		if (is_invalid_value(v1) || is_invalid_value(v2))
+	for (size_t i = 0; i < dives.size(); ++i) {
+		if (is_invalid_value(v1[i]) || is_invalid_value(v2[i]))
 			continue;
-		res.push_back({ v1, v2, d });
+		res.push_back({ v1[i], v2[i], dives[i] });
 	}
 	std::sort(res.begin(), res.end(),
 		  [](const StatsScatterItem &i1, const StatsScatterItem &i2)
@@ -573,8 +610,9 @@ std::vector<StatsBinQuartiles> StatsVariable::bin_quartiles(const StatsBinner &b
 
 std::vector<StatsBinOp> StatsVariable::bin_operations(const StatsBinner &binner, const std::vector<dive *> &dives, bool fill_empty) const
 {
+	std::vector<double> scratch;
 	return bin_convert<StatsOperationResults>(*this, binner, dives, fill_empty,
-						  [this](const std::vector<dive *> &d) { return applyOperations(d); });
+						  [this, &scratch](const std::vector<dive *> &d) { return applyOperations(d, scratch); });
 }
 
 std::vector<StatsBinValues> StatsVariable::bin_values(const StatsBinner &binner, const std::vector<dive *> &dives, bool fill_empty) const
@@ -604,6 +642,10 @@ struct SimpleBin : public StatsBin {
 	bool operator==(StatsBin &b) const {
 		return value == dynamic_cast<SimpleBin &>(b).value;
 	}
+
+	StatsBinPtr clone() const override {
+		return std::make_unique<SimpleBin>(*this);
+	}
 };
 using IntBin = SimpleBin<int>;
 using StringBin = SimpleBin<QString>;
@@ -685,6 +727,39 @@ value_vector_to_bin_vector(const Binner &binner, std::vector<std::pair<BinValueT
 	return res;
 }
 
+// For integer bins, if the used range is not much larger than the number
+// of dives, put the dives directly into a bucket per value. This avoids
+// the binary search of register_bin_value() for every dive.
+// Returns false if the range is too large.
+template<typename Pair>
+static bool int_bins_direct(const std::vector<int> &values, const std::vector<dive *> &dives,
+			    std::vector<Pair> &value_bins)
+{
+	int min = std::numeric_limits<int>::max();
+	int max = std::numeric_limits<int>::min();
+	for (int v: values) {
+		if (is_invalid_value(v))
+			continue;
+		min = std::min(min, v);
+		max = std::max(max, v);
+	}
+	if (min > max)
+		return true; // No valid values
+	if ((int64_t)max - min >= 2 * (int64_t)dives.size() + 64)
+		return false;
+
+	std::vector<std::vector<dive *>> buckets(max - min + 1);
+	for (size_t i = 0; i < dives.size(); ++i) {
+		if (!is_invalid_value(values[i]))
+			buckets[values[i] - min].push_back(dives[i]);
+	}
+	for (size_t i = 0; i < buckets.size(); ++i) {
+		if (!buckets[i].empty())
+			value_bins.emplace_back(min + (int)i, std::move(buckets[i]));
+	}
+	return true;
+}
+
 template<typename Binner, typename Bin>
 std::vector<StatsBinDives> SimpleBinner<Binner, Bin>::bin_dives(const std::vector<dive *> &dives, bool fill_empty) const
 {
@@ -692,12 +767,28 @@ std::vector<StatsBinDives> SimpleBinner<Binner, Bin>::bin_dives(const std::vecto
 	// out of that. I wonder if that is premature optimization?
 	using Pair = std::pair<Type, std::vector<dive *>>;
 	std::vector<Pair> value_bins;
-	for (dive *d: dives) {
-		Type value = derived().to_bin_value(d);
-		if (is_invalid_value(value))
-			continue;
-		register_bin_value(value_bins, value,
-				   [d](std::vector<dive *> &v) { v.push_back(d); });
+	std::vector<Type> values;
+	values.reserve(dives.size());
+	for (dive *d: dives)
+		values.push_back(derived().to_bin_value(d));
+
+	bool done = false;
+	if constexpr (std::is_same_v<Type, int>)
+		done = int_bins_direct(values, dives, value_bins);
+	if (!done) {
+		for (size_t i = 0; i < dives.size(); ++i) {
+			const Type &value = values[i];
+			if (is_invalid_value(value))
+				continue;
+			// Consecutive dives often end up in the same bin (e.g. dates)
+			if (!value_bins.empty() && value_bins.back().first == value) {
+				value_bins.back().second.push_back(dives[i]);
+				continue;
+			}
+			dive *d = dives[i];
+			register_bin_value(value_bins, value,
+					   [d](std::vector<dive *> &v) { v.push_back(d); });
+		}
 	}
 
 	// Now, turn that into our result array with allocated bin objects.
@@ -59,6 +59,7 @@ struct StatsBin {
 	virtual bool operator<(StatsBin &) const = 0;
 	virtual bool operator==(StatsBin &) const = 0;
 	bool operator!=(StatsBin &b) const { return !(*this == b); }
+	virtual std::unique_ptr<StatsBin> clone() const = 0;
 };
 
 using StatsBinPtr = std::unique_ptr<StatsBin>;
@@ -134,14 +135,17 @@ struct StatsVariable {
 	StatsOperation idxToOperation(int idx) const;
 	static QString operationName(StatsOperation);
 	double mean(const std::vector<dive *> &dives) const; // Returns NaN for empty list
+	StatsOperationResults operations(const std::vector<dive *> &dives) const; // Only for numeric variables
 	static StatsQuartiles quartiles(const std::vector<StatsValue> &values); // Returns invalid quartiles for empty list
 	StatsQuartiles quartiles(const std::vector<dive *> &dives) const; // Only for numeric variables
 	std::vector<StatsValue> values(const std::vector<dive *> &dives) const; // Only for numeric variables
+	std::vector<double> toFloats(const std::vector<dive *> &dives) const; // Only for numeric variables - one value (or NaN) per dive
 	QString valueWithUnit(const dive *d) const; // Only for numeric variables
 	std::vector<StatsScatterItem> scatter(const StatsVariable &t2, const std::vector<dive *> &dives) const;
 private:
 	virtual double toFloat(const struct dive *d) const; // For numeric variables - if dive doesn't have that value, returns NaN
 	StatsOperationResults applyOperations(const std::vector<dive *> &dives) const;
+	StatsOperationResults applyOperations(const std::vector<dive *> &dives, std::vector<double> &scratch) const;
 };
 
 extern const std::vector<const StatsVariable *> stats_variables;
@@ -19,21 +19,160 @@
 #include "core/divefilter.h"
 #include "core/subsurface-qt/divelistnotifier.h"
 #include "core/selection.h"
+#include "core/trace.h"
 #include "core/trip.h"
 
+#include <algorithm>
 #include <array> // for std::array
 #include <cmath>
+#include <tuple>
 #include <QQuickItem>
 #include <QQuickWindow>
 #include <QSGImageNode>
 #include <QSGRectangleNode>
 #include <QSGTexture>
+#include <QTimer>
+#include <unordered_map>
 
 // Constants that control the graph layouts
 static const double sceneBorder = 5.0;			// Border between scene edges and statitistics view
 static const double titleBorder = 2.0;			// Border between title and chart
 static const double selectionLassoWidth = 2.0;		// Border between title and chart
 
+// The binning results for the current set of dives. When only the chart type
+// or the sort mode changes, these are reused instead of binning all dives again.
+// The plot functions consume the bins, therefore copies are handed out.
+class StatsView::BinCache {
+	template <typename T>
+	struct Entry {
+		const StatsVariable *variable; // null for the plain bin_dives() of a binner
+		const StatsBinner *binner;
+		bool fillEmpty;
+		std::vector<StatsBinValue<T>> bins;
+	};
+	template <typename T>
+	using Entries = std::vector<Entry<T>>;
+	static constexpr size_t maxEntries = 8; // per type
+	std::vector<dive *> dives;
+	std::tuple<Entries<std::vector<dive *>>, Entries<StatsOperationResults>,
+		   Entries<StatsQuartiles>, Entries<std::vector<StatsValue>>> entries;
+public:
+	void clear();
+	void setDives(const std::vector<dive *> &dives); // Clears the cache if the dives differ
+	void divesChanged(const QVector<dive *> &changed); // Rebins only the changed dives
+	template <typename T, typename Func>
+	std::vector<StatsBinValue<T>> get(const StatsVariable *variable, const StatsBinner &binner, bool fillEmpty, Func compute);
+};
+
+void StatsView::BinCache::clear()
+{
+	std::apply([](auto &... e) { (e.clear(), ...); }, entries);
+}
+
+void StatsView::BinCache::setDives(const std::vector<dive *> &newDives)
+{
+	if (newDives == dives)
+		return;
+	clear();
+	dives = newDives;
+}
+
+// Only the plain bins are updated in place: the changed dives are removed from
+// all bins, binned on their own and merged back. The operations, quartiles and
+// values are derived from the values of all dives in a bin and are recalculated.
+void StatsView::BinCache::divesChanged(const QVector<dive *> &changedIn)
+{
+	std::get<Entries<StatsOperationResults>>(entries).clear();
+	std::get<Entries<StatsQuartiles>>(entries).clear();
+	std::get<Entries<std::vector<StatsValue>>>(entries).clear();
+
+	Entries<std::vector<dive *>> &cache = std::get<Entries<std::vector<dive *>>>(entries);
+	if (cache.empty())
+		return;
+
+	// The position of the dives in the list, to keep the order of the dives in the bins.
+	std::unordered_map<const dive *, size_t> index;
+	index.reserve(dives.size());
+	for (size_t i = 0; i < dives.size(); ++i)
+		index.emplace(dives[i], i);
+	auto inOrder = [&index](const dive *d1, const dive *d2) { return index[d1] < index[d2]; };
+
+	std::vector<dive *> changed;
+	for (dive *d: changedIn) {
+		if (index.count(d))
+			changed.push_back(d);
+	}
+	if (changed.empty())
+		return;
+	std::sort(changed.begin(), changed.end(), inOrder);
+	std::vector<dive *> changedSorted = changed; // By pointer for quick lookup
+	std::sort(changedSorted.begin(), changedSorted.end());
+	auto isChanged = [&changedSorted](dive *d) { return std::binary_search(changedSorted.begin(), changedSorted.end(), d); };
+
+	for (Entry<std::vector<dive *>> &entry: cache) {
+		auto &bins = entry.bins;
+		for (auto &[bin, binDives]: bins)
+			binDives.erase(std::remove_if(binDives.begin(), binDives.end(), isChanged), binDives.end());
+
+		for (auto &[bin, binDives]: entry.binner->bin_dives(changed, false)) {
+			auto it = std::lower_bound(bins.begin(), bins.end(), bin,
+						   [] (const StatsBinDives &b1, const StatsBinPtr &b2) { return *b1.bin < *b2; });
+			if (it == bins.end() || *it->bin != *bin) {
+				bins.insert(it, { std::move(bin), std::move(binDives) });
+				continue;
+			}
+			std::vector<dive *> merged;
+			merged.reserve(it->value.size() + binDives.size());
+			std::merge(it->value.begin(), it->value.end(), binDives.begin(), binDives.end(),
+				   std::back_inserter(merged), inOrder);
+			it->value = std::move(merged);
+		}
+
+		// Without filling, bins only exist if they contain dives. With filling,
+		// the first and the last bin contain dives and all gaps are filled.
+		if (!entry.fillEmpty) {
+			bins.erase(std::remove_if(bins.begin(), bins.end(),
+						  [](const StatsBinDives &b) { return b.value.empty(); }),
+				   bins.end());
+			continue;
+		}
+		auto first = std::find_if(bins.begin(), bins.end(), [](const StatsBinDives &b) { return !b.value.empty(); });
+		bins.erase(bins.begin(), first);
+		while (!bins.empty() && bins.back().value.empty())
+			bins.pop_back();
+		std::vector<StatsBinDives> filled;
+		filled.reserve(bins.size());
+		for (auto &b: bins) {
+			if (!filled.empty()) {
+				for (StatsBinPtr &between: entry.binner->bins_between(*filled.back().bin, *b.bin))
+					filled.push_back({ std::move(between), std::vector<dive *>() });
+			}
+			filled.push_back(std::move(b));
+		}
+		bins = std::move(filled);
+	}
+}
+
+template <typename T, typename Func>
+std::vector<StatsBinValue<T>> StatsView::BinCache::get(const StatsVariable *variable, const StatsBinner &binner, bool fillEmpty, Func compute)
+{
+	Entries<T> &cache = std::get<Entries<T>>(entries);
+	auto it = std::find_if(cache.begin(), cache.end(), [&](const Entry<T> &e)
+			       { return e.variable == variable && e.binner == &binner && e.fillEmpty == fillEmpty; });
+	if (it == cache.end()) {
+		if (cache.size() >= maxEntries)
+			cache.erase(cache.begin());
+		cache.push_back({ variable, &binner, fillEmpty, compute() });
+		it = cache.end() - 1;
+	}
+
+	std::vector<StatsBinValue<T>> res;
+	res.reserve(it->bins.size());
+	for (const auto &[bin, value]: it->bins)
+		res.push_back({ bin->clone(), value });
+	return res;
+}
+
 StatsView::StatsView(QQuickItem *parent) : QQuickItem(parent),
 	backgroundDirty(true),
 	currentTheme(&getStatsTheme(false)),
@@ -42,6 +181,8 @@ StatsView::StatsView(QQuickItem *parent) : QQuickItem(parent),
 	yAxis(nullptr),
 	draggedItem(nullptr),
 	restrictDives(false),
+	binCache(std::make_unique<BinCache>()),
+	replotPending(false),
 	rootNode(nullptr)
 {
 	setFlag(ItemHasContents, true);
@@ -52,6 +193,25 @@ StatsView::StatsView(QQuickItem *parent) : QQuickItem(parent),
 	connect(&diveListNotifier, &DiveListNotifier::dataReset, this, &StatsView::replotIfVisible);
 	connect(&diveListNotifier, &DiveListNotifier::settingsChanged, this, &StatsView::replotIfVisible);
 	connect(&diveListNotifier, &DiveListNotifier::divesSelected, this, &StatsView::divesSelected);
+	connect(&diveListNotifier, &DiveListNotifier::divesChanged, this, &StatsView::divesChanged);
+
+	// These edits don't replot the chart, but make the cached bins stale
+	auto clearBinCache = [this]() { binCache->clear(); };
+	connect(&diveListNotifier, &DiveListNotifier::divesTimeChanged, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::divesMovedBetweenTrips, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::diveComputerEdited, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::cylindersReset, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::cylinderAdded, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::cylinderRemoved, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::cylinderEdited, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::weightsystemsReset, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::weightAdded, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::weightRemoved, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::weightEdited, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::tripChanged, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::diveSiteChanged, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::diveSiteDivesChanged, this, clearBinCache);
+	connect(&diveListNotifier, &DiveListNotifier::eventsChanged, this, clearBinCache);
 
 	setAcceptHoverEvents(true);
 	setAcceptedMouseButtons(Qt::LeftButton);
@@ -389,10 +549,25 @@ void StatsView::plotAreaChanged(const QSizeF &s)
 
 void StatsView::replotIfVisible()
 {
+	binCache->clear();
 	if (isVisible())
 		plot(state);
 }
 
+void StatsView::divesChanged(const QVector<dive *> &dives)
+{
+	binCache->divesChanged(dives);
+	if (!isVisible() || replotPending)
+		return;
+	// An edit sends one signal per changed field. Replot only once.
+	replotPending = true;
+	QTimer::singleShot(0, this, [this]() {
+		replotPending = false;
+		if (isVisible())
+			plot(state);
+	});
+}
+
 void StatsView::divesSelected(const QVector<dive *> &dives)
 {
 	if (isVisible()) {
@@ -536,6 +711,7 @@ int StatsView::restrictionCount() const
 
 void StatsView::plot(const StatsState &stateIn)
 {
+	TRACE_ZONE("StatsView::plot");
 	state = stateIn;
 	plotChart();
 	updateFeatures(); // Show / hide chart features, such as legend, etc.
@@ -569,6 +745,7 @@ void StatsView::plotChart()
 	} else {
 		dives = DiveFilter::instance()->visibleDives();
 	}
+	binCache->setDives(dives);
 	switch (state.type) {
 	case ChartType::DiscreteBar:
 		return plotBarChart(dives, state.subtype, state.sortMode1, state.var1, state.var1Binner,
@@ -736,7 +913,8 @@ void StatsView::plotBarChart(const std::vector<dive *> &dives,
 
 	setTitle(valueVariable->nameWithBinnerUnit(*valueBinner));
 
-	std::vector<StatsBinDives> categoryBins = categoryBinner->bin_dives(dives, false);
+	std::vector<StatsBinDives> categoryBins = binCache->get<std::vector<dive *>>(nullptr, *categoryBinner, false,
+		[&]() { return categoryBinner->bin_dives(dives, false); });
 
 	if (sortMode == ChartSortMode::Count) {
 		// Note: we sort by count in reverse order, as this is probably what the user desires(?).
@@ -854,7 +1032,8 @@ void StatsView::plotValueChart(const std::vector<dive *> &dives,
 
 	setTitle(QStringLiteral("%1 (%2)").arg(valueVariable->name(), StatsVariable::operationName(valueAxisOperation)));
 
-	std::vector<StatsBinOp> categoryBins = valueVariable->bin_operations(*categoryBinner, dives, false);
+	std::vector<StatsBinOp> categoryBins = binCache->get<StatsOperationResults>(valueVariable, *categoryBinner, false,
+		[&]() { return valueVariable->bin_operations(*categoryBinner, dives, false); });
 
 	// If there is nothing to display, quit
 	if (categoryBins.empty())
@@ -928,7 +1107,8 @@ void StatsView::plotDiscreteCountChart(const std::vector<dive *> &dives,
 
 	setTitle(categoryVariable->nameWithBinnerUnit(*categoryBinner));
 
-	std::vector<StatsBinDives> categoryBins = categoryBinner->bin_dives(dives, false);
+	std::vector<StatsBinDives> categoryBins = binCache->get<std::vector<dive *>>(nullptr, *categoryBinner, false,
+		[&]() { return categoryBinner->bin_dives(dives, false); });
 
 	// If there is nothing to display, quit
 	if (categoryBins.empty())
@@ -976,7 +1156,8 @@ void StatsView::plotPieChart(const std::vector<dive *> &dives, ChartSortMode sor
 
 	setTitle(categoryVariable->nameWithBinnerUnit(*categoryBinner));
 
-	std::vector<StatsBinDives> categoryBins = categoryBinner->bin_dives(dives, false);
+	std::vector<StatsBinDives> categoryBins = binCache->get<std::vector<dive *>>(nullptr, *categoryBinner, false,
+		[&]() { return categoryBinner->bin_dives(dives, false); });
 
 	// If there is nothing to display, quit
 	if (categoryBins.empty())
@@ -1001,7 +1182,8 @@ void StatsView::plotDiscreteBoxChart(const std::vector<dive *> &dives,
 
 	setTitle(valueVariable->name());
 
-	std::vector<StatsBinQuartiles> categoryBins = valueVariable->bin_quartiles(*categoryBinner, dives, false);
+	std::vector<StatsBinQuartiles> categoryBins = binCache->get<StatsQuartiles>(valueVariable, *categoryBinner, false,
+		[&]() { return valueVariable->bin_quartiles(*categoryBinner, dives, false); });
 
 	// If there is nothing to display, quit
 	if (categoryBins.empty())
@@ -1035,7 +1217,8 @@ void StatsView::plotDiscreteScatter(const std::vector<dive *> &dives,
 
 	setTitle(valueVariable->name());
 
-	std::vector<StatsBinValues> categoryBins = valueVariable->bin_values(*categoryBinner, dives, false);
+	std::vector<StatsBinValues> categoryBins = binCache->get<std::vector<StatsValue>>(valueVariable, *categoryBinner, false,
+		[&]() { return valueVariable->bin_values(*categoryBinner, dives, false); });
 
 	// If there is nothing to display, quit
 	if (categoryBins.empty())
@@ -1100,7 +1283,8 @@ void StatsView::plotHistogramCountChart(const std::vector<dive *> &dives,
 
 	setTitle(categoryVariable->name());
 
-	std::vector<StatsBinDives> categoryBins = categoryBinner->bin_dives(dives, true);
+	std::vector<StatsBinDives> categoryBins = binCache->get<std::vector<dive *>>(nullptr, *categoryBinner, true,
+		[&]() { return categoryBinner->bin_dives(dives, true); });
 
 	// If there is nothing to display, quit
 	if (categoryBins.empty())
@@ -1155,7 +1339,8 @@ void StatsView::plotHistogramValueChart(const std::vector<dive *> &dives,
 
 	setTitle(QStringLiteral("%1 (%2)").arg(valueVariable->name(), StatsVariable::operationName(valueAxisOperation)));
 
-	std::vector<StatsBinOp> categoryBins = valueVariable->bin_operations(*categoryBinner, dives, true);
+	std::vector<StatsBinOp> categoryBins = binCache->get<StatsOperationResults>(valueVariable, *categoryBinner, true,
+		[&]() { return valueVariable->bin_operations(*categoryBinner, dives, true); });
 
 	// If there is nothing to display, quit
 	if (categoryBins.empty())
@@ -1205,7 +1390,8 @@ void StatsView::plotHistogramStackedChart(const std::vector<dive *> &dives,
 
 	setTitle(valueVariable->nameWithBinnerUnit(*valueBinner));
 
-	std::vector<StatsBinDives> categoryBins = categoryBinner->bin_dives(dives, true);
+	std::vector<StatsBinDives> categoryBins = binCache->get<std::vector<dive *>>(nullptr, *categoryBinner, true,
+		[&]() { return categoryBinner->bin_dives(dives, true); });
 
 	// Construct the histogram axis now, because the pointers to the bins
 	// will be moved away when constructing BarPlotData below.
@@ -1245,7 +1431,8 @@ void StatsView::plotHistogramBoxChart(const std::vector<dive *> &dives,
 
 	setTitle(valueVariable->name());
 
-	std::vector<StatsBinQuartiles> categoryBins = valueVariable->bin_quartiles(*categoryBinner, dives, true);
+	std::vector<StatsBinQuartiles> categoryBins = binCache->get<StatsQuartiles>(valueVariable, *categoryBinner, true,
+		[&]() { return valueVariable->bin_quartiles(*categoryBinner, dives, true); });
 
 	// If there is nothing to display, quit
 	if (categoryBins.empty())
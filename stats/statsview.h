@@ -73,6 +73,7 @@ public:
 private slots:
 	void replotIfVisible();
 	void divesSelected(const QVector<dive *> &dives);
+	void divesChanged(const QVector<dive *> &dives);
 private:
 	// QtQuick related things
 	bool backgroundDirty;
@@ -159,6 +160,9 @@ private:
 	std::vector<dive *> oldSelection;
 	bool restrictDives;
 	std::vector<dive *> restrictedDives;	// sorted by pointer for quick lookup.
+	class BinCache;
+	std::unique_ptr<BinCache> binCache;
+	bool replotPending;			// Replot after edits is deferred to coalesce multiple signals
 
 	void hoverEnterEvent(QHoverEvent *event) override;
 	void hoverMoveEvent(QHoverEvent *event) override;
@@ -6,9 +6,13 @@
 #include <string.h>
 #include <time.h>
 
+#include "commands/command.h"
+#include "core/changejournal.h"
 #include "core/downloadfromdcthread.h" // for fill_computer_list
 #include "core/divelog.h"
 #include "core/errorhelper.h"
+#include "core/imagedownloader.h"
+#include "core/memoryusage.h"
 #include "core/parse.h"
 #include "core/qt-gui.h"
 #include "core/qthelper.h"
@@ -16,6 +20,7 @@
 #include "core/subsurface-string.h"
 #include "core/settings/qPref.h"
 #include "core/tag.h"
+#include "core/trace.h"
 #include "desktop-widgets/mainwindow.h"
 #include "core/checkcloudconnection.h"
 
@@ -26,9 +31,13 @@
 #include <QOpenGLFunctions>
 #include <QQuickWindow>
 #include <QStringList>
+#include <QTimer>
 #include <git2.h>
 
 static void validateGL();
+#ifdef QT_NO_DEBUG
+static void fast_exit();
+#endif
 static void messageHandler(QtMsgType type, const QMessageLogContext &ctx, const QString &msg);
 
 int main(int argc, char **argv)
@@ -41,6 +50,7 @@ int main(int argc, char **argv)
 	bool no_filenames = true;
 	QLoggingCategory::setFilterRules(QStringLiteral("qt.bluetooth* = true"));
 	std::unique_ptr<QApplication> app(new QApplication(argc, argv));
+	startup_phase("application");
 	std::vector<std::string> files;
 	std::vector<std::string> importedFiles;
 	QStringList arguments = QCoreApplication::arguments();
@@ -67,7 +77,9 @@ int main(int argc, char **argv)
 		printf("If you insist to do so, run with option --allow_run_as_root.\n");
 		exit(0);
 	}
+	startup_phase("arguments");
 	validateGL();
+	startup_phase("OpenGL validation");
 #if !LIBGIT2_VER_MAJOR && LIBGIT2_VER_MINOR < 22
 	git_threads_init();
 #else
@@ -77,11 +89,12 @@ int main(int argc, char **argv)
 	prefs = default_prefs;
 	CheckCloudConnection ccc;
 	ccc.pickServer();
-	fill_computer_list();
 	reset_tank_info_table(tank_info_table);
 	parse_xml_init();
 	taglist_init_global();
+	startup_phase("core");
 	init_ui();
+	startup_phase("main window");
 	if (no_filenames) {
 		if (prefs.default_file_behavior == LOCAL_DEFAULT_FILE) {
 			if (!prefs.default_filename.empty())
@@ -96,15 +109,38 @@ int main(int argc, char **argv)
 	if (verbose && !files.empty())
 		report_info("loading dive data from: %s", join(files, std::string(", ")).c_str());
 	m->loadFiles(files);
+	startup_phase("loading files");
 	if (verbose && !importedFiles.empty())
 		report_info("importing dive data from %s", join(importedFiles, std::string(", ")).c_str());
 	m->importFiles(importedFiles);
+	startup_phase("importing files");
+
+	// What is not needed for the dive list is done once the event loop
+	// runs, i.e. after the main window was shown.
+	QTimer::singleShot(0, [] {
+		startup_phase("event loop");
+		fill_computer_list();
+		startup_phase("dive computer list");
+	});
 
 	if (verbose > 0)
 		print_files();
 	if (!quit)
 		run_ui();
+	if (verbose > 0) {
+		report_memory_usage();
+		Thumbnailer::instance()->reportCacheStatistics();
+	}
+#ifdef QT_NO_DEBUG
+	// Freeing the dive data, the undo stack and the models object by object
+	// takes seconds with a big log. If there's nothing left to save, write
+	// what is kept on disk and let the operating system reclaim the memory.
+	// Debug builds tear down in order, so that leaks can be found.
+	if (Command::isClean())
+		fast_exit();
+#endif
 	exit_ui();
+	trace_finish();
 	parse_xml_exit();
 	subsurface_console_exit();
 
@@ -114,6 +150,21 @@ int main(int argc, char **argv)
 	return 0;
 }
 
+#ifdef QT_NO_DEBUG
+// Doesn't return.
+static void fast_exit()
+{
+	Thumbnailer::instance()->finish();
+	write_hashes();
+	ChangeJournal::instance()->close();
+	trace_finish();
+	subsurface_console_exit();
+	qPref::sync();
+	fflush(NULL);
+	_Exit(0);
+}
+#endif
+
 #define VALIDATE_GL_PREFIX "validateGL(): "
 
 void validateGL()
@@ -13,6 +13,8 @@
 #include "core/file.h"
 #include "core/trip.h"
 #include "core/libdivecomputer.h"
+#include "core/memoryusage.h"
+#include "core/trace.h"
 #include "commands/command.h"
 
 #include <QApplication>
@@ -22,6 +24,7 @@
 
 static void messageHandler(QtMsgType type, const QMessageLogContext &ctx, const QString &msg);
 extern void cliDownloader(const std::string &vendor, const std::string &product, const std::string &device);
+extern void cliBatchDownloader(const std::string &filename);
 
 int main(int argc, char **argv)
 {
@@ -95,7 +98,10 @@ int main(int argc, char **argv)
 	}
 	print_files();
 	if (!quit) {
-		if (!prefs.dive_computer.vendor.empty() && !prefs.dive_computer.product.empty() && !prefs.dive_computer.device.empty()) {
+		if (!dc_batch_file.empty()) {
+			printf("Downloading dives from the dive computers listed in %s\n", dc_batch_file.c_str());
+			cliBatchDownloader(dc_batch_file);
+		} else if (!prefs.dive_computer.vendor.empty() && !prefs.dive_computer.product.empty() && !prefs.dive_computer.device.empty()) {
 			// download from that dive computer
 			printf("Downloading dives from %s %s (via %s)\n", prefs.dive_computer.vendor.c_str(),
 					prefs.dive_computer.product.c_str(), prefs.dive_computer.device.c_str());
@@ -105,10 +111,12 @@ int main(int argc, char **argv)
 	if (!files.empty()) {
 		report_info("saving dive data to %s", join(files, ", ").c_str());
 		save_dives(files.front().c_str());
+		report_memory_usage();
 	} else {
 		printf("No log files given, not saving dive data.\n");
 		printf("Give a log file name as argument, or configure a cloud URL.\n");
 	}
+	trace_finish();
 	parse_xml_exit();
 
 	// Sync struct preferences to disk
@@ -11,6 +11,7 @@
 #include "core/devicedetails.h"
 #include "core/errorhelper.h"
 #include "core/globals.h"
+#include "core/perfcounters.h"
 #include "core/qt-gui.h"
 #include "core/settings/qPref.h"
 
@@ -120,6 +121,8 @@ void run_mobile_ui(double initial_font_size)
 	ctxt->setContextProperty("vendorList", vendorList);
 	ctxt->setContextProperty("swipeModel", MobileModels::instance()->swipeModel());
 	ctxt->setContextProperty("diveModel", MobileModels::instance()->listModel());
+	MobileModels::instance()->snapshotModel()->load(QMLManager::snapshotKey());
+	ctxt->setContextProperty("snapshotModel", MobileModels::instance()->snapshotModel());
 	set_non_bt_addresses();
 
 	// we need to setup the initial font size before the QML UI is instantiated
@@ -187,6 +190,8 @@ void run_mobile_ui(double initial_font_size)
 #endif // not Q_OS_ANDROID and not Q_OS_IOS
 	qml_window->show();
 	qApp->exec();
+	if (verbose)
+		report_info("performance counters: %s", perf_counters_json().c_str());
 }
 #else // SUBSURFACE_MOBILE
 // just run the desktop UI
@@ -194,6 +199,8 @@ void run_ui()
 {
 	MainWindow::instance()->show();
 	qApp->exec();
+	if (verbose)
+		report_info("performance counters: %s", perf_counters_json().c_str());
 }
 #endif // SUBSURFACE_MOBILE
 
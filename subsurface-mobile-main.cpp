@@ -17,6 +17,7 @@
 #include "core/settings/qPref.h"
 #include "core/settings/qPrefDisplay.h"
 #include "core/tag.h"
+#include "core/trace.h"
 #include "core/settings/qPrefCloudStorage.h"
 #include "core/checkcloudconnection.h"
 
@@ -92,6 +93,7 @@ int main(int argc, char **argv)
 	if (!quit)
 		run_mobile_ui(initial_font_size);
 	exit_ui();
+	trace_finish();
 	parse_xml_exit();
 	subsurface_console_exit();
 
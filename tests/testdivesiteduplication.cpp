@@ -2,6 +2,7 @@
 #include "testdivesiteduplication.h"
 #include "core/divelog.h"
 #include "core/divesite.h"
+#include "core/divesiteindex.h"
 #include "core/file.h"
 #include "core/pref.h"
 
@@ -12,4 +13,68 @@ void TestDiveSiteDuplication::testReadV2()
 	QCOMPARE(divelog.sites.size(), 2);
 }
 
+void TestDiveSiteDuplication::testGpsProximity()
+{
+	dive_site_table sites;
+	location_t loc = create_location(47.0, 8.0);
+	dive_site *near = sites.create("near", create_location(47.0001, 8.0));	// ~11 m
+	dive_site *far = sites.create("far", create_location(47.0, 8.01));	// ~760 m
+	sites.create("north", create_location(48.0, 8.0));			// ~111 km
+	sites.create("no gps");
+
+	QCOMPARE(sites.get_by_gps_proximity(loc, 20), near);
+	QCOMPARE(sites.get_by_gps_proximity(loc, 10), (dive_site *)nullptr);
+	QCOMPARE(sites.get_by_gps_proximity(create_location(47.0, 8.0099), 40075000), far);
+	QCOMPARE(sites.get_by_gps_proximity(loc, 40075000), near);
+}
+
+void TestDiveSiteDuplication::testGetByName()
+{
+	dive_site_table sites;
+	dive_site *a = sites.create("A");
+	dive_site *b = sites.create("B");
+
+	QCOMPARE(sites.get_by_name("A"), a);
+	QCOMPARE(sites.get_by_name("B"), b);
+	QCOMPARE(sites.get_by_name("C"), (dive_site *)nullptr);
+
+	// Renamed and removed sites must not be found under their old names
+	a->name = "C";
+	QCOMPARE(sites.get_by_name("A"), (dive_site *)nullptr);
+	QCOMPARE(sites.get_by_name("C"), a);
+	sites.pull(b);
+	QCOMPARE(sites.get_by_name("B"), (dive_site *)nullptr);
+}
+
+void TestDiveSiteDuplication::testSiteIndex()
+{
+	dive_site_table sites;
+	location_t loc = create_location(47.0, 8.0);
+	dive_site *near = sites.create("Near", create_location(47.0001, 8.0));	// ~11 m
+	dive_site *far = sites.create("far", create_location(47.0, 8.01));	// ~760 m
+	sites.create("north", create_location(48.0, 8.0));			// ~111 km
+	dive_site *nogps = sites.create("no gps");
+	dive_site *same_place = sites.create("same place", create_location(47.0001, 8.0));
+
+	dive_site_index index(sites);
+	unsigned int distance = 0;
+	QCOMPARE(index.get_by_gps_proximity(loc, 20, &distance), sites.get_by_gps_proximity(loc, 20));
+	QCOMPARE(distance, get_distance(loc, near->location));
+	QCOMPARE(index.get_by_gps_proximity(loc, 10), (dive_site *)nullptr);
+	QCOMPARE(index.get_by_gps_proximity(create_location(47.0, 8.0099), 40075000), far);
+	QCOMPARE(index.get_by_gps_proximity(create_location(60.0, 8.0), 40075000), sites.get_by_gps_proximity(create_location(60.0, 8.0), 40075000));
+
+	// Of sites at the same location, the first one is found
+	QCOMPARE(index.get_by_gps(same_place->location), sites.get_by_gps(&same_place->location));
+	QCOMPARE(index.get_by_gps(location_t()), nogps);
+	QCOMPARE(index.get_by_gps(loc), (dive_site *)nullptr);
+
+	// Names are hashed in normalized form, but only the same sites are considered equal
+	QCOMPARE(dive_site_index::normalize_name("  Blue\tHole  "), std::string("blue hole"));
+	dive_site copy("Near", near->location);
+	QCOMPARE(index.get_same(copy), near);
+	dive_site other_case(" near", near->location);
+	QCOMPARE(index.get_same(other_case), (dive_site *)nullptr);
+}
+
 QTEST_GUILESS_MAIN(TestDiveSiteDuplication)
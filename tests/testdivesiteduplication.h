@@ -8,6 +8,9 @@ class TestDiveSiteDuplication : public QObject {
 	Q_OBJECT
 private slots:
 	void testReadV2();
+	void testGpsProximity();
+	void testGetByName();
+	void testSiteIndex();
 };
 
 #endif // TESTDIVESITEDUPLICATION_H
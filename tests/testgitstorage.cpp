@@ -213,6 +213,162 @@ void TestGitStorage::testGitStorageLocal()
 	QCOMPARE(readin, written);
 }
 
+void TestGitStorage::testGitStorageParallel()
+{
+	// enough dives to render them on the thread pool
+	git_repository *repo;
+	for (int i = 0; i < 3; i++)
+		QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QVERIFY(divelog.dives.size() >= 64);
+	QDir testDir("./gittestparallel");
+	QCOMPARE(testDir.removeRecursively(), true);
+	QCOMPARE(QDir().mkdir("./gittestparallel"), true);
+	QCOMPARE(git_repository_init(&repo, "./gittestparallel", false), 0);
+	QCOMPARE(save_dives("./gittestparallel[test]"), 0);
+	QCOMPARE(save_dives("./SampleDivesParallel.ssrf"), 0);
+	clear_dive_file_data();
+	QCOMPARE(parse_file("./gittestparallel[test]", &divelog), 0);
+	QCOMPARE(save_dives("./SampleDivesParallelviagit.ssrf"), 0);
+	QFile org("./SampleDivesParallel.ssrf");
+	org.open(QFile::ReadOnly);
+	QFile out("./SampleDivesParallelviagit.ssrf");
+	out.open(QFile::ReadOnly);
+	QTextStream orgS(&org);
+	QTextStream outS(&out);
+	QString readin = orgS.readAll();
+	QString written = outS.readAll();
+	QCOMPARE(readin, written);
+}
+
+void TestGitStorage::testGitStorageIncremental()
+{
+	// save a repository, change one dive and save again: the
+	// unchanged months are reused, the changed one is rewritten
+	QDir testDir("./gittestincremental");
+	QCOMPARE(testDir.removeRecursively(), true);
+	QCOMPARE(QDir().mkdir("./gittestincremental"), true);
+	git_repository *repo;
+	QCOMPARE(git_repository_init(&repo, "./gittestincremental", false), 0);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QCOMPARE(save_dives("./gittestincremental[test]"), 0);
+	clear_dive_file_data();
+	QCOMPARE(parse_file("./gittestincremental[test]", &divelog), 0);
+	QCOMPARE(save_dives("./gittestincremental[test]"), 0);
+	QVERIFY(divelog.dives.size() > 1);
+	struct dive *d = divelog.dives.back().get();
+	d->notes = "changed after the first save";
+	d->invalidate_cache();
+	QCOMPARE(save_dives("./gittestincremental[test]"), 0);
+	QCOMPARE(save_dives("./SampleDivesIncremental.ssrf"), 0);
+	clear_dive_file_data();
+	QCOMPARE(parse_file("./gittestincremental[test]", &divelog), 0);
+	QCOMPARE(save_dives("./SampleDivesIncrementalviagit.ssrf"), 0);
+	QFile org("./SampleDivesIncremental.ssrf");
+	org.open(QFile::ReadOnly);
+	QFile out("./SampleDivesIncrementalviagit.ssrf");
+	out.open(QFile::ReadOnly);
+	QTextStream orgS(&org);
+	QTextStream outS(&out);
+	QString readin = orgS.readAll();
+	QString written = outS.readAll();
+	QCOMPARE(readin, written);
+	QVERIFY(written.contains("changed after the first save"));
+}
+
+void TestGitStorage::testGitStorageChangedDives()
+{
+	// change one dive and delete another: only the changed dive is
+	// loaded and the old versions of both are reported as removed
+	QDir testDir("./gittestchanged");
+	QCOMPARE(testDir.removeRecursively(), true);
+	QCOMPARE(QDir().mkdir("./gittestchanged"), true);
+	git_repository *repo;
+	QCOMPARE(git_repository_init(&repo, "./gittestchanged", false), 0);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QCOMPARE(save_dives("./gittestchanged[test]"), 0);
+	clear_dive_file_data();
+	QCOMPARE(parse_file("./gittestchanged[test]", &divelog), 0);
+	QVERIFY(divelog.dives.size() > 2);
+	std::string old_sha = get_sha(repo, "test");
+	QVERIFY(!old_sha.empty());
+	struct dive *d = divelog.dives.front().get();
+	d->notes = "changed on another device";
+	d->invalidate_cache();
+	divelog.delete_single_dive(divelog.dives.size() - 1);
+	QCOMPARE(save_dives("./gittestchanged[test]"), 0);
+	clear_dive_file_data();
+
+	struct git_info info;
+	QCOMPARE(is_git_repository("./gittestchanged[test]", &info), true);
+	QCOMPARE(open_git_repository(&info), true);
+	struct divelog log;
+	std::vector<git_dive_id> removed;
+	QCOMPARE(git_load_changed_dives(&info, old_sha, &log, removed), 0);
+	QCOMPARE(log.dives.size(), 1);
+	QCOMPARE(log.dives[0]->notes, std::string("changed on another device"));
+	QCOMPARE(removed.size(), 2);
+}
+
+void TestGitStorage::testGitStorageBinarySamples()
+{
+	// samples saved in binary form have to give the same dives
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QCOMPARE(save_dives("./SampleDivesBinary.ssrf"), 0);
+	QDir testDir("./gittestbinary");
+	QCOMPARE(testDir.removeRecursively(), true);
+	QCOMPARE(QDir().mkdir("./gittestbinary"), true);
+	git_repository *repo;
+	QCOMPARE(git_repository_init(&repo, "./gittestbinary", false), 0);
+	git_binary_samples = true;
+	QCOMPARE(save_dives("./gittestbinary[test]"), 0);
+	git_binary_samples = false;
+	clear_dive_file_data();
+	QCOMPARE(parse_file("./gittestbinary[test]", &divelog), 0);
+	QCOMPARE(save_dives("./SampleDivesBinaryviagit.ssrf"), 0);
+	QFile org("./SampleDivesBinary.ssrf");
+	org.open(QFile::ReadOnly);
+	QFile out("./SampleDivesBinaryviagit.ssrf");
+	out.open(QFile::ReadOnly);
+	QTextStream orgS(&org);
+	QTextStream outS(&out);
+	QString readin = orgS.readAll();
+	QString written = outS.readAll();
+	QCOMPARE(readin, written);
+}
+
+void TestGitStorage::testGitStorageSharded()
+{
+	// the years saved as shards have to give the same dives, and stay shards
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QCOMPARE(save_dives("./SampleDivesSharded.ssrf"), 0);
+	QDir testDir("./gittestsharded");
+	QCOMPARE(testDir.removeRecursively(), true);
+	QCOMPARE(QDir().mkdir("./gittestsharded"), true);
+	git_repository *repo;
+	QCOMPARE(git_repository_init(&repo, "./gittestsharded", false), 0);
+	git_sharded_layout = true;
+	QCOMPARE(save_dives("./gittestsharded[test]"), 0);
+	git_sharded_layout = false;
+	QCOMPARE(git_branch_is_sharded(repo, "test"), true);
+	clear_dive_file_data();
+	QCOMPARE(parse_file("./gittestsharded[test]", &divelog), 0);
+	QCOMPARE(save_dives("./SampleDivesShardedviagit.ssrf"), 0);
+	QFile org("./SampleDivesSharded.ssrf");
+	org.open(QFile::ReadOnly);
+	QFile out("./SampleDivesShardedviagit.ssrf");
+	out.open(QFile::ReadOnly);
+	QTextStream orgS(&org);
+	QTextStream outS(&out);
+	QString readin = orgS.readAll();
+	QString written = outS.readAll();
+	QCOMPARE(readin, written);
+
+	// saving again keeps the layout
+	QCOMPARE(save_dives("./gittestsharded[test]"), 0);
+	QCOMPARE(git_branch_is_sharded(repo, "test"), true);
+	git_repository_free(repo);
+}
+
 void TestGitStorage::testGitStorageCloud()
 {
 	// test writing and reading back from cloud storage
@@ -13,6 +13,11 @@ private slots:
 
 	void testGitStorageLocal_data();
 	void testGitStorageLocal();
+	void testGitStorageParallel();
+	void testGitStorageIncremental();
+	void testGitStorageChangedDives();
+	void testGitStorageBinarySamples();
+	void testGitStorageSharded();
 	void testGitStorageCloud();
 	void testGitStorageCloudOfflineSync();
 	void testGitStorageCloudMerge();
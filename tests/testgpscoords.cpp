@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "testgpscoords.h"
+#include "core/parse-gpx.h"
 
 //unit under test
 extern bool parseGpsText(const QString &gps_text, double *latitude, double *longitude);
@@ -127,4 +128,28 @@ double TestGpsCoords::coord2double(double deg, double min, double sec)
 	return deg + min / 60.0 + sec / 3600.0;
 }
 
+void TestGpsCoords::testGPXTrack()
+{
+	gpx_track track;
+	QCOMPARE(readGPXFile(track, SUBSURFACE_TEST_DATA "/dives/gps-import.gpx"), 0);
+	// The <time> of the metadata is not a track point.
+	QCOMPARE(track.size(), 2315);
+	QCOMPARE(track[0].time, (int64_t)1501995366); // 2017-08-06T04:56:06Z
+	QCOMPARE(track[0].lat_udeg, -26843438);
+	QCOMPARE(track[0].lon_udeg, 32884612);
+
+	// The first point at or after the start of the dive, here in the time zone UTC+2.
+	dive_coords coords;
+	coords.start_dive = 1501995366 + 2 * 3600 + 10;
+	coords.end_dive = coords.start_dive + 3600;
+	coords.lat = coords.lon = 0.0;
+	coords.settingsDiff_offset = 0;
+	coords.timeZone_offset = 2 * 3600;
+	getCoordsFromGPXTrack(&coords, track);
+	QCOMPARE(coords.start_track, (time_t)(1501995366 + 2 * 3600));
+	QCOMPARE(coords.end_track, (time_t)(track.back().time + 2 * 3600));
+	QCOMPARE(coords.lat, -26.840948);
+	QCOMPARE(coords.lon, 32.885982);
+}
+
 QTEST_GUILESS_MAIN(TestGpsCoords)
@@ -25,6 +25,7 @@ private slots:
 	void testPrefixNoUnitParse();
 	void testOurWeb();
 	void testGoogle();
+	void testGPXTrack();
 
 private:
 	static void testParseOK(const QString &txt, double expectedLat,
@@ -1,6 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "testhelper.h"
 #include "core/btdiscovery.h"
+#include "core/format.h"
+#include "core/messagering.h"
+#include "core/pref.h"
+#include "core/qthelper.h"
+
+#include <thread>
 
 void TestHelper::initTestCase()
 {
@@ -41,4 +47,111 @@ void TestHelper::parseNameAddress()
 
 }
 
+void TestHelper::messageRing()
+{
+	MessageRing ring(4);
+	int dropped;
+
+	// Only the first message of a batch wakes up the consumer.
+	QCOMPARE(ring.push(0, "a"), true);
+	QCOMPARE(ring.push(0, "b"), false);
+	QCOMPARE(ring.push(0, "a"), false);
+	QCOMPARE(ring.push(1, "a"), false);
+	QCOMPARE(ring.push(0, "c"), false);
+	std::vector<MessageRing::Message> messages = ring.drain(dropped);
+	QCOMPARE(dropped, 1);
+	QCOMPARE(messages.size(), 3);
+	QCOMPARE(messages[0].text, std::string("a"));
+	QCOMPARE(messages[0].count, 2);
+	QCOMPARE(messages[1].text, std::string("b"));
+	QCOMPARE(messages[1].count, 1);
+	QCOMPARE(messages[2].level, 1);
+	QCOMPARE(messages[2].text, std::string("a"));
+	QCOMPARE(ring.drain(dropped).size(), 0);
+	QCOMPARE(dropped, 0);
+	QCOMPARE(ring.push(0, "d"), true);
+
+	// Concurrent producers: nothing is lost or duplicated.
+	MessageRing big(4096);
+	std::vector<std::thread> producers;
+	for (int i = 0; i < 4; ++i) {
+		producers.emplace_back([&big, i]() {
+			for (int j = 0; j < 500; ++j)
+				big.push(0, std::to_string(i * 1000 + j % 10));
+		});
+	}
+	for (std::thread &t: producers)
+		t.join();
+	messages = big.drain(dropped);
+	QCOMPARE(dropped, 0);
+	QCOMPARE(messages.size(), 40);
+	for (const MessageRing::Message &m: messages)
+		QCOMPARE(m.count, 50);
+}
+
+void TestHelper::unitStrings()
+{
+	// The unit strings are formatted by hand: they must read like the ones of QString::arg()
+	struct units old_units = prefs.units;
+	QLocale old_locale;
+	for (const char *name: { "en_US", "de_DE", "fr_FR", "de_CH" }) {
+		QLocale::setDefault(QLocale(name));
+		for (int mm: { 0, 49, 50, 250, 350, 1050, 19949, 19950, 20500, 123456, 1000000 }) {
+			prefs.units.length = units::METERS;
+			QCOMPARE(get_depth_string(mm, false, true), QString("%L1").arg(mm / 1000.0, 0, 'f', mm < 20000 ? 1 : 0));
+			QCOMPARE(get_depth_string(mm, false, false), QString("%L1").arg(mm / 1000.0, 0, 'f', 0));
+			QCOMPARE(get_depth_string(mm, true, false), QString("%L1m").arg(mm / 1000.0, 0, 'f', 0));
+			prefs.units.length = units::FEET;
+			QCOMPARE(get_depth_string(mm, true, true), QString("%L1ft").arg(mm_to_feet(mm), 0, 'f', 0));
+		}
+		for (int mbar: { 0, 499, 500, 1500, 200500, 232000, 1000000 }) {
+			prefs.units.pressure = units::BAR;
+			QCOMPARE(get_pressure_string(pressure_t { .mbar = mbar }), QString("%L1").arg(mbar / 1000.0, 0, 'f', 0));
+			prefs.units.pressure = units::PSI;
+			QCOMPARE(get_pressure_string(pressure_t { .mbar = mbar }), QString("%L1").arg(mbar_to_PSI(mbar), 0, 'f', 0));
+		}
+		for (int mkelvin: { 1, 250000, 273150, 273200, 273100, 293150, 373150 }) {
+			prefs.units.temperature = units::CELSIUS;
+			QCOMPARE(get_temperature_string(temperature_t { .mkelvin = (uint32_t)mkelvin }),
+				 QString("%L1").arg(mkelvin_to_C(mkelvin), 0, 'f', 1));
+			prefs.units.temperature = units::FAHRENHEIT;
+			QCOMPARE(get_temperature_string(temperature_t { .mkelvin = (uint32_t)mkelvin }),
+				 QString("%L1").arg(mkelvin_to_F(mkelvin), 0, 'f', 1));
+		}
+		for (int ml: { 0, 50, 11100, 1234567, 80000000 }) {
+			prefs.units.volume = units::LITER;
+			QCOMPARE(get_volume_string(ml), QString("%L1").arg(ml / 1000.0, 0, 'f', 1));
+			prefs.units.volume = units::CUFT;
+			QCOMPARE(get_volume_string(ml), QString("%L1").arg(ml_to_cuft(ml), 0, 'f', 2));
+		}
+	}
+	QLocale::setDefault(old_locale);
+
+	prefs.units.duration_units = units::MIXED;
+	QCOMPARE(get_dive_duration_string(3725, "h", "min"), QString("1:02h"));
+	QCOMPARE(get_dive_duration_string(2700, "h", "min"), QString("45min"));
+	QCOMPARE(get_dive_duration_string(335, "h", "min", "sec", ":", true), QString("5:35min"));
+	QCOMPARE(get_dive_duration_string(335, "h", "", "", ":", true), QString("0:05:35h"));
+	QCOMPARE(get_dive_duration_string(335, "h", "min", "sec", " ", true), QString("5min 35sec"));
+	prefs.units.duration_units = units::ALWAYS_HOURS;
+	QCOMPARE(get_dive_duration_string(2700, "h", "min", "sec", " "), QString("0h 45min"));
+	prefs.units = old_units;
+}
+
+void TestHelper::appendFormat()
+{
+	std::string buf = "<div>";
+	append_format_std(buf, "%s: %d%%", "CNS", 12);
+	QCOMPARE(buf, std::string("<div>CNS: 12%"));
+	append_format_std(buf, "%s", "");
+	QCOMPARE(buf, std::string("<div>CNS: 12%"));
+	std::string long_string(5000, 'x');
+	append_format_std(buf, "%s|", long_string.c_str());
+	QCOMPARE(buf, "<div>CNS: 12%" + long_string + "|");
+
+	buf = "<br/>";
+	append_format_loc(buf, "%.1f%s", 1.25, "bar");
+	QCOMPARE(buf, "<br/>" + casprintf_loc("%.1f%s", 1.25, "bar"));
+}
+
 QTEST_GUILESS_MAIN(TestHelper)
@@ -11,6 +11,9 @@ private slots:
 	void initTestCase();
 	void recognizeBtAddress();
 	void parseNameAddress();
+	void messageRing();
+	void unitStrings();
+	void appendFormat();
 };
 
 #endif
@@ -7,6 +7,8 @@
 #include "core/file.h"
 #include "core/trip.h"
 #include "core/pref.h"
+#include "core/profilesignature.h"
+#include "core/sample.h"
 #include <QTextStream>
 
 void TestMerge::initTestCase()
@@ -68,3 +70,86 @@ void TestMerge::testMergeBackwards()
 }
 
 QTEST_GUILESS_MAIN(TestMerge)
+
+void TestMerge::testSplitAtTime()
+{
+	/*
+	 * check that the samples are distributed over the split dives
+	 */
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/test34.xml", &divelog), 0);
+	QCOMPARE(divelog.dives.size(), 1);
+	const struct dive &d = *divelog.dives[0];
+	const std::vector<sample> &samples = d.dcs[0].samples;
+	size_t idx = samples.size() / 2;
+	auto [d1, d2] = divelog.dives.split_dive_at_time(d, samples[idx].time);
+	QVERIFY(d1 && d2);
+	QCOMPARE(d1->dcs[0].samples.size(), idx);
+	QCOMPARE(d2->dcs[0].samples.size(), samples.size() - idx + 1);
+	QCOMPARE(d1->dcs[0].samples.back().time.seconds, samples[idx - 1].time.seconds);
+	QCOMPARE(d2->dcs[0].samples[0].time.seconds, 0);
+	QCOMPARE(d2->when, d.when + samples[idx - 1].time.seconds);
+	QCOMPARE(d2->dcs[0].samples.back().depth.mm, samples.back().depth.mm);
+}
+
+void TestMerge::testMergeSplitDives()
+{
+	/*
+	 * check that merging the two halves of a split dive
+	 * interleaves the samples back into the original order
+	 */
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/test34.xml", &divelog), 0);
+	QCOMPARE(divelog.dives.size(), 1);
+	const struct dive &d = *divelog.dives[0];
+	const std::vector<sample> &samples = d.dcs[0].samples;
+	auto [d1, d2] = divelog.dives.split_dive_at_time(d, samples[samples.size() / 2].time);
+	QVERIFY(d1 && d2);
+	merge_result res = divelog.dives.merge_dives({ d1.get(), d2.get() });
+	QVERIFY(res.dive);
+	const std::vector<sample> &merged = res.dive->dcs[0].samples;
+	QCOMPARE(merged.size(), samples.size());
+	for (size_t i = 0; i < samples.size(); ++i)
+		QCOMPARE(merged[i].time.seconds, samples[i].time.seconds);
+}
+
+void TestMerge::testLikelyDuplicates()
+{
+	/*
+	 * check that the same dive recorded by a buddy, whose clock
+	 * is three hours off, is flagged on import, but a dive with
+	 * a different profile is not
+	 */
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/test34.xml", &divelog), 0);
+	QCOMPARE(divelog.dives.size(), 1);
+	struct dive *d = divelog.dives[0].get();
+
+	auto buddy = std::make_unique<dive>(*d);
+	buddy->when += 3 * 3600;
+	buddy->dive_site = nullptr;
+	buddy->divetrip = nullptr;
+	buddy->dcs[0].model = "Buddy computer";
+	for (sample &s: buddy->dcs[0].samples)
+		s.depth.mm += 300;
+	auto other = std::make_unique<dive>(*buddy);
+	other->when += 3 * 3600;
+	for (sample &s: other->dcs[0].samples)
+		s.depth.mm *= 2;
+
+	struct divelog log;
+	log.dives.put(std::move(buddy));
+	log.dives.put(std::move(other));
+	auto res = divelog.process_imported_dives(log, import_flags::merge_all_trips);
+	QCOMPARE(res.dives_to_add.size(), 2);
+	QCOMPARE(res.dives_to_remove.size(), 0);
+	QCOMPARE(res.likely_duplicates.size(), 1);
+	QCOMPARE(res.likely_duplicates[0].first, res.dives_to_add[0].get());
+	QCOMPARE(res.likely_duplicates[0].second, d);
+
+	profile_signature_index index({ d, res.dives_to_add[0].get(), res.dives_to_add[1].get() });
+	auto duplicates = index.find_duplicates();
+	QCOMPARE(duplicates.size(), 1);
+	QCOMPARE(duplicates[0].first, d);
+	QCOMPARE(duplicates[0].second, res.dives_to_add[0].get());
+	auto similar = index.find_similar(*d, profile_signature_index::duplicate_distance);
+	QCOMPARE(similar.size(), 1);
+	QCOMPARE(similar[0].dive, res.dives_to_add[0].get());
+}
@@ -12,6 +12,9 @@ private slots:
 
 	void testMergeEmpty();
 	void testMergeBackwards();
+	void testSplitAtTime();
+	void testMergeSplitDives();
+	void testLikelyDuplicates();
 };
 
 #endif
@@ -1,17 +1,25 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "testparse.h"
+#include "core/binarylog.h"
+#include "core/changejournal.h"
 #include "core/device.h"
 #include "core/dive.h"
 #include "core/divelog.h"
+#include "core/divelogsnapshot.h"
 #include "core/divesite.h"
 #include "core/errorhelper.h"
 #include "core/trip.h"
 #include "core/file.h"
 #include "core/import-csv.h"
+#include "core/membuffer.h"
+#include "core/memoryusage.h"
 #include "core/parse.h"
 #include "core/qthelper.h"
+#include "core/sample.h"
 #include "core/subsurface-string.h"
 #include "core/xmlparams.h"
+#include "core/zipwriter.h"
+#include "core/subsurface-qt/divelistnotifier.h"
 #include <QTextStream>
 
 /* We have to use a macro since QCOMPARE
@@ -199,6 +207,58 @@ void TestParse::testParseHUDC()
 		     SUBSURFACE_TEST_DATA "/dives/TestDiveSeabearHUDC.xml");
 }
 
+void TestParse::testParseCSVNative_data()
+{
+	QTest::addColumn<int>("units");
+	QTest::addColumn<int>("stopdepthField");
+	QTest::addColumn<int>("pressureField");
+
+	QTest::newRow("metric") << 0 << -1 << -1;
+	QTest::newRow("metric stopdepth pressure") << 0 << 3 << 6;
+	QTest::newRow("imperial stopdepth pressure") << 1 << 3 << 6;
+}
+
+void TestParse::testParseCSVNative()
+{
+	/*
+	 * check that the native CSV import gives the same dive
+	 * as the stylesheet
+	 */
+	QFETCH(int, units);
+	QFETCH(int, stopdepthField);
+	QFETCH(int, pressureField);
+
+	for (bool native: { false, true }) {
+		xml_params params;
+
+		xml_params_add_int(&params, "timeField", 0);
+		xml_params_add_int(&params, "depthField", 1);
+		xml_params_add_int(&params, "tempField", 5);
+		xml_params_add_int(&params, "ndlField", 2);
+		xml_params_add_int(&params, "stopdepthField", stopdepthField);
+		xml_params_add_int(&params, "pressureField", pressureField);
+		xml_params_add_int(&params, "separatorIndex", 2);
+		xml_params_add_int(&params, "units", units);
+		xml_params_add(&params, "hw", "\"DC text\"");
+
+		csv_native_import = native;
+		QCOMPARE(parse_csv_file(SUBSURFACE_TEST_DATA "/dives/TestDiveSeabearHUDC.csv",
+					&params, "csv", &divelog),
+			 0);
+		QCOMPARE(divelog.dives.size(), 1);
+
+		struct dive &dive = *divelog.dives.back();
+		dive.when = 1255152761;
+		dive.dcs[0].when = 1255152761;
+		QCOMPARE(save_dives(native ? "./testcsvnative.ssrf" : "./testcsvxslt.ssrf"), 0);
+		clear_dive_file_data();
+	}
+	csv_native_import = true;
+
+	FILE_COMPARE("./testcsvnative.ssrf",
+		     "./testcsvxslt.ssrf");
+}
+
 void TestParse::testParseNewFormat()
 {
 	QDir dir;
@@ -266,6 +326,313 @@ void TestParse::testParseMerge()
 		     SUBSURFACE_TEST_DATA "/dives/mergedVyperOstc.xml");
 }
 
+void TestParse::testParseStream()
+{
+	/*
+	 * check that native files parsed on the fly give the same
+	 * result as parsing the document tree
+	 */
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/test42.xml", &divelog), 0);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/ostc.xml", &divelog), 0);
+	QCOMPARE(save_dives("./teststream.ssrf"), 0);
+	clear_dive_file_data();
+
+	auto [mem, err] = readfile("./teststream.ssrf");
+	QVERIFY(err > 0);
+	QCOMPARE(parse_xml_buffer("./teststream.ssrf", mem.data(), mem.size(), &divelog, NULL), 0);
+	QCOMPARE(save_dives("./teststreamtree.ssrf"), 0);
+	clear_dive_file_data();
+
+	QCOMPARE(parse_file("./teststream.ssrf", &divelog), 0);
+	QCOMPARE(save_dives("./teststreamreader.ssrf"), 0);
+	FILE_COMPARE("./teststreamreader.ssrf",
+		     "./teststreamtree.ssrf");
+}
+
+void TestParse::testParseZipParallel()
+{
+	/*
+	 * archives with many entries are parsed on a thread pool:
+	 * check that all dives arrive and that the dive sites of
+	 * different entries are merged
+	 */
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	size_t nr = divelog.dives.size();
+	QVERIFY(nr >= 16);
+	size_t nr_sites = std::count_if(divelog.sites.begin(), divelog.sites.end(),
+					[](const auto &ds) { return !ds->dives.empty(); });
+	QFile file("./testparallel.zip");
+	QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+	ZipWriter zip(file);
+	int i = 0;
+	for (auto &d: divelog.dives) {
+		membuffer mb;
+		save_one_dive_as_log_to_mb(&mb, *d);
+		QVERIFY(zip.add("dive" + std::to_string(i++) + ".ssrf", mb.buffer, mb.len));
+	}
+	QVERIFY(zip.finish());
+	file.close();
+	clear_dive_file_data();
+
+	QCOMPARE(try_to_open_zip("./testparallel.zip", &divelog), (int)nr);
+	QCOMPARE(divelog.dives.size(), nr);
+	QCOMPARE(divelog.sites.size(), nr_sites);
+	for (auto &d: divelog.dives)
+		QVERIFY(!d->dive_site || std::find(d->dive_site->dives.begin(), d->dive_site->dives.end(), d.get()) !=
+					 d->dive_site->dives.end());
+}
+
+void TestParse::testSaveParallel()
+{
+	/*
+	 * big logs are rendered on a thread pool: check that all
+	 * dives are written and that the file reads back the same
+	 */
+	for (int i = 0; i < 3; i++)
+		QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QVERIFY(divelog.dives.size() >= 64);
+	size_t nr = divelog.dives.size();
+	QCOMPARE(save_dives("./testparallel.ssrf"), 0);
+	clear_dive_file_data();
+
+	QCOMPARE(parse_file("./testparallel.ssrf", &divelog), 0);
+	QCOMPARE(divelog.dives.size(), nr);
+	QCOMPARE(save_dives("./testparallelout.ssrf"), 0);
+	FILE_COMPARE("./testparallelout.ssrf",
+		     "./testparallel.ssrf");
+}
+
+void TestParse::testAllCylinderRelatedInfo()
+{
+	// the single pass over all dives gives the same values as updating dive by dive
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/abitofeverything.ssrf", &divelog), 0);
+	std::vector<int> expected;
+	for (auto &d: divelog.dives)
+		d->cns = d->maxcns = 0;
+	for (auto &d: divelog.dives) {
+		divelog.dives.update_cylinder_related_info(*d);
+		expected.push_back(d->maxcns);
+	}
+
+	for (auto &d: divelog.dives)
+		d->cns = d->maxcns = 0;
+	divelog.dives.update_all_cylinder_related_info();
+	QCOMPARE(divelog.dives.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); i++)
+		QCOMPARE(divelog.dives[i]->maxcns, expected[i]);
+}
+
+void TestParse::testRecordDives()
+{
+	// the batched fixup of the loaders gives the same values as fixing up dive by dive
+	for (int i = 0; i < 5; i++)
+		QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	dive_table one_by_one, batched;
+	std::vector<std::unique_ptr<dive>> dives;
+	for (auto &d: divelog.dives) {
+		auto copy = std::make_unique<dive>(*d);
+		copy->cns = copy->maxcns = 0;
+		one_by_one.record_dive(std::make_unique<dive>(*copy));
+		dives.push_back(std::move(copy));
+	}
+	batched.record_dives(std::move(dives));
+
+	QCOMPARE(batched.size(), one_by_one.size());
+	for (size_t i = 0; i < batched.size(); i++) {
+		QCOMPARE(batched[i]->maxcns, one_by_one[i]->maxcns);
+		QCOMPARE(batched[i]->sac, one_by_one[i]->sac);
+		QCOMPARE(batched[i]->otu, one_by_one[i]->otu);
+		QCOMPARE(batched[i]->maxdepth.mm, one_by_one[i]->maxdepth.mm);
+		QCOMPARE(batched[i]->duration.seconds, one_by_one[i]->duration.seconds);
+	}
+}
+
+void TestParse::testSaveCompressed()
+{
+	/* a ".gz" file reads back the same as the uncompressed one */
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QCOMPARE(save_dives("./testcompressed.ssrf"), 0);
+	QCOMPARE(save_dives("./testcompressed.ssrf.gz"), 0);
+	clear_dive_file_data();
+
+	QFile gz("./testcompressed.ssrf.gz");
+	QVERIFY(gz.open(QFile::ReadOnly));
+	QByteArray magic = gz.read(2);
+	QCOMPARE(magic, QByteArray("\x1f\x8b"));
+
+	QCOMPARE(parse_file("./testcompressed.ssrf.gz", &divelog), 0);
+	QCOMPARE(save_dives("./testcompressedout.ssrf"), 0);
+	FILE_COMPARE("./testcompressedout.ssrf",
+		     "./testcompressed.ssrf");
+}
+
+void TestParse::testBinaryLog()
+{
+	/* a binary log reads back the same as the XML file */
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/abitofeverything.ssrf", &divelog), 0);
+	QCOMPARE(save_dives("./testbinary.ssrf"), 0);
+	QCOMPARE(save_dives("./testbinary.ssrb"), 0);
+	clear_dive_file_data();
+
+	QCOMPARE(parse_file("./testbinary.ssrb", &divelog), 0);
+	// the samples are only decoded when they are needed
+	QVERIFY(std::any_of(divelog.dives.begin(), divelog.dives.end(),
+			    [](auto &d) { return d->dcs[0].samples_pending; }));
+	QCOMPARE(save_dives("./testbinaryout.ssrf"), 0);
+	FILE_COMPARE("./testbinaryout.ssrf",
+		     "./testbinary.ssrf");
+	size_t nr = divelog.dives.size();
+	size_t nr_trips = divelog.trips.size();
+	clear_dive_file_data();
+
+	/* appended dives and their sites come after the dives of the log */
+	struct divelog log;
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &log), 0);
+	std::vector<const dive *> dives;
+	for (auto &d: log.dives)
+		dives.push_back(d.get());
+	QCOMPARE(append_binary_log("./testbinary.ssrb", dives), 0);
+	QCOMPARE(parse_file("./testbinary.ssrb", &divelog), 0);
+	QCOMPARE(divelog.dives.size(), nr + log.dives.size());
+	QCOMPARE(divelog.trips.size(), nr_trips + log.trips.size());
+	for (auto &d: divelog.dives)
+		QVERIFY(!d->dive_site || std::find(d->dive_site->dives.begin(), d->dive_site->dives.end(), d.get()) !=
+					 d->dive_site->dives.end());
+
+	/* and a truncated append is ignored */
+	QFile file("./testbinary.ssrb");
+	QVERIFY(file.resize(file.size() - 1));
+	clear_dive_file_data();
+	QCOMPARE(parse_file("./testbinary.ssrb", &divelog), 0);
+	QCOMPARE(divelog.dives.size(), nr);
+}
+
+void TestParse::testSnapshots()
+{
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QVERIFY(divelog.dives.size() >= 2);
+	auto first = DiveLogSnapshots::instance()->take();
+	QCOMPARE(first->dives.size(), divelog.dives.size());
+	QCOMPARE(first->trips.size(), divelog.trips.size());
+	QCOMPARE(first->sites.size(), divelog.sites.size());
+	for (size_t i = 0; i < divelog.dives.size(); i++) {
+		const dive &d = *first->dives[i];
+		QCOMPARE(d.id, divelog.dives[i]->id);
+		QVERIFY(d.notes == divelog.dives[i]->notes);
+		// the dives point to the trips and sites of the snapshot
+		if (d.divetrip)
+			QVERIFY(std::any_of(first->trips.begin(), first->trips.end(), [&d](auto &t) { return t.get() == d.divetrip; }));
+		if (d.dive_site)
+			QVERIFY(std::any_of(first->sites.begin(), first->sites.end(), [&d](auto &ds) { return ds.get() == d.dive_site; }));
+	}
+
+	// only the edited dive is copied, the old snapshot doesn't change
+	std::string old_notes = divelog.dives[0]->notes;
+	divelog.dives[0]->notes = "Edited after the snapshot";
+	emit diveListNotifier.divesChanged(QVector<dive *> { divelog.dives[0].get() }, DiveField(DiveField::NOTES));
+	auto second = DiveLogSnapshots::instance()->take();
+	QVERIFY(second->dives[0] != first->dives[0]);
+	QVERIFY(second->dives[0]->notes == "Edited after the snapshot");
+	QVERIFY(first->dives[0]->notes == old_notes);
+	for (size_t i = 1; i < second->dives.size(); i++)
+		QCOMPARE(second->dives[i], first->dives[i]);
+	QCOMPARE(second->trips, first->trips);
+	QCOMPARE(second->sites, first->sites);
+}
+
+void TestParse::testChangeJournal()
+{
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QVERIFY(divelog.dives.size() >= 2);
+	ChangeJournal journal("./testjournal");
+	QCOMPARE(journal.open("journaltest.ssrf"), 0);
+
+	// edit one dive and add another one
+	dive *edited = divelog.dives[0].get();
+	edited->notes = "Edited after loading";
+	emit diveListNotifier.divesChanged(QVector<dive *> { edited }, DiveField(DiveField::NOTES));
+	auto d = std::make_unique<dive>();
+	copy_dive(divelog.dives[1].get(), d.get());
+	d->id = dive_getUniqID();
+	d->dive_site = nullptr;
+	d->divetrip = nullptr;
+	d->when += 365 * 24 * 3600;
+	d->notes = "Added after loading";
+	dive *added = divelog.dives.register_dive(std::move(d));
+	emit diveListNotifier.divesAdded(nullptr, false, QVector<dive *> { added });
+	journal.flush();
+
+	// "crash": load the log again, the journal of the first session is still there
+	clear_dive_file_data();
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	ChangeJournal recovered("./testjournal");
+	QCOMPARE(recovered.open("journaltest.ssrf"), 3);
+	struct divelog log;
+	std::vector<dive *> removed;
+	recovered.takeRecovered(log, removed);
+	QCOMPARE(removed.size(), 1);
+	QCOMPARE(removed[0], divelog.dives[0].get());
+	QCOMPARE(log.dives.size(), 2);
+	QStringList notes;
+	for (auto &d: log.dives)
+		notes.push_back(QString::fromStdString(d->notes));
+	QVERIFY(notes.contains("Edited after loading"));
+	QVERIFY(notes.contains("Added after loading"));
+
+	// the journal of another log isn't used and closing removes the journal
+	QCOMPARE(ChangeJournal("./testjournal").open("otherlog.ssrf"), 0);
+	recovered.close();
+	QCOMPARE(ChangeJournal("./testjournal").open("journaltest.ssrf"), 0);
+}
+
+void TestParse::testCompactSamples()
+{
+	/* packed samples are decoded on access and give the same dives */
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	QCOMPARE(save_dives("./testcompact.ssrf"), 0);
+	QVERIFY(!divelog.dives.empty());
+
+	struct divecomputer &dc = divelog.dives[0]->dcs[0];
+	QVERIFY(!dc.samples.empty());
+	uint32_t channels = get_sample_channels(dc);
+	QVERIFY(channels & SAMPLE_TIME);
+	QVERIFY(channels & SAMPLE_DEPTH);
+	for (auto &d: divelog.dives)
+		d->compact_samples();
+	QVERIFY(dc.samples.empty());
+	QVERIFY(dc.samples_pending);
+	QCOMPARE(get_sample_channels(dc), channels);
+
+	QCOMPARE(save_dives("./testcompactout.ssrf"), 0);
+	QVERIFY(!dc.samples_pending);
+	FILE_COMPARE("./testcompactout.ssrf",
+		     "./testcompact.ssrf");
+}
+
+void TestParse::testMemoryUsage()
+{
+	auto bytes = [](const char *subsystem) {
+		for (const memory_usage &usage: get_memory_usage()) {
+			if (!strcmp(usage.subsystem, subsystem))
+				return usage.bytes;
+		}
+		return (size_t)0;
+	};
+
+	QCOMPARE(parse_file(SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf", &divelog), 0);
+	size_t samples = bytes("samples");
+	QVERIFY(samples > 0);
+	QCOMPARE(bytes("packed samples"), (size_t)0);
+
+	/* compacting trades the sample vectors for the much smaller encoded form */
+	for (auto &d: divelog.dives)
+		d->compact_samples();
+	QCOMPARE(bytes("samples"), (size_t)0);
+	QVERIFY(bytes("packed samples") > 0);
+	QVERIFY(bytes("packed samples") < samples);
+}
+
 int TestParse::parseCSVmanual(int units, std::string file)
 {
 	verbose = 1;
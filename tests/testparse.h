@@ -21,9 +21,22 @@ private slots:
 	void testParseDM4();
 	void testParseDM5();
 	void testParseHUDC();
+	void testParseCSVNative_data();
+	void testParseCSVNative();
 	void testParseNewFormat();
 	void testParseDLD();
 	void testParseMerge();
+	void testParseStream();
+	void testParseZipParallel();
+	void testSaveParallel();
+	void testSaveCompressed();
+	void testBinaryLog();
+	void testCompactSamples();
+	void testChangeJournal();
+	void testSnapshots();
+	void testMemoryUsage();
+	void testAllCylinderRelatedInfo();
+	void testRecordDives();
 
 	int parseCSVmanual(int, std::string);
 	void exportSubsurfaceCSV();
@@ -1,20 +1,136 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "testparseperformance.h"
+#include "core/deco.h"
 #include "core/device.h"
+#include "core/dive.h"
 #include "core/divelog.h"
 #include "core/divesite.h"
 #include "core/errorhelper.h"
 #include "core/trip.h"
 #include "core/file.h"
+#include "core/divefilter.h"
+#include "core/fulltext.h"
 #include "core/git-access.h"
+#include "core/import-csv.h"
+#include "core/planner.h"
+#include "core/profile.h"
+#include "core/version.h"
+#include "core/xmlparams.h"
 #include "core/settings/qPrefProxy.h"
 #include "core/settings/qPrefCloudStorage.h"
+#include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkProxy>
+#include <algorithm>
 #include "QTextCodec"
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
 
 #define LARGE_TEST_REPO "https://github.com/Subsurface/large-anonymous-sample-data"
 
+/*
+ * Besides the usual QBENCHMARK output, the results are collected and,
+ * if SUBSURFACE_BENCH_OUTPUT is set, written to that file as JSON at
+ * the end of the run (see the subsurface-bench target).
+ */
+static QJsonArray benchmark_results;
+
+// Peak resident set size of the process so far, in kB (0 if unknown)
+static long peak_rss_kb()
+{
+#ifdef Q_OS_UNIX
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+#ifdef Q_OS_DARWIN
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#else
+	return 0;
+#endif
+}
+
+// Records the wall time of the QBENCHMARK loop of the current test function
+class BenchmarkTimer {
+public:
+	BenchmarkTimer()
+	{
+		timer.start();
+	}
+	~BenchmarkTimer()
+	{
+		if (!iterations)
+			return;
+		QString name = QTest::currentTestFunction();
+		if (QTest::currentDataTag())
+			name += QString(":") + QTest::currentDataTag();
+		QJsonObject result;
+		result["name"] = name;
+		result["iterations"] = iterations;
+		result["wall_ms"] = (double)timer.nsecsElapsed() / 1e6 / iterations;
+		result["peak_rss_kb"] = (qint64)peak_rss_kb();
+		for (auto it = extra.begin(); it != extra.end(); ++it)
+			result[it.key()] = it.value();
+		benchmark_results.append(result);
+	}
+	void iteration()
+	{
+		iterations++;
+	}
+	// Additional values to report with the wall time
+	void set(const QString &key, double value)
+	{
+		extra[key] = value;
+	}
+private:
+	QElapsedTimer timer;
+	int iterations = 0;
+	QJsonObject extra;
+};
+
+// Use the large anonymous log if it is there and fall back to the test data
+static QString benchmark_source()
+{
+	QString source = SUBSURFACE_TEST_DATA "/dives/large-anon.ssrf";
+	if (!QFile::exists(source))
+		source = SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf";
+	return source;
+}
+
+/*
+ * The stop schedules of planCorpus() are compared against this file.
+ * Run the benchmarks with SUBSURFACE_UPDATE_GOLDEN set to write it
+ * anew after an intended change of the planner.
+ */
+#define PLAN_GOLDEN_FILE SUBSURFACE_TEST_DATA "/dives/plan-golden.json"
+static QJsonObject plan_golden;
+
+static bool update_golden()
+{
+	return !qgetenv("SUBSURFACE_UPDATE_GOLDEN").isEmpty();
+}
+
+static bool create_local_repo(const char *path)
+{
+	git_repository *repo;
+
+	git_libgit2_init();
+	if (!QDir(path).removeRecursively() || !QDir().mkdir(path))
+		return false;
+	if (git_repository_init(&repo, path, false))
+		return false;
+	git_repository_free(repo);
+	return true;
+}
+
 void TestParsePerformance::initTestCase()
 {
 	/* we need to manually tell that the resource exists, because we are using it as library. */
@@ -41,12 +157,36 @@ void TestParsePerformance::initTestCase()
 	}
 	QNetworkProxy::setApplicationProxy(proxy);
 
+	QFile golden(PLAN_GOLDEN_FILE);
+	if (!update_golden() && golden.open(QFile::ReadOnly))
+		plan_golden = QJsonDocument::fromJson(golden.readAll()).object();
+
 	// now cleanup the cache dir in case there's something weird from previous runs
 	std::string localCacheDir = get_local_dir(LARGE_TEST_REPO, "git");
 	QDir localCacheDirectory(localCacheDir.c_str());
 	QCOMPARE(localCacheDirectory.removeRecursively(), true);
 }
 
+void TestParsePerformance::cleanupTestCase()
+{
+	if (update_golden()) {
+		QFile golden(PLAN_GOLDEN_FILE);
+		QVERIFY(golden.open(QFile::WriteOnly | QFile::Truncate));
+		QVERIFY(golden.write(QJsonDocument(plan_golden).toJson()) >= 0);
+	}
+
+	QByteArray output = qgetenv("SUBSURFACE_BENCH_OUTPUT");
+	if (output.isEmpty())
+		return;
+
+	QJsonObject root;
+	root["version"] = QString(subsurface_git_version());
+	root["benchmarks"] = benchmark_results;
+	QFile file(QString::fromLocal8Bit(output));
+	QVERIFY(file.open(QFile::WriteOnly | QFile::Truncate));
+	QVERIFY(file.write(QJsonDocument(root).toJson()) >= 0);
+}
+
 void TestParsePerformance::init()
 {
 }
@@ -65,11 +205,24 @@ void TestParsePerformance::parseSsrf()
 		report_info("clone the repo, uncompress the file and copy it to " SUBSURFACE_TEST_DATA "/dives/large-anon.ssrf");
 		return;
 	}
+	BenchmarkTimer timer;
 	QBENCHMARK {
+		timer.iteration();
 		parse_file(SUBSURFACE_TEST_DATA "/dives/large-anon.ssrf", &divelog);
 	}
 }
 
+void TestParsePerformance::saveSsrf()
+{
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		QCOMPARE(save_dives("./benchsave.ssrf"), 0);
+	}
+}
+
 void TestParsePerformance::parseGit()
 {
 	// some more necessary setup
@@ -81,9 +234,378 @@ void TestParsePerformance::parseGit()
 
 	cleanup();
 
+	BenchmarkTimer timer;
 	QBENCHMARK {
+		timer.iteration();
 		parse_file(LARGE_TEST_REPO "[git]", &divelog);
 	}
 }
 
+void TestParsePerformance::parseGitSamples_data()
+{
+	QTest::addColumn<bool>("fastSamples");
+
+	QTest::newRow("fast sample lines") << true;
+	QTest::newRow("generic line parser") << false;
+}
+
+void TestParsePerformance::parseGitSamples()
+{
+	// compare the git sample parsing paths on a local repository
+	QFETCH(bool, fastSamples);
+	QVERIFY(create_local_repo("./gitsamples"));
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+	QCOMPARE(save_dives("./gitsamples[test]"), 0);
+	cleanup();
+
+	git_load_fast_samples = fastSamples;
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		clear_dive_file_data();
+		parse_file("./gitsamples[test]", &divelog);
+	}
+	git_load_fast_samples = true;
+}
+
+void TestParsePerformance::saveGit_data()
+{
+	QTest::addColumn<bool>("cached");
+
+	QTest::newRow("cold") << false;
+	QTest::newRow("cached") << true;
+}
+
+void TestParsePerformance::saveGit()
+{
+	// a cold save renders every dive, a cached one reuses the previous commit
+	QFETCH(bool, cached);
+	QVERIFY(create_local_repo("./gitsave"));
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+	QCOMPARE(save_dives("./gitsave[test]"), 0);
+
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		if (!cached) {
+			saved_git_id.clear();
+			for (auto &d: divelog.dives)
+				d->invalidate_cache();
+		}
+		QCOMPARE(save_dives("./gitsave[test]"), 0);
+	}
+}
+
+void TestParsePerformance::importCsv()
+{
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+	QCOMPARE(export_dives_xslt("./benchimport.csv", false, 0, "xml2manualcsv.xslt", false), 0);
+	cleanup();
+
+	xml_params params;
+	xml_params_add_int(&params, "separatorIndex", 1);
+	xml_params_add_int(&params, "units", 0);
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		clear_dive_file_data();
+		QCOMPARE(parse_csv_file("./benchimport.csv", &params, "SubsurfaceCSV", &divelog), 0);
+	}
+}
+
+void TestParsePerformance::plotInfo()
+{
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		for (auto &d: divelog.dives) {
+			plot_info pi = create_plot_info_new(d.get(), d->get_dc(0), nullptr);
+			QVERIFY(pi.nr >= 0);
+		}
+	}
+}
+
+void TestParsePerformance::profileCorpus_data()
+{
+	QTest::addColumn<bool>("ceiling");
+	QTest::addColumn<bool>("tissues");
+	QTest::addColumn<int>("decoMode");
+	QTest::addColumn<bool>("po2");
+
+	QTest::newRow("no deco") << false << false << (int)BUEHLMANN << false;
+	QTest::newRow("buehlmann ceiling") << true << false << (int)BUEHLMANN << false;
+	QTest::newRow("vpmb ceiling") << true << false << (int)VPMB << false;
+	QTest::newRow("buehlmann ceiling tissues") << true << true << (int)BUEHLMANN << false;
+	QTest::newRow("vpmb ceiling tissues") << true << true << (int)VPMB << false;
+	QTest::newRow("buehlmann ceiling tissues po2") << true << true << (int)BUEHLMANN << true;
+	QTest::newRow("vpmb ceiling tissues po2") << true << true << (int)VPMB << true;
+}
+
+// The quantile q (0..1) of sorted values
+static double quantile(const std::vector<qint64> &sorted, double q)
+{
+	if (sorted.empty())
+		return 0.0;
+	return (double)sorted[std::min(sorted.size() - 1, (size_t)(q * (double)sorted.size()))];
+}
+
+void TestParsePerformance::profileCorpus()
+{
+	// the profile of every dive computer of every dive, with the preferences
+	// and the channels that the profile would ask for
+	QFETCH(bool, ceiling);
+	QFETCH(bool, tissues);
+	QFETCH(int, decoMode);
+	QFETCH(bool, po2);
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+
+	struct preferences saved_prefs = prefs;
+	prefs.calcceiling = ceiling;
+	prefs.calcndltts = ceiling;
+	prefs.calcalltissues = tissues;
+	prefs.percentagegraph = tissues;
+	prefs.display_deco_mode = (deco_mode)decoMode;
+	prefs.pp_graphs.po2 = po2;
+	int channels = (ceiling ? PLOT_DECO : 0) | (tissues ? PLOT_TISSUES : 0);
+
+	std::vector<qint64> latencies; // per dive computer, in ns
+	qint64 total = 0;
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		latencies.clear();
+		total = 0;
+		for (auto &d: divelog.dives) {
+			for (const divecomputer &dc: d->dcs) {
+				QElapsedTimer t;
+				t.start();
+				plot_info pi = create_plot_info_new(d.get(), &dc, nullptr, channels);
+				latencies.push_back(t.nsecsElapsed());
+				QVERIFY(pi.nr >= 0);
+			}
+		}
+		for (qint64 l: latencies)
+			total += l;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	timer.set("profiles", (double)latencies.size());
+	timer.set("dives_per_s", total > 0 ? (double)divelog.dives.size() * 1e9 / (double)total : 0.0);
+	timer.set("profiles_per_s", total > 0 ? (double)latencies.size() * 1e9 / (double)total : 0.0);
+	timer.set("latency_p50_us", quantile(latencies, 0.5) / 1e3);
+	timer.set("latency_p90_us", quantile(latencies, 0.9) / 1e3);
+	timer.set("latency_p99_us", quantile(latencies, 0.99) / 1e3);
+	timer.set("latency_max_us", latencies.empty() ? 0.0 : (double)latencies.back() / 1e3);
+	report_info("%s: %d profiles, %.0f per second, latency p50 %.0f us, p99 %.0f us",
+		    QTest::currentDataTag(), (int)latencies.size(),
+		    total > 0 ? (double)latencies.size() * 1e9 / (double)total : 0.0,
+		    quantile(latencies, 0.5) / 1e3, quantile(latencies, 0.99) / 1e3);
+	prefs = saved_prefs;
+}
+
+void TestParsePerformance::planDive()
+{
+	// a 30 minute trimix dive to 79m with two deco gases, as in TestPlan
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		struct dive dive;
+		struct deco_state ds;
+		deco_state_cache cache;
+		diveplan dp;
+		dp.salinity = 10300;
+		dp.surface_pressure = 1_atm;
+		dp.gfhigh = 100;
+		dp.gflow = 100;
+		dp.bottomsac = prefs.bottomsac;
+		dp.decosac = prefs.decosac;
+
+		cylinder_t *cyl2 = dive.get_or_create_cylinder(2);
+		cylinder_t *cyl0 = dive.get_or_create_cylinder(0);
+		cylinder_t *cyl1 = dive.get_or_create_cylinder(1);
+		cyl0->gasmix = { 15_percent, 45_percent };
+		cyl0->type.size = 36_l;
+		cyl0->type.workingpressure = 232_bar;
+		cyl1->gasmix = { 36_percent, 0_percent };
+		cyl2->gasmix = { 100_percent, 0_percent };
+		reset_cylinders(&dive, true);
+
+		int droptime = 79 * 60 / 23;
+		plan_add_segment(dp, 0, dive.gas_mod(cyl1->gasmix, 1600_mbar, 3000).mm, 1, 0, 1, OC);
+		plan_add_segment(dp, 0, dive.gas_mod(cyl2->gasmix, 1600_mbar, 3000).mm, 2, 0, 1, OC);
+		plan_add_segment(dp, droptime, 79000, 0, 0, 1, OC);
+		plan_add_segment(dp, 30 * 60 - droptime, 79000, 0, 0, 1, OC);
+		plan(&ds, dp, &dive, 0, 60, cache, true, false);
+	}
+}
+
+// The dives of the planner corpus
+enum corpus_dive {
+	CORPUS_RECREATIONAL_AIR,	// 18m for as long as there's no deco
+	CORPUS_TRIMIX,			// 30 minutes at 79m with two deco gases
+	CORPUS_CCR_BAILOUT,		// 20 minutes at 60m, CCR with bailout to two gases
+};
+
+static diveplan corpus_plan(corpus_dive kind, struct dive &dive)
+{
+	diveplan dp;
+	dp.salinity = 10300;
+	dp.surface_pressure = 1_atm;
+	dp.gflow = 50;
+	dp.gfhigh = 70;
+	dp.bottomsac = prefs.bottomsac;
+	dp.decosac = prefs.decosac;
+
+	// add the highest-index cylinder first, because pointers to cylinders are not stable
+	switch (kind) {
+	case CORPUS_RECREATIONAL_AIR: {
+		cylinder_t *cyl0 = dive.get_or_create_cylinder(0);
+		cyl0->gasmix = { 21_percent, 0_percent };
+		cyl0->type.size = 24_l;
+		cyl0->type.workingpressure = 232_bar;
+		reset_cylinders(&dive, true);
+		plan_add_segment(dp, 2 * 60, 18000, 0, 0, 1, OC);
+		plan_add_segment(dp, 10 * 60, 18000, 0, 0, 1, OC);
+		break;
+	}
+	case CORPUS_TRIMIX: {
+		cylinder_t *cyl2 = dive.get_or_create_cylinder(2);
+		cylinder_t *cyl0 = dive.get_or_create_cylinder(0);
+		cylinder_t *cyl1 = dive.get_or_create_cylinder(1);
+		cyl0->gasmix = { 15_percent, 45_percent };
+		cyl0->type.size = 36_l;
+		cyl0->type.workingpressure = 232_bar;
+		cyl1->gasmix = { 36_percent, 0_percent };
+		cyl2->gasmix = { 100_percent, 0_percent };
+		reset_cylinders(&dive, true);
+		int droptime = 79 * 60 / 23;
+		plan_add_segment(dp, 0, dive.gas_mod(cyl1->gasmix, 1600_mbar, 3000).mm, 1, 0, 1, OC);
+		plan_add_segment(dp, 0, dive.gas_mod(cyl2->gasmix, 1600_mbar, 3000).mm, 2, 0, 1, OC);
+		plan_add_segment(dp, droptime, 79000, 0, 0, 1, OC);
+		plan_add_segment(dp, 30 * 60 - droptime, 79000, 0, 0, 1, OC);
+		break;
+	}
+	case CORPUS_CCR_BAILOUT: {
+		cylinder_t *cyl2 = dive.get_or_create_cylinder(2);
+		cylinder_t *cyl0 = dive.get_or_create_cylinder(0);
+		cylinder_t *cyl1 = dive.get_or_create_cylinder(1);
+		cyl0->gasmix = { 20_percent, 21_percent };
+		cyl0->type.size = 3_l;
+		cyl0->type.workingpressure = 200_bar;
+		cyl0->cylinder_use = DILUENT;
+		cyl1->gasmix = { 53_percent, 0_percent };
+		cyl1->depth = dive.gas_mod(cyl1->gasmix, 1600_mbar, 3000);
+		cyl2->gasmix = { 19_percent, 33_percent };
+		cyl2->depth = dive.gas_mod(cyl2->gasmix, 1600_mbar, 3000);
+		reset_cylinders(&dive, true);
+		dive.dcs[0].divemode = CCR;
+		plan_add_segment(dp, 0, cyl1->depth.mm, 1, 0, false, OC);
+		plan_add_segment(dp, 0, cyl2->depth.mm, 2, 0, false, OC);
+		plan_add_segment(dp, 20 * 60, 60000, 0, 1300, true, CCR);
+		break;
+	}
+	}
+	return dp;
+}
+
+// The runtime and the stops of a plan, as stored in the golden file
+static QJsonObject plan_summary(const struct dive &dive, const std::vector<decostop> &stops)
+{
+	QJsonArray stop_array;
+	for (const decostop &stop: stops)
+		stop_array.append(QJsonArray { stop.depth, stop.time });
+	QJsonObject summary;
+	summary["runtime"] = dive.dcs[0].duration.seconds;
+	summary["stops"] = stop_array;
+	return summary;
+}
+
+void TestParsePerformance::planCorpus_data()
+{
+	QTest::addColumn<int>("kind");
+	QTest::addColumn<int>("decoMode");
+	QTest::addColumn<int>("conservatism");
+
+	QTest::newRow("recreational air 18m") << (int)CORPUS_RECREATIONAL_AIR << (int)RECREATIONAL << 0;
+	QTest::newRow("buehlmann trimix 79m") << (int)CORPUS_TRIMIX << (int)BUEHLMANN << 0;
+	QTest::newRow("buehlmann ccr bailout 60m") << (int)CORPUS_CCR_BAILOUT << (int)BUEHLMANN << 0;
+	QTest::newRow("vpmb+0 trimix 79m") << (int)CORPUS_TRIMIX << (int)VPMB << 0;
+	QTest::newRow("vpmb+2 trimix 79m") << (int)CORPUS_TRIMIX << (int)VPMB << 2;
+	QTest::newRow("vpmb+4 trimix 79m") << (int)CORPUS_TRIMIX << (int)VPMB << 4;
+}
+
+void TestParsePerformance::planCorpus()
+{
+	QFETCH(int, kind);
+	QFETCH(int, decoMode);
+	QFETCH(int, conservatism);
+
+	struct preferences saved_prefs = prefs;
+	prefs.planner_deco_mode = (deco_mode)decoMode;
+	prefs.dobailout = kind == CORPUS_CCR_BAILOUT;
+	auto run_plan = [kind, conservatism]() {
+		struct dive dive;
+		struct deco_state ds;
+		deco_state_cache cache;
+		diveplan dp = corpus_plan((corpus_dive)kind, dive);
+		dp.vpmb_conservatism = conservatism;
+		std::vector<decostop> stops = plan(&ds, dp, &dive, 0, 60, cache, true, false);
+		return plan_summary(dive, stops);
+	};
+
+	// plan once to count the work and to check the result
+	thread_deco_stats() = deco_stats();
+	QJsonObject summary = run_plan();
+	struct deco_stats stats = thread_deco_stats();
+
+	QString name = QTest::currentDataTag();
+	if (update_golden())
+		plan_golden[name] = summary;
+	else if (plan_golden.contains(name))
+		QVERIFY2(plan_golden[name].toObject() == summary,
+			 qPrintable("stops changed: " + QJsonDocument(summary).toJson(QJsonDocument::Compact)));
+	else
+		report_info("no golden output for plan %s in " PLAN_GOLDEN_FILE, qPrintable(name));
+
+	BenchmarkTimer timer;
+	timer.set("add_segment_calls", (double)stats.add_segment_calls);
+	timer.set("deco_state_copies", (double)stats.state_copies);
+	QBENCHMARK {
+		timer.iteration();
+		run_plan();
+	}
+	prefs = saved_prefs;
+}
+
+void TestParsePerformance::filterDives()
+{
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+	fulltext_populate();
+	FilterData data;
+	data.fullText = QStringLiteral("dive");
+	DiveFilter::instance()->setFilter(data);
+
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		DiveFilter::instance()->updateAll();
+	}
+	DiveFilter::instance()->reset();
+	fulltext_unregister_all();
+}
+
+void TestParsePerformance::populateFulltext()
+{
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+
+	BenchmarkTimer timer;
+	QBENCHMARK {
+		timer.iteration();
+		fulltext_unregister_all();
+		fulltext_populate();
+	}
+	fulltext_unregister_all();
+}
+
 QTEST_GUILESS_MAIN(TestParsePerformance)
@@ -8,11 +8,26 @@ class TestParsePerformance : public QObject {
 	Q_OBJECT
 private slots:
 	void initTestCase();
+	void cleanupTestCase();
 	void init();
 	void cleanup();
 
 	void parseSsrf();
+	void saveSsrf();
 	void parseGit();
+	void parseGitSamples_data();
+	void parseGitSamples();
+	void saveGit_data();
+	void saveGit();
+	void importCsv();
+	void plotInfo();
+	void profileCorpus_data();
+	void profileCorpus();
+	void planDive();
+	void planCorpus_data();
+	void planCorpus();
+	void filterDives();
+	void populateFulltext();
 };
 
 #endif
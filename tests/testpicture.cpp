@@ -2,12 +2,16 @@
 #include "testpicture.h"
 #include "core/device.h"
 #include "core/dive.h"
+#include "core/divelist.h"
 #include "core/divelog.h"
 #include "core/errorhelper.h"
 #include "core/picture.h"
 #include "core/file.h"
 #include "core/pref.h"
+#include "core/thumbnailstore.h"
 #include <QString>
+#include <QCryptographicHash>
+#include <QTemporaryDir>
 #include <core/qthelper.h>
 
 void TestPicture::initTestCase()
@@ -63,4 +67,101 @@ void TestPicture::addPicture()
 	QCOMPARE(localFilePath(QString::fromStdString(pic2.filename)), QString(PIC2_NAME));
 }
 
+static dive *add_dive(timestamp_t when, int duration, bool selected)
+{
+	auto d = std::make_unique<dive>();
+	d->when = when;
+	d->duration.seconds = duration;
+	d->selected = selected;
+	return divelog.dives.register_dive(std::move(d));
+}
+
+void TestPicture::matchPictureTimes()
+{
+	clear_dive_file_data();
+	QVERIFY(picture_matcher().nearest_dive(1000) == nullptr);
+
+	dive *long_dive = add_dive(1000, 3600, true);
+	add_dive(2000, 600, true);	// during the long dive
+	add_dive(5000, 600, false);
+	dive *last_dive = add_dive(10000, 600, true);
+
+	picture_matcher matcher;
+	QVERIFY(matcher.nearest_dive(500) == long_dive);
+	QVERIFY(matcher.nearest_dive(3000) == long_dive);
+	QVERIFY(matcher.nearest_dive(5000) == long_dive);
+	QVERIFY(matcher.nearest_dive(9000) == last_dive);
+	QVERIFY(matcher.nearest_dive(20000) == last_dive);
+	QCOMPARE(matcher.check_time(4600 + 29 * 60), true);
+	QCOMPARE(matcher.check_time(4600 + 31 * 60), false);
+	QCOMPARE(picture_check_valid_time(4600, 29 * 60), true);
+
+	clear_dive_file_data();
+}
+
+void TestPicture::testThumbnailStore()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	QString pack = dir.filePath("thumbnails.pack");
+	QString legacyDir = dir.path() + "/";
+
+	// A thumbnail of the old one-file-per-picture cache
+	QString legacyName = legacyDir + QCryptographicHash::hash(QByteArray("/legacy.jpg"), QCryptographicHash::Sha1).toHex();
+	{
+		QFile legacy(legacyName);
+		QVERIFY(legacy.open(QIODevice::WriteOnly));
+		legacy.write("legacy");
+	}
+
+	QByteArray data;
+	QDateTime written;
+	{
+		ThumbnailStore store(pack, legacyDir);
+		QCOMPARE(store.count(), 0);
+		QVERIFY(!store.get("/a.jpg", data, written));
+		store.put("/a.jpg", "first");
+		store.put("/b.jpg", "second");
+		store.put("/a.jpg", "third");
+		QCOMPARE(store.count(), 2);
+		QVERIFY(store.get("/a.jpg", data, written));
+		QCOMPARE(data, QByteArray("third"));
+		QVERIFY(written.isValid());
+
+		// Reading a legacy thumbnail moves it into the pack
+		QVERIFY(store.get("/legacy.jpg", data, written));
+		QCOMPARE(data, QByteArray("legacy"));
+		QVERIFY(!QFile::exists(legacyName));
+		QCOMPARE(store.count(), 3);
+	}
+
+	// The thumbnails survive reopening and compaction
+	{
+		ThumbnailStore store(pack, legacyDir);
+		QCOMPARE(store.count(), 3);
+		qint64 size = QFileInfo(pack).size();
+		store.compact();
+		QVERIFY(QFileInfo(pack).size() < size);
+		QVERIFY(store.get("/a.jpg", data, written));
+		QCOMPARE(data, QByteArray("third"));
+		QVERIFY(store.get("/b.jpg", data, written));
+		QCOMPARE(data, QByteArray("second"));
+		QVERIFY(store.get("/legacy.jpg", data, written));
+		QCOMPARE(data, QByteArray("legacy"));
+	}
+
+	// A truncated record at the end is dropped
+	{
+		QFile f(pack);
+		QVERIFY(f.open(QIODevice::ReadWrite));
+		QVERIFY(f.resize(f.size() - 2));
+	}
+	{
+		ThumbnailStore store(pack, legacyDir);
+		QCOMPARE(store.count(), 2);
+		QVERIFY(store.get("/a.jpg", data, written));
+		QCOMPARE(data, QByteArray("third"));
+	}
+}
+
 QTEST_GUILESS_MAIN(TestPicture)
@@ -9,6 +9,8 @@ class TestPicture : public QObject {
 private slots:
 	void initTestCase();
 	void addPicture();
+	void matchPictureTimes();
+	void testThumbnailStore();
 };
 
 #endif
@@ -577,6 +577,9 @@ void TestPlan::testVpmbMetric45m30minTx()
 	// check minimum gas result
 	auto dp = std::find_if(testPlan.dp.begin(), testPlan.dp.end(), [](auto &dp) { return dp.minimum_gas.mbar != 0; });
 	QCOMPARE(lrint(dp == testPlan.dp.end() ? 0.0 : dp->minimum_gas.mbar / 1000.0), 108l);
+	// the CVA needs more than one ascent, but converges
+	QVERIFY(testPlan.cva_iteration_usec.size() > 1);
+	QVERIFY(testPlan.cva_iteration_usec.size() < 10);
 	// print first ceiling
 	printf("First ceiling %.1f m\n", dive.mbar_to_depth(test_deco_state.first_ceiling_pressure.mbar) * 0.001);
 	// check benchmark run time of 141 minutes, and known Subsurface runtime of 139 minutes
@@ -953,4 +956,115 @@ void TestPlan::testCcrBailoutGasSelection()
 
 }
 
+void TestPlan::testPlanVariants()
+{
+	setupPrefs();
+	prefs.unit_system = METRIC;
+	prefs.units.length = units::METERS;
+	prefs.planner_deco_mode = BUEHLMANN;
+
+	// the plan of testMetric(), with lower gradient factors and a longer bottom time
+	dive.clear();
+	std::vector<diveplan> variants(3, setupPlan());
+	variants[1].gflow = 30;
+	variants[1].gfhigh = 70;
+	variants[2].dp.back().time += 10 * 60;
+
+	struct deco_config defaults = get_deco_config();
+	auto res = plan_variants(&test_deco_state, variants, &dive, 0, 60);
+	QCOMPARE(res.size(), variants.size());
+	QVERIFY(compareDecoTime(res[0].runtime.seconds, 109u * 60u, 109u * 60u));
+	QVERIFY(res[0].deco_time.seconds > 0);
+	QVERIFY(res[1].runtime.seconds > res[0].runtime.seconds);
+	QVERIFY(res[1].first_stop.mm >= res[0].first_stop.mm);
+	QVERIFY(res[2].runtime.seconds > res[0].runtime.seconds);
+
+	// the variants don't touch the dive they start from
+	QCOMPARE(res[0].runtime.seconds, plan_variants(&test_deco_state, { variants[0] }, &dive, 0, 60)[0].runtime.seconds);
+
+	// planning concurrently with different gradient factors gives the same
+	// result as planning alone and leaves the default gradient factors alone
+	QCOMPARE(res[1].runtime.seconds, plan_variants(&test_deco_state, { variants[1] }, &dive, 0, 60)[0].runtime.seconds);
+	QCOMPARE(get_deco_config().gf_low, defaults.gf_low);
+	QCOMPARE(get_deco_config().gf_high, defaults.gf_high);
+
+	// cancelled variants are not planned
+	res = plan_variants(&test_deco_state, variants, &dive, 0, 60, []() { return true; });
+	QCOMPARE(res.size(), variants.size());
+	for (const plan_variant &variant: res) {
+		QVERIFY(variant.stops.empty());
+		QCOMPARE(variant.runtime.seconds, 0);
+	}
+}
+
+void TestPlan::testPlanCheckpoints()
+{
+	setupPrefs();
+	prefs.unit_system = METRIC;
+	prefs.units.length = units::METERS;
+	prefs.planner_deco_mode = BUEHLMANN;
+
+	dive.clear();
+	plan_checkpoints checkpoints;
+	{
+		deco_state_cache cache;
+		struct deco_state ds;
+		auto testPlan = setupPlanVpmbMultiLevelAir();
+		plan(&ds, testPlan, &dive, 0, 60, cache, true, false, &checkpoints);
+	}
+	QVERIFY(!checkpoints.segments.empty());
+
+	// move the last waypoint deeper: replanning from the checkpoints must
+	// give the same result as planning from scratch
+	auto moved = setupPlanVpmbMultiLevelAir();
+	moved.dp.back().depth = 65_m;
+	auto reference = moved;
+
+	deco_state_cache cache_checkpointed, cache_reference;
+	struct deco_state ds_checkpointed, ds_reference;
+	plan(&ds_checkpointed, moved, &dive, 0, 60, cache_checkpointed, true, false, &checkpoints);
+	int runtime = dive.dcs[0].duration.seconds;
+	plan(&ds_reference, reference, &dive, 0, 60, cache_reference, true, false);
+	QCOMPARE(runtime, dive.dcs[0].duration.seconds);
+	for (int ci = 0; ci < 16; ci++) {
+		QCOMPARE(ds_checkpointed.tissue_n2_sat[ci], ds_reference.tissue_n2_sat[ci]);
+		QCOMPARE(ds_checkpointed.tissue_he_sat[ci], ds_reference.tissue_he_sat[ci]);
+	}
+}
+
+void TestPlan::testLinearSegment()
+{
+	setupPrefs();
+	prefs.planner_deco_mode = BUEHLMANN;
+	struct gasmix trimix = { 18_percent, 35_percent };
+
+	// a descent to 40m and an ascent to 6m in one step each, against the same
+	// segments cut into steps of one second at the mean pressure of the step:
+	// the results agree within 0.1 mbar
+	for (auto [from, to]: { std::make_pair(1.013, 5.0), std::make_pair(5.0, 1.6) }) {
+		struct deco_state linear, steps;
+		clear_deco(&linear, 1.013, false);
+		add_segment(&linear, from, trimix, 20 * 60, 0, OC, prefs.bottomsac, false);
+		clear_deco(&steps, 1.013, false);
+		add_segment(&steps, from, trimix, 20 * 60, 0, OC, prefs.bottomsac, false);
+
+		add_linear_segment(&linear, from, to, trimix, 120, 0, OC, prefs.bottomsac, false);
+		for (int i = 0; i < 120; i++)
+			add_segment(&steps, from + (to - from) * (i + 0.5) / 120, trimix, 1, 0, OC, prefs.bottomsac, false);
+		for (int ci = 0; ci < 16; ci++) {
+			QVERIFY(fabs(linear.tissue_n2_sat[ci] - steps.tissue_n2_sat[ci]) < 1e-4);
+			QVERIFY(fabs(linear.tissue_he_sat[ci] - steps.tissue_he_sat[ci]) < 1e-4);
+		}
+	}
+
+	// at constant pressure, it is the same as a plain segment
+	struct deco_state linear, flat;
+	clear_deco(&linear, 1.013, false);
+	clear_deco(&flat, 1.013, false);
+	add_linear_segment(&linear, 3.0, 3.0, trimix, 300, 0, OC, prefs.bottomsac, false);
+	add_segment(&flat, 3.0, trimix, 300, 0, OC, prefs.bottomsac, false);
+	for (int ci = 0; ci < 16; ci++)
+		QCOMPARE(linear.tissue_n2_sat[ci], flat.tissue_n2_sat[ci]);
+}
+
 QTEST_GUILESS_MAIN(TestPlan)
@@ -20,6 +20,9 @@ private slots:
 	void testVpmbMetricRepeat();
 	void testMultipleGases();
 	void testCcrBailoutGasSelection();
+	void testPlanVariants();
+	void testPlanCheckpoints();
+	void testLinearSegment();
 };
 
 #endif // TESTPLAN_H
@@ -11,6 +11,15 @@ private slots:
 	void init();
 	void testProfileExport();
 	void testProfileExportVPMB();
+	void testProfileExportCached();
+	void testPlotInfoCached();
+	void testPlotInfoChannels();
+	void testPlotInfoRequestedChannels();
+	void testPlotDetails();
+	void testCreatePlotInfos();
+	void testTimeline();
+	void testRangeIndex();
+	void testCcrPo2Consensus();
 };
 
 #endif
@@ -5,6 +5,7 @@
 #include "core/qthelper.h"
 #include "core/settings/qPrefGeneral.h"
 #include "core/settings/qPref.h"
+#include "core/subsurface-qt/divelistnotifier.h"
 
 #include <QTest>
 #include <QSignalSpy>
@@ -158,4 +159,44 @@ void TestQPrefGeneral::test_signals()
 	qPrefGeneral::set_diveshareExport_private(false);
 }
 
+void TestQPrefGeneral::test_transaction()
+{
+	qPrefGeneral::set_defaultsetpoint(10);
+	qPrefGeneral::set_o2consumption(10);
+
+	QSignalSpy spy(&diveListNotifier, &DiveListNotifier::settingsChanged);
+	QSignalSpy spy5(qPrefGeneral::instance(), &qPrefGeneral::defaultsetpointChanged);
+	{
+		qPrefTransaction transaction;
+		QVERIFY(qPrefTransaction::active());
+		qPrefGeneral::set_defaultsetpoint(11);
+		{
+			qPrefTransaction nested;
+			qPrefGeneral::set_o2consumption(12);
+		}
+		QCOMPARE(spy.count(), 0);
+		QCOMPARE(spy5.count(), 1);
+	}
+	QVERIFY(!qPrefTransaction::active());
+	QCOMPARE(spy.count(), 1);
+
+	// the values were written to disk
+	prefs.defaultsetpoint = 0;
+	prefs.o2consumption = 0;
+	qPrefGeneral::load();
+	QCOMPARE(prefs.defaultsetpoint, 11);
+	QCOMPARE(prefs.o2consumption, 12);
+
+	// nothing changed: no notification
+	{
+		qPrefTransaction transaction;
+		qPrefGeneral::set_defaultsetpoint(11);
+	}
+	QCOMPARE(spy.count(), 1);
+
+	// loading doesn't notify
+	qPref::load();
+	QCOMPARE(spy.count(), 1);
+}
+
 QTEST_MAIN(TestQPrefGeneral)
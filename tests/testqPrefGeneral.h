@@ -16,6 +16,7 @@ private slots:
 	void test_multiple();
 	void test_oldPreferences();
 	void test_signals();
+	void test_transaction();
 };
 
 #endif // TESTQPREFGENERAL_H
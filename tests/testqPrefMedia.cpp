@@ -27,11 +27,13 @@ void TestQPrefMedia::test_struct_get()
 	prefs.extract_video_thumbnails = true;
 	prefs.extract_video_thumbnails_position = 15;
 	prefs.ffmpeg_executable = "new base16";
+	prefs.thumbnail_cache_size = 16;
 
 	QCOMPARE(tst->auto_recalculate_thumbnails(), prefs.auto_recalculate_thumbnails);
 	QCOMPARE(tst->extract_video_thumbnails(), prefs.extract_video_thumbnails);
 	QCOMPARE(tst->extract_video_thumbnails_position(), prefs.extract_video_thumbnails_position);
 	QCOMPARE(tst->ffmpeg_executable(), QString::fromStdString(prefs.ffmpeg_executable));
+	QCOMPARE(tst->thumbnail_cache_size(), prefs.thumbnail_cache_size);
 }
 
 void TestQPrefMedia::test_set_struct()
@@ -44,11 +46,13 @@ void TestQPrefMedia::test_set_struct()
 	tst->set_extract_video_thumbnails(false);
 	tst->set_extract_video_thumbnails_position(25);
 	tst->set_ffmpeg_executable("new base26");
+	tst->set_thumbnail_cache_size(26);
 
 	QCOMPARE(prefs.auto_recalculate_thumbnails, false);
 	QCOMPARE(prefs.extract_video_thumbnails, false);
 	QCOMPARE(prefs.extract_video_thumbnails_position, 25);
 	QCOMPARE(QString::fromStdString(prefs.ffmpeg_executable), QString("new base26"));
+	QCOMPARE(prefs.thumbnail_cache_size, 26);
 }
 
 void TestQPrefMedia::test_set_load_struct()
@@ -61,17 +65,20 @@ void TestQPrefMedia::test_set_load_struct()
 	tst->set_extract_video_thumbnails(true);
 	tst->set_extract_video_thumbnails_position(35);
 	tst->set_ffmpeg_executable("new base36");
+	tst->set_thumbnail_cache_size(36);
 
 	prefs.auto_recalculate_thumbnails = false;
 	prefs.extract_video_thumbnails = false;
 	prefs.extract_video_thumbnails_position = 15;
 	prefs.ffmpeg_executable = "error";
+	prefs.thumbnail_cache_size = 1;
 
 	tst->load();
 	QCOMPARE(prefs.auto_recalculate_thumbnails, true);
 	QCOMPARE(prefs.extract_video_thumbnails, true);
 	QCOMPARE(prefs.extract_video_thumbnails_position, 35);
 	QCOMPARE(QString::fromStdString(prefs.ffmpeg_executable), QString("new base36"));
+	QCOMPARE(prefs.thumbnail_cache_size, 36);
 }
 
 void TestQPrefMedia::test_struct_disk()
@@ -84,18 +91,21 @@ void TestQPrefMedia::test_struct_disk()
 	prefs.extract_video_thumbnails = true;
 	prefs.extract_video_thumbnails_position = 45;
 	prefs.ffmpeg_executable = "base46";
+	prefs.thumbnail_cache_size = 46;
 
 	tst->sync();
 	prefs.auto_recalculate_thumbnails = false;
 	prefs.extract_video_thumbnails = false;
 	prefs.extract_video_thumbnails_position = 15;
 	prefs.ffmpeg_executable = "error";
+	prefs.thumbnail_cache_size = 1;
 
 	tst->load();
 	QCOMPARE(prefs.auto_recalculate_thumbnails, true);
 	QCOMPARE(prefs.extract_video_thumbnails, true);
 	QCOMPARE(prefs.extract_video_thumbnails_position, 45);
 	QCOMPARE(QString::fromStdString(prefs.ffmpeg_executable), QString("base46"));
+	QCOMPARE(prefs.thumbnail_cache_size, 46);
 }
 
 #define TEST(METHOD, VALUE)      \
@@ -3,6 +3,8 @@
 #include "core/dive.h"
 #include "core/tag.h"
 
+#include <algorithm>
+
 void TestTagList::initTestCase()
 {
 	taglist_init_global();
@@ -99,4 +101,49 @@ void TestTagList::testMergeTags()
 			 "A new tag 6"));
 }
 
+void TestTagList::testTagSets()
+{
+	// Enough tags to need the overflow words of the tag sets
+	tag_list tags1, tags2, cleaned;
+	for (int i = 0; i < 150; ++i) {
+		std::string tag = "set tag " + std::to_string(i);
+		if (i % 2 == 0)
+			taglist_add_tag(tags1, tag);
+		if (i % 3 == 0)
+			taglist_add_tag(tags2, tag);
+	}
+	taglist_add_tag(tags1, "set tag 0");
+	QCOMPARE(tags1.size(), (size_t)75);
+	QCOMPARE(tags2.size(), (size_t)50);
+	QVERIFY(tags1.bits().intersects(tags2.bits()));
+
+	tag_list merged = taglist_merge(tags1, tags2);
+	QCOMPARE(merged.size(), (size_t)100);
+	for (const std::unique_ptr<divetag> &tag: g_tag_list) {
+		QCOMPARE(merged.contains(tag.get()), tags1.contains(tag.get()) || tags2.contains(tag.get()));
+		QCOMPARE(merged.bits().test(tag->index), merged.contains(tag.get()));
+	}
+	QVERIFY(std::is_sorted(merged.begin(), merged.end(),
+			       [](const divetag *t1, const divetag *t2) { return t1->name < t2->name; }));
+
+	// Indices are dense and unique
+	std::vector<int> indices;
+	for (const std::unique_ptr<divetag> &tag: g_tag_list)
+		indices.push_back(tag->index);
+	std::sort(indices.begin(), indices.end());
+	for (size_t i = 0; i < indices.size(); ++i)
+		QCOMPARE(indices[i], (int)i);
+
+	taglist_add_tag(cleaned, "set tag 149");
+	QVERIFY(!cleaned.bits().intersects(tags1.bits()));
+	taglist_add_tag(cleaned, "");
+	taglist_add_tag(cleaned, "set tag 148");
+	taglist_cleanup(cleaned);
+	QCOMPARE(QString::fromStdString(taglist_get_tagstring(cleaned)), QString("set tag 148, set tag 149"));
+	QVERIFY(cleaned.bits().intersects(tags1.bits()));
+	cleaned.clear();
+	QVERIFY(cleaned.empty());
+	QVERIFY(cleaned.bits().empty());
+}
+
 QTEST_GUILESS_MAIN(TestTagList)
@@ -16,6 +16,7 @@ private slots:
 	void testGetTagstringWithAnEmptyTag();
 	void testGetTagstringEmptyTagOnly();
 	void testMergeTags();
+	void testTagSets();
 };
 
 #endif
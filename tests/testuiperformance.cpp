@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "testuiperformance.h"
+#include "desktop-widgets/divelistview.h"
+#include "desktop-widgets/statswidget.h"
+#include "profile-widget/profilewidget2.h"
+#include "core/dive.h"
+#include "core/divefilter.h"
+#include "core/divelog.h"
+#include "core/errorhelper.h"
+#include "core/file.h"
+#include "core/fulltext.h"
+#include "core/pref.h"
+#include "core/version.h"
+#include <QAbstractEventDispatcher>
+#include <QComboBox>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <algorithm>
+#include <functional>
+#include "QTextCodec"
+
+/*
+ * Each scenario scripts a sequence of steps. A step is an action, the
+ * events it posted and a synchronous repaint of the widget. Its duration
+ * is the frame time. The part after the action, during which the event
+ * loop is busy with the consequences of the action, is the stall time.
+ *
+ * The test fails if the 95th percentile of the frame times is more than
+ * the budget. The budget is SUBSURFACE_FRAME_BUDGET_MS (default 100 ms),
+ * or, if SUBSURFACE_FRAME_BASELINE names the output of a previous run,
+ * the p95 of that run plus SUBSURFACE_FRAME_TOLERANCE percent (default 25).
+ * If SUBSURFACE_BENCH_OUTPUT is set, the results are written to that file
+ * as JSON (see the subsurface-ui-bench target).
+ */
+static QJsonArray benchmark_results;
+static QJsonObject baseline;
+
+static double env_double(const char *name, double def)
+{
+	bool ok;
+	double res = qEnvironmentVariable(name).toDouble(&ok);
+	return ok ? res : def;
+}
+
+class FrameRecorder {
+public:
+	void step(QWidget *widget, const std::function<void()> &action)
+	{
+		QElapsedTimer timer;
+		timer.start();
+		action();
+		qint64 actionDone = timer.nsecsElapsed();
+		QCoreApplication::processEvents();
+		widget->repaint();
+		qint64 done = timer.nsecsElapsed();
+		frames.push_back(done);
+		stalls.push_back(done - actionDone);
+	}
+	// Reports the results and checks the p95 frame time against the budget
+	void finish()
+	{
+		QVERIFY(!frames.empty());
+		std::sort(frames.begin(), frames.end());
+		std::sort(stalls.begin(), stalls.end());
+		QString name = QTest::currentTestFunction();
+		double p95 = ms(quantile(frames, 0.95));
+
+		QJsonObject result;
+		result["name"] = name;
+		result["frames"] = (int)frames.size();
+		result["frame_p50_ms"] = ms(quantile(frames, 0.5));
+		result["frame_p95_ms"] = p95;
+		result["frame_max_ms"] = ms(frames.back());
+		result["stall_p95_ms"] = ms(quantile(stalls, 0.95));
+		result["stall_max_ms"] = ms(stalls.back());
+		benchmark_results.append(result);
+		report_info("%s: %d frames, p50 %.1f ms, p95 %.1f ms, max %.1f ms, longest stall %.1f ms",
+			    qPrintable(name), (int)frames.size(), ms(quantile(frames, 0.5)), p95,
+			    ms(frames.back()), ms(stalls.back()));
+
+		double budget = env_double("SUBSURFACE_FRAME_BUDGET_MS", 100.0);
+		for (const QJsonValue &v: baseline["benchmarks"].toArray()) {
+			QJsonObject old = v.toObject();
+			if (old["name"].toString() == name)
+				budget = old["frame_p95_ms"].toDouble() * (1.0 + env_double("SUBSURFACE_FRAME_TOLERANCE", 25.0) / 100.0);
+		}
+		QVERIFY2(p95 <= budget, qPrintable(QString("p95 frame time %1 ms exceeds %2 ms").arg(p95).arg(budget)));
+	}
+private:
+	static qint64 quantile(const std::vector<qint64> &sorted, double q)
+	{
+		return sorted[std::min(sorted.size() - 1, (size_t)(q * (double)sorted.size()))];
+	}
+	static double ms(qint64 ns)
+	{
+		return (double)ns / 1e6;
+	}
+	std::vector<qint64> frames, stalls;	// in ns
+};
+
+// Use the large anonymous log if it is there and fall back to the test data
+static QString benchmark_source()
+{
+	QString source = SUBSURFACE_TEST_DATA "/dives/large-anon.ssrf";
+	if (!QFile::exists(source))
+		source = SUBSURFACE_TEST_DATA "/dives/SampleDivesV2.ssrf";
+	return source;
+}
+
+void TestUiPerformance::initTestCase()
+{
+	/* we need to manually tell that the resource exists, because we are using it as library. */
+	Q_INIT_RESOURCE(subsurface);
+
+	// Set UTF8 text codec as in real applications
+	QTextCodec::setCodecForLocale(QTextCodec::codecForMib(106));
+
+	prefs = default_prefs;
+	QCoreApplication::setOrganizationName("Subsurface");
+	QCoreApplication::setOrganizationDomain("subsurface.hohndel.org");
+	QCoreApplication::setApplicationName("SubsurfaceUiPerformance");
+
+	QByteArray baselineFile = qgetenv("SUBSURFACE_FRAME_BASELINE");
+	if (!baselineFile.isEmpty()) {
+		QFile f(QString::fromLocal8Bit(baselineFile));
+		QVERIFY(f.open(QFile::ReadOnly));
+		baseline = QJsonDocument::fromJson(f.readAll()).object();
+	}
+
+	QCOMPARE(parse_file(qPrintable(benchmark_source()), &divelog), 0);
+	divelog.process_loaded_dives();
+	fulltext_populate();
+}
+
+void TestUiPerformance::cleanupTestCase()
+{
+	fulltext_unregister_all();
+	clear_dive_file_data();
+
+	QByteArray output = qgetenv("SUBSURFACE_BENCH_OUTPUT");
+	if (output.isEmpty())
+		return;
+
+	QJsonObject root;
+	root["version"] = QString(subsurface_git_version());
+	root["benchmarks"] = benchmark_results;
+	QFile file(QString::fromLocal8Bit(output));
+	QVERIFY(file.open(QFile::WriteOnly | QFile::Truncate));
+	QVERIFY(file.write(QJsonDocument(root).toJson()) >= 0);
+}
+
+void TestUiPerformance::scrollDiveList()
+{
+	DiveListView diveList;
+	diveList.resize(1000, 700);
+	diveList.show();
+	diveList.reload();
+	diveList.expandAll();
+	QVERIFY(QTest::qWaitForWindowExposed(&diveList));
+
+	QScrollBar *bar = diveList.verticalScrollBar();
+	FrameRecorder recorder;
+	for (int pos = bar->minimum(); pos <= bar->maximum(); pos += std::max(bar->pageStep(), 1))
+		recorder.step(diveList.viewport(), [bar, pos]() { bar->setValue(pos); });
+	recorder.step(diveList.viewport(), [bar]() { bar->setValue(bar->minimum()); });
+	recorder.finish();
+}
+
+void TestUiPerformance::switchProfileDives()
+{
+	ProfileWidget2 profile(nullptr, 1.0);
+	profile.resize(1000, 600);
+	profile.show();
+	QVERIFY(QTest::qWaitForWindowExposed(&profile));
+
+	// as when going through the dive list with the cursor keys
+	FrameRecorder recorder;
+	size_t count = std::min(divelog.dives.size(), (size_t)500);
+	for (size_t i = 0; i < count; ++i) {
+		const dive *d = divelog.dives[i].get();
+		recorder.step(profile.viewport(), [&profile, d]() { profile.plotDive(d, 0); });
+	}
+	recorder.finish();
+}
+
+static void sendWheel(QWidget *w, QPoint angleDelta)
+{
+	QPointF pos(w->width() / 2, w->height() / 2);
+	QWheelEvent event(pos, w->mapToGlobal(pos.toPoint()), QPoint(), angleDelta,
+			  Qt::NoButton, Qt::NoModifier, Qt::NoScrollPhase, false);
+	QCoreApplication::sendEvent(w, &event);
+}
+
+void TestUiPerformance::zoomPanProfile()
+{
+	QVERIFY(!divelog.dives.empty());
+	// the dive with the most samples is the slowest to zoom and pan
+	auto it = std::max_element(divelog.dives.begin(), divelog.dives.end(),
+				   [](const auto &d1, const auto &d2) { return d1->dcs[0].samples.size() < d2->dcs[0].samples.size(); });
+
+	ProfileWidget2 profile(nullptr, 1.0);
+	profile.resize(1000, 600);
+	profile.show();
+	QVERIFY(QTest::qWaitForWindowExposed(&profile));
+	profile.plotDive(it->get(), 0);
+
+	QWidget *viewport = profile.viewport();
+	FrameRecorder recorder;
+	for (int i = 0; i < 10; ++i)
+		recorder.step(viewport, [viewport]() { sendWheel(viewport, QPoint(0, 120)); });
+	for (int i = 0; i < 20; ++i)
+		recorder.step(viewport, [viewport]() { sendWheel(viewport, QPoint(-120, 0)); });
+	for (int i = 0; i < 20; ++i)
+		recorder.step(viewport, [viewport]() { sendWheel(viewport, QPoint(120, 0)); });
+	for (int i = 0; i < 10; ++i)
+		recorder.step(viewport, [viewport]() { sendWheel(viewport, QPoint(0, -120)); });
+	recorder.finish();
+}
+
+void TestUiPerformance::changeFilterText()
+{
+	DiveListView diveList;
+	diveList.resize(1000, 700);
+	diveList.show();
+	diveList.reload();
+	QVERIFY(QTest::qWaitForWindowExposed(&diveList));
+
+	// typing, deleting and typing again, one key at a time
+	QString text = QStringLiteral("reef wall");
+	FrameRecorder recorder;
+	auto setText = [](const QString &s) {
+		FilterData data;
+		data.fullText = s;
+		DiveFilter::instance()->setFilter(data);
+	};
+	for (int len = 1; len <= text.size(); ++len)
+		recorder.step(diveList.viewport(), [&]() { setText(text.left(len)); });
+	for (int len = text.size() - 1; len >= 0; --len)
+		recorder.step(diveList.viewport(), [&]() { setText(text.left(len)); });
+	recorder.finish();
+}
+
+void TestUiPerformance::cycleStatsCharts()
+{
+	StatsWidget stats;
+	stats.resize(1000, 700);
+	stats.show();
+	QVERIFY(QTest::qWaitForWindowExposed(&stats));
+
+	QComboBox *chartType = stats.findChild<QComboBox *>("chartType");
+	QVERIFY(chartType);
+	FrameRecorder recorder;
+	for (int i = 0; i < chartType->count(); ++i) {
+		recorder.step(&stats, [chartType, i]() {
+			chartType->setCurrentIndex(i);
+			emit chartType->activated(i);
+		});
+	}
+	recorder.finish();
+}
+
+QTEST_MAIN(TestUiPerformance)
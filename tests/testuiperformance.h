@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef TESTUIPERFORMANCE_H
+#define TESTUIPERFORMANCE_H
+
+#include <QtTest>
+
+class TestUiPerformance : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void scrollDiveList();
+	void switchProfileDives();
+	void zoomPanProfile();
+	void changeFilterText();
+	void cycleStatsCharts();
+};
+
+#endif
@@ -1,7 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "testunitconversion.h"
 #include "core/dive.h"
+#include "core/membuffer.h"
 #include "core/subsurface-float.h"
+#include "core/subsurface-string.h"
+#include "core/subsurface-time.h"
+
+#include <cmath>
 
 void TestUnitConversion::testUnitConversions()
 {
@@ -23,4 +28,125 @@ void TestUnitConversion::testUnitConversions()
 	QCOMPARE(nearly_equal(mbar_to_PSI(1013), 14.6923228594), true);
 }
 
+void TestUnitConversion::testStrtod()
+{
+	const char *end;
+
+	QVERIFY(ascii_strtod("12.345 m", &end) == 12.345);
+	QCOMPARE(*end, ' ');
+	QVERIFY(ascii_strtod("200.0bar", &end) == 200.0);
+	QCOMPARE(*end, 'b');
+	QVERIFY(ascii_strtod("-3.5", NULL) == -3.5);
+	QVERIFY(ascii_strtod(".5", NULL) == 0.5);
+	QVERIFY(ascii_strtod("1:23", &end) == 1.0);
+	QCOMPARE(*end, ':');
+	QVERIFY(ascii_strtod("1.5.3", &end) == 1.5);
+	QCOMPARE(*end, '.');
+	QVERIFY(ascii_strtod("1,5", &end) == 1.0);
+	QCOMPARE(*end, ',');
+	/* these are handled by the generic code */
+	QVERIFY(ascii_strtod(" 12.5", NULL) == 12.5);
+	QVERIFY(ascii_strtod("1.5e3", NULL) == 1500.0);
+	QCOMPARE(ascii_strtod("1234567890.1234567", NULL), 1234567890.1234567);
+	QVERIFY(permissive_strtod("1,5", NULL) == 1.5);
+	const char *none = "m";
+	QVERIFY(ascii_strtod(none, &end) == 0.0);
+	QCOMPARE(end, none);
+}
+
+void TestUnitConversion::testGasCompressibility()
+{
+	// The component polynomials, evaluated separately
+	auto reference = [](struct gasmix gas, double bar) {
+		static const double o2[3] = { -7.18092073703e-04, +2.81852572808e-06, -1.50290620492e-09 };
+		static const double n2[3] = { -2.19260353292e-04, +2.92844845532e-06, -2.07613482075e-09 };
+		static const double he[3] = { +4.87320026468e-04, -8.83632921053e-08, +5.33304543646e-11 };
+		auto virial = [bar](const double c[]) { return bar * c[0] + bar * bar * c[1] + bar * bar * bar * c[2]; };
+		int o = get_o2(gas), h = get_he(gas);
+		return (virial(o2) * o + virial(he) * h + virial(n2) * (1000 - o - h)) * 0.001 + 1.0;
+	};
+	for (struct gasmix gas: { gasmix_air, gasmix { 32_percent, 0_percent }, gasmix { 18_percent, 45_percent }, gasmix { 100_percent, 0_percent } }) {
+		gas_compressibility z(gas);
+		for (double bar: { 0.0, 1.0, 50.0, 200.0, 232.0, 300.0, 500.0 }) {
+			QVERIFY(fabs(z.factor(bar) - reference(gas, bar)) < 1e-12);
+			QCOMPARE(gas_compressibility_factor(gas, bar), z.factor(bar));
+		}
+		// Out of the fitted range, the pressure is clamped
+		QCOMPARE(z.factor(600.0), z.factor(500.0));
+		QCOMPARE(z.factor(-1.0), 1.0);
+	}
+	QVERIFY(fabs(gas_compressibility_factor(gasmix_air, 200.0) - 1.0359) < 0.001);
+}
+
+void TestUnitConversion::testCalendar()
+{
+	struct tm tm;
+
+	// 2024-02-29 13:14:15 UTC was a Thursday
+	utc_mkdate(1709212455, &tm);
+	QCOMPARE(tm.tm_year, 2024);
+	QCOMPARE(tm.tm_mon, 1);
+	QCOMPARE(tm.tm_mday, 29);
+	QCOMPARE(tm.tm_hour, 13);
+	QCOMPARE(tm.tm_min, 14);
+	QCOMPARE(tm.tm_sec, 15);
+	QCOMPARE(tm.tm_wday, 4);
+	QCOMPARE(utc_year(1709212455), 2024);
+	QCOMPARE(utc_weekday(1709212455), 4);
+
+	// Zero means "no date"
+	QCOMPARE(utc_year(0), 0);
+	QCOMPARE(utc_weekday(0), 0);
+
+	// Every day of a leap year and of the following common year round-trips
+	// and the shortcuts agree with the full conversion.
+	timestamp_t start = 1704067200;	// 2024-01-01 00:00:00 UTC
+	for (int day = 0; day < 366 + 365; ++day) {
+		timestamp_t when = start + day * 86400 + 43200;
+		utc_mkdate(when, &tm);
+		QCOMPARE(utc_mktime(&tm), when);
+		QCOMPARE(utc_year(when), tm.tm_year);
+		QCOMPARE(utc_weekday(when), tm.tm_wday);
+		QCOMPARE(tm.tm_year, day < 366 ? 2024 : 2025);
+	}
+	utc_mkdate(start + 365 * 86400, &tm);
+	QCOMPARE(tm.tm_mon, 11);
+	QCOMPARE(tm.tm_mday, 31);
+}
+
+static QString quoted(const char *text, int is_attribute, int is_html)
+{
+	membuffer b;
+	put_quoted(&b, text, is_attribute, is_html);
+	return QString::fromUtf8(b.buffer, b.len);
+}
+
+void TestUnitConversion::testQuoting()
+{
+	QCOMPARE(quoted("", 0, 0), QString());
+	QCOMPARE(quoted("plain text", 0, 0), QString("plain text"));
+	QCOMPARE(quoted("a<b>&'\"", 0, 0), QString("a&lt;b&gt;&amp;'\""));
+	QCOMPARE(quoted("a<b>&'\"", 1, 0), QString("a&lt;b&gt;&amp;&apos;&quot;"));
+	QCOMPARE(quoted("line\nline\ttab\x01", 0, 0), QString("line\nline\ttab?"));
+	QCOMPARE(quoted("line\nline", 1, 1), QString("line<br>line"));
+	QCOMPARE(quoted("Tauchgang \xc3\xbc<ber>", 0, 0), QString::fromUtf8("Tauchgang \xc3\xbc&lt;ber&gt;"));
+
+	// Long runs of safe characters with a special at every position
+	// relative to the (16 byte) blocks of the vectorized scan.
+	for (int len = 0; len < 40; ++len) {
+		for (int pos = 0; pos <= len; ++pos) {
+			std::string text(len, 'x');
+			QString expected = QString(len, 'x');
+			if (pos < len) {
+				text[pos] = '&';
+				expected.replace(pos, 1, "&amp;");
+			}
+			for (int offset = 0; offset < 16; ++offset) {
+				std::string shifted = std::string(offset, 'y') + text;
+				QCOMPARE(quoted(shifted.c_str() + offset, 1, 0), expected);
+			}
+		}
+	}
+}
+
 QTEST_GUILESS_MAIN(TestUnitConversion)
@@ -8,6 +8,10 @@ class TestUnitConversion : public QObject {
 	Q_OBJECT
 private slots:
 	void testUnitConversions();
+	void testStrtod();
+	void testGasCompressibility();
+	void testCalendar();
+	void testQuoting();
 };
 
 #endif